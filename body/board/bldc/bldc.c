@@ -85,8 +85,12 @@ static int32_t batVoltageFixdt  = (400 * BAT_CELLS * BAT_CALIB_ADC) / BAT_CALIB_
 int32_t motPosL = 0;
 int32_t motPosR = 0;
 
+volatile bldc_profile_t bldc_profile = { 0 };
+
 // DMA interrupt frequency =~ 16 kHz
 void DMA2_Stream0_IRQHandler(void) {
+  const uint32_t isr_start = DWT->CYCCNT;
+  uint32_t step_start;
   DMA2->LIFCR = DMA_LIFCR_CTCIF0;
 
   if(offsetcount < 2000) {  // calibrate ADC offsets
@@ -183,7 +187,9 @@ void DMA2_Stream0_IRQHandler(void) {
     rtU_Left.i_DCLink     = curL_DC;
 
     #ifdef MOTOR_LEFT_ENA
+    step_start = DWT->CYCCNT;
     BLDC_controller_step(rtM_Left);
+    bldc_profile.step_max[0] = MAX(bldc_profile.step_max[0], DWT->CYCCNT - step_start);
     #endif
 
     ul            = rtY_Left.DC_phaA;
@@ -213,7 +219,9 @@ void DMA2_Stream0_IRQHandler(void) {
     rtU_Right.i_DCLink      = curR_DC;
 
     #ifdef MOTOR_RIGHT_ENA
+    step_start = DWT->CYCCNT;
     BLDC_controller_step(rtM_Right);
+    bldc_profile.step_max[1] = MAX(bldc_profile.step_max[1], DWT->CYCCNT - step_start);
     #endif
 
     ur            = rtY_Right.DC_phaA;
@@ -267,4 +275,9 @@ void DMA2_Stream0_IRQHandler(void) {
   motAngleLeftLast = rtY_Left.a_elecAngle;
   motAngleRightLast = rtY_Right.a_elecAngle;
   cnt++;
+
+  const uint32_t isr_cycles = DWT->CYCCNT - isr_start;
+  bldc_profile.isr_sum += isr_cycles;
+  bldc_profile.isr_cnt++;
+  bldc_profile.isr_max = MAX(bldc_profile.isr_max, isr_cycles);
 }
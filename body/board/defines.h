@@ -185,4 +185,12 @@ typedef struct {
     uint8_t right_angle : 1;
 } fault_status_t;
 
+// DWT cycle counts of the motor control ISR, since the last MOTORS_PROFILE message
+typedef struct {
+  uint32_t isr_sum;
+  uint32_t isr_cnt;
+  uint32_t isr_max;
+  uint32_t step_max[2];  // BLDC_controller_step of the left and the right motor
+} bldc_profile_t;
+
 #endif // DEFINES_H
@@ -50,6 +50,8 @@ extern int16_t batVoltage;              // global variable for battery voltage
 extern int32_t motPosL;
 extern int32_t motPosR;
 
+extern volatile bldc_profile_t bldc_profile;
+
 extern board_t board;
 
 //------------------------------------------------------------------------
@@ -102,6 +104,11 @@ int main(void) {
   SystemClock_Config();
   MX_GPIO_Clocks_Init();
 
+  // cycle counter for the motor ISR profile
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   __HAL_RCC_DMA2_CLK_DISABLE();
 
   board_detect();
@@ -291,6 +298,12 @@ int main(void) {
       // runs at 10Hz
        if ((HAL_GetTick() - (main_loop_10Hz - main_loop_10Hz_runtime)) >= 100) {
         main_loop_10Hz_runtime = HAL_GetTick();
+        // taken every time, so a window is never longer than 100ms
+        __disable_irq();
+        bldc_profile_t profile = bldc_profile;
+        bldc_profile = (bldc_profile_t){ 0 };
+        __enable_irq();
+
         if (ignition_off_counter <= IGNITION_OFF_DELAY) {
           // VAR_VALUES: fault_status(0:4), enable_motors(0:1), ignition(0:1), left motor error(1), right motor error(1)
           uint8_t dat[2];
@@ -298,6 +311,23 @@ int main(void) {
           dat[1] = rtY_Left.z_errCode;
           dat[2] = rtY_Right.z_errCode;
           can_send_msg((0x202U + board.can_addr_offset), 0x0U, ((dat[2] << 16U) | (dat[1] << 8U) | dat[0]), 3U);
+
+          // MOTORS_PROFILE: isr avg cycles(2), isr max cycles(2), left step max cycles(2), right step max cycles(2)
+          // The budget is CORE_FREQ / PWM_FREQ cycles
+          uint16_t isr_avg = (profile.isr_cnt > 0U) ? MIN(profile.isr_sum / profile.isr_cnt, 0xFFFFU) : 0U;
+          uint16_t isr_max = MIN(profile.isr_max, 0xFFFFU);
+          uint16_t step_max_l = MIN(profile.step_max[0], 0xFFFFU);
+          uint16_t step_max_r = MIN(profile.step_max[1], 0xFFFFU);
+          uint8_t prof[8];
+          prof[0] = (isr_avg >> 8U) & 0xFFU;
+          prof[1] = isr_avg & 0xFFU;
+          prof[2] = (isr_max >> 8U) & 0xFFU;
+          prof[3] = isr_max & 0xFFU;
+          prof[4] = (step_max_l >> 8U) & 0xFFU;
+          prof[5] = step_max_l & 0xFFU;
+          prof[6] = (step_max_r >> 8U) & 0xFFU;
+          prof[7] = step_max_r & 0xFFU;
+          can_send_msg((0x208U + board.can_addr_offset), ((prof[7] << 24U) | (prof[6] << 16U) | (prof[5] << 8U) | prof[4]), ((prof[3] << 24U) | (prof[2] << 16U) | (prof[1] << 8U) | prof[0]), 8U);
         }
         out_enable(LED_GREEN, ignition);
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cereal/gen/cpp/log.capnp.h"
+
+// Plain structs of the fields hot consumers read, filled in one pass over a capnp Reader.
+// Every Reader access decodes and bounds checks its pointer again, these structs are
+// checked while they're filled and after that a field is a load. Pointers into the
+// message, like CanFrame::dat, are valid as long as the message is.
+//
+// A struct is generated from a list of (type, field, getter) for the Reader, add a field
+// to the list to have it decoded:
+//
+//   #define MY_FIELDS(X) X(float, vEgo, getVEgo) X(bool, standstill, getStandstill)
+//   CEREAL_LITE_STRUCT(CarStateLite, cereal::CarState, MY_FIELDS)
+//
+// which declares CarStateLite with the fields and cereal_lite::decode(reader, out).
+
+#define CEREAL_LITE_FIELD(type, name, getter) type name;
+#define CEREAL_LITE_DECODE(type, name, getter) out.name = reader.getter();
+
+#define CEREAL_LITE_STRUCT(lite, capnp_struct, FIELDS)                          \
+  struct lite {                                                                 \
+    FIELDS(CEREAL_LITE_FIELD)                                                   \
+  };                                                                            \
+  namespace cereal_lite {                                                       \
+  inline void decode(const capnp_struct::Reader &reader, lite &out) {           \
+    FIELDS(CEREAL_LITE_DECODE)                                                  \
+  }                                                                             \
+  }
+
+#define CEREAL_LITE_CAN_FIELDS(X) \
+  X(uint32_t, address, getAddress) \
+  X(uint16_t, busTime, getBusTime) \
+  X(uint8_t, src, getSrc)
+
+// without dat, which isn't a scalar
+CEREAL_LITE_STRUCT(CanHeader, cereal::CanData, CEREAL_LITE_CAN_FIELDS)
+
+struct CanFrame : CanHeader {
+  const uint8_t *dat;
+  uint32_t size;
+};
+
+// With BOARDD_CAN_BUS_INDEX boardd groups the frames of a can message by src and puts a
+// bus index in front: a frame with CAN_BUS_INDEX_ADDRESS and CAN_BUS_INDEX_SRC, and in
+// its dat for every bus in the message its src and a little endian uint16 count, in the
+// order of the groups. A consumer of one bus reads only that bus's frames. Anything
+// that doesn't know about the index sees a frame on a bus that doesn't exist
+#define CAN_BUS_INDEX_ADDRESS 0xFFFFFFFFU
+#define CAN_BUS_INDEX_SRC 255
+
+namespace cereal_lite {
+
+// [begin, end) of the frames of bus, empty if it has none. False if the message has no
+// index, or one that doesn't add up, then every frame has to be looked at
+inline bool bus_index_range(const capnp::List<cereal::CanData>::Reader &cans, int bus, uint32_t &begin, uint32_t &end) {
+  if (cans.size() == 0) return false;
+  const auto index = cans[0];
+  if (index.getAddress() != CAN_BUS_INDEX_ADDRESS || index.getSrc() != CAN_BUS_INDEX_SRC) return false;
+
+  const auto dat = index.getDat();
+  if (dat.size() % 3 != 0) return false;
+  uint32_t pos = 1;
+  begin = end = pos;
+  for (size_t i = 0; i < dat.size(); i += 3) {
+    const uint32_t count = dat[i + 1] | (dat[i + 2] << 8);
+    if (dat[i] == bus) {
+      begin = pos;
+      end = pos + count;
+    }
+    pos += count;
+  }
+  return pos == cans.size();
+}
+
+// only the frames from bus if it's given, the others cost a read of src, or nothing with
+// a bus index
+inline void decode(const capnp::List<cereal::CanData>::Reader &cans, std::vector<CanFrame> &out, int bus = -1) {
+  uint32_t begin = 0, end = cans.size();
+  uint32_t bus_begin, bus_end;
+  if (bus_index_range(cans, bus, bus_begin, bus_end)) {
+    begin = bus >= 0 ? bus_begin : 1;
+    end = bus >= 0 ? bus_end : end;
+  }
+
+  out.clear();
+  out.reserve(end - begin);
+  for (uint32_t i = begin; i < end; i++) {
+    const auto c = cans[i];
+    if (bus >= 0 && c.getSrc() != bus) continue;
+    CanFrame &f = out.emplace_back();
+    decode(c, static_cast<CanHeader &>(f));
+    const auto dat = c.getDat();
+    f.dat = dat.begin();
+    f.size = dat.size();
+  }
+}
+
+}  // namespace cereal_lite
@@ -1,6 +1,7 @@
 # must be built with scons
 from .messaging_pyx import Context, Poller, SubSocket, PubSocket, SocketEventHandle, toggle_fake_events, \
-                                set_fake_prefix, get_fake_prefix, delete_fake_prefix, wait_for_one_event
+                                set_fake_prefix, get_fake_prefix, delete_fake_prefix, wait_for_one_event, \
+                                SimulatedClock, toggle_sim_time
 from .messaging_pyx import MultiplePublishersError, MessagingError
 
 import os
@@ -20,6 +21,8 @@ assert set_fake_prefix
 assert get_fake_prefix
 assert delete_fake_prefix
 assert wait_for_one_event
+assert SimulatedClock
+assert toggle_sim_time
 
 NO_TRAVERSAL_LIMIT = 2**64-1
 AVG_FREQ_HISTORY = 100
@@ -36,6 +39,10 @@ def fake_event_handle(endpoint: str, identifier: Optional[str] = None, override:
   return handle
 
 
+def simulated_clock(identifier: Optional[str] = None, start_nanos: int = 0) -> SimulatedClock:
+  return SimulatedClock(identifier or get_fake_prefix(), start_nanos)
+
+
 def log_from_bytes(dat: bytes) -> capnp.lib.capnp._DynamicStructReader:
   with log.Event.from_bytes(dat, traversal_limit_in_words=NO_TRAVERSAL_LIMIT) as msg:
     return msg
@@ -1,9 +1,17 @@
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
+
+#include <zstd.h>
 
 typedef void (*sighandler_t)(int sig);
 
@@ -34,11 +42,201 @@ static std::vector<std::string> get_services(std::string whitelist_str, bool zmq
   return service_list;
 }
 
+// Batched mode: all topics share one zmq socket. Every poll cycle is sent as one frame,
+// a BatchHeader followed by the (optionally zstd compressed) records: name length (uint16),
+// name, message size (uint32), message. Messages are forwarded as is, so logMonoTime is preserved.
+const uint32_t BATCH_MAGIC = 0x62726467;  // "brdg"
+const size_t MAX_BATCH_SIZE = 4 * 1024 * 1024;
+
+struct BatchHeader {
+  uint32_t magic;
+  uint32_t compressed;
+  uint32_t count;
+  uint32_t raw_size;
+};
+
+static void append_record(std::string &batch, const std::string &name, const char *data, uint32_t size) {
+  uint16_t name_len = name.size();
+  batch.append((const char *)&name_len, sizeof(name_len));
+  batch.append(name);
+  batch.append((const char *)&size, sizeof(size));
+  batch.append(data, size);
+}
+
+// topics is a comma separated list of topic[:decimation], empty for all services
+static std::map<std::string, int> parse_topics(const std::string &topics) {
+  std::map<std::string, int> decimation;
+  std::stringstream ss(topics);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    size_t sep = item.find(':');
+    std::string name = item.substr(0, sep);
+    decimation[name] = (sep == std::string::npos) ? 1 : std::max(1, std::atoi(item.c_str() + sep + 1));
+  }
+  if (decimation.empty()) {
+    for (auto &name : get_services("", false)) decimation[name] = 1;
+  }
+  return decimation;
+}
+
+static int batch_sender(const std::string &port, const std::string &topics, bool compress) {
+  MSGQContext sub_context;
+  ZMQContext pub_context;
+  MSGQPoller poller;
+
+  ZMQPubSocket pub_sock;
+  if (pub_sock.connect(&pub_context, port, false) != 0) {
+    std::cerr << "Error, failed to bind port " << port << std::endl;
+    return 1;
+  }
+
+  struct Topic {
+    std::string name;
+    int decimation;
+    uint64_t counter;
+  };
+  std::map<SubSocket *, Topic> sub_topics;
+  for (auto &[name, decimation] : parse_topics(topics)) {
+    if (services.count(name) == 0) {
+      std::cerr << "Warning, " << name << " is not in service list." << std::endl;
+      continue;
+    }
+    SubSocket *sub_sock = new MSGQSubSocket();
+    sub_sock->connect(&sub_context, name, "127.0.0.1", false);
+    poller.registerSocket(sub_sock);
+    sub_topics[sub_sock] = {name, decimation, 0};
+  }
+
+  std::string batch, compressed;
+  std::vector<Message *> msgs;
+  uint32_t count = 0;
+
+  auto flush = [&]() {
+    if (count == 0) return;
+
+    BatchHeader header = {BATCH_MAGIC, compress, count, (uint32_t)batch.size()};
+    const std::string *payload = &batch;
+    if (compress) {
+      compressed.resize(sizeof(header) + ZSTD_compressBound(batch.size()));
+      size_t n = ZSTD_compress(compressed.data() + sizeof(header), compressed.size() - sizeof(header), batch.data(), batch.size(), 1);
+      assert(!ZSTD_isError(n));
+      compressed.resize(sizeof(header) + n);
+      memcpy(compressed.data(), &header, sizeof(header));
+      payload = &compressed;
+    } else {
+      batch.insert(0, (const char *)&header, sizeof(header));
+    }
+
+    int ret;
+    do {
+      ret = pub_sock.send((char *)payload->data(), payload->size());
+    } while (ret == -1 && errno == EINTR && !do_exit);
+
+    batch.clear();
+    count = 0;
+  };
+
+  while (!do_exit) {
+    for (auto sub_sock : poller.poll(100)) {
+      Topic &topic = sub_topics[sub_sock];
+
+      msgs.clear();
+      sub_sock->receiveMany(msgs, MAX_BATCH);
+      for (auto msg : msgs) {
+        if (topic.counter++ % topic.decimation == 0) {
+          append_record(batch, topic.name, msg->getData(), msg->getSize());
+          count++;
+        }
+        delete msg;
+      }
+
+      if (batch.size() >= MAX_BATCH_SIZE) flush();
+    }
+    flush();
+  }
+
+  for (auto &[sub_sock, _] : sub_topics) delete sub_sock;
+  return 0;
+}
+
+static int batch_receiver(const std::string &ip, const std::string &port) {
+  ZMQContext sub_context;
+  MSGQContext pub_context;
+
+  ZMQSubSocket sub_sock;
+  if (sub_sock.connect(&sub_context, port, ip, false, false) != 0) {
+    std::cerr << "Error, failed to connect to " << ip << ":" << port << std::endl;
+    return 1;
+  }
+  sub_sock.setTimeout(100);
+
+  std::map<std::string, PubSocket *> pub_socks;
+  std::string decompressed;
+  while (!do_exit) {
+    std::unique_ptr<Message> msg(sub_sock.receive());
+    if (!msg || msg->getSize() < sizeof(BatchHeader)) continue;
+
+    BatchHeader header;
+    memcpy(&header, msg->getData(), sizeof(header));
+    if (header.magic != BATCH_MAGIC) {
+      std::cerr << "Warning, dropping frame with bad magic" << std::endl;
+      continue;
+    }
+
+    const char *p = msg->getData() + sizeof(header);
+    const char *end = msg->getData() + msg->getSize();
+    if (header.compressed) {
+      decompressed.resize(header.raw_size);
+      size_t n = ZSTD_decompress(decompressed.data(), decompressed.size(), p, end - p);
+      if (ZSTD_isError(n) || n != header.raw_size) {
+        std::cerr << "Warning, dropping corrupt frame" << std::endl;
+        continue;
+      }
+      p = decompressed.data();
+      end = p + n;
+    }
+
+    for (uint32_t i = 0; i < header.count && p < end; i++) {
+      uint16_t name_len;
+      memcpy(&name_len, p, sizeof(name_len));
+      std::string name(p + sizeof(name_len), name_len);
+      p += sizeof(name_len) + name_len;
+
+      uint32_t size;
+      memcpy(&size, p, sizeof(size));
+      p += sizeof(size);
+      if (p + size > end) break;
+
+      PubSocket *&pub_sock = pub_socks[name];
+      if (pub_sock == nullptr) {
+        pub_sock = new MSGQPubSocket();
+        pub_sock->connect(&pub_context, name);
+      }
+      pub_sock->send((char *)p, size);
+      p += size;
+    }
+  }
+
+  for (auto &[_, pub_sock] : pub_socks) delete pub_sock;
+  return 0;
+}
+
 int main(int argc, char** argv) {
   signal(SIGPIPE, (sighandler_t)sigpipe_handler);
   signal(SIGINT, (sighandler_t)set_do_exit);
   signal(SIGTERM, (sighandler_t)set_do_exit);
 
+  // bridge --send <port> [topic[:decimation],...] [--zstd]
+  // bridge --recv <ip> <port>
+  if (argc > 2 && strcmp(argv[1], "--send") == 0) {
+    bool compress = strcmp(argv[argc - 1], "--zstd") == 0;
+    int nargs = argc - (compress ? 1 : 0);
+    return batch_sender(argv[2], nargs > 3 ? argv[3] : "", compress);
+  } else if (argc > 3 && strcmp(argv[1], "--recv") == 0) {
+    return batch_receiver(argv[2], argv[3]);
+  }
+
   bool zmq_to_msgq = argc > 2;
   std::string ip = zmq_to_msgq ? argv[1] : "127.0.0.1";
   std::string whitelist_str = zmq_to_msgq ? std::string(argv[2]) : "";
@@ -74,16 +272,19 @@ int main(int argc, char** argv) {
     sub2pub[sub_sock] = pub_sock;
   }
 
+  std::vector<Message *> msgs;
   while (!do_exit) {
     for (auto sub_sock : poller->poll(100)) {
-      Message * msg = sub_sock->receive();
-      if (msg == NULL) continue;
-      int ret;
-      do {
-        ret = sub2pub[sub_sock]->sendMessage(msg);
-      } while (ret == -1 && errno == EINTR && !do_exit);
-      assert(ret >= 0 || do_exit);
-      delete msg;
+      msgs.clear();
+      sub_sock->receiveMany(msgs, MAX_BATCH);
+      for (auto msg : msgs) {
+        int ret;
+        do {
+          ret = sub2pub[sub_sock]->sendMessage(msg);
+        } while (ret == -1 && errno == EINTR && !do_exit);
+        assert(ret >= 0 || do_exit);
+        delete msg;
+      }
 
       if (do_exit) break;
     }
@@ -18,7 +18,7 @@
 #ifndef __APPLE__
 #include <sys/eventfd.h>
 
-void event_state_shm_mmap(std::string endpoint, std::string identifier, char **shm_mem, std::string *shm_path) {
+void event_state_shm_mmap(std::string endpoint, std::string identifier, char **shm_mem, std::string *shm_path, size_t size) {
   const char* op_prefix = std::getenv("OPENPILOT_PREFIX");
 
   std::string full_path = "/dev/shm/";
@@ -37,15 +37,15 @@ void event_state_shm_mmap(std::string endpoint, std::string identifier, char **s
     throw std::runtime_error("Could not open shared memory file.");
   }
 
-  int rc = ftruncate(shm_fd, sizeof(EventState));
+  int rc = ftruncate(shm_fd, size);
   if (rc < 0){
     close(shm_fd);
     throw std::runtime_error("Could not truncate shared memory file.");
   }
 
-  char * mem = (char*)mmap(NULL, sizeof(EventState), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+  char * mem = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
   close(shm_fd);
-  if (mem == nullptr) {
+  if (mem == MAP_FAILED) {
     throw std::runtime_error("Could not map shared memory file.");
   }
 
@@ -113,6 +113,49 @@ std::string SocketEventHandle::fake_prefix() {
   }
 }
 
+SimulatedClock::SimulatedClock(std::string identifier, uint64_t start_nanos) {
+  char *mem;
+  event_state_shm_mmap(CEREAL_SIM_CLOCK, identifier, &mem, &this->shm_path, sizeof(SimClockState));
+
+  this->state = (SimClockState*)mem;
+  this->set(start_nanos);
+}
+
+SimulatedClock::~SimulatedClock() {
+  munmap(this->state, sizeof(SimClockState));
+  unlink(this->shm_path.c_str());
+}
+
+uint64_t SimulatedClock::nanos() const {
+  return this->state->nanos.load(std::memory_order_acquire);
+}
+
+void SimulatedClock::set(uint64_t nanos) {
+  this->state->nanos.store(nanos, std::memory_order_release);
+}
+
+void SimulatedClock::advance(uint64_t nanos) {
+  this->state->nanos.fetch_add(nanos, std::memory_order_acq_rel);
+}
+
+const SimClockState *SimulatedClock::current() {
+  // stays mapped for as long as the process runs, the driver's SimulatedClock removes the file
+  static const SimClockState *clock = []() -> const SimClockState * {
+    if (std::getenv("CEREAL_SIM_TIME") == nullptr) return nullptr;
+    char *mem;
+    event_state_shm_mmap(CEREAL_SIM_CLOCK, SocketEventHandle::fake_prefix(), &mem, nullptr, sizeof(SimClockState));
+    return (const SimClockState *)mem;
+  }();
+  return clock;
+}
+
+void SimulatedClock::toggle(bool enabled) {
+  if (enabled)
+    setenv("CEREAL_SIM_TIME", "1", true);
+  else
+    unsetenv("CEREAL_SIM_TIME");
+}
+
 Event::Event(int fd): event_fd(fd) {}
 
 void Event::set() const {
@@ -210,7 +253,7 @@ int Event::wait_for_one(const std::vector<Event>& events, int timeout_sec) {
 }
 #else
 // Stub implementation for Darwin, which does not support eventfd
-void event_state_shm_mmap(std::string endpoint, std::string identifier, char **shm_mem, std::string *shm_path) {}
+void event_state_shm_mmap(std::string endpoint, std::string identifier, char **shm_mem, std::string *shm_path, size_t size) {}
 
 SocketEventHandle::SocketEventHandle(std::string endpoint, std::string identifier, bool override) {
   std::cerr << "SocketEventHandle not supported on macOS" << std::endl;
@@ -225,6 +268,17 @@ void SocketEventHandle::toggle_fake_events(bool enabled) {}
 void SocketEventHandle::set_fake_prefix(std::string prefix) {}
 std::string SocketEventHandle::fake_prefix() { return ""; }
 
+SimulatedClock::SimulatedClock(std::string identifier, uint64_t start_nanos) {
+  std::cerr << "SimulatedClock not supported on macOS" << std::endl;
+  assert(false);
+}
+SimulatedClock::~SimulatedClock() {}
+uint64_t SimulatedClock::nanos() const { return 0; }
+void SimulatedClock::set(uint64_t nanos) {}
+void SimulatedClock::advance(uint64_t nanos) {}
+const SimClockState *SimulatedClock::current() { return nullptr; }
+void SimulatedClock::toggle(bool enabled) {}
+
 Event::Event(int fd): event_fd(fd) {}
 void Event::set() const {}
 int Event::clear() const { return 0; }
@@ -1,11 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 #define CEREAL_EVENTS_PREFIX std::string("cereal_events")
-
-void event_state_shm_mmap(std::string endpoint, std::string identifier, char **shm_mem, std::string *shm_path);
+#define CEREAL_SIM_CLOCK std::string("sim_clock")
 
 enum EventPurpose {
   RECV_CALLED,
@@ -17,6 +18,12 @@ struct EventState {
   bool enabled;
 };
 
+struct SimClockState {
+  std::atomic<uint64_t> nanos;
+};
+
+void event_state_shm_mmap(std::string endpoint, std::string identifier, char **shm_mem, std::string *shm_path, size_t size = sizeof(EventState));
+
 class Event {
 private:
   int event_fd = -1;
@@ -56,3 +63,25 @@ public:
   static void set_fake_prefix(std::string prefix);
   static std::string fake_prefix();
 };
+
+// The clock of a deterministic replay. The driver owns it and moves it forward between the
+// messages it feeds, daemons started with CEREAL_SIM_TIME take their boot time from it
+// instead of CLOCK_BOOTTIME: logMonoTime, SubMaster's receive times and, through
+// common/timing.h, nanos_since_boot() and RateKeeper, which doesn't sleep on it. It's mapped
+// from the fake events directory of the prefix, next to the socket events
+class SimulatedClock {
+private:
+  std::string shm_path;
+  SimClockState *state;
+public:
+  SimulatedClock(std::string identifier = "", uint64_t start_nanos = 0);
+  ~SimulatedClock();
+
+  uint64_t nanos() const;
+  void set(uint64_t nanos);
+  void advance(uint64_t nanos);
+
+  // the clock this process runs on, nullptr unless CEREAL_SIM_TIME is set
+  static const SimClockState *current();
+  static void toggle(bool enabled);
+};
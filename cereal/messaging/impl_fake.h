@@ -54,6 +54,24 @@ public:
 
     return TSubSocket::receive(non_blocking);
   }
+
+  kj::ArrayPtr<const capnp::word> receiveAligned(AlignedBuffer &buf, bool non_blocking=false) override {
+    if (this->state->enabled) {
+      this->recv_called->set();
+      this->recv_ready->wait();
+      this->recv_ready->clear();
+    }
+
+    return TSubSocket::receiveAligned(buf, non_blocking);
+  }
+
+  size_t receiveMany(std::vector<Message *> &messages, size_t max_count) override {
+    // Keep the per message handshake when faking
+    if (this->state->enabled) {
+      return SubSocket::receiveMany(messages, max_count);
+    }
+    return TSubSocket::receiveMany(messages, max_count);
+  }
 };
 
 class FakePoller: public Poller {
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "cereal/services.h"
+#include "cereal/messaging/impl_local.h"
+
+// while local and other sockets are polled together, how long the other poller gets at a time
+const int MIXED_POLL_SLICE_MS = 5;
+
+// The subscribers of a service. The lock is only taken by publishers and by sockets that
+// connect or go away, a receive doesn't touch it
+struct LocalEndpoint {
+  std::mutex lock;
+  std::vector<LocalSubSocket *> subscribers;
+};
+
+static LocalEndpoint *local_endpoint(const std::string &endpoint) {
+  static std::mutex lock;
+  static std::unordered_map<std::string, std::unique_ptr<LocalEndpoint>> endpoints;
+
+  std::lock_guard lk(lock);
+  auto &ep = endpoints[endpoint];
+  if (!ep) ep = std::make_unique<LocalEndpoint>();
+  return ep.get();
+}
+
+static const std::vector<std::string> &local_services() {
+  static const std::vector<std::string> list = [] {
+    std::vector<std::string> ret;
+    const char *env = std::getenv("CEREAL_INPROC");
+    std::stringstream ss(env ? env : "");
+    for (std::string s; std::getline(ss, s, ',');) {
+      if (!s.empty()) ret.push_back(s);
+    }
+    return ret;
+  }();
+  return list;
+}
+
+bool messaging_use_local() {
+  return !local_services().empty();
+}
+
+bool messaging_use_local(const std::string &endpoint) {
+  auto &list = local_services();
+  return std::any_of(list.begin(), list.end(), [&](auto &s) { return s == "*" || s == endpoint; });
+}
+
+static std::shared_ptr<LocalBuffer> local_buffer(size_t size) {
+  auto buf = std::make_shared<LocalBuffer>();
+  buf->words = kj::heapArray<capnp::word>(size / sizeof(capnp::word) + 1);
+  memset(buf->words.begin(), 0, buf->words.size() * sizeof(capnp::word));
+  buf->size = size;
+  return buf;
+}
+
+void LocalMessage::init(size_t size) {
+  buf = local_buffer(size);
+}
+
+void LocalMessage::init(char *data, size_t size) {
+  auto b = local_buffer(size);
+  memcpy(b->words.begin(), data, size);
+  buf = std::move(b);
+}
+
+int LocalSubSocket::connect(Context *context, std::string endpoint, std::string address, bool conflate, bool check_endpoint) {
+  assert(address == "127.0.0.1");
+
+  if (check_endpoint && services.count(endpoint) == 0) {
+    std::cout << "Warning, " << endpoint << " is not in service list." << std::endl;
+  }
+
+  this->conflate = conflate;
+  ep = local_endpoint(endpoint);
+  std::lock_guard lk(ep->lock);
+  ep->subscribers.push_back(this);
+  return 0;
+}
+
+void LocalSubSocket::setPoller(std::shared_ptr<QueueWaiter> waiter) {
+  std::lock_guard lk(ep->lock);
+  poller_ready = std::move(waiter);
+}
+
+LocalBufferPtr LocalSubSocket::pop(bool non_blocking) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  LocalBufferPtr buf;
+  while (true) {
+    const uint32_t seen = ready.epoch();
+    if (queue.try_pop(buf)) {
+      // with conflate only the newest one is seen
+      for (LocalBufferPtr next; conflate && queue.try_pop(next);) buf = std::move(next);
+      return buf;
+    }
+    if (non_blocking) return nullptr;
+
+    int64_t wait_ns = -1;
+    if (timeout != -1) {
+      wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+      if (wait_ns <= 0) return nullptr;
+    }
+    ready.wait(seen, wait_ns);
+  }
+}
+
+Message *LocalSubSocket::receive(bool non_blocking) {
+  LocalBufferPtr buf = pop(non_blocking);
+  return buf ? new LocalMessage(std::move(buf)) : nullptr;
+}
+
+// no copy into buf, the words are the publisher's and stay valid until the next receive
+kj::ArrayPtr<const capnp::word> LocalSubSocket::receiveAligned(AlignedBuffer &buf, bool non_blocking) {
+  LocalBufferPtr b = pop(non_blocking);
+  if (!b) return {};
+  last = std::move(b);
+  return last->words.slice(0, (last->size + sizeof(capnp::word) - 1) / sizeof(capnp::word));
+}
+
+LocalSubSocket::~LocalSubSocket() {
+  if (ep) {
+    std::lock_guard lk(ep->lock);
+    auto &subs = ep->subscribers;
+    subs.erase(std::remove(subs.begin(), subs.end(), this), subs.end());
+  }
+}
+
+int LocalPubSocket::connect(Context *context, std::string endpoint, bool check_endpoint) {
+  if (check_endpoint && services.count(endpoint) == 0) {
+    std::cout << "Warning, " << endpoint << " is not in service list." << std::endl;
+  }
+
+  ep = local_endpoint(endpoint);
+  return 0;
+}
+
+int LocalPubSocket::publish(LocalBufferPtr buf) {
+  std::lock_guard lk(ep->lock);
+  for (auto s : ep->subscribers) {
+    // a slow subscriber loses its oldest message, like a msgq reader that falls behind
+    LocalBufferPtr b = buf;
+    while (!s->queue.try_push(b)) {
+      LocalBufferPtr dropped;
+      s->queue.try_pop(dropped);
+    }
+    s->ready.notify();
+    if (s->poller_ready) s->poller_ready->notify();
+  }
+  return buf->size;
+}
+
+int LocalPubSocket::sendMessage(Message *message) {
+  if (auto m = dynamic_cast<LocalMessage *>(message)) {
+    return publish(m->buffer());
+  }
+  return send(message->getData(), message->getSize());
+}
+
+int LocalPubSocket::send(char *data, size_t size) {
+  auto buf = local_buffer(size);
+  memcpy(buf->words.begin(), data, size);
+  return publish(std::move(buf));
+}
+
+bool LocalPubSocket::all_readers_updated() {
+  std::lock_guard lk(ep->lock);
+  return std::none_of(ep->subscribers.begin(), ep->subscribers.end(), [](auto s) { return s->pending(); });
+}
+
+// the message is built straight into the buffer the subscribers get
+kj::ArrayPtr<capnp::word> LocalPubSocket::reserve(size_t size) {
+  reserved = local_buffer(size);
+  return reserved->words;
+}
+
+int LocalPubSocket::commit(size_t size) {
+  assert(reserved && size <= reserved->words.size() * sizeof(capnp::word));
+  reserved->size = size;
+  return publish(std::move(reserved));
+}
+
+void LocalPoller::registerSocket(SubSocket *socket) {
+  if (auto s = dynamic_cast<LocalSubSocket *>(socket)) {
+    s->setPoller(ready);
+    sockets.push_back(s);
+  } else {
+    other->registerSocket(socket);
+    has_other = true;
+  }
+}
+
+std::vector<SubSocket *> LocalPoller::poll(int timeout) {
+  if (sockets.empty()) return other->poll(timeout);
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  std::vector<SubSocket *> ret;
+  while (true) {
+    const uint32_t seen = ready->epoch();
+    for (auto s : sockets) {
+      if (s->pending()) ret.push_back(s);
+    }
+
+    int remaining_ms = -1;
+    if (timeout >= 0) {
+      remaining_ms = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+    }
+    if (has_other) {
+      int t = ret.empty() ? MIXED_POLL_SLICE_MS : 0;
+      if (remaining_ms >= 0) t = std::min(t, remaining_ms);
+      for (auto s : other->poll(t)) ret.push_back(s);
+    }
+    if (!ret.empty() || remaining_ms == 0) return ret;
+
+    if (!has_other) {
+      ready->wait(seen, remaining_ms < 0 ? -1 : remaining_ms * 1000000LL);
+    }
+  }
+}
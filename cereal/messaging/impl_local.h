@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "common/queue.h"
+
+// In-process transport, for publishers and subscribers of a service that live in the same
+// process. A message is built once in a refcounted buffer and every subscriber gets a
+// reference to that same buffer through a lock-free queue, nothing is copied or mapped.
+// The services it's used for are listed in CEREAL_INPROC, comma separated, or "*" for all
+
+#define LOCAL_QUEUE_SIZE 128
+
+bool messaging_use_local();
+bool messaging_use_local(const std::string &endpoint);
+
+struct LocalBuffer {
+  kj::Array<capnp::word> words;
+  size_t size = 0;
+};
+typedef std::shared_ptr<const LocalBuffer> LocalBufferPtr;
+
+struct LocalEndpoint;
+
+class LocalMessage : public Message {
+private:
+  LocalBufferPtr buf;
+public:
+  LocalMessage() = default;
+  LocalMessage(LocalBufferPtr buf) : buf(std::move(buf)) {}
+  void init(size_t size);
+  void init(char *data, size_t size);
+  size_t getSize() { return buf ? buf->size : 0; }
+  char *getData() { return buf ? (char *)buf->words.begin() : nullptr; }
+  const LocalBufferPtr &buffer() const { return buf; }
+  void close() { buf.reset(); }
+  ~LocalMessage() {}
+};
+
+class LocalSubSocket : public SubSocket {
+private:
+  LocalEndpoint *ep = nullptr;
+  bool conflate = false;
+  int timeout = -1;
+  MPMCQueue<LocalBufferPtr, LOCAL_QUEUE_SIZE> queue;
+  QueueWaiter ready;
+  // set by a LocalPoller, kept alive for as long as this socket can notify it
+  std::shared_ptr<QueueWaiter> poller_ready;
+  // what the last receiveAligned returned points into this
+  LocalBufferPtr last;
+
+  LocalBufferPtr pop(bool non_blocking);
+  friend class LocalPubSocket;
+public:
+  int connect(Context *context, std::string endpoint, std::string address, bool conflate=false, bool check_endpoint=true);
+  void setTimeout(int timeout) { this->timeout = timeout; }
+  void *getRawSocket() { return nullptr; }
+  Message *receive(bool non_blocking=false);
+  kj::ArrayPtr<const capnp::word> receiveAligned(AlignedBuffer &buf, bool non_blocking=false);
+  bool pending() const { return queue.size() > 0; }
+  void setPoller(std::shared_ptr<QueueWaiter> waiter);
+  ~LocalSubSocket();
+};
+
+class LocalPubSocket : public PubSocket {
+private:
+  LocalEndpoint *ep = nullptr;
+  std::shared_ptr<LocalBuffer> reserved;
+
+  int publish(LocalBufferPtr buf);
+public:
+  int connect(Context *context, std::string endpoint, bool check_endpoint=true);
+  int sendMessage(Message *message);
+  int send(char *data, size_t size);
+  bool all_readers_updated();
+  kj::ArrayPtr<capnp::word> reserve(size_t size);
+  int commit(size_t size);
+  ~LocalPubSocket() {}
+};
+
+// Polls local sockets itself and hands the others to the poller of the process wide
+// transport. With both kinds registered the other poller is polled in short slices
+class LocalPoller : public Poller {
+private:
+  std::unique_ptr<Poller> other;
+  bool has_other = false;
+  std::vector<LocalSubSocket *> sockets;
+  std::shared_ptr<QueueWaiter> ready = std::make_shared<QueueWaiter>();
+
+public:
+  LocalPoller(Poller *other) : other(other) {}
+  void registerSocket(SubSocket *socket);
+  std::vector<SubSocket *> poll(int timeout);
+  ~LocalPoller() {}
+};
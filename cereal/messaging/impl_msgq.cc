@@ -4,6 +4,8 @@
 #include <cstdlib>
 #include <csignal>
 #include <cerrno>
+#include <algorithm>
+#include <map>
 
 #include "cereal/services.h"
 #include "cereal/messaging/impl_msgq.h"
@@ -20,6 +22,52 @@ static bool service_exists(std::string path){
   return services.count(path) > 0;
 }
 
+struct QueueConfig {
+  size_t size;
+  int flags;
+};
+
+// Ring size and mapping flags for queues that differ from DEFAULT_SEGMENT_SIZE without flags.
+// All processes need to agree on the size, since a queue can't be opened with a different one.
+// Hot topics read by realtime processes are pre-faulted, low rate topics with small messages get a smaller ring
+static const std::map<std::string, QueueConfig> queue_configs = {
+  {"can", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"sendcan", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"carState", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"carControl", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"controlsState", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"modelV2", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"lateralPlan", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"longitudinalPlan", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"radarState", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+  {"liveLocationKalman", {DEFAULT_SEGMENT_SIZE, MSGQ_PREFAULT | MSGQ_HUGEPAGE}},
+
+  {"deviceState", {1024 * 1024, 0}},
+  {"peripheralState", {1024 * 1024, 0}},
+  {"managerState", {1024 * 1024, 0}},
+  {"liveCalibration", {1024 * 1024, 0}},
+  {"liveParameters", {1024 * 1024, 0}},
+  {"liveTorqueParameters", {1024 * 1024, 0}},
+  {"uploaderState", {1024 * 1024, 0}},
+  {"clocks", {1024 * 1024, 0}},
+};
+
+static QueueConfig queue_config(const std::string &endpoint){
+  auto it = queue_configs.find(endpoint);
+  return it != queue_configs.end() ? it->second : QueueConfig{DEFAULT_SEGMENT_SIZE, 0};
+}
+
+// Number of reader slots for queues created by this process, the default fits
+// the stock services. Tooling with many subscribers can raise it with MSGQ_NUM_READERS
+static size_t queue_num_readers(){
+  static const size_t num_readers = []() -> size_t {
+    const char *env = std::getenv("MSGQ_NUM_READERS");
+    int n = env ? std::atoi(env) : 0;
+    return (n > 0 && n <= MAX_NUM_READERS) ? n : NUM_READERS;
+  }();
+  return num_readers;
+}
+
 
 MSGQContext::MSGQContext() {
 }
@@ -63,7 +111,8 @@ int MSGQSubSocket::connect(Context *context, std::string endpoint, std::string a
   }
 
   q = new msgq_queue_t;
-  int r = msgq_new_queue(q, endpoint.c_str(), DEFAULT_SEGMENT_SIZE);
+  QueueConfig config = queue_config(endpoint);
+  int r = msgq_new_queue(q, endpoint.c_str(), config.size, queue_num_readers(), config.flags);
   if (r != 0){
     return r;
   }
@@ -136,6 +185,48 @@ Message * MSGQSubSocket::receive(bool non_blocking){
   return (Message*)r;
 }
 
+kj::ArrayPtr<const capnp::word> MSGQSubSocket::receiveAligned(AlignedBuffer &buf, bool non_blocking){
+  if (!non_blocking){
+    return SubSocket::receiveAligned(buf, false);
+  }
+
+  // Copy once from the ring instead of going through a heap MSGQMessage. The copy goes into
+  // a scratch buffer that is only swapped in once the message is known to be intact,
+  // so readers still pointing into buf never see a torn message
+  msgq_msg_t msg;
+  while (msgq_msg_acquire(&msg, q) > 0){
+    auto words = scratch_buf.align(msg.data, msg.size);
+    if (msgq_msg_release(&msg, q) == 0){
+      buf.swap(scratch_buf);
+      return words;
+    }
+    // Overwritten while copying, try again with the next valid message
+  }
+
+  return {};
+}
+
+size_t MSGQSubSocket::receiveMany(std::vector<Message *> &messages, size_t max_count){
+  msgq_msg_t msgs[MAX_BATCH];
+
+  size_t count = 0;
+  while (count < max_count){
+    int n = msgq_msg_recv_batch(msgs, std::min<size_t>(max_count - count, MAX_BATCH), q);
+    for (int i = 0; i < n; i++){
+      MSGQMessage *r = new MSGQMessage;
+      r->takeOwnership(msgs[i].data, msgs[i].size);
+      messages.push_back(r);
+    }
+
+    count += std::max(n, 0);
+    if (n < MAX_BATCH){
+      break;
+    }
+  }
+
+  return count;
+}
+
 void MSGQSubSocket::setTimeout(int t){
   timeout = t;
 }
@@ -155,7 +246,8 @@ int MSGQPubSocket::connect(Context *context, std::string endpoint, bool check_en
   }
 
   q = new msgq_queue_t;
-  int r = msgq_new_queue(q, endpoint.c_str(), DEFAULT_SEGMENT_SIZE);
+  QueueConfig config = queue_config(endpoint);
+  int r = msgq_new_queue(q, endpoint.c_str(), config.size, queue_num_readers(), config.flags);
   if (r != 0){
     return r;
   }
@@ -185,6 +277,44 @@ bool MSGQPubSocket::all_readers_updated() {
   return msgq_all_readers_updated(q);
 }
 
+int MSGQPubSocket::sendBatch(const std::vector<kj::ArrayPtr<capnp::byte>> &messages){
+  msgq_msg_t msgs[MAX_BATCH];
+
+  size_t sent = 0;
+  while (sent < messages.size()){
+    size_t n = std::min<size_t>(messages.size() - sent, MAX_BATCH);
+    for (size_t i = 0; i < n; i++){
+      msgs[i].data = (char *)messages[sent + i].begin();
+      msgs[i].size = messages[sent + i].size();
+    }
+
+    if (msgq_msg_send_batch(msgs, n, q) < 0){
+      return -1;
+    }
+    sent += n;
+  }
+
+  return sent;
+}
+
+kj::ArrayPtr<capnp::word> MSGQPubSocket::reserve(size_t size){
+  // Messages start right after the 8 byte size tag, so the region is always word aligned
+  if (msgq_msg_reserve(&reserved, q, size) < 0){
+    return {};
+  }
+
+  memset(reserved.data, 0, reserved.size);
+  return kj::arrayPtr((capnp::word *)reserved.data, reserved.size / sizeof(capnp::word));
+}
+
+int MSGQPubSocket::commit(size_t size){
+  assert(reserved.data != NULL);
+  reserved.size = size;
+  int r = msgq_msg_commit(&reserved, q);
+  reserved = {};
+  return r;
+}
+
 MSGQPubSocket::~MSGQPubSocket(){
   if (q != NULL){
     msgq_close_queue(q);
@@ -7,6 +7,7 @@
 #include "cereal/messaging/msgq.h"
 
 #define MAX_POLLERS 128
+#define MAX_BATCH 64
 
 class MSGQContext : public Context {
 private:
@@ -35,22 +36,29 @@ class MSGQSubSocket : public SubSocket {
 private:
   msgq_queue_t * q = NULL;
   int timeout;
+  AlignedBuffer scratch_buf;
 public:
   int connect(Context *context, std::string endpoint, std::string address, bool conflate=false, bool check_endpoint=true);
   void setTimeout(int timeout);
   void * getRawSocket() {return (void*)q;}
   Message *receive(bool non_blocking=false);
+  kj::ArrayPtr<const capnp::word> receiveAligned(AlignedBuffer &buf, bool non_blocking=false);
+  size_t receiveMany(std::vector<Message *> &messages, size_t max_count);
   ~MSGQSubSocket();
 };
 
 class MSGQPubSocket : public PubSocket {
 private:
   msgq_queue_t * q = NULL;
+  msgq_msg_t reserved = {};
 public:
   int connect(Context *context, std::string endpoint, bool check_endpoint=true);
   int sendMessage(Message *message);
   int send(char *data, size_t size);
   bool all_readers_updated();
+  int sendBatch(const std::vector<kj::ArrayPtr<capnp::byte>> &messages);
+  kj::ArrayPtr<capnp::word> reserve(size_t size);
+  int commit(size_t size);
   ~MSGQPubSocket();
 };
 
@@ -5,6 +5,7 @@
 #include "cereal/messaging/impl_zmq.h"
 #include "cereal/messaging/impl_msgq.h"
 #include "cereal/messaging/impl_fake.h"
+#include "cereal/messaging/impl_local.h"
 
 #ifdef __APPLE__
 const bool MUST_USE_ZMQ = true;
@@ -58,7 +59,12 @@ SubSocket * SubSocket::create(){
 }
 
 SubSocket * SubSocket::create(Context * context, std::string endpoint, std::string address, bool conflate, bool check_endpoint){
-  SubSocket *s = SubSocket::create();
+  SubSocket *s;
+  if (address == "127.0.0.1" && messaging_use_local(endpoint)) {
+    s = new LocalSubSocket();
+  } else {
+    s = SubSocket::create();
+  }
   int r = s->connect(context, endpoint, address, conflate, check_endpoint);
 
   if (r == 0) {
@@ -71,6 +77,36 @@ SubSocket * SubSocket::create(Context * context, std::string endpoint, std::stri
   }
 }
 
+kj::ArrayPtr<const capnp::word> SubSocket::receiveAligned(AlignedBuffer &buf, bool non_blocking){
+  Message *msg = receive(non_blocking);
+  if (msg == nullptr) {
+    return {};
+  }
+
+  auto words = buf.align(msg);
+  delete msg;
+  return words;
+}
+
+size_t SubSocket::receiveMany(std::vector<Message *> &messages, size_t max_count){
+  size_t count = 0;
+  Message *msg = nullptr;
+  while (count < max_count && (msg = receive(true))) {
+    messages.push_back(msg);
+    count++;
+  }
+  return count;
+}
+
+int PubSocket::sendBatch(const std::vector<kj::ArrayPtr<capnp::byte>> &messages){
+  for (auto &m : messages) {
+    if (send((char *)m.begin(), m.size()) < 0) {
+      return -1;
+    }
+  }
+  return messages.size();
+}
+
 PubSocket * PubSocket::create(){
   PubSocket * s;
   if (messaging_use_zmq()){
@@ -83,7 +119,7 @@ PubSocket * PubSocket::create(){
 }
 
 PubSocket * PubSocket::create(Context * context, std::string endpoint, bool check_endpoint){
-  PubSocket *s = PubSocket::create();
+  PubSocket *s = messaging_use_local(endpoint) ? new LocalPubSocket() : PubSocket::create();
   int r = s->connect(context, endpoint, check_endpoint);
 
   if (r == 0) {
@@ -107,6 +143,9 @@ Poller * Poller::create(){
       p = new MSGQPoller();
     }
   }
+  if (messaging_use_local()) {
+    p = new LocalPoller(p);
+  }
   return p;
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <cstring>
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
@@ -10,6 +12,7 @@
 #include <capnp/serialize.h>
 
 #include "cereal/gen/cpp/log.capnp.h"
+#include "cereal/messaging/event.h"
 
 #ifdef __APPLE__
 #define CLOCK_BOOTTIME CLOCK_MONOTONIC
@@ -19,6 +22,8 @@
 
 bool messaging_use_zmq();
 
+class AlignedBuffer;
+
 class Context {
 public:
   virtual void * getRawContext() = 0;
@@ -42,6 +47,10 @@ public:
   virtual int connect(Context *context, std::string endpoint, std::string address, bool conflate=false, bool check_endpoint=true) = 0;
   virtual void setTimeout(int timeout) = 0;
   virtual Message *receive(bool non_blocking=false) = 0;
+  // Receive straight into buf, skipping the intermediate Message. Returns an empty array if there is no message
+  virtual kj::ArrayPtr<const capnp::word> receiveAligned(AlignedBuffer &buf, bool non_blocking=false);
+  // Non-blocking receive of up to max_count messages, appended to messages. Returns the number received
+  virtual size_t receiveMany(std::vector<Message *> &messages, size_t max_count);
   virtual void * getRawSocket() = 0;
   static SubSocket * create();
   static SubSocket * create(Context * context, std::string endpoint, std::string address="127.0.0.1", bool conflate=false, bool check_endpoint=true);
@@ -54,6 +63,12 @@ public:
   virtual int sendMessage(Message *message) = 0;
   virtual int send(char *data, size_t size) = 0;
   virtual bool all_readers_updated() = 0;
+  // Sends a burst of messages, returns the number of messages sent or -1
+  virtual int sendBatch(const std::vector<kj::ArrayPtr<capnp::byte>> &messages);
+  // In-place publishing: reserve returns zeroed, word aligned space for a message of up to size bytes,
+  // commit publishes the first size bytes of it. Transports that can't do this return an empty array
+  virtual kj::ArrayPtr<capnp::word> reserve(size_t size) { return {}; }
+  virtual int commit(size_t size) { return -1; }
   static PubSocket * create();
   static PubSocket * create(Context * context, std::string endpoint, bool check_endpoint=true);
   static PubSocket * create(Context * context, std::string endpoint, int port, bool check_endpoint=true);
@@ -71,10 +86,15 @@ public:
 
 class SubMaster {
 public:
+  // In lazy mode update() only records which services have a new message, copying and parsing
+  // it is deferred to the first valid()/operator[] access. Only supported with msgq, not with CEREAL_INPROC
   SubMaster(const std::vector<const char *> &service_list, const std::vector<const char *> &poll = {},
-            const char *address = nullptr, const std::vector<const char *> &ignore_alive = {});
+            const char *address = nullptr, const std::vector<const char *> &ignore_alive = {}, bool lazy = false);
   void update(int timeout = 1000);
   void update_msgs(uint64_t current_time, const std::vector<std::pair<std::string, cereal::Event::Reader>> &messages);
+  // Handlers run from update() for every message received in that update, ordered by logMonoTime
+  typedef std::function<void(const cereal::Event::Reader &event)> Handler;
+  void setHandler(const char *name, Handler handler);
   inline bool allAlive(const std::vector<const char *> &service_list = {}) { return all_(service_list, false, true); }
   inline bool allValid(const std::vector<const char *> &service_list = {}) { return all_(service_list, true, false); }
   inline bool allAliveAndValid(const std::vector<const char *> &service_list = {}) { return all_(service_list, true, true); }
@@ -91,8 +111,12 @@ public:
 
 private:
   bool all_(const std::vector<const char *> &service_list, bool valid, bool alive);
-  Poller *poller_ = nullptr;
   struct SubMessage;
+  bool receive_(SubMessage *m) const;
+  void materialize_(SubMessage *m) const;
+  Poller *poller_ = nullptr;
+  Poller *lazy_poller_ = nullptr;  // non-polled sockets in lazy mode
+  bool lazy_ = false;
   std::map<SubSocket *, SubMessage *> messages_;
   std::map<std::string, SubMessage *> services_;
 };
@@ -100,12 +124,19 @@ private:
 class MessageBuilder : public capnp::MallocMessageBuilder {
 public:
   MessageBuilder() = default;
+  // firstSegment must be zeroed
+  MessageBuilder(kj::ArrayPtr<capnp::word> firstSegment) : capnp::MallocMessageBuilder(firstSegment) {}
 
   cereal::Event::Builder initEvent(bool valid = true) {
     cereal::Event::Builder event = initRoot<cereal::Event>();
-    struct timespec t;
-    clock_gettime(CLOCK_BOOTTIME, &t);
-    uint64_t current_time = t.tv_sec * 1000000000ULL + t.tv_nsec;
+    uint64_t current_time;
+    if (const SimClockState *sim = SimulatedClock::current()) {
+      current_time = sim->nanos.load(std::memory_order_acquire);
+    } else {
+      struct timespec t;
+      clock_gettime(CLOCK_BOOTTIME, &t);
+      current_time = t.tv_sec * 1000000000ULL + t.tv_nsec;
+    }
     event.setLogMonoTime(current_time);
     event.setValid(valid);
     return event;
@@ -132,15 +163,53 @@ private:
   kj::Array<capnp::word> heapArray_;
 };
 
+// Reusable first segment for MessageBuilder. It grows to fit the largest message
+// built in it so far, so a publisher building similar messages every cycle stops
+// allocating once warmed up. The builder zeroes what it used when it's destroyed,
+// so build one message at a time and let it go out of scope before the next.
+class MessageArena {
+public:
+  MessageArena(size_t words = 1024) : want_words_(words) {}
+
+  kj::ArrayPtr<capnp::word> segment() {
+    if (buf_.size() < want_words_) {
+      buf_ = kj::heapArray<capnp::word>(want_words_);
+      memset(buf_.begin(), 0, buf_.size() * sizeof(capnp::word));
+    }
+    return buf_;
+  }
+
+  // Call when the message is complete, grows the segment if it overflowed
+  void update(MessageBuilder &msg) {
+    size_t words = 0;
+    for (auto &s : msg.getSegmentsForOutput()) {
+      words += s.size();
+    }
+    if (words > buf_.size()) {
+      want_words_ = words + words / 4;
+    }
+  }
+
+private:
+  kj::Array<capnp::word> buf_;
+  size_t want_words_;
+};
+
 class PubMaster {
 public:
   PubMaster(const std::vector<const char *> &service_list);
   inline int send(const char *name, capnp::byte *data, size_t size) { return sockets_.at(name)->send((char *)data, size); }
+  inline int sendBatch(const char *name, const std::vector<kj::ArrayPtr<capnp::byte>> &messages) { return sockets_.at(name)->sendBatch(messages); }
   int send(const char *name, MessageBuilder &msg);
+  // Builds the message straight into the publisher's queue, max_size is the expected serialized size.
+  // Falls back to a regular send if the transport doesn't support it or the message outgrows max_size
+  template <typename F>
+  int sendInPlace(const char *name, size_t max_size, F &&build);
   ~PubMaster();
 
 private:
   std::map<std::string, PubSocket *> sockets_;
+  MessageArena arena_;
 };
 
 class AlignedBuffer {
@@ -156,7 +225,40 @@ public:
   inline kj::ArrayPtr<const capnp::word> align(Message *m) {
     return align(m->getData(), m->getSize());
   }
+  inline void swap(AlignedBuffer &other) {
+    std::swap(aligned_buf, other.aligned_buf);
+    std::swap(words_size, other.words_size);
+  }
 private:
   kj::Array<capnp::word> aligned_buf;
   size_t words_size;
 };
+
+template <typename F>
+int PubMaster::sendInPlace(const char *name, size_t max_size, F &&build) {
+  PubSocket *socket = sockets_.at(name);
+
+  // One word for the segment table of a single segment message
+  size_t words = max_size / sizeof(capnp::word) + 2;
+  kj::ArrayPtr<capnp::word> region = socket->reserve(words * sizeof(capnp::word));
+  if (region.size() == 0) {
+    MessageBuilder msg(arena_.segment());
+    build(msg);
+    arena_.update(msg);
+    return send(name, msg);
+  }
+
+  MessageBuilder msg(region.slice(1, region.size()));
+  build(msg);
+
+  auto segments = msg.getSegmentsForOutput();
+  if (segments.size() != 1 || segments[0].begin() != region.begin() + 1) {
+    // Outgrew the reserved space, drop the reservation
+    return send(name, msg);
+  }
+
+  uint32_t *table = reinterpret_cast<uint32_t *>(region.begin());
+  table[0] = 0;  // segment count - 1
+  table[1] = segments[0].size();
+  return socket->commit((segments[0].size() + 1) * sizeof(capnp::word));
+}
@@ -4,6 +4,7 @@
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp cimport bool
+from libc.stdint cimport uint64_t
 
 
 cdef extern from "cereal/messaging/impl_fake.h":
@@ -33,6 +34,15 @@ cdef extern from "cereal/messaging/impl_fake.h":
     Event recv_called()
     Event recv_ready()
 
+  cdef cppclass SimulatedClock:
+    @staticmethod
+    void toggle(bool)
+
+    SimulatedClock(string, uint64_t)
+    uint64_t nanos()
+    void set(uint64_t)
+    void advance(uint64_t)
+
 
 cdef extern from "cereal/messaging/messaging.h":
   cdef cppclass Context:
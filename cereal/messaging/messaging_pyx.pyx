@@ -5,6 +5,7 @@ import sys
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp cimport bool
+from libc.stdint cimport uint64_t
 from libc cimport errno
 from libc.string cimport strerror
 from cython.operator import dereference
@@ -15,7 +16,7 @@ from .messaging cimport SubSocket as cppSubSocket
 from .messaging cimport PubSocket as cppPubSocket
 from .messaging cimport Poller as cppPoller
 from .messaging cimport Message as cppMessage
-from .messaging cimport Event as cppEvent, SocketEventHandle as cppSocketEventHandle
+from .messaging cimport Event as cppEvent, SocketEventHandle as cppSocketEventHandle, SimulatedClock as cppSimulatedClock
 
 
 class MessagingError(Exception):
@@ -33,6 +34,10 @@ def toggle_fake_events(bool enabled):
   cppSocketEventHandle.toggle_fake_events(enabled)
 
 
+def toggle_sim_time(bool enabled):
+  cppSimulatedClock.toggle(enabled)
+
+
 def set_fake_prefix(string prefix):
   cppSocketEventHandle.set_fake_prefix(prefix)
 
@@ -114,6 +119,27 @@ cdef class SocketEventHandle:
     return e
 
 
+cdef class SimulatedClock:
+  cdef cppSimulatedClock * clock;
+
+  def __cinit__(self, string identifier, uint64_t start_nanos=0):
+    self.clock = new cppSimulatedClock(identifier, start_nanos)
+
+  def __dealloc__(self):
+    del self.clock
+
+  @property
+  def nanos(self):
+    return self.clock.nanos()
+
+  @nanos.setter
+  def nanos(self, uint64_t value):
+    self.clock.set(value)
+
+  def advance(self, uint64_t nanos):
+    self.clock.advance(nanos)
+
+
 cdef class Context:
   cdef cppContext * context
 
@@ -14,6 +14,7 @@
 
 #include <poll.h>
 #include <sys/ioctl.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -21,10 +22,30 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
+
 #include <stdio.h>
 
 #include "cereal/messaging/msgq.h"
 
+#if defined(__linux__) && !defined(SYS_futex_waitv)
+#define SYS_futex_waitv 449
+#endif
+
+#ifndef FUTEX_32
+#define FUTEX_32 2
+struct futex_waitv {
+  uint64_t val;
+  uint64_t uaddr;
+  uint32_t flags;
+  uint32_t __reserved;
+};
+#endif
+
+#define MSGQ_FUTEX_WAITV_MAX 128
+
 void sigusr2_handler(int signal) {
   assert(signal == SIGUSR2);
 }
@@ -71,10 +92,32 @@ int msgq_msg_close(msgq_msg_t * msg){
 
 void msgq_reset_reader(msgq_queue_t * q){
   int id = q->reader_id;
+
+  // Everything sent since the last consumed message is skipped
+  uint64_t write_count = *q->write_count;
+  uint64_t read_count = *q->read_counts[id];
+  if (write_count > read_count){
+    *q->read_losts[id] += write_count - read_count;
+  }
+  *q->read_counts[id] = write_count;
+
   q->read_valids[id]->store(true);
   q->read_pointers[id]->store(*q->write_pointer);
 }
 
+static uint64_t msgq_lag(msgq_queue_t * q, uint64_t packed_read_pointer){
+  uint32_t read_cycles, read_pointer;
+  UNPACK64(read_cycles, read_pointer, packed_read_pointer);
+
+  uint32_t write_cycles, write_pointer;
+  UNPACK64(write_cycles, write_pointer, *q->write_pointer);
+
+  if (read_cycles == write_cycles){
+    return (write_pointer >= read_pointer) ? write_pointer - read_pointer : 0;
+  }
+  return (read_pointer <= q->size) ? q->size - read_pointer + write_pointer : 0;
+}
+
 void msgq_wait_for_subscriber(msgq_queue_t *q){
   while (*q->num_readers == 0){
     // wait for subscriber
@@ -83,8 +126,63 @@ void msgq_wait_for_subscriber(msgq_queue_t *q){
   return;
 }
 
-int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size){
+static void msgq_map_header(msgq_queue_t * q, char * mem){
+  msgq_header_t *header = (msgq_header_t *)mem;
+  msgq_reader_t *readers = (msgq_reader_t *)(mem + sizeof(msgq_header_t));
+
+  // Setup pointers to header segment
+  q->num_readers = reinterpret_cast<std::atomic<uint64_t>*>(&header->num_readers);
+  q->write_pointer = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_pointer);
+  q->write_uid = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_uid);
+  q->wakeup_seq = reinterpret_cast<std::atomic<uint32_t>*>(&header->wakeup_seq);
+  q->num_waiters = reinterpret_cast<std::atomic<uint32_t>*>(&header->num_waiters);
+  q->write_count = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_count);
+
+  for (size_t i = 0; i < q->max_readers; i++){
+    q->read_pointers[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_pointer);
+    q->read_valids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_valid);
+    q->read_uids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_uid);
+    q->read_wakeups[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_wakeup);
+    q->read_counts[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_count);
+    q->read_losts[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_lost);
+    q->read_max_lags[i] = reinterpret_cast<std::atomic<uint64_t>*>(&readers[i].read_max_lag);
+  }
+  q->futex_wakeup = true;
+}
+
+static void msgq_map_legacy_header(msgq_queue_t * q, char * mem){
+  msgq_legacy_header_t *header = (msgq_legacy_header_t *)mem;
+
+  q->num_readers = reinterpret_cast<std::atomic<uint64_t>*>(&header->num_readers);
+  q->write_pointer = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_pointer);
+  q->write_uid = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_uid);
+
+  // Legacy publishers only know about signals and don't keep counters,
+  // so the remaining fields are process local
+  q->legacy_header = {};
+  q->legacy_readers.reset(new msgq_reader_t[NUM_READERS]());
+  q->wakeup_seq = reinterpret_cast<std::atomic<uint32_t>*>(&q->legacy_header.wakeup_seq);
+  q->num_waiters = reinterpret_cast<std::atomic<uint32_t>*>(&q->legacy_header.num_waiters);
+  q->write_count = reinterpret_cast<std::atomic<uint64_t>*>(&q->legacy_header.write_count);
+
+  for (size_t i = 0; i < NUM_READERS; i++){
+    msgq_reader_t *local = &q->legacy_readers[i];
+    local->read_wakeup = MSGQ_WAKEUP_SIGNAL;
+
+    q->read_pointers[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_pointers[i]);
+    q->read_valids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_valids[i]);
+    q->read_uids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_uids[i]);
+    q->read_wakeups[i] = reinterpret_cast<std::atomic<uint64_t>*>(&local->read_wakeup);
+    q->read_counts[i] = reinterpret_cast<std::atomic<uint64_t>*>(&local->read_count);
+    q->read_losts[i] = reinterpret_cast<std::atomic<uint64_t>*>(&local->read_lost);
+    q->read_max_lags[i] = reinterpret_cast<std::atomic<uint64_t>*>(&local->read_max_lag);
+  }
+  q->futex_wakeup = false;
+}
+
+int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size, size_t max_readers, int flags){
   assert(size < 0xFFFFFFFF); // Buffer must be smaller than 2^32 bytes
+  assert(max_readers > 0 && max_readers <= MAX_NUM_READERS);
   std::signal(SIGUSR2, sigusr2_handler);
 
   std::string full_path = "/dev/shm/";
@@ -100,45 +198,122 @@ int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size){
     return -1;
   }
 
-  int rc = ftruncate(fd, size + sizeof(msgq_header_t));
-  if (rc < 0){
+  // Hold the lock while deciding on the layout, so two processes
+  // creating the same queue at the same time agree on the reader count
+  flock(fd, LOCK_EX);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0){
     close(fd);
     return -1;
   }
-  char * mem = (char*)mmap(NULL, size + sizeof(msgq_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  close(fd);
 
-  if (mem == NULL){
+  bool legacy = false;
+  if (st.st_size > 0){
+    // The queue already exists, the creator decided on the number of reader slots
+    msgq_header_t existing = {};
+    if (pread(fd, &existing, sizeof(existing), 0) != sizeof(existing)){
+      close(fd);
+      return -1;
+    }
+
+    size_t existing_header_size = sizeof(msgq_header_t) + existing.max_readers * sizeof(msgq_reader_t);
+    if (existing.magic == (MSGQ_MAGIC | MSGQ_VERSION) && size == 0 && (size_t)st.st_size > existing_header_size){
+      size = st.st_size - existing_header_size;
+    }
+
+    if (existing.magic == (MSGQ_MAGIC | MSGQ_VERSION) && (size_t)st.st_size == size + existing_header_size){
+      max_readers = existing.max_readers;
+    } else if ((size_t)st.st_size == (size ? size : DEFAULT_SEGMENT_SIZE) + sizeof(msgq_legacy_header_t)){
+      size = size ? size : DEFAULT_SEGMENT_SIZE;
+      legacy = true;
+      max_readers = NUM_READERS;
+    } else {
+      std::cout << "Warning, unknown queue layout: " << full_path << std::endl;
+      close(fd);
+      return -1;
+    }
+  }
+
+  size_t header_size = legacy ? sizeof(msgq_legacy_header_t) : sizeof(msgq_header_t) + max_readers * sizeof(msgq_reader_t);
+
+  if (st.st_size == 0){
+    if (size == 0){
+      close(fd);
+      return -1;
+    }
+    int rc = ftruncate(fd, size + header_size);
+    if (rc < 0){
+      close(fd);
+      return -1;
+    }
+  }
+  int mmap_flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (flags & MSGQ_PREFAULT){
+    mmap_flags |= MAP_POPULATE;
+  }
+#endif
+  char * mem = (char*)mmap(NULL, size + header_size, PROT_READ | PROT_WRITE, mmap_flags, fd, 0);
+
+  if (mem == MAP_FAILED){
+    close(fd);
     return -1;
   }
-  q->mmap_p = mem;
 
-  msgq_header_t *header = (msgq_header_t *)mem;
+  // Both are best effort, e.g. mlock is bounded by RLIMIT_MEMLOCK
+#ifdef MADV_HUGEPAGE
+  if (flags & MSGQ_HUGEPAGE){
+    madvise(mem, size + header_size, MADV_HUGEPAGE);
+  }
+#endif
+  if (flags & MSGQ_PREFAULT){
+    mlock(mem, size + header_size);
+  }
 
-  // Setup pointers to header segment
-  q->num_readers = reinterpret_cast<std::atomic<uint64_t>*>(&header->num_readers);
-  q->write_pointer = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_pointer);
-  q->write_uid = reinterpret_cast<std::atomic<uint64_t>*>(&header->write_uid);
+  if (st.st_size == 0){
+    msgq_header_t *header = (msgq_header_t *)mem;
+    header->max_readers = max_readers;
+    header->magic = MSGQ_MAGIC | MSGQ_VERSION;
+  }
 
-  for (size_t i = 0; i < NUM_READERS; i++){
-    q->read_pointers[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_pointers[i]);
-    q->read_valids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_valids[i]);
-    q->read_uids[i] = reinterpret_cast<std::atomic<uint64_t>*>(&header->read_uids[i]);
+  // The mapping keeps the open file description alive, so the lock has to be dropped explicitly
+  flock(fd, LOCK_UN);
+  close(fd);
+
+  q->mmap_p = mem;
+  q->header_size = header_size;
+  q->max_readers = max_readers;
+  q->read_pointers.resize(max_readers);
+  q->read_valids.resize(max_readers);
+  q->read_uids.resize(max_readers);
+  q->read_wakeups.resize(max_readers);
+  q->read_counts.resize(max_readers);
+  q->read_losts.resize(max_readers);
+  q->read_max_lags.resize(max_readers);
+
+  if (legacy){
+    msgq_map_legacy_header(q, mem);
+  } else {
+    msgq_map_header(q, mem);
   }
 
-  q->data = mem + sizeof(msgq_header_t);
+  q->data = mem + header_size;
   q->size = size;
   q->reader_id = -1;
 
   q->endpoint = path;
   q->read_conflate = false;
+  q->borrowed = false;
+  q->reserved_size = 0;
 
   return 0;
 }
 
 void msgq_close_queue(msgq_queue_t *q){
   if (q->mmap_p != NULL){
-    munmap(q->mmap_p, q->size + sizeof(msgq_header_t));
+    // munmap also drops any mlock
+    munmap(q->mmap_p, q->size + q->header_size);
   }
 }
 
@@ -150,7 +325,7 @@ void msgq_init_publisher(msgq_queue_t * q) {
   *q->write_uid = uid;
   *q->num_readers = 0;
 
-  for (size_t i = 0; i < NUM_READERS; i++){
+  for (size_t i = 0; i < q->max_readers; i++){
     *q->read_valids[i] = false;
     *q->read_uids[i] = 0;
   }
@@ -167,6 +342,67 @@ static void thread_signal(uint32_t tid) {
   #endif
 }
 
+bool msgq_futex_enabled() {
+#ifdef __linux__
+  // MSGQ_SIGNAL_WAKEUP=1 forces the legacy SIGUSR2 wakeup for all readers in this process
+  static const bool enabled = std::getenv("MSGQ_SIGNAL_WAKEUP") == nullptr;
+  return enabled;
+#else
+  return false;
+#endif
+}
+
+static bool futex_waitv_supported() {
+#ifdef __linux__
+  // Probe once with an empty wait list. Kernels without futex_waitv (< 5.16) return ENOSYS
+  static const bool supported = syscall(SYS_futex_waitv, NULL, 0, 0, NULL, 0) == 0 || errno != ENOSYS;
+  return supported;
+#else
+  return false;
+#endif
+}
+
+static void futex_wake_all(msgq_queue_t *q) {
+#ifdef __linux__
+  // Queues are mapped MAP_SHARED across processes, so the private futex flag must not be used
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(q->wakeup_seq), FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#else
+  UNUSED(q);
+#endif
+}
+
+static int futex_wait(msgq_pollitem_t *items, size_t nitems, const uint32_t *seqs, int ms) {
+#ifdef __linux__
+  if (nitems == 1) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000 * 1000;
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(items[0].q->wakeup_seq), FUTEX_WAIT, seqs[0], &ts, NULL, 0);
+  }
+
+  struct futex_waitv waiters[MSGQ_FUTEX_WAITV_MAX] = {};
+  for (size_t i = 0; i < nitems; i++) {
+    waiters[i].uaddr = (uint64_t)(uintptr_t)items[i].q->wakeup_seq;
+    waiters[i].val = seqs[i];
+    waiters[i].flags = FUTEX_32;
+  }
+
+  // futex_waitv takes an absolute timeout
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000 * 1000;
+  if (ts.tv_nsec >= 1000 * 1000 * 1000) {
+    ts.tv_sec += 1;
+    ts.tv_nsec -= 1000 * 1000 * 1000;
+  }
+  return syscall(SYS_futex_waitv, waiters, nitems, 0, &ts, CLOCK_MONOTONIC);
+#else
+  UNUSED(items); UNUSED(nitems); UNUSED(seqs); UNUSED(ms);
+  return -1;
+#endif
+}
+
 void msgq_init_subscriber(msgq_queue_t * q) {
   assert(q != NULL);
   assert(q->num_readers != NULL);
@@ -179,11 +415,11 @@ void msgq_init_subscriber(msgq_queue_t * q) {
     uint64_t new_num_readers = cur_num_readers + 1;
 
     // No more slots available. Reset all subscribers to kick out inactive ones
-    if (new_num_readers > NUM_READERS){
+    if (new_num_readers > q->max_readers){
       //std::cout << "Warning, evicting all subscribers!" << std::endl;
       *q->num_readers = 0;
 
-      for (size_t i = 0; i < NUM_READERS; i++){
+      for (size_t i = 0; i < q->max_readers; i++){
         *q->read_valids[i] = false;
 
         uint64_t old_uid = *q->read_uids[i];
@@ -208,6 +444,10 @@ void msgq_init_subscriber(msgq_queue_t * q) {
       // on the first read the read pointer will be synchronized with the write pointer
       *q->read_valids[cur_num_readers] = false;
       *q->read_pointers[cur_num_readers] = 0;
+      *q->read_wakeups[cur_num_readers] = (q->futex_wakeup && msgq_futex_enabled()) ? MSGQ_WAKEUP_FUTEX : MSGQ_WAKEUP_SIGNAL;
+      *q->read_counts[cur_num_readers] = q->write_count->load();
+      *q->read_losts[cur_num_readers] = 0;
+      *q->read_max_lags[cur_num_readers] = 0;
       *q->read_uids[cur_num_readers] = uid;
       break;
     }
@@ -217,25 +457,25 @@ void msgq_init_subscriber(msgq_queue_t * q) {
   msgq_reset_reader(q);
 }
 
-int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
+static bool msgq_check_publisher(msgq_queue_t *q){
   // Die if we are no longer the active publisher
   if (q->write_uid_local != *q->write_uid){
     std::cout << "Killing old publisher: " << q->endpoint << std::endl;
     errno = EADDRINUSE;
-    return -1;
+    return false;
   }
+  return true;
+}
 
-  uint64_t total_msg_size = ALIGN(msg->size + sizeof(int64_t));
+// Prepares size bytes at the (possibly unpublished) write position, wrapping around if needed.
+// Returns a pointer to the size tag of the new message
+static char *msgq_prepare_write(msgq_queue_t *q, size_t size, uint64_t num_readers, uint32_t &write_cycles, uint32_t &write_pointer){
+  uint64_t total_msg_size = ALIGN(size + sizeof(int64_t));
 
   // We need to fit at least three messages in the queue,
   // then we can always safely access the last message
   assert(3 * total_msg_size <= q->size);
 
-  uint64_t num_readers = *q->num_readers;
-
-  uint32_t write_cycles, write_pointer;
-  UNPACK64(write_cycles, write_pointer, *q->write_pointer);
-
   char *p = q->data + write_pointer; // add base offset
 
   // Check remaining space
@@ -257,9 +497,11 @@ int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
       }
     }
 
-    // Update global and local copies of write pointer and write_cycles
+    // Update global and local copies of write pointer and write_cycles.
+    // Messages of a batch written before the wraparound tag are published by this as well
     write_pointer = 0;
     write_cycles = write_cycles + 1;
+    __sync_synchronize();
     PACK64(*q->write_pointer, write_cycles, write_pointer);
 
     // Set actual pointer to the beginning of the data segment
@@ -268,7 +510,7 @@ int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
 
   // Invalidate readers that are in the area that will be written
   uint64_t start = write_pointer;
-  uint64_t end = ALIGN(start + sizeof(int64_t) + msg->size);
+  uint64_t end = ALIGN(start + sizeof(int64_t) + size);
 
   for (uint64_t i = 0; i < num_readers; i++){
     uint32_t read_cycles, read_pointer;
@@ -279,28 +521,111 @@ int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
     }
   }
 
+  return p;
+}
+
+static void msgq_notify_readers(msgq_queue_t *q, uint64_t num_readers){
+  // Futex readers are only woken when at least one of them is parked,
+  // readers that can't use the futex (e.g. old kernels polling multiple queues) still get a signal
+  for (uint64_t i = 0; i < num_readers; i++){
+    if (*q->read_wakeups[i] == MSGQ_WAKEUP_SIGNAL){
+      uint64_t reader_uid = *q->read_uids[i];
+      thread_signal(reader_uid & 0xFFFFFFFF);
+    }
+  }
+
+  q->wakeup_seq->fetch_add(1);
+  if (*q->num_waiters > 0){
+    futex_wake_all(q);
+  }
+}
+
+int msgq_msg_reserve(msgq_msg_t * msg, msgq_queue_t *q, size_t size){
+  if (!msgq_check_publisher(q)){
+    return -1;
+  }
+
+  uint32_t write_cycles, write_pointer;
+  UNPACK64(write_cycles, write_pointer, *q->write_pointer);
+
+  char *p = msgq_prepare_write(q, size, *q->num_readers, write_cycles, write_pointer);
+
+  msg->data = p + sizeof(int64_t);
+  msg->size = size;
+  q->reserved_size = size;
+  return 0;
+}
+
+int msgq_msg_commit(msgq_msg_t * msg, msgq_queue_t *q){
+  assert(msg->size <= q->reserved_size);
+  q->reserved_size = 0;
+
+  uint64_t num_readers = *q->num_readers;
+
+  uint32_t write_cycles, write_pointer;
+  UNPACK64(write_cycles, write_pointer, *q->write_pointer);
+
+  char *p = q->data + write_pointer;
+  assert(msg->data == p + sizeof(int64_t));
 
   // Write size tag
   std::atomic<int64_t> *size_p = reinterpret_cast<std::atomic<int64_t>*>(p);
   *size_p = msg->size;
-
-  // Copy data
-  memcpy(p + sizeof(int64_t), msg->data, msg->size);
   __sync_synchronize();
 
   // Update write pointer
   uint32_t new_ptr = ALIGN(write_pointer + msg->size + sizeof(int64_t));
   PACK64(*q->write_pointer, write_cycles, new_ptr);
+  q->write_count->fetch_add(1);
 
-  // Notify readers
-  for (uint64_t i = 0; i < num_readers; i++){
-    uint64_t reader_uid = *q->read_uids[i];
-    thread_signal(reader_uid & 0xFFFFFFFF);
-  }
+  msgq_notify_readers(q, num_readers);
 
   return msg->size;
 }
 
+int msgq_msg_send(msgq_msg_t * msg, msgq_queue_t *q){
+  msgq_msg_t reserved;
+  if (msgq_msg_reserve(&reserved, q, msg->size) < 0){
+    return -1;
+  }
+
+  // Copy data
+  memcpy(reserved.data, msg->data, msg->size);
+  return msgq_msg_commit(&reserved, q);
+}
+
+int msgq_msg_send_batch(msgq_msg_t * msgs, size_t count, msgq_queue_t *q){
+  if (!msgq_check_publisher(q)){
+    return -1;
+  }
+
+  uint64_t num_readers = *q->num_readers;
+
+  uint32_t write_cycles, write_pointer;
+  UNPACK64(write_cycles, write_pointer, *q->write_pointer);
+
+  // Write all messages behind the write pointer, then publish them with a single update
+  for (size_t i = 0; i < count; i++){
+    char *p = msgq_prepare_write(q, msgs[i].size, num_readers, write_cycles, write_pointer);
+
+    std::atomic<int64_t> *size_p = reinterpret_cast<std::atomic<int64_t>*>(p);
+    *size_p = msgs[i].size;
+    memcpy(p + sizeof(int64_t), msgs[i].data, msgs[i].size);
+
+    write_pointer = ALIGN(write_pointer + msgs[i].size + sizeof(int64_t));
+  }
+  __sync_synchronize();
+
+  PACK64(*q->write_pointer, write_cycles, write_pointer);
+  q->write_count->fetch_add(count);
+
+  if (count > 0){
+    msgq_notify_readers(q, num_readers);
+  }
+
+  return count;
+}
+
 
 int msgq_msg_ready(msgq_queue_t * q){
  start:
@@ -331,7 +656,9 @@ int msgq_msg_ready(msgq_queue_t * q){
   return (read_pointer != write_pointer);
 }
 
-int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
+static int msgq_msg_recv_impl(msgq_msg_t * msg, msgq_queue_t * q, bool borrow){
+  assert(!q->borrowed); // Previous borrowed message needs to be released first
+
  start:
   int id = q->reader_id;
   assert(id >= 0); // Make sure subscriber is initialized
@@ -387,15 +714,32 @@ int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
 
   uint32_t new_read_pointer = ALIGN(read_pointer + sizeof(std::int64_t) + size);
 
+  uint64_t lag = msgq_lag(q, *q->read_pointers[id]);
+  if (lag > *q->read_max_lags[id]){
+    *q->read_max_lags[id] = lag;
+  }
+
   // If conflate is true, check if this is the latest message, else start over
   if (q->read_conflate){
     if (new_read_pointer != write_pointer){
       // Update read pointer
       PACK64(*q->read_pointers[id], read_cycles, new_read_pointer);
+      *q->read_counts[id] += 1;
       goto start;
     }
   }
 
+  if (borrow){
+    // Hand out a view into the ring. The read pointer stays at the start of the message
+    // until release, so the writer invalidates this reader if it overwrites the message
+    __sync_synchronize();
+    msg->size = size;
+    msg->data = p + sizeof(int64_t);
+    PACK64(q->borrowed_read_pointer, read_cycles, new_read_pointer);
+    q->borrowed = true;
+    return msg->size;
+  }
+
   // Copy message
   if (msgq_msg_init_size(msg, size) < 0)
     return -1;
@@ -406,6 +750,7 @@ int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
 
   // Update read pointer
   PACK64(*q->read_pointers[id], read_cycles, new_read_pointer);
+  *q->read_counts[id] += 1;
 
   // Check if the actual data that was copied is valid
   if (!*q->read_valids[id]){
@@ -418,7 +763,168 @@ int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
   return msg->size;
 }
 
+int msgq_msg_recv(msgq_msg_t * msg, msgq_queue_t * q){
+  return msgq_msg_recv_impl(msg, q, false);
+}
+
+int msgq_msg_recv_batch(msgq_msg_t * msgs, size_t max_count, msgq_queue_t * q){
+  assert(!q->borrowed);
+  if (max_count == 0){
+    return 0;
+  }
+
+  // A conflating reader only ever wants the latest message
+  if (q->read_conflate){
+    int r = msgq_msg_recv(&msgs[0], q);
+    return r > 0 ? 1 : r;
+  }
+
+ start:
+  int id = q->reader_id;
+  assert(id >= 0); // Make sure subscriber is initialized
+
+  if (q->read_uid_local != *q->read_uids[id]){
+    msgq_init_subscriber(q);
+    goto start;
+  }
+
+  // Check valid
+  if (!*q->read_valids[id]){
+    msgq_reset_reader(q);
+    goto start;
+  }
+
+  uint64_t packed_read_pointer = *q->read_pointers[id];
+  uint32_t read_cycles, read_pointer;
+  UNPACK64(read_cycles, read_pointer, packed_read_pointer);
+
+  uint32_t write_cycles, write_pointer;
+  UNPACK64(write_cycles, write_pointer, *q->write_pointer);
+  UNUSED(write_cycles);
+
+  __sync_synchronize();
+
+  // Copy everything up to the write pointer sampled above
+  size_t count = 0;
+  while (count < max_count && read_pointer != write_pointer){
+    char * p = q->data + read_pointer;
+    std::int64_t size = *reinterpret_cast<std::atomic<int64_t>*>(p);
+
+    // If size is -1 the buffer was full, and we need to wrap around
+    if (size == -1){
+      read_cycles++;
+      read_pointer = 0;
+      continue;
+    }
+
+    // A bogus size means the writer lapped us, which the validity check below catches
+    if (size <= 0 || (uint64_t)size >= q->size){
+      assert(!*q->read_valids[id]);
+      break;
+    }
+
+    if (msgq_msg_init_size(&msgs[count], size) < 0){
+      break;
+    }
+    memcpy(msgs[count].data, p + sizeof(int64_t), size);
+    count++;
+
+    read_pointer = ALIGN(read_pointer + sizeof(std::int64_t) + size);
+  }
+  __sync_synchronize();
+
+  // Update read pointer once for the whole batch
+  PACK64(*q->read_pointers[id], read_cycles, read_pointer);
+
+  // Check if the actual data that was copied is valid
+  if (!*q->read_valids[id]){
+    for (size_t i = 0; i < count; i++){
+      msgq_msg_close(&msgs[i]);
+    }
+    msgq_reset_reader(q);
+    goto start;
+  }
+
+  uint64_t lag = msgq_lag(q, packed_read_pointer);
+  if (lag > *q->read_max_lags[id]){
+    *q->read_max_lags[id] = lag;
+  }
+  *q->read_counts[id] += count;
+
+  return count;
+}
+
+int msgq_msg_acquire(msgq_msg_t * msg, msgq_queue_t * q){
+  return msgq_msg_recv_impl(msg, q, true);
+}
+
+int msgq_msg_release(msgq_msg_t * msg, msgq_queue_t * q){
+  assert(q->borrowed);
+  q->borrowed = false;
+  msg->size = 0;
+  msg->data = NULL;
+
+  // The writer wrapped around and overwrote the message while it was borrowed
+  __sync_synchronize();
+  int id = q->reader_id;
+  if (q->read_uid_local != *q->read_uids[id] || !*q->read_valids[id]){
+    return -1;
+  }
+
+  *q->read_pointers[id] = q->borrowed_read_pointer;
+  *q->read_counts[id] += 1;
+  return 0;
+}
+
+static int msgq_poll_futex(msgq_pollitem_t * items, size_t nitems, int timeout){
+  int num = 0;
+  uint32_t seqs[MSGQ_FUTEX_WAITV_MAX];
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
 
+  while (true) {
+    // Register as a waiter before sampling the sequence numbers. A publisher either sees
+    // num_waiters > 0 and wakes us, or we see its message in the ready check below
+    for (size_t i = 0; i < nitems; i++) {
+      items[i].q->num_waiters->fetch_add(1);
+      seqs[i] = *items[i].q->wakeup_seq;
+    }
+
+    for (size_t i = 0; i < nitems; i++) {
+      items[i].revents = msgq_msg_ready(items[i].q);
+      if (items[i].revents) num++;
+    }
+
+    int ms = 100;
+    if (num == 0 && timeout != -1) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      ms = std::max<int>(remaining.count(), 0);
+    }
+
+    if (num == 0 && ms > 0) {
+      futex_wait(items, nitems, seqs, ms);
+    }
+
+    for (size_t i = 0; i < nitems; i++) {
+      items[i].q->num_waiters->fetch_sub(1);
+    }
+
+    if (num > 0 || (timeout != -1 && ms == 0)) {
+      break;
+    }
+
+    for (size_t i = 0; i < nitems; i++) {
+      items[i].revents = msgq_msg_ready(items[i].q);
+      if (items[i].revents) num++;
+    }
+
+    if (num > 0) {
+      break;
+    }
+  }
+
+  return num;
+}
 
 int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout){
   int num = 0;
@@ -429,6 +935,27 @@ int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout){
     if (items[i].revents) num++;
   }
 
+  if (num == 0 && timeout == 0) {
+    return 0;
+  }
+
+  // Waiting on several queues needs futex_waitv, otherwise fall back to signals
+  bool use_futex = msgq_futex_enabled() && nitems <= MSGQ_FUTEX_WAITV_MAX && (nitems == 1 || futex_waitv_supported());
+  for (size_t i = 0; i < nitems; i++) {
+    use_futex = use_futex && items[i].q->futex_wakeup;
+  }
+  for (size_t i = 0; i < nitems; i++) {
+    *items[i].q->read_wakeups[items[i].q->reader_id] = use_futex ? MSGQ_WAKEUP_FUTEX : MSGQ_WAKEUP_SIGNAL;
+  }
+
+  if (num > 0) {
+    return num;
+  }
+
+  if (use_futex) {
+    return msgq_poll_futex(items, nitems, timeout);
+  }
+
   int ms = (timeout == -1) ? 100 : timeout;
   struct timespec ts;
   ts.tv_sec = ms / 1000;
@@ -466,3 +993,21 @@ bool msgq_all_readers_updated(msgq_queue_t *q) {
   }
   return num_readers > 0;
 }
+
+uint64_t msgq_get_stats(msgq_queue_t *q, std::vector<msgq_reader_stats_t> *readers) {
+  readers->clear();
+
+  uint64_t num_readers = std::min<uint64_t>(*q->num_readers, q->max_readers);
+  for (uint64_t i = 0; i < num_readers; i++) {
+    msgq_reader_stats_t stats = {};
+    stats.tid = *q->read_uids[i] & 0xFFFFFFFF;
+    stats.valid = *q->read_valids[i];
+    stats.lag = msgq_lag(q, *q->read_pointers[i]);
+    stats.max_lag = *q->read_max_lags[i];
+    stats.count = *q->read_counts[i];
+    stats.lost = *q->read_losts[i];
+    readers->push_back(stats);
+  }
+
+  return *q->write_count;
+}
@@ -4,16 +4,52 @@
 #include <cstring>
 #include <string>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 #define DEFAULT_SEGMENT_SIZE (10 * 1024 * 1024)
 #define NUM_READERS 12
+#define MAX_NUM_READERS 256
+#define MSGQ_WAKEUP_SIGNAL 0
+#define MSGQ_WAKEUP_FUTEX 1
 #define ALIGN(n) ((n + (8 - 1)) & -8)
 
+// Mapping flags for msgq_new_queue
+#define MSGQ_PREFAULT (1 << 0)   // populate and mlock the ring, no page faults on the first laps
+#define MSGQ_HUGEPAGE (1 << 1)   // back the ring with transparent huge pages where shmem allows it
+
+// "msgq" followed by the layout version. Queues without this magic use the legacy
+// fixed layout with NUM_READERS slots, see msgq_legacy_header_t
+#define MSGQ_MAGIC 0x6d73677100000000ULL
+#define MSGQ_VERSION 3
+
 #define UNUSED(x) (void)x
 #define UNPACK64(higher, lower, input) do {uint64_t tmp = input; higher = tmp >> 32; lower = tmp & 0xFFFFFFFF;} while (0)
 #define PACK64(output, higher, lower) output = ((uint64_t)higher << 32) | ((uint64_t)lower & 0xFFFFFFFF)
 
-struct  msgq_header_t {
+// Shared memory layout: msgq_header_t, max_readers * msgq_reader_t, data
+struct msgq_header_t {
+  uint64_t magic;
+  uint64_t max_readers;
+  uint64_t num_readers;
+  uint64_t write_pointer;
+  uint64_t write_uid;
+  uint32_t wakeup_seq;   // futex word, bumped on every send
+  uint32_t num_waiters;  // readers currently parked on wakeup_seq
+  uint64_t write_count;  // messages sent
+};
+
+struct msgq_reader_t {
+  uint64_t read_pointer;
+  uint64_t read_valid;
+  uint64_t read_uid;
+  uint64_t read_wakeup;
+  uint64_t read_count;    // messages consumed, including ones skipped by conflate
+  uint64_t read_lost;     // messages overwritten before this reader got to them
+  uint64_t read_max_lag;  // largest distance to the write pointer seen on receive, in bytes
+};
+
+struct msgq_legacy_header_t {
   uint64_t num_readers;
   uint64_t write_pointer;
   uint64_t write_uid;
@@ -26,18 +62,44 @@ struct msgq_queue_t {
   std::atomic<uint64_t> *num_readers;
   std::atomic<uint64_t> *write_pointer;
   std::atomic<uint64_t> *write_uid;
-  std::atomic<uint64_t> *read_pointers[NUM_READERS];
-  std::atomic<uint64_t> *read_valids[NUM_READERS];
-  std::atomic<uint64_t> *read_uids[NUM_READERS];
+  std::atomic<uint32_t> *wakeup_seq;
+  std::atomic<uint32_t> *num_waiters;
+  std::atomic<uint64_t> *write_count;
+  std::vector<std::atomic<uint64_t> *> read_pointers;
+  std::vector<std::atomic<uint64_t> *> read_valids;
+  std::vector<std::atomic<uint64_t> *> read_uids;
+  std::vector<std::atomic<uint64_t> *> read_wakeups;
+  std::vector<std::atomic<uint64_t> *> read_counts;
+  std::vector<std::atomic<uint64_t> *> read_losts;
+  std::vector<std::atomic<uint64_t> *> read_max_lags;
   char * mmap_p;
   char * data;
   size_t size;
+  size_t header_size;
+  size_t max_readers;
   int reader_id;
   uint64_t read_uid_local;
   uint64_t write_uid_local;
 
   bool read_conflate;
+  bool borrowed;  // a message handed out by msgq_msg_acquire hasn't been released yet
+  uint64_t borrowed_read_pointer;
+  size_t reserved_size;  // size of the region handed out by msgq_msg_reserve
+  bool futex_wakeup;  // false for legacy queues, whose publishers only send signals
   std::string endpoint;
+
+  // Process local stand-in for the fields legacy queues don't have in shared memory
+  msgq_header_t legacy_header;
+  std::unique_ptr<msgq_reader_t[]> legacy_readers;
+};
+
+struct msgq_reader_stats_t {
+  uint32_t tid;
+  bool valid;
+  uint64_t lag;       // bytes between the read and write pointer
+  uint64_t max_lag;
+  uint64_t count;
+  uint64_t lost;
 };
 
 struct msgq_msg_t {
@@ -57,14 +119,37 @@ int msgq_msg_init_size(msgq_msg_t *msg, size_t size);
 int msgq_msg_init_data(msgq_msg_t *msg, char * data, size_t size);
 int msgq_msg_close(msgq_msg_t *msg);
 
-int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size);
+// size 0 opens an existing queue with whatever ring size it was created with
+int msgq_new_queue(msgq_queue_t * q, const char * path, size_t size, size_t max_readers = NUM_READERS, int flags = 0);
 void msgq_close_queue(msgq_queue_t *q);
 void msgq_init_publisher(msgq_queue_t * q);
 void msgq_init_subscriber(msgq_queue_t * q);
 
 int msgq_msg_send(msgq_msg_t *msg, msgq_queue_t *q);
+
+// Zero-copy send. Reserve points msg->data at size bytes in the ring for the caller to fill,
+// commit publishes the first msg->size bytes of it (msg->size may be lowered, not raised).
+// A reservation that is never committed is simply dropped
+int msgq_msg_reserve(msgq_msg_t *msg, msgq_queue_t *q, size_t size);
+int msgq_msg_commit(msgq_msg_t *msg, msgq_queue_t *q);
 int msgq_msg_recv(msgq_msg_t *msg, msgq_queue_t *q);
+
+// Batched variants, moving the read/write pointer once for all messages.
+// They return the number of messages received/sent
+int msgq_msg_recv_batch(msgq_msg_t *msgs, size_t max_count, msgq_queue_t *q);
+int msgq_msg_send_batch(msgq_msg_t *msgs, size_t count, msgq_queue_t *q);
+
+// Zero-copy receive. msg->data points into the shared ring and stays readable until
+// msgq_msg_release, which returns -1 if the writer overwrote the message in the meantime.
+// Anything derived from a borrowed message must be discarded when release fails.
+// Don't call msgq_msg_close on a borrowed message
+int msgq_msg_acquire(msgq_msg_t *msg, msgq_queue_t *q);
+int msgq_msg_release(msgq_msg_t *msg, msgq_queue_t *q);
 int msgq_msg_ready(msgq_queue_t * q);
 int msgq_poll(msgq_pollitem_t * items, size_t nitems, int timeout);
 
 bool msgq_all_readers_updated(msgq_queue_t *q);
+
+// Snapshot of the per reader counters, returns the number of messages sent on the queue
+uint64_t msgq_get_stats(msgq_queue_t *q, std::vector<msgq_reader_stats_t> *readers);
+bool msgq_futex_enabled();
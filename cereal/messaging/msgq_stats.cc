@@ -0,0 +1,66 @@
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cereal/messaging/msgq.h"
+
+// Dumps the per reader counters of every msgq queue in /dev/shm (or /dev/shm/$OPENPILOT_PREFIX).
+// Usage: msgq_stats [endpoint ...]
+
+static std::vector<std::string> list_queues() {
+  std::string dir = "/dev/shm/";
+  const char* prefix = std::getenv("OPENPILOT_PREFIX");
+  if (prefix) {
+    dir += std::string(prefix) + "/";
+  }
+
+  std::vector<std::string> queues;
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL) {
+    return queues;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    struct stat st;
+    if (stat((dir + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+      queues.push_back(entry->d_name);
+    }
+  }
+  closedir(d);
+  return queues;
+}
+
+int main(int argc, char** argv) {
+  std::vector<std::string> endpoints(argv + 1, argv + argc);
+  if (endpoints.empty()) {
+    endpoints = list_queues();
+  }
+
+  std::vector<msgq_reader_stats_t> readers;
+  for (auto &endpoint : endpoints) {
+    msgq_queue_t q;
+    // Files that aren't queues fail the layout check and are skipped
+    if (msgq_new_queue(&q, endpoint.c_str(), 0) != 0) {
+      continue;
+    }
+
+    uint64_t sent = msgq_get_stats(&q, &readers);
+    printf("%s: %" PRIu64 " sent, %zu/%zu readers%s\n", endpoint.c_str(), sent, readers.size(), q.max_readers,
+           q.futex_wakeup ? "" : " (legacy layout)");
+    for (size_t i = 0; i < readers.size(); i++) {
+      auto &r = readers[i];
+      printf("  [%2zu] tid %-7u %-7s read %-10" PRIu64 " lost %-8" PRIu64 " lag %-9" PRIu64 " max lag %" PRIu64 "\n", i, r.tid, r.valid ? "valid" : "invalid",
+             r.count, r.lost, r.lag, r.max_lag);
+    }
+
+    msgq_close_queue(&q);
+  }
+
+  return 0;
+}
@@ -2,14 +2,20 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string>
+#include <algorithm>
 #include <mutex>
 
 #include "cereal/services.h"
 #include "cereal/messaging/messaging.h"
+#include "cereal/messaging/impl_local.h"
+#include "cereal/messaging/msgq.h"
 
 const bool SIMULATION = (getenv("SIMULATION") != nullptr) && (std::string(getenv("SIMULATION")) == "1");
 
 static inline uint64_t nanos_since_boot() {
+  if (const SimClockState *sim = SimulatedClock::current()) {
+    return sim->nanos.load(std::memory_order_acquire);
+  }
   struct timespec t;
   clock_gettime(CLOCK_BOOTTIME, &t);
   return t.tv_sec * 1000000000ULL + t.tv_nsec;
@@ -45,14 +51,19 @@ struct SubMaster::SubMessage {
   uint64_t rcv_time = 0, rcv_frame = 0;
   void *allocated_msg_reader = nullptr;
   bool is_polled = false;
+  bool pending = false;  // lazy mode: a message is waiting in the queue
+  uint64_t pending_write_count = 0;
+  SubMaster::Handler handler;
   capnp::FlatArrayMessageReader *msg_reader = nullptr;
   AlignedBuffer aligned_buf;
   cereal::Event::Reader event;
 };
 
 SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::vector<const char *> &poll,
-                     const char *address, const std::vector<const char *> &ignore_alive) {
+                     const char *address, const std::vector<const char *> &ignore_alive, bool lazy) {
   poller_ = Poller::create();
+  lazy_ = lazy && !messaging_use_zmq() && !messaging_use_local();
+  if (lazy_) lazy_poller_ = Poller::create();
   for (auto name : service_list) {
     assert(services.count(std::string(name)) > 0);
 
@@ -60,7 +71,11 @@ SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::v
     SubSocket *socket = SubSocket::create(message_context.context(), name, address ? address : "127.0.0.1", true);
     assert(socket != 0);
     bool is_polled = inList(poll, name) || poll.empty();
-    if (is_polled) poller_->registerSocket(socket);
+    if (is_polled) {
+      poller_->registerSocket(socket);
+    } else if (lazy_) {
+      lazy_poller_->registerSocket(socket);
+    }
     SubMessage *m = new SubMessage{
       .name = name,
       .socket = socket,
@@ -74,42 +89,80 @@ SubMaster::SubMaster(const std::vector<const char *> &service_list, const std::v
   }
 }
 
+bool SubMaster::receive_(SubMessage *m) const {
+  auto words = m->socket->receiveAligned(m->aligned_buf, true);
+  if (words.size() == 0) return false;
+
+  m->msg_reader->~FlatArrayMessageReader();
+  capnp::ReaderOptions options;
+  options.traversalLimitInWords = kj::maxValue; // Don't limit
+  m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(words, options);
+  return true;
+}
+
+void SubMaster::materialize_(SubMessage *m) const {
+  if (!m->pending) return;
+
+  m->pending = false;
+  if (receive_(m)) {
+    m->event = m->msg_reader->getRoot<cereal::Event>();
+    m->valid = m->event.getValid();
+  }
+}
+
 void SubMaster::update(int timeout) {
   for (auto &kv : messages_) kv.second->updated = false;
 
   auto sockets = poller_->poll(timeout);
 
   // add non-polled sockets for non-blocking receive
-  for (auto &kv : messages_) {
-    SubMessage *m = kv.second;
-    SubSocket *s = kv.first;
-    if (!m->is_polled) sockets.push_back(s);
+  if (lazy_) {
+    for (auto s : lazy_poller_->poll(0)) sockets.push_back(s);
+  } else {
+    for (auto &kv : messages_) {
+      SubMessage *m = kv.second;
+      SubSocket *s = kv.first;
+      if (!m->is_polled) sockets.push_back(s);
+    }
   }
 
   uint64_t current_time = nanos_since_boot();
 
   std::vector<std::pair<std::string, cereal::Event::Reader>> messages;
+  std::vector<SubMessage *> lazy_updated;
 
   for (auto s : sockets) {
-    Message *msg = s->receive(true);
-    if (msg == nullptr) continue;
-
     SubMessage *m = messages_.at(s);
 
-    m->msg_reader->~FlatArrayMessageReader();
-    capnp::ReaderOptions options;
-    options.traversalLimitInWords = kj::maxValue; // Don't limit
-    m->msg_reader = new (m->allocated_msg_reader) capnp::FlatArrayMessageReader(m->aligned_buf.align(msg), options);
-    delete msg;
+    if (lazy_ && !m->handler) {
+      // An unread message keeps the socket ready, only count it again if something new was sent
+      uint64_t write_count = *((msgq_queue_t *)s->getRawSocket())->write_count;
+      if (!m->pending || write_count != m->pending_write_count) {
+        m->pending = true;
+        m->pending_write_count = write_count;
+        m->rcv_time = current_time;
+        lazy_updated.push_back(m);
+      }
+      continue;
+    }
+
+    if (!receive_(m)) continue;
     messages.push_back({m->name, m->msg_reader->getRoot<cereal::Event>()});
   }
 
   update_msgs(current_time, messages);
+
+  for (auto m : lazy_updated) {
+    m->updated = true;
+    m->rcv_frame = frame;
+    if (SIMULATION) m->alive = true;
+  }
 }
 
 void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<std::string, cereal::Event::Reader>> &messages){
   if (++frame == UINT64_MAX) frame = 1;
 
+  std::vector<SubMessage *> dispatch;
   for (auto &kv : messages) {
     auto m_find = services_.find(kv.first);
     if (m_find == services_.end()){
@@ -121,7 +174,9 @@ void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<s
     m->rcv_time = current_time;
     m->rcv_frame = frame;
     m->valid = m->event.getValid();
+    m->pending = false;
     if (SIMULATION) m->alive = true;
+    if (m->handler) dispatch.push_back(m);
   }
 
   if (!SIMULATION) {
@@ -130,6 +185,18 @@ void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<s
       m->alive = (m->freq <= (1e-5) || ((current_time - m->rcv_time) * (1e-9)) < (10.0 / m->freq));
     }
   }
+
+  // Messages are received per socket, hand them out in the order they were sent
+  std::stable_sort(dispatch.begin(), dispatch.end(), [](SubMessage *a, SubMessage *b) {
+    return a->event.getLogMonoTime() < b->event.getLogMonoTime();
+  });
+  for (auto m : dispatch) {
+    m->handler(m->event);
+  }
+}
+
+void SubMaster::setHandler(const char *name, Handler handler) {
+  services_.at(name)->handler = handler;
 }
 
 bool SubMaster::all_(const std::vector<const char *> &service_list, bool valid, bool alive) {
@@ -137,6 +204,7 @@ bool SubMaster::all_(const std::vector<const char *> &service_list, bool valid,
   for (auto &kv : messages_) {
     SubMessage *m = kv.second;
     if (service_list.size() == 0 || inList(service_list, m->name.c_str())) {
+      if (valid) materialize_(m);
       found += (!valid || m->valid) && (!alive || (m->alive || m->ignore_alive));
     }
   }
@@ -144,6 +212,8 @@ bool SubMaster::all_(const std::vector<const char *> &service_list, bool valid,
 }
 
 void SubMaster::drain() {
+  for (auto &kv : messages_) kv.second->pending = false;
+
   while (true) {
     auto polls = poller_->poll(0);
     if (polls.size() == 0)
@@ -165,7 +235,9 @@ bool SubMaster::alive(const char *name) const {
 }
 
 bool SubMaster::valid(const char *name) const {
-  return services_.at(name)->valid;
+  SubMessage *m = services_.at(name);
+  materialize_(m);
+  return m->valid;
 }
 
 uint64_t SubMaster::rcv_frame(const char *name) const {
@@ -177,11 +249,14 @@ uint64_t SubMaster::rcv_time(const char *name) const {
 }
 
 cereal::Event::Reader &SubMaster::operator[](const char *name) const {
-  return services_.at(name)->event;
+  SubMessage *m = services_.at(name);
+  materialize_(m);
+  return m->event;
 }
 
 SubMaster::~SubMaster() {
   delete poller_;
+  delete lazy_poller_;
   for (auto &kv : messages_) {
     SubMessage *m = kv.second;
     m->msg_reader->~FlatArrayMessageReader();
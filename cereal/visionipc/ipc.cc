@@ -5,10 +5,18 @@
 #include <assert.h>
 #include <errno.h>
 
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef __APPLE__
 #define getsocket() socket(AF_UNIX, SOCK_STREAM, 0)
 #else
@@ -119,3 +127,90 @@ int ipc_sendrecv_with_fds(bool send, int fd, void *buf, size_t buf_size, int* fd
     return r;
   }
 }
+
+int ipc_tcp_connect(const char* host, int port) {
+  struct addrinfo hints = {0}, *res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", port);
+  if (getaddrinfo(host, port_str, &hints, &res) != 0) return -1;
+
+  int sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
+    close(sock);
+    sock = -1;
+  }
+  freeaddrinfo(res);
+  if (sock < 0) return -1;
+
+  int one = 1;
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return sock;
+}
+
+int ipc_tcp_bind(int port) {
+  int sock = socket(AF_INET, SOCK_STREAM, 0);
+  assert(sock >= 0);
+
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {0};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  int err = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+  assert(err == 0);
+
+  err = listen(sock, 1);
+  assert(err == 0);
+
+  return sock;
+}
+
+bool ipc_write_all(int fd, const void *buf, size_t size) {
+  const char *p = (const char *)buf;
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool ipc_read_all(int fd, void *buf, size_t size) {
+  char *p = (char *)buf;
+  while (size > 0) {
+    ssize_t n = recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+#ifdef __linux__
+// not FUTEX_PRIVATE_FLAG, the word is in memory shared with other processes
+void ipc_futex_wait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms) {
+  struct timespec ts = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+void ipc_futex_wake(std::atomic<uint32_t> *word) {
+  syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+#else
+// no futex, poll the word
+void ipc_futex_wait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms) {
+  for (int i = 0; i < timeout_ms && word->load(std::memory_order_acquire) == expected; i++) {
+    usleep(1000);
+  }
+}
+
+void ipc_futex_wake(std::atomic<uint32_t> *word) {}
+#endif
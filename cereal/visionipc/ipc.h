@@ -1,7 +1,20 @@
 #pragma once
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 
 int ipc_connect(const char* socket_path);
 int ipc_bind(const char* socket_path);
 int ipc_sendrecv_with_fds(bool send, int fd, void *buf, size_t buf_size, int* fds, int num_fds,
                           int *out_num_fds);
+
+// TCP transport for remote clients
+int ipc_tcp_connect(const char* host, int port);
+int ipc_tcp_bind(int port);
+bool ipc_write_all(int fd, const void *buf, size_t size);
+bool ipc_read_all(int fd, void *buf, size_t size);
+
+// Wait on a word in shared memory, across processes. Returns when it doesn't hold
+// expected anymore, on a wake or after timeout_ms (which may also be early).
+void ipc_futex_wait(std::atomic<uint32_t> *word, uint32_t expected, int timeout_ms);
+void ipc_futex_wake(std::atomic<uint32_t> *word);
@@ -27,9 +27,41 @@ void VisionBuf::init_yuv(size_t init_width, size_t init_height, size_t init_stri
 
 
 uint64_t VisionBuf::get_frame_id() {
-  return *frame_id;
+  return shared->frame_id;
 }
 
 void VisionBuf::set_frame_id(uint64_t id) {
-  *frame_id = id;
+  shared->frame_id = id;
+}
+
+void VisionBuf::begin_write() {
+  shared->seq.store(this->seq | 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void VisionBuf::end_write() {
+  // Also valid without begin_write, the sequence moves to the next even value
+  this->seq = (this->seq | 1) + 1;
+  shared->seq.store(this->seq, std::memory_order_release);
+}
+
+bool VisionBuf::in_use() {
+  return shared->readers.load(std::memory_order_acquire) > 0;
+}
+
+void VisionBuf::acquire() {
+  if (held) return;
+  shared->readers.fetch_add(1, std::memory_order_acq_rel);
+  held = true;
+}
+
+void VisionBuf::release() {
+  if (!held) return;
+  shared->readers.fetch_sub(1, std::memory_order_acq_rel);
+  held = false;
+}
+
+bool VisionBuf::is_intact() {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return shared->seq.load(std::memory_order_relaxed) == this->seq;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+
 #include "cereal/visionipc/visionipc.h"
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
@@ -18,15 +20,51 @@ enum VisionStreamType {
   VISION_STREAM_WIDE_ROAD,
 
   VISION_STREAM_MAP,
+
+  // downscaled copies of the road stream
+  VISION_STREAM_ROAD_HALF,
+  VISION_STREAM_ROAD_QCAM,
   VISION_STREAM_MAX,
 };
 
+// Lives in shared memory right after the image data. seq is odd while the server
+// is writing the frame, readers counts clients currently holding the buffer.
+struct VisionBufShared {
+  uint64_t frame_id;
+  std::atomic<uint32_t> seq;
+  std::atomic<int32_t> readers;
+};
+
+// Shared per stream, handed to clients with the buffers. Frames are announced in the ring,
+// and a client claims a slot and stores the count of each frame it receives there, so the
+// server knows how far behind it is.
+constexpr int VISIONIPC_MAX_CLIENTS = 16;
+constexpr int VISIONIPC_RING_SIZE = 16;
+
+struct VisionIpcClientSlot {
+  std::atomic<int32_t> pid;        // 0 if the slot is free
+  std::atomic<bool> priority;      // the frame it receives next isn't overwritten
+  std::atomic<uint64_t> received;  // count of the last frame it received
+  std::atomic<uint64_t> missed;    // frames overwritten before it received them, kept by the server
+};
+
+struct VisionIpcStreamShared {
+  int32_t server_pid;
+  std::atomic<bool> closed;
+  // frames sent on the stream, frame n is in ring[n % VISIONIPC_RING_SIZE]
+  std::atomic<uint64_t> sent;
+  // bumped after every frame, clients wait on it
+  std::atomic<uint32_t> futex;
+  VisionIpcPacket ring[VISIONIPC_RING_SIZE];
+  VisionIpcClientSlot slots[VISIONIPC_MAX_CLIENTS];
+};
+
 class VisionBuf {
  public:
   size_t len = 0;
   size_t mmap_len = 0;
   void * addr = nullptr;
-  uint64_t *frame_id;
+  VisionBufShared *shared = nullptr;
   int fd = 0;
 
   bool rgb = false;
@@ -43,6 +81,8 @@ class VisionBuf {
   uint64_t server_id = 0;
   size_t idx = 0;
   VisionStreamType type;
+  uint32_t seq = 0;
+  bool held = false;
 
   // OpenCL
   cl_mem buf_cl = nullptr;
@@ -61,6 +101,17 @@ class VisionBuf {
 
   void set_frame_id(uint64_t id);
   uint64_t get_frame_id();
+
+  // Server side
+  void begin_write();
+  void end_write();
+  bool in_use();
+
+  // Client side. Holding a buffer keeps the server from reusing it,
+  // is_intact() tells whether the frame was overwritten since it was received.
+  void acquire();
+  void release();
+  bool is_intact();
 };
 
 void visionbuf_compute_aligned_width_and_height(int width, int height, int *aligned_w, int *aligned_h);
@@ -34,9 +34,9 @@ static void *malloc_with_fd(size_t len, int *fd) {
 
 void VisionBuf::allocate(size_t length) {
   this->len = length;
-  this->mmap_len = this->len + sizeof(uint64_t);
+  this->mmap_len = this->len + sizeof(VisionBufShared);
   this->addr = malloc_with_fd(this->mmap_len, &this->fd);
-  this->frame_id = (uint64_t*)((uint8_t*)this->addr + this->len);
+  this->shared = (VisionBufShared*)((uint8_t*)this->addr + this->len);
 }
 
 void VisionBuf::init_cl(cl_device_id device_id, cl_context ctx){
@@ -55,7 +55,7 @@ void VisionBuf::import(){
   this->addr = mmap(NULL, this->mmap_len, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
   assert(this->addr != MAP_FAILED);
 
-  this->frame_id = (uint64_t*)((uint8_t*)this->addr + this->len);
+  this->shared = (VisionBufShared*)((uint8_t*)this->addr + this->len);
 }
 
 
@@ -78,6 +78,7 @@ int VisionBuf::sync(int dir) {
 
 int VisionBuf::free() {
   int err = 0;
+  release();
   if (this->buf_cl){
     err = clReleaseMemObject(this->buf_cl);
     if (err != 0) return err;
@@ -10,10 +10,34 @@ struct VisionIpcBufExtra {
   uint64_t timestamp_sof;
   uint64_t timestamp_eof;
   bool valid;
+  // of the image, for servers that can say whether a frame is the same as the last one.
+  // 0 when it's not set
+  uint64_t content_hash;
 };
 
 struct VisionIpcPacket {
   uint64_t server_id;
   size_t idx;
+  uint32_t seq;
+  uint64_t count;  // frames sent on the stream, including this one
   struct VisionIpcBufExtra extra;
 };
+
+// Remote (TCP) transport. The server sends a VisionIpcRemoteHeader once per
+// connection, then a VisionIpcRemoteFrame followed by len bytes per frame.
+constexpr uint32_t VISIONIPC_REMOTE_MAGIC = 0x76697063;  // "vipc"
+
+struct VisionIpcRemoteHeader {
+  uint32_t magic;
+  uint32_t rgb;
+  uint64_t width;
+  uint64_t height;
+  uint64_t stride;
+  uint64_t uv_offset;
+  uint64_t len;
+};
+
+struct VisionIpcRemoteFrame {
+  struct VisionIpcBufExtra extra;
+  uint64_t len;
+};
@@ -36,6 +36,7 @@ cdef extern from "cereal/visionipc/visionipc.h":
     uint64_t timestamp_sof
     uint64_t timestamp_eof
     bool valid
+    uint64_t content_hash
 
 cdef extern from "cereal/visionipc/visionipc_server.h":
   string get_endpoint_name(string, VisionStreamType)
@@ -56,5 +57,6 @@ cdef extern from "cereal/visionipc/visionipc_client.h":
     VisionBuf * recv(VisionIpcBufExtra *, int)
     bool connect(bool)
     bool is_connected()
+    void set_priority(bool)
     @staticmethod
     set[VisionStreamType] getAvailableStreams(string, bool)
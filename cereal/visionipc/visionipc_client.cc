@@ -1,8 +1,18 @@
+#include <algorithm>
 #include <chrono>
 #include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
 #include <iostream>
 #include <thread>
 
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+
 #include "cereal/visionipc/ipc.h"
 #include "cereal/visionipc/visionipc_client.h"
 #include "cereal/visionipc/visionipc_server.h"
@@ -25,27 +35,114 @@ static int connect_to_vipc_server(const std::string &name, bool blocking) {
   return socket_fd;
 }
 
-VisionIpcClient::VisionIpcClient(std::string name, VisionStreamType type, bool conflate, cl_device_id device_id, cl_context ctx) : name(name), type(type), device_id(device_id), ctx(ctx) {
-  msg_ctx = Context::create();
-  sock = SubSocket::create(msg_ctx, get_endpoint_name(name, type), "127.0.0.1", conflate, false);
+static double millis_since_boot() {
+  struct timespec t;
+  clock_gettime(CLOCK_BOOTTIME, &t);
+  return t.tv_sec * 1000.0 + t.tv_nsec * 1e-6;
+}
 
-  poller = Poller::create();
-  poller->registerSocket(sock);
+void LatencyHistogram::add(double ms) {
+  int bin = std::clamp((int)ms, 0, NUM_BINS - 1);
+  bins[bin]++;
+  count++;
+  max_ms = std::max(max_ms, ms);
 }
 
-// Connect is not thread safe. Do not use the buffers while calling connect
-bool VisionIpcClient::connect(bool blocking){
-  connected = false;
+double LatencyHistogram::percentile(double p) const {
+  if (count == 0) return 0;
+  uint64_t target = std::ceil(count * p / 100.0), seen = 0;
+  for (int i = 0; i < NUM_BINS; i++) {
+    seen += bins[i];
+    if (seen >= target) return i + 1;
+  }
+  return NUM_BINS;
+}
 
-  // Cleanup old buffers on reconnect
+void LatencyHistogram::reset() {
+  *this = LatencyHistogram();
+}
+
+// Number of local buffers frames from a remote server are received into
+const int VISIONIPC_REMOTE_BUFFERS = 4;
+
+VisionIpcClient::VisionIpcClient(std::string name, VisionStreamType type, bool conflate, cl_device_id device_id, cl_context ctx) : name(name), conflate(conflate), type(type), device_id(device_id), ctx(ctx) {
+  if (const char *interval = std::getenv("VISIONIPC_LATENCY_STATS")) {
+    latency_interval_ms = std::atof(interval) * 1000.0;
+  }
+
+  const std::string tcp_prefix = "tcp://";
+  if (name.rfind(tcp_prefix, 0) == 0) {
+    size_t sep = name.rfind(':');
+    assert(sep > tcp_prefix.size());
+    remote_host = name.substr(tcp_prefix.size(), sep - tcp_prefix.size());
+    remote_port = std::stoi(name.substr(sep + 1));
+  }
+}
+
+void VisionIpcClient::free_buffers() {
   for (size_t i = 0; i < num_buffers; i++){
     if (buffers[i].free() != 0) {
       LOGE("Failed to free buffer %zu", i);
     }
   }
-
   num_buffers = 0;
 
+  if (slot) {
+    slot->pid = 0;
+    slot = nullptr;
+  }
+  if (stream) {
+    munmap(stream, sizeof(VisionIpcStreamShared));
+    stream = nullptr;
+  }
+}
+
+bool VisionIpcClient::map_stream(int shared_fd) {
+  void *addr = mmap(NULL, sizeof(VisionIpcStreamShared), PROT_READ | PROT_WRITE, MAP_SHARED, shared_fd, 0);
+  close(shared_fd);
+  if (addr == MAP_FAILED) {
+    LOGE("Failed to map visionipc stream state");
+    return false;
+  }
+  stream = (VisionIpcStreamShared*)addr;
+  // only frames sent from now on
+  last_count = stream->sent.load(std::memory_order_acquire);
+  return true;
+}
+
+void VisionIpcClient::claim_slot() {
+  const int32_t pid = getpid();
+  for (auto &s : stream->slots) {
+    // free, or left behind by a client that died
+    int32_t owner = s.pid;
+    if (owner != 0 && (owner == pid || kill(owner, 0) == 0 || errno != ESRCH)) continue;
+    if (s.pid.compare_exchange_strong(owner, pid)) {
+      s.priority = priority;
+      s.received = last_count;
+      s.missed = 0;
+      slot = &s;
+      return;
+    }
+  }
+  LOGW("No free visionipc client slot for %s stream %d", name.c_str(), (int)type);
+}
+
+void VisionIpcClient::set_priority(bool enabled) {
+  priority = enabled;
+  if (slot) slot->priority = enabled;
+}
+
+// Connect is not thread safe. Do not use the buffers while calling connect
+bool VisionIpcClient::connect(bool blocking){
+  connected = false;
+
+  // Cleanup old buffers on reconnect
+  free_buffers();
+
+  if (remote_port >= 0) {
+    return connect_remote(blocking);
+  }
+
   int socket_fd = connect_to_vipc_server(name, blocking);
   if (socket_fd < 0) {
     return false;
@@ -56,11 +153,13 @@ bool VisionIpcClient::connect(bool blocking){
 
   // Get FDs
   int fds[VISIONIPC_MAX_FDS];
+  int num_fds = 0;
   VisionBuf bufs[VISIONIPC_MAX_FDS];
-  r = ipc_sendrecv_with_fds(false, socket_fd, &bufs, sizeof(bufs), fds, VISIONIPC_MAX_FDS, &num_buffers);
+  r = ipc_sendrecv_with_fds(false, socket_fd, &bufs, sizeof(bufs), fds, VISIONIPC_MAX_FDS, &num_fds);
 
-  assert(num_buffers >= 0);
-  assert(r == sizeof(VisionBuf) * num_buffers);
+  assert(r >= 0 && r % sizeof(VisionBuf) == 0);
+  num_buffers = r / sizeof(VisionBuf);
+  assert(num_fds >= num_buffers);
 
   // Import buffers
   for (size_t i = 0; i < num_buffers; i++){
@@ -77,44 +176,172 @@ bool VisionIpcClient::connect(bool blocking){
   }
 
   close(socket_fd);
+
+  // the shared stream state follows the buffers
+  if (num_fds <= num_buffers || !map_stream(fds[num_buffers])) {
+    free_buffers();
+    return false;
+  }
+  claim_slot();
   connected = true;
   return true;
 }
 
-VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_ms){
-  auto p = poller->poll(timeout_ms);
+bool VisionIpcClient::connect_remote(bool blocking) {
+  if (remote_fd >= 0) {
+    close(remote_fd);
+  }
+
+  remote_fd = ipc_tcp_connect(remote_host.c_str(), remote_port);
+  while (remote_fd < 0 && blocking) {
+    std::cout << "VisionIpcClient connecting to " << remote_host << ":" << remote_port << std::endl;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    remote_fd = ipc_tcp_connect(remote_host.c_str(), remote_port);
+  }
+  if (remote_fd < 0) {
+    return false;
+  }
+
+  VisionIpcRemoteHeader header = {};
+  if (!ipc_read_all(remote_fd, &header, sizeof(header)) || header.magic != VISIONIPC_REMOTE_MAGIC) {
+    LOGE("Bad header from remote visionipc server");
+    close(remote_fd);
+    remote_fd = -1;
+    return false;
+  }
+
+  for (int i = 0; i < VISIONIPC_REMOTE_BUFFERS; i++) {
+    VisionBuf &buf = buffers[i];
+    buf.allocate(header.len);
+    buf.idx = i;
+    buf.type = type;
+    if (device_id) buf.init_cl(device_id, ctx);
+    header.rgb ? buf.init_rgb(header.width, header.height, header.stride) : buf.init_yuv(header.width, header.height, header.stride, header.uv_offset);
+  }
+  num_buffers = VISIONIPC_REMOTE_BUFFERS;
+  remote_idx = 0;
+
+  connected = true;
+  return true;
+}
 
-  if (!p.size()){
+VisionBuf * VisionIpcClient::recv_remote(VisionIpcBufExtra * extra, const int timeout_ms) {
+  struct pollfd pfd = {.fd = remote_fd, .events = POLLIN};
+  if (poll(&pfd, 1, timeout_ms) <= 0) {
     return nullptr;
   }
 
-  Message * r = sock->receive(true);
-  if (r == nullptr){
+  // Frames are read into the local buffers round robin, so a buffer stays
+  // valid until VISIONIPC_REMOTE_BUFFERS more frames are received.
+  VisionBuf *buf = &buffers[remote_idx++ % num_buffers];
+
+  VisionIpcRemoteFrame frame = {};
+  if (!ipc_read_all(remote_fd, &frame, sizeof(frame)) || frame.len != buf->len ||
+      !ipc_read_all(remote_fd, buf->addr, buf->len)) {
+    LOGE("Lost connection to remote visionipc server");
+    close(remote_fd);
+    remote_fd = -1;
+    connected = false;
     return nullptr;
   }
 
-  // Get buffer
-  assert(r->getSize() == sizeof(VisionIpcPacket));
-  VisionIpcPacket *packet = (VisionIpcPacket*)r->getData();
+  buf->set_frame_id(frame.extra.frame_id);
+  if (extra) {
+    *extra = frame.extra;
+  }
+
+  if (buf->sync(VISIONBUF_SYNC_TO_DEVICE) != 0) {
+    LOGE("Failed to sync buffer");
+  }
+  return buf;
+}
+
+void VisionIpcClient::update_latency(const VisionIpcBufExtra &extra) {
+  const double now = millis_since_boot();
+  if (extra.timestamp_sof > 0) sof_latency.add(now - extra.timestamp_sof * 1e-6);
+  if (extra.timestamp_eof > 0) eof_latency.add(now - extra.timestamp_eof * 1e-6);
 
-  assert(packet->idx < num_buffers);
-  VisionBuf * buf = &buffers[packet->idx];
+  if (latency_start_ms == 0) latency_start_ms = now;
+  if (now - latency_start_ms < latency_interval_ms) return;
 
-  if (buf->server_id != packet->server_id){
+  LOG("visionipc latency %s stream %d: %" PRIu64 " frames, sof p50 %.0f p90 %.0f p99 %.0f max %.1f ms, eof p50 %.0f p90 %.0f p99 %.0f max %.1f ms",
+      name.c_str(), (int)type, sof_latency.count,
+      sof_latency.percentile(50), sof_latency.percentile(90), sof_latency.percentile(99), sof_latency.max_ms,
+      eof_latency.percentile(50), eof_latency.percentile(90), eof_latency.percentile(99), eof_latency.max_ms);
+  sof_latency.reset();
+  eof_latency.reset();
+  latency_start_ms = now;
+}
+
+VisionBuf * VisionIpcClient::recv(VisionIpcBufExtra * extra, const int timeout_ms){
+  if (latency_interval_ms > 0) {
+    VisionIpcBufExtra local_extra = {};
+    extra = extra ? extra : &local_extra;
+    VisionBuf *buf = remote_port >= 0 ? recv_remote(extra, timeout_ms) : recv_local(extra, timeout_ms);
+    if (buf) update_latency(*extra);
+    return buf;
+  }
+  return remote_port >= 0 ? recv_remote(extra, timeout_ms) : recv_local(extra, timeout_ms);
+}
+
+VisionBuf * VisionIpcClient::recv_local(VisionIpcBufExtra * extra, const int timeout_ms){
+  if (!stream) {
+    return nullptr;
+  }
+
+  const double deadline = millis_since_boot() + timeout_ms;
+  VisionIpcPacket packet;
+  while (true) {
+    // read the futex before sent, a frame sent in between wakes the wait right away
+    const uint32_t futex = stream->futex.load(std::memory_order_acquire);
+    const uint64_t sent = stream->sent.load(std::memory_order_acquire);
+
+    if (sent > last_count) {
+      // the oldest frame not received yet, or the newest when conflating. The server
+      // writes frame n + VISIONIPC_RING_SIZE while sent is one below it, frames older
+      // than that may be partially overwritten and are skipped
+      const uint64_t oldest = sent > VISIONIPC_RING_SIZE - 2 ? sent - (VISIONIPC_RING_SIZE - 2) : 1;
+      const uint64_t count = conflate ? sent : std::max(last_count + 1, oldest);
+      packet = stream->ring[count % VISIONIPC_RING_SIZE];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (stream->sent.load(std::memory_order_relaxed) - count > VISIONIPC_RING_SIZE - 2) continue;
+      last_count = count;
+      break;
+    }
+
+    // gone without closing the stream, a new server sends to a new ring
+    if (stream->closed || (kill(stream->server_pid, 0) != 0 && errno == ESRCH)) {
+      connected = false;
+      return nullptr;
+    }
+
+    const double remaining = deadline - millis_since_boot();
+    if (remaining <= 0) {
+      return nullptr;
+    }
+    ipc_futex_wait(&stream->futex, futex, std::ceil(remaining));
+  }
+
+  assert(packet.idx < num_buffers);
+  VisionBuf * buf = &buffers[packet.idx];
+
+  if (buf->server_id != packet.server_id){
     connected = false;
-    delete r;
     return nullptr;
   }
 
   if (extra) {
-    *extra = packet->extra;
+    *extra = packet.extra;
+  }
+  buf->seq = packet.seq;
+  if (slot) {
+    slot->received.store(packet.count, std::memory_order_relaxed);
   }
 
   if (buf->sync(VISIONBUF_SYNC_TO_DEVICE) != 0) {
     LOGE("Failed to sync buffer");
   }
 
-  delete r;
   return buf;
 }
 
@@ -136,13 +363,8 @@ std::set<VisionStreamType> VisionIpcClient::getAvailableStreams(const std::strin
 }
 
 VisionIpcClient::~VisionIpcClient(){
-  for (size_t i = 0; i < num_buffers; i++){
-    if (buffers[i].free() != 0) {
-      LOGE("Failed to free buffer %zu", i);
-    }
+  free_buffers();
+  if (remote_fd >= 0) {
+    close(remote_fd);
   }
-
-  delete sock;
-  delete poller;
-  delete msg_ctx;
 }
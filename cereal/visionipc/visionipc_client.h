@@ -9,17 +9,55 @@
 #include "cereal/visionipc/visionipc.h"
 #include "cereal/visionipc/visionbuf.h"
 
+// Histogram of frame latencies in 1 ms bins, the last bin collects everything slower
+class LatencyHistogram {
+public:
+  static const int NUM_BINS = 250;
+  void add(double ms);
+  double percentile(double p) const;
+  void reset();
+  uint64_t count = 0;
+  double max_ms = 0;
+
+private:
+  uint64_t bins[NUM_BINS] = {};
+};
+
 class VisionIpcClient {
 private:
   std::string name;
-  Context * msg_ctx;
-  SubSocket * sock;
-  Poller * poller;
+  bool conflate;
 
   cl_device_id device_id = nullptr;
   cl_context ctx = nullptr;
 
-  void init_msgq(bool conflate);
+
+  // remote transport, used when name is "tcp://<host>:<port>"
+  std::string remote_host;
+  int remote_port = -1;
+  int remote_fd = -1;
+  size_t remote_idx = 0;
+  bool connect_remote(bool blocking);
+  VisionBuf * recv_remote(VisionIpcBufExtra * extra, const int timeout_ms);
+  VisionBuf * recv_local(VisionIpcBufExtra * extra, const int timeout_ms);
+  void free_buffers();
+
+  // the server's shared state of the stream, frames are read from its ring
+  VisionIpcStreamShared * stream = nullptr;
+  uint64_t last_count = 0;
+  bool map_stream(int shared_fd);
+
+  // our slot in it
+  bool priority = false;
+  VisionIpcClientSlot * slot = nullptr;
+  void claim_slot();
+
+  // Optional timestamp_sof/eof -> recv latency stats, enabled with VISIONIPC_LATENCY_STATS=<seconds>.
+  // A summary is logged every interval.
+  double latency_interval_ms = 0;
+  double latency_start_ms = 0;
+  LatencyHistogram sof_latency, eof_latency;
+  void update_latency(const VisionIpcBufExtra &extra);
 
 public:
   bool connected = false;
@@ -31,5 +69,8 @@ public:
   VisionBuf * recv(VisionIpcBufExtra * extra=nullptr, const int timeout_ms=100);
   bool connect(bool blocking=true);
   bool is_connected() { return connected; }
+  // The server doesn't overwrite the frame a priority client receives next, for clients
+  // like modeld that can fall behind but shouldn't read a torn frame
+  void set_priority(bool enabled);
   static std::set<VisionStreamType> getAvailableStreams(const std::string &name, bool blocking = true);
 };
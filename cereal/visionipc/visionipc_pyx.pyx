@@ -26,6 +26,8 @@ cpdef enum VisionStreamType:
   VISION_STREAM_DRIVER
   VISION_STREAM_WIDE_ROAD
   VISION_STREAM_MAP
+  VISION_STREAM_ROAD_HALF
+  VISION_STREAM_ROAD_QCAM
 
 
 cdef class VisionBuf:
@@ -84,6 +86,7 @@ cdef class VisionIpcServer:
     extra.frame_id = frame_id
     extra.timestamp_sof = timestamp_sof
     extra.timestamp_eof = timestamp_eof
+    extra.content_hash = 0
 
     self.server.send(buf, &extra, False)
 
@@ -147,6 +150,10 @@ cdef class VisionIpcClient:
   def timestamp_eof(self):
     return self.extra.timestamp_eof
 
+  @property
+  def content_hash(self):
+    return self.extra.content_hash
+
   @property
   def valid(self):
     return self.extra.valid
@@ -163,6 +170,9 @@ cdef class VisionIpcClient:
   def is_connected(self):
     return self.client.is_connected()
 
+  def set_priority(self, bool enabled):
+    self.client.set_priority(enabled)
+
   @staticmethod
   def available_streams(string name, bool block):
     return cppVisionIpcClient.getAvailableStreams(name, block)
@@ -1,8 +1,10 @@
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 #include <cassert>
 #include <random>
 #include <limits>
+#include <new>
 
 #include <poll.h>
 #include <sys/socket.h>
@@ -23,8 +25,6 @@ std::string get_endpoint_name(std::string name, VisionStreamType type){
 }
 
 VisionIpcServer::VisionIpcServer(std::string name, cl_device_id device_id, cl_context ctx) : name(name), device_id(device_id), ctx(ctx) {
-  msg_ctx = Context::create();
-
   std::random_device rd("/dev/urandom");
   std::uniform_int_distribution<uint64_t> distribution(0, std::numeric_limits<uint64_t>::max());
   server_id = distribution(rd);
@@ -68,12 +68,28 @@ void VisionIpcServer::create_buffers_with_sizes(VisionStreamType type, size_t nu
   }
 
   cur_idx[type] = 0;
+  sent_count[type].assign(num_buffers, 0);
 
-  // Create msgq publisher for each of the `name` + type combos
-  // TODO: compute port number directly if using zmq
-  sockets[type] = PubSocket::create(msg_ctx, get_endpoint_name(name, type), false);
+  VisionBuf *shared = new VisionBuf();
+  shared->allocate(sizeof(VisionIpcStreamShared));
+  VisionIpcStreamShared *state = new (shared->addr) VisionIpcStreamShared{};
+  state->server_pid = getpid();
+  stream_shared[type] = shared;
 }
 
+void VisionIpcServer::create_derived_buffers(VisionStreamType type, VisionStreamType source, size_t num_buffers, size_t width, size_t height) {
+  assert(buffers.count(source) && buffers.count(type) == 0);
+  assert(!buffers[source][0]->rgb);
+  assert(width <= buffers[source][0]->width && height <= buffers[source][0]->height);
+
+  create_buffers(type, num_buffers, false, width, height);
+  derived[source].push_back(type);
+}
+
+std::vector<VisionStreamType> VisionIpcServer::get_derived_streams(VisionStreamType source) {
+  auto it = derived.find(source);
+  return it != derived.end() ? it->second : std::vector<VisionStreamType>{};
+}
 
 void VisionIpcServer::start_listener(){
   listener_thread = std::thread(&VisionIpcServer::listener, this);
@@ -153,7 +169,10 @@ void VisionIpcServer::listener(){
       bufs[i].server_id = server_id;
     }
 
-    r = ipc_sendrecv_with_fds(true, fd, &bufs, sizeof(VisionBuf) * num_fds, fds, num_fds, nullptr);
+    // the shared stream state goes after the buffers
+    fds[num_fds] = stream_shared[type]->fd;
+
+    r = ipc_sendrecv_with_fds(true, fd, &bufs, sizeof(VisionBuf) * num_fds, fds, num_fds + 1, nullptr);
 
     close(fd);
   }
@@ -165,11 +184,41 @@ void VisionIpcServer::listener(){
 
 
 
+VisionIpcStreamShared * VisionIpcServer::shared_state(VisionStreamType type) {
+  return (VisionIpcStreamShared*)stream_shared.at(type)->addr;
+}
+
 VisionBuf * VisionIpcServer::get_buffer(VisionStreamType type){
-  // Do we want to keep track if the buffer has been sent out yet and warn user?
   assert(buffers.count(type));
-  auto b = buffers[type];
-  return b[cur_idx[type]++ % b.size()];
+  auto &b = buffers[type];
+  auto &sent = sent_count[type];
+  VisionIpcStreamShared *state = shared_state(type);
+
+  auto reusable = [&](VisionBuf *buf) {
+    if (buf->in_use()) return false;
+    for (auto &slot : state->slots) {
+      if (slot.pid && slot.priority && sent[buf->idx] == slot.received + 1) return false;
+    }
+    return true;
+  };
+
+  // Skip buffers that are still held by a client or have the frame a priority client
+  // receives next, so it gets an intact one however far behind it is. If none is left
+  // (or a client died holding one) fall back to plain round robin.
+  VisionBuf *buf = b[cur_idx[type]++ % b.size()];
+  for (size_t i = 1; i < b.size() && !reusable(buf); i++) {
+    buf = b[cur_idx[type]++ % b.size()];
+  }
+
+  // clients that haven't received the frame in it yet won't
+  for (auto &slot : state->slots) {
+    if (slot.pid && slot.received < sent[buf->idx]) {
+      slot.missed.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  buf->begin_write();
+  return buf;
 }
 
 void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync){
@@ -180,14 +229,41 @@ void VisionIpcServer::send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync
   }
   assert(buffers.count(buf->type));
   assert(buf->idx < buffers[buf->type].size());
+  buf->end_write();
+
+  VisionIpcStreamShared *state = shared_state(buf->type);
+  const uint64_t count = state->sent.load(std::memory_order_relaxed) + 1;
+  sent_count[buf->type][buf->idx] = count;
 
-  // Send over correct msgq socket
-  VisionIpcPacket packet = {0};
+  // Announce it in the ring, clients see it once sent is bumped
+  VisionIpcPacket &packet = state->ring[count % VISIONIPC_RING_SIZE];
   packet.server_id = server_id;
   packet.idx = buf->idx;
+  packet.seq = buf->seq;
+  packet.count = count;
   packet.extra = *extra;
+  state->sent.store(count, std::memory_order_release);
 
-  sockets[buf->type]->send((char*)&packet, sizeof(packet));
+  state->futex.fetch_add(1, std::memory_order_release);
+  ipc_futex_wake(&state->futex);
+}
+
+std::vector<VisionIpcClientStats> VisionIpcServer::get_client_stats(VisionStreamType type) {
+  VisionIpcStreamShared *state = shared_state(type);
+  const uint64_t sent = state->sent;
+
+  std::vector<VisionIpcClientStats> stats;
+  for (auto &slot : state->slots) {
+    int pid = slot.pid;
+    if (pid == 0) continue;
+    stats.push_back({
+      .pid = pid,
+      .priority = slot.priority,
+      .lag = sent - std::min<uint64_t>(slot.received, sent),
+      .missed = slot.missed,
+    });
+  }
+  return stats;
 }
 
 VisionIpcServer::~VisionIpcServer(){
@@ -204,9 +280,16 @@ VisionIpcServer::~VisionIpcServer(){
     }
   }
 
-  // Messaging cleanup
-  for (auto const& [type, sock] : sockets) {
-    delete sock;
+  // Clients still mapping the stream state see it closed
+  for (auto const& [type, shared] : stream_shared) {
+    VisionIpcStreamShared *state = (VisionIpcStreamShared*)shared->addr;
+    state->closed = true;
+    state->futex.fetch_add(1, std::memory_order_release);
+    ipc_futex_wake(&state->futex);
+
+    if (shared->free() != 0) {
+      LOGE("Failed to free stream state");
+    }
+    delete shared;
   }
-  delete msg_ctx;
 }
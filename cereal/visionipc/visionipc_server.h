@@ -11,6 +11,13 @@
 
 std::string get_endpoint_name(std::string name, VisionStreamType type);
 
+struct VisionIpcClientStats {
+  int pid;
+  bool priority;
+  uint64_t lag;     // frames sent since the last one it received
+  uint64_t missed;  // frames overwritten before it received them
+};
+
 class VisionIpcServer {
  private:
   cl_device_id device_id = nullptr;
@@ -23,9 +30,12 @@ class VisionIpcServer {
 
   std::map<VisionStreamType, std::atomic<size_t> > cur_idx;
   std::map<VisionStreamType, std::vector<VisionBuf*> > buffers;
+  std::map<VisionStreamType, std::vector<VisionStreamType> > derived;
 
-  Context * msg_ctx;
-  std::map<VisionStreamType, PubSocket*> sockets;
+  // the frame ring and clients of each stream, and the count of the frame last sent from each buffer
+  std::map<VisionStreamType, VisionBuf*> stream_shared;
+  std::map<VisionStreamType, std::vector<uint64_t> > sent_count;
+  VisionIpcStreamShared * shared_state(VisionStreamType type);
 
   void listener(void);
 
@@ -37,6 +47,12 @@ class VisionIpcServer {
 
   void create_buffers(VisionStreamType type, size_t num_buffers, bool rgb, size_t width, size_t height);
   void create_buffers_with_sizes(VisionStreamType type, size_t num_buffers, bool rgb, size_t width, size_t height, size_t size, size_t stride, size_t uv_offset);
+  // Derived streams are downscaled yuv copies of source, filled and sent by the producer alongside it
+  void create_derived_buffers(VisionStreamType type, VisionStreamType source, size_t num_buffers, size_t width, size_t height);
+  std::vector<VisionStreamType> get_derived_streams(VisionStreamType source);
   void send(VisionBuf * buf, VisionIpcBufExtra * extra, bool sync=true);
   void start_listener();
+
+  // Connected local clients, and how far behind the stream they are
+  std::vector<VisionIpcClientStats> get_client_stats(VisionStreamType type);
 };
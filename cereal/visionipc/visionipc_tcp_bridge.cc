@@ -0,0 +1,105 @@
+#include <cassert>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "cereal/visionipc/ipc.h"
+#include "cereal/visionipc/visionipc_client.h"
+
+// Serves one local visionipc stream to a remote VisionIpcClient over TCP.
+// Usage: visionipc_tcp_bridge <server name> <stream type> <port>
+// The remote side connects with VisionIpcClient("tcp://<device ip>:<port>", type, false).
+// Frames are only sent when the previous one has left the socket buffer, so a
+// slow link drops frames instead of building up latency.
+
+static volatile sig_atomic_t do_exit = 0;
+static void set_do_exit(int sig) {
+  do_exit = 1;
+}
+
+// Returns when the remote client disconnects or the local stream restarts,
+// in which case the remote reconnects and gets the new buffer layout.
+static void serve(VisionIpcClient &client, int fd) {
+  VisionBuf &info = client.buffers[0];
+  VisionIpcRemoteHeader header = {
+    .magic = VISIONIPC_REMOTE_MAGIC,
+    .rgb = info.rgb,
+    .width = info.width,
+    .height = info.height,
+    .stride = info.stride,
+    .uv_offset = info.uv_offset,
+    .len = info.len,
+  };
+  if (!ipc_write_all(fd, &header, sizeof(header))) return;
+
+  uint64_t sent = 0, dropped = 0;
+  while (!do_exit) {
+    VisionIpcBufExtra extra = {};
+    VisionBuf *buf = client.recv(&extra);
+    if (buf == nullptr) {
+      if (!client.connected) return;
+      continue;
+    }
+
+    struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+    int ret = poll(&pfd, 1, 0);
+    if (ret > 0 && (pfd.revents & (POLLERR | POLLHUP))) return;
+    if (ret <= 0 || !(pfd.revents & POLLOUT)) {
+      dropped++;
+      continue;
+    }
+
+    buf->acquire();
+    VisionIpcRemoteFrame frame = {.extra = extra, .len = buf->len};
+    bool ok = ipc_write_all(fd, &frame, sizeof(frame)) && ipc_write_all(fd, buf->addr, buf->len);
+    buf->release();
+    if (!ok) return;
+
+    if (++sent % 200 == 0) {
+      std::cout << "sent " << sent << " frames, dropped " << dropped << std::endl;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    std::cerr << "Usage: " << argv[0] << " <server name> <stream type> <port>" << std::endl;
+    return 1;
+  }
+  signal(SIGINT, set_do_exit);
+  signal(SIGTERM, set_do_exit);
+
+  const std::string name = argv[1];
+  const VisionStreamType type = (VisionStreamType)std::atoi(argv[2]);
+  int listen_fd = ipc_tcp_bind(std::atoi(argv[3]));
+
+  VisionIpcClient client(name, type, true);
+  while (!do_exit) {
+    struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+    if (poll(&pfd, 1, 100) <= 0) continue;
+
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) continue;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::cout << "remote client connected" << std::endl;
+
+    while (!do_exit && !client.connected && !client.connect(false)) {
+      usleep(100 * 1000);
+    }
+    if (!do_exit) serve(client, fd);
+
+    std::cout << "remote client disconnected" << std::endl;
+    close(fd);
+  }
+
+  close(listen_fd);
+  return 0;
+}
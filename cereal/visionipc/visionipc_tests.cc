@@ -146,3 +146,121 @@ TEST_CASE("Test conflate"){
   recv_buf = client.recv(&extra_recv);
   REQUIRE(recv_buf == nullptr);
 }
+
+TEST_CASE("Held buffers are not reused"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  VisionIpcBufExtra extra = {0};
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  server.send(buf, &extra);
+
+  VisionBuf * recv_buf = client.recv(&extra);
+  REQUIRE(recv_buf != nullptr);
+  recv_buf->acquire();
+  REQUIRE(recv_buf->is_intact());
+
+  // Both following frames skip the held buffer
+  for (int i = 0; i < 2; i++) {
+    VisionBuf * next = server.get_buffer(VISION_STREAM_ROAD);
+    REQUIRE(next->idx != buf->idx);
+    server.send(next, &extra);
+  }
+  REQUIRE(recv_buf->is_intact());
+
+  // Once released it is overwritten, which the client can detect
+  recv_buf->release();
+  REQUIRE(server.get_buffer(VISION_STREAM_ROAD)->idx == buf->idx);
+  server.send(buf, &extra);
+  REQUIRE(!recv_buf->is_intact());
+}
+
+TEST_CASE("Client lag is tracked"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  zmq_sleep();
+
+  auto stats = server.get_client_stats(VISION_STREAM_ROAD);
+  REQUIRE(stats.size() == 1);
+  REQUIRE(stats[0].pid == getpid());
+  REQUIRE(stats[0].lag == 0);
+
+  // Three frames into two buffers, the first is overwritten before the client reads it
+  VisionIpcBufExtra extra = {0};
+  for (int i = 0; i < 3; i++) {
+    server.send(server.get_buffer(VISION_STREAM_ROAD), &extra);
+  }
+  stats = server.get_client_stats(VISION_STREAM_ROAD);
+  REQUIRE(stats[0].lag == 3);
+  REQUIRE(stats[0].missed == 1);
+
+  for (int i = 0; i < 3; i++) {
+    REQUIRE(client.recv(&extra) != nullptr);
+  }
+  REQUIRE(server.get_client_stats(VISION_STREAM_ROAD)[0].lag == 0);
+}
+
+TEST_CASE("Priority client keeps its next frame"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 3, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+  client.set_priority(true);
+  zmq_sleep();
+
+  VisionIpcBufExtra extra = {0};
+  for (int i = 0; i < 3; i++) {
+    extra.frame_id = i;
+    server.send(server.get_buffer(VISION_STREAM_ROAD), &extra);
+  }
+
+  // Round robin would reuse the first buffer, which has the frame the client reads next
+  VisionBuf * buf = server.get_buffer(VISION_STREAM_ROAD);
+  REQUIRE(buf->idx == 1);
+  extra.frame_id = 3;
+  server.send(buf, &extra);
+
+  VisionBuf * recv_buf = client.recv(&extra);
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(recv_buf->idx == 0);
+  REQUIRE(extra.frame_id == 0);
+  REQUIRE(recv_buf->is_intact());
+  REQUIRE(server.get_client_stats(VISION_STREAM_ROAD)[0].missed == 1);
+}
+
+TEST_CASE("Recv wakes up on send"){
+  VisionIpcServer server("camerad");
+  server.create_buffers(VISION_STREAM_ROAD, 2, false, 100, 100);
+  server.start_listener();
+
+  VisionIpcClient client = VisionIpcClient("camerad", VISION_STREAM_ROAD, false);
+  REQUIRE(client.connect());
+
+  std::thread sender([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    VisionIpcBufExtra extra = {0};
+    extra.frame_id = 7;
+    server.send(server.get_buffer(VISION_STREAM_ROAD), &extra);
+  });
+
+  VisionIpcBufExtra extra = {0};
+  auto start = std::chrono::steady_clock::now();
+  VisionBuf * recv_buf = client.recv(&extra, 1000);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  sender.join();
+
+  REQUIRE(recv_buf != nullptr);
+  REQUIRE(extra.frame_id == 7);
+  REQUIRE(elapsed < std::chrono::milliseconds(500));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "third_party/json11/json11.hpp"
+
+// What a daemon bench reports, the same for every daemon so the numbers can be tracked
+// per release: CPU time per second of drive, handler latency percentiles and peak RSS.
+// The bench starts the report before it feeds the recorded inputs, times every handler
+// call with add() and calls finish() with how much drive the inputs covered.
+//
+//   BenchReport report("locationd");
+//   for (...) { auto t = report.now(); handle(e); report.add("carState", t); }
+//   report.finish(log_seconds);
+//   report.write(json_path);  // one JSON object, to stdout if the path is empty
+
+class BenchReport {
+public:
+  using clock = std::chrono::steady_clock;
+
+  BenchReport(const std::string &name) : name(name) {
+    start_cpu = cpu_seconds();
+    start_wall = clock::now();
+  }
+
+  static clock::time_point now() { return clock::now(); }
+
+  void add(const std::string &handler, clock::time_point started) {
+    add_ns(handler, std::chrono::duration<double, std::nano>(clock::now() - started).count());
+  }
+  void add_ns(const std::string &handler, double ns) {
+    latencies_us[handler].push_back(ns / 1e3);
+  }
+  // for numbers only the bench knows about, like filter rewinds
+  void set(const std::string &key, json11::Json value) {
+    extra[key] = value;
+  }
+
+  void finish(double drive_seconds) {
+    const double cpu = cpu_seconds() - start_cpu;
+    const double wall = std::chrono::duration<double>(clock::now() - start_wall).count();
+    struct rusage ru = {};
+    getrusage(RUSAGE_SELF, &ru);
+
+    std::vector<double> all;
+    json11::Json::object handlers;
+    for (auto &[handler, us] : latencies_us) {
+      all.insert(all.end(), us.begin(), us.end());
+      handlers[handler] = percentiles(us);
+    }
+
+    result = json11::Json::object{
+      {"name", name},
+      {"drive_seconds", drive_seconds},
+      {"wall_seconds", wall},
+      {"cpu_seconds", cpu},
+      {"cpu_per_drive_second", drive_seconds > 0 ? cpu / drive_seconds : 0.0},
+      {"peak_rss_kb", (double)ru.ru_maxrss},
+      {"latency_us", percentiles(all)},
+      {"handlers_us", handlers},
+    };
+    for (auto &[key, value] : extra) result[key] = value;
+  }
+
+  void write(const std::string &path) const {
+    const std::string s = json11::Json(result).dump();
+    FILE *f = path.empty() ? stdout : fopen(path.c_str(), "w");
+    if (!f) {
+      fprintf(stderr, "can't write %s\n", path.c_str());
+      return;
+    }
+    fprintf(f, "%s\n", s.c_str());
+    if (f != stdout) fclose(f);
+  }
+
+private:
+  static double cpu_seconds() {
+    struct rusage ru = {};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+  }
+
+  static json11::Json percentiles(std::vector<double> us) {
+    if (us.empty()) return json11::Json();
+    std::sort(us.begin(), us.end());
+    auto at = [&](double p) { return us[std::min(us.size() - 1, (size_t)(p / 100.0 * us.size()))]; };
+    return json11::Json::object{{"count", (double)us.size()}, {"p50", at(50)}, {"p99", at(99)}, {"max", us.back()}};
+  }
+
+  const std::string name;
+  double start_cpu;
+  clock::time_point start_wall;
+  std::map<std::string, std::vector<double>> latencies_us;
+  json11::Json::object extra;
+  json11::Json::object result;
+};
@@ -6,6 +6,7 @@
 
 #include "common/util.h"
 #include "common/swaglog.h"
+#include "system/hardware/hw.h"
 
 namespace {  // helper functions
 
@@ -53,6 +54,73 @@ void cl_print_build_errors(cl_program program, cl_device_id device) {
   LOGE("build failed; status=%d, log: %s", status, log.c_str());
 }
 
+uint64_t fnv1a64(const std::string &s, uint64_t hash = 14695981039346656037ull) {
+  for (unsigned char c : s) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// where the binary built from src with args goes. Everything the driver's output depends on
+// is in the name, so a new driver or changed kernel misses instead of loading a stale one.
+std::string cl_cache_path(cl_device_id device_id, const std::string &src, const char *args) {
+  cl_platform_id platform;
+  CL_CHECK(clGetDeviceInfo(device_id, CL_DEVICE_PLATFORM, sizeof(platform), &platform, NULL));
+  uint64_t hash = fnv1a64(src);
+  for (const std::string &s : {std::string(args ? args : ""),
+                               get_device_info(device_id, CL_DEVICE_NAME),
+                               get_device_info(device_id, CL_DEVICE_VERSION),
+                               get_device_info(device_id, CL_DRIVER_VERSION),
+                               get_platform_info(platform, CL_PLATFORM_VERSION)}) {
+    hash = fnv1a64(s + '\0', hash);
+  }
+  return util::string_format("%s/%016llx.bin", Path::cl_cache().c_str(), (unsigned long long)hash);
+}
+
+cl_program cl_program_from_cache(cl_context ctx, cl_device_id device_id, const std::string &path, const char* args) {
+  std::string binary = util::read_file(path);
+  if (binary.empty()) return nullptr;
+
+  const uint8_t *bin = (const uint8_t *)binary.data();
+  size_t length = binary.size();
+  cl_int err = CL_SUCCESS, status = CL_SUCCESS;
+  cl_program prg = clCreateProgramWithBinary(ctx, 1, &device_id, &length, &bin, &status, &err);
+  if (err == CL_SUCCESS && status == CL_SUCCESS && clBuildProgram(prg, 1, &device_id, args, NULL, NULL) == CL_SUCCESS) {
+    return prg;
+  }
+
+  // the driver won't take it, build again and replace it
+  LOGW("cached cl program %s rejected: %s", path.c_str(), cl_get_error_string(err != CL_SUCCESS ? err : status));
+  if (prg) clReleaseProgram(prg);
+  ::unlink(path.c_str());
+  return nullptr;
+}
+
+void cl_cache_program(cl_program prg, const std::string &path) {
+  size_t size = 0;
+  if (clGetProgramInfo(prg, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) != CL_SUCCESS || size == 0) {
+    return;
+  }
+  std::string binary(size, '\0');
+  unsigned char *bin = (unsigned char *)binary.data();
+  if (clGetProgramInfo(prg, CL_PROGRAM_BINARIES, sizeof(bin), &bin, NULL) != CL_SUCCESS) {
+    return;
+  }
+
+  // written next to it and moved into place, a process starting meanwhile never reads half of one
+  const std::string dir = Path::cl_cache();
+  std::string tmp_path = dir + "/.tmp_XXXXXX";
+  if (!util::create_directories(dir, 0775)) return;
+  int fd = mkstemp((char *)tmp_path.c_str());
+  if (fd < 0) return;
+  ssize_t written = HANDLE_EINTR(write(fd, binary.data(), binary.size()));
+  close(fd);
+  if (written != (ssize_t)binary.size() || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOGW("failed to cache cl program %s", path.c_str());
+    ::unlink(tmp_path.c_str());
+  }
+}
+
 }  // namespace
 
 cl_device_id cl_get_device_id(cl_device_type device_type) {
@@ -84,12 +152,25 @@ cl_program cl_program_from_file(cl_context ctx, cl_device_id device_id, const ch
 }
 
 cl_program cl_program_from_source(cl_context ctx, cl_device_id device_id, const std::string& src, const char* args) {
+  // binaries built before are loaded from the cache. A kernel that includes others could
+  // change without its source changing, those are always built.
+  const bool cacheable = src.find("#include") == std::string::npos;
+  const std::string cache_path = cacheable ? cl_cache_path(device_id, src, args) : "";
+  if (cacheable) {
+    if (cl_program prg = cl_program_from_cache(ctx, device_id, cache_path, args)) {
+      return prg;
+    }
+  }
+
   const char *csrc = src.c_str();
   cl_program prg = CL_CHECK_ERR(clCreateProgramWithSource(ctx, 1, &csrc, NULL, &err));
   if (int err = clBuildProgram(prg, 1, &device_id, args, NULL, NULL); err != 0) {
     cl_print_build_errors(prg, device_id);
     assert(0);
   }
+  if (cacheable) {
+    cl_cache_program(prg, cache_path);
+  }
   return prg;
 }
 
@@ -5,7 +5,9 @@
 #include <unistd.h>
 
 #include <cassert>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <stdexcept>
 
 #include "common/swaglog.h"
@@ -14,10 +16,9 @@
 #define UNUSED(x) (void)(x)
 
 #ifdef QCOM2
-// TODO: decide if we want to install libi2c-dev everywhere
 extern "C" {
+  #include <linux/i2c.h>
   #include <linux/i2c-dev.h>
-  #include <i2c/smbus.h>
 }
 
 I2CBus::I2CBus(uint8_t bus_id) {
@@ -37,33 +38,44 @@ I2CBus::~I2CBus() {
 }
 
 int I2CBus::read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) {
-  std::lock_guard lk(m);
-
-  int ret = 0;
-
-  ret = HANDLE_EINTR(ioctl(i2c_fd, I2C_SLAVE, device_address));
-  if (ret < 0) { goto fail; }
-
-  ret = i2c_smbus_read_i2c_block_data(i2c_fd, register_address, len, buffer);
-  if ((ret < 0) || (ret != len)) { goto fail; }
-
-fail:
-  return ret;
+  I2CAccess access = {.register_address = register_address, .buffer = buffer, .len = len};
+  int ret = transfer(device_address, &access, 1);
+  return ret < 0 ? ret : len;
 }
 
 int I2CBus::set_register(uint8_t device_address, uint register_address, uint8_t data) {
-  std::lock_guard lk(m);
-
-  int ret = 0;
-
-  ret = HANDLE_EINTR(ioctl(i2c_fd, I2C_SLAVE, device_address));
-  if (ret < 0) { goto fail; }
+  I2CAccess access = {.register_address = register_address, .buffer = &data, .len = 1, .write = true};
+  return transfer(device_address, &access, 1);
+}
 
-  ret = i2c_smbus_write_byte_data(i2c_fd, register_address, data);
-  if (ret < 0) { goto fail; }
+// The address goes with every message, so there's no I2C_SLAVE ioctl to select the
+// device, and a read is the register write and the data read in the same ioctl
+int I2CBus::transfer(uint8_t device_address, const I2CAccess *accesses, size_t count) {
+  struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+  // register addresses of the reads, register address and data of the writes
+  uint8_t out[I2C_RDWR_IOCTL_MAX_MSGS * (UINT8_MAX + 1)];
+  size_t num_msgs = 0, out_len = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    const I2CAccess &a = accesses[i];
+    if (num_msgs + (a.write ? 1 : 2) > I2C_RDWR_IOCTL_MAX_MSGS) return -EINVAL;
+
+    uint8_t *o = &out[out_len];
+    o[0] = a.register_address;
+    const size_t o_len = a.write ? a.len + 1 : 1;
+    if (a.write) memcpy(o + 1, a.buffer, a.len);
+    out_len += o_len;
+
+    msgs[num_msgs++] = {.addr = device_address, .flags = 0, .len = (uint16_t)o_len, .buf = o};
+    if (!a.write) {
+      msgs[num_msgs++] = {.addr = device_address, .flags = I2C_M_RD, .len = a.len, .buf = a.buffer};
+    }
+  }
 
-fail:
-  return ret;
+  struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = (uint32_t)num_msgs};
+  std::lock_guard lk(m);
+  int ret = HANDLE_EINTR(ioctl(i2c_fd, I2C_RDWR, &data));
+  return ret < 0 ? -errno : 0;
 }
 
 #else
@@ -89,4 +101,11 @@ int I2CBus::set_register(uint8_t device_address, uint register_address, uint8_t
   UNUSED(data);
   return -1;
 }
+
+int I2CBus::transfer(uint8_t device_address, const I2CAccess *accesses, size_t count) {
+  UNUSED(device_address);
+  UNUSED(accesses);
+  UNUSED(count);
+  return -1;
+}
 #endif
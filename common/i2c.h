@@ -1,10 +1,20 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <mutex>
 
 #include <sys/types.h>
 
+// One register access of a transfer, a block read of len bytes from register_address
+// into buffer, or with write a write of len bytes from buffer starting at it
+struct I2CAccess {
+  uint register_address;
+  uint8_t *buffer;
+  uint8_t len;
+  bool write = false;
+};
+
 class I2CBus {
   private:
     int i2c_fd;
@@ -16,4 +26,6 @@ class I2CBus {
 
     int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
     int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    // All accesses in one I2C_RDWR ioctl, with repeated starts between them. Returns 0 or the error
+    int transfer(uint8_t device_address, const I2CAccess *accesses, size_t count);
 };
@@ -0,0 +1,112 @@
+#include "common/logring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring is shared between processes");
+static_assert((LOG_RING_SLOTS & (LOG_RING_SLOTS - 1)) == 0, "LOG_RING_SLOTS must be a power of two");
+
+// not the boot clock of timing.h, which follows a replay's simulated time
+static uint64_t monotonic_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000ULL + t.tv_nsec / 1000000;
+}
+
+std::string log_ring_path(const std::string &endpoint) {
+  const std::string ipc = "ipc:///tmp/";
+  return "/dev/shm/" + (endpoint.rfind(ipc, 0) == 0 ? endpoint.substr(ipc.size()) : endpoint);
+}
+
+LogRing::LogRing(const std::string &path, bool create) {
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0666);
+  if (fd < 0) return;
+
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && create && st.st_size != sizeof(LogRingData)) {
+    // new, or of another layout: start over from an empty ring
+    fchmod(fd, 0666);
+    ok = ftruncate(fd, 0) == 0 && ftruncate(fd, sizeof(LogRingData)) == 0;
+  } else if (ok && st.st_size != sizeof(LogRingData)) {
+    ok = false;
+  }
+  if (ok) {
+    void *p = mmap(nullptr, sizeof(LogRingData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) ring = (LogRingData *)p;
+  }
+  close(fd);
+}
+
+LogRing::~LogRing() {
+  if (ring) munmap(ring, sizeof(LogRingData));
+}
+
+// the sequence numbers are stored minus the slot index, see logring.h
+bool LogRing::push(const char *data, size_t size) {
+  uint64_t pos = ring->write_pos.load(std::memory_order_relaxed);
+  LogRingSlot *slot;
+  uint64_t idx;
+  while (true) {
+    idx = pos & (LOG_RING_SLOTS - 1);
+    slot = &ring->slots[idx];
+    int64_t dif = (int64_t)(slot->seq.load(std::memory_order_acquire) + idx - pos);
+    if (dif == 0) {
+      if (ring->write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (dif < 0) {
+      add_dropped(1);
+      return false;
+    } else {
+      pos = ring->write_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  memcpy(slot->data, data, size);
+  slot->size = size;
+  // fails only when the reader gave up on this slot, after LOG_RING_STALE_MS
+  uint64_t expected = pos - idx;
+  if (!slot->seq.compare_exchange_strong(expected, pos + 1 - idx, std::memory_order_release, std::memory_order_relaxed)) {
+    add_dropped(1);
+    return false;
+  }
+  return true;
+}
+
+bool LogRing::pop(std::string &out) {
+  const uint64_t pos = ring->read_pos.load(std::memory_order_relaxed);
+  const uint64_t idx = pos & (LOG_RING_SLOTS - 1);
+  LogRingSlot *slot = &ring->slots[idx];
+
+  if (slot->seq.load(std::memory_order_acquire) + idx == pos + 1) {
+    out.assign(slot->data, std::min<size_t>(slot->size, sizeof(slot->data)));
+    slot->seq.store(pos + LOG_RING_SLOTS - idx, std::memory_order_release);
+    ring->read_pos.store(pos + 1, std::memory_order_relaxed);
+    stalled_pos = UINT64_MAX;
+    return true;
+  }
+  if (ring->write_pos.load(std::memory_order_acquire) <= pos) return false;
+
+  // taken by a writer that hasn't finished yet
+  const uint64_t now = monotonic_ms();
+  if (stalled_pos != pos) {
+    stalled_pos = pos;
+    stalled_since = now;
+    return false;
+  }
+  if (now - stalled_since < LOG_RING_STALE_MS) return false;
+
+  uint64_t expected = pos - idx;
+  if (slot->seq.compare_exchange_strong(expected, pos + LOG_RING_SLOTS - idx, std::memory_order_acq_rel)) {
+    add_dropped(1);
+    ring->read_pos.store(pos + 1, std::memory_order_relaxed);
+  }
+  // either way the slot at pos is done with or readable now
+  stalled_pos = UINT64_MAX;
+  return pop(out);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared memory ring for log and metric records, any number of writers in any number
+// of processes and one reader, the daemon that drains it. A write is a compare and swap
+// and a copy into a fixed size slot, nothing locks or makes a syscall, so it can be
+// done from a realtime thread. When the ring is full the record is dropped and counted
+// in the ring, the reader reports the count.
+//
+// The reader creates the ring, writers attach to it when they start logging and fall
+// back to the zmq socket when it isn't there or a record is bigger than a slot.
+// Every slot has a sequence number like the slots of MPMCQueue in common/queue.h, kept
+// relative to the slot index so a zeroed file is an empty ring.
+
+#define LOG_RING_SLOTS 1024
+#define LOG_RING_SLOT_SIZE 1024
+// a slot whose writer hasn't finished by then is taken back, it died mid write
+#define LOG_RING_STALE_MS 1000
+
+struct LogRingSlot {
+  std::atomic<uint64_t> seq;
+  uint32_t size;
+  char data[LOG_RING_SLOT_SIZE - sizeof(uint64_t) - sizeof(uint32_t)];
+};
+
+struct LogRingData {
+  alignas(64) std::atomic<uint64_t> write_pos;
+  alignas(64) std::atomic<uint64_t> read_pos;
+  std::atomic<uint64_t> dropped;
+  alignas(64) LogRingSlot slots[LOG_RING_SLOTS];
+};
+
+// the ring of a zmq ipc endpoint, /dev/shm/logmessage for ipc:///tmp/logmessage
+std::string log_ring_path(const std::string &endpoint);
+
+class LogRing {
+public:
+  // the reader creates the file, a writer only opens it
+  LogRing(const std::string &path, bool create);
+  ~LogRing();
+  bool valid() const { return ring != nullptr; }
+  static bool fits(size_t size) { return size <= sizeof(LogRingSlot::data); }
+
+  // a record that fits, false if the ring is full and it was dropped
+  bool push(const char *data, size_t size);
+  void add_dropped(uint64_t n) { ring->dropped.fetch_add(n, std::memory_order_relaxed); }
+
+  // reader only. False when there's nothing to read
+  bool pop(std::string &out);
+  // dropped since the last call
+  uint64_t take_dropped() { return ring->dropped.exchange(0, std::memory_order_relaxed); }
+
+private:
+  LogRingData *ring = nullptr;
+  uint64_t stalled_pos = UINT64_MAX;
+  uint64_t stalled_since = 0;
+};
@@ -0,0 +1,42 @@
+# distutils: language = c++
+# cython: language_level = 3
+from libcpp cimport bool
+from libcpp.string cimport string
+from libc.stdint cimport uint64_t
+
+cdef extern from "common/logring.h":
+  string log_ring_path(string)
+
+  cdef cppclass c_LogRing "LogRing":
+    c_LogRing(string, bool) except +
+    bool valid()
+    bool pop(string &) nogil
+    uint64_t take_dropped()
+
+
+cdef class LogRingReader:
+  """The reading end of the shared memory ring of a zmq ipc endpoint, for the daemon
+  that drains the endpoint. Creates the ring, the C++ writers that start after it use it."""
+  cdef c_LogRing *ring
+
+  def __cinit__(self, endpoint):
+    self.ring = new c_LogRing(log_ring_path(endpoint.encode()), True)
+
+  def __dealloc__(self):
+    del self.ring
+
+  def valid(self):
+    return self.ring.valid()
+
+  def read(self, int max_records=1024):
+    cdef string record
+    out = []
+    if not self.ring.valid():
+      return out
+    while len(out) < max_records and self.ring.pop(record):
+      out.append(<bytes>record)
+    return out
+
+  def take_dropped(self):
+    """records dropped since the last call, because the ring was full"""
+    return self.ring.take_dropped() if self.ring.valid() else 0
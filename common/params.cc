@@ -2,12 +2,24 @@
 
 #include <dirent.h>
 #include <sys/file.h>
+#ifdef __linux__
+#include <linux/magic.h>
+#include <sys/vfs.h>
+#endif
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <csignal>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
+#include "common/params_cache.h"
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 
@@ -61,6 +73,15 @@ bool create_params_path(const std::string &param_path, const std::string &key_pa
   return true;
 }
 
+bool is_tmpfs(const std::string &path) {
+#ifdef __linux__
+  struct statfs st;
+  return statfs(path.c_str(), &st) == 0 && st.f_type == TMPFS_MAGIC;
+#else
+  return false;
+#endif
+}
+
 std::string ensure_params_path(const std::string &prefix, const std::string &path = {}) {
   std::string params_path = path.empty() ? Path::params() : path;
   if (!create_params_path(params_path, params_path + prefix)) {
@@ -95,6 +116,7 @@ std::unordered_map<std::string, uint32_t> keys = {
     {"CalibrationParams", PERSISTENT},
     {"CameraDebugExpGain", CLEAR_ON_MANAGER_START},
     {"CameraDebugExpTime", CLEAR_ON_MANAGER_START},
+    {"CameraRawDump", CLEAR_ON_MANAGER_START},
     {"CarBatteryCapacity", PERSISTENT},
     {"CarParams", CLEAR_ON_MANAGER_START | CLEAR_ON_ONROAD_TRANSITION},
     {"CarParamsCache", CLEAR_ON_MANAGER_START},
@@ -275,6 +297,7 @@ std::unordered_map<std::string, uint32_t> keys = {
     {"LowerVolt", PERSISTENT},
     {"MapboxPublicKey", PERSISTENT},
     {"MapboxSecretKey", PERSISTENT},
+    {"MapLowResolution", PERSISTENT},
     {"MapOpen", PERSISTENT},
     {"MapSpeedLimit", PERSISTENT},
     {"MapSpeedLimitControl", PERSISTENT},
@@ -332,12 +355,125 @@ std::unordered_map<std::string, uint32_t> keys = {
     {"WideCameraDisable", PERSISTENT},
 };
 
+const std::vector<std::string> &sorted_keys() {
+  static const std::vector<std::string> sorted = [] {
+    std::vector<std::string> ret;
+    for (auto &p : keys) {
+      ret.push_back(p.first);
+    }
+    std::sort(ret.begin(), ret.end());
+    return ret;
+  }();
+  return sorted;
+}
+
 } // namespace
 
+// Writes the non blocking puts of the process, on a thread of its own started by the first
+// one. A key that's put again while queued is written once, with the latest value, after
+// everything put before it. So other processes see the puts in the order they were made,
+// like when each of them blocked, just not every value in between.
+class ParamsWriter {
+public:
+  static ParamsWriter &instance() {
+    // started on first use, so it's torn down before the keys and writes out what's left
+    static ParamsWriter writer;
+    return writer;
+  }
+
+  ~ParamsWriter() {
+    {
+      std::lock_guard lk(lock);
+      do_exit = true;
+    }
+    cv.notify_one();
+    if (thread.joinable()) thread.join();
+  }
+
+  void queue(const std::string &path, const std::string &key, const std::string &value) {
+    {
+      std::lock_guard lk(lock);
+      const std::string id = path + "/" + key;
+      if (auto it = index.find(id); it != index.end()) {
+        queued.erase(it->second);
+      }
+      index[id] = queued.insert(queued.end(), {path, key, value, ++seq});
+      num_queued = queued.size();
+      if (!thread.joinable()) thread = std::thread(&ParamsWriter::run, this);
+    }
+    cv.notify_one();
+  }
+
+  // the value queued for key, it's only dropped once written
+  bool pending(const std::string &path, const std::string &key, std::string &value) {
+    if (num_queued == 0) return false;
+    std::lock_guard lk(lock);
+    auto it = index.find(path + "/" + key);
+    if (it == index.end()) return false;
+    value = it->second->value;
+    return true;
+  }
+
+  // a blocking put or remove of key supersedes what's queued for it
+  void cancel(const std::string &path, const std::string &key) {
+    if (num_queued == 0) return;
+    std::lock_guard lk(lock);
+    if (auto it = index.find(path + "/" + key); it != index.end()) {
+      queued.erase(it->second);
+      index.erase(it);
+      num_queued = queued.size();
+    }
+  }
+
+private:
+  struct Write {
+    std::string path, key, value;
+    uint64_t seq;
+  };
+
+  ParamsWriter() = default;
+
+  void run() {
+    std::map<std::string, std::unique_ptr<Params>> params;
+    std::unique_lock lk(lock);
+    while (true) {
+      cv.wait(lk, [this] { return do_exit || !queued.empty(); });
+      if (queued.empty()) break;
+
+      const Write w = queued.front();
+      lk.unlock();
+      auto &p = params[w.path];
+      if (!p) p = std::make_unique<Params>(w.path);
+      if (p->putSync(w.key.c_str(), w.value.data(), w.value.size()) != 0) {
+        LOGE("Failed to write param %s to %s", w.key.c_str(), w.path.c_str());
+      }
+      lk.lock();
+
+      // unless it was put again or cancelled meanwhile
+      const std::string id = w.path + "/" + w.key;
+      if (auto it = index.find(id); it != index.end() && it->second->seq == w.seq) {
+        queued.erase(it->second);
+        index.erase(it);
+        num_queued = queued.size();
+      }
+    }
+  }
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::list<Write> queued;
+  std::unordered_map<std::string, std::list<Write>::iterator> index;
+  std::atomic<size_t> num_queued = 0;  // lets reads skip the lock when nothing is queued
+  uint64_t seq = 0;
+  bool do_exit = false;
+  std::thread thread;
+};
 
 Params::Params(const std::string &path) {
   prefix = "/" + util::getenv("OPENPILOT_PREFIX", "d");
   params_path = ensure_params_path(prefix, path);
+  cache = ParamsCache::get(getParamPath(), sorted_keys());
+  fsync_writes = !is_tmpfs(params_path);
 }
 
 std::vector<std::string> Params::allKeys() const {
@@ -357,6 +493,17 @@ ParamKeyType Params::getKeyType(const std::string &key) {
 }
 
 int Params::put(const char* key, const char* value, size_t value_size) {
+  ParamsWriter::instance().cancel(params_path, key);
+  return putSync(key, value, value_size);
+}
+
+void Params::putNonBlocking(const std::string &key, const std::string &val) {
+  if (read(key) != val) {
+    ParamsWriter::instance().queue(params_path, key, val);
+  }
+}
+
+int Params::putSync(const char* key, const char* value, size_t value_size) {
   // Information about safely and atomically writing a file: https://lwn.net/Articles/457667/
   // 1) Create temp file
   // 2) Write data to temp file
@@ -377,15 +524,16 @@ int Params::put(const char* key, const char* value, size_t value_size) {
     }
 
     // fsync to force persist the changes.
-    if ((result = fsync(tmp_fd)) < 0) break;
+    if (fsync_writes && (result = fsync(tmp_fd)) < 0) break;
 
     FileLock file_lock(params_path + "/.lock");
 
     // Move temp into place.
     if ((result = rename(tmp_path.c_str(), getParamPath(key).c_str())) < 0) break;
+    if (cache) cache->update(key, value, value_size);
 
     // fsync parent directory
-    result = fsync_dir(getParamPath());
+    result = fsync_writes ? fsync_dir(getParamPath()) : 0;
   } while (false);
 
   close(tmp_fd);
@@ -393,18 +541,88 @@ int Params::put(const char* key, const char* value, size_t value_size) {
   return result;
 }
 
+int Params::putMany(const std::map<std::string, std::string> &values, double *commit_ms) {
+  // the steps of put, each for all values at once
+  // 1) write and fsync a temp file per value
+  // 2) rename them all into place under one lock
+  // 3) fsync the containing directory once
+  const double start = millis_since_boot();
+  std::vector<std::pair<const std::string *, std::string>> tmp_paths;
+  int result = 0;
+  for (const auto &[key, value] : values) {
+    ParamsWriter::instance().cancel(params_path, key);
+
+    std::string tmp_path = params_path + "/.tmp_value_XXXXXX";
+    int tmp_fd = mkstemp((char*)tmp_path.c_str());
+    if (tmp_fd < 0) {
+      result = -1;
+      break;
+    }
+    tmp_paths.push_back({&key, tmp_path});
+
+    ssize_t bytes_written = HANDLE_EINTR(write(tmp_fd, value.data(), value.size()));
+    if (bytes_written < 0 || (size_t)bytes_written != value.size()) {
+      result = -20;
+    } else if (fsync_writes) {
+      result = fsync(tmp_fd);
+    }
+    close(tmp_fd);
+    if (result < 0) break;
+  }
+
+  if (result == 0) {
+    FileLock file_lock(params_path + "/.lock");
+    for (const auto &[key, tmp_path] : tmp_paths) {
+      if ((result = rename(tmp_path.c_str(), getParamPath(*key).c_str())) < 0) break;
+      if (cache) {
+        const std::string &value = values.at(*key);
+        cache->update(*key, value.data(), value.size());
+      }
+    }
+    if (result == 0 && fsync_writes) {
+      result = fsync_dir(getParamPath());
+    }
+  }
+
+  // only the ones that weren't moved into place are left
+  for (const auto &p : tmp_paths) {
+    ::unlink(p.second.c_str());
+  }
+  if (commit_ms) *commit_ms = millis_since_boot() - start;
+  return result;
+}
+
 int Params::remove(const std::string &key) {
+  ParamsWriter::instance().cancel(params_path, key);
   FileLock file_lock(params_path + "/.lock");
   int result = unlink(getParamPath(key).c_str());
   if (result != 0) {
     return result;
   }
-  return fsync_dir(getParamPath());
+  if (cache) cache->update(key, "", 0);
+  return fsync_writes ? fsync_dir(getParamPath()) : 0;
+}
+
+std::string Params::read(const std::string &key) {
+  std::string value;
+  if (ParamsWriter::instance().pending(params_path, key, value)) {
+    return value;
+  }
+  ParamsCache::ReadResult cached = cache ? cache->read(key, value) : ParamsCache::UNCACHED;
+  if (cached == ParamsCache::MISS) {
+    // read under the lock, a put can't land between reading the file and caching it
+    FileLock file_lock(params_path + "/.lock");
+    value = util::read_file(getParamPath(key));
+    cache->fill(key, value);
+  } else if (cached == ParamsCache::UNCACHED) {
+    value = util::read_file(getParamPath(key));
+  }
+  return value;
 }
 
 std::string Params::get(const std::string &key, bool block) {
   if (!block) {
-    return util::read_file(getParamPath(key));
+    return read(key);
   } else {
     // blocking read until successful
     params_do_exit = 0;
@@ -413,10 +631,11 @@ std::string Params::get(const std::string &key, bool block) {
 
     std::string value;
     while (!params_do_exit) {
-      if (value = util::read_file(getParamPath(key)); !value.empty()) {
+      uint32_t last_version = version();
+      if (value = read(key); !value.empty()) {
         break;
       }
-      util::sleep_for(100);  // 0.1 s
+      waitForChange(last_version, 100);  // 0.1 s, to check for a signal
     }
 
     std::signal(SIGINT, prev_handler_sigint);
@@ -427,7 +646,15 @@ std::string Params::get(const std::string &key, bool block) {
 
 std::map<std::string, std::string> Params::readAll() {
   FileLock file_lock(params_path + "/.lock");
-  return util::read_files_in_dir(getParamPath());
+  std::map<std::string, std::string> values = util::read_files_in_dir(getParamPath());
+  // every known key, a missing file is cached as empty like a remove
+  if (cache) {
+    for (const auto &[key, type] : keys) {
+      auto it = values.find(key);
+      cache->fill(key, it != values.end() ? it->second : "");
+    }
+  }
+  return values;
 }
 
 void Params::clearAll(ParamKeyType key_type) {
@@ -448,5 +675,20 @@ void Params::clearAll(ParamKeyType key_type) {
     closedir(d);
   }
 
-  fsync_dir(getParamPath());
+  if (cache) cache->invalidate_all();
+  if (fsync_writes) fsync_dir(getParamPath());
+}
+
+uint32_t Params::version() {
+  static std::atomic<uint32_t> uncached_version = 0;
+  return cache ? cache->version() : uncached_version++;
+}
+
+bool Params::waitForChange(uint32_t last_version, int timeout_ms) {
+  if (!cache) {
+    // nothing to wait on, report a change after the timeout so callers poll
+    util::sleep_for(timeout_ms >= 0 ? timeout_ms : 100);
+    return true;
+  }
+  return cache->wait(last_version, timeout_ms);
 }
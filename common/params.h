@@ -1,10 +1,12 @@
 #pragma once
 
-#include <future>
 #include <map>
 #include <string>
 #include <vector>
 
+class ParamsCache;
+class ParamsWriter;
+
 enum ParamKeyType {
   PERSISTENT = 0x02,
   CLEAR_ON_MANAGER_START = 0x04,
@@ -41,8 +43,17 @@ public:
     std::string value = get(key, block);
     return value.empty() ? 0 : std::stoi(value);
   }
+  // one pass over the directory, which also fills the shared cache so the gets after it are
+  // memory reads
   std::map<std::string, std::string> readAll();
 
+  // change notification, bumped by every put, remove and clearAll on these params from any
+  // process. Without the shared cache every call returns a new version, so callers that
+  // refresh on a change fall back to refreshing every time.
+  uint32_t version();
+  // waits until version() isn't last_version, false if timeout_ms (-1 for none) passes first
+  bool waitForChange(uint32_t last_version, int timeout_ms = -1);
+
   // helpers for writing values
   int put(const char *key, const char *val, size_t value_size);
   inline int put(const std::string &key, const std::string &val) {
@@ -54,14 +65,28 @@ public:
   inline int putInt(const std::string &key, int val) {
     return put(key.c_str(), std::to_string(val).c_str(), std::to_string(val).size());
   }
+  // writes all of values taking the lock once and syncing the directory once, for bulk
+  // changes. Not atomic: after a failure partway the keys moved into place before it stay
+  // written. commit_ms, if given, is set to how long the whole write took.
+  int putMany(const std::map<std::string, std::string> &values, double *commit_ms = nullptr);
+  // queued for a background writer shared by the whole process, in order. Only the latest
+  // value per key is written and values that are already set are dropped. Gets in this
+  // process see a queued value right away, other processes once it's written.
+  void putNonBlocking(const std::string &key, const std::string &val);
   inline void putBoolNonBlocking(const std::string &key, bool val) {
-    std::async(std::launch::async, [this, &key, val] { put(key, val ? "1" : "0"); }).get();
+    putNonBlocking(key, val ? "1" : "0");
   }
   inline void putIntNonBlocking(const std::string &key, int val) {
-    std::async(std::launch::async, [this, &key, val] { put(key, std::to_string(val)); }).get();
+    putNonBlocking(key, std::to_string(val));
   }
 
 private:
+  friend class ParamsWriter;
+  int putSync(const char *key, const char *val, size_t value_size);  // put, without cancelling a queued write
+  std::string read(const std::string &key);
+
   std::string params_path;
   std::string prefix;
+  ParamsCache *cache = nullptr;  // shared by every Params on this path in the process
+  bool fsync_writes = true;  // not on tmpfs, where there's nothing to persist
 };
@@ -0,0 +1,190 @@
+#include "common/params_cache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
+
+namespace {
+
+const uint32_t CACHE_MAGIC = 0x50524d43;  // "PRMC"
+
+// cleared on boot, like the caches should be
+#ifdef __linux__
+const char *CACHE_DIR = "/dev/shm";
+#else
+const char *CACHE_DIR = "/tmp";
+#endif
+
+uint32_t fnv1a(const std::string &s, uint32_t hash = 2166136261u) {
+  for (unsigned char c : s) {
+    hash = (hash ^ c) * 16777619u;
+  }
+  return hash;
+}
+
+uint32_t layout_hash(const std::vector<std::string> &sorted_keys) {
+  uint32_t hash = fnv1a(std::to_string(ParamsCache::VALUE_SIZE));
+  for (const std::string &key : sorted_keys) {
+    hash = fnv1a(key + "\n", hash);
+  }
+  return hash;
+}
+
+} // namespace
+
+ParamsCache *ParamsCache::get(const std::string &dir, const std::vector<std::string> &sorted_keys) {
+  static std::mutex caches_lock;
+  static std::map<std::string, ParamsCache *> caches;
+
+  // a directory that's deleted and made again gets a new inode, and so a new cache
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0) return nullptr;
+  std::string path = util::string_format("%s/.params_cache_%08x_%llu", CACHE_DIR, fnv1a(dir), (unsigned long long)st.st_ino);
+
+  std::lock_guard lk(caches_lock);
+  if (auto it = caches.find(path); it != caches.end()) {
+    return it->second;
+  }
+
+  ParamsCache *cache = nullptr;
+  const size_t size = sizeof(Header) + sorted_keys.size() * sizeof(Slot);
+  int fd = HANDLE_EINTR(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666));
+  if (fd >= 0) {
+    // only a new, empty file is sized. one of another size was made for other keys
+    struct stat fst;
+    if (fstat(fd, &fst) == 0 && ((size_t)fst.st_size == size || (fst.st_size == 0 && ftruncate(fd, size) == 0))) {
+      void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (mem != MAP_FAILED) {
+        cache = new ParamsCache(mem, sorted_keys);
+        if (cache->header->layout != layout_hash(sorted_keys) || cache->header->num_slots != sorted_keys.size()) {
+          LOGW("params cache %s was made for other keys, not using it", path.c_str());
+          munmap(mem, size);
+          delete cache;
+          cache = nullptr;
+        }
+      }
+    }
+    close(fd);
+  }
+  if (cache == nullptr) {
+    LOGW("params cache unavailable for %s, reading from disk", dir.c_str());
+  }
+  caches[path] = cache;
+  return cache;
+}
+
+ParamsCache::ParamsCache(void *mem, const std::vector<std::string> &sorted_keys) {
+  this->header = (Header *)mem;
+  this->slots = (Slot *)((char *)mem + sizeof(Header));
+  for (size_t i = 0; i < sorted_keys.size(); i++) {
+    this->slot_of_key[sorted_keys[i]] = i;
+  }
+
+  // a new file is all zeros, which is every slot UNKNOWN. racing to set it up is
+  // fine, everyone writes the same
+  if (this->header->magic.load(std::memory_order_acquire) != CACHE_MAGIC) {
+    this->header->layout = layout_hash(sorted_keys);
+    this->header->num_slots = sorted_keys.size();
+    this->header->magic.store(CACHE_MAGIC, std::memory_order_release);
+  }
+}
+
+int ParamsCache::slot_index(const std::string &key) const {
+  auto it = this->slot_of_key.find(key);
+  return it == this->slot_of_key.end() ? -1 : it->second;
+}
+
+ParamsCache::ReadResult ParamsCache::read(const std::string &key, std::string &value) const {
+  int i = this->slot_index(key);
+  if (i < 0) return UNCACHED;
+
+  const Slot &slot = this->slots[i];
+  // writes take microseconds, give up on one that doesn't finish and go to disk
+  for (int tries = 0; tries < 16; tries++) {
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1) continue;
+
+    uint32_t state = slot.state;
+    if (state == CACHED) {
+      value.assign(slot.value, std::min<size_t>(slot.size, VALUE_SIZE));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == seq) {
+      return state == CACHED ? HIT : state == TOO_LARGE ? UNCACHED : MISS;
+    }
+  }
+  return UNCACHED;
+}
+
+void ParamsCache::write_slot(Slot &slot, uint32_t state, const char *value, size_t size) {
+  // writers hold the params lock. odd here means one died mid-write, which this one finishes
+  uint32_t seq = slot.seq.load(std::memory_order_relaxed) | 1;
+  slot.seq.store(seq, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.state = state;
+  slot.size = state == CACHED ? size : 0;
+  if (state == CACHED) {
+    memcpy(slot.value, value, size);
+  }
+  slot.seq.store(seq + 1, std::memory_order_release);
+}
+
+void ParamsCache::fill(const std::string &key, const std::string &value) {
+  if (int i = this->slot_index(key); i >= 0) {
+    this->write_slot(this->slots[i], value.size() <= VALUE_SIZE ? CACHED : TOO_LARGE, value.data(), value.size());
+  }
+}
+
+void ParamsCache::update(const std::string &key, const char *value, size_t size) {
+  if (int i = this->slot_index(key); i >= 0) {
+    this->write_slot(this->slots[i], size <= VALUE_SIZE ? CACHED : TOO_LARGE, value, size);
+  }
+  this->bump_version();
+}
+
+void ParamsCache::invalidate_all() {
+  for (uint32_t i = 0; i < this->header->num_slots; i++) {
+    this->write_slot(this->slots[i], UNKNOWN, nullptr, 0);
+  }
+  this->bump_version();
+}
+
+void ParamsCache::bump_version() {
+  this->header->version.fetch_add(1, std::memory_order_acq_rel);
+#ifdef __linux__
+  // mapped MAP_SHARED across processes, so the private futex flag must not be used
+  syscall(SYS_futex, reinterpret_cast<uint32_t *>(&this->header->version), FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#endif
+}
+
+bool ParamsCache::wait(uint32_t last_version, int timeout_ms) const {
+  const double deadline = millis_since_boot() + timeout_ms;
+  while (this->version() == last_version) {
+    double remaining = deadline - millis_since_boot();
+    if (timeout_ms >= 0 && remaining <= 0) return false;
+#ifdef __linux__
+    struct timespec ts = {(time_t)(remaining / 1000), (long)(std::fmod(remaining, 1000.0) * 1e6)};
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&this->header->version), FUTEX_WAIT, last_version,
+            timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+#else
+    util::sleep_for(timeout_ms >= 0 ? std::min(10.0, remaining) : 10);
+#endif
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Shared memory copy of the values in one params directory, mapped by every process
+// that opens it. Reads are seqlocked memory loads. Changes (put, remove, clearAll, and
+// filling a slot after a miss) are made with the params lock held, so the slots stay
+// in step with the files as long as they're only written through Params. Values over
+// VALUE_SIZE aren't cached and are always read from disk.
+class ParamsCache {
+public:
+  static constexpr size_t VALUE_SIZE = 256;
+
+  // the process wide mapping of dir, null if it couldn't be mapped or was made for other keys
+  static ParamsCache *get(const std::string &dir, const std::vector<std::string> &sorted_keys);
+
+  enum ReadResult {
+    HIT,
+    MISS,  // read the file and offer it to fill
+    UNCACHED,  // too large or not a known key, read the file
+  };
+  ReadResult read(const std::string &key, std::string &value) const;
+
+  // with the params lock held
+  void fill(const std::string &key, const std::string &value);
+  void update(const std::string &key, const char *value, size_t size);
+  void invalidate_all();
+
+  // bumped by every update and invalidate_all, from any process
+  uint32_t version() const { return this->header->version.load(std::memory_order_acquire); }
+  // true once the version isn't last_version, false after timeout_ms (-1 waits forever)
+  bool wait(uint32_t last_version, int timeout_ms) const;
+
+private:
+  enum SlotState : uint32_t {
+    UNKNOWN = 0,  // not read since the cache was made, or cleared
+    CACHED = 1,
+    TOO_LARGE = 2,
+  };
+
+  struct Slot {
+    std::atomic<uint32_t> seq;  // odd while being written
+    uint32_t state;
+    uint32_t size;
+    char value[VALUE_SIZE];
+  };
+
+  struct Header {
+    std::atomic<uint32_t> magic;  // set once the rest is
+    uint32_t layout;
+    uint32_t num_slots;
+    std::atomic<uint32_t> version;
+  };
+
+  ParamsCache(void *mem, const std::vector<std::string> &sorted_keys);
+  int slot_index(const std::string &key) const;
+  void write_slot(Slot &slot, uint32_t state, const char *value, size_t size);
+  void bump_version();
+
+  Header *header;
+  Slot *slots;
+  std::unordered_map<std::string, int> slot_of_key;
+};
@@ -1,9 +1,9 @@
 # distutils: language = c++
 # cython: language_level = 3
 from libcpp cimport bool
+from libcpp.map cimport map
 from libcpp.string cimport string
 from libcpp.vector cimport vector
-import threading
 
 cdef extern from "common/params.h":
   cpdef enum ParamKeyType:
@@ -22,10 +22,14 @@ cdef extern from "common/params.h":
     int put(string, string) nogil
     int putBool(string, bool) nogil
     int putInt(string, int) nogil
+    void putNonBlocking(string, string) nogil
+    int putMany(map[string, string]) nogil
     bool checkKey(string) nogil
     string getParamPath(string) nogil
     void clearAll(ParamKeyType)
     vector[string] allKeys()
+    unsigned int version() nogil
+    bool waitForChange(unsigned int, int) nogil
 
 
 def ensure_bytes(v):
@@ -106,6 +110,21 @@ cdef class Params:
     with nogil:
       self.p.putInt(k, val)
 
+  def put_many(self, values):
+    """Like put for every key in the dict, with one lock and one directory sync"""
+    cdef map[string, string] m
+    for key, dat in values.items():
+      m[self.check_key(key)] = ensure_bytes(dat)
+    with nogil:
+      self.p.putMany(m)
+
+  def put_nonblocking(self, key, dat):
+    """Queues the write for a background thread, gets in this process see it right away"""
+    cdef string k = self.check_key(key)
+    cdef string dat_bytes = ensure_bytes(dat)
+    with nogil:
+      self.p.putNonBlocking(k, dat_bytes)
+
   def remove(self, key):
     cdef string k = self.check_key(key)
     with nogil:
@@ -118,11 +137,22 @@ cdef class Params:
   def all_keys(self):
     return self.p.allKeys()
 
+  def version(self):
+    """Changes with every put, remove and clear on these params, from any process"""
+    return self.p.version()
+
+  def wait_for_change(self, unsigned int last_version, int timeout_ms=-1):
+    """Waits until version() isn't last_version, False if the timeout passed first"""
+    cdef bool r
+    with nogil:
+      r = self.p.waitForChange(last_version, timeout_ms)
+    return r
+
 def put_nonblocking(key, val, d=""):
-  threading.Thread(target=lambda: Params(d).put(key, val)).start()
+  Params(d).put_nonblocking(key, val)
 
 def put_bool_nonblocking(key, bool val, d=""):
-  threading.Thread(target=lambda: Params(d).put_bool(key, val)).start()
+  Params(d).put_nonblocking(key, b"1" if val else b"0")
 
 def put_int_nonblocking(key, int val, d=""):
-  threading.Thread(target=lambda: Params(d).put_int(key, val)).start()
+  Params(d).put_nonblocking(key, str(val))
@@ -0,0 +1,92 @@
+#include "common/placement.h"
+
+#include <sys/resource.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include "common/swaglog.h"
+#include "common/util.h"
+#include "system/hardware/hw.h"
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// the python daemons are placed with config_realtime_process() in common/realtime.py,
+// keep the priorities in order with the ones there
+static const Placement placements[] = {
+  // processes
+  {.name = "boardd", .cores = {4}, .rt_priority = 54},
+  {.name = "camerad", .cores = {6}, .rt_priority = 53},
+  {.name = "encoderd", .cores = {3}, .rt_priority = 52},
+  {.name = "locationd", .rt_priority = 5},
+  // TODO: why does a realtime priority impact camerad timings?
+  {.name = "loggerd", .cores = {0, 1, 2, 3}},
+  // next to the imu interrupt, which sensord moves to core 1 too
+  {.name = "sensord", .cores = {1}, .nice = -18},
+
+  // threads
+  // the Kalman output is built and saved off the realtime filter loop
+  {.name = "locationd_publish", .rt_priority = PLACEMENT_NORMAL},
+};
+
+const Placement *find_placement(const std::string &name) {
+  for (const auto &p : placements) {
+    if (name == p.name) return &p;
+  }
+  return nullptr;
+}
+
+#ifdef __linux__
+static std::string cores_str(const cpu_set_t &set) {
+  std::ostringstream ss;
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+    if (CPU_ISSET(i, &set)) ss << (ss.tellp() > 0 ? "," : "") << i;
+  }
+  return ss.str();
+}
+#endif
+
+int apply_placement(const std::string &name) {
+  const Placement *p = find_placement(name);
+  if (!p || Hardware::PC()) return 0;
+
+#ifdef __linux__
+  int ret = 0;
+  if (!p->cores.empty() && util::set_core_affinity(p->cores) != 0) {
+    LOGE("placement %s: can't set core affinity: %s", p->name, strerror(errno));
+    ret = -1;
+  }
+  if (p->rt_priority > PLACEMENT_NORMAL) {
+    if (util::set_realtime_priority(p->rt_priority) != 0) {
+      LOGE("placement %s: can't set realtime priority %d: %s", p->name, p->rt_priority, strerror(errno));
+      ret = -1;
+    }
+  } else if (p->rt_priority == PLACEMENT_NORMAL) {
+    struct sched_param sa = {};
+    if (sched_setscheduler(0, SCHED_OTHER, &sa) != 0) {
+      LOGE("placement %s: can't set SCHED_OTHER: %s", p->name, strerror(errno));
+      ret = -1;
+    }
+  }
+  if (p->nice != 0 && setpriority(PRIO_PROCESS, 0, p->nice) != 0) {
+    LOGE("placement %s: can't set nice %d: %s", p->name, p->nice, strerror(errno));
+    ret = -1;
+  }
+
+  // what it runs with now, as the kernel has it
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  sched_getaffinity(0, sizeof(set), &set);
+  struct sched_param sa = {};
+  sched_getparam(0, &sa);
+  const int policy = sched_getscheduler(0);
+  LOG("placement %s: cores %s, %s %d, nice %d", p->name, cores_str(set).c_str(),
+      policy == SCHED_FIFO ? "fifo" : "other", sa.sched_priority, getpriority(PRIO_PROCESS, 0));
+  return ret;
+#else
+  return -1;
+#endif
+}
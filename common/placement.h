@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Where the daemons and their named threads run, all in one table in placement.cc.
+// A process applies its entry at the start of main, a thread gets its own entry from
+// util::set_thread_name(). What isn't in the table inherits from the thread that
+// started it, like before.
+
+// leave it as the parent thread had it
+#define PLACEMENT_INHERIT -1
+// SCHED_OTHER, for a thread that shouldn't inherit a realtime priority
+#define PLACEMENT_NORMAL 0
+
+struct Placement {
+  const char *name;
+  // empty: inherit
+  std::vector<int> cores;
+  // PLACEMENT_INHERIT, PLACEMENT_NORMAL or a SCHED_FIFO priority
+  int rt_priority = PLACEMENT_INHERIT;
+  // setpriority() niceness for SCHED_OTHER, 0 leaves it
+  int nice = 0;
+};
+
+const Placement *find_placement(const std::string &name);
+
+// Applies the entry of name to the calling thread and logs what the kernel reports back.
+// Returns 0 when there's no entry, on PC, or when all of it was applied.
+int apply_placement(const std::string &name);
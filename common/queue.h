@@ -1,8 +1,21 @@
 #pragma once
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <queue>
+#include <utility>
 
 template <class T>
 class SafeQueue {
@@ -50,3 +63,230 @@ private:
   std::condition_variable cv;
   std::queue<T> q;
 };
+
+// Lock-free single producer, single consumer ring of N-1 slots. Items are
+// swapped in and out rather than copied, so a slot's buffers (e.g. a vector's
+// capacity) are handed back to the producer and reused.
+template <class T, size_t N>
+class SPSCQueue {
+public:
+  using value_type = T;
+
+  SPSCQueue() = default;
+
+  // on success v holds whatever the slot held before
+  bool try_push(T& v) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t next = (h + 1) % N;
+    if (next == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    std::swap(slots[h], v);
+    head.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T& v) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    std::swap(slots[t], v);
+    tail.store((t + 1) % N, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return (head.load(std::memory_order_acquire) + N - tail.load(std::memory_order_acquire)) % N;
+  }
+
+private:
+  std::array<T, N> slots;
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) std::atomic<size_t> tail = 0;
+};
+
+// Lock-free bounded queue of N slots for any number of producers and consumers, N a
+// power of two. Every slot has a sequence number that says whose turn it is, so a push
+// or pop is one compare and swap on its end of the queue and they never wait on each
+// other. (Vyukov's bounded MPMC queue.)
+template <class T, size_t N>
+class MPMCQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  using value_type = T;
+
+  MPMCQueue() {
+    for (size_t i = 0; i < N; i++) {
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // v is moved from on success
+  bool try_push(T& v) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    Cell *c;
+    while (true) {
+      c = &cells[pos & (N - 1)];
+      intptr_t dif = (intptr_t)c->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+      if (dif == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (dif < 0) {
+        return false;  // full
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    c->value = std::move(v);
+    c->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool try_pop(T& v) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    Cell *c;
+    while (true) {
+      c = &cells[pos & (N - 1)];
+      intptr_t dif = (intptr_t)c->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (dif < 0) {
+        return false;  // empty
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    v = std::move(c->value);
+    c->seq.store(pos + N, std::memory_order_release);
+    return true;
+  }
+
+  // a snapshot, it may be out of date by the time it's used
+  size_t size() const {
+    size_t tail = dequeue_pos.load(std::memory_order_acquire);
+    size_t head = enqueue_pos.load(std::memory_order_acquire);
+    return head > tail ? std::min(head - tail, N) : 0;
+  }
+
+private:
+  struct alignas(64) Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+  std::array<Cell, N> cells;
+  alignas(64) std::atomic<size_t> enqueue_pos = 0;
+  alignas(64) std::atomic<size_t> dequeue_pos = 0;
+};
+
+// What a blocked push or pop of a BlockingQueue sleeps on, a futex on Linux. The word
+// changes on every notify, a waiter passes the value it saw before it last checked the
+// queue so a notify in between isn't missed. The notify only makes the syscall when
+// someone is waiting, so the side that doesn't block pays an atomic add.
+class QueueWaiter {
+public:
+  uint32_t epoch() const { return word.load(std::memory_order_seq_cst); }
+
+  // timeout_ns < 0 waits for as long as it takes
+  void wait(uint32_t seen, int64_t timeout_ns) {
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+    struct timespec ts = {.tv_sec = (time_t)(timeout_ns / 1000000000), .tv_nsec = (long)(timeout_ns % 1000000000)};
+    syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, seen, timeout_ns < 0 ? nullptr : &ts, nullptr, 0);
+#else
+    std::unique_lock lk(m);
+    auto changed = [&] { return word.load(std::memory_order_seq_cst) != seen; };
+    if (timeout_ns < 0) {
+      cv.wait(lk, changed);
+    } else {
+      cv.wait_for(lk, std::chrono::nanoseconds(timeout_ns), changed);
+    }
+#endif
+    waiters.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void notify() {
+    word.fetch_add(1, std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) > 0) {
+#ifdef __linux__
+      syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+      { std::lock_guard lk(m); }
+      cv.notify_all();
+#endif
+    }
+  }
+
+private:
+  std::atomic<uint32_t> word = 0;
+  std::atomic<int> waiters = 0;
+#ifndef __linux__
+  std::mutex m;
+  std::condition_variable cv;
+#endif
+};
+
+// SPSCQueue or MPMCQueue with pushes that wait while it's full and pops that wait while
+// it's empty. The handoff itself stays lock-free, a producer or consumer only sleeps
+// when it has to.
+template <class Q>
+class BlockingQueue {
+public:
+  using T = typename Q::value_type;
+
+  BlockingQueue() = default;
+
+  bool try_push(T v) {
+    if (!q.try_push(v)) return false;
+    not_empty.notify();
+    return true;
+  }
+
+  void push(T v) {
+    wait_for(not_full, [&] { return q.try_push(v); }, -1);
+    not_empty.notify();
+  }
+
+  T pop() {
+    T v;
+    try_pop(v, -1);
+    return v;
+  }
+
+  // waits up to timeout_ms for an item, forever if it's negative
+  bool try_pop(T& v, int timeout_ms = 0) {
+    if (!wait_for(not_empty, [&] { return q.try_pop(v); }, timeout_ms)) return false;
+    not_full.notify();
+    return true;
+  }
+
+  bool empty() const { return q.size() == 0; }
+  size_t size() const { return q.size(); }
+
+private:
+  template <class F>
+  static bool wait_for(QueueWaiter &w, F &&ready, int timeout_ms) {
+    if (ready()) return true;
+    if (timeout_ms == 0) return false;
+
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+      uint32_t seen = w.epoch();
+      if (ready()) return true;
+      int64_t left_ns = -1;
+      if (timeout_ms > 0) {
+        left_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (left_ns <= 0) return false;
+      }
+      w.wait(seen, left_ns);
+    }
+  }
+
+  Q q;
+  QueueWaiter not_empty, not_full;
+};
+
+template <class T, size_t N>
+using BlockingSPSCQueue = BlockingQueue<SPSCQueue<T, N>>;
+template <class T, size_t N>
+using BlockingMPMCQueue = BlockingQueue<MPMCQueue<T, N>>;
@@ -1,7 +1,9 @@
 #include "common/ratekeeper.h"
 
 #include <algorithm>
+#include <cmath>
 
+#include "common/statlog.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
 #include "common/util.h"
@@ -12,11 +14,13 @@ RateKeeper::RateKeeper(const std::string &name, float rate, float print_delay_th
   interval = 1 / rate;
   last_monitor_time = seconds_since_boot();
   next_frame_time = last_monitor_time + interval;
+  stats_start_time = last_monitor_time;
 }
 
 bool RateKeeper::keepTime() {
   bool lagged = monitorTime();
-  if (remaining_ > 0) {
+  // on a simulated clock the frame ends when the replay moves time on
+  if (remaining_ > 0 && !simulated_clock()) {
     util::sleep_for(remaining_ * 1000);
   }
   return lagged;
@@ -24,10 +28,14 @@ bool RateKeeper::keepTime() {
 
 bool RateKeeper::monitorTime() {
   ++frame_;
+  const double prev_monitor_time = last_monitor_time;
   last_monitor_time = seconds_since_boot();
   remaining_ = next_frame_time - last_monitor_time;
 
   bool lagged = remaining_ < 0;
+  // jitter is how far the time since the last call is off the interval
+  max_jitter = std::max(max_jitter, std::abs(last_monitor_time - prev_monitor_time - interval));
+  record(last_monitor_time, lagged);
   if (lagged) {
     if (print_delay_threshold > 0 && remaining_ < -print_delay_threshold) {
       LOGW("%s lagging by %.2f ms", name.c_str(), -remaining_ * 1000);
@@ -38,3 +46,46 @@ bool RateKeeper::monitorTime() {
   }
   return lagged;
 }
+
+void RateKeeper::record(double now, bool lagged) {
+  // the part of the interval that was used, from the start of this frame until now
+  const double budget = (interval - remaining_) / interval;
+  budget_hist[std::clamp((int)(budget * 20), 0, RATEKEEPER_BUDGET_BINS - 1)]++;
+  max_budget = std::max(max_budget, budget);
+  frames++;
+  if (lagged) {
+    missed_++;
+    missed_total++;
+  }
+
+  if (now - stats_start_time >= RATEKEEPER_STATS_INTERVAL) {
+    sendStats(now);
+  }
+}
+
+void RateKeeper::sendStats(double now) {
+  auto percentile = [this](double p) {
+    uint32_t target = std::ceil(frames * p), count = 0;
+    for (int i = 0; i < RATEKEEPER_BUDGET_BINS; i++) {
+      count += budget_hist[i];
+      if (count >= target) return (i + 1) * 5.f;  // the bin's upper edge, in percent
+    }
+    return RATEKEEPER_BUDGET_BINS * 5.f;
+  };
+  const float p50 = percentile(0.5), p99 = percentile(0.99);
+  const std::string prefix = "ratekeeper." + name;
+  statlog_gauge((prefix + ".budget_p50").c_str(), p50);
+  statlog_gauge((prefix + ".budget_p99").c_str(), p99);
+  statlog_gauge((prefix + ".budget_max").c_str(), (float)(max_budget * 100));
+  statlog_gauge((prefix + ".jitter_max_ms").c_str(), (float)(max_jitter * 1000));
+  statlog_count((prefix + ".missed").c_str(), missed_);
+  if (missed_ > 0) {
+    LOGW("%s missed %u of %u deadlines in %.0fs, budget p50 %.0f%% p99 %.0f%% max %.0f%%, jitter max %.2f ms",
+         name.c_str(), missed_, frames, now - stats_start_time, p50, p99, max_budget * 100, max_jitter * 1000);
+  }
+
+  budget_hist = {};
+  frames = missed_ = 0;
+  max_budget = max_jitter = 0;
+  stats_start_time = now;
+}
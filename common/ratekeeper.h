@@ -1,8 +1,14 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <string>
 
+// how much of its interval a loop took, in 5% bins up to twice the interval
+#define RATEKEEPER_BUDGET_BINS 41
+// how often the loop stats are sent to statsd, as ratekeeper.<name>.*
+#define RATEKEEPER_STATS_INTERVAL 10.0
+
 class RateKeeper {
 public:
   RateKeeper(const std::string &name, float rate, float print_delay_threshold = 0);
@@ -11,8 +17,13 @@ public:
   bool monitorTime();
   inline double frame() const { return frame_; }
   inline double remaining() const { return remaining_; }
+  // deadlines missed since construction
+  inline uint64_t missed() const { return missed_total; }
 
 private:
+  void record(double now, bool lagged);
+  void sendStats(double now);
+
   double interval;
   double next_frame_time;
   double last_monitor_time;
@@ -20,4 +31,13 @@ private:
   float print_delay_threshold = 0;
   uint64_t frame_ = 0;
   std::string name;
+
+  // since the last stats sent
+  std::array<uint32_t, RATEKEEPER_BUDGET_BINS> budget_hist = {};
+  uint32_t frames = 0;
+  uint32_t missed_ = 0;
+  double max_budget = 0;
+  double max_jitter = 0;
+  double stats_start_time;
+  uint64_t missed_total = 0;
 };
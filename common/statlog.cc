@@ -3,11 +3,20 @@
 #endif
 
 #include "common/statlog.h"
+#include "common/timing.h"
 #include "common/util.h"
 
-#include <cstdarg>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
 #include <stdio.h>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include <zmq.h>
 
 class StatlogState : public LogState {
@@ -17,31 +26,180 @@ class StatlogState : public LogState {
 
 static StatlogState s = {};
 
-static void log(const char* metric_type, const char* metric, const char* fmt, ...) {
-  std::lock_guard lk(s.lock);
-  if (!s.initialized) s.initialize();
+namespace {
 
-  char* value_buf = nullptr;
-  va_list args;
-  va_start(args, fmt);
-  int ret = vasprintf(&value_buf, fmt, args);
-  va_end(args);
+struct Gauge {
+  double value = 0;
+  uint64_t ts = 0;  // 0 once flushed
+};
+
+struct Samples {
+  std::vector<float> values;
+  uint64_t seen = 0;  // since the last flush
+};
+
+// what one thread logged since the last flush. The lock is the thread's own, it only
+// waits while the flush copies the values out.
+struct Shard {
+  std::mutex lock;
+  std::map<std::string, double, std::less<>> counters;
+  std::map<std::string, Gauge, std::less<>> gauges;
+  std::map<std::string, Samples, std::less<>> samples;
+  uint32_t rand_state = (uint32_t)(uintptr_t)this | 1;
+
+  uint32_t rand() {
+    // xorshift32, only picks which samples to keep
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+  }
+};
+
+template <typename T>
+T &find_or_add(std::map<std::string, T, std::less<>> &m, const char *key) {
+  auto it = m.find(std::string_view(key));
+  if (it == m.end()) {
+    it = m.emplace(key, T()).first;
+  }
+  return it->second;
+}
+
+class StatlogFlusher {
+public:
+  ~StatlogFlusher() {
+    {
+      std::lock_guard lk(lock);
+      do_exit = true;
+    }
+    cv.notify_one();
+    if (thread.joinable()) thread.join();
+  }
+
+  Shard *shard() {
+    thread_local std::shared_ptr<Shard> local;
+    if (!local) {
+      local = std::make_shared<Shard>();
+      std::lock_guard lk(lock);
+      shards.push_back(local);
+      if (!thread.joinable()) thread = std::thread(&StatlogFlusher::run, this);
+    }
+    return local.get();
+  }
+
+private:
+  void run() {
+    std::unique_lock lk(lock);
+    while (true) {
+      bool exiting = cv.wait_for(lk, std::chrono::milliseconds(STATLOG_FLUSH_MS), [this] { return do_exit; });
+      lk.unlock();
+      flush();
+      lk.lock();
+      if (exiting) break;
+    }
+  }
+
+  void flush() {
+    std::vector<std::shared_ptr<Shard>> current;
+    {
+      std::lock_guard lk(lock);
+      // a shard held only here and in current is of a thread that's gone, this is its last flush
+      current = shards;
+      shards.erase(std::remove_if(shards.begin(), shards.end(), [](auto &sh) { return sh.use_count() == 2; }), shards.end());
+    }
+
+    std::map<std::string, double> changed_totals;
+    std::map<std::string, Gauge> gauges;
+    std::map<std::string, std::vector<float>> samples;
+    for (auto &sh : current) {
+      // values are reset in place, so the threads don't allocate again for the same metrics
+      std::lock_guard lk(sh->lock);
+      for (auto &[metric, n] : sh->counters) {
+        if (n != 0) {
+          changed_totals[metric] = totals[metric] += n;
+          n = 0;
+        }
+      }
+      for (auto &[metric, g] : sh->gauges) {
+        if (g.ts != 0) {
+          Gauge &latest = gauges[metric];
+          if (g.ts > latest.ts) latest = g;
+          g.ts = 0;
+        }
+      }
+      for (auto &[metric, sa] : sh->samples) {
+        if (!sa.values.empty()) {
+          std::vector<float> &all = samples[metric];
+          all.insert(all.end(), sa.values.begin(), sa.values.end());
+          sa.values.clear();
+          sa.seen = 0;
+        }
+      }
+    }
+
+    {
+      std::lock_guard lk(s.lock);
+      if (!s.initialized) s.initialize();
+    }
+    for (auto &[metric, total] : changed_totals) {
+      send(metric, total, STATLOG_GAUGE);
+    }
+    for (auto &[metric, g] : gauges) {
+      send(metric, g.value, STATLOG_GAUGE);
+    }
+    for (auto &[metric, values] : samples) {
+      for (float v : values) {
+        send(metric, v, STATLOG_SAMPLE);
+      }
+    }
+  }
 
-  if (ret > 0 && value_buf) {
-    char* line_buf = nullptr;
-    ret = asprintf(&line_buf, "%s:%s|%s", metric, value_buf, metric_type);
-    if (ret > 0 && line_buf) {
-      zmq_send(s.sock, line_buf, ret, ZMQ_NOBLOCK);
-      free(line_buf);
+  void send(const std::string &metric, double value, const char *metric_type) {
+    char line_buf[256];
+    int ret = snprintf(line_buf, sizeof(line_buf), "%s:%.10g|%s", metric.c_str(), value, metric_type);
+    if (ret > 0 && ret < (int)sizeof(line_buf)) {
+      s.send(line_buf, ret);
     }
-    free(value_buf);
+  }
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::vector<std::shared_ptr<Shard>> shards;
+  std::map<std::string, double> totals;  // of the counters, only touched by the flush
+  bool do_exit = false;
+  std::thread thread;
+};
+
+// after s, so it's torn down first and the last flush still has a socket
+static StatlogFlusher flusher;
+
+void log(const char* metric_type, const char* metric, double value) {
+  Shard *sh = flusher.shard();
+  std::lock_guard lk(sh->lock);
+  if (strcmp(metric_type, STATLOG_COUNTER) == 0) {
+    find_or_add(sh->counters, metric) += value;
+  } else if (strcmp(metric_type, STATLOG_GAUGE) == 0) {
+    Gauge &g = find_or_add(sh->gauges, metric);
+    g.value = value;
+    g.ts = nanos_since_boot();
+  } else if (strcmp(metric_type, STATLOG_SAMPLE) == 0) {
+    // reservoir sampling, every sample since the flush is as likely to be kept
+    Samples &sa = find_or_add(sh->samples, metric);
+    if (sa.values.size() < STATLOG_MAX_SAMPLES) {
+      sa.values.push_back(value);
+    } else if (uint64_t i = sh->rand() % (sa.seen + 1); i < STATLOG_MAX_SAMPLES) {
+      sa.values[i] = value;
+    }
+    sa.seen++;
   }
 }
 
+} // namespace
+
 void statlog_log(const char* metric_type, const char* metric, int value) {
-  log(metric_type, metric, "%d", value);
+  log(metric_type, metric, value);
 }
 
 void statlog_log(const char* metric_type, const char* metric, float value) {
-  log(metric_type, metric, "%f", value);
+  log(metric_type, metric, value);
 }
@@ -2,9 +2,21 @@
 
 #define STATLOG_GAUGE "g"
 #define STATLOG_SAMPLE "sa"
+#define STATLOG_COUNTER "c"
+
+// Metrics for statsd. A call only adds to aggregates kept by the calling thread, and a
+// background thread merges those and sends them out every STATLOG_FLUSH_MS, so they're
+// cheap enough for per frame and per message paths:
+// - counters add up, sent as a gauge of the total since the process started
+// - gauges send the latest value
+// - samples keep up to STATLOG_MAX_SAMPLES per metric and flush, picked at random once
+//   there are more, so the distribution statsd computes from them stays representative
+#define STATLOG_FLUSH_MS 1000
+#define STATLOG_MAX_SAMPLES 256
 
 void statlog_log(const char* metric_type, const char* metric, int value);
 void statlog_log(const char* metric_type, const char* metric, float value);
 
 #define statlog_gauge(metric, value) statlog_log(STATLOG_GAUGE, metric, value)
 #define statlog_sample(metric, value) statlog_log(STATLOG_SAMPLE, metric, value)
+#define statlog_count(metric, n) statlog_log(STATLOG_COUNTER, metric, (int)(n))
@@ -4,6 +4,7 @@
 
 #include "common/swaglog.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <cstring>
@@ -23,6 +24,7 @@ class SwaglogState : public LogState {
   SwaglogState() : LogState(Path::swaglog_ipc().c_str()) {}
 
   json11::Json::object ctx_j;
+  std::string ctx_s;  // ctx_j dumped, it's the same in every message
 
   inline void initialize() {
     ctx_j = json11::Json::object {};
@@ -52,6 +54,7 @@ class SwaglogState : public LogState {
 
     // device type
     ctx_j["device"] = Hardware::get_name();
+    ctx_s = ((json11::Json)ctx_j).dump();
     LogState::initialize();
   }
 };
@@ -64,36 +67,108 @@ static void log(int levelnum, const char* filename, int lineno, const char* func
   if (levelnum >= s.print_level) {
     printf("%s: %s\n", filename, msg);
   }
-  zmq_send(s.sock, log_s.data(), log_s.length(), ZMQ_NOBLOCK);
+  s.send(log_s.data(), log_s.length());
+}
+
+// a string the way json11 dumps one, without making a Json value of it first
+static void dump_string(const char *str, std::string &out) {
+  out += '"';
+  for (const char *c = str; *c; c++) {
+    const uint8_t ch = *c;
+    if (ch == '\\') {
+      out += "\\\\";
+    } else if (ch == '"') {
+      out += "\\\"";
+    } else if (ch == '\b') {
+      out += "\\b";
+    } else if (ch == '\f') {
+      out += "\\f";
+    } else if (ch == '\n') {
+      out += "\\n";
+    } else if (ch == '\r') {
+      out += "\\r";
+    } else if (ch == '\t') {
+      out += "\\t";
+    } else if (ch <= 0x1f) {
+      char buf[8];
+      snprintf(buf, sizeof buf, "\\u%04x", ch);
+      out += buf;
+    } else if (ch == 0xe2 && (uint8_t)c[1] == 0x80 && ((uint8_t)c[2] == 0xa8 || (uint8_t)c[2] == 0xa9)) {
+      out += (uint8_t)c[2] == 0xa8 ? "\\u2028" : "\\u2029";
+      c += 2;
+    } else {
+      out += *c;
+    }
+  }
+  out += '"';
 }
 
 static void cloudlog_common(int levelnum, const char* filename, int lineno, const char* func,
                             char* msg_buf, const json11::Json::object &msg_j={}) {
-  std::lock_guard lk(s.lock);
-  if (!s.initialized) s.initialize();
-
-  json11::Json::object log_j = json11::Json::object {
-    {"ctx", s.ctx_j},
-    {"levelnum", levelnum},
-    {"filename", filename},
-    {"lineno", lineno},
-    {"funcname", func},
-    {"created", seconds_since_epoch()}
-  };
-  if (msg_j.empty()) {
-    log_j["msg"] = msg_buf;
-  } else {
-    log_j["msg"] = msg_j;
+  {
+    std::lock_guard lk(s.lock);
+    if (!s.initialized) s.initialize();
   }
 
+  // written out like the json11 object of these would dump, keys in order, so the
+  // receiving end parses the same thing. Only the message is escaped for each one,
+  // the context is dumped once, and none of it needs the lock.
+  char num_buf[32];
   std::string log_s;
+  log_s.reserve(s.ctx_s.size() + strlen(msg_buf) + 192);
   log_s += (char)levelnum;
-  ((json11::Json)log_j).dump(log_s);
-  log(levelnum, filename, lineno, func, msg_buf, log_s);
+  snprintf(num_buf, sizeof(num_buf), "%.17g", seconds_since_epoch());
+  log_s += "{\"created\": ";
+  log_s += num_buf;
+  log_s += ", \"ctx\": ";
+  log_s += s.ctx_s;
+  log_s += ", \"filename\": ";
+  dump_string(filename, log_s);
+  log_s += ", \"funcname\": ";
+  dump_string(func, log_s);
+  snprintf(num_buf, sizeof(num_buf), "%d", levelnum);
+  log_s += ", \"levelnum\": ";
+  log_s += num_buf;
+  snprintf(num_buf, sizeof(num_buf), "%d", lineno);
+  log_s += ", \"lineno\": ";
+  log_s += num_buf;
+  log_s += ", \"msg\": ";
+  if (msg_j.empty()) {
+    dump_string(msg_buf, log_s);
+  } else {
+    ((json11::Json)msg_j).dump(log_s);
+  }
+  log_s += '}';
 
+  log(levelnum, filename, lineno, func, msg_buf, log_s);
   free(msg_buf);
 }
 
+bool SwaglogRateLimit::take(int &dropped, double &dropped_secs) {
+  std::lock_guard lk(lock);
+  const uint64_t ts = nanos_since_boot();
+  if (last_ns != 0) {
+    tokens = std::min<double>(SWAGLOG_RATE_BURST, tokens + (ts - last_ns) * 1e-9 * SWAGLOG_RATE_PER_SEC);
+  }
+  last_ns = ts;
+
+  dropped = 0;
+  if (num_dropped > 0 && ts - first_dropped_ns >= SWAGLOG_RATE_SUMMARY_SEC * 1000000000ULL) {
+    dropped = num_dropped;
+    dropped_secs = (ts - first_dropped_ns) * 1e-9;
+    num_dropped = 0;
+  }
+
+  if (tokens >= 1.0) {
+    tokens -= 1.0;
+    return true;
+  }
+  if (num_dropped++ == 0) {
+    first_dropped_ns = ts;
+  }
+  return false;
+}
+
 void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func,
                 const char* fmt, ...) {
   va_list args;
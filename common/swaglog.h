@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+
 #include "common/timing.h"
 
 #define CLOUDLOG_DEBUG 10
@@ -8,6 +11,37 @@
 #define CLOUDLOG_ERROR 40
 #define CLOUDLOG_CRITICAL 50
 
+// messages below this level aren't built in at all, so -DSWAGLOG_MIN_LEVEL=CLOUDLOG_INFO
+// takes every LOGD, and the work for its arguments, out of a hot path's build
+#ifndef SWAGLOG_MIN_LEVEL
+#define SWAGLOG_MIN_LEVEL CLOUDLOG_DEBUG
+#endif
+// every log call site is a token bucket of SWAGLOG_RATE_BURST messages, refilled at
+// SWAGLOG_RATE_PER_SEC. What's over is dropped and counted, and a count of the dropped
+// ones is logged from the same site at most every SWAGLOG_RATE_SUMMARY_SEC.
+#ifndef SWAGLOG_RATE_BURST
+#define SWAGLOG_RATE_BURST 20
+#endif
+#ifndef SWAGLOG_RATE_PER_SEC
+#define SWAGLOG_RATE_PER_SEC 5
+#endif
+#ifndef SWAGLOG_RATE_SUMMARY_SEC
+#define SWAGLOG_RATE_SUMMARY_SEC 5
+#endif
+
+class SwaglogRateLimit {
+public:
+  // true if the message is logged. dropped is set to the number dropped since the last
+  // summary, when it's time for one, and to 0 otherwise
+  bool take(int &dropped, double &dropped_secs);
+
+private:
+  std::mutex lock;
+  double tokens = SWAGLOG_RATE_BURST;
+  uint64_t last_ns = 0;
+  uint64_t first_dropped_ns = 0;
+  int num_dropped = 0;
+};
 
 #ifdef __GNUC__
 #define SWAG_LOG_CHECK_FMT(a, b) __attribute__ ((format (printf, a, b)))
@@ -25,13 +59,29 @@ void cloudlog_te(int levelnum, const char* filename, int lineno, const char* fun
                  uint32_t frame_id, const char* fmt, ...) SWAG_LOG_CHECK_FMT(6, 7);
 
 
-#define cloudlog(lvl, fmt, ...) cloudlog_e(lvl, __FILE__, __LINE__, \
-                                           __func__, \
-                                           fmt, ## __VA_ARGS__)
+#define cloudlog(lvl, fmt, ...)                                           \
+do {                                                                      \
+  if ((lvl) >= SWAGLOG_MIN_LEVEL) {                                       \
+    static SwaglogRateLimit __rl;                                         \
+    int __dropped;                                                        \
+    double __dropped_secs;                                                \
+    bool __take = __rl.take(__dropped, __dropped_secs);                   \
+    if (__dropped > 0) {                                                  \
+      cloudlog_e(lvl, __FILE__, __LINE__, __func__,                       \
+                 "repeated %d times in %.1fs, not logged", __dropped, __dropped_secs); \
+    }                                                                     \
+    if (__take) {                                                         \
+      cloudlog_e(lvl, __FILE__, __LINE__, __func__, fmt, ## __VA_ARGS__); \
+    }                                                                     \
+  }                                                                       \
+} while (0)
 
-#define cloudlog_t(lvl, ...) cloudlog_te(lvl, __FILE__, __LINE__, \
-                                          __func__, \
-                                          __VA_ARGS__)
+#define cloudlog_t(lvl, ...)                                            \
+do {                                                                    \
+  if ((lvl) >= SWAGLOG_MIN_LEVEL) {                                     \
+    cloudlog_te(lvl, __FILE__, __LINE__, __func__, __VA_ARGS__);        \
+  }                                                                     \
+} while (0)
 
 
 #define cloudlog_rl(burst, millis, lvl, fmt, ...)   \
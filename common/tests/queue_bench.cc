@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/queue.h"
+
+// Handoff latency of SafeQueue against the lock-free queues, from a push to the pop
+// that returns it, with one consumer and 1 to 4 producers. "paced" pushes one item a
+// millisecond, like frames, so the consumer is asleep every time and it's the wakeup
+// that's measured. "burst" pushes as fast as it goes, which is contention on the queue
+// itself.
+// Usage: queue_bench [items per producer]
+
+using Clock = std::chrono::steady_clock;
+
+struct Item {
+  int64_t ns = 0;
+};
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// SafeQueue is unbounded, give it the push of the blocking queues
+struct SafeQueueBench {
+  SafeQueue<Item> q;
+  void push(const Item &v) { q.push(v); }
+  Item pop() { return q.pop(); }
+};
+
+template <class Q>
+struct LockFreeBench {
+  Q q;
+  void push(const Item &v) { q.push(v); }
+  Item pop() { return q.pop(); }
+};
+
+template <class B>
+static void run(const char *name, int producers, int items, bool paced) {
+  B b;
+  std::vector<int64_t> latency;
+  latency.reserve((size_t)producers * items);
+
+  auto start = Clock::now();
+  std::thread consumer([&] {
+    for (int i = 0; i < producers * items; i++) {
+      Item v = b.pop();
+      latency.push_back(now_ns() - v.ns);
+    }
+  });
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < items; i++) {
+        if (paced) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        b.push({now_ns()});
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+  consumer.join();
+  double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::sort(latency.begin(), latency.end());
+  auto pct = [&](double p) { return latency[std::min(latency.size() - 1, (size_t)(p * latency.size()))] / 1e3; };
+  printf("%-10s %-6s %9d %12.0f %10.2f %10.2f %10.2f\n", name, paced ? "paced" : "burst", producers,
+         latency.size() / secs, pct(0.5), pct(0.99), latency.back() / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+  const int items = argc > 1 ? atoi(argv[1]) : 200000;
+  const int paced_items = std::max(1, std::min(items, 2000));
+
+  printf("%-10s %-6s %9s %12s %10s %10s %10s\n", "queue", "mode", "producers", "items/s", "p50 us", "p99 us", "max us");
+  for (bool paced : {true, false}) {
+    const int n = paced ? paced_items : items;
+    run<SafeQueueBench>("SafeQueue", 1, n, paced);
+    run<LockFreeBench<BlockingSPSCQueue<Item, 64>>>("SPSC", 1, n, paced);
+    run<LockFreeBench<BlockingMPMCQueue<Item, 64>>>("MPMC", 1, n, paced);
+    run<SafeQueueBench>("SafeQueue", 4, n, paced);
+    run<LockFreeBench<BlockingMPMCQueue<Item, 64>>>("MPMC", 4, n, paced);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#include "common/timing.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+
+// The same file SimulatedClock in cereal/messaging/event.cc maps for the replay driver:
+// /dev/shm/[OPENPILOT_PREFIX/]cereal_events/[CEREAL_FAKE_PREFIX/]sim_clock
+const std::atomic<uint64_t> *simulated_clock() {
+  static const std::atomic<uint64_t> *clock = []() -> const std::atomic<uint64_t> * {
+    if (std::getenv("CEREAL_SIM_TIME") == nullptr) return nullptr;
+
+    std::string dir = "/dev/shm/";
+    if (const char *prefix = std::getenv("OPENPILOT_PREFIX")) dir += std::string(prefix) + "/";
+    dir += "cereal_events/";
+    if (const char *prefix = std::getenv("CEREAL_FAKE_PREFIX"); prefix && prefix[0]) dir += std::string(prefix) + "/";
+    std::filesystem::create_directories(dir);
+
+    // created here if the daemon is up before the driver, it starts at 0 either way
+    int fd = open((dir + "sim_clock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+    if (fd < 0 || ftruncate(fd, sizeof(std::atomic<uint64_t>)) < 0) abort();
+    void *mem = mmap(nullptr, sizeof(std::atomic<uint64_t>), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) abort();
+    return (const std::atomic<uint64_t> *)mem;
+  }();
+  return clock;
+}
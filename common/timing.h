@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <ctime>
 
@@ -7,19 +8,26 @@
 #define CLOCK_BOOTTIME CLOCK_MONOTONIC
 #endif
 
+// The replay clock when the process was started with CEREAL_SIM_TIME, nullptr otherwise.
+// The boot time functions below follow it, see SimulatedClock in cereal/messaging/event.h
+const std::atomic<uint64_t> *simulated_clock();
+
 static inline uint64_t nanos_since_boot() {
+  if (auto sim = simulated_clock()) return sim->load(std::memory_order_acquire);
   struct timespec t;
   clock_gettime(CLOCK_BOOTTIME, &t);
   return t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 
 static inline double millis_since_boot() {
+  if (auto sim = simulated_clock()) return sim->load(std::memory_order_acquire) * 1e-6;
   struct timespec t;
   clock_gettime(CLOCK_BOOTTIME, &t);
   return t.tv_sec * 1000.0 + t.tv_nsec * 1e-6;
 }
 
 static inline double seconds_since_boot() {
+  if (auto sim = simulated_clock()) return sim->load(std::memory_order_acquire) * 1e-9;
   struct timespec t;
   clock_gettime(CLOCK_BOOTTIME, &t);
   return (double)t.tv_sec + t.tv_nsec * 1e-9;
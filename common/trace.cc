@@ -0,0 +1,184 @@
+#include "common/trace.h"
+
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common/swaglog.h"
+#include "common/util.h"
+
+bool trace_enabled = getenv("TRACE") && strcmp(getenv("TRACE"), "1") == 0;
+
+namespace {
+
+enum TraceEventType : uint8_t {
+  SPAN,
+  COUNTER,
+};
+
+struct TraceEvent {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint64_t flow_id;
+  double value;
+  TraceEventType type;
+};
+
+// only its thread writes, the dump reads what's behind head
+struct TraceRing {
+  std::array<TraceEvent, TRACE_RING_SIZE> events;
+  std::atomic<uint64_t> head = 0;  // number written, the oldest are overwritten
+  int tid;
+};
+
+std::mutex rings_lock;
+std::vector<std::shared_ptr<TraceRing>> rings;  // kept after their thread exits, for the dump
+int dump_pipe[2] = {-1, -1};
+
+int get_tid() {
+#ifdef __linux__
+  return syscall(SYS_gettid);
+#else
+  return getpid();
+#endif
+}
+
+TraceRing *thread_ring() {
+  thread_local std::shared_ptr<TraceRing> ring;
+  if (!ring) {
+    ring = std::make_shared<TraceRing>();
+    ring->tid = get_tid();
+    std::lock_guard lk(rings_lock);
+    rings.push_back(ring);
+  }
+  return ring.get();
+}
+
+void push(const TraceEvent &e) {
+  TraceRing *ring = thread_ring();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  ring->events[head % TRACE_RING_SIZE] = e;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+std::string default_dump_path() {
+  return util::string_format("%s/trace_%s_%d.json", util::getenv("TRACE_DIR", "/tmp").c_str(),
+                             util::getenv("MANAGER_DAEMON", "process").c_str(), getpid());
+}
+
+int write_trace(const std::string &path);
+
+void dump_on_signal(int) {
+  char c = 0;
+  [[maybe_unused]] ssize_t ret = write(dump_pipe[1], &c, 1);
+}
+
+void dump_thread() {
+  char c;
+  while (HANDLE_EINTR(read(dump_pipe[0], &c, 1)) == 1) {
+    trace_dump(default_dump_path());
+  }
+}
+
+// with tracing on, a thread waits for SIGUSR1 to dump, and exit dumps too
+struct TraceInit {
+  TraceInit() {
+    if (!trace_enabled || pipe(dump_pipe) != 0) return;
+    std::thread(dump_thread).detach();
+    struct sigaction act = {};
+    act.sa_handler = dump_on_signal;
+    act.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &act, NULL);
+    // no logging from here, swaglog may be torn down already
+    std::atexit([] { write_trace(default_dump_path()); });
+  }
+} trace_init;
+
+}  // namespace
+
+void trace_span(const char *name, uint64_t start_ns, uint64_t end_ns, uint64_t flow_id) {
+  push({.name = name, .start_ns = start_ns, .end_ns = end_ns, .flow_id = flow_id, .type = SPAN});
+}
+
+void trace_counter(const char *name, double value) {
+  push({.name = name, .start_ns = nanos_since_boot(), .value = value, .type = COUNTER});
+}
+
+namespace {
+
+// -1 if it couldn't be written
+int write_trace(const std::string &path) {
+  std::vector<std::shared_ptr<TraceRing>> current;
+  {
+    std::lock_guard lk(rings_lock);
+    current = rings;
+  }
+
+  std::string tmp_path = path + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "w");
+  if (!f) return -1;
+
+  const int pid = getpid();
+  int count = 0;
+  fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"%s\"}}",
+          pid, util::getenv("MANAGER_DAEMON", "process").c_str());
+
+  std::vector<TraceEvent> events;
+  for (auto &ring : current) {
+    // copied out while the thread may keep writing, the ones it overwrote meanwhile are dropped
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    events.clear();
+    for (uint64_t i = first; i < head; i++) {
+      events.push_back(ring->events[i % TRACE_RING_SIZE]);
+    }
+    // the slot of the one being written may be torn too
+    uint64_t oldest_intact = ring->head.load(std::memory_order_acquire) + 1;
+    oldest_intact = oldest_intact > TRACE_RING_SIZE ? oldest_intact - TRACE_RING_SIZE : 0;
+    size_t overwritten = std::min<uint64_t>(oldest_intact > first ? oldest_intact - first : 0, events.size());
+
+    for (size_t i = overwritten; i < events.size(); i++) {
+      const TraceEvent &e = events[i];
+      if (e.type == SPAN) {
+        fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d",
+                e.name, e.start_ns / 1e3, (e.end_ns - e.start_ns) / 1e3, pid, ring->tid);
+        if (e.flow_id != 0) {
+          fprintf(f, ", \"bind_id\": \"0x%llx\", \"flow_in\": true, \"flow_out\": true", (unsigned long long)e.flow_id);
+        }
+        fprintf(f, "}");
+      } else {
+        fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": %d, \"args\": {\"value\": %.10g}}",
+                e.name, e.start_ns / 1e3, pid, e.value);
+      }
+      count++;
+    }
+  }
+  fprintf(f, "\n]}\n");
+
+  return fclose(f) == 0 && rename(tmp_path.c_str(), path.c_str()) == 0 ? count : -1;
+}
+
+}  // namespace
+
+bool trace_dump(const std::string &path) {
+  int count = write_trace(path);
+  if (count < 0) {
+    LOGE("failed to write trace to %s", path.c_str());
+    return false;
+  }
+  LOGW("wrote %d trace events to %s", count, path.c_str());
+  return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "common/timing.h"
+
+// Tracing into per thread rings, written out as a Chrome JSON trace that Perfetto and
+// chrome://tracing open. It's off unless a process runs with TRACE=1, then every call is
+// a branch. With it on a process writes its trace to $TRACE_DIR (/tmp by default) as
+// trace_<daemon>_<pid>.json on SIGUSR1 and at exit. Timestamps are from the boot clock
+// so the files of several processes line up, common/trace_merge.py puts them in one.
+//
+// Names must outlive the process, string literals. A span with a flow id is linked to
+// every other span with the same id, in any process, which is how a frame is followed
+// from camerad to modeld and on.
+
+#define TRACE_RING_SIZE (1 << 14)
+
+// the flow id of a frame of a vision stream
+#define TRACE_FRAME_FLOW(stream, frame_id) (((uint64_t)(stream) << 32) | (uint32_t)(frame_id))
+
+extern bool trace_enabled;
+
+void trace_span(const char *name, uint64_t start_ns, uint64_t end_ns, uint64_t flow_id = 0);
+void trace_counter(const char *name, double value);
+// writes what's in the rings of every thread of the process
+bool trace_dump(const std::string &path);
+
+class TraceScope {
+public:
+  TraceScope(const char *span_name, uint64_t span_flow_id = 0) : name(span_name), flow_id(span_flow_id) {
+    if (trace_enabled) start_ns = nanos_since_boot();
+  }
+  ~TraceScope() {
+    if (trace_enabled) trace_span(name, start_ns, nanos_since_boot(), flow_id);
+  }
+
+private:
+  const char *name;
+  uint64_t flow_id;
+  uint64_t start_ns = 0;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(__trace_scope_, __LINE__)(name)
+#define TRACE_SCOPE_FLOW(name, flow_id) TraceScope TRACE_CONCAT(__trace_scope_, __LINE__)(name, flow_id)
+#define TRACE_COUNTER(name, value) do { if (trace_enabled) trace_counter(name, value); } while (0)
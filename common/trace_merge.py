@@ -0,0 +1,31 @@
+#!/usr/bin/env python3
+"""Merges the traces processes wrote with TRACE=1 into one file for Perfetto.
+
+Their timestamps are all from the boot clock, so the spans of camerad, modeld and the
+rest line up and the flows of a frame connect across them.
+"""
+import argparse
+import glob
+import json
+import os
+
+
+def merge(paths):
+  events = []
+  for path in paths:
+    with open(path) as f:
+      events += json.load(f)["traceEvents"]
+  return {"displayTimeUnit": "ns", "traceEvents": events}
+
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument("traces", nargs="*", help="defaults to every trace_*.json in $TRACE_DIR or /tmp")
+  parser.add_argument("-o", "--output", default="trace.json")
+  args = parser.parse_args()
+
+  paths = args.traces or sorted(glob.glob(os.path.join(os.getenv("TRACE_DIR", "/tmp"), "trace_*.json")))
+  merged = merge(paths)
+  with open(args.output, "w") as f:
+    json.dump(merged, f)
+  print(f"merged {len(merged['traceEvents'])} events from {len(paths)} traces into {args.output}")
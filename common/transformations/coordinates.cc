@@ -25,22 +25,17 @@ static Geodetic to_radians(Geodetic geodetic){
 }
 
 
-ECEF geodetic2ecef(Geodetic g){
-  g = to_radians(g);
-  double xi = sqrt(1.0 - esq * pow(sin(g.lat), 2));
-  double x = (a / xi + g.alt) * cos(g.lat) * cos(g.lon);
-  double y = (a / xi + g.alt) * cos(g.lat) * sin(g.lon);
-  double z = (a / xi * (1.0 - esq) + g.alt) * sin(g.lat);
-  return {x, y, z};
+// the closed form conversions on plain doubles, shared by the single point and batched versions
+static inline void geodetic2ecef_rad(double lat, double lon, double alt, double *out) {
+  double xi = sqrt(1.0 - esq * pow(sin(lat), 2));
+  out[0] = (a / xi + alt) * cos(lat) * cos(lon);
+  out[1] = (a / xi + alt) * cos(lat) * sin(lon);
+  out[2] = (a / xi * (1.0 - esq) + alt) * sin(lat);
 }
 
-Geodetic ecef2geodetic(ECEF e){
+static inline void ecef2geodetic_rad(double x, double y, double z, double *out) {
   // Convert from ECEF to geodetic using Ferrari's methods
   // https://en.wikipedia.org/wiki/Geographic_coordinate_conversion#Ferrari.27s_solution
-  double x = e.x;
-  double y = e.y;
-  double z = e.z;
-
   double r = sqrt(x * x + y * y);
   double Esq = a * a - b * b;
   double F = 54 * b * b * z * z;
@@ -55,10 +50,39 @@ Geodetic ecef2geodetic(ECEF e){
   double Z_0 = b * b * z / (a * V);
   double h = U * (1 - b * b / (a * V));
 
-  double lat = atan((z + e1sq * Z_0) / r);
-  double lon = atan2(y, x);
+  out[0] = atan((z + e1sq * Z_0) / r);
+  out[1] = atan2(y, x);
+  out[2] = h;
+}
+
+ECEF geodetic2ecef(Geodetic g){
+  g = to_radians(g);
+  double e[3];
+  geodetic2ecef_rad(g.lat, g.lon, g.alt, e);
+  return {e[0], e[1], e[2]};
+}
+
+Geodetic ecef2geodetic(ECEF e){
+  double g[3];
+  ecef2geodetic_rad(e.x, e.y, e.z, g);
+  return to_degrees({g[0], g[1], g[2]});
+}
 
-  return to_degrees({lat, lon, h});
+void geodetic2ecef(const double *geodetic, double *ecef, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const double *g = geodetic + 3 * i;
+    geodetic2ecef_rad(DEG2RAD(g[0]), DEG2RAD(g[1]), g[2], ecef + 3 * i);
+  }
+}
+
+void ecef2geodetic(const double *ecef, double *geodetic, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const double *e = ecef + 3 * i;
+    double *g = geodetic + 3 * i;
+    ecef2geodetic_rad(e[0], e[1], e[2], g);
+    g[0] = RAD2DEG(g[0]);
+    g[1] = RAD2DEG(g[1]);
+  }
 }
 
 LocalCoord::LocalCoord(Geodetic g, ECEF e){
@@ -98,3 +122,26 @@ Geodetic LocalCoord::ned2geodetic(NED n){
   ECEF e = ned2ecef(n);
   return ::ecef2geodetic(e);
 }
+
+typedef Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>> ConstPoints;
+typedef Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>> Points;
+
+void LocalCoord::ecef2ned(const double *ecef, double *ned, size_t n) {
+  // one matrix product over all points, transposed since points are rows
+  Points(ned, n, 3) = (ConstPoints(ecef, n, 3).rowwise() - init_ecef.transpose()) * ecef2ned_matrix.transpose();
+}
+
+void LocalCoord::ned2ecef(const double *ned, double *ecef, size_t n) {
+  Points(ecef, n, 3) = (ConstPoints(ned, n, 3) * ned2ecef_matrix.transpose()).rowwise() + init_ecef.transpose();
+}
+
+void LocalCoord::geodetic2ned(const double *geodetic, double *ned, size_t n) {
+  // ned holds the ECEF points in between
+  ::geodetic2ecef(geodetic, ned, n);
+  ecef2ned(ned, ned, n);
+}
+
+void LocalCoord::ned2geodetic(const double *ned, double *geodetic, size_t n) {
+  ned2ecef(ned, geodetic, n);
+  ::ecef2geodetic(geodetic, geodetic, n);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #include <eigen3/Eigen/Dense>
 
 #define DEG2RAD(x) ((x) * M_PI / 180.0)
@@ -27,6 +29,11 @@ struct Geodetic {
 ECEF geodetic2ecef(Geodetic g);
 Geodetic ecef2geodetic(ECEF e);
 
+// Batched versions over n points, stored as n x 3 row major arrays like numpy's.
+// Geodetic is in degrees.
+void geodetic2ecef(const double *geodetic, double *ecef, size_t n);
+void ecef2geodetic(const double *ecef, double *geodetic, size_t n);
+
 class LocalCoord {
 public:
   Eigen::Matrix3d ned2ecef_matrix;
@@ -40,4 +47,9 @@ public:
   ECEF ned2ecef(NED n);
   NED geodetic2ned(Geodetic g);
   Geodetic ned2geodetic(NED n);
+
+  void ecef2ned(const double *ecef, double *ned, size_t n);
+  void ned2ecef(const double *ned, double *ecef, size_t n);
+  void geodetic2ned(const double *geodetic, double *ned, size_t n);
+  void ned2geodetic(const double *ned, double *geodetic, size_t n);
 };
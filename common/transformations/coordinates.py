@@ -1,18 +1,30 @@
-from openpilot.common.transformations.orientation import numpy_wrap
-from openpilot.common.transformations.transformations import (ecef2geodetic_single,
-                                                    geodetic2ecef_single)
+import numpy as np
+from typing import Callable
+
+from openpilot.common.transformations.transformations import (ecef2geodetic_batch,
+                                                    geodetic2ecef_batch)
 from openpilot.common.transformations.transformations import LocalCoord as LocalCoord_single
 
 
+def batch_wrap(function) -> Callable[..., np.ndarray]:
+  """Wrap a batched conversion to take either a point or a list of points and return the same shape"""
+  def f(*inps):
+    *args, inp = inps
+    inp = np.ascontiguousarray(inp, dtype=np.float64)
+    result = function(*args, inp.reshape(-1, 3))
+    return result.reshape(inp.shape)
+  return f
+
+
 class LocalCoord(LocalCoord_single):
-  ecef2ned = numpy_wrap(LocalCoord_single.ecef2ned_single, (3,), (3,))
-  ned2ecef = numpy_wrap(LocalCoord_single.ned2ecef_single, (3,), (3,))
-  geodetic2ned = numpy_wrap(LocalCoord_single.geodetic2ned_single, (3,), (3,))
-  ned2geodetic = numpy_wrap(LocalCoord_single.ned2geodetic_single, (3,), (3,))
+  ecef2ned = batch_wrap(LocalCoord_single.ecef2ned_batch)
+  ned2ecef = batch_wrap(LocalCoord_single.ned2ecef_batch)
+  geodetic2ned = batch_wrap(LocalCoord_single.geodetic2ned_batch)
+  ned2geodetic = batch_wrap(LocalCoord_single.ned2geodetic_batch)
 
 
-geodetic2ecef = numpy_wrap(geodetic2ecef_single, (3,), (3,))
-ecef2geodetic = numpy_wrap(ecef2geodetic_single, (3,), (3,))
+geodetic2ecef = batch_wrap(geodetic2ecef_batch)
+ecef2geodetic = batch_wrap(ecef2geodetic_batch)
 
 geodetic_from_ecef = ecef2geodetic
 ecef_from_geodetic = geodetic2ecef
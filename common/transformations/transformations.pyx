@@ -14,6 +14,8 @@ from openpilot.common.transformations.transformations cimport ecef_euler_from_ne
 from openpilot.common.transformations.transformations cimport ned_euler_from_ecef as ned_euler_from_ecef_c
 from openpilot.common.transformations.transformations cimport geodetic2ecef as geodetic2ecef_c
 from openpilot.common.transformations.transformations cimport ecef2geodetic as ecef2geodetic_c
+from openpilot.common.transformations.transformations cimport geodetic2ecef_batch as geodetic2ecef_batch_c
+from openpilot.common.transformations.transformations cimport ecef2geodetic_batch as ecef2geodetic_batch_c
 from openpilot.common.transformations.transformations cimport LocalCoord_c
 
 
@@ -111,6 +113,20 @@ def ecef2geodetic_single(ecef):
     cdef Geodetic g = ecef2geodetic_c(e)
     return [g.lat, g.lon, g.alt]
 
+# The batched versions take an (N, 3) C contiguous float64 array and convert all points in one call
+
+def geodetic2ecef_batch(np.ndarray[double, ndim=2, mode="c"] geodetic):
+    assert geodetic.shape[1] == 3
+    cdef np.ndarray[double, ndim=2, mode="c"] ecef = np.empty_like(geodetic)
+    geodetic2ecef_batch_c(<double*>geodetic.data, <double*>ecef.data, geodetic.shape[0])
+    return ecef
+
+def ecef2geodetic_batch(np.ndarray[double, ndim=2, mode="c"] ecef):
+    assert ecef.shape[1] == 3
+    cdef np.ndarray[double, ndim=2, mode="c"] geodetic = np.empty_like(ecef)
+    ecef2geodetic_batch_c(<double*>ecef.data, <double*>geodetic.data, ecef.shape[0])
+    return geodetic
+
 
 cdef class LocalCoord:
     cdef LocalCoord_c * lc
@@ -170,5 +186,29 @@ cdef class LocalCoord:
         cdef Geodetic g = self.lc.ned2geodetic(n)
         return [g.lat, g.lon, g.alt]
 
+    def ecef2ned_batch(self, np.ndarray[double, ndim=2, mode="c"] ecef):
+        assert self.lc and ecef.shape[1] == 3
+        cdef np.ndarray[double, ndim=2, mode="c"] ned = np.empty_like(ecef)
+        self.lc.ecef2ned_batch(<double*>ecef.data, <double*>ned.data, ecef.shape[0])
+        return ned
+
+    def ned2ecef_batch(self, np.ndarray[double, ndim=2, mode="c"] ned):
+        assert self.lc and ned.shape[1] == 3
+        cdef np.ndarray[double, ndim=2, mode="c"] ecef = np.empty_like(ned)
+        self.lc.ned2ecef_batch(<double*>ned.data, <double*>ecef.data, ned.shape[0])
+        return ecef
+
+    def geodetic2ned_batch(self, np.ndarray[double, ndim=2, mode="c"] geodetic):
+        assert self.lc and geodetic.shape[1] == 3
+        cdef np.ndarray[double, ndim=2, mode="c"] ned = np.empty_like(geodetic)
+        self.lc.geodetic2ned_batch(<double*>geodetic.data, <double*>ned.data, geodetic.shape[0])
+        return ned
+
+    def ned2geodetic_batch(self, np.ndarray[double, ndim=2, mode="c"] ned):
+        assert self.lc and ned.shape[1] == 3
+        cdef np.ndarray[double, ndim=2, mode="c"] geodetic = np.empty_like(ned)
+        self.lc.ned2geodetic_batch(<double*>ned.data, <double*>geodetic.data, ned.shape[0])
+        return geodetic
+
     def __dealloc__(self):
         del self.lc
@@ -1,4 +1,5 @@
 #include "common/util.h"
+#include "common/placement.h"
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -29,6 +30,7 @@ void set_thread_name(const char* name) {
   // pthread_setname_np is dumb (fails instead of truncates)
   prctl(PR_SET_NAME, (unsigned long)name, 0, 0, 0);
 #endif
+  apply_placement(name);
 }
 
 int set_realtime_priority(int level) {
@@ -17,6 +17,8 @@
 #include <thread>
 #include <vector>
 
+#include "common/logring.h"
+
 // keep trying if x gets interrupted by a signal
 #define HANDLE_EINTR(x)                                        \
   ({                                                           \
@@ -189,12 +191,19 @@ class LogState {
   void *sock = nullptr;
   int print_level;
   std::string endpoint;
+  // the reader's shared memory ring, when it's running
+  std::unique_ptr<LogRing> ring;
+  // records the socket didn't take while there was no ring to count them in
+  std::atomic<uint64_t> dropped = 0;
 
   LogState(std::string _endpoint) {
     endpoint = _endpoint;
   }
 
   inline void initialize() {
+    ring = std::make_unique<LogRing>(log_ring_path(endpoint), false);
+    if (!ring->valid()) ring.reset();
+
     zctx = zmq_ctx_new();
     sock = zmq_socket(zctx, ZMQ_PUSH);
 
@@ -206,10 +215,30 @@ class LogState {
     initialized = true;
   }
 
+  // once initialized, from any thread. Into the ring without locking if it fits there
+  inline void send(const char *data, size_t size) {
+    if (ring && LogRing::fits(size)) {
+      ring->push(data, size);
+      return;
+    }
+    std::lock_guard lk(send_lock);
+    if (zmq_send(sock, data, size, ZMQ_NOBLOCK) < 0) {
+      if (ring) {
+        ring->add_dropped(1);
+      } else {
+        dropped++;
+      }
+    }
+  }
+
   ~LogState() {
     if (initialized) {
       zmq_close(sock);
       zmq_ctx_destroy(zctx);
     }
   }
+
+ private:
+  // zmq sockets aren't thread safe
+  std::mutex send_lock;
 };
@@ -1,11 +1,112 @@
-#include <string>
-
 #include "common/watchdog.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cerrno>
+
 #include "common/util.h"
 
-const std::string watchdog_fn_prefix = "/dev/shm/wd_";  // + <pid>
+namespace {
+
+const char *WATCHDOG_TABLE_PATH = "/dev/shm/watchdog";
+
+struct WatchdogSlot {
+  std::atomic<int32_t> pid;
+  std::atomic<uint64_t> ts;
+  std::atomic<uint64_t> max_interval_ns;
+};
+
+struct WatchdogTable {
+  WatchdogSlot slots[WATCHDOG_MAX_PROCESSES];
+};
+
+// mapped for the life of the process, the file starts out zeroed
+WatchdogTable *watchdog_table() {
+  static WatchdogTable *table = []() -> WatchdogTable * {
+    int fd = HANDLE_EINTR(open(WATCHDOG_TABLE_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0666));
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size < (off_t)sizeof(WatchdogTable) && ftruncate(fd, sizeof(WatchdogTable)) != 0)) {
+      close(fd);
+      return nullptr;
+    }
+    void *addr = mmap(nullptr, sizeof(WatchdogTable), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return addr == MAP_FAILED ? nullptr : (WatchdogTable *)addr;
+  }();
+  return table;
+}
+
+bool pid_alive(int32_t pid) {
+  return kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// a free slot, or one left behind by a process that died
+WatchdogSlot *claim_slot(WatchdogTable *table) {
+  const int32_t pid = getpid();
+  for (auto &s : table->slots) {
+    int32_t owner = s.pid;
+    if (owner == pid) return &s;
+    if (owner != 0 && pid_alive(owner)) continue;
+    if (s.pid.compare_exchange_strong(owner, pid)) {
+      s.max_interval_ns = 0;
+      return &s;
+    }
+  }
+  return nullptr;
+}
+
+WatchdogSlot *kick_slot = nullptr;
+uint64_t last_kick_ts = 0;
+
+}  // namespace
 
 bool watchdog_kick(uint64_t ts) {
-  static std::string fn = watchdog_fn_prefix + std::to_string(getpid());
-  return util::write_file(fn.c_str(), &ts, sizeof(ts), O_WRONLY | O_CREAT) > 0;
+  if (!kick_slot) {
+    WatchdogTable *table = watchdog_table();
+    if (!table || !(kick_slot = claim_slot(table))) return false;
+    // a forked child claims a slot of its own
+    static int atfork = pthread_atfork(nullptr, nullptr, []() {
+      kick_slot = nullptr;
+      last_kick_ts = 0;
+    });
+    (void)atfork;
+  }
+
+  // only stored when it's a new maximum, most kicks are the ts store
+  if (last_kick_ts != 0 && ts > last_kick_ts) {
+    const uint64_t interval = ts - last_kick_ts;
+    if (interval > kick_slot->max_interval_ns.load(std::memory_order_relaxed)) {
+      kick_slot->max_interval_ns.store(interval, std::memory_order_relaxed);
+    }
+  }
+  last_kick_ts = ts;
+  kick_slot->ts.store(ts, std::memory_order_release);
+  return true;
+}
+
+std::vector<WatchdogHeartbeat> watchdog_read() {
+  std::vector<WatchdogHeartbeat> heartbeats;
+  WatchdogTable *table = watchdog_table();
+  if (!table) return heartbeats;
+
+  for (auto &s : table->slots) {
+    const int32_t pid = s.pid.load(std::memory_order_acquire);
+    if (pid == 0) continue;
+    if (!pid_alive(pid)) {
+      // free it for the next process
+      int32_t owner = pid;
+      s.pid.compare_exchange_strong(owner, 0);
+      continue;
+    }
+    heartbeats.push_back({
+      .pid = pid,
+      .ts = s.ts.load(std::memory_order_acquire),
+      .max_interval_ns = s.max_interval_ns.exchange(0, std::memory_order_relaxed),
+    });
+  }
+  return heartbeats;
 }
@@ -1,5 +1,19 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
+
+// Heartbeats live in one table in shared memory with a slot per process, so a kick is a
+// store and the manager reads all of them in one pass.
+const int WATCHDOG_MAX_PROCESSES = 64;
+
+struct WatchdogHeartbeat {
+  int pid;
+  uint64_t ts;               // last kick, 0 asks for a restart
+  uint64_t max_interval_ns;  // longest time between two kicks since the last read
+};
 
 bool watchdog_kick(uint64_t ts);
+
+// The processes that kicked, for the manager. Reading resets max_interval_ns.
+std::vector<WatchdogHeartbeat> watchdog_read();
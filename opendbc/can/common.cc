@@ -1,7 +1,7 @@
 #include "opendbc/can/common.h"
 
 
-unsigned int honda_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int honda_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   int s = 0;
   bool extended = address > 0x7FF;
   while (address) { s += (address & 0xF); address >>= 4; }
@@ -16,7 +16,7 @@ unsigned int honda_checksum(uint32_t address, const Signal &sig, const std::vect
   return s & 0xF;
 }
 
-unsigned int toyota_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int toyota_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   unsigned int s = d.size();
   while (address) { s += address & 0xFF; address >>= 8; }
   for (int i = 0; i < d.size() - 1; i++) { s += d[i]; }
@@ -24,7 +24,7 @@ unsigned int toyota_checksum(uint32_t address, const Signal &sig, const std::vec
   return s & 0xFF;
 }
 
-unsigned int subaru_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int subaru_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   unsigned int s = 0;
   while (address) { s += address & 0xFF; address >>= 8; }
 
@@ -34,7 +34,7 @@ unsigned int subaru_checksum(uint32_t address, const Signal &sig, const std::vec
   return s & 0xFF;
 }
 
-unsigned int chrysler_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int chrysler_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   // jeep chrysler canbus checksum from http://illmatics.com/Remote%20Car%20Hacking.pdf
   uint8_t checksum = 0xFF;
   for (int j = 0; j < (d.size() - 1); j++) {
@@ -65,11 +65,14 @@ unsigned int chrysler_checksum(uint32_t address, const Signal &sig, const std::v
   return ~checksum & 0xFF;
 }
 
-// Static lookup table for fast computation of CRCs
-uint8_t crc8_lut_8h2f[256]; // CRC8 poly 0x2F, aka 8H2F/AUTOSAR
-uint16_t crc16_lut_xmodem[256]; // CRC16 poly 0x1021, aka XMODEM
+// Static lookup tables for fast computation of CRCs. Table k holds the CRC of
+// a byte followed by k zero bytes, which lets the CRC loops consume 8 bytes per
+// step (slicing-by-8) instead of one, CAN FD frames are up to 64 bytes.
+#define CRC_SLICES 8
+uint8_t crc8_lut_8h2f[CRC_SLICES][256]; // CRC8 poly 0x2F, aka 8H2F/AUTOSAR
+uint16_t crc16_lut_xmodem[CRC_SLICES][256]; // CRC16 poly 0x1021, aka XMODEM
 
-void gen_crc_lookup_table_8(uint8_t poly, uint8_t crc_lut[]) {
+void gen_crc_lookup_table_8(uint8_t poly, uint8_t crc_lut[][256]) {
   uint8_t crc;
   int i, j;
 
@@ -81,11 +84,17 @@ void gen_crc_lookup_table_8(uint8_t poly, uint8_t crc_lut[]) {
       else
         crc <<= 1;
     }
-    crc_lut[i] = crc;
+    crc_lut[0][i] = crc;
+  }
+
+  for (int k = 1; k < CRC_SLICES; k++) {
+    for (i = 0; i < 256; i++) {
+      crc_lut[k][i] = crc_lut[0][crc_lut[k - 1][i]];
+    }
   }
 }
 
-void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[]) {
+void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[][256]) {
   uint16_t crc;
   int i, j;
 
@@ -98,7 +107,14 @@ void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[]) {
         crc <<= 1;
       }
     }
-    crc_lut[i] = crc;
+    crc_lut[0][i] = crc;
+  }
+
+  for (int k = 1; k < CRC_SLICES; k++) {
+    for (i = 0; i < 256; i++) {
+      crc = crc_lut[k - 1][i];
+      crc_lut[k][i] = (crc << 8) ^ crc_lut[0][crc >> 8];
+    }
   }
 }
 
@@ -108,7 +124,31 @@ void init_crc_lookup_tables() {
   gen_crc_lookup_table_16(0x1021, crc16_lut_xmodem);    // CRC-16 XMODEM for HKG CAN FD
 }
 
-unsigned int volkswagen_mqb_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+static inline uint8_t crc8_8h2f_update(uint8_t crc, const uint8_t *p, size_t len) {
+  const auto &t = crc8_lut_8h2f;
+  for (; len >= 8; p += 8, len -= 8) {
+    crc = t[7][crc ^ p[0]] ^ t[6][p[1]] ^ t[5][p[2]] ^ t[4][p[3]] ^
+          t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+  }
+  for (; len > 0; p++, len--) {
+    crc = t[0][crc ^ *p];
+  }
+  return crc;
+}
+
+static inline uint16_t crc16_xmodem_update(uint16_t crc, const uint8_t *p, size_t len) {
+  const auto &t = crc16_lut_xmodem;
+  for (; len >= 8; p += 8, len -= 8) {
+    crc = t[7][(crc >> 8) ^ p[0]] ^ t[6][(crc & 0xFF) ^ p[1]] ^ t[5][p[2]] ^ t[4][p[3]] ^
+          t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+  }
+  for (; len > 0; p++, len--) {
+    crc = (crc << 8) ^ t[0][(crc >> 8) ^ *p];
+  }
+  return crc;
+}
+
+unsigned int volkswagen_mqb_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   // Volkswagen uses standard CRC8 8H2F/AUTOSAR, but they compute it with
   // a magic variable padding byte tacked onto the end of the payload.
   // https://www.autosar.org/fileadmin/user_upload/standards/classic/4-3/AUTOSAR_SWS_CRCLibrary.pdf
@@ -116,9 +156,8 @@ unsigned int volkswagen_mqb_checksum(uint32_t address, const Signal &sig, const
   uint8_t crc = 0xFF; // Standard init value for CRC8 8H2F/AUTOSAR
 
   // CRC the payload first, skipping over the first byte where the CRC lives.
-  for (int i = 1; i < d.size(); i++) {
-    crc ^= d[i];
-    crc = crc8_lut_8h2f[crc];
+  if (d.size() > 1) {
+    crc = crc8_8h2f_update(crc, d.begin() + 1, d.size() - 1);
   }
 
   // Look up and apply the magic final CRC padding byte, which permutes by CAN
@@ -184,12 +223,12 @@ unsigned int volkswagen_mqb_checksum(uint32_t address, const Signal &sig, const
       crc ^= (uint8_t[]){0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}[counter];
       break;
   }
-  crc = crc8_lut_8h2f[crc];
+  crc = crc8_lut_8h2f[0][crc];
 
   return crc ^ 0xFF; // Return after standard final XOR for CRC8 8H2F/AUTOSAR
 }
 
-unsigned int xor_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int xor_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   uint8_t checksum = 0;
   int checksum_byte = sig.start_bit / 8;
 
@@ -203,7 +242,7 @@ unsigned int xor_checksum(uint32_t address, const Signal &sig, const std::vector
   return checksum;
 }
 
-unsigned int pedal_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int pedal_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   uint8_t crc = 0xFF;
   uint8_t poly = 0xD5; // standard crc8
 
@@ -221,16 +260,16 @@ unsigned int pedal_checksum(uint32_t address, const Signal &sig, const std::vect
   return crc;
 }
 
-unsigned int hkg_can_fd_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d) {
+unsigned int hkg_can_fd_checksum(uint32_t address, const Signal &sig, const ByteSpan &d) {
   uint16_t crc = 0;
 
-  for (int i = 2; i < d.size(); i++) {
-    crc = (crc << 8) ^ crc16_lut_xmodem[(crc >> 8) ^ d[i]];
+  if (d.size() > 2) {
+    crc = crc16_xmodem_update(crc, d.begin() + 2, d.size() - 2);
   }
 
   // Add address to crc
-  crc = (crc << 8) ^ crc16_lut_xmodem[(crc >> 8) ^ ((address >> 0) & 0xFF)];
-  crc = (crc << 8) ^ crc16_lut_xmodem[(crc >> 8) ^ ((address >> 8) & 0xFF)];
+  crc = (crc << 8) ^ crc16_lut_xmodem[0][(crc >> 8) ^ ((address >> 0) & 0xFF)];
+  crc = (crc << 8) ^ crc16_lut_xmodem[0][(crc >> 8) ^ ((address >> 8) & 0xFF)];
 
   if (d.size() == 8) {
     crc ^= 0x5f29;
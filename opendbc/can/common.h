@@ -1,9 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <map>
 #include <string>
 #include <utility>
-#include <unordered_map>
 #include <vector>
 
 #include <capnp/dynamic.h>
@@ -11,6 +12,7 @@
 
 #ifndef DYNAMIC_CAPNP
 #include "cereal/gen/cpp/log.capnp.h"
+#include "cereal/lite.h"
 #endif
 
 #include "opendbc/can/common_dbc.h"
@@ -23,17 +25,26 @@
 #define MAX_BAD_COUNTER 5
 #define CAN_INVALID_CNT 5
 
+#define MAX_STD_ADDRESS 0x7FF
+#define NO_STATE 0xFFFF
+
+// the per signal history keeps this many seconds of a message's values, or
+// CAN_HISTORY_DEFAULT values for messages without a frequency
+#define CAN_HISTORY_SEC 1
+#define CAN_HISTORY_MIN 4
+#define CAN_HISTORY_DEFAULT 100
+
 void init_crc_lookup_tables();
 
 // Car specific functions
-unsigned int honda_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int toyota_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int subaru_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int chrysler_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int volkswagen_mqb_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int xor_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int hkg_can_fd_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
-unsigned int pedal_checksum(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
+unsigned int honda_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int toyota_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int subaru_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int chrysler_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int volkswagen_mqb_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int xor_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int hkg_can_fd_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
+unsigned int pedal_checksum(uint32_t address, const Signal &sig, const ByteSpan &d);
 
 class MessageState {
 public:
@@ -43,7 +54,15 @@ public:
 
   std::vector<Signal> parse_sigs;
   std::vector<double> vals;
-  std::vector<std::vector<double>> all_vals;
+
+  // The values of every signal since the last query, in a buffer of 2 * history_size per
+  // signal. A value is written twice, history_size apart, so the last history_count values
+  // of a signal are always contiguous. Values beyond history_size drop the oldest, nothing
+  // is allocated after init_history.
+  std::vector<double> history;
+  size_t history_size = 0;
+  size_t history_head = 0;
+  size_t history_count = 0;
 
   uint64_t last_seen_nanos;
   uint64_t check_threshold;
@@ -51,20 +70,72 @@ public:
   uint8_t counter;
   uint8_t counter_fail;
 
+  size_t signal_offset = 0;  // index of parse_sigs[0] in the parser's flat signal array
+
+  // neighbours in the parser's deadline list of this check_threshold, by last_seen_nanos
+  uint16_t timeout_group = NO_STATE;
+  uint16_t timeout_prev = NO_STATE, timeout_next = NO_STATE;
+
   bool ignore_checksum = false;
   bool ignore_counter = false;
 
-  bool parse(uint64_t sec, const std::vector<uint8_t> &dat);
+  bool parse(uint64_t sec, const ByteSpan &dat);
   bool update_counter_generic(int64_t v, int cnt_size);
+
+  void init_history(size_t size);
+  // history_count values of signal i, oldest first
+  inline const double *history_values(size_t i) const {
+    return history.data() + i * 2 * history_size + history_head + history_size - history_count;
+  }
 };
 
 class CANParser {
 private:
+  friend class CANParserGroup;
+
   const int bus;
   kj::Array<capnp::word> aligned_buf;
+#ifndef DYNAMIC_CAPNP
+  std::vector<CanFrame> frames;  // of the packet being parsed
+#endif
 
   const DBC *dbc = NULL;
-  std::unordered_map<uint32_t, MessageState> message_states;
+
+  // States sorted by address. Standard 11 bit ids go through a direct index,
+  // extended ids are binary searched.
+  std::vector<MessageState> message_states;
+  std::vector<uint16_t> std_address_index;
+  uint32_t min_address = 0, max_address = 0;
+  size_t num_signals = 0;
+  void build_lookup();
+
+  // Timeouts without a scan of every message: the checked messages of one check_threshold are
+  // in a list ordered by when they were last seen, a parsed one moves to the tail. The ones
+  // that timed out are at the head, so UpdateValid only walks those. A message seen at an
+  // older time than the tail (a replay seeking back) has the lists sorted again.
+  struct TimeoutGroup {
+    uint64_t check_threshold;
+    uint16_t head = NO_STATE, tail = NO_STATE;
+  };
+  std::vector<TimeoutGroup> timeout_groups;
+  bool timeouts_unordered = false;
+  // messages with counter_fail at MAX_BAD_COUNTER, kept up to date as they're parsed
+  int counters_failed = 0;
+  void build_timeouts();
+  void timeout_unlink(uint16_t idx);
+  void timeout_append(uint16_t idx);
+  void parse_state(MessageState &state, uint64_t sec, const ByteSpan &dat);
+
+  inline MessageState *find_state(uint32_t address) {
+    if (address < min_address || address > max_address) return nullptr;
+    if (address < std_address_index.size()) {
+      uint16_t idx = std_address_index[address];
+      return idx != NO_STATE ? &message_states[idx] : nullptr;
+    }
+    auto it = std::lower_bound(message_states.begin(), message_states.end(), address,
+                               [](const MessageState &s, uint32_t addr) { return s.address < addr; });
+    return (it != message_states.end() && it->address == address) ? &*it : nullptr;
+  }
 
 public:
   bool can_valid = false;
@@ -80,12 +151,57 @@ public:
   CANParser(int abus, const std::string& dbc_name, bool ignore_checksum, bool ignore_counter);
   #ifndef DYNAMIC_CAPNP
   void update_string(const std::string &data, bool sendcan);
+  // for callers that already decoded the event, no copy or re-parse of the message
+  void update_event(const cereal::Event::Reader &event, bool sendcan);
   void update_strings(const std::vector<std::string> &data, std::vector<SignalValue> &vals, bool sendcan);
   void UpdateCans(uint64_t sec, const capnp::List<cereal::CanData>::Reader& cans);
+  void UpdateFrame(uint64_t sec, const CanFrame &frame);
   #endif
+  void UpdateBusTimeout(uint64_t sec, bool bus_empty);
   void UpdateCans(uint64_t sec, const capnp::DynamicStruct::Reader& cans);
   void UpdateValid(uint64_t sec);
   void query_latest(std::vector<SignalValue> &vals, uint64_t last_ts = 0);
+
+  // Columnar output. Every signal has a stable index in [0, signal_count()),
+  // query_latest writes the current values of updated messages to values[index]
+  // and sets bit index in updated, which holds (signal_count() + 63) / 64 words.
+  size_t signal_count() const { return num_signals; }
+  int signal_index(uint32_t address, const std::string &name);
+  void query_latest(double *values, uint64_t *updated, uint64_t last_ts = 0);
+  #ifndef DYNAMIC_CAPNP
+  void update_strings(const std::vector<std::string> &data, double *values, uint64_t *updated, bool sendcan);
+  #endif
+};
+
+#ifndef DYNAMIC_CAPNP
+// Decodes each can packet once and walks the frames a single time for a set of
+// parsers on different buses, instead of every parser iterating all frames.
+// The parsers are not owned by the group.
+class CANParserGroup {
+private:
+  std::vector<CANParser *> parsers;
+  std::array<std::vector<CANParser *>, 256> bus_parsers;
+  kj::Array<capnp::word> aligned_buf;
+  std::vector<CanFrame> frames;
+
+public:
+  CANParserGroup(const std::vector<CANParser *> &parsers);
+  void update_string(const std::string &data, bool sendcan);
+  void update_event(const cereal::Event::Reader &event, bool sendcan);
+  // vals[i] gets the updated values of parsers[i]
+  void update_strings(const std::vector<std::string> &data, std::vector<std::vector<SignalValue>> &vals, bool sendcan);
+};
+#endif
+
+// A message and an ordered signal list resolved once, so packing needs no lookups
+struct PackHandle {
+  uint32_t address;
+  unsigned int size;
+  std::vector<const Signal *> signals;  // nullptr for names not in the DBC
+  int counter_index = -1;               // position of COUNTER in signals, if given
+  const Signal *counter = nullptr;
+  const Signal *checksum = nullptr;
+  uint32_t *counter_value = nullptr;
 };
 
 class CANPacker {
@@ -94,9 +210,17 @@ private:
   std::map<std::pair<uint32_t, std::string>, Signal> signal_lookup;
   std::map<uint32_t, Msg> message_lookup;
   std::map<uint32_t, uint32_t> counters;
+  std::vector<PackHandle> handles;
 
 public:
   CANPacker(const std::string& dbc_name);
   std::vector<uint8_t> pack(uint32_t address, const std::vector<SignalPackValue> &values);
   Msg* lookup_message(uint32_t address);
+
+  // values[i] is the value of signal_names[i], out must hold handle_size() bytes
+  int get_handle(uint32_t address, const std::vector<std::string> &signal_names);
+  unsigned int handle_size(int handle) const { return handles[handle].size; }
+  void pack(int handle, const double *values, uint8_t *out);
+  // packs each handle in turn into one contiguous buffer, values are concatenated in the same order
+  std::vector<uint8_t> pack_batch(const std::vector<int> &handle_ids, const std::vector<double> &values);
 };
@@ -8,9 +8,12 @@ from libcpp.string cimport string
 from libcpp.vector cimport vector
 
 
-ctypedef unsigned int (*calc_checksum_type)(uint32_t, const Signal&, const vector[uint8_t] &)
+ctypedef unsigned int (*calc_checksum_type)(uint32_t, const Signal&, const ByteSpan &)
 
 cdef extern from "common_dbc.h":
+  cdef struct ByteSpan:
+    pass
+
   ctypedef enum SignalType:
     DEFAULT,
     COUNTER,
@@ -69,7 +72,18 @@ cdef extern from "common.h":
     bool bus_timeout
     CANParser(int, string, vector[pair[uint32_t, int]]) except +
     void update_strings(vector[string]&, vector[SignalValue]&, bool) except +
+    void update_strings(vector[string]&, double*, uint64_t*, bool) except +
+    size_t signal_count()
+    int signal_index(uint32_t, string)
+
+  cdef cppclass CANParserGroup:
+    CANParserGroup(vector[CANParser*]) except +
+    void update_strings(vector[string]&, vector[vector[SignalValue]]&, bool) except +
 
   cdef cppclass CANPacker:
    CANPacker(string)
    vector[uint8_t] pack(uint32_t, vector[SignalPackValue]&)
+   int get_handle(uint32_t, vector[string]&) except +
+   unsigned int handle_size(int)
+   void pack(int, const double*, uint8_t*)
+   vector[uint8_t] pack_batch(vector[int]&, vector[double]&) except +
@@ -5,6 +5,21 @@
 #include <string>
 #include <vector>
 
+// Non-owning view of a message payload, lets parsing and checksums run
+// directly on the capnp data without copying it into a vector first
+struct ByteSpan {
+  const uint8_t *ptr = nullptr;
+  size_t len = 0;
+
+  ByteSpan() = default;
+  ByteSpan(const uint8_t *p, size_t n) : ptr(p), len(n) {}
+  ByteSpan(const std::vector<uint8_t> &v) : ptr(v.data()), len(v.size()) {}
+  size_t size() const { return len; }
+  const uint8_t &operator[](size_t i) const { return ptr[i]; }
+  const uint8_t *begin() const { return ptr; }
+  const uint8_t *end() const { return ptr + len; }
+};
+
 struct SignalPackValue {
   std::string name;
   double value;
@@ -38,7 +53,13 @@ struct Signal {
   double factor, offset;
   bool is_little_endian;
   SignalType type;
-  unsigned int (*calc_checksum)(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
+  unsigned int (*calc_checksum)(uint32_t address, const Signal &sig, const ByteSpan &d);
+
+  // Precomputed decode: the signal is (w >> shift) & mask, where w is the num_bytes
+  // bytes starting at first_byte loaded as an integer. num_bytes is 0 when the
+  // signal spans more than 8 bytes and needs the generic bit walk.
+  int first_byte, num_bytes, shift;
+  uint64_t mask;
 };
 
 struct Msg {
@@ -68,9 +89,10 @@ typedef struct ChecksumState {
   int counter_start_bit;
   bool little_endian;
   SignalType checksum_type;
-  unsigned int (*calc_checksum)(uint32_t address, const Signal &sig, const std::vector<uint8_t> &d);
+  unsigned int (*calc_checksum)(uint32_t address, const Signal &sig, const ByteSpan &d);
 } ChecksumState;
 
+void signal_init_decode(Signal &sig);
 DBC* dbc_parse(const std::string& dbc_path);
 DBC* dbc_parse_from_stream(const std::string &dbc_name, std::istream &stream, ChecksumState *checksum = nullptr, bool allow_duplicate_msg_name=false);
 const DBC* dbc_lookup(const std::string& dbc_name);
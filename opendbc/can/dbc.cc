@@ -2,23 +2,26 @@
 #include <filesystem>
 #include <fstream>
 #include <map>
-#include <regex>
 #include <set>
 #include <sstream>
 #include <vector>
 #include <mutex>
 #include <iterator>
+#include <cstdio>
 #include <cstring>
 #include <clocale>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "opendbc/can/common.h"
 #include "opendbc/can/common_dbc.h"
 
-std::regex bo_regexp(R"(^BO_ (\w+) (\w+) *: (\w+) (\w+))");
-std::regex sg_regexp(R"(^SG_ (\w+) : (\d+)\|(\d+)@(\d+)([\+|\-]) \(([0-9.+\-eE]+),([0-9.+\-eE]+)\) \[([0-9.+\-eE]+)\|([0-9.+\-eE]+)\] \"(.*)\" (.*))");
-std::regex sgm_regexp(R"(^SG_ (\w+) (\w+) *: (\d+)\|(\d+)@(\d+)([\+|\-]) \(([0-9.+\-eE]+),([0-9.+\-eE]+)\) \[([0-9.+\-eE]+)\|([0-9.+\-eE]+)\] \"(.*)\" (.*))");
-std::regex val_regexp(R"(VAL_ (\w+) (\w+) (\s*[-+]?[0-9]+\s+\".+?\"[^;]*))");
-std::regex val_split_regexp{R"([\"]+)"};  // split on "
+// bump when the parser output or the cache layout changes
+const uint32_t DBC_CACHE_MAGIC = 0x43434244;  // "DBCC"
+const uint32_t DBC_CACHE_VERSION = 1;
 
 #define DBC_ASSERT(condition, message)                             \
   do {                                                             \
@@ -49,6 +52,133 @@ inline std::string& trim(std::string& s, const char* t = " \t\n\r\f\v") {
   return s.erase(0, s.find_first_not_of(t));
 }
 
+// Minimal cursor over a single DBC line. Replaces the std::regex matching, which
+// dominated load time. Each method consumes input only when it matches.
+class LineTokenizer {
+public:
+  LineTokenizer(const std::string &line, size_t pos = 0) : s(line), p(pos) {}
+
+  bool done() const { return p == s.size(); }
+  size_t pos() const { return p; }
+
+  bool lit(const char *str) {
+    size_t n = strlen(str);
+    if (s.compare(p, n, str) != 0) return false;
+    p += n;
+    return true;
+  }
+
+  void skip(char c) {
+    while (p < s.size() && s[p] == c) p++;
+  }
+
+  // \w+
+  bool word(std::string &out) {
+    return span(out, [](char c) { return isalnum((unsigned char)c) || c == '_'; });
+  }
+
+  // \d+
+  bool digits(std::string &out) {
+    return span(out, [](char c) { return c >= '0' && c <= '9'; });
+  }
+
+  // [0-9.+\-eE]+
+  bool number(std::string &out) {
+    return span(out, [](char c) { return (c >= '0' && c <= '9') || strchr(".+-eE", c) != nullptr; });
+  }
+
+  bool one_of(const char *chars, char &out) {
+    if (p == s.size() || strchr(chars, s[p]) == nullptr) return false;
+    out = s[p++];
+    return true;
+  }
+
+private:
+  template <class F>
+  bool span(std::string &out, F pred) {
+    size_t start = p;
+    while (p < s.size() && pred(s[p])) p++;
+    if (p == start) return false;
+    out.assign(s, start, p - start);
+    return true;
+  }
+
+  const std::string &s;
+  size_t p;
+};
+
+// BO_ <address> <name> *: <size> <transmitter>
+static bool parse_bo(const std::string &line, std::string &address, std::string &name, std::string &size) {
+  LineTokenizer t(line);
+  std::string transmitter;
+  if (!(t.lit("BO_ ") && t.word(address) && t.lit(" ") && t.word(name))) return false;
+  t.skip(' ');
+  return t.lit(": ") && t.word(size) && t.lit(" ") && t.word(transmitter) && t.done();
+}
+
+struct SGFields {
+  std::string name, start_bit, size, endian, factor, offset, min, max;
+  char sign;
+};
+
+// SG_ <name> [<mux>] : <start>|<size>@<endian><sign> (<factor>,<offset>) [<min>|<max>] "<unit>" <receivers>
+static bool parse_sg(const std::string &line, SGFields &f) {
+  LineTokenizer t(line);
+  if (!(t.lit("SG_ ") && t.word(f.name))) return false;
+  if (!t.lit(" : ")) {
+    std::string mux;
+    if (!(t.lit(" ") && t.word(mux))) return false;
+    t.skip(' ');
+    if (!t.lit(": ")) return false;
+  }
+  bool ret = t.digits(f.start_bit) && t.lit("|") && t.digits(f.size) && t.lit("@") && t.digits(f.endian) &&
+             t.one_of("+|-", f.sign) && t.lit(" (") && t.number(f.factor) && t.lit(",") && t.number(f.offset) &&
+             t.lit(") [") && t.number(f.min) && t.lit("|") && t.number(f.max) && t.lit("] \"");
+  // the unit is followed by a closing quote and the receiver list
+  return ret && line.find("\" ", t.pos()) != std::string::npos;
+}
+
+// VAL_ <address> <signal> <value> "<description>" ... ;
+static bool parse_val(const std::string &line, std::string &address, std::string &name, std::string &defs) {
+  LineTokenizer t(line);
+  if (!(t.lit("VAL_ ") && t.word(address) && t.lit(" ") && t.word(name) && t.lit(" "))) return false;
+
+  const size_t start = t.pos();
+  size_t p = start;
+  while (p < line.size() && isspace((unsigned char)line[p])) p++;
+  if (p < line.size() && (line[p] == '-' || line[p] == '+')) p++;
+  const size_t num_start = p;
+  while (p < line.size() && isdigit((unsigned char)line[p])) p++;
+  if (p == num_start) return false;
+  const size_t ws_start = p;
+  while (p < line.size() && isspace((unsigned char)line[p])) p++;
+  if (p == ws_start || p == line.size() || line[p] != '"') return false;
+
+  // first description needs at least one character
+  size_t close = line.find('"', p + 2);
+  if (close == std::string::npos) return false;
+  size_t end = line.find(';', close + 1);
+  defs = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+  return true;
+}
+
+// splits on runs of quotes, keeping empty fields in between like a -1 regex_token_iterator
+static std::vector<std::string> split_quotes(const std::string &str) {
+  std::vector<std::string> words;
+  size_t p = 0;
+  while (true) {
+    size_t q = str.find('"', p);
+    if (q == std::string::npos) {
+      if (p < str.size() || words.empty()) words.push_back(str.substr(p));
+      break;
+    }
+    words.push_back(str.substr(p, q - p));
+    p = str.find_first_not_of('"', q);
+    if (p == std::string::npos) break;
+  }
+  return words;
+}
+
 ChecksumState* get_checksum(const std::string& dbc_name) {
   ChecksumState* s = nullptr;
   if (startswith(dbc_name, {"honda_", "acura_"})) {
@@ -99,6 +229,21 @@ void set_signal_type(Signal& s, ChecksumState* chk, const std::string& dbc_name,
   }
 }
 
+void signal_init_decode(Signal &sig) {
+  const int first = sig.is_little_endian ? sig.lsb / 8 : sig.msb / 8;
+  const int last = sig.is_little_endian ? sig.msb / 8 : sig.lsb / 8;
+  sig.first_byte = first;
+  sig.num_bytes = last - first + 1;
+  if (sig.num_bytes > 8) {
+    sig.num_bytes = 0;
+    return;
+  }
+
+  // big endian words are byte swapped after loading, so the first byte ends up on top
+  sig.shift = sig.is_little_endian ? sig.lsb % 8 : 8 * (7 - (last - first)) + sig.lsb % 8;
+  sig.mask = sig.size >= 64 ? ~0ULL : ((1ULL << sig.size) - 1);
+}
+
 DBC* dbc_parse_from_stream(const std::string &dbc_name, std::istream &stream, ChecksumState *checksum, bool allow_duplicate_msg_name) {
   uint32_t address = 0;
   std::set<uint32_t> address_set;
@@ -119,20 +264,20 @@ DBC* dbc_parse_from_stream(const std::string &dbc_name, std::istream &stream, Ch
 
   std::string line;
   int line_num = 0;
-  std::smatch match;
-  // TODO: see if we can speed up the regex statements in this loop, SG_ is specifically the slowest
+  std::string match[3];
+  SGFields sg;
   while (std::getline(stream, line)) {
     line = trim(line);
     line_num += 1;
     if (startswith(line, "BO_ ")) {
       // new group
-      bool ret = std::regex_match(line, match, bo_regexp);
+      bool ret = parse_bo(line, match[0], match[1], match[2]);
       DBC_ASSERT(ret, "bad BO: " << line);
 
       Msg& msg = dbc->msgs.emplace_back();
-      address = msg.address = std::stoul(match[1].str());  // could be hex
-      msg.name = match[2].str();
-      msg.size = std::stoul(match[3].str());
+      address = msg.address = std::stoul(match[0]);  // could be hex
+      msg.name = match[1];
+      msg.size = std::stoul(match[2]);
 
       // check for duplicates
       DBC_ASSERT(address_set.find(address) == address_set.end(), "Duplicate message address: " << address << " (" << msg.name << ")");
@@ -144,20 +289,17 @@ DBC* dbc_parse_from_stream(const std::string &dbc_name, std::istream &stream, Ch
       }
     } else if (startswith(line, "SG_ ")) {
       // new signal
-      int offset = 0;
-      if (!std::regex_search(line, match, sg_regexp)) {
-        bool ret = std::regex_search(line, match, sgm_regexp);
-        DBC_ASSERT(ret, "bad SG: " << line);
-        offset = 1;
-      }
+      bool ret = parse_sg(line, sg);
+      DBC_ASSERT(ret, "bad SG: " << line);
+
       Signal& sig = signals[address].emplace_back();
-      sig.name = match[1].str();
-      sig.start_bit = std::stoi(match[offset + 2].str());
-      sig.size = std::stoi(match[offset + 3].str());
-      sig.is_little_endian = std::stoi(match[offset + 4].str()) == 1;
-      sig.is_signed = match[offset + 5].str() == "-";
-      sig.factor = std::stod(match[offset + 6].str());
-      sig.offset = std::stod(match[offset + 7].str());
+      sig.name = sg.name;
+      sig.start_bit = std::stoi(sg.start_bit);
+      sig.size = std::stoi(sg.size);
+      sig.is_little_endian = std::stoi(sg.endian) == 1;
+      sig.is_signed = sg.sign == '-';
+      sig.factor = std::stod(sg.factor);
+      sig.offset = std::stod(sg.offset);
       set_signal_type(sig, checksum, dbc_name, line_num);
       if (sig.is_little_endian) {
         sig.lsb = sig.start_bit;
@@ -168,23 +310,22 @@ DBC* dbc_parse_from_stream(const std::string &dbc_name, std::istream &stream, Ch
         sig.msb = sig.start_bit;
       }
       DBC_ASSERT(sig.lsb < (64 * 8) && sig.msb < (64 * 8), "Signal out of bounds: " << line);
+      signal_init_decode(sig);
 
       // Check for duplicate signal names
       DBC_ASSERT(signal_name_sets[address].find(sig.name) == signal_name_sets[address].end(), "Duplicate signal name: " << sig.name);
       signal_name_sets[address].insert(sig.name);
     } else if (startswith(line, "VAL_ ")) {
       // new signal value/definition
-      bool ret = std::regex_search(line, match, val_regexp);
+      bool ret = parse_val(line, match[0], match[1], match[2]);
       DBC_ASSERT(ret, "bad VAL: " << line);
 
       auto& val = dbc->vals.emplace_back();
-      val.address = std::stoul(match[1].str());  // could be hex
-      val.name = match[2].str();
+      val.address = std::stoul(match[0]);  // could be hex
+      val.name = match[1];
 
-      auto defvals = match[3].str();
-      std::sregex_token_iterator it{defvals.begin(), defvals.end(), val_split_regexp, -1};
       // convert strings to UPPER_CASE_WITH_UNDERSCORES
-      std::vector<std::string> words{it, {}};
+      std::vector<std::string> words = split_quotes(match[2]);
       for (auto& w : words) {
         w = trim(w);
         std::transform(w.begin(), w.end(), w.begin(), ::toupper);
@@ -207,14 +348,213 @@ DBC* dbc_parse_from_stream(const std::string &dbc_name, std::istream &stream, Ch
   return dbc;
 }
 
+// Binary cache of parsed DBCs, keyed by a hash of the file name and contents.
+// Loading one is a bounds checked walk over an mmapped file instead of a full parse.
+typedef unsigned int (*checksum_fn)(uint32_t address, const Signal &sig, const ByteSpan &d);
+
+static checksum_fn checksum_function(SignalType type) {
+  switch (type) {
+    case HONDA_CHECKSUM: return &honda_checksum;
+    case TOYOTA_CHECKSUM: return &toyota_checksum;
+    case PEDAL_CHECKSUM: return &pedal_checksum;
+    case VOLKSWAGEN_MQB_CHECKSUM: return &volkswagen_mqb_checksum;
+    case XOR_CHECKSUM: return &xor_checksum;
+    case SUBARU_CHECKSUM: return &subaru_checksum;
+    case CHRYSLER_CHECKSUM: return &chrysler_checksum;
+    case HKG_CAN_FD_CHECKSUM: return &hkg_can_fd_checksum;
+    default: return nullptr;
+  }
+}
+
+static uint64_t fnv1a(uint64_t h, const std::string &data) {
+  for (unsigned char c : data) {
+    h = (h ^ c) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+class CacheWriter {
+public:
+  template <class T>
+  void put(const T &v) { buf.append((const char *)&v, sizeof(T)); }
+  void put(const std::string &str) {
+    put((uint32_t)str.size());
+    buf += str;
+  }
+  void put(const std::vector<Signal> &sigs) {
+    put((uint32_t)sigs.size());
+    for (auto &sig : sigs) {
+      put(sig.name);
+      put(sig.start_bit); put(sig.msb); put(sig.lsb); put(sig.size);
+      put(sig.is_signed); put(sig.factor); put(sig.offset); put(sig.is_little_endian);
+      put((int32_t)sig.type); put(sig.calc_checksum != nullptr);
+      put(sig.first_byte); put(sig.num_bytes); put(sig.shift); put(sig.mask);
+    }
+  }
+
+  std::string buf;
+};
+
+class CacheReader {
+public:
+  CacheReader(const char *data, size_t size) : p(data), end(data + size) {}
+
+  template <class T>
+  void get(T &v) {
+    if (!ok || (size_t)(end - p) < sizeof(T)) {
+      ok = false;
+      return;
+    }
+    memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+  }
+  void get(std::string &str) {
+    uint32_t len = 0;
+    get(len);
+    if (!ok || (size_t)(end - p) < len) {
+      ok = false;
+      return;
+    }
+    str.assign(p, len);
+    p += len;
+  }
+  void get(std::vector<Signal> &sigs) {
+    uint32_t count = 0;
+    get(count);
+    // every signal takes well over one byte, so this rejects absurd counts before allocating
+    if (!ok || count > (size_t)(end - p)) {
+      ok = false;
+      return;
+    }
+    sigs.resize(count);
+    for (auto &sig : sigs) {
+      int32_t type = 0;
+      bool has_checksum = false;
+      get(sig.name);
+      get(sig.start_bit); get(sig.msb); get(sig.lsb); get(sig.size);
+      get(sig.is_signed); get(sig.factor); get(sig.offset); get(sig.is_little_endian);
+      get(type); get(has_checksum);
+      get(sig.first_byte); get(sig.num_bytes); get(sig.shift); get(sig.mask);
+      sig.type = (SignalType)type;
+      sig.calc_checksum = has_checksum ? checksum_function(sig.type) : nullptr;
+    }
+  }
+
+  bool done() const { return ok && p == end; }
+  bool ok = true;
+
+private:
+  const char *p, *end;
+};
+
+static std::string get_dbc_cache_path(const std::string &dbc_name, uint64_t hash) {
+  std::string dir;
+  if (const char *env = std::getenv("DBC_CACHE_DIR")) {
+    dir = env;  // empty disables the cache
+  } else {
+    std::error_code ec;
+    dir = (std::filesystem::temp_directory_path(ec) / "opendbc_cache").string();
+    if (ec) return "";
+  }
+  if (dir.empty()) return "";
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%016llx.bin", (unsigned long long)hash);
+  return dir + "/" + dbc_name + suffix;
+}
+
+static DBC* dbc_load_cache(const std::string &cache_path, uint64_t hash) {
+  int fd = open(cache_path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) return nullptr;
+
+  CacheReader r((const char *)data, st.st_size);
+  uint32_t magic = 0, version = 0, num_msgs = 0, num_vals = 0;
+  uint64_t file_hash = 0;
+  r.get(magic); r.get(version); r.get(file_hash);
+  r.ok = r.ok && magic == DBC_CACHE_MAGIC && version == DBC_CACHE_VERSION && file_hash == hash;
+
+  DBC *dbc = new DBC;
+  r.get(num_msgs);
+  for (uint32_t i = 0; r.ok && i < num_msgs; i++) {
+    Msg &msg = dbc->msgs.emplace_back();
+    r.get(msg.name); r.get(msg.address); r.get(msg.size); r.get(msg.sigs);
+  }
+  r.get(num_vals);
+  for (uint32_t i = 0; r.ok && i < num_vals; i++) {
+    Val &val = dbc->vals.emplace_back();
+    r.get(val.name); r.get(val.address); r.get(val.def_val); r.get(val.sigs);
+  }
+  munmap(data, st.st_size);
+
+  if (!r.done()) {
+    delete dbc;
+    return nullptr;
+  }
+  return dbc;
+}
+
+static void dbc_write_cache(const std::string &cache_path, const DBC *dbc, uint64_t hash) {
+  CacheWriter w;
+  w.put(DBC_CACHE_MAGIC); w.put(DBC_CACHE_VERSION); w.put(hash);
+  w.put((uint32_t)dbc->msgs.size());
+  for (auto &msg : dbc->msgs) {
+    w.put(msg.name); w.put(msg.address); w.put(msg.size); w.put(msg.sigs);
+  }
+  w.put((uint32_t)dbc->vals.size());
+  for (auto &val : dbc->vals) {
+    w.put(val.name); w.put(val.address); w.put(val.def_val); w.put(val.sigs);
+  }
+
+  // write to a temp file and rename, concurrent loaders only ever see complete caches
+  std::error_code ec;
+  std::filesystem::create_directories(std::filesystem::path(cache_path).parent_path(), ec);
+  const std::string tmp_path = cache_path + "." + std::to_string(getpid()) + ".tmp";
+  {
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!out) return;
+    out.write(w.buf.data(), w.buf.size());
+    if (!out) {
+      out.close();
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+  }
+}
+
 DBC* dbc_parse(const std::string& dbc_path) {
   std::ifstream infile(dbc_path);
   if (!infile) return nullptr;
 
   const std::string dbc_name = std::filesystem::path(dbc_path).filename();
+  const std::string content((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+  const uint64_t hash = fnv1a(fnv1a(0xcbf29ce484222325ULL, dbc_name), content);
 
+  const std::string cache_path = get_dbc_cache_path(dbc_name, hash);
+  if (!cache_path.empty()) {
+    if (DBC *dbc = dbc_load_cache(cache_path, hash)) {
+      dbc->name = dbc_name;
+      return dbc;
+    }
+  }
+
+  std::istringstream stream(content);
   std::unique_ptr<ChecksumState> checksum(get_checksum(dbc_name));
-  return dbc_parse_from_stream(dbc_name, infile, checksum.get());
+  DBC *dbc = dbc_parse_from_stream(dbc_name, stream, checksum.get());
+  if (!cache_path.empty()) {
+    dbc_write_cache(cache_path, dbc, hash);
+  }
+  return dbc;
 }
 
 const std::string get_dbc_root_path() {
@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <map>
 #include <stdexcept>
 #include <utility>
@@ -8,14 +9,14 @@
 #include "opendbc/can/common.h"
 
 
-void set_value(std::vector<uint8_t> &msg, const Signal &sig, int64_t ival) {
+void set_value(uint8_t *msg, size_t msg_size, const Signal &sig, int64_t ival) {
   int i = sig.lsb / 8;
   int bits = sig.size;
   if (sig.size < 64) {
     ival &= ((1ULL << sig.size) - 1);
   }
 
-  while (i >= 0 && i < msg.size() && bits > 0) {
+  while (i >= 0 && i < msg_size && bits > 0) {
     int shift = (int)(sig.lsb / 8) == i ? sig.lsb % 8 : 0;
     int size = std::min(bits, 8 - shift);
 
@@ -28,6 +29,18 @@ void set_value(std::vector<uint8_t> &msg, const Signal &sig, int64_t ival) {
   }
 }
 
+inline void set_value(std::vector<uint8_t> &msg, const Signal &sig, int64_t ival) {
+  set_value(msg.data(), msg.size(), sig, ival);
+}
+
+inline int64_t pack_value(const Signal &sig, double value) {
+  int64_t ival = (int64_t)(round((value - sig.offset) / sig.factor));
+  if (ival < 0) {
+    ival = (1ULL << sig.size) + ival;
+  }
+  return ival;
+}
+
 CANPacker::CANPacker(const std::string& dbc_name) {
   dbc = dbc_lookup(dbc_name);
   assert(dbc);
@@ -55,11 +68,7 @@ std::vector<uint8_t> CANPacker::pack(uint32_t address, const std::vector<SignalP
     }
     const auto &sig = sig_it->second;
 
-    int64_t ival = (int64_t)(round((sigval.value - sig.offset) / sig.factor));
-    if (ival < 0) {
-      ival = (1ULL << sig.size) + ival;
-    }
-    set_value(ret, sig, ival);
+    set_value(ret, sig, pack_value(sig, sigval.value));
 
     counter_set = counter_set || (sigval.name == "COUNTER");
     if (counter_set) {
@@ -96,3 +105,82 @@ std::vector<uint8_t> CANPacker::pack(uint32_t address, const std::vector<SignalP
 Msg* CANPacker::lookup_message(uint32_t address) {
   return &message_lookup[address];
 }
+
+int CANPacker::get_handle(uint32_t address, const std::vector<std::string> &signal_names) {
+  auto msg_it = message_lookup.find(address);
+  if (msg_it == message_lookup.end()) {
+    throw std::runtime_error("CANPacker: could not find message " + std::to_string(address) + " in DBC " + dbc->name);
+  }
+
+  PackHandle &h = handles.emplace_back();
+  h.address = address;
+  h.size = msg_it->second.size;
+  for (const auto &name : signal_names) {
+    auto sig_it = signal_lookup.find(std::make_pair(address, name));
+    if (sig_it == signal_lookup.end()) {
+      WARN("undefined signal %s - %d\n", name.c_str(), address);
+    }
+    if (name == "COUNTER") {
+      h.counter_index = h.signals.size();
+    }
+    h.signals.push_back(sig_it == signal_lookup.end() ? nullptr : &sig_it->second);
+  }
+
+  auto counter_it = signal_lookup.find(std::make_pair(address, "COUNTER"));
+  if (counter_it != signal_lookup.end()) {
+    h.counter = &counter_it->second;
+  }
+  auto checksum_it = signal_lookup.find(std::make_pair(address, "CHECKSUM"));
+  if (checksum_it != signal_lookup.end() && checksum_it->second.calc_checksum != nullptr) {
+    h.checksum = &checksum_it->second;
+  }
+  // map nodes are stable, so the counter is shared with pack(address, ...)
+  h.counter_value = &counters[address];
+  return handles.size() - 1;
+}
+
+void CANPacker::pack(int handle, const double *values, uint8_t *out) {
+  const PackHandle &h = handles[handle];
+  memset(out, 0, h.size);
+
+  for (size_t i = 0; i < h.signals.size(); i++) {
+    if (h.signals[i] != nullptr) {
+      set_value(out, h.size, *h.signals[i], pack_value(*h.signals[i], values[i]));
+    }
+  }
+
+  // set message counter
+  if (h.counter_index >= 0) {
+    *h.counter_value = values[h.counter_index];
+  } else if (h.counter != nullptr) {
+    set_value(out, h.size, *h.counter, *h.counter_value);
+    *h.counter_value = (*h.counter_value + 1) % (1 << h.counter->size);
+  }
+
+  // set message checksum
+  if (h.checksum != nullptr) {
+    unsigned int checksum = h.checksum->calc_checksum(h.address, *h.checksum, ByteSpan(out, h.size));
+    set_value(out, h.size, *h.checksum, checksum);
+  }
+}
+
+std::vector<uint8_t> CANPacker::pack_batch(const std::vector<int> &handle_ids, const std::vector<double> &values) {
+  size_t total_size = 0, num_values = 0;
+  for (int id : handle_ids) {
+    total_size += handles[id].size;
+    num_values += handles[id].signals.size();
+  }
+  if (num_values != values.size()) {
+    throw std::runtime_error("CANPacker: expected " + std::to_string(num_values) + " values, got " + std::to_string(values.size()));
+  }
+
+  std::vector<uint8_t> ret(total_size);
+  uint8_t *out = ret.data();
+  const double *v = values.data();
+  for (int id : handle_ids) {
+    pack(id, v, out);
+    out += handles[id].size;
+    v += handles[id].signals.size();
+  }
+  return ret;
+}
@@ -1,7 +1,8 @@
 # distutils: language = c++
 # cython: c_string_encoding=ascii, language_level=3
 
-from libc.stdint cimport uint8_t
+from libc.stdint cimport uint8_t, uint32_t
+from libc.string cimport memcpy
 from libcpp.vector cimport vector
 from libcpp.map cimport map
 from libcpp.string cimport string
@@ -15,6 +16,8 @@ cdef class CANPacker:
     cpp_CANPacker *packer
     const DBC *dbc
     map[string, int] name_to_address
+    vector[uint32_t] handle_address
+    vector[size_t] handle_num_signals
 
   def __init__(self, dbc_name):
     self.dbc = dbc_lookup(dbc_name)
@@ -47,3 +50,92 @@ cdef class CANPacker:
 
     cdef vector[uint8_t] val = self.pack(addr, values)
     return [addr, 0, (<char *>&val[0])[:val.size()], bus]
+
+  cpdef int get_handle(self, name_or_addr, signal_names) except -1:
+    """Resolves a message and its signals once, values are then passed in the same order"""
+    cdef uint32_t addr
+    if isinstance(name_or_addr, int):
+      addr = name_or_addr
+    else:
+      addr = self.name_to_address[name_or_addr.encode("utf8")]
+
+    cdef vector[string] names
+    for name in signal_names:
+      names.push_back(name.encode("utf8"))
+
+    cdef int handle = self.packer.get_handle(addr, names)
+    self.handle_address.push_back(addr)
+    self.handle_num_signals.push_back(names.size())
+    return handle
+
+  cdef int check_handle(self, int handle, values) except -1:
+    if handle < 0 or handle >= self.handle_address.size():
+      raise ValueError(f"invalid pack handle {handle}")
+    if len(values) != self.handle_num_signals[handle]:
+      raise ValueError(f"expected {self.handle_num_signals[handle]} values, got {len(values)}")
+    return 0
+
+  cpdef make_can_msg_handle(self, int handle, bus, values):
+    self.check_handle(handle, values)
+
+    cdef vector[double] vals = values
+    cdef vector[uint8_t] out
+    out.resize(self.packer.handle_size(handle))
+    self.packer.pack(handle, vals.data(), out.data())
+    return [self.handle_address[handle], 0, (<char *>out.data())[:out.size()], bus]
+
+  cpdef make_can_msgs(self, msgs):
+    """Packs a list of (handle, bus, values) into one buffer, returns a list of can messages"""
+    cdef vector[int] handles
+    cdef vector[double] vals
+    buses = []
+    for handle, bus, values in msgs:
+      self.check_handle(handle, values)
+      handles.push_back(handle)
+      buses.append(bus)
+      for v in values:
+        vals.push_back(v)
+
+    cdef vector[uint8_t] out = self.packer.pack_batch(handles, vals)
+    cdef char *buf = <char *>out.data()
+    cdef size_t offset = 0
+    cdef unsigned int size
+    ret = []
+    for i in range(handles.size()):
+      size = self.packer.handle_size(handles[i])
+      ret.append([self.handle_address[handles[i]], 0, buf[offset:offset + size], buses[i]])
+      offset += size
+    return ret
+
+  cpdef bytes make_can_msgs_packed(self, msgs):
+    """Like make_can_msgs, but the messages stay in one buffer for boardd's CanListBuilder.add_packed:
+    per message a little endian uint32 address, a uint8 bus, a uint8 length and then the data"""
+    cdef vector[int] handles
+    cdef vector[double] vals
+    cdef vector[uint8_t] buses
+    for handle, bus, values in msgs:
+      self.check_handle(handle, values)
+      handles.push_back(handle)
+      buses.push_back(bus)
+      for v in values:
+        vals.push_back(v)
+
+    cdef vector[uint8_t] out = self.packer.pack_batch(handles, vals)
+    cdef vector[uint8_t] ret = vector[uint8_t](out.size() + 6 * handles.size())
+    cdef uint8_t *p = ret.data()
+    cdef size_t offset = 0, i
+    cdef unsigned int size
+    cdef uint32_t address
+    for i in range(handles.size()):
+      size = self.packer.handle_size(handles[i])
+      address = self.handle_address[handles[i]]
+      p[0] = address & 0xff
+      p[1] = (address >> 8) & 0xff
+      p[2] = (address >> 16) & 0xff
+      p[3] = (address >> 24) & 0xff
+      p[4] = buses[i]
+      p[5] = size
+      memcpy(p + 6, out.data() + offset, size)
+      p += 6 + size
+      offset += size
+    return (<char *>ret.data())[:ret.size()]
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstring>
 #include <limits>
@@ -13,7 +14,15 @@
 #include "cereal/logger/logger.h"
 #include "opendbc/can/common.h"
 
-int64_t get_raw_value(const std::vector<uint8_t> &msg, const Signal &sig) {
+int64_t get_raw_value(const ByteSpan &msg, const Signal &sig) {
+  // fast path, a single load, shift and mask when all bytes of the signal are present
+  if (sig.num_bytes > 0 && sig.first_byte + sig.num_bytes <= msg.size()) {
+    uint64_t w = 0;
+    memcpy(&w, msg.begin() + sig.first_byte, sig.num_bytes);
+    if (!sig.is_little_endian) w = __builtin_bswap64(w);
+    return (w >> sig.shift) & sig.mask;
+  }
+
   int64_t ret = 0;
 
   int i = sig.msb / 8;
@@ -33,7 +42,7 @@ int64_t get_raw_value(const std::vector<uint8_t> &msg, const Signal &sig) {
 }
 
 
-bool MessageState::parse(uint64_t sec, const std::vector<uint8_t> &dat) {
+bool MessageState::parse(uint64_t sec, const ByteSpan &dat) {
   for (int i = 0; i < parse_sigs.size(); i++) {
     const auto &sig = parse_sigs[i];
 
@@ -65,14 +74,24 @@ bool MessageState::parse(uint64_t sec, const std::vector<uint8_t> &dat) {
 
     // TODO: these may get updated if the invalid or checksum gets checked later
     vals[i] = tmp * sig.factor + sig.offset;
-    all_vals[i].push_back(vals[i]);
+    double *h = &history[i * 2 * history_size + history_head];
+    h[0] = h[history_size] = vals[i];
   }
+  // only a frame that passed every check is added to the history
+  history_head = (history_head + 1) % history_size;
+  history_count = std::min(history_count + 1, history_size);
   last_seen_nanos = sec;
 
   return true;
 }
 
 
+void MessageState::init_history(size_t size) {
+  history_size = std::max<size_t>(size, 1);
+  history.assign(parse_sigs.size() * 2 * history_size, 0);
+  history_head = history_count = 0;
+}
+
 bool MessageState::update_counter_generic(int64_t v, int cnt_size) {
   uint8_t old_counter = counter;
   counter = v;
@@ -101,13 +120,14 @@ CANParser::CANParser(int abus, const std::string& dbc_name, const std::vector<st
 
   for (const auto& [address, frequency] : messages) {
     // disallow duplicate message checks
-    if (message_states.find(address) != message_states.end()) { 
+    auto duplicate = std::find_if(message_states.begin(), message_states.end(), [a = address](auto &s) { return s.address == a; });
+    if (duplicate != message_states.end()) {
       std::stringstream is;
       is << "Duplicate Message Check: " << address;
       throw std::runtime_error(is.str());
     }
 
-    MessageState &state = message_states[address];
+    MessageState &state = message_states.emplace_back();
     state.address = address;
     // state.check_frequency = op.check_frequency,
 
@@ -138,8 +158,9 @@ CANParser::CANParser(int abus, const std::string& dbc_name, const std::vector<st
     // track all signals for this message
     state.parse_sigs = msg->sigs;
     state.vals.resize(msg->sigs.size());
-    state.all_vals.resize(msg->sigs.size());
+    state.init_history(frequency > 0 ? std::max(CAN_HISTORY_MIN, frequency * CAN_HISTORY_SEC) : CAN_HISTORY_DEFAULT);
   }
+  build_lookup();
 }
 
 CANParser::CANParser(int abus, const std::string& dbc_name, bool ignore_checksum, bool ignore_counter)
@@ -162,26 +183,120 @@ CANParser::CANParser(int abus, const std::string& dbc_name, bool ignore_checksum
     for (const auto& sig : msg.sigs) {
       state.parse_sigs.push_back(sig);
       state.vals.push_back(0);
-      state.all_vals.push_back({});
     }
+    state.init_history(CAN_HISTORY_DEFAULT);
+
+    message_states.push_back(state);
+  }
+  build_lookup();
+}
+
+void CANParser::build_lookup() {
+  std::sort(message_states.begin(), message_states.end(), [](auto &a, auto &b) { return a.address < b.address; });
+  assert(message_states.size() < NO_STATE);
+
+  num_signals = 0;
+  for (auto &state : message_states) {
+    state.signal_offset = num_signals;
+    num_signals += state.parse_sigs.size();
+  }
+
+  std_address_index.clear();
+  if (message_states.empty()) {
+    min_address = 1;
+    max_address = 0;
+    return;
+  }
+  min_address = message_states.front().address;
+  max_address = message_states.back().address;
 
-    message_states[state.address] = state;
+  std_address_index.assign(std::min(max_address, (uint32_t)MAX_STD_ADDRESS) + 1, NO_STATE);
+  for (size_t i = 0; i < message_states.size() && message_states[i].address <= MAX_STD_ADDRESS; i++) {
+    std_address_index[message_states[i].address] = i;
   }
+
+  timeout_groups.clear();
+  for (auto &state : message_states) {
+    if (state.check_threshold == 0) continue;
+    auto g = std::find_if(timeout_groups.begin(), timeout_groups.end(), [&](auto &g) { return g.check_threshold == state.check_threshold; });
+    if (g == timeout_groups.end()) g = timeout_groups.insert(g, {.check_threshold = state.check_threshold});
+    state.timeout_group = g - timeout_groups.begin();
+  }
+  build_timeouts();
+}
+
+void CANParser::build_timeouts() {
+  std::vector<uint16_t> order;
+  for (size_t i = 0; i < message_states.size(); i++) {
+    if (message_states[i].timeout_group != NO_STATE) order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint16_t a, uint16_t b) {
+    return message_states[a].last_seen_nanos < message_states[b].last_seen_nanos;
+  });
+
+  for (auto &g : timeout_groups) g.head = g.tail = NO_STATE;
+  for (uint16_t idx : order) timeout_append(idx);
+  timeouts_unordered = false;
+}
+
+void CANParser::timeout_unlink(uint16_t idx) {
+  MessageState &state = message_states[idx];
+  TimeoutGroup &g = timeout_groups[state.timeout_group];
+  if (state.timeout_prev != NO_STATE) message_states[state.timeout_prev].timeout_next = state.timeout_next;
+  else g.head = state.timeout_next;
+  if (state.timeout_next != NO_STATE) message_states[state.timeout_next].timeout_prev = state.timeout_prev;
+  else g.tail = state.timeout_prev;
+  state.timeout_prev = state.timeout_next = NO_STATE;
+}
+
+void CANParser::timeout_append(uint16_t idx) {
+  MessageState &state = message_states[idx];
+  TimeoutGroup &g = timeout_groups[state.timeout_group];
+  if (g.tail != NO_STATE && message_states[g.tail].last_seen_nanos > state.last_seen_nanos) {
+    timeouts_unordered = true;
+  }
+  state.timeout_prev = g.tail;
+  state.timeout_next = NO_STATE;
+  if (g.tail != NO_STATE) message_states[g.tail].timeout_next = idx;
+  else g.head = idx;
+  g.tail = idx;
+}
+
+void CANParser::parse_state(MessageState &state, uint64_t sec, const ByteSpan &dat) {
+  const bool counter_failed = state.counter_fail >= MAX_BAD_COUNTER;
+  if (state.parse(sec, dat) && state.timeout_group != NO_STATE) {
+    const uint16_t idx = &state - message_states.data();
+    timeout_unlink(idx);
+    timeout_append(idx);
+  }
+  counters_failed += (int)(state.counter_fail >= MAX_BAD_COUNTER) - (int)counter_failed;
 }
 
 #ifndef DYNAMIC_CAPNP
-void CANParser::update_string(const std::string &data, bool sendcan) {
+// Word view of a serialized message. Only copies into buf when data isn't word aligned,
+// strings coming from msgq or python usually are.
+static kj::ArrayPtr<const capnp::word> aligned_words(const std::string &data, kj::Array<capnp::word> &buf) {
+  if (!data.empty() && data.length() % sizeof(capnp::word) == 0 &&
+      reinterpret_cast<uintptr_t>(data.data()) % alignof(capnp::word) == 0) {
+    return kj::ArrayPtr<const capnp::word>((const capnp::word *)data.data(), data.length() / sizeof(capnp::word));
+  }
+
   // format for board, make copy due to alignment issues.
   const size_t buf_size = (data.length() / sizeof(capnp::word)) + 1;
-  if (aligned_buf.size() < buf_size) {
-    aligned_buf = kj::heapArray<capnp::word>(buf_size);
+  if (buf.size() < buf_size) {
+    buf = kj::heapArray<capnp::word>(buf_size);
   }
-  memcpy(aligned_buf.begin(), data.data(), data.length());
+  memcpy(buf.begin(), data.data(), data.length());
+  return buf.slice(0, buf_size);
+}
 
+void CANParser::update_string(const std::string &data, bool sendcan) {
   // extract the messages
-  capnp::FlatArrayMessageReader cmsg(aligned_buf.slice(0, buf_size));
-  cereal::Event::Reader event = cmsg.getRoot<cereal::Event>();
+  capnp::FlatArrayMessageReader cmsg(aligned_words(data, aligned_buf));
+  update_event(cmsg.getRoot<cereal::Event>(), sendcan);
+}
 
+void CANParser::update_event(const cereal::Event::Reader &event, bool sendcan) {
   if (first_sec == 0) {
     first_sec = event.getLogMonoTime();
   }
@@ -204,49 +319,112 @@ void CANParser::update_strings(const std::vector<std::string> &data, std::vector
   query_latest(vals, current_sec);
 }
 
+void CANParser::update_strings(const std::vector<std::string> &data, double *values, uint64_t *updated, bool sendcan) {
+  uint64_t current_sec = 0;
+  for (const auto &d : data) {
+    update_string(d, sendcan);
+    if (current_sec == 0) {
+      current_sec = last_sec;
+    }
+  }
+  query_latest(values, updated, current_sec);
+}
+
 void CANParser::UpdateCans(uint64_t sec, const capnp::List<cereal::CanData>::Reader& cans) {
   //DEBUG("got %d messages\n", cans.size());
 
-  bool bus_empty = true;
-
-  // parse the messages
-  for (const auto cmsg : cans) {
-    if (cmsg.getSrc() != bus) {
-      // DEBUG("skip %d: wrong bus\n", cmsg.getAddress());
-      continue;
-    }
-    bus_empty = false;
+  // parse the messages of this bus, decoded once into plain frames
+  cereal_lite::decode(cans, frames, bus);
+  for (const CanFrame &frame : frames) {
+    UpdateFrame(sec, frame);
+  }
 
-    auto state_it = message_states.find(cmsg.getAddress());
-    if (state_it == message_states.end()) {
-      // DEBUG("skip %d: not specified\n", cmsg.getAddress());
-      continue;
-    }
+  UpdateBusTimeout(sec, frames.empty());
+}
 
-    auto dat = cmsg.getDat();
+void CANParser::UpdateFrame(uint64_t sec, const CanFrame &frame) {
+  MessageState *state = find_state(frame.address);
+  if (state == nullptr) {
+    // DEBUG("skip %d: not specified\n", frame.address);
+    return;
+  }
 
-    if (dat.size() > 64) {
-      DEBUG("got message longer than 64 bytes: 0x%X %zu\n", cmsg.getAddress(), dat.size());
-      continue;
-    }
+  if (frame.size > 64) {
+    DEBUG("got message longer than 64 bytes: 0x%X %u\n", frame.address, frame.size);
+    return;
+  }
 
-    // TODO: this actually triggers for some cars. fix and enable this
-    //if (dat.size() != state_it->second.size) {
-    //  DEBUG("got message with unexpected length: expected %d, got %zu for %d", state_it->second.size, dat.size(), cmsg.getAddress());
-    //  continue;
-    //}
+  // TODO: this actually triggers for some cars. fix and enable this
+  //if (frame.size != state->size) {
+  //  DEBUG("got message with unexpected length: expected %d, got %u for %d", state->size, frame.size, frame.address);
+  //  return;
+  //}
 
-    std::vector<uint8_t> data(dat.size(), 0);
-    memcpy(data.data(), dat.begin(), dat.size());
-    state_it->second.parse(sec, data);
-  }
+  parse_state(*state, sec, ByteSpan(frame.dat, frame.size));
+}
 
-  // update bus timeout
+void CANParser::UpdateBusTimeout(uint64_t sec, bool bus_empty) {
   if (!bus_empty) {
     last_nonempty_sec = sec;
   }
   bus_timeout = (sec - last_nonempty_sec) > bus_timeout_threshold;
 }
+
+CANParserGroup::CANParserGroup(const std::vector<CANParser *> &group_parsers)
+  : parsers(group_parsers), aligned_buf(kj::heapArray<capnp::word>(1024)) {
+  for (auto p : parsers) {
+    assert(p->bus >= 0 && p->bus < bus_parsers.size());
+    bus_parsers[p->bus].push_back(p);
+  }
+}
+
+void CANParserGroup::update_string(const std::string &data, bool sendcan) {
+  capnp::FlatArrayMessageReader cmsg(aligned_words(data, aligned_buf));
+  update_event(cmsg.getRoot<cereal::Event>(), sendcan);
+}
+
+void CANParserGroup::update_event(const cereal::Event::Reader &event, bool sendcan) {
+  const uint64_t sec = event.getLogMonoTime();
+
+  bool bus_empty[256];
+  std::fill(std::begin(bus_empty), std::end(bus_empty), true);
+
+  // one pass over the frames for all buses
+  cereal_lite::decode(sendcan ? event.getSendcan() : event.getCan(), frames);
+  for (const CanFrame &frame : frames) {
+    const uint8_t src = frame.src;
+    if (src >= bus_parsers.size()) continue;
+
+    bus_empty[src] = false;
+    for (auto p : bus_parsers[src]) {
+      p->UpdateFrame(sec, frame);
+    }
+  }
+
+  for (auto p : parsers) {
+    if (p->first_sec == 0) {
+      p->first_sec = sec;
+    }
+    p->last_sec = sec;
+    p->UpdateBusTimeout(sec, bus_empty[p->bus]);
+    p->UpdateValid(sec);
+  }
+}
+
+void CANParserGroup::update_strings(const std::vector<std::string> &data, std::vector<std::vector<SignalValue>> &vals, bool sendcan) {
+  uint64_t current_sec = 0;
+  for (const auto &d : data) {
+    update_string(d, sendcan);
+    if (current_sec == 0 && !parsers.empty()) {
+      current_sec = parsers[0]->last_sec;
+    }
+  }
+
+  vals.resize(parsers.size());
+  for (int i = 0; i < parsers.size(); i++) {
+    parsers[i]->query_latest(vals[i], current_sec);
+  }
+}
 #endif
 
 void CANParser::UpdateCans(uint64_t sec, const capnp::DynamicStruct::Reader& cmsg) {
@@ -258,54 +436,50 @@ void CANParser::UpdateCans(uint64_t sec, const capnp::DynamicStruct::Reader& cms
     return;
   }
 
-  auto state_it = message_states.find(cmsg.get("address").as<uint32_t>());
-  if (state_it == message_states.end()) {
+  MessageState *state = find_state(cmsg.get("address").as<uint32_t>());
+  if (state == nullptr) {
     DEBUG("skip %d: not specified\n", cmsg.get("address").as<uint32_t>());
     return;
   }
 
   auto dat = cmsg.get("dat").as<capnp::Data>();
   if (dat.size() > 64) return; // shouldn't ever happen
-  std::vector<uint8_t> data(dat.size(), 0);
-  memcpy(data.data(), dat.begin(), dat.size());
-  state_it->second.parse(sec, data);
+  parse_state(*state, sec, ByteSpan(dat.begin(), dat.size()));
 }
 
 void CANParser::UpdateValid(uint64_t sec) {
   const bool show_missing = (last_sec - first_sec) > 8e9;
 
-  bool _valid = true;
-  bool _counters_valid = true;
-  for (const auto& kv : message_states) {
-    const auto& state = kv.second;
+  const bool log_missing = show_missing && !bus_timeout;
+  if (timeouts_unordered) build_timeouts();
 
-    if (state.counter_fail >= MAX_BAD_COUNTER) {
-      _counters_valid = false;
-    }
+  bool _valid = true;
+  for (const auto &g : timeout_groups) {
+    // oldest first, the first one that's in time means the rest of the group is too
+    for (uint16_t i = g.head; i != NO_STATE; i = message_states[i].timeout_next) {
+      const auto &state = message_states[i];
+      const bool missing = state.last_seen_nanos == 0;
+      const bool timed_out = (sec - state.last_seen_nanos) > state.check_threshold;
+      if (!missing && !timed_out) break;
 
-    const bool missing = state.last_seen_nanos == 0;
-    const bool timed_out = (sec - state.last_seen_nanos) > state.check_threshold;
-    if (state.check_threshold > 0 && (missing || timed_out)) {
-      if (show_missing && !bus_timeout) {
-        if (missing) {
-          LOGE("0x%X '%s' NOT SEEN", state.address, state.name.c_str());
-        } else if (timed_out) {
-          LOGE("0x%X '%s' TIMED OUT", state.address, state.name.c_str());
-        }
-      }
       _valid = false;
+      if (!log_missing) break;
+      if (missing) {
+        LOGE("0x%X '%s' NOT SEEN", state.address, state.name.c_str());
+      } else {
+        LOGE("0x%X '%s' TIMED OUT", state.address, state.name.c_str());
+      }
     }
   }
   can_invalid_cnt = _valid ? 0 : (can_invalid_cnt + 1);
-  can_valid = (can_invalid_cnt < CAN_INVALID_CNT) && _counters_valid;
+  can_valid = (can_invalid_cnt < CAN_INVALID_CNT) && counters_failed == 0;
 }
 
 void CANParser::query_latest(std::vector<SignalValue> &vals, uint64_t last_ts) {
   if (last_ts == 0) {
     last_ts = last_sec;
   }
-  for (auto& kv : message_states) {
-    auto& state = kv.second;
+  for (auto& state : message_states) {
     if (last_ts != 0 && state.last_seen_nanos < last_ts) {
       continue;
     }
@@ -317,8 +491,41 @@ void CANParser::query_latest(std::vector<SignalValue> &vals, uint64_t last_ts) {
       v.ts_nanos = state.last_seen_nanos;
       v.name = sig.name;
       v.value = state.vals[i];
-      v.all_values = state.all_vals[i];
-      state.all_vals[i].clear();
+      const double *h = state.history_values(i);
+      v.all_values.assign(h, h + state.history_count);
+    }
+    state.history_count = 0;
+  }
+}
+
+int CANParser::signal_index(uint32_t address, const std::string &name) {
+  MessageState *state = find_state(address);
+  if (state == nullptr) return -1;
+
+  for (int i = 0; i < state->parse_sigs.size(); i++) {
+    if (state->parse_sigs[i].name == name) {
+      return state->signal_offset + i;
+    }
+  }
+  return -1;
+}
+
+void CANParser::query_latest(double *values, uint64_t *updated, uint64_t last_ts) {
+  if (last_ts == 0) {
+    last_ts = last_sec;
+  }
+  std::fill_n(updated, (num_signals + 63) / 64, 0);
+  for (auto& state : message_states) {
+    if (last_ts != 0 && state.last_seen_nanos < last_ts) {
+      continue;
+    }
+
+    std::copy(state.vals.begin(), state.vals.end(), values + state.signal_offset);
+    for (size_t i = 0; i < state.parse_sigs.size(); i++) {
+      const size_t idx = state.signal_offset + i;
+      updated[idx / 64] |= 1ULL << (idx % 64);
     }
+    // no consumer for the per cycle values in this mode
+    state.history_count = 0;
   }
 }
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <capnp/serialize.h>
+
+#include "common/bench.h"
+#include "common/util.h"
+#include "opendbc/can/common.h"
+
+// CANParser on the can events of an uncompressed rlog, every message of the DBC parsed
+// and the latest values queried after each event, the way carstate does it. Writes the
+// common daemon bench report, see common/bench.h.
+// Usage: parser_bench [--json FILE] [--bus N] dbc_name rlog
+
+int main(int argc, char *argv[]) {
+  std::string json_path;
+  std::vector<std::string> args;
+  int bus = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "--bus") == 0 && i + 1 < argc) {
+      bus = std::atoi(argv[++i]);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() != 2) {
+    fprintf(stderr, "usage: %s [--json FILE] [--bus N] dbc_name rlog\n", argv[0]);
+    return 1;
+  }
+
+  std::string raw = util::read_file(args[1]);
+  auto words = kj::heapArray<capnp::word>(raw.size() / sizeof(capnp::word));
+  memcpy(words.begin(), raw.data(), words.size() * sizeof(capnp::word));
+
+  // the events as the parser gets them from a socket
+  std::vector<std::string> events;
+  uint64_t first_mono_time = 0, last_mono_time = 0;
+  kj::ArrayPtr<const capnp::word> remaining = words.asPtr();
+  try {
+    while (remaining.size() > 0) {
+      capnp::FlatArrayMessageReader reader(remaining);
+      cereal::Event::Reader event = reader.getRoot<cereal::Event>();
+      if (event.which() == cereal::Event::CAN) {
+        if (first_mono_time == 0) first_mono_time = event.getLogMonoTime();
+        last_mono_time = event.getLogMonoTime();
+        events.emplace_back((const char *)remaining.begin(), (reader.getEnd() - remaining.begin()) * sizeof(capnp::word));
+      }
+      remaining = kj::arrayPtr(reader.getEnd(), remaining.end());
+    }
+  } catch (const kj::Exception &e) {
+    fprintf(stderr, "stopped at a corrupt event: %s\n", e.getDescription().cStr());
+  }
+
+  CANParser parser(bus, args[0], true, true);
+  std::vector<SignalValue> vals;
+  BenchReport report("can_parser");
+  for (const auto &e : events) {
+    auto t = report.now();
+    parser.update_strings({e}, vals, false);
+    report.add("update_strings", t);
+  }
+
+  report.set("dbc", args[0]);
+  report.set("events", (double)events.size());
+  report.finish((last_mono_time - first_mono_time) * 1e-9);
+  report.write(json_path);
+  return 0;
+}
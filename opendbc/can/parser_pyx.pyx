@@ -6,9 +6,10 @@ from libcpp.pair cimport pair
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.unordered_set cimport unordered_set
-from libc.stdint cimport uint32_t
+from libc.stdint cimport uint32_t, uint64_t
 
 from .common cimport CANParser as cpp_CANParser
+from .common cimport CANParserGroup as cpp_CANParserGroup
 from .common cimport dbc_lookup, SignalValue, DBC
 
 import numbers
@@ -20,6 +21,9 @@ cdef class CANParser:
     cpp_CANParser *can
     const DBC *dbc
     vector[SignalValue] can_values
+    vector[double] columns
+    vector[uint64_t] updated_bits
+    dict msg_name_to_address
 
   cdef readonly:
     dict vl
@@ -63,18 +67,26 @@ cdef class CANParser:
       self.ts_nanos[address] = {}
       self.ts_nanos[name] = self.ts_nanos[address]
 
+    self.msg_name_to_address = msg_name_to_address
     self.can = new cpp_CANParser(bus, dbc_name, message_v)
+    self.columns.resize(self.can.signal_count())
+    self.updated_bits.resize((self.can.signal_count() + 63) // 64)
     self.update_strings([])
 
   def update_strings(self, strings, sendcan=False):
+    self.clear_all_values()
+
+    cdef vector[SignalValue] new_vals
+    self.can.update_strings(strings, new_vals, sendcan)
+    return self.update_values(new_vals)
+
+  cdef clear_all_values(self):
     for v in self.vl_all.values():
       for l in v.values():  # no-cython-lint
         l.clear()
 
-    cdef vector[SignalValue] new_vals
+  cdef update_values(self, vector[SignalValue] &new_vals):
     cdef unordered_set[uint32_t] updated_addrs
-
-    self.can.update_strings(strings, new_vals, sendcan)
     cdef vector[SignalValue].iterator it = new_vals.begin()
     cdef SignalValue* cv
     while it != new_vals.end():
@@ -89,6 +101,29 @@ cdef class CANParser:
 
     return updated_addrs
 
+  def signal_index(self, msg, sig):
+    """Stable index of a signal in values, for use with update_strings_columnar"""
+    address = msg if isinstance(msg, numbers.Number) else self.msg_name_to_address.get(msg)
+    idx = -1 if address is None else self.can.signal_index(address, sig.encode("utf8"))
+    if idx < 0:
+      raise KeyError(f"{msg!r} {sig!r} is not parsed by this CANParser")
+    return idx
+
+  def update_strings_columnar(self, strings, sendcan=False):
+    """Like update_strings, but only fills values and the updated flags, vl and friends are untouched"""
+    self.can.update_strings(strings, self.columns.data(), self.updated_bits.data(), sendcan)
+
+  @property
+  def values(self):
+    if self.columns.empty():
+      return memoryview(b"").cast("d")
+    return <double[:self.columns.size()]> self.columns.data()
+
+  cpdef int updated(self, int idx) except -1:
+    if idx < 0 or idx >= self.columns.size():
+      raise IndexError(f"signal index {idx} out of range")
+    return (self.updated_bits[idx // 64] >> (idx % 64)) & 1
+
   @property
   def can_valid(self):
     return self.can.can_valid
@@ -98,6 +133,33 @@ cdef class CANParser:
     return self.can.bus_timeout
 
 
+cdef class CANParserGroup:
+  """Updates several CANParsers (usually one per bus) with a single pass over each can packet"""
+  cdef:
+    cpp_CANParserGroup *group
+    list parsers
+
+  def __init__(self, parsers):
+    self.parsers = list(parsers)
+    cdef vector[cpp_CANParser*] cpp_parsers
+    cdef CANParser p
+    for p in self.parsers:
+      cpp_parsers.push_back(p.can)
+    self.group = new cpp_CANParserGroup(cpp_parsers)
+
+  def __dealloc__(self):
+    del self.group
+
+  def update_strings(self, strings, sendcan=False):
+    cdef CANParser p
+    for p in self.parsers:
+      p.clear_all_values()
+
+    cdef vector[vector[SignalValue]] new_vals
+    self.group.update_strings(strings, new_vals, sendcan)
+    return [(<CANParser>self.parsers[i]).update_values(new_vals[i]) for i in range(len(self.parsers))]
+
+
 cdef class CANDefine():
   cdef:
     const DBC *dbc
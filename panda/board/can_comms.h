@@ -4,11 +4,12 @@
   into multiple transfers or chunks.
 
   * comms_can_read outputs this buffer in chunks of a specified length.
-    chunks are always the given length, except the last one.
-  * comms_can_write reads in this buffer in chunks.
-  * both functions maintain an overflow buffer for a partial CANPacket_t that
-    spans multiple transfers/chunks.
-  * the overflow buffers are reset by a dedicated control transfer handler,
+    chunks are always the given length, except the last one. the rx rings
+    are kept in this format already, so a read is a copy out of the rings.
+  * comms_can_write reads in this buffer in chunks, and maintains an
+    overflow buffer for a partial CANPacket_t that spans multiple
+    transfers/chunks.
+  * partial packets are dropped by a dedicated control transfer handler,
     which is sent by the host on each start of a connection.
 */
 
@@ -18,39 +19,8 @@ typedef struct {
   uint8_t data[72];
 } asm_buffer;
 
-asm_buffer can_read_buffer = {.ptr = 0U, .tail_size = 0U};
-
 int comms_can_read(uint8_t *data, uint32_t max_len) {
-  uint32_t pos = 0U;
-
-  // Send tail of previous message if it is in buffer
-  if (can_read_buffer.ptr > 0U) {
-    uint32_t overflow_len = MIN(max_len - pos, can_read_buffer.ptr);
-    (void)memcpy(&data[pos], can_read_buffer.data, overflow_len);
-    pos += overflow_len;
-    (void)memcpy(can_read_buffer.data, &can_read_buffer.data[overflow_len], can_read_buffer.ptr - overflow_len);
-    can_read_buffer.ptr -= overflow_len;
-  }
-
-  if (can_read_buffer.ptr == 0U) {
-    // Fill rest of buffer with new data
-    CANPacket_t can_packet;
-    while ((pos < max_len) && can_pop(&can_rx_q, &can_packet)) {
-      uint32_t pckt_len = CANPACKET_HEAD_SIZE + dlc_to_len[can_packet.data_len_code];
-      if ((pos + pckt_len) <= max_len) {
-        (void)memcpy(&data[pos], &can_packet, pckt_len);
-        pos += pckt_len;
-      } else {
-        (void)memcpy(&data[pos], &can_packet, max_len - pos);
-        can_read_buffer.ptr += pckt_len - (max_len - pos);
-        // cppcheck-suppress objectIndex
-        (void)memcpy(can_read_buffer.data, &((uint8_t*)&can_packet)[(max_len - pos)], can_read_buffer.ptr);
-        pos = max_len;
-      }
-    }
-  }
-
-  return pos;
+  return (int)can_rx_read(data, max_len);
 }
 
 asm_buffer can_write_buffer = {.ptr = 0U, .tail_size = 0U};
@@ -107,8 +77,7 @@ void comms_can_write(uint8_t *data, uint32_t len) {
 void comms_can_reset(void) {
   can_write_buffer.ptr = 0U;
   can_write_buffer.tail_size = 0U;
-  can_read_buffer.ptr = 0U;
-  can_read_buffer.tail_size = 0U;
+  can_rx_skip_partial();
 }
 
 // TODO: make this more general!
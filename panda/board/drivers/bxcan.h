@@ -143,7 +143,7 @@ void process_can(uint8_t can_number) {
           WORD_TO_BYTE_ARRAY(&to_push.data[4], CANx->sTxMailBox[0].TDHR);
           can_set_checksum(&to_push);
 
-          rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
+          rx_buffer_overflow += can_rx_push(&to_push) ? 0U : 1U;
         }
 
         // clear interrupt
@@ -220,7 +220,7 @@ void can_rx(uint8_t can_number) {
     ignition_can_hook(&to_push);
 
     current_board->set_led(LED_BLUE, true);
-    rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
+    rx_buffer_overflow += can_rx_push(&to_push) ? 0U : 1U;
 
     // next
     CANx->RF0R |= CAN_RF0R_RFOM0;
@@ -239,6 +239,14 @@ void CAN3_TX_IRQ_Handler(void) { process_can(2); }
 void CAN3_RX0_IRQ_Handler(void) { can_rx(2); }
 void CAN3_SCE_IRQ_Handler(void) { can_sce(2); }
 
+void can_apply_hw_filters(uint8_t can_number) {
+  uint16_t addrs[CAN_HW_FILTER_MAX];
+  uint8_t len;
+  if (can_hw_filter_build(can_number, addrs, &len)) {
+    llcan_set_filters(CANIF_FROM_CAN_NUM(can_number), addrs, len);
+  }
+}
+
 bool can_init(uint8_t can_number) {
   bool ret = false;
 
@@ -256,6 +264,15 @@ bool can_init(uint8_t can_number) {
     CAN_TypeDef *CANx = CANIF_FROM_CAN_NUM(can_number);
     ret &= can_set_speed(can_number);
     ret &= llcan_init(CANx);
+    can_apply_hw_filters(can_number);
+    // CAN1 init resets the first CAN2 filter bank too
+    if (CANx == CAN1) {
+      for (uint8_t i = 0U; i < PANDA_CAN_CNT; i++) {
+        if (CANIF_FROM_CAN_NUM(i) == CAN2) {
+          can_apply_hw_filters(i);
+        }
+      }
+    }
     // in case there are queued up messages
     process_can(can_number);
   }
@@ -5,6 +5,18 @@ typedef struct {
   CANPacket_t *elems;
 } can_ring;
 
+// rx queue to the host, kept in the host wire format (packed CANPacket_t
+// headers and payloads back to back) so reads are plain copies of the stream
+typedef struct {
+  volatile uint32_t w_ptr;
+  volatile uint32_t r_ptr;
+  uint32_t pkt_left;  // bytes of the packet at r_ptr that were not read yet
+  uint32_t size;
+  uint8_t *data;
+  uint32_t high_water;    // max bytes queued
+  uint32_t overflow_cnt;  // packets dropped because the ring was full
+} can_wire_ring;
+
 typedef struct {
   uint8_t bus_lookup;
   uint8_t can_num_lookup;
@@ -47,6 +59,20 @@ int can_silent = ALL_CAN_SILENT;
 bool can_init(uint8_t can_number);
 void process_can(uint8_t can_number);
 
+// Optional hardware acceptance filters, set per bus by the host. While enabled
+// only the listed standard ids, the ones the safety mode checks and all
+// extended frames reach the ISR. Frames that are filtered out can't be
+// forwarded, so buses that forward are never filtered.
+#define CAN_HW_FILTER_MAX 36U
+
+typedef struct {
+  bool enabled;
+  uint8_t len;
+  uint16_t addrs[CAN_HW_FILTER_MAX];
+} can_hw_filter_t;
+
+can_hw_filter_t can_hw_filters[PANDA_CAN_CNT];
+
 // ********************* instantiate queues *********************
 #define can_buffer(x, size) \
   CANPacket_t elems_##x[size]; \
@@ -56,13 +82,33 @@ void process_can(uint8_t can_number);
 #define CAN_TX_BUFFER_SIZE 416U
 #define GMLAN_TX_BUFFER_SIZE 416U
 
+// Each bus has its own rx ring, so a busy bus can't push out the frames of the
+// others when the host falls behind. Depths are in full size packets and add up
+// to CAN_RX_BUFFER_SIZE; short frames only take their actual length.
+#ifndef CAN_RX_BUS0_PKTS
+  #define CAN_RX_BUS0_PKTS 2048U
+#endif
+#ifndef CAN_RX_BUS1_PKTS
+  #define CAN_RX_BUS1_PKTS 1024U
+#endif
+#ifndef CAN_RX_BUS2_PKTS
+  #define CAN_RX_BUS2_PKTS 1024U
+#endif
+#define can_wire_buffer(x, pkts) \
+  uint8_t data_##x[(pkts) * sizeof(CANPacket_t)]; \
+  can_wire_ring can_##x = { .w_ptr = 0, .r_ptr = 0, .pkt_left = 0, .size = ((pkts) * sizeof(CANPacket_t)), .data = (uint8_t *)&(data_##x), .high_water = 0, .overflow_cnt = 0 };
+
 #ifdef STM32H7
 // ITCM RAM and DTCM RAM are the fastest for Cortex-M7 core access
-__attribute__((section(".axisram"))) can_buffer(rx_q, CAN_RX_BUFFER_SIZE)
+__attribute__((section(".axisram"))) can_wire_buffer(rx0_q, CAN_RX_BUS0_PKTS)
+__attribute__((section(".axisram"))) can_wire_buffer(rx1_q, CAN_RX_BUS1_PKTS)
+__attribute__((section(".axisram"))) can_wire_buffer(rx2_q, CAN_RX_BUS2_PKTS)
 __attribute__((section(".itcmram"))) can_buffer(tx1_q, CAN_TX_BUFFER_SIZE)
 __attribute__((section(".itcmram"))) can_buffer(tx2_q, CAN_TX_BUFFER_SIZE)
 #else
-can_buffer(rx_q, CAN_RX_BUFFER_SIZE)
+can_wire_buffer(rx0_q, CAN_RX_BUS0_PKTS)
+can_wire_buffer(rx1_q, CAN_RX_BUS1_PKTS)
+can_wire_buffer(rx2_q, CAN_RX_BUS2_PKTS)
 can_buffer(tx1_q, CAN_TX_BUFFER_SIZE)
 can_buffer(tx2_q, CAN_TX_BUFFER_SIZE)
 #endif
@@ -71,6 +117,9 @@ can_buffer(txgmlan_q, GMLAN_TX_BUFFER_SIZE)
 // FIXME:
 // cppcheck-suppress misra-c2012-9.3
 can_ring *can_queues[] = {&can_tx1_q, &can_tx2_q, &can_tx3_q, &can_txgmlan_q};
+// in the order they are drained to the host. packets from bus 3 (gmlan) share the bus 2 ring
+// cppcheck-suppress misra-c2012-9.3
+can_wire_ring *can_rx_queues[] = {&can_rx0_q, &can_rx1_q, &can_rx2_q};
 
 // helpers
 #define WORD_TO_BYTE_ARRAY(dst8, src32) 0[dst8] = ((src32) & 0xFFU); 1[dst8] = (((src32) >> 8U) & 0xFFU); 2[dst8] = (((src32) >> 16U) & 0xFFU); 3[dst8] = (((src32) >> 24U) & 0xFFU)
@@ -114,9 +163,7 @@ bool can_push(can_ring *q, CANPacket_t *elem) {
   if (!ret) {
     #ifdef DEBUG
       print("can_push to ");
-      if (q == &can_rx_q) {
-        print("can_rx_q");
-      } else if (q == &can_tx1_q) {
+      if (q == &can_tx1_q) {
         print("can_tx1_q");
       } else if (q == &can_tx2_q) {
         print("can_tx2_q");
@@ -133,6 +180,154 @@ bool can_push(can_ring *q, CANPacket_t *elem) {
   return ret;
 }
 
+static uint32_t can_wire_used(const can_wire_ring *q) {
+  return (q->w_ptr >= q->r_ptr) ? (q->w_ptr - q->r_ptr) : (q->size - q->r_ptr + q->w_ptr);
+}
+
+bool can_wire_push(can_wire_ring *q, const CANPacket_t *elem) {
+  bool ret = false;
+  uint32_t len = CANPACKET_HEAD_SIZE + dlc_to_len[elem->data_len_code];
+
+  ENTER_CRITICAL();
+  uint32_t used = can_wire_used(q);
+  if ((used + len) < q->size) {
+    uint32_t first = MIN(len, q->size - q->w_ptr);
+    (void)memcpy(&q->data[q->w_ptr], (const uint8_t *)elem, first);
+    (void)memcpy(q->data, &((const uint8_t *)elem)[first], len - first);
+    q->w_ptr = (q->w_ptr + len) % q->size;
+    q->high_water = MAX(q->high_water, used + len);
+    ret = true;
+  } else {
+    q->overflow_cnt += 1U;
+  }
+  EXIT_CRITICAL();
+  if (!ret) {
+    #ifdef DEBUG
+      print("can_wire_push to rx queue failed!\n");
+    #endif
+  }
+  return ret;
+}
+
+// copies up to max_len bytes of the stream, packets may span reads
+uint32_t can_wire_read(can_wire_ring *q, uint8_t *data, uint32_t max_len) {
+  // only the writers run concurrently, and they never touch unread data
+  ENTER_CRITICAL();
+  uint32_t w_ptr = q->w_ptr;
+  EXIT_CRITICAL();
+
+  uint32_t r_ptr = q->r_ptr;
+  uint32_t avail = (w_ptr >= r_ptr) ? (w_ptr - r_ptr) : (q->size - r_ptr + w_ptr);
+  uint32_t len = MIN(avail, max_len);
+  uint32_t first = MIN(len, q->size - r_ptr);
+  (void)memcpy(data, &q->data[r_ptr], first);
+  (void)memcpy(&data[first], q->data, len - first);
+
+  // keep track of where the next packet starts, for can_wire_skip_partial
+  uint32_t left = q->pkt_left;
+  while (left < len) {
+    left += CANPACKET_HEAD_SIZE + dlc_to_len[q->data[(r_ptr + left) % q->size] >> 4U];
+  }
+  q->pkt_left = left - len;
+
+  ENTER_CRITICAL();
+  q->r_ptr = (r_ptr + len) % q->size;
+  EXIT_CRITICAL();
+  return len;
+}
+
+// drops the rest of a partially read packet, so the next read starts on a packet
+void can_wire_skip_partial(can_wire_ring *q) {
+  ENTER_CRITICAL();
+  q->r_ptr = (q->r_ptr + q->pkt_left) % q->size;
+  q->pkt_left = 0U;
+  EXIT_CRITICAL();
+}
+
+void can_wire_clear(can_wire_ring *q) {
+  ENTER_CRITICAL();
+  q->w_ptr = 0;
+  q->r_ptr = 0;
+  q->pkt_left = 0;
+  EXIT_CRITICAL();
+}
+
+// Enabled by the host. Every rx packet is then preceded by a marker packet
+// with the reserved bit set, holding the microsecond timer at receive time
+// in 4 data bytes.
+bool can_rx_timestamps = false;
+
+bool can_rx_push(const CANPacket_t *elem) {
+  uint8_t bus = elem->bus;
+  can_wire_ring *q = can_rx_queues[MIN(bus, PANDA_CAN_CNT - 1U)];
+  bool ret;
+
+  if (can_rx_timestamps) {
+    CANPacket_t marker = {0};
+    marker.reserved = 1U;
+    marker.bus = bus;
+    marker.data_len_code = 4U;
+    uint32_t ts = microsecond_timer_get();
+    WORD_TO_BYTE_ARRAY(marker.data, ts);
+    marker.checksum = 0U;
+    for (uint32_t i = 0U; i < (CANPACKET_HEAD_SIZE + 4U); i++) {
+      marker.checksum ^= ((uint8_t *)&marker)[i];
+    }
+
+    // both or neither, so a frame never shows up without its timestamp
+    uint32_t len = (2U * CANPACKET_HEAD_SIZE) + 4U + dlc_to_len[elem->data_len_code];
+    ENTER_CRITICAL();
+    if ((can_wire_used(q) + len) < q->size) {
+      (void)can_wire_push(q, &marker);
+      ret = can_wire_push(q, elem);
+    } else {
+      q->overflow_cnt += 1U;
+      ret = false;
+    }
+    EXIT_CRITICAL();
+  } else {
+    ret = can_wire_push(q, elem);
+  }
+  return ret;
+}
+
+// Drains the rx rings in can_rx_queues order. A packet that was cut off by
+// the end of the previous read is finished first, so the stream stays intact.
+uint32_t can_rx_read(uint8_t *data, uint32_t max_len) {
+  uint32_t pos = 0U;
+  for (uint8_t i = 0U; i < PANDA_CAN_CNT; i++) {
+    if (can_rx_queues[i]->pkt_left > 0U) {
+      pos += can_wire_read(can_rx_queues[i], data, MIN(max_len, can_rx_queues[i]->pkt_left));
+    }
+  }
+  for (uint8_t i = 0U; (i < PANDA_CAN_CNT) && (pos < max_len); i++) {
+    pos += can_wire_read(can_rx_queues[i], &data[pos], max_len - pos);
+  }
+  return pos;
+}
+
+void can_rx_skip_partial(void) {
+  for (uint8_t i = 0U; i < PANDA_CAN_CNT; i++) {
+    can_wire_skip_partial(can_rx_queues[i]);
+  }
+}
+
+void can_rx_clear(void) {
+  for (uint8_t i = 0U; i < PANDA_CAN_CNT; i++) {
+    can_wire_clear(can_rx_queues[i]);
+  }
+}
+
+void can_rx_get_stats(uint8_t bus, can_rx_stats_t *stats) {
+  can_wire_ring *q = can_rx_queues[bus];
+  ENTER_CRITICAL();
+  stats->size = q->size;
+  stats->used = can_wire_used(q);
+  stats->high_water = q->high_water;
+  stats->overflow_cnt = q->overflow_cnt;
+  EXIT_CRITICAL();
+}
+
 uint32_t can_slots_empty(can_ring *q) {
   uint32_t ret = 0;
 
@@ -190,6 +385,70 @@ void can_init_all(void) {
   UNUSED(ret);
 }
 
+static bool can_hw_filter_append(uint16_t addrs[], uint8_t *len, uint16_t addr) {
+  bool ok = true;
+  bool found = false;
+  for (uint8_t i = 0U; i < *len; i++) {
+    found |= (addrs[i] == addr);
+  }
+  if (!found) {
+    if (*len < CAN_HW_FILTER_MAX) {
+      addrs[*len] = addr;
+      *len += 1U;
+    } else {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// Builds the standard id list for a bus. Returns false if the bus should
+// accept everything: filtering is off, the bus forwards, or the list doesn't fit.
+bool can_hw_filter_build(uint8_t can_number, uint16_t addrs[], uint8_t *len) {
+  uint8_t bus_number = BUS_NUM_FROM_CAN_NUM(can_number);
+  bool active = (bus_number < PANDA_CAN_CNT) && can_hw_filters[bus_number].enabled;
+  *len = 0U;
+
+  if (active) {
+    active = (bus_config[bus_number].forwarding_bus == -1);
+    // forwarding of the safety mode depends on the address, so check them all
+    for (int addr = 0; active && (addr < 0x800); addr++) {
+      active = (current_hooks->fwd(bus_number, addr) == -1);
+    }
+  }
+
+  if (active) {
+    for (uint8_t i = 0U; active && (i < can_hw_filters[bus_number].len); i++) {
+      active = can_hw_filter_append(addrs, len, can_hw_filters[bus_number].addrs[i]);
+    }
+    for (int i = 0; active && (i < current_rx_checks->len); i++) {
+      for (uint8_t j = 0U; active && (j < MAX_ADDR_CHECK_MSGS) && (current_rx_checks->check[i].msg[j].addr != 0); j++) {
+        const CanMsgCheck *m = &current_rx_checks->check[i].msg[j];
+        if ((m->bus == (int)bus_number) && (m->addr < 0x800)) {
+          active = can_hw_filter_append(addrs, len, (uint16_t)m->addr);
+        }
+      }
+    }
+  }
+  return active;
+}
+
+void can_hw_filter_add(uint8_t bus, uint16_t addr) {
+  if (can_hw_filters[bus].len < CAN_HW_FILTER_MAX) {
+    can_hw_filters[bus].addrs[can_hw_filters[bus].len] = addr;
+    can_hw_filters[bus].len += 1U;
+  }
+}
+
+// disabling also clears the list
+void can_hw_filter_enable(uint8_t bus, bool enabled) {
+  can_hw_filters[bus].enabled = enabled;
+  if (!enabled) {
+    can_hw_filters[bus].len = 0U;
+  }
+  (void)can_init(CAN_NUM_FROM_BUS_NUM(bus));
+}
+
 void can_flip_buses(uint8_t bus1, uint8_t bus2){
   bus_config[bus1].bus_lookup = bus2;
   bus_config[bus2].bus_lookup = bus1;
@@ -273,7 +532,7 @@ void can_send(CANPacket_t *to_push, uint8_t bus_number, bool skip_tx_hook) {
 
     // data changed
     can_set_checksum(to_push);
-    rx_buffer_overflow += can_push(&can_rx_q, to_push) ? 0U : 1U;
+    rx_buffer_overflow += can_rx_push(to_push) ? 0U : 1U;
   }
 }
 
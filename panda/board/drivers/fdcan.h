@@ -134,7 +134,7 @@ void process_can(uint8_t can_number) {
           (void)memcpy(to_push.data, to_send.data, dlc_to_len[to_push.data_len_code]);
           can_set_checksum(&to_push);
 
-          rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
+          rx_buffer_overflow += can_rx_push(&to_push) ? 0U : 1U;
         } else {
           can_health[can_number].total_tx_checksum_error_cnt += 1U;
         }
@@ -220,7 +220,7 @@ void can_rx(uint8_t can_number) {
     ignition_can_hook(&to_push);
 
     current_board->set_led(LED_BLUE, true);
-    rx_buffer_overflow += can_push(&can_rx_q, &to_push) ? 0U : 1U;
+    rx_buffer_overflow += can_rx_push(&to_push) ? 0U : 1U;
 
     // Enable CAN FD and BRS if CAN FD message was received
     if (!(bus_config[can_number].canfd_enabled) && (canfd_frame)) {
@@ -249,6 +249,14 @@ void FDCAN2_IT1_IRQ_Handler(void) { process_can(1); }
 void FDCAN3_IT0_IRQ_Handler(void) { can_rx(2);  }
 void FDCAN3_IT1_IRQ_Handler(void) { process_can(2); }
 
+void can_apply_hw_filters(uint8_t can_number) {
+  uint16_t addrs[CAN_HW_FILTER_MAX];
+  uint8_t len;
+  if (can_hw_filter_build(can_number, addrs, &len)) {
+    (void)llcan_set_filters(CANIF_FROM_CAN_NUM(can_number), addrs, len);
+  }
+}
+
 bool can_init(uint8_t can_number) {
   bool ret = false;
 
@@ -263,6 +271,7 @@ bool can_init(uint8_t can_number) {
     FDCAN_GlobalTypeDef *FDCANx = CANIF_FROM_CAN_NUM(can_number);
     ret &= can_set_speed(can_number);
     ret &= llcan_init(FDCANx);
+    can_apply_hw_filters(can_number);
     // in case there are queued up messages
     process_can(can_number);
   }
@@ -85,7 +85,8 @@ uint16_t spi_version_packet(uint8_t *out) {
   data_len += 1U;
 
   // SPI protocol version
-  out[data_pos + data_len] = 0x2;
+  // 0x3: endpoint 4, CAN write and read in one transaction
+  out[data_pos + data_len] = 0x3;
   data_len += 1U;
 
   // data length
@@ -182,6 +183,23 @@ void spi_rx_done(void) {
         } else {
           print("SPI: did expect data for can_write\n");
         }
+      } else if (spi_endpoint == 4U) {
+        // batched CAN: consume the MOSI data like endpoint 3, answer with RX data like endpoint 0x81.
+        // a NACK means nothing was written or read, so the host can retry the whole transaction
+        bool can_tx_ok = true;
+        if (spi_data_len_mosi > 0U) {
+          if (spi_can_tx_ready) {
+            spi_can_tx_ready = false;
+            comms_can_write(&spi_buf_rx[SPI_HEADER_SIZE], spi_data_len_mosi);
+          } else {
+            can_tx_ok = false;
+            print("SPI: CAN NACK\n");
+          }
+        }
+        if (can_tx_ok) {
+          response_len = comms_can_read(&(spi_buf_tx[3]), spi_data_len_miso);
+          response_ack = true;
+        }
       } else {
         print("SPI: unexpected endpoint"); puth(spi_endpoint); print("\n");
       }
@@ -79,7 +79,9 @@ void refresh_can_tx_slots_available(void);
 #define STS_SETUP_COMP                         4
 #define STS_SETUP_UPDT                         6
 
-uint8_t resp[USBPACKET_MAX_SIZE];
+// control responses larger than one packet go out through USB_WritePacket_EP0
+#define USB_CONTROL_RESP_SIZE 0x100U
+uint8_t resp[USB_CONTROL_RESP_SIZE];
 
 // for the repeating interfaces
 #define DSCR_INTERFACE_LEN 9
@@ -650,7 +652,9 @@ void usb_setup(void) {
 
       resp_len = comms_control_handler(&control_req, resp);
       // response pending if -1 was returned
-      if (resp_len != -1) {
+      if (resp_len > (int)USBPACKET_MAX_SIZE) {
+        USB_WritePacket_EP0(resp, MIN(resp_len, setup.b.wLength.w));
+      } else if (resp_len != -1) {
         USB_WritePacket(resp, MIN(resp_len, setup.b.wLength.w), 0);
         USBx_OUTEP(0)->DOEPCTL |= USB_OTG_DOEPCTL_CNAK;
       }
@@ -60,3 +60,14 @@ typedef struct __attribute__((packed)) {
   uint32_t irq2_call_rate;
   uint32_t can_core_reset_cnt;
 } can_health_t;
+
+#define CAN_RX_STATS_PACKET_VERSION 1
+typedef struct __attribute__((packed)) {
+  uint32_t size;          // rx ring size in bytes
+  uint32_t used;          // bytes currently queued for the host
+  uint32_t high_water;    // max bytes queued since boot
+  uint32_t overflow_cnt;  // packets dropped because the ring was full
+} can_rx_stats_t;
+
+// 0xca response, health_t followed by a can_health_t for each of the 3 CAN buses
+#define PANDA_TELEMETRY_SIZE (sizeof(struct health_t) + (3U * sizeof(can_health_t)))
@@ -205,7 +205,7 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
     case 0xf1:
       if (req->param1 == 0xFFFFU) {
         print("Clearing CAN Rx queue\n");
-        can_clear(&can_rx_q);
+        can_rx_clear();
       } else if (req->param1 < PANDA_BUS_CNT) {
         print("Clearing CAN Tx queue\n");
         can_clear(can_queues[req->param1]);
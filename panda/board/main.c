@@ -171,7 +171,9 @@ void tick_handler(void) {
       }
       #ifdef DEBUG
         print("** blink ");
-        print("rx:"); puth4(can_rx_q.r_ptr); print("-"); puth4(can_rx_q.w_ptr); print("  ");
+        print("rx0:"); puth4(can_rx0_q.r_ptr); print("-"); puth4(can_rx0_q.w_ptr); print("  ");
+        print("rx1:"); puth4(can_rx1_q.r_ptr); print("-"); puth4(can_rx1_q.w_ptr); print("  ");
+        print("rx2:"); puth4(can_rx2_q.r_ptr); print("-"); puth4(can_rx2_q.w_ptr); print("  ");
         print("tx1:"); puth4(can_tx1_q.r_ptr); print("-"); puth4(can_tx1_q.w_ptr); print("  ");
         print("tx2:"); puth4(can_tx2_q.r_ptr); print("-"); puth4(can_tx2_q.w_ptr); print("  ");
         print("tx3:"); puth4(can_tx3_q.r_ptr); print("-"); puth4(can_tx3_q.w_ptr); print("\n");
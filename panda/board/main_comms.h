@@ -67,6 +67,17 @@ void comms_endpoint2_write(uint8_t *data, uint32_t len) {
   }
 }
 
+int get_can_health_pkt(uint8_t can_number, uint8_t *dat) {
+  update_can_health_pkt(can_number, 0U);
+  can_health[can_number].can_speed = (bus_config[can_number].can_speed / 10U);
+  can_health[can_number].can_data_speed = (bus_config[can_number].can_data_speed / 10U);
+  can_health[can_number].canfd_enabled = bus_config[can_number].canfd_enabled;
+  can_health[can_number].brs_enabled = bus_config[can_number].brs_enabled;
+  can_health[can_number].canfd_non_iso = bus_config[can_number].canfd_non_iso;
+  (void)memcpy(dat, &can_health[can_number], sizeof(can_health_t));
+  return sizeof(can_health_t);
+}
+
 int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
   unsigned int resp_len = 0;
   uart_ring *ur = NULL;
@@ -167,16 +178,43 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
     case 0xc2:
       COMPILE_TIME_ASSERT(sizeof(can_health_t) <= USBPACKET_MAX_SIZE);
       if (req->param1 < 3U) {
-        update_can_health_pkt(req->param1, 0U);
-        can_health[req->param1].can_speed = (bus_config[req->param1].can_speed / 10U);
-        can_health[req->param1].can_data_speed = (bus_config[req->param1].can_data_speed / 10U);
-        can_health[req->param1].canfd_enabled = bus_config[req->param1].canfd_enabled;
-        can_health[req->param1].brs_enabled = bus_config[req->param1].brs_enabled;
-        can_health[req->param1].canfd_non_iso = bus_config[req->param1].canfd_non_iso;
-        resp_len = sizeof(can_health[req->param1]);
-        (void)memcpy(resp, &can_health[req->param1], resp_len);
+        resp_len = get_can_health_pkt(req->param1, resp);
+      }
+      break;
+    // **** 0xca: health and the CAN health of every bus in one read
+    case 0xca:
+      COMPILE_TIME_ASSERT(PANDA_TELEMETRY_SIZE <= USB_CONTROL_RESP_SIZE);
+      resp_len = get_health_pkt(resp);
+      for (uint8_t i = 0U; i < PANDA_CAN_CNT; i++) {
+        resp_len += get_can_health_pkt(i, &resp[resp_len]);
+      }
+      break;
+    // **** 0xc6: CAN rx queue stats
+    case 0xc6:
+      COMPILE_TIME_ASSERT(sizeof(can_rx_stats_t) <= USBPACKET_MAX_SIZE);
+      if (req->param1 < PANDA_CAN_CNT) {
+        can_rx_stats_t stats;
+        can_rx_get_stats(req->param1, &stats);
+        resp_len = sizeof(stats);
+        (void)memcpy(resp, &stats, resp_len);
+      }
+      break;
+    // **** 0xc7: add a standard id to the hardware filter list of a CAN bus
+    case 0xc7:
+      if ((req->param1 < PANDA_CAN_CNT) && (req->param2 < 0x800U)) {
+        can_hw_filter_add(req->param1, req->param2);
       }
       break;
+    // **** 0xc8: enable the hardware filter of a CAN bus, disabling clears its list
+    case 0xc8:
+      if (req->param1 < PANDA_CAN_CNT) {
+        can_hw_filter_enable(req->param1, req->param2 != 0U);
+      }
+      break;
+    // **** 0xc9: enable CAN rx timestamp markers
+    case 0xc9:
+      can_rx_timestamps = (req->param1 != 0U);
+      break;
     // **** 0xc3: fetch MCU UID
     case 0xc3:
       (void)memcpy(resp, ((uint8_t *)UID_BASE), 12);
@@ -395,7 +433,7 @@ int comms_control_handler(ControlPacket_t *req, uint8_t *resp) {
     case 0xf1:
       if (req->param1 == 0xFFFFU) {
         print("Clearing CAN Rx queue\n");
-        can_clear(&can_rx_q);
+        can_rx_clear();
       } else if (req->param1 < PANDA_BUS_CNT) {
         print("Clearing CAN Tx queue\n");
         can_clear(can_queues[req->param1]);
@@ -115,46 +115,149 @@ void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[]) {
   }
 }
 
+static uint32_t safety_lut_hash(int addr, int bus) {
+  uint32_t a = (uint32_t)addr;
+  return ((a ^ (a >> 7U) ^ ((uint32_t)bus << 5U)) & (SAFETY_LUT_SIZE - 1U));
+}
+
+static void safety_lut_init(safety_lut *lut, const void *list, int len) {
+  lut->list = list;
+  lut->len = len;
+  lut->valid = (len >= 0) && ((uint32_t)len <= SAFETY_LUT_MAX_ENTRIES);
+  for (uint32_t i = 0U; i < SAFETY_LUT_SIZE; i++) {
+    lut->entries[i].index = -1;
+  }
+}
+
+// entries are inserted in list order, and since equal keys share a probe
+// sequence, lookups see the entries of a key in list order too
+static void safety_lut_insert(safety_lut *lut, int addr, int bus, int index, int msg) {
+  uint32_t slot = safety_lut_hash(addr, bus);
+  while (lut->entries[slot].index != -1) {
+    slot = (slot + 1U) & (SAFETY_LUT_SIZE - 1U);
+  }
+  lut->entries[slot].addr = addr;
+  lut->entries[slot].bus = bus;
+  lut->entries[slot].index = index;
+  lut->entries[slot].msg = msg;
+}
+
+void safety_lut_build_rx(AddrCheckStruct addr_list[], const int len) {
+  int count = 0;
+  for (int i = 0; i < len; i++) {
+    for (uint8_t j = 0U; (j < MAX_ADDR_CHECK_MSGS) && (addr_list[i].msg[j].addr != 0); j++) {
+      count++;
+    }
+  }
+
+  safety_lut_init(&rx_lut, addr_list, count);
+  rx_lut.len = len;
+  if (rx_lut.valid) {
+    for (int i = 0; i < len; i++) {
+      for (uint8_t j = 0U; (j < MAX_ADDR_CHECK_MSGS) && (addr_list[i].msg[j].addr != 0); j++) {
+        safety_lut_insert(&rx_lut, addr_list[i].msg[j].addr, addr_list[i].msg[j].bus, i, j);
+      }
+    }
+  }
+}
+
+void safety_lut_build_tx(const CanMsg msg_list[], int len) {
+  safety_lut_init(&tx_lut, msg_list, len);
+  if (tx_lut.valid) {
+    for (int i = 0; i < len; i++) {
+      safety_lut_insert(&tx_lut, msg_list[i].addr, msg_list[i].bus, i, 0);
+    }
+  }
+}
+
 bool msg_allowed(CANPacket_t *to_send, const CanMsg msg_list[], int len) {
   int addr = GET_ADDR(to_send);
   int bus = GET_BUS(to_send);
   int length = GET_LEN(to_send);
 
+  // safety modes pick their tx list per param, so build the table on first use
+  if ((tx_lut.list != (const void *)msg_list) || (tx_lut.len != len)) {
+    safety_lut_build_tx(msg_list, len);
+  }
+
   bool allowed = false;
-  for (int i = 0; i < len; i++) {
-    if ((addr == msg_list[i].addr) && (bus == msg_list[i].bus) && (length == msg_list[i].len)) {
-      allowed = true;
-      break;
+  if (tx_lut.valid) {
+    uint32_t slot = safety_lut_hash(addr, bus);
+    while (tx_lut.entries[slot].index != -1) {
+      const safety_lut_entry *e = &tx_lut.entries[slot];
+      if ((e->addr == addr) && (e->bus == bus) && (length == msg_list[e->index].len)) {
+        allowed = true;
+        break;
+      }
+      slot = (slot + 1U) & (SAFETY_LUT_SIZE - 1U);
+    }
+  } else {
+    for (int i = 0; i < len; i++) {
+      if ((addr == msg_list[i].addr) && (bus == msg_list[i].bus) && (length == msg_list[i].len)) {
+        allowed = true;
+        break;
+      }
     }
   }
   return allowed;
 }
 
+// returns true if msg j of check i is the message on the bus, latching it as the
+// one to check if none of the alternatives has been seen yet
+static bool addr_check_matches(AddrCheckStruct addr_list[], int i, int j, int addr, int bus, int length) {
+  bool match = false;
+  const CanMsgCheck *m = &addr_list[i].msg[j];
+  if ((addr == m->addr) && (bus == m->bus) && (length == m->len)) {
+    if (!addr_list[i].msg_seen) {
+      addr_list[i].index = j;
+      addr_list[i].msg_seen = true;
+    }
+    match = (addr_list[i].index == j);
+  }
+  return match;
+}
+
 int get_addr_check_index(CANPacket_t *to_push, AddrCheckStruct addr_list[], const int len) {
   int bus = GET_BUS(to_push);
   int addr = GET_ADDR(to_push);
   int length = GET_LEN(to_push);
 
+  if ((rx_lut.list != (const void *)addr_list) || (rx_lut.len != len)) {
+    safety_lut_build_rx(addr_list, len);
+  }
+
   int index = -1;
-  for (int i = 0; i < len; i++) {
-    // if multiple msgs are allowed, determine which one is present on the bus
-    if (!addr_list[i].msg_seen) {
-      for (uint8_t j = 0U; (j < MAX_ADDR_CHECK_MSGS) && (addr_list[i].msg[j].addr != 0); j++) {
-        if ((addr == addr_list[i].msg[j].addr) && (bus == addr_list[i].msg[j].bus) &&
-              (length == addr_list[i].msg[j].len)) {
-          addr_list[i].index = j;
-          addr_list[i].msg_seen = true;
-          break;
-        }
+  if (rx_lut.valid) {
+    uint32_t slot = safety_lut_hash(addr, bus);
+    while (rx_lut.entries[slot].index != -1) {
+      const safety_lut_entry *e = &rx_lut.entries[slot];
+      if ((e->addr == addr) && (e->bus == bus) && addr_check_matches(addr_list, e->index, e->msg, addr, bus, length)) {
+        index = e->index;
+        break;
       }
+      slot = (slot + 1U) & (SAFETY_LUT_SIZE - 1U);
     }
+  } else {
+    for (int i = 0; i < len; i++) {
+      // if multiple msgs are allowed, determine which one is present on the bus
+      if (!addr_list[i].msg_seen) {
+        for (uint8_t j = 0U; (j < MAX_ADDR_CHECK_MSGS) && (addr_list[i].msg[j].addr != 0); j++) {
+          if ((addr == addr_list[i].msg[j].addr) && (bus == addr_list[i].msg[j].bus) &&
+                (length == addr_list[i].msg[j].len)) {
+            addr_list[i].index = j;
+            addr_list[i].msg_seen = true;
+            break;
+          }
+        }
+      }
 
-    if (addr_list[i].msg_seen) {
-      int idx = addr_list[i].index;
-      if ((addr == addr_list[i].msg[idx].addr) && (bus == addr_list[i].msg[idx].bus) &&
-          (length == addr_list[i].msg[idx].len)) {
-        index = i;
-        break;
+      if (addr_list[i].msg_seen) {
+        int idx = addr_list[i].index;
+        if ((addr == addr_list[i].msg[idx].addr) && (bus == addr_list[i].msg[idx].bus) &&
+            (length == addr_list[i].msg[idx].len)) {
+          index = i;
+          break;
+        }
       }
     }
   }
@@ -382,7 +485,10 @@ int set_safety_hooks(uint16_t mode, uint16_t param) {
       current_rx_checks->check[j].index = 0;
       current_rx_checks->check[j].msg_seen = false;
     }
+    safety_lut_build_rx(current_rx_checks->check, current_rx_checks->len);
   }
+  // tx list isn't known until the first tx hook call
+  safety_lut_init(&tx_lut, NULL, 0);
   return set_status;
 }
 
@@ -131,6 +131,25 @@ typedef struct {
   int len;
 } addr_checks;
 
+// open addressing hash table keyed by (bus, addr), used to find the rx check
+// or tx whitelist entry of a message without scanning the whole list
+#define SAFETY_LUT_SIZE 128U  // power of 2
+#define SAFETY_LUT_MAX_ENTRIES (SAFETY_LUT_SIZE / 2U)
+
+typedef struct {
+  int addr;
+  int bus;
+  int16_t index;  // index into the source list, -1 if the slot is empty
+  int16_t msg;    // for rx checks, which of AddrCheckStruct.msg this entry is
+} safety_lut_entry;
+
+typedef struct {
+  const void *list;  // source list the table was built from
+  int len;
+  bool valid;        // false if the list doesn't fit, lookups then scan the list
+  safety_lut_entry entries[SAFETY_LUT_SIZE];
+} safety_lut;
+
 int safety_rx_hook(CANPacket_t *to_push);
 int safety_tx_hook(CANPacket_t *to_send);
 int safety_tx_lin_hook(int lin_num, uint8_t *data, int len);
@@ -153,6 +172,8 @@ void gen_crc_lookup_table_8(uint8_t poly, uint8_t crc_lut[]);
 void gen_crc_lookup_table_16(uint16_t poly, uint16_t crc_lut[]);
 bool msg_allowed(CANPacket_t *to_send, const CanMsg msg_list[], int len);
 int get_addr_check_index(CANPacket_t *to_push, AddrCheckStruct addr_list[], const int len);
+void safety_lut_build_rx(AddrCheckStruct addr_list[], const int len);
+void safety_lut_build_tx(const CanMsg msg_list[], int len);
 void update_counter(AddrCheckStruct addr_list[], int index, uint8_t counter);
 void update_addr_timestamp(AddrCheckStruct addr_list[], int index);
 bool is_msg_valid(AddrCheckStruct addr_list[], int index);
@@ -211,6 +232,10 @@ int cruise_button_prev = 0;
 int main_button_prev = 0;
 bool safety_rx_checks_invalid = false;
 
+// lookup tables for the current rx checks and tx whitelist
+safety_lut rx_lut = {.list = NULL, .len = 0, .valid = false};
+safety_lut tx_lut = {.list = NULL, .len = 0, .valid = false};
+
 // for safety modes with torque steering control
 int desired_torque_last = 0;       // last desired steer torque
 int rt_torque_last = 0;            // last desired torque for real time check
@@ -136,6 +136,9 @@ bool llcan_init(CAN_TypeDef *CANx) {
   if(ret){
     // no mask
     // For some weird reason some of these registers do not want to set properly on CAN2 and CAN3. Probably something to do with the single/dual mode and their different filters.
+    // banks 0 and 14 back to mask mode, in case hardware filters were set before
+    CANx->FM1R &= ~(1U | (1U << 14));
+    CANx->FS1R &= ~(1U | (1U << 14));
     CANx->sFilterRegister[0].FR1 = 0U;
     CANx->sFilterRegister[0].FR2 = 0U;
     CANx->sFilterRegister[14].FR1 = 0U;
@@ -156,6 +159,42 @@ bool llcan_init(CAN_TypeDef *CANx) {
   return ret;
 }
 
+// Only lets the given standard ids and all extended frames through. CAN1 owns
+// filter banks 0-13 and CAN2 banks 14-27, both configured through CAN1; CAN3
+// has banks of its own.
+void llcan_set_filters(CAN_TypeDef *CANx, const uint16_t addrs[], uint8_t len) {
+  CAN_TypeDef *filter_can = (CANx == CAN2) ? CAN1 : CANx;
+  uint32_t first_bank = (CANx == CAN2) ? 14U : 0U;
+
+  register_set_bits(&(filter_can->FMR), CAN_FMR_FINIT);
+  filter_can->FA1R &= ~(0x3FFFU << first_bank);
+  filter_can->FFA1R &= ~(0x3FFFU << first_bank);  // everything to FIFO 0
+
+  // first bank: 32 bit mask mode, only the IDE bit has to match
+  filter_can->FM1R &= ~(1U << first_bank);
+  filter_can->FS1R |= (1U << first_bank);
+  filter_can->sFilterRegister[first_bank].FR1 = CAN_TI0R_IDE;
+  filter_can->sFilterRegister[first_bank].FR2 = CAN_TI0R_IDE;
+  filter_can->FA1R |= (1U << first_bank);
+
+  // the rest: 16 bit list mode, 4 standard ids per bank
+  for (uint8_t i = 0U; i < len; i += 4U) {
+    uint32_t bank = first_bank + 1U + (i / 4U);
+    uint32_t ids[4];
+    for (uint8_t j = 0U; j < 4U; j++) {
+      // unused slots repeat the last id
+      uint8_t k = MIN((uint8_t)(i + j), (uint8_t)(len - 1U));
+      ids[j] = ((uint32_t)addrs[k] & 0x7FFU) << 5U;
+    }
+    filter_can->FM1R |= (1U << bank);
+    filter_can->FS1R &= ~(1U << bank);
+    filter_can->sFilterRegister[bank].FR1 = ids[0] | (ids[1] << 16U);
+    filter_can->sFilterRegister[bank].FR2 = ids[2] | (ids[3] << 16U);
+    filter_can->FA1R |= (1U << bank);
+  }
+  register_clear_bits(&(filter_can->FMR), CAN_FMR_FINIT);
+}
+
 void llcan_clear_send(CAN_TypeDef *CANx) {
   CANx->TSR |= CAN_TSR_ABRQ0; // Abort message transmission on error interrupt
   CANx->MSR |= CAN_MSR_ERRI; // Clear error interrupt
@@ -17,10 +17,11 @@
 #define FDCAN_OFFSET_W 846UL // words for each FDCAN module, equally
 #define FDCAN_END_ADDRESS 0x4000D3FCUL // Message RAM has a width of 4 bytes
 
-// FDCAN_RX_FIFO_0_EL_CNT + FDCAN_TX_FIFO_EL_CNT can't exceed 47 elements (47 * 72 bytes = 3,384 bytes) per FDCAN module
+// FDCAN_RX_FIFO_0_EL_CNT + FDCAN_TX_FIFO_EL_CNT can't exceed 47 elements (47 * 72 bytes = 3,384 bytes) per FDCAN module,
+// one element worth of words is used for the standard id filter list
 
 // RX FIFO 0
-#define FDCAN_RX_FIFO_0_EL_CNT 46UL
+#define FDCAN_RX_FIFO_0_EL_CNT 45UL
 #define FDCAN_RX_FIFO_0_HEAD_SIZE 8UL // bytes
 #define FDCAN_RX_FIFO_0_DATA_SIZE 64UL // bytes
 #define FDCAN_RX_FIFO_0_EL_SIZE (FDCAN_RX_FIFO_0_HEAD_SIZE + FDCAN_RX_FIFO_0_DATA_SIZE)
@@ -35,6 +36,10 @@
 #define FDCAN_TX_FIFO_EL_W_SIZE (FDCAN_TX_FIFO_EL_SIZE / 4UL)
 #define FDCAN_TX_FIFO_OFFSET (FDCAN_RX_FIFO_0_OFFSET + (FDCAN_RX_FIFO_0_EL_CNT * FDCAN_RX_FIFO_0_EL_W_SIZE))
 
+// Standard id filters, one word each holding two ids (dual id filter)
+#define FDCAN_SID_FILTER_W_CNT 18UL
+#define FDCAN_SID_FILTER_OFFSET (FDCAN_TX_FIFO_OFFSET + (FDCAN_TX_FIFO_EL_CNT * FDCAN_TX_FIFO_EL_W_SIZE))
+
 #define CAN_NAME_FROM_CANIF(CAN_DEV) (((CAN_DEV)==FDCAN1) ? "FDCAN1" : (((CAN_DEV) == FDCAN2) ? "FDCAN2" : "FDCAN3"))
 #define CAN_NUM_FROM_CANIF(CAN_DEV) (((CAN_DEV)==FDCAN1) ? 0UL : (((CAN_DEV) == FDCAN2) ? 1UL : 2UL))
 
@@ -230,7 +235,7 @@ bool llcan_init(FDCAN_GlobalTypeDef *FDCANx) {
     FDCANx->TXBC |= FDCAN_TX_FIFO_EL_CNT << FDCAN_TXBC_TFQS_Pos;
 
     // Flush allocated RAM
-    uint32_t EndAddress = TxFIFOSA + (FDCAN_TX_FIFO_EL_CNT * FDCAN_TX_FIFO_EL_SIZE);
+    uint32_t EndAddress = TxFIFOSA + (FDCAN_TX_FIFO_EL_CNT * FDCAN_TX_FIFO_EL_SIZE) + (FDCAN_SID_FILTER_W_CNT * 4UL);
     for (uint32_t RAMcounter = RxFIFO0SA; RAMcounter < EndAddress; RAMcounter += 4U) {
         *(uint32_t *)(RAMcounter) = 0x00000000;
     }
@@ -267,3 +272,32 @@ void llcan_clear_send(FDCAN_GlobalTypeDef *FDCANx) {
   bool ret = llcan_init(FDCANx);
   UNUSED(ret);
 }
+
+// Only lets the given standard ids and all extended frames through
+bool llcan_set_filters(FDCAN_GlobalTypeDef *FDCANx, const uint16_t addrs[], uint8_t len) {
+  uint32_t can_number = CAN_NUM_FROM_CANIF(FDCANx);
+  bool ret = fdcan_request_init(FDCANx);
+
+  if (ret) {
+    FDCANx->CCCR |= FDCAN_CCCR_CCE;
+
+    uint32_t count = MIN(((uint32_t)len + 1U) / 2U, FDCAN_SID_FILTER_W_CNT);
+    volatile uint32_t *filters = (uint32_t *)(FDCAN_START_ADDRESS + (can_number * FDCAN_OFFSET) + (FDCAN_SID_FILTER_OFFSET * 4UL));
+    for (uint32_t i = 0U; i < count; i++) {
+      uint32_t id1 = addrs[2U * i] & 0x7FFU;
+      uint32_t id2 = addrs[MIN((2U * i) + 1U, (uint32_t)len - 1U)] & 0x7FFU;
+      // SFT = dual id, SFEC = store in RX FIFO 0
+      filters[i] = (0x1UL << 30U) | (0x1UL << 27U) | (id1 << 16U) | id2;
+    }
+
+    FDCANx->SIDFC = ((FDCAN_SID_FILTER_OFFSET + (can_number * FDCAN_OFFSET_W)) << FDCAN_SIDFC_FLSSA_Pos) | (count << FDCAN_SIDFC_LSS_Pos);
+    // reject standard frames that match no filter
+    FDCANx->GFC = (FDCANx->GFC & ~(FDCAN_GFC_ANFS)) | (0x2U << FDCAN_GFC_ANFS_Pos);
+
+    ret = fdcan_exit_init(FDCANx);
+  }
+  if (!ret) {
+    print(CAN_NAME_FROM_CANIF(FDCANx)); print(" llcan_set_filters timed out!\n");
+  }
+  return ret;
+}
@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+# Writes the can and sendcan of an rlog in the format safety_bench reads.
+# Usage: dump_can.py <rlog[.bz2]> <out>
+import bz2
+import struct
+import sys
+
+from cereal import log
+
+DUMP_MAGIC = 0x31425350  # "PSB1"
+
+
+def main(rlog: str, out: str) -> None:
+  with open(rlog, 'rb') as f:
+    dat = f.read()
+  if rlog.endswith('.bz2'):
+    dat = bz2.decompress(dat)
+
+  frames = 0
+  with open(out, 'wb') as f:
+    f.write(struct.pack('<I', DUMP_MAGIC))
+    for event in log.Event.read_multiple_bytes(dat):
+      which = event.which()
+      if which not in ('can', 'sendcan'):
+        continue
+      tx = which == 'sendcan'
+      for c in getattr(event, which):
+        # received frames only, not the echoes of what was sent (128+) or rejects (192+)
+        if not tx and c.src >= 128:
+          continue
+        f.write(struct.pack('<QIBBBx', event.logMonoTime, c.address, c.src, tx, len(c.dat)))
+        f.write(c.dat)
+        frames += 1
+  print(f'{frames} frames written to {out}')
+
+
+if __name__ == '__main__':
+  if len(sys.argv) != 3:
+    print(f'usage: {sys.argv[0]} <rlog[.bz2]> <out>')
+    sys.exit(1)
+  main(sys.argv[1], sys.argv[2])
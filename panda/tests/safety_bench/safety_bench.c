@@ -0,0 +1,222 @@
+// Host benchmark of the safety hooks. Replays the can and sendcan of a route through
+// safety_rx_hook and safety_tx_hook for every safety mode, or the ones given, and reports
+// the time per frame: the mean, p99 and worst, which is what has to fit in the CAN ISR.
+// The panda's microsecond timer follows the log, and safety_tick runs once a second of it
+// like in the main loop. Get the dump with dump_can.py.
+//
+// Build: gcc -std=gnu11 -O2 -I panda/board panda/tests/safety_bench/safety_bench.c -o safety_bench
+// Usage: safety_bench <dump> [mode[:param] ...]
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_stm.h"
+#include "config.h"
+#include "can_definitions.h"
+#include "faults.h"
+#include "safety.h"
+
+#define DUMP_MAGIC 0x31425350U  // "PSB1"
+
+typedef struct {
+  uint64_t nanos;
+  bool tx;
+  CANPacket_t pkt;
+} Frame;
+
+typedef struct {
+  const char *name;
+  uint16_t mode;
+} ModeName;
+
+static const ModeName mode_names[] = {
+  {"silent", SAFETY_SILENT}, {"honda_nidec", SAFETY_HONDA_NIDEC}, {"toyota", SAFETY_TOYOTA},
+  {"elm327", SAFETY_ELM327}, {"gm", SAFETY_GM}, {"honda_bosch", SAFETY_HONDA_BOSCH},
+  {"hyundai", SAFETY_HYUNDAI}, {"chrysler", SAFETY_CHRYSLER}, {"subaru", SAFETY_SUBARU},
+  {"volkswagen_mqb", SAFETY_VOLKSWAGEN_MQB}, {"nissan", SAFETY_NISSAN}, {"nooutput", SAFETY_NOOUTPUT},
+  {"hyundai_legacy", SAFETY_HYUNDAI_LEGACY}, {"mazda", SAFETY_MAZDA}, {"body", SAFETY_BODY},
+  {"ford", SAFETY_FORD}, {"hyundai_canfd", SAFETY_HYUNDAI_CANFD}, {"tesla", SAFETY_TESLA},
+  {"subaru_preglobal", SAFETY_SUBARU_PREGLOBAL}, {"volkswagen_pq", SAFETY_VOLKSWAGEN_PQ},
+  {"alloutput", SAFETY_ALLOUTPUT},
+};
+#define MODE_NAMES_CNT (sizeof(mode_names) / sizeof(mode_names[0]))
+
+static const char *mode_name(uint16_t mode) {
+  for (unsigned int i = 0U; i < MODE_NAMES_CNT; i++) {
+    if (mode_names[i].mode == mode) return mode_names[i].name;
+  }
+  return "?";
+}
+
+static uint64_t now_ns(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+  return (t.tv_sec * 1000000000ULL) + t.tv_nsec;
+}
+
+static int exact_dlc(uint8_t len) {
+  for (int i = 0; i < 16; i++) {
+    if (dlc_to_len[i] == len) return i;
+  }
+  return -1;
+}
+
+// records of: u64 nanos, u32 addr, u8 bus, u8 tx, u8 len, u8 reserved, data[len]
+static Frame *load_dump(const char *path, size_t *count) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return NULL;
+
+  uint32_t magic = 0U;
+  size_t cap = 1U << 16, n = 0U;
+  Frame *frames = malloc(cap * sizeof(Frame));
+  if ((fread(&magic, sizeof(magic), 1, f) != 1U) || (magic != DUMP_MAGIC)) {
+    fprintf(stderr, "%s isn't a dump_can.py dump\n", path);
+    n = 0U;
+    goto done;
+  }
+
+  while (true) {
+    uint8_t rec[16];
+    if (fread(rec, sizeof(rec), 1, f) != 1U) break;
+    uint64_t nanos;
+    uint32_t addr;
+    memcpy(&nanos, &rec[0], sizeof(nanos));
+    memcpy(&addr, &rec[8], sizeof(addr));
+    const uint8_t bus = rec[12], tx = rec[13], len = rec[14];
+    const int dlc = exact_dlc(len);
+
+    uint8_t data[64];
+    if ((len > sizeof(data)) || (fread(data, 1, len, f) != len)) break;
+    if ((dlc < 0) || (len > CANPACKET_DATA_SIZE_MAX) || (bus >= PANDA_BUS_CNT)) continue;
+
+    if (n == cap) {
+      cap *= 2U;
+      frames = realloc(frames, cap * sizeof(Frame));
+    }
+    Frame *fr = &frames[n++];
+    memset(fr, 0, sizeof(Frame));
+    fr->nanos = nanos;
+    fr->tx = tx != 0U;
+    fr->pkt.addr = addr;
+    fr->pkt.extended = (addr >= 0x800U) ? 1U : 0U;
+    fr->pkt.bus = bus;
+    fr->pkt.data_len_code = dlc;
+    memcpy(fr->pkt.data, data, len);
+  }
+
+done:
+  fclose(f);
+  *count = n;
+  return frames;
+}
+
+static int cmp_u32(const void *a, const void *b) {
+  const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+typedef struct {
+  uint32_t *ns;
+  size_t n;
+  uint64_t sum;
+} Timings;
+
+static void report(const char *what, Timings *t) {
+  if (t->n == 0U) {
+    printf("  %s -", what);
+    return;
+  }
+  qsort(t->ns, t->n, sizeof(uint32_t), cmp_u32);
+  printf("  %s %6.0f %6u %7u", what, (double)t->sum / t->n, t->ns[(t->n * 99U) / 100U], t->ns[t->n - 1U]);
+}
+
+// one pass over the dump, per frame times go to rx and tx
+static void replay(const Frame *frames, size_t count, Timings *rx, Timings *tx, int *tx_allowed) {
+  rx->n = tx->n = 0U;
+  rx->sum = tx->sum = 0U;
+  *tx_allowed = 0;
+  uint64_t next_tick = frames[0].nanos + 1000000000ULL;
+  for (size_t i = 0U; i < count; i++) {
+    const Frame *f = &frames[i];
+    timer.CNT = (uint32_t)(f->nanos / 1000U);
+    if (f->nanos >= next_tick) {
+      safety_tick(current_rx_checks);
+      next_tick += 1000000000ULL;
+    }
+
+    CANPacket_t pkt = f->pkt;
+    const uint64_t start = now_ns();
+    if (f->tx) {
+      *tx_allowed += safety_tx_hook(&pkt) > 0;
+    } else {
+      safety_rx_hook(&pkt);
+    }
+    const uint32_t ns = (uint32_t)(now_ns() - start);
+    Timings *t = f->tx ? tx : rx;
+    t->ns[t->n++] = ns;
+    t->sum += ns;
+  }
+}
+
+static void bench(const Frame *frames, size_t count, uint16_t mode, uint16_t param, Timings *rx, Timings *tx) {
+  int tx_allowed = 0;
+  // the first pass warms the caches, the second one is reported
+  for (int pass = 0; pass < 2; pass++) {
+    if (set_safety_hooks(mode, param) != 0) {
+      printf("%-17s can't be set\n", mode_name(mode));
+      return;
+    }
+    replay(frames, count, rx, tx, &tx_allowed);
+  }
+  printf("%-17s", mode_name(mode));
+  report("rx", rx);
+  report("tx", tx);
+  printf("  %d/%zu tx allowed\n", tx_allowed, tx->n);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <dump> [mode[:param] ...]\n", argv[0]);
+    return 1;
+  }
+
+  size_t count = 0U;
+  Frame *frames = load_dump(argv[1], &count);
+  if ((frames == NULL) || (count == 0U)) {
+    fprintf(stderr, "no frames in %s\n", argv[1]);
+    return 1;
+  }
+
+  Timings rx = {.ns = malloc(count * sizeof(uint32_t))};
+  Timings tx = {.ns = malloc(count * sizeof(uint32_t))};
+  // the overhead of the clock reads is in every number below
+  const uint64_t start = now_ns();
+  for (int i = 0; i < 1000; i++) (void)now_ns();
+  printf("%zu frames, clock read %.0f ns\n", count, (double)(now_ns() - start) / 1000.0);
+  printf("%-17s  ns/frame: mean    p99     max\n", "");
+
+  if (argc == 2) {
+    for (unsigned int i = 0U; i < sizeof(safety_hook_registry) / sizeof(safety_hook_config); i++) {
+      bench(frames, count, safety_hook_registry[i].id, 0U, &rx, &tx);
+    }
+  }
+  for (int i = 2; i < argc; i++) {
+    char name[32] = {0};
+    unsigned int param = 0U;
+    sscanf(argv[i], "%31[^:]:%u", name, &param);
+    bool found = false;
+    for (unsigned int j = 0U; j < MODE_NAMES_CNT; j++) {
+      if (strcmp(mode_names[j].name, name) == 0) {
+        bench(frames, count, mode_names[j].mode, param, &rx, &tx);
+        found = true;
+      }
+    }
+    if (!found) fprintf(stderr, "unknown safety mode %s\n", name);
+  }
+
+  free(rx.ns);
+  free(tx.ns);
+  free(frames);
+  return 0;
+}
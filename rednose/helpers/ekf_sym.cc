@@ -40,6 +40,11 @@ EKFSym::EKFSym(std::string name, Map<MatrixXdr> Q, Map<VectorXd> x_initial, Map<
   this->Q = Q;
 
   this->max_rewind_age = max_rewind_age;
+  // checkpoints are sized now, the observation storage grows to the largest kind and stays
+  RewindEntry entry;
+  entry.x = VectorXd::Zero(this->dim_x);
+  entry.P = MatrixXdr::Zero(this->dim_err, this->dim_err);
+  this->rewind_buf = RewindBuffer<RewindEntry>(REWIND_TO_KEEP, entry);
   this->init_state(x_initial, P_initial, NAN);
 }
 
@@ -84,17 +89,6 @@ void EKFSym::set_global(std::string global_var, double val) {
 std::optional<Estimate> EKFSym::predict_and_update_batch(double t, int kind, std::vector<Map<VectorXd>> z_map,
     std::vector<Map<MatrixXdr>> R_map, std::vector<std::vector<double>> extra_args, bool augment)
 {
-  // TODO handle rewinding at this level
-
-  std::deque<Observation> rewound;
-  if (!std::isnan(this->filter_time) && t < this->filter_time) {
-    if (this->rewind_t.empty() || t < this->rewind_t.front() || t < this->rewind_t.back() - this->max_rewind_age) {
-      LOGD("observation too old at %f with filter at %f, ignoring!", t, this->filter_time);
-      return std::nullopt;
-    }
-    rewound = this->rewind(t);
-  }
-
   Observation obs;
   obs.t = t;
   obs.kind = kind;
@@ -105,6 +99,35 @@ std::optional<Estimate> EKFSym::predict_and_update_batch(double t, int kind, std
   for (Map<MatrixXdr> Ri : R_map) {
     obs.R.push_back(Ri);
   }
+  return this->observe(obs, augment);
+}
+
+std::optional<Estimate> EKFSym::predict_and_update_batch(double t, int kind, const double *z, const double *R, int n, int z_dim,
+    const double *extra_args, int ea_dim, bool augment)
+{
+  // the measurements of a batch are independent, so updating with them one after
+  // another is the same as one update with the stacked innovation
+  Observation obs;
+  obs.t = t;
+  obs.kind = kind;
+  for (int i = 0; i < n; i++) {
+    obs.z.push_back(Map<const VectorXd>(z + i * z_dim, z_dim));
+    obs.R.push_back(Map<const MatrixXdr>(R + i * z_dim * z_dim, z_dim, z_dim));
+    obs.extra_args.emplace_back(extra_args + i * ea_dim, extra_args + (i + 1) * ea_dim);
+  }
+  return this->observe(obs, augment);
+}
+
+std::optional<Estimate> EKFSym::observe(Observation& obs, bool augment) {
+  std::deque<Observation> rewound;
+  if (!std::isnan(this->filter_time) && obs.t < this->filter_time) {
+    if (this->rewind_buf.empty() || obs.t < this->rewind_buf.front().filter_time ||
+        obs.t < this->rewind_buf.back().filter_time - this->max_rewind_age) {
+      LOGD("observation too old at %f with filter at %f, ignoring!", obs.t, this->filter_time);
+      return std::nullopt;
+    }
+    rewound = this->rewind(obs.t);
+  }
 
   std::optional<Estimate> res = std::make_optional(this->predict_and_update_batch(obs, augment));
 
@@ -118,41 +141,57 @@ std::optional<Estimate> EKFSym::predict_and_update_batch(double t, int kind, std
 }
 
 void EKFSym::reset_rewind() {
-  this->rewind_obscache.clear();
-  this->rewind_t.clear();
-  this->rewind_states.clear();
+  this->rewind_buf.clear();
 }
 
 std::deque<Observation> EKFSym::rewind(double t) {
   std::deque<Observation> rewound;
 
   // rewind observations until t is after previous observation
-  while (this->rewind_t.back() > t) {
-    rewound.push_front(this->rewind_obscache.back());
-    this->rewind_t.pop_back();
-    this->rewind_states.pop_back();
-    this->rewind_obscache.pop_back();
+  while (this->rewind_buf.back().filter_time > t) {
+    const RewindEntry &e = this->rewind_buf.back();
+    Observation obs;
+    obs.t = e.t;
+    obs.kind = e.kind;
+    const double *p = e.data.data();
+    for (int i = 0; i < e.z_rows.size(); i++) {
+      const int n = e.z_rows[i];
+      obs.z.push_back(Map<const VectorXd>(p, n));
+      p += n;
+      obs.R.push_back(Map<const MatrixXdr>(p, n, n));
+      p += n * n;
+      obs.extra_args.emplace_back(p, p + e.ea_len[i]);
+      p += e.ea_len[i];
+    }
+    rewound.push_front(std::move(obs));
+    this->rewind_buf.pop_back();
   }
 
   // set the state to the time right before that
-  this->filter_time = this->rewind_t.back();
-  this->x = this->rewind_states.back().first;
-  this->P = this->rewind_states.back().second;
+  this->filter_time = this->rewind_buf.back().filter_time;
+  this->x = this->rewind_buf.back().x;
+  this->P = this->rewind_buf.back().P;
 
   return rewound;
 }
 
 void EKFSym::checkpoint(Observation& obs) {
-  // push to rewinder
-  this->rewind_t.push_back(this->filter_time);
-  this->rewind_states.push_back(std::make_pair(this->x, this->P));
-  this->rewind_obscache.push_back(obs);
-
-  // only keep a certain number around
-  if (this->rewind_t.size() > REWIND_TO_KEEP) {
-    this->rewind_t.pop_front();
-    this->rewind_states.pop_front();
-    this->rewind_obscache.pop_front();
+  // push to rewinder, the oldest is dropped once REWIND_TO_KEEP are kept
+  RewindEntry &e = this->rewind_buf.push_back();
+  e.filter_time = this->filter_time;
+  e.x = this->x;
+  e.P = this->P;
+  e.t = obs.t;
+  e.kind = obs.kind;
+  e.z_rows.clear();
+  e.ea_len.clear();
+  e.data.clear();
+  for (int i = 0; i < obs.z.size(); i++) {
+    e.z_rows.push_back(obs.z[i].rows());
+    e.data.insert(e.data.end(), obs.z[i].data(), obs.z[i].data() + obs.z[i].size());
+    e.data.insert(e.data.end(), obs.R[i].data(), obs.R[i].data() + obs.R[i].size());
+    e.ea_len.push_back(obs.extra_args[i].size());
+    e.data.insert(e.data.end(), obs.extra_args[i].begin(), obs.extra_args[i].end());
   }
 }
 
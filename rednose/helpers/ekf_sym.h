@@ -13,6 +13,7 @@
 #include <eigen3/Eigen/Dense>
 
 #include "common_ekf.h"
+#include "rewind_buffer.h"
 
 #define REWIND_TO_KEEP 512
 
@@ -40,6 +41,19 @@ typedef struct Estimate {
   std::vector<std::vector<double>> extra_args;
 } Estimate;
 
+// a checkpoint: the filter right after an observation, and the observation flattened
+// into data as z, R and extra_args of each measurement. reused once the ring wraps
+typedef struct RewindEntry {
+  double filter_time;
+  Eigen::VectorXd x;
+  MatrixXdr P;
+  double t;
+  int kind;
+  std::vector<int> z_rows;
+  std::vector<int> ea_len;
+  std::vector<double> data;
+} RewindEntry;
+
 class EKFSym {
 public:
   EKFSym(std::string name, Eigen::Map<MatrixXdr> Q, Eigen::Map<Eigen::VectorXd> x_initial,
@@ -61,10 +75,15 @@ public:
   void predict(double t);
   std::optional<Estimate> predict_and_update_batch(double t, int kind, std::vector<Eigen::Map<Eigen::VectorXd>> z,
       std::vector<Eigen::Map<MatrixXdr>> R, std::vector<std::vector<double>> extra_args = {{}}, bool augment = false);
+  // the same batch as contiguous blocks: n measurements of z_dim in z, their row major
+  // covariances in R and ea_dim extra args each in extra_args, nothing to build per call
+  std::optional<Estimate> predict_and_update_batch(double t, int kind, const double *z, const double *R, int n, int z_dim,
+      const double *extra_args = nullptr, int ea_dim = 0, bool augment = false);
 
   extra_routine_t get_extra_routine(const std::string& routine);
 
 private:
+  std::optional<Estimate> observe(Observation& obs, bool augment);
   std::deque<Observation> rewind(double t);
   void checkpoint(Observation& obs);
 
@@ -100,9 +119,7 @@ private:
 
   // rewind stuff
   double max_rewind_age;
-  std::deque<double> rewind_t;
-  std::deque<std::pair<Eigen::VectorXd, MatrixXdr>> rewind_states;
-  std::deque<Observation> rewind_obscache;
+  RewindBuffer<RewindEntry> rewind_buf;
 
   Eigen::VectorXd augment_times;
 
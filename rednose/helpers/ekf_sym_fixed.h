@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "common_ekf.h"
+#include "ekf_sym.h"
+#include "rewind_buffer.h"
+#include "rednose/logger/logger.h"
+
+namespace EKFS {
+
+// EKFSym for a filter with dimensions known at build time, like live. State, covariance
+// and observations are fixed size Eigen types, so predict and update don't touch the heap.
+// Observations are up to MaxObsDim long and come up to MaxBatch at a time. Covers what
+// locationd needs: no msckf augmentation and no extra args.
+template <int DimX, int DimErr, int MaxObsDim, int MaxBatch = 1>
+class EKFSymFixed {
+public:
+  typedef Eigen::Matrix<double, DimX, 1> StateVec;
+  typedef Eigen::Matrix<double, DimErr, DimErr, Eigen::RowMajor> CovMat;
+  // sized per kind, stored inline up to the max
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, Eigen::ColMajor, MaxObsDim, 1> ObsVec;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, MaxObsDim, MaxObsDim> ObsMat;
+
+  struct Observation {
+    double t;
+    int kind;
+    int n;
+    std::array<ObsVec, MaxBatch> z;
+    std::array<ObsMat, MaxBatch> R;
+  };
+
+  EKFSymFixed(std::string name, const CovMat &Q, const StateVec &x_initial, const CovMat &P_initial,
+              std::vector<int> quaternion_idxs = std::vector<int>(), double max_rewind_age = 1.0)
+    : Q(Q), quaternion_idxs(quaternion_idxs), max_rewind_age(max_rewind_age) {
+    this->ekf = ekf_lookup(name);
+    assert(this->ekf);
+    this->rewind_buf = RewindBuffer<Checkpoint>(REWIND_TO_KEEP);
+    // the replay list is filled during rewinds, never beyond what's kept
+    this->rewound.reserve(REWIND_TO_KEEP);
+    this->init_state(x_initial, P_initial, NAN);
+  }
+
+  void init_state(const StateVec &state, const CovMat &covs, double init_filter_time) {
+    this->x = state;
+    this->P = covs;
+    this->filter_time = init_filter_time;
+    this->reset_rewind();
+  }
+
+  const StateVec &state() const { return this->x; }
+  const CovMat &covs() const { return this->P; }
+  void set_filter_time(double t) { this->filter_time = t; }
+  double get_filter_time() const { return this->filter_time; }
+  void set_global(const std::string &global_var, double val) { this->ekf->sets.at(global_var)(val); }
+  extra_routine_t get_extra_routine(const std::string &routine) const { return this->ekf->extra_routines.at(routine); }
+  // observations that needed a rewind / were too old for one, since construction
+  size_t get_rewind_count() const { return this->rewind_count; }
+  size_t get_rejected_count() const { return this->rejected_count; }
+
+  void reset_rewind() {
+    this->rewind_buf.clear();
+  }
+
+  void predict(double t) {
+    // initialize time
+    if (std::isnan(this->filter_time)) {
+      this->filter_time = t;
+    }
+
+    double dt = t - this->filter_time;
+    assert(dt >= 0.0);
+
+    this->ekf->predict(this->x.data(), this->P.data(), this->Q.data(), dt);
+    this->normalize_quaternions();
+    this->filter_time = t;
+  }
+
+  // false if the observation is older than what can be rewound to
+  bool predict_and_update_batch(double t, int kind, const ObsVec *z, const ObsMat *R, int n) {
+    assert(n <= MaxBatch);
+    Observation obs;
+    obs.t = t;
+    obs.kind = kind;
+    obs.n = n;
+    for (int i = 0; i < n; i++) {
+      assert(z[i].rows() == R[i].rows() && z[i].rows() == R[i].cols());
+      obs.z[i] = z[i];
+      obs.R[i] = R[i];
+    }
+    return this->observe(obs);
+  }
+
+  // the same from contiguous blocks, n measurements of z_dim in z and their row major covariances in R
+  bool predict_and_update_batch(double t, int kind, const double *z, const double *R, int n, int z_dim) {
+    assert(n <= MaxBatch && z_dim <= MaxObsDim);
+    Observation obs;
+    obs.t = t;
+    obs.kind = kind;
+    obs.n = n;
+    for (int i = 0; i < n; i++) {
+      obs.z[i] = Eigen::Map<const ObsVec>(z + i * z_dim, z_dim);
+      obs.R[i] = Eigen::Map<const ObsMat>(R + i * z_dim * z_dim, z_dim, z_dim);
+    }
+    return this->observe(obs);
+  }
+
+private:
+  bool observe(Observation &obs) {
+    if (!std::isnan(this->filter_time) && obs.t < this->filter_time) {
+      if (this->rewind_buf.empty() || obs.t < this->rewind_buf.front().filter_time ||
+          obs.t < this->rewind_buf.back().filter_time - this->max_rewind_age) {
+        LOGD("observation too old at %f with filter at %f, ignoring!", obs.t, this->filter_time);
+        this->rejected_count++;
+        return false;
+      }
+      this->rewind(obs.t);
+      this->rewind_count++;
+    }
+
+    this->predict_and_update_batch(obs);
+
+    // fast forward through what was rewound, oldest first
+    for (Observation &r : this->rewound) {
+      this->predict_and_update_batch(r);
+    }
+    this->rewound.clear();
+    return true;
+  }
+
+  void normalize_quaternions() {
+    for (int idx : this->quaternion_idxs) {
+      this->x.template segment<4>(idx).normalize();
+    }
+  }
+
+  void rewind(double t) {
+    // rewind observations until t is after previous observation
+    // copied out, replaying checkpoints into the same slots
+    while (this->rewind_buf.back().filter_time > t) {
+      this->rewound.push_back(this->rewind_buf.back().obs);
+      this->rewind_buf.pop_back();
+    }
+    std::reverse(this->rewound.begin(), this->rewound.end());
+
+    // set the state to the time right before that
+    this->filter_time = this->rewind_buf.back().filter_time;
+    this->x = this->rewind_buf.back().x;
+    this->P = this->rewind_buf.back().P;
+  }
+
+  void checkpoint(const Observation &obs) {
+    // the oldest is dropped once REWIND_TO_KEEP are kept
+    Checkpoint &c = this->rewind_buf.push_back();
+    c.filter_time = this->filter_time;
+    c.x = this->x;
+    c.P = this->P;
+    c.obs = obs;
+  }
+
+  void predict_and_update_batch(Observation &obs) {
+    this->predict(obs.t);
+    auto update = this->ekf->updates.at(obs.kind);
+    for (int i = 0; i < obs.n; i++) {
+      // no extra args, the generated update doesn't read them
+      update(this->x.data(), this->P.data(), obs.z[i].data(), obs.R[i].data(), nullptr);
+      this->normalize_quaternions();
+    }
+    this->checkpoint(obs);
+  }
+
+  struct Checkpoint {
+    double filter_time;
+    StateVec x;
+    CovMat P;
+    Observation obs;
+  };
+
+  // stuct with linked sympy generated functions
+  const EKF *ekf = NULL;
+
+  StateVec x;  // state
+  CovMat P;  // covs
+  CovMat Q;  // process noise
+  double filter_time;
+
+  std::vector<int> quaternion_idxs;
+
+  // rewind stuff
+  double max_rewind_age;
+  RewindBuffer<Checkpoint> rewind_buf;
+  std::vector<Observation> rewound;
+  size_t rewind_count = 0;
+  size_t rejected_count = 0;
+
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}
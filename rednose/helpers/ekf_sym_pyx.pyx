@@ -62,6 +62,8 @@ cdef extern from "rednose/helpers/ekf_sym.h" namespace "EKFS":
     void predict(double t)
     optional[Estimate] predict_and_update_batch(double t, int kind, vector[MapVectorXd] z, vector[MapMatrixXdr] z,
         vector[vector[double]] extra_args, bool augment)
+    optional[Estimate] predict_and_update_batch(double t, int kind, double *z, double *R, int n, int z_dim,
+        double *extra_args, int ea_dim, bool augment)
 
 # Functions like `numpy_to_matrix` are not possible, cython requires default
 # constructor for return variable types which aren't available with Eigen::Map
@@ -137,27 +139,18 @@ cdef class EKF_sym_pyx:
     self.ekf.predict(t)
 
   def predict_and_update_batch(self, double t, int kind, z, R, extra_args=[[]], bool augment=False):
-    cdef vector[MapVectorXd] z_map
-    cdef np.ndarray[np.float64_t, ndim=1, mode='c'] zi_b
-    for zi in z:
-      zi_b = np.ascontiguousarray(zi, dtype=np.double)
-      z_map.push_back(MapVectorXd(<double*> zi_b.data, zi.shape[0]))
-
-    cdef vector[MapMatrixXdr] R_map
-    cdef np.ndarray[np.float64_t, ndim=2, mode='c'] Ri_b
-    for Ri in R:
-      Ri_b = np.ascontiguousarray(Ri, dtype=np.double)
-      R_map.push_back(MapMatrixXdr(<double*> Ri_b.data, Ri.shape[0], Ri.shape[1]))
-
-    cdef vector[vector[double]] extra_args_map
-    cdef vector[double] args_map
-    for args in extra_args:
-      args_map.clear()
-      for a in args:
-        args_map.push_back(a)
-      extra_args_map.push_back(args_map)
-
-    cdef optional[Estimate] res = self.ekf.predict_and_update_batch(t, kind, z_map, R_map, extra_args_map, augment)
+    # a batch is one kind, so every measurement and its extra args have the same size and
+    # the whole batch goes over as contiguous blocks
+    cdef int n = len(z)
+    cdef np.ndarray[np.float64_t, ndim=2, mode='c'] z_b = np.ascontiguousarray(z, dtype=np.double).reshape(n, -1)
+    cdef int z_dim = z_b.shape[1]
+    cdef np.ndarray[np.float64_t, ndim=3, mode='c'] R_b = np.ascontiguousarray(R, dtype=np.double).reshape(n, z_dim, z_dim)
+    if len(extra_args) != n:
+      raise ValueError(f"{n} measurements with {len(extra_args)} sets of extra args")
+    cdef np.ndarray[np.float64_t, ndim=2, mode='c'] ea_b = np.ascontiguousarray(extra_args, dtype=np.double).reshape(n, -1)
+
+    cdef optional[Estimate] res = self.ekf.predict_and_update_batch(t, kind, <double*> z_b.data, <double*> R_b.data, n, z_dim,
+                                                                     <double*> ea_b.data, ea_b.shape[1], augment)
     if not res.has_value():
       return None
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace EKFS {
+
+// Fixed capacity ring of rewind checkpoints, oldest first. All entries are built
+// up front and reused, push_back hands out a slot to assign in place and drops the
+// oldest once full, so checkpointing doesn't allocate.
+template <typename T>
+class RewindBuffer {
+public:
+  RewindBuffer(size_t capacity = 0, const T &init = T()) : buf(capacity, init) {}
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  void clear() { head = count = 0; }
+
+  T &push_back() {
+    assert(!buf.empty());
+    T &slot = buf[(head + count) % buf.size()];
+    if (count == buf.size()) {
+      head = (head + 1) % buf.size();
+    } else {
+      count++;
+    }
+    return slot;
+  }
+  void pop_back() {
+    assert(count > 0);
+    count--;
+  }
+
+  T &front() { return (*this)[0]; }
+  T &back() { return (*this)[count - 1]; }
+  T &operator[](size_t i) {
+    assert(i < count);
+    return buf[(head + i) % buf.size()];
+  }
+
+private:
+  std::vector<T> buf;
+  size_t head = 0;
+  size_t count = 0;
+};
+
+}
@@ -13,17 +13,25 @@
 #include <cassert>
 #include <cerrno>
 #include <chrono>
+#include <cinttypes>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <thread>
 
 #include "cereal/gen/cpp/car.capnp.h"
+#include "cereal/lite.h"
 #include "cereal/messaging/messaging.h"
 #include "common/params.h"
+#include "common/queue.h"
 #include "common/ratekeeper.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
@@ -187,6 +195,31 @@ bool safety_setter_thread(std::vector<Panda *> pandas) {
   return true;
 }
 
+// BOARDD_CAN_FILTER="1:0x1a0,0x1b0;5:0x2e4", lists the standard ids to receive per bus
+static void set_can_hw_filters(Panda *panda, const char *env) {
+  std::stringstream ss(env);
+  std::string entry;
+  while (std::getline(ss, entry, ';')) {
+    size_t sep = entry.find(':');
+    try {
+      uint32_t bus = std::stoul(entry.substr(0, sep));
+      if (sep == std::string::npos || bus < panda->bus_offset || bus >= panda->bus_offset + PANDA_CAN_CNT) {
+        continue;
+      }
+
+      std::vector<uint16_t> addrs;
+      std::stringstream addr_ss(entry.substr(sep + 1));
+      std::string addr;
+      while (std::getline(addr_ss, addr, ',')) {
+        addrs.push_back(std::stoul(addr, nullptr, 0));
+      }
+      panda->set_can_hw_filter(bus - panda->bus_offset, addrs);
+    } catch (std::exception &e) {
+      LOGE("invalid BOARDD_CAN_FILTER entry: %s", entry.c_str());
+    }
+  }
+}
+
 Panda *connect(std::string serial="", uint32_t index=0) {
   std::unique_ptr<Panda> panda;
   try {
@@ -199,6 +232,11 @@ Panda *connect(std::string serial="", uint32_t index=0) {
   if (getenv("BOARDD_LOOPBACK")) {
     panda->set_loopback(true);
   }
+  if (const char *filters = getenv("BOARDD_CAN_FILTER")) {
+    set_can_hw_filters(panda.get(), filters);
+  }
+  // panda side receive timestamps, mapped to the host clock by panda_state_thread
+  panda->set_can_timestamps(getenv("BOARDD_CAN_TIMESTAMPS") != nullptr);
   //panda->enable_deepsleep();
 
   if (!panda->up_to_date() && !getenv("BOARDD_SKIP_FW_CHECK")) {
@@ -209,6 +247,144 @@ Panda *connect(std::string serial="", uint32_t index=0) {
   return panda.release();
 }
 
+// -- sendcan queueing --
+// Every panda gets its own send worker with one queue per bus, so a slow or
+// stalled panda can't hold up the others. Each frame carries a deadline
+// (logMonoTime + the deadline of its address); frames that are still queued
+// past it are dropped instead of going out late, and the rest are sent
+// earliest deadline first. Per address deadlines can be set with
+// BOARDD_SEND_DEADLINES="0x2e4:20,0x191:50" (ms), everything else uses 1s.
+
+const uint64_t SEND_DEFAULT_DEADLINE_NS = 1e9;
+const size_t SEND_QUEUE_SIZE = 256;  // per bus
+
+struct SendFrame {
+  can_frame frame;
+  uint64_t deadline;
+};
+
+static std::map<uint32_t, uint64_t> parse_send_deadlines(const char *env) {
+  std::map<uint32_t, uint64_t> deadlines;
+  if (env == nullptr) return deadlines;
+
+  std::stringstream ss(env);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    size_t sep = item.find(':');
+    if (sep == std::string::npos) {
+      LOGE("invalid BOARDD_SEND_DEADLINES entry: %s", item.c_str());
+      continue;
+    }
+    try {
+      uint32_t address = std::stoul(item.substr(0, sep), nullptr, 0);
+      deadlines[address] = std::stoul(item.substr(sep + 1)) * 1e6;
+    } catch (std::exception &e) {
+      LOGE("invalid BOARDD_SEND_DEADLINES entry: %s", item.c_str());
+    }
+  }
+  return deadlines;
+}
+
+class PandaSendWorker {
+public:
+  PandaSendWorker(Panda *panda) : panda(panda) {}
+
+  void push(const capnp::List<cereal::CanData>::Reader &can_data_list, uint64_t log_mono_time,
+            const std::map<uint32_t, uint64_t> &deadlines) {
+    std::lock_guard lk(lock);
+    for (auto cmsg : can_data_list) {
+      uint8_t bus = cmsg.getSrc();
+      if (bus < panda->bus_offset || bus >= (panda->bus_offset + PANDA_BUS_CNT)) {
+        continue;
+      }
+      auto dat = cmsg.getDat();
+      if (dat.size() > CAN_FRAME_MAX_LEN) {
+        LOGE("sendcan frame too long: %x, %zu bytes", cmsg.getAddress(), dat.size());
+        continue;
+      }
+
+      auto &q = queues[bus - panda->bus_offset];
+      if (q.size() >= SEND_QUEUE_SIZE) {
+        q.pop_front();
+        dropped++;
+      }
+
+      SendFrame &f = q.emplace_back();
+      f.frame.address = cmsg.getAddress();
+      f.frame.busTime = 0;
+      f.frame.src = bus;
+      f.frame.len = dat.size();
+      memcpy(f.frame.dat, dat.begin(), dat.size());
+      auto it = deadlines.find(f.frame.address);
+      f.deadline = log_mono_time + (it != deadlines.end() ? it->second : SEND_DEFAULT_DEADLINE_NS);
+    }
+    cv.notify_one();
+  }
+
+  void run() {
+    util::set_thread_name("boardd_can_send_worker");
+
+    std::vector<SendFrame> pending;
+    std::vector<can_frame> frames;
+    uint64_t last_log = nanos_since_boot();
+    while (!do_exit && panda->connected()) {
+      {
+        std::unique_lock lk(lock);
+        cv.wait_for(lk, 100ms, [&] { return do_exit || !empty(); });
+        for (auto &q : queues) {
+          pending.insert(pending.end(), q.begin(), q.end());
+          q.clear();
+        }
+      }
+
+      uint64_t now = nanos_since_boot();
+      if (!pending.empty()) {
+        std::stable_sort(pending.begin(), pending.end(), [](const SendFrame &a, const SendFrame &b) {
+          return a.deadline < b.deadline;
+        });
+
+        frames.clear();
+        for (const auto &f : pending) {
+          if (f.deadline < now) {
+            late++;
+          } else {
+            frames.push_back(f.frame);
+          }
+        }
+        pending.clear();
+
+        if (!frames.empty()) {
+          panda->can_send(frames);
+          sent += frames.size();
+        }
+      }
+
+      if (now - last_log > 10e9) {
+        if (late > 0 || dropped > 0) {
+          LOGW("sendcan %s: %" PRIu64 " sent, %" PRIu64 " late, %" PRIu64 " dropped", panda->hw_serial().c_str(), sent, late, dropped.load());
+        }
+        last_log = now;
+      }
+    }
+  }
+
+  void wake() { cv.notify_one(); }
+
+private:
+  bool empty() const {
+    return std::all_of(queues.begin(), queues.end(), [](const auto &q) { return q.empty(); });
+  }
+
+  Panda *panda;
+  std::mutex lock;
+  std::condition_variable cv;
+  std::array<std::deque<SendFrame>, PANDA_BUS_CNT> queues;
+
+  // sent and late are only touched from run()
+  uint64_t sent = 0, late = 0;
+  std::atomic<uint64_t> dropped = 0;
+};
+
 void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
   util::set_thread_name("boardd_can_send");
 
@@ -218,6 +394,15 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
   assert(subscriber != NULL);
   subscriber->setTimeout(100);
 
+  const auto deadlines = parse_send_deadlines(getenv("BOARDD_SEND_DEADLINES"));
+
+  std::vector<std::unique_ptr<PandaSendWorker>> workers;
+  std::vector<std::thread> worker_threads;
+  for (const auto &panda : pandas) {
+    auto &w = workers.emplace_back(std::make_unique<PandaSendWorker>(panda));
+    worker_threads.emplace_back(&PandaSendWorker::run, w.get());
+  }
+
   // run as fast as messages come in
   while (!do_exit && check_all_connected(pandas)) {
     std::unique_ptr<Message> msg(subscriber->receive());
@@ -233,50 +418,236 @@ void can_send_thread(std::vector<Panda *> pandas, bool fake_send) {
 
     // Don't send if older than 1 second
     if ((nanos_since_boot() - event.getLogMonoTime() < 1e9) && !fake_send) {
-      for (const auto& panda : pandas) {
-        LOGT("sending sendcan to panda: %s", (panda->hw_serial()).c_str());
-        panda->can_send(event.getSendcan());
-        LOGT("sendcan sent to panda: %s", (panda->hw_serial()).c_str());
+      for (auto &w : workers) {
+        w->push(event.getSendcan(), event.getLogMonoTime(), deadlines);
       }
     } else {
       LOGE("sendcan too old to send: %" PRIu64 ", %" PRIu64, nanos_since_boot(), event.getLogMonoTime());
     }
   }
+
+  for (auto &w : workers) w->wake();
+  for (auto &t : worker_threads) t.join();
+}
+
+// see CAN_BUS_INDEX_ADDRESS in cereal/lite.h, loggerd logs the grouped message like any other
+const bool CAN_BUS_INDEX = getenv("BOARDD_CAN_BUS_INDEX") != nullptr;
+
+// the frames grouped by src, in the order they came within a bus, and the bus index
+static void group_by_bus(const std::vector<can_frame> &frames, std::vector<can_frame> &grouped, std::vector<uint8_t> &index) {
+  std::array<uint32_t, 256> counts = {};
+  for (const auto &f : frames) counts[(uint8_t)f.src]++;
+
+  std::array<uint32_t, 256> pos;
+  uint32_t total = 0;
+  index.clear();
+  for (int src = 0; src < 256; src++) {
+    pos[src] = total;
+    total += counts[src];
+    if (counts[src] > 0) {
+      index.insert(index.end(), {(uint8_t)src, (uint8_t)(counts[src] & 0xff), (uint8_t)(counts[src] >> 8)});
+    }
+  }
+  grouped.resize(frames.size());
+  for (const auto &f : frames) grouped[pos[(uint8_t)f.src]++] = f;
+}
+
+void send_can(PubMaster &pm, const std::vector<can_frame> &all_frames, bool valid) {
+  // kept between calls, so they keep their capacity
+  static thread_local std::vector<can_frame> grouped;
+  static thread_local std::vector<uint8_t> index;
+  const bool with_index = CAN_BUS_INDEX && all_frames.size() < UINT16_MAX;
+  if (with_index) group_by_bus(all_frames, grouped, index);
+  const std::vector<can_frame> &frames = with_index ? grouped : all_frames;
+
+  // Upper bound of the serialized size: event header, then per frame the CanData struct and padded payload
+  size_t max_size = 256;
+  for (const auto &frame : frames) {
+    max_size += 24 + ((frame.len + 7) & ~7);
+  }
+  if (with_index) max_size += 24 + ((index.size() + 7) & ~7);
+
+  pm.sendInPlace("can", max_size, [&](MessageBuilder &msg) {
+    auto evt = msg.initEvent();
+    evt.setValid(valid);
+    auto canData = evt.initCan(frames.size() + with_index);
+    if (with_index) {
+      canData[0].setAddress(CAN_BUS_INDEX_ADDRESS);
+      canData[0].setSrc(CAN_BUS_INDEX_SRC);
+      canData[0].setDat(kj::arrayPtr(index.data(), index.size()));
+    }
+    for (uint i = 0; i<frames.size(); i++) {
+      auto c = canData[i + with_index];
+      c.setAddress(frames[i].address);
+      c.setBusTime(frames[i].busTime);
+      c.setDat(kj::arrayPtr(frames[i].dat, frames[i].len));
+      c.setSrc(frames[i].src);
+    }
+  });
+}
+
+// Parallel receive (BOARDD_PARALLEL_RECV): every panda is polled on its own
+// thread, so USB latency doesn't add up across pandas and one slow panda can't
+// stall the rest. The readers hand batches to the publisher through lock-free
+// queues. The pandas don't timestamp frames, so batches are merged in the order
+// they were received by the host.
+struct CanBatch {
+  uint64_t recv_nanos = 0;
+  bool healthy = true;
+  std::vector<can_frame> frames;
+};
+
+typedef SPSCQueue<CanBatch, 16> CanBatchQueue;
+
+void can_recv_panda_thread(Panda *panda, CanBatchQueue *queue, std::chrono::milliseconds poll_period) {
+  util::set_thread_name("boardd_can_recv_panda");
+
+  CanBatch batch;
+  batch.frames.reserve(256);
+  auto next_poll = std::chrono::steady_clock::now();
+  while (!do_exit && panda->connected()) {
+    if (batch.frames.empty() && batch.healthy) {
+      batch.recv_nanos = nanos_since_boot();
+    }
+    batch.healthy &= panda->can_receive(batch.frames);
+
+    // if the publisher is behind, keep appending to this batch until there's room
+    if ((!batch.frames.empty() || !batch.healthy) && queue->try_push(batch)) {
+      batch.frames.clear();
+      batch.healthy = true;
+    }
+
+    next_poll = std::max(next_poll + poll_period, std::chrono::steady_clock::now());
+    std::this_thread::sleep_until(next_poll);
+  }
+}
+
+void can_recv_thread_parallel(std::vector<Panda *> pandas, bool low_latency) {
+  util::set_thread_name("boardd_can_recv");
+
+  PubMaster pm({"can"});
+
+  const auto poll_period = low_latency ? 1ms : 10ms;
+  const auto min_publish_period = low_latency ? 2ms : 10ms;
+  const auto max_publish_period = 10ms;
+
+  std::vector<std::unique_ptr<CanBatchQueue>> queues;
+  std::vector<std::thread> readers;
+  for (const auto &panda : pandas) {
+    auto &q = queues.emplace_back(std::make_unique<CanBatchQueue>());
+    readers.emplace_back(can_recv_panda_thread, panda, q.get(), poll_period);
+  }
+
+  // popped batches swap with these, so the readers get cleared vectors back
+  std::vector<CanBatch> batches(queues.size() * 4);
+  size_t num_batches = 0;
+  std::vector<can_frame> raw_can_data;
+  raw_can_data.reserve(256);
+  bool comms_healthy = true;
+  auto next_poll = std::chrono::steady_clock::now();
+  auto last_publish = next_poll;
+
+  while (!do_exit && check_all_connected(pandas)) {
+    for (auto &q : queues) {
+      while (true) {
+        if (num_batches == batches.size()) batches.emplace_back();
+        if (!q->try_pop(batches[num_batches])) break;
+        num_batches++;
+      }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const auto since_publish = now - last_publish;
+    const bool have_data = num_batches > 0;
+    if (since_publish >= max_publish_period || (have_data && since_publish >= min_publish_period)) {
+      std::stable_sort(batches.begin(), batches.begin() + num_batches, [](const CanBatch &a, const CanBatch &b) {
+        return a.recv_nanos < b.recv_nanos;
+      });
+      for (size_t i = 0; i < num_batches; i++) {
+        auto &b = batches[i];
+        comms_healthy &= b.healthy;
+        raw_can_data.insert(raw_can_data.end(), b.frames.begin(), b.frames.end());
+        b.frames.clear();
+        b.healthy = true;
+      }
+      num_batches = 0;
+
+      send_can(pm, raw_can_data, comms_healthy);
+      raw_can_data.clear();
+      comms_healthy = true;
+      last_publish = now;
+    }
+
+    next_poll = std::max(next_poll + 1ms, now);
+    std::this_thread::sleep_until(next_poll);
+  }
+
+  for (auto &t : readers) t.join();
 }
 
-void can_recv_thread(std::vector<Panda *> pandas) {
+// Normal mode polls the pandas and publishes at a fixed 100Hz. Low latency mode
+// (BOARDD_LOW_LATENCY) polls at 1kHz and publishes as soon as frames arrive,
+// coalesced to at most one can message per 2ms. Either way an empty message
+// still goes out every 10ms.
+void can_recv_thread(std::vector<Panda *> pandas, bool low_latency) {
   util::set_thread_name("boardd_can_recv");
 
   PubMaster pm({"can"});
 
+  const auto poll_period = 1ms;
+  const auto min_publish_period = 2ms;
+  const auto max_publish_period = 10ms;
+  auto next_poll = std::chrono::steady_clock::now();
+  auto last_publish = next_poll;
+
   // run at 100Hz
   RateKeeper rk("boardd_can_recv", 100);
+  // cleared every cycle but keeps its capacity, so steady state receives don't allocate
   std::vector<can_frame> raw_can_data;
+  raw_can_data.reserve(256);
+  bool comms_healthy = true;
 
   while (!do_exit && check_all_connected(pandas)) {
-    bool comms_healthy = true;
-    raw_can_data.clear();
     for (const auto& panda : pandas) {
       comms_healthy &= panda->can_receive(raw_can_data);
     }
 
-    MessageBuilder msg;
-    auto evt = msg.initEvent();
-    evt.setValid(comms_healthy);
-    auto canData = evt.initCan(raw_can_data.size());
-    for (uint i = 0; i<raw_can_data.size(); i++) {
-      canData[i].setAddress(raw_can_data[i].address);
-      canData[i].setBusTime(raw_can_data[i].busTime);
-      canData[i].setDat(kj::arrayPtr((uint8_t*)raw_can_data[i].dat.data(), raw_can_data[i].dat.size()));
-      canData[i].setSrc(raw_can_data[i].src);
+    const auto now = std::chrono::steady_clock::now();
+    const auto since_publish = now - last_publish;
+    if (!low_latency || since_publish >= max_publish_period || (!raw_can_data.empty() && since_publish >= min_publish_period)) {
+      send_can(pm, raw_can_data, comms_healthy);
+      raw_can_data.clear();
+      comms_healthy = true;
+      last_publish = now;
     }
-    pm.send("can", msg);
 
-    rk.keepTime();
+    if (low_latency) {
+      next_poll = std::max(next_poll + poll_period, now);
+      std::this_thread::sleep_until(next_poll);
+    } else {
+      rk.keepTime();
+    }
+  }
+}
+
+// Reads health of every panda, one batched control transfer each so the CAN
+// threads wait on hw_lock as little as possible. The result is shared by the
+// pandaStates publisher and the ignition logic for the cycle.
+std::optional<std::vector<PandaTelemetry>> get_telemetry(const std::vector<Panda *> &pandas) {
+  std::vector<PandaTelemetry> telemetry;
+  telemetry.reserve(pandas.size());
+  for (const auto &panda : pandas) {
+    auto t = panda->get_telemetry();
+    if (!t) {
+      return std::nullopt;
+    }
+    telemetry.push_back(*t);
   }
+  return telemetry;
 }
 
-std::optional<bool> send_panda_states(PubMaster *pm, const std::vector<Panda *> &pandas, bool spoofing_started) {
+bool send_panda_states(PubMaster *pm, const std::vector<Panda *> &pandas,
+                       const std::vector<PandaTelemetry> &telemetry, bool spoofing_started) {
   bool ignition_local = false;
   const uint32_t pandas_cnt = pandas.size();
 
@@ -295,23 +666,10 @@ std::optional<bool> send_panda_states(PubMaster *pm, const std::vector<Panda *>
                                      (pandas[0]->hw_type == cereal::PandaState::PandaType::DOS) &&
                                      (pandas[1]->hw_type == cereal::PandaState::PandaType::RED_PANDA);
 
-  for (const auto& panda : pandas){
-    auto health_opt = panda->get_state();
-    if (!health_opt) {
-      return std::nullopt;
-    }
-
-    health_t health = *health_opt;
-
-    std::array<can_health_t, PANDA_CAN_CNT> can_health{};
-    for (uint32_t i = 0; i < PANDA_CAN_CNT; i++) {
-      auto can_health_opt = panda->get_can_state(i);
-      if (!can_health_opt) {
-        return std::nullopt;
-      }
-      can_health[i] = *can_health_opt;
-    }
-    pandaCanStates.push_back(can_health);
+  for (uint32_t i = 0; i < pandas_cnt; i++) {
+    auto panda = pandas[i];
+    health_t health = telemetry[i].health;
+    pandaCanStates.push_back(telemetry[i].can_health);
 
     if (spoofing_started) {
       health.ignition_line_pkt = 1;
@@ -481,15 +839,43 @@ void panda_state_thread(std::vector<Panda *> pandas, bool spoofing_started) {
       send_peripheral_state(&pm, peripheral_panda);
     }
 
-    auto ignition_opt = send_panda_states(&pm, pandas, spoofing_started);
-
-    if (!ignition_opt) {
-      LOGE("Failed to get ignition_opt");
+    auto telemetry = get_telemetry(pandas);
+    if (!telemetry) {
+      LOGE("Failed to get panda telemetry");
       rk.keepTime();
       continue;
     }
 
-    ignition = *ignition_opt;
+    ignition = send_panda_states(&pm, pandas, *telemetry, spoofing_started);
+
+    // keep the receive timestamp clock mapping fresh, every 1s
+    if (getenv("BOARDD_CAN_TIMESTAMPS") && (uint64_t)rk.frame() % 10 == 0) {
+      for (const auto &panda : pandas) {
+        if (!panda->sync_clock()) {
+          LOGW("%s clock sync failed", panda->hw_serial().c_str());
+        }
+      }
+    }
+
+    // comms stats, every 10s
+    if (rk.frame() > 0 && (uint64_t)rk.frame() % 100 == 0) {
+      for (const auto &panda : pandas) {
+        TransferStats ts = panda->take_transfer_stats();
+        if (ts.count > 0) {
+          LOG("%s usb reads: %" PRIu64 ", transfer avg %.2fms max %.2fms, queued avg %.2fms max %.2fms", panda->hw_serial().c_str(), ts.count,
+              ts.transfer_ms_sum / ts.count, ts.transfer_ms_max, ts.queued_ms_sum / ts.count, ts.queued_ms_max);
+        }
+
+        // per bus rx queue fill on the panda, to tell bus and host induced drops apart
+        for (uint16_t bus = 0; bus < PANDA_CAN_CNT; bus++) {
+          auto rx_stats = panda->get_can_rx_stats(bus);
+          if (rx_stats && rx_stats->overflow_cnt > 0) {
+            LOGW("%s can rx queue %d: %u/%u bytes used, high water %u, %u overflows", panda->hw_serial().c_str(), bus,
+                 rx_stats->used, rx_stats->size, rx_stats->high_water, rx_stats->overflow_cnt);
+          }
+        }
+      }
+    }
 
     // check if we should have pandad reconnect
     if (!ignition) {
@@ -641,7 +1027,11 @@ void boardd_main_thread(std::vector<std::string> serials) {
     threads.emplace_back(peripheral_control_thread, pandas[0], getenv("NO_FAN_CONTROL") != nullptr);
 
     threads.emplace_back(can_send_thread, pandas, getenv("FAKESEND") != nullptr);
-    threads.emplace_back(can_recv_thread, pandas);
+    if (getenv("BOARDD_PARALLEL_RECV") != nullptr) {
+      threads.emplace_back(can_recv_thread_parallel, pandas, getenv("BOARDD_LOW_LATENCY") != nullptr);
+    } else {
+      threads.emplace_back(can_recv_thread, pandas, getenv("BOARDD_LOW_LATENCY") != nullptr);
+    }
 
     for (auto &t : threads) t.join();
   }
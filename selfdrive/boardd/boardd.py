@@ -1,10 +1,17 @@
 # Cython, now uses scons to build
-from openpilot.selfdrive.boardd.boardd_api_impl import can_list_to_can_capnp
+from openpilot.selfdrive.boardd.boardd_api_impl import can_list_to_can_capnp, CanListBuilder
 assert can_list_to_can_capnp
+assert CanListBuilder
+
+# the bus index of BOARDD_CAN_BUS_INDEX, see cereal/lite.h
+CAN_BUS_INDEX_ADDRESS = 0xFFFFFFFF
+CAN_BUS_INDEX_SRC = 255
 
 def can_capnp_to_can_list(can, src_filter=None):
   ret = []
   for msg in can:
+    if msg.src == CAN_BUS_INDEX_SRC and msg.address == CAN_BUS_INDEX_ADDRESS:
+      continue
     if src_filter is None or msg.src in src_filter:
       ret.append((msg.address, msg.busTime, msg.dat, msg.src))
   return ret
@@ -3,28 +3,69 @@
 from libcpp.vector cimport vector
 from libcpp.string cimport string
 from libcpp cimport bool
+from libc.stdint cimport uint8_t
 
 cdef extern from "panda.h":
+  cdef int CAN_FRAME_MAX_LEN
   cdef struct can_frame:
     long address
-    string dat
     long busTime
     long src
+    uint8_t len
+    uint8_t dat[64]
 
 cdef extern from "can_list_to_can_capnp.cc":
   void can_list_to_can_capnp_cpp(const vector[can_frame] &can_list, string &out, bool sendCan, bool valid)
+  cdef cppclass cpp_CanListBuilder "CanListBuilder":
+    void clear()
+    size_t size()
+    bool add(long address, long busTime, const uint8_t *dat, size_t len, long src)
+    int add_packed(const uint8_t *buf, size_t size)
+    void to_capnp(string &out, bool sendCan, bool valid)
+
+
+cdef class CanListBuilder:
+  """Builds can/sendcan messages without a python list of frames in between. The data of a
+  frame is copied once, from the bytes or packer buffer into the builder, and the builder
+  is meant to be kept and reused for every message"""
+  cdef cpp_CanListBuilder b
+
+  def __len__(self):
+    return self.b.size()
+
+  def clear(self):
+    self.b.clear()
+
+  def add(self, long address, bytes dat, long src, long bus_time=0):
+    if not self.b.add(address, bus_time, <const uint8_t *><const char *>dat, len(dat), src):
+      raise ValueError(f"CAN frame too long: {len(dat)} bytes")
+
+  def extend(self, can_msgs):
+    """Adds a list of [address, busTime, dat, src]"""
+    cdef bytes dat
+    for can_msg in can_msgs:
+      dat = can_msg[2]
+      if not self.b.add(can_msg[0], can_msg[1], <const uint8_t *><const char *>dat, len(dat), can_msg[3]):
+        raise ValueError(f"CAN frame too long: {len(dat)} bytes")
+
+  def add_packed(self, bytes buf):
+    """Adds the frames of CANPacker.make_can_msgs_packed"""
+    n = self.b.add_packed(<const uint8_t *><const char *>buf, len(buf))
+    if n < 0:
+      raise ValueError("malformed packed CAN buffer")
+    return n
+
+  def to_bytes(self, msgtype='can', valid=True, clear=True):
+    cdef string out
+    self.b.to_capnp(out, msgtype == 'sendcan', valid)
+    if clear:
+      self.b.clear()
+    return out
+
+
+cdef CanListBuilder _builder = CanListBuilder()
 
 def can_list_to_can_capnp(can_msgs, msgtype='can', valid=True):
-  cdef vector[can_frame] can_list
-  can_list.reserve(len(can_msgs))
-
-  cdef can_frame f
-  for can_msg in can_msgs:
-    f.address = can_msg[0]
-    f.busTime = can_msg[1]
-    f.dat = can_msg[2]
-    f.src = can_msg[3]
-    can_list.push_back(f)
-  cdef string out
-  can_list_to_can_capnp_cpp(can_list, out, msgtype == 'sendcan', valid)
-  return out
+  _builder.clear()
+  _builder.extend(can_msgs)
+  return _builder.to_bytes(msgtype, valid)
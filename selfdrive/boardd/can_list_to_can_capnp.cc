@@ -1,8 +1,11 @@
+#include <cstring>
+
 #include "cereal/messaging/messaging.h"
 #include "selfdrive/boardd/panda.h"
 
 void can_list_to_can_capnp_cpp(const std::vector<can_frame> &can_list, std::string &out, bool sendCan, bool valid) {
-  MessageBuilder msg;
+  static thread_local MessageArena arena;
+  MessageBuilder msg(arena.segment());
   auto event = msg.initEvent(valid);
 
   auto canData = sendCan ? event.initSendcan(can_list.size()) : event.initCan(can_list.size());
@@ -11,11 +14,53 @@ void can_list_to_can_capnp_cpp(const std::vector<can_frame> &can_list, std::stri
     auto c = canData[j];
     c.setAddress(it->address);
     c.setBusTime(it->busTime);
-    c.setDat(kj::arrayPtr((uint8_t*)it->dat.data(), it->dat.size()));
+    c.setDat(kj::arrayPtr(it->dat, it->len));
     c.setSrc(it->src);
   }
+  arena.update(msg);
   const uint64_t msg_size = capnp::computeSerializedSizeInWords(msg) * sizeof(capnp::word);
   out.resize(msg_size);
   kj::ArrayOutputStream output_stream(kj::ArrayPtr<capnp::byte>((unsigned char *)out.data(), msg_size));
   capnp::writeMessage(output_stream, msg);
 }
+
+// Frames for one can/sendcan message, appended from python and kept between messages so the
+// frame list is allocated once. add_packed() takes the buffer of CANPacker.make_can_msgs_packed,
+// per frame a little endian uint32 address, a uint8 bus, a uint8 length and then the data.
+class CanListBuilder {
+public:
+  void clear() { frames.clear(); }
+  size_t size() const { return frames.size(); }
+
+  bool add(long address, long busTime, const uint8_t *dat, size_t len, long src) {
+    if (len > CAN_FRAME_MAX_LEN) return false;
+    can_frame &f = frames.emplace_back();
+    f.address = address;
+    f.busTime = busTime;
+    f.src = src;
+    f.len = len;
+    memcpy(f.dat, dat, len);
+    return true;
+  }
+
+  // the number of frames added, -1 if the buffer is cut off or has a frame that's too long
+  int add_packed(const uint8_t *buf, size_t size) {
+    int n = 0;
+    for (size_t pos = 0; pos < size; n++) {
+      if (size - pos < 6) return -1;
+      const uint32_t address = buf[pos] | (buf[pos + 1] << 8) | (buf[pos + 2] << 16) | ((uint32_t)buf[pos + 3] << 24);
+      const uint8_t bus = buf[pos + 4], len = buf[pos + 5];
+      pos += 6;
+      if (size - pos < len || !add(address, 0, buf + pos, len, bus)) return -1;
+      pos += len;
+    }
+    return n;
+  }
+
+  void to_capnp(std::string &out, bool sendCan, bool valid) const {
+    can_list_to_can_capnp_cpp(frames, out, sendCan, valid);
+  }
+
+private:
+  std::vector<can_frame> frames;
+};
@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/boardd/panda.h"
+
+// CAN loopback benchmark. Puts the panda in loopback with ALL_OUTPUT safety,
+// sends frames at a fixed rate through the same Panda::can_send/can_receive path
+// boardd uses, and reports throughput, drops and one-way latency percentiles.
+// boardd must not be running, and the panda needs a debug build for ALL_OUTPUT.
+//
+// Usage: can_loopback_bench [--serial S] [--bus N] [--rate FRAMES_PER_S] [--len BYTES] [--fd] [--seconds N]
+
+const uint32_t BENCH_ADDR = 0x5a5;
+// sequence numbers index a ring of send times, sized for a few seconds in flight
+const uint32_t SEND_TIMES_SIZE = 1 << 16;
+
+struct BenchConfig {
+  std::string serial;
+  uint8_t bus = 0;
+  double rate = 1000;
+  uint8_t len = 8;
+  bool fd = false;
+  double seconds = 10;
+};
+
+static bool parse_args(int argc, char *argv[], BenchConfig &cfg) {
+  bool len_set = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_val = (i + 1) < argc;
+    if (arg == "--fd") {
+      cfg.fd = true;
+    } else if (arg == "--serial" && has_val) {
+      cfg.serial = argv[++i];
+    } else if (arg == "--bus" && has_val) {
+      cfg.bus = std::atoi(argv[++i]);
+    } else if (arg == "--rate" && has_val) {
+      cfg.rate = std::atof(argv[++i]);
+    } else if (arg == "--len" && has_val) {
+      cfg.len = std::atoi(argv[++i]);
+      len_set = true;
+    } else if (arg == "--seconds" && has_val) {
+      cfg.seconds = std::atof(argv[++i]);
+    } else {
+      return false;
+    }
+  }
+
+  if (cfg.fd && !len_set) {
+    cfg.len = 64;
+  }
+  // payload carries a 4 byte sequence number, CAN-FD frames above 8 bytes must be a valid DLC length
+  const std::vector<uint8_t> fd_lens = {12, 16, 20, 24, 32, 48, 64};
+  bool valid_len = (cfg.len >= 4 && cfg.len <= 8) ||
+                   (cfg.fd && std::find(fd_lens.begin(), fd_lens.end(), cfg.len) != fd_lens.end());
+  if (!valid_len) {
+    fprintf(stderr, "invalid frame length %d\n", cfg.len);
+    return false;
+  }
+  return cfg.bus < PANDA_CAN_CNT && cfg.rate > 0 && cfg.seconds > 0;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t idx = std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()));
+  return sorted[idx];
+}
+
+int main(int argc, char *argv[]) {
+  BenchConfig cfg;
+  if (!parse_args(argc, argv, cfg)) {
+    fprintf(stderr, "usage: %s [--serial S] [--bus N] [--rate FRAMES_PER_S] [--len BYTES] [--fd] [--seconds N]\n", argv[0]);
+    return 1;
+  }
+
+  Panda panda(cfg.serial);
+  std::vector<std::string> usb_serials = Panda::list(true);
+  bool usb = std::find(usb_serials.begin(), usb_serials.end(), panda.hw_serial()) != usb_serials.end();
+
+  panda.set_safety_model(cereal::CarParams::SafetyModel::ALL_OUTPUT);
+  panda.set_power_saving(false);
+  if (cfg.fd) {
+    panda.set_data_speed_kbps(cfg.bus, 2000);
+  }
+  panda.set_loopback(true);
+  panda.can_reset_communications();
+
+  printf("%s over %s, bus %d, %s %d byte frames at %.0f/s for %.0fs\n", panda.hw_serial().c_str(), usb ? "USB" : "SPI",
+         cfg.bus, cfg.fd ? "CAN-FD" : "classic", cfg.len, cfg.rate, cfg.seconds);
+
+  std::vector<std::atomic<uint64_t>> send_times(SEND_TIMES_SIZE);
+  std::atomic<uint32_t> sent(0);
+  std::atomic<bool> done(false);
+
+  std::vector<double> latencies_us;
+  latencies_us.reserve(cfg.rate * cfg.seconds);
+  uint64_t received = 0, reordered = 0;
+
+  std::thread receiver([&]() {
+    std::vector<can_frame> frames;
+    frames.reserve(256);
+    uint32_t next_seq = 0;
+    while (!done) {
+      frames.clear();
+      if (!panda.can_receive(frames)) {
+        fprintf(stderr, "receive failed\n");
+        break;
+      }
+      uint64_t now = nanos_since_boot();
+      for (const auto &f : frames) {
+        // loopback frames come back on the bus they were sent on, tx echoes have the returned flag set
+        if (f.address != BENCH_ADDR || f.src != cfg.bus || f.len < 4) continue;
+        uint32_t seq;
+        memcpy(&seq, f.dat, sizeof(seq));
+        if (seq < next_seq) {
+          reordered++;
+        }
+        next_seq = seq + 1;
+        received++;
+        uint64_t t = send_times[seq % SEND_TIMES_SIZE];
+        if (t != 0 && now > t) {
+          latencies_us.push_back((now - t) / 1e3);
+        }
+      }
+      if (frames.empty()) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+    }
+  });
+
+  // send in 1ms ticks, carrying the fractional frame count over
+  const double per_tick = cfg.rate / 1000.0;
+  double owed = 0;
+  std::vector<can_frame> batch;
+  auto next = std::chrono::steady_clock::now();
+  const auto end = next + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(cfg.seconds));
+  const uint64_t start_nanos = nanos_since_boot();
+  while (std::chrono::steady_clock::now() < end) {
+    owed += per_tick;
+    batch.clear();
+    uint64_t now = nanos_since_boot();
+    for (; owed >= 1; owed -= 1) {
+      can_frame f = {};
+      f.address = BENCH_ADDR;
+      f.src = cfg.bus;
+      f.len = cfg.len;
+      uint32_t seq = sent++;
+      memcpy(f.dat, &seq, sizeof(seq));
+      send_times[seq % SEND_TIMES_SIZE] = now;
+      batch.push_back(f);
+    }
+    if (!batch.empty()) {
+      panda.can_send(batch);
+    }
+    next += std::chrono::milliseconds(1);
+    std::this_thread::sleep_until(next);
+  }
+  const double send_seconds = (nanos_since_boot() - start_nanos) / 1e9;
+
+  // let the tail of the traffic drain
+  util::sleep_for(500);
+  done = true;
+  receiver.join();
+  const double total_seconds = (nanos_since_boot() - start_nanos) / 1e9;
+
+  panda.set_loopback(false);
+  panda.set_safety_model(cereal::CarParams::SafetyModel::SILENT);
+
+  std::sort(latencies_us.begin(), latencies_us.end());
+  const uint64_t total_sent = sent;
+  const uint64_t dropped = total_sent > received ? total_sent - received : 0;
+  printf("sent %" PRIu64 " (%.0f/s), received %" PRIu64 " (%.0f/s), dropped %" PRIu64 " (%.2f%%), reordered %" PRIu64 "\n",
+         total_sent, total_sent / send_seconds, received, received / total_seconds, dropped,
+         total_sent > 0 ? 100.0 * dropped / total_sent : 0.0, reordered);
+  printf("payload throughput %.1f kB/s\n", received * cfg.len / total_seconds / 1e3);
+  printf("latency us: p50 %.0f, p90 %.0f, p99 %.0f, p99.9 %.0f, max %.0f\n", percentile(latencies_us, 50),
+         percentile(latencies_us, 90), percentile(latencies_us, 99), percentile(latencies_us, 99.9),
+         latencies_us.empty() ? 0.0 : latencies_us.back());
+  return 0;
+}
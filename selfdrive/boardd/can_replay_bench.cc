@@ -0,0 +1,70 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "common/bench.h"
+#include "selfdrive/boardd/panda.h"
+#include "selfdrive/boardd/panda_comms.h"
+
+// The CAN receive path of boardd on a recorded capture or rlog, through the replay
+// comms handle as fast as it goes: can_receive, which reads and unpacks the wire
+// data, then building the can event the way send_can does it. Writes the common
+// daemon bench report, see common/bench.h.
+// Usage: can_replay_bench [--json FILE] <capture|rlog>
+
+int main(int argc, char *argv[]) {
+  std::string json_path, path;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path.empty()) {
+    fprintf(stderr, "usage: %s [--json FILE] <capture|rlog>\n", argv[0]);
+    return 1;
+  }
+
+  // only for the length of the trace, the Panda below replays its own copy
+  const double drive_seconds = PandaReplayHandle(path, 0).duration();
+
+  setenv("BOARDD_REPLAY", path.c_str(), 1);
+  setenv("BOARDD_REPLAY_SPEED", "0", 1);
+  Panda panda;
+
+  BenchReport report("boardd");
+  std::vector<can_frame> frames;
+  frames.reserve(256);
+  uint64_t frame_cnt = 0, can_bytes = 0;
+  while (panda.connected()) {
+    auto t = report.now();
+    panda.can_receive(frames);
+    report.add("can_receive", t);
+    if (frames.empty()) continue;
+
+    t = report.now();
+    MessageBuilder msg;
+    auto canData = msg.initEvent().initCan(frames.size());
+    for (size_t i = 0; i < frames.size(); i++) {
+      canData[i].setAddress(frames[i].address);
+      canData[i].setBusTime(frames[i].busTime);
+      canData[i].setDat(kj::arrayPtr(frames[i].dat, frames[i].len));
+      canData[i].setSrc(frames[i].src);
+    }
+    can_bytes += msg.toBytes().size();
+    report.add("build_can", t);
+
+    frame_cnt += frames.size();
+    frames.clear();
+  }
+
+  report.set("frames", (double)frame_cnt);
+  report.set("can_bytes", (double)can_bytes);
+  report.finish(drive_seconds);
+  report.write(json_path);
+  return 0;
+}
@@ -8,20 +8,39 @@
 
 #include "cereal/messaging/messaging.h"
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "common/util.h"
 
 Panda::Panda(std::string serial, uint32_t bus_offset) : bus_offset(bus_offset) {
-  // try USB first, then SPI
-  try {
-    handle = std::make_unique<PandaUsbHandle>(serial);
-    LOGW("connected to %s over USB", serial.c_str());
-  } catch (std::exception &e) {
+  // BOARDD_REPLAY=<capture or rlog> feeds CAN from a file instead of a panda
+  if (const char *replay = getenv("BOARDD_REPLAY")) {
+    const char *speed = getenv("BOARDD_REPLAY_SPEED");
+    handle = std::make_unique<PandaReplayHandle>(replay, speed ? std::atof(speed) : 1.0, getenv("BOARDD_REPLAY_LOOP") != nullptr);
+  } else {
+    // try USB first, then SPI
+    try {
+      auto usb_handle = std::make_unique<PandaUsbHandle>(serial);
+      LOGW("connected to %s over USB", serial.c_str());
+      // BOARDD_USB_ASYNC keeps several CAN reads in flight instead of one synchronous read per poll
+      if (getenv("BOARDD_USB_ASYNC")) {
+        usb_handle->start_async_read(0x81, USB_ASYNC_READS, RECV_SIZE / USB_ASYNC_READS);
+      }
+      handle = std::move(usb_handle);
+    } catch (std::exception &e) {
 #ifndef __APPLE__
-    handle = std::make_unique<PandaSpiHandle>(serial);
-    LOGW("connected to %s over SPI", serial.c_str());
+      handle = std::make_unique<PandaSpiHandle>(serial);
+      LOGW("connected to %s over SPI", serial.c_str());
 #else
-    throw e;
+      throw e;
 #endif
+    }
+  }
+
+  // BOARDD_CAPTURE=<path> records the CAN bulk reads for BOARDD_REPLAY, one file per panda
+  if (const char *capture_path = getenv("BOARDD_CAPTURE")) {
+    std::string path = capture_path;
+    if (bus_offset > 0) path += "." + std::to_string(bus_offset / PANDA_BUS_CNT);
+    capture.open(path, std::ios::binary | std::ios::trunc);
   }
 
   hw_type = get_hw_type();
@@ -46,7 +65,14 @@ std::string Panda::hw_serial() {
   return handle->hw_serial;
 }
 
+TransferStats Panda::take_transfer_stats() {
+  return handle->take_transfer_stats();
+}
+
 std::vector<std::string> Panda::list(bool usb_only) {
+  if (getenv("BOARDD_REPLAY")) {
+    return {"replay"};
+  }
   std::vector<std::string> serials = PandaUsbHandle::list();
 
 #ifndef __APPLE__
@@ -138,6 +164,44 @@ std::optional<can_health_t> Panda::get_can_state(uint16_t can_number) {
   return err >= 0 ? std::make_optional(can_health) : std::nullopt;
 }
 
+std::optional<can_rx_stats_t> Panda::get_can_rx_stats(uint16_t can_number) {
+  can_rx_stats_t stats {0};
+  int err = handle->control_read(0xc6, can_number, 0, (unsigned char*)&stats, sizeof(stats));
+  return err == sizeof(stats) ? std::make_optional(stats) : std::nullopt;
+}
+
+std::optional<PandaTelemetry> Panda::get_telemetry() {
+  PandaTelemetry t {};
+  if (telemetry_batched) {
+    uint8_t buf[PANDA_TELEMETRY_SIZE] = {};
+    int err = handle->control_read(0xca, 0, 0, buf, sizeof(buf));
+    if (err == sizeof(buf)) {
+      memcpy(&t.health, buf, sizeof(t.health));
+      memcpy(t.can_health.data(), &buf[sizeof(t.health)], sizeof(t.can_health));
+      return t;
+    } else if (err < 0) {
+      return std::nullopt;
+    }
+    // older firmware answers unknown requests with an empty response
+    LOGW("%s: no batched health read, falling back to per bus requests", hw_serial().c_str());
+    telemetry_batched = false;
+  }
+
+  auto health_opt = get_state();
+  if (!health_opt) {
+    return std::nullopt;
+  }
+  t.health = *health_opt;
+  for (uint16_t i = 0; i < PANDA_CAN_CNT; i++) {
+    auto can_health_opt = get_can_state(i);
+    if (!can_health_opt) {
+      return std::nullopt;
+    }
+    t.can_health[i] = *can_health_opt;
+  }
+  return t;
+}
+
 void Panda::set_loopback(bool loopback) {
   handle->control_write(0xe5, loopback, 0);
 }
@@ -192,6 +256,19 @@ void Panda::set_canfd_non_iso(uint16_t bus, bool non_iso) {
   handle->control_write(0xfc, bus, non_iso);
 }
 
+// Only the given standard ids (plus what the safety mode checks) and extended
+// frames are received on the bus. An empty list turns filtering off. Buses
+// that forward are never filtered by the panda.
+void Panda::set_can_hw_filter(uint16_t bus, const std::vector<uint16_t> &addrs) {
+  handle->control_write(0xc8, bus, 0);
+  if (!addrs.empty()) {
+    for (uint16_t addr : addrs) {
+      handle->control_write(0xc7, bus, addr);
+    }
+    handle->control_write(0xc8, bus, 1);
+  }
+}
+
 static uint8_t len_to_dlc(uint8_t len) {
   if (len <= 8) {
     return len;
@@ -203,54 +280,96 @@ static uint8_t len_to_dlc(uint8_t len) {
   }
 }
 
-void Panda::pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
-                            std::function<void(uint8_t *, size_t)> write_func) {
-  int32_t pos = 0;
-  uint8_t send_buf[2 * USB_TX_SOFT_LIMIT];
-
-  for (auto cmsg : can_data_list) {
+// packs one frame into buf and returns its size
+uint32_t Panda::pack_can_frame(uint8_t *buf, uint32_t address, uint8_t bus, const uint8_t *dat, size_t len) {
+  uint8_t data_len_code = len_to_dlc(len);
+  assert(len <= 64);
+  assert(len == dlc_to_len[data_len_code]);
+
+  can_header header = {};
+  header.addr = address;
+  header.extended = (address >= 0x800) ? 1 : 0;
+  header.data_len_code = data_len_code;
+  header.bus = bus - bus_offset;
+  header.checksum = 0;
+
+  memcpy(buf, (uint8_t *)&header, sizeof(can_header));
+  memcpy(buf + sizeof(can_header), dat, len);
+  uint32_t msg_size = sizeof(can_header) + len;
+
+  // set checksum
+  ((can_header *)buf)->checksum = calculate_checksum(buf, msg_size);
+  return msg_size;
+}
+
+// fields(frame, address, bus, dat, len) reads a frame of either kind
+template <class Frames, class Fields>
+uint32_t Panda::pack_can_frames(const Frames &frames, Fields fields) {
+  const uint32_t limit = handle ? handle->can_write_limit() : USB_TX_SOFT_LIMIT;
+  // room for the largest frames, so the buffer is sized once per event at most
+  const size_t max_size = frames.size() * (sizeof(can_header) + CAN_FRAME_MAX_LEN);
+  if (send_buf.size() < max_size) send_buf.resize(max_size);
+  send_chunks.clear();
+
+  uint32_t pos = 0, chunk_start = 0;
+  for (const auto &f : frames) {
+    uint32_t address;
+    uint8_t bus;
+    const uint8_t *dat;
+    size_t len;
+    fields(f, address, bus, dat, len);
     // check if the message is intended for this panda
-    uint8_t bus = cmsg.getSrc();
     if (bus < bus_offset || bus >= (bus_offset + PANDA_BUS_CNT)) {
       continue;
     }
-    auto can_data = cmsg.getDat();
-    uint8_t data_len_code = len_to_dlc(can_data.size());
-    assert(can_data.size() <= 64);
-    assert(can_data.size() == dlc_to_len[data_len_code]);
-
-    can_header header = {};
-    header.addr = cmsg.getAddress();
-    header.extended = (cmsg.getAddress() >= 0x800) ? 1 : 0;
-    header.data_len_code = data_len_code;
-    header.bus = bus - bus_offset;
-    header.checksum = 0;
-
-    memcpy(&send_buf[pos], (uint8_t *)&header, sizeof(can_header));
-    memcpy(&send_buf[pos + sizeof(can_header)], (uint8_t *)can_data.begin(), can_data.size());
-    uint32_t msg_size = sizeof(can_header) + can_data.size();
-
-    // set checksum
-    ((can_header *) &send_buf[pos])->checksum = calculate_checksum(&send_buf[pos], msg_size);
-
-    pos += msg_size;
-
-    if (pos >= USB_TX_SOFT_LIMIT) {
-      write_func(send_buf, pos);
-      pos = 0;
+    pos += pack_can_frame(&send_buf[pos], address, bus, dat, len);
+
+    if (pos - chunk_start >= limit) {
+      send_chunks.push_back(pos);
+      chunk_start = pos;
     }
   }
+  if (pos > chunk_start) send_chunks.push_back(pos);
+  return pos;
+}
 
-  // send remaining packets
-  if (pos > 0) write_func(send_buf, pos);
+uint32_t Panda::pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list) {
+  return pack_can_frames(can_data_list, [](const cereal::CanData::Reader &c, uint32_t &address, uint8_t &bus, const uint8_t *&dat, size_t &len) {
+    auto d = c.getDat();
+    address = c.getAddress();
+    bus = c.getSrc();
+    dat = d.begin();
+    len = d.size();
+  });
 }
 
-void Panda::can_send(capnp::List<cereal::CanData>::Reader can_data_list) {
-  pack_can_buffer(can_data_list, [=](uint8_t* data, size_t size) {
-    handle->bulk_write(3, data, size, 5);
+uint32_t Panda::pack_can_buffer(const std::vector<can_frame> &frames) {
+  return pack_can_frames(frames, [](const can_frame &f, uint32_t &address, uint8_t &bus, const uint8_t *&dat, size_t &len) {
+    address = f.address;
+    bus = f.src;
+    dat = f.dat;
+    len = f.len;
   });
 }
 
+void Panda::write_can_buffer() {
+  uint32_t start = 0;
+  for (uint32_t end : send_chunks) {
+    handle->bulk_write(3, &send_buf[start], end - start, 5);
+    start = end;
+  }
+}
+
+void Panda::can_send(capnp::List<cereal::CanData>::Reader can_data_list) {
+  pack_can_buffer(can_data_list);
+  write_can_buffer();
+}
+
+void Panda::can_send(const std::vector<can_frame> &frames) {
+  pack_can_buffer(frames);
+  write_can_buffer();
+}
+
 bool Panda::can_receive(std::vector<can_frame>& out_vec) {
   // Check if enough space left in buffer to store RECV_SIZE data
   assert(receive_buffer_size + RECV_SIZE <= sizeof(receive_buffer));
@@ -262,6 +381,11 @@ bool Panda::can_receive(std::vector<can_frame>& out_vec) {
   if (recv == RECV_SIZE) {
     LOGW("Panda receive buffer full");
   }
+  if (recv > 0 && capture.is_open()) {
+    TraceRecord rec = {nanos_since_boot(), (uint32_t)recv};
+    capture.write((const char *)&rec, sizeof(rec));
+    capture.write((const char *)&receive_buffer[receive_buffer_size], recv);
+  }
   receive_buffer_size += recv;
 
   return (recv <= 0) ? true : unpack_can_buffer(receive_buffer, receive_buffer_size, out_vec);
@@ -271,9 +395,46 @@ void Panda::can_reset_communications() {
   handle->control_write(0xc0, 0, 0);
 }
 
+void Panda::set_can_timestamps(bool enabled) {
+  handle->control_write(0xc9, enabled, 0);
+}
+
+bool Panda::sync_clock(int samples) {
+  uint64_t best_rtt = UINT64_MAX, best_nanos = 0;
+  uint32_t best_us = 0;
+  for (int i = 0; i < samples; i++) {
+    uint8_t buf[4];
+    uint64_t t0 = nanos_since_boot();
+    int err = handle->control_read(0xa8, 0, 0, buf, sizeof(buf));
+    uint64_t t1 = nanos_since_boot();
+    if (err != sizeof(buf)) continue;
+
+    if (t1 - t0 < best_rtt) {
+      best_rtt = t1 - t0;
+      best_nanos = t0 + (t1 - t0) / 2;
+      memcpy(&best_us, buf, sizeof(best_us));
+    }
+  }
+  if (best_rtt == UINT64_MAX) return false;
+
+  std::lock_guard lk(clock_lock);
+  clock_synced = true;
+  clock_ref_us = best_us;
+  clock_ref_nanos = best_nanos;
+  return true;
+}
+
 bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_frame> &out_vec) {
   int pos = 0;
 
+  uint32_t ref_us;
+  uint64_t ref_nanos = 0;
+  {
+    std::lock_guard lk(clock_lock);
+    ref_us = clock_ref_us;
+    if (clock_synced) ref_nanos = clock_ref_nanos;
+  }
+
   while (pos <= size - sizeof(can_header)) {
     can_header header;
     memcpy(&header, &data[pos], sizeof(can_header));
@@ -284,8 +445,34 @@ bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_fra
       break;
     }
 
+    if (calculate_checksum(&data[pos], sizeof(can_header) + data_len) != 0) {
+      LOGE("Panda CAN checksum failed");
+      size = 0;
+      return false;
+    }
+
+    if (header.reserved) {
+      // timestamp marker for the next frame on this bus
+      if (data_len == 4) {
+        memcpy(&rx_ts_us[header.bus], &data[pos + sizeof(can_header)], 4);
+        rx_ts_valid[header.bus] = true;
+      }
+      pos += sizeof(can_header) + data_len;
+      continue;
+    }
+
     can_frame &canData = out_vec.emplace_back();
     canData.busTime = 0;
+    canData.rx_nanos = 0;
+    if (rx_ts_valid[header.bus]) {
+      const uint32_t ts = rx_ts_us[header.bus];
+      canData.busTime = ts;
+      if (ref_nanos != 0) {
+        // the timer wraps every ~71 minutes, deltas are fine within half of that
+        canData.rx_nanos = ref_nanos + (int64_t)(int32_t)(ts - ref_us) * 1000;
+      }
+      rx_ts_valid[header.bus] = false;
+    }
     canData.address = header.addr;
     canData.src = header.bus + bus_offset;
     if (header.rejected) {
@@ -295,13 +482,8 @@ bool Panda::unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_fra
       canData.src += CAN_RETURNED_BUS_OFFSET;
     }
 
-    if (calculate_checksum(&data[pos], sizeof(can_header) + data_len) != 0) {
-      LOGE("Panda CAN checksum failed");
-      size = 0;
-      return false;
-    }
-
-    canData.dat.assign((char *)&data[pos + sizeof(can_header)], data_len);
+    canData.len = data_len;
+    memcpy(canData.dat, &data[pos + sizeof(can_header)], data_len);
 
     pos += sizeof(can_header) + data_len;
   }
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <ctime>
-#include <functional>
+#include <fstream>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
@@ -15,10 +17,10 @@
 #include "panda/board/can_definitions.h"
 #include "selfdrive/boardd/panda_comms.h"
 
-#define USB_TX_SOFT_LIMIT   (0x100U)
 #define USBPACKET_MAX_SIZE  (0x40)
 
 #define RECV_SIZE (0x4000U)
+#define USB_ASYNC_READS 4
 
 #define CAN_REJECTED_BUS_OFFSET   0xC0U
 #define CAN_RETURNED_BUS_OFFSET 0x80U
@@ -34,11 +36,22 @@ struct __attribute__((packed)) can_header {
   uint8_t checksum : 8;
 };
 
+#define CAN_FRAME_MAX_LEN 64
+
+// fixed size so a reused std::vector<can_frame> receives without allocating
 struct can_frame {
   long address;
-  std::string dat;
   long busTime;
   long src;
+  uint8_t len;
+  uint8_t dat[CAN_FRAME_MAX_LEN];
+  uint64_t rx_nanos;  // panda receive time on the host clock, 0 without timestamps
+};
+
+// health and CAN health of every bus, as read in one go by get_telemetry
+struct PandaTelemetry {
+  health_t health;
+  std::array<can_health_t, PANDA_CAN_CNT> can_health;
 };
 
 
@@ -56,6 +69,7 @@ public:
   bool connected();
   bool comms_healthy();
   std::string hw_serial();
+  TransferStats take_transfer_stats();
 
   // Static functions
   static std::vector<std::string> list(bool usb_only=false);
@@ -71,6 +85,8 @@ public:
   void set_ir_pwr(uint16_t ir_pwr);
   std::optional<health_t> get_state();
   std::optional<can_health_t> get_can_state(uint16_t can_number);
+  std::optional<can_rx_stats_t> get_can_rx_stats(uint16_t can_number);
+  std::optional<PandaTelemetry> get_telemetry();
   void set_loopback(bool loopback);
   std::optional<std::vector<uint8_t>> get_firmware_version();
   bool up_to_date();
@@ -81,18 +97,49 @@ public:
   void set_can_speed_kbps(uint16_t bus, uint16_t speed);
   void set_data_speed_kbps(uint16_t bus, uint16_t speed);
   void set_canfd_non_iso(uint16_t bus, bool non_iso);
+  void set_can_hw_filter(uint16_t bus, const std::vector<uint16_t> &addrs);
   void can_send(capnp::List<cereal::CanData>::Reader can_data_list);
+  void can_send(const std::vector<can_frame> &frames);
   bool can_receive(std::vector<can_frame>& out_vec);
   void can_reset_communications();
 
+  // Receive timestamps. With them enabled the panda stamps every frame with its
+  // microsecond timer, and sync_clock estimates the offset to nanos_since_boot
+  // from the ping with the lowest round trip. Call it about once a second to
+  // follow clock drift.
+  void set_can_timestamps(bool enabled);
+  bool sync_clock(int samples = 8);
+
 protected:
   // for unit tests
   uint8_t receive_buffer[RECV_SIZE + sizeof(can_header) + 64];
   uint32_t receive_buffer_size = 0;
 
   Panda(uint32_t bus_offset) : bus_offset(bus_offset) {}
-  void pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list,
-                         std::function<void(uint8_t *, size_t)> write_func);
+  // Packs the frames for this panda into send_buf in wire format, send_chunks gets the end
+  // of every bulk write they take. Returns the packed size
+  uint32_t pack_can_buffer(const capnp::List<cereal::CanData>::Reader &can_data_list);
+  uint32_t pack_can_buffer(const std::vector<can_frame> &frames);
+  template <class Frames, class Fields>
+  uint32_t pack_can_frames(const Frames &frames, Fields fields);
+  void write_can_buffer();
+  uint32_t pack_can_frame(uint8_t *buf, uint32_t address, uint8_t bus, const uint8_t *dat, size_t len);
+  // only grows, can_send is called from one thread
+  std::vector<uint8_t> send_buf;
+  std::vector<uint32_t> send_chunks;
   bool unpack_can_buffer(uint8_t *data, uint32_t &size, std::vector<can_frame> &out_vec);
+
+  std::ofstream capture;  // BOARDD_CAPTURE
+  // cleared once the firmware turns out not to support the batched health read
+  bool telemetry_batched = true;
+
+  // last sync point, panda timer and host time taken at the same instant
+  std::mutex clock_lock;
+  bool clock_synced = false;
+  uint32_t clock_ref_us = 0;
+  uint64_t clock_ref_nanos = 0;
+  // timestamp from the last marker per bus, applies to the next frame on that bus
+  uint32_t rx_ts_us[PANDA_BUS_CNT] = {};
+  bool rx_ts_valid[PANDA_BUS_CNT] = {};
   uint8_t calculate_checksum(uint8_t *data, uint32_t len);
 };
@@ -1,9 +1,13 @@
 #include "selfdrive/boardd/panda.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <stdexcept>
 
 #include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
 
 static int init_usb_ctx(libusb_context **context) {
   assert(context != nullptr);
@@ -83,6 +87,8 @@ PandaUsbHandle::~PandaUsbHandle() {
 }
 
 void PandaUsbHandle::cleanup() {
+  stop_async_read();
+
   if (dev_handle) {
     libusb_release_interface(dev_handle, 0);
     libusb_close(dev_handle);
@@ -187,7 +193,7 @@ int PandaUsbHandle::bulk_write(unsigned char endpoint, unsigned char* data, int
     return 0;
   }
 
-  std::lock_guard lk(hw_lock);
+  std::lock_guard lk(bulk_out_lock);
   do {
     // Try sending can messages. If the receive buffer on the panda is full it will NAK
     // and libusb will try again. After 5ms, it will time out. We will drop the messages.
@@ -212,7 +218,11 @@ int PandaUsbHandle::bulk_read(unsigned char endpoint, unsigned char* data, int l
     return 0;
   }
 
-  std::lock_guard lk(hw_lock);
+  if (endpoint == async_endpoint && !async_reads.empty()) {
+    return async_bulk_read(data, length, timeout);
+  }
+
+  std::lock_guard lk(bulk_in_lock);
 
   do {
     err = libusb_bulk_transfer(dev_handle, endpoint, data, length, &transferred, timeout);
@@ -230,3 +240,152 @@ int PandaUsbHandle::bulk_read(unsigned char endpoint, unsigned char* data, int l
 
   return transferred;
 }
+
+bool PandaUsbHandle::start_async_read(unsigned char endpoint, int count, int length) {
+  {
+    std::lock_guard lk(async_lock);
+    assert(async_reads.empty() && count > 0);
+    async_endpoint = endpoint;
+    async_next = 0;
+    async_reads.resize(count);
+    for (auto &r : async_reads) {
+      r.handle = this;
+      r.buf.resize(length);
+      r.transfer = libusb_alloc_transfer(0);
+    }
+  }
+
+  bool ok = true;
+  {
+    std::lock_guard lk(async_lock);
+    for (auto &r : async_reads) {
+      ok = ok && r.transfer != nullptr && submit_async_read(r);
+    }
+  }
+  if (!ok) {
+    LOGE("failed to start async usb reads");
+    stop_async_read();
+    return false;
+  }
+
+  stop_events = false;
+  event_thread = std::thread([this]() {
+    util::set_thread_name("boardd_usb_events");
+    while (!stop_events) {
+      struct timeval tv = {0, 100000};
+      libusb_handle_events_timeout_completed(ctx, &tv, nullptr);
+    }
+  });
+  return true;
+}
+
+// must hold async_lock
+bool PandaUsbHandle::submit_async_read(AsyncRead &r) {
+  libusb_fill_bulk_transfer(r.transfer, dev_handle, async_endpoint, r.buf.data(), r.buf.size(), async_read_callback, &r, 0);
+  r.done = false;
+  r.submit_nanos = nanos_since_boot();
+  int err = libusb_submit_transfer(r.transfer);
+  r.submitted = (err == 0);
+  if (err != 0) {
+    handle_usb_issue(err, __func__);
+    comms_healthy = false;
+  }
+  return r.submitted;
+}
+
+void LIBUSB_CALL PandaUsbHandle::async_read_callback(libusb_transfer *transfer) {
+  AsyncRead *r = (AsyncRead *)transfer->user_data;
+  PandaUsbHandle *h = r->handle;
+  {
+    std::lock_guard lk(h->async_lock);
+    r->submitted = false;
+    r->done = true;
+    r->complete_nanos = nanos_since_boot();
+  }
+  h->async_cv.notify_all();
+}
+
+int PandaUsbHandle::async_bulk_read(unsigned char *data, int length, unsigned int timeout) {
+  std::unique_lock lk(async_lock);
+  // like the synchronous path a zero timeout means wait for the next transfer,
+  // but never block forever on a wedged device
+  const auto wait = std::chrono::milliseconds(timeout > 0 ? timeout : 100);
+  async_cv.wait_for(lk, wait, [&] { return async_reads[async_next].done || !connected; });
+
+  int total = 0;
+  const uint64_t now = nanos_since_boot();
+  while (connected) {
+    AsyncRead &r = async_reads[async_next];
+    if (!r.done) break;
+
+    libusb_transfer *t = r.transfer;
+    if (t->status == LIBUSB_TRANSFER_COMPLETED) {
+      if (total + t->actual_length > length) break;  // leave it for the next call
+
+      memcpy(data + total, r.buf.data(), t->actual_length);
+      total += t->actual_length;
+
+      const double transfer_ms = (r.complete_nanos - r.submit_nanos) / 1e6;
+      const double queued_ms = (now - r.complete_nanos) / 1e6;
+      stats.count++;
+      stats.transfer_ms_sum += transfer_ms;
+      stats.transfer_ms_max = std::max(stats.transfer_ms_max, transfer_ms);
+      stats.queued_ms_sum += queued_ms;
+      stats.queued_ms_max = std::max(stats.queued_ms_max, queued_ms);
+    } else if (t->status == LIBUSB_TRANSFER_OVERFLOW) {
+      comms_healthy = false;
+      LOGE_100("overflow got 0x%x", t->actual_length);
+    } else if (t->status == LIBUSB_TRANSFER_NO_DEVICE) {
+      LOGE("lost connection");
+      connected = false;
+      break;
+    } else {
+      LOGE_100("usb async read failed with status %d", t->status);
+    }
+
+    async_next = (async_next + 1) % async_reads.size();
+    if (!submit_async_read(r)) break;
+  }
+  return total;
+}
+
+void PandaUsbHandle::stop_async_read() {
+  if (event_thread.joinable()) {
+    stop_events = true;
+    event_thread.join();
+  }
+
+  std::unique_lock lk(async_lock);
+  if (async_reads.empty()) return;
+
+  for (auto &r : async_reads) {
+    if (r.submitted) {
+      libusb_cancel_transfer(r.transfer);
+    }
+  }
+
+  // run the callbacks of the cancelled transfers before freeing them
+  auto any_submitted = [&]() {
+    return std::any_of(async_reads.begin(), async_reads.end(), [](auto &r) { return r.submitted; });
+  };
+  for (int i = 0; i < 100 && any_submitted(); i++) {
+    lk.unlock();
+    struct timeval tv = {0, 10000};
+    libusb_handle_events_timeout_completed(ctx, &tv, nullptr);
+    lk.lock();
+  }
+
+  for (auto &r : async_reads) {
+    if (r.transfer && !r.submitted) {
+      libusb_free_transfer(r.transfer);
+    }
+  }
+  async_reads.clear();
+}
+
+TransferStats PandaUsbHandle::take_transfer_stats() {
+  std::lock_guard lk(async_lock);
+  TransferStats ret = stats;
+  stats = {};
+  return ret;
+}
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #ifndef __APPLE__
@@ -15,8 +17,16 @@
 
 #define TIMEOUT 0
 #define SPI_BUF_SIZE 2048
+#define USB_TX_SOFT_LIMIT (0x100U)
 
 
+// latency of queued bulk IN transfers, since the last reset
+struct TransferStats {
+  uint64_t count = 0;
+  double transfer_ms_sum = 0, transfer_ms_max = 0;  // submit to completion
+  double queued_ms_sum = 0, queued_ms_max = 0;      // completion until read by boardd
+};
+
 // comms base class
 class PandaCommsHandle {
 public:
@@ -34,6 +44,12 @@ public:
   virtual int control_read(uint8_t request, uint16_t param1, uint16_t param2, unsigned char *data, uint16_t length, unsigned int timeout=TIMEOUT) = 0;
   virtual int bulk_write(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT) = 0;
   virtual int bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT) = 0;
+
+  // returns the stats and starts a new window, all zero for handles without async reads
+  virtual TransferStats take_transfer_stats() { return {}; }
+  // how many bytes of CAN frames one bulk write should carry, a write ends at the first
+  // frame boundary past it. On USB a write that times out drops the rest of it
+  virtual uint32_t can_write_limit() { return USB_TX_SOFT_LIMIT; }
 };
 
 class PandaUsbHandle : public PandaCommsHandle {
@@ -46,13 +62,88 @@ public:
   int bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
   void cleanup();
 
+  // Keeps count IN transfers of length bytes queued on endpoint. bulk_read on that
+  // endpoint then returns data from completed transfers in order instead of
+  // issuing a synchronous transfer.
+  bool start_async_read(unsigned char endpoint, int count, int length);
+  TransferStats take_transfer_stats();
+
   static std::vector<std::string> list();
 
 private:
+  struct AsyncRead {
+    PandaUsbHandle *handle;
+    libusb_transfer *transfer = nullptr;
+    std::vector<uint8_t> buf;
+    uint64_t submit_nanos = 0;
+    uint64_t complete_nanos = 0;
+    bool done = false;
+    bool submitted = false;
+  };
+
   libusb_context *ctx = NULL;
   libusb_device_handle *dev_handle = NULL;
+  // control transfers and each bulk direction are locked separately, so health
+  // polling doesn't stall the CAN pipe
   std::recursive_mutex hw_lock;
+  std::mutex bulk_in_lock, bulk_out_lock;
   void handle_usb_issue(int err, const char func[]);
+
+  unsigned char async_endpoint = 0;
+  std::vector<AsyncRead> async_reads;
+  size_t async_next = 0;  // oldest outstanding transfer, completions arrive in submission order
+  std::mutex async_lock;
+  std::condition_variable async_cv;
+  std::thread event_thread;
+  std::atomic<bool> stop_events = false;
+  TransferStats stats;
+
+  static void LIBUSB_CALL async_read_callback(libusb_transfer *transfer);
+  bool submit_async_read(AsyncRead &r);
+  int async_bulk_read(unsigned char *data, int length, unsigned int timeout);
+  void stop_async_read();
+};
+
+// Bulk IN capture written with BOARDD_CAPTURE, a sequence of TraceRecord
+// headers each followed by length bytes of panda CAN wire data
+struct __attribute__((packed)) TraceRecord {
+  uint64_t nanos;
+  uint32_t length;
+};
+
+// Serves bulk_read from a recorded trace instead of hardware, so the receive,
+// unpack and publish stages of boardd can be profiled on a PC. Takes a capture
+// or an uncompressed rlog, whose can events are packed back into wire format.
+// Data is handed out at the recorded rate times speed, or as fast as it's read
+// with speed 0. Control transfers succeed and read zeros, writes are dropped.
+// Without loop the handle disconnects at the end of the trace, so boardd exits.
+class PandaReplayHandle : public PandaCommsHandle {
+public:
+  PandaReplayHandle(std::string path, double speed = 1.0, bool loop = false);
+  int control_write(uint8_t request, uint16_t param1, uint16_t param2, unsigned int timeout=TIMEOUT);
+  int control_read(uint8_t request, uint16_t param1, uint16_t param2, unsigned char *data, uint16_t length, unsigned int timeout=TIMEOUT);
+  int bulk_write(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
+  int bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
+  void cleanup();
+  // seconds of CAN from the first chunk to the last
+  double duration() const { return chunks.empty() ? 0 : chunks.back().nanos * 1e-9; }
+
+private:
+  struct Chunk {
+    uint64_t nanos;  // relative to the first chunk
+    std::vector<uint8_t> data;
+  };
+
+  bool load_trace(const std::string &data);
+  bool load_rlog(const std::string &data);
+
+  std::vector<Chunk> chunks;
+  size_t next_chunk = 0;
+  size_t chunk_pos = 0;  // bytes of chunks[next_chunk] already returned
+  uint64_t start_nanos = 0;
+  double speed;
+  bool loop;
+  std::mutex lock;
 };
 
 #ifndef __APPLE__
@@ -65,15 +156,29 @@ public:
   int bulk_write(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
   int bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout=TIMEOUT);
   void cleanup();
+  // transfers are split into SPI_XFER_SIZE pieces anyway, this only keeps lengths in 16 bits
+  uint32_t can_write_limit() { return 0x4000; }
 
   static std::vector<std::string> list();
 
 private:
   int spi_fd = -1;
-  uint8_t tx_buf[SPI_BUF_SIZE];
-  uint8_t rx_buf[SPI_BUF_SIZE];
+  // page aligned, so spidev's DMA mapping doesn't straddle extra pages
+  alignas(4096) uint8_t tx_buf[SPI_BUF_SIZE];
+  alignas(4096) uint8_t rx_buf[SPI_BUF_SIZE];
   inline static std::recursive_mutex hw_lock;
 
+  // Protocol version 3+ panda firmware takes CAN writes on endpoint 4 and
+  // returns pending CAN RX data in the same transaction, this is kept in
+  // rx_stash until the next bulk_read.
+  int protocol_version = 0;
+  bool batched = false;
+  std::mutex batch_lock;
+  std::vector<uint8_t> rx_stash;
+  int get_protocol_version();
+  int batched_write(uint8_t *data, int length, unsigned int timeout);
+  int batched_read(uint8_t *data, int length, unsigned int timeout);
+
   int wait_for_ack(uint8_t ack, uint8_t tx, unsigned int timeout, unsigned int length);
   int bulk_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx_len, uint8_t *rx_data, uint16_t rx_len, unsigned int timeout);
   int spi_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx_len, uint8_t *rx_data, uint16_t max_rx_len, unsigned int timeout);
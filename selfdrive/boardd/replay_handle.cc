@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <capnp/serialize.h>
+
+#include "cereal/gen/cpp/log.capnp.h"
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/boardd/panda.h"
+#include "selfdrive/boardd/panda_comms.h"
+
+// dlc for an exact frame length, -1 if no dlc encodes it
+static int exact_dlc(size_t len) {
+  for (int i = 0; i < 16; i++) {
+    if (dlc_to_len[i] == len) return i;
+  }
+  return -1;
+}
+
+static uint8_t wire_checksum(const uint8_t *data, size_t len) {
+  uint8_t checksum = 0U;
+  for (size_t i = 0U; i < len; i++) {
+    checksum ^= data[i];
+  }
+  return checksum;
+}
+
+PandaReplayHandle::PandaReplayHandle(std::string path, double speed, bool loop) : PandaCommsHandle(path), speed(speed), loop(loop) {
+  std::string data = util::read_file(path);
+  if (data.empty()) {
+    throw std::runtime_error("PandaReplayHandle: can't read " + path);
+  }
+
+  // rlogs are told apart by name, everything else is read as a BOARDD_CAPTURE trace
+  bool ok = util::ends_with(path, "rlog") ? load_rlog(data) : load_trace(data);
+  if (!ok || chunks.empty()) {
+    throw std::runtime_error("PandaReplayHandle: no CAN data in " + path);
+  }
+
+  hw_serial = "replay";
+  LOGW("replaying %zu chunks from %s at %.1fx", chunks.size(), path.c_str(), speed);
+}
+
+bool PandaReplayHandle::load_trace(const std::string &data) {
+  size_t pos = 0;
+  uint64_t first_nanos = 0;
+  while (pos + sizeof(TraceRecord) <= data.size()) {
+    TraceRecord rec;
+    memcpy(&rec, &data[pos], sizeof(rec));
+    pos += sizeof(rec);
+    if (pos + rec.length > data.size()) {
+      LOGW("replay trace truncated");
+      break;
+    }
+
+    if (rec.length == 0) continue;
+    if (chunks.empty()) first_nanos = rec.nanos;
+    auto &c = chunks.emplace_back();
+    c.nanos = rec.nanos - first_nanos;
+    c.data.assign(data.begin() + pos, data.begin() + pos + rec.length);
+    pos += rec.length;
+  }
+  return true;
+}
+
+bool PandaReplayHandle::load_rlog(const std::string &data) {
+  kj::Array<capnp::word> words = kj::heapArray<capnp::word>(data.size() / sizeof(capnp::word));
+  memcpy(words.begin(), data.data(), words.size() * sizeof(capnp::word));
+
+  kj::ArrayPtr<const capnp::word> remaining = words;
+  uint64_t first_nanos = 0;
+  try {
+    while (remaining.size() > 0) {
+      capnp::FlatArrayMessageReader msg(remaining);
+      remaining = kj::arrayPtr(msg.getEnd(), remaining.end());
+
+      cereal::Event::Reader event = msg.getRoot<cereal::Event>();
+      if (!event.isCan()) continue;
+
+      Chunk c;
+      if (first_nanos == 0) first_nanos = event.getLogMonoTime();
+      c.nanos = event.getLogMonoTime() - first_nanos;
+      for (auto cmsg : event.getCan()) {
+        // only what the first panda received, tx echoes and rejects are dropped
+        auto dat = cmsg.getDat();
+        int dlc = exact_dlc(dat.size());
+        if (cmsg.getSrc() >= PANDA_BUS_CNT || dlc < 0) continue;
+
+        can_header header = {};
+        header.addr = cmsg.getAddress();
+        header.extended = (cmsg.getAddress() >= 0x800) ? 1 : 0;
+        header.data_len_code = dlc;
+        header.bus = cmsg.getSrc();
+
+        size_t pos = c.data.size();
+        c.data.resize(pos + sizeof(header) + dat.size());
+        memcpy(&c.data[pos], &header, sizeof(header));
+        memcpy(&c.data[pos + sizeof(header)], dat.begin(), dat.size());
+        ((can_header *)&c.data[pos])->checksum = wire_checksum(&c.data[pos], sizeof(header) + dat.size());
+      }
+      if (!c.data.empty()) {
+        chunks.push_back(std::move(c));
+      }
+    }
+  } catch (const kj::Exception &e) {
+    LOGW("replay rlog parse stopped: %s", e.getDescription().cStr());
+  }
+  return true;
+}
+
+void PandaReplayHandle::cleanup() {
+  connected = false;
+}
+
+int PandaReplayHandle::control_write(uint8_t request, uint16_t param1, uint16_t param2, unsigned int timeout) {
+  return 0;
+}
+
+int PandaReplayHandle::control_read(uint8_t request, uint16_t param1, uint16_t param2, unsigned char *data, uint16_t length, unsigned int timeout) {
+  memset(data, 0, length);
+  return length;
+}
+
+int PandaReplayHandle::bulk_write(unsigned char endpoint, unsigned char *data, int length, unsigned int timeout) {
+  return length;
+}
+
+int PandaReplayHandle::bulk_read(unsigned char endpoint, unsigned char *data, int length, unsigned int timeout) {
+  std::lock_guard lk(lock);
+
+  const uint64_t now = nanos_since_boot();
+  if (start_nanos == 0) start_nanos = now;
+
+  int written = 0;
+  while (written < length) {
+    if (next_chunk == chunks.size()) {
+      if (!loop) {
+        if (written == 0) connected = false;
+        break;
+      }
+      next_chunk = 0;
+      start_nanos = now;
+    }
+
+    const Chunk &c = chunks[next_chunk];
+    if (speed > 0 && (now - start_nanos) < (uint64_t)(c.nanos / speed)) {
+      break;
+    }
+
+    // a chunk can be split across reads, unpack_can_buffer keeps partial frames
+    size_t n = std::min(c.data.size() - chunk_pos, (size_t)(length - written));
+    memcpy(&data[written], &c.data[chunk_pos], n);
+    written += n;
+    chunk_pos += n;
+    if (chunk_pos == c.data.size()) {
+      next_chunk++;
+      chunk_pos = 0;
+    }
+  }
+  return written;
+}
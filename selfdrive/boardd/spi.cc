@@ -38,6 +38,12 @@ struct __attribute__((packed)) spi_header {
 const unsigned int SPI_ACK_TIMEOUT = 500; // milliseconds
 const std::string SPI_DEVICE = "/dev/spidev0.0";
 
+const uint8_t SPI_BATCH_ENDPOINT = 4;
+const int SPI_BATCH_PROTOCOL_VERSION = 3;
+const int SPI_XFER_SIZE = SPI_BUF_SIZE - 0x40;
+// at most this much RX data is buffered from writes before reads catch up
+const size_t SPI_RX_STASH_SIZE = 0x4000;
+
 class LockEx {
 public:
   LockEx(int fd, std::recursive_mutex &m) : fd(fd), m(m) {
@@ -114,6 +120,10 @@ PandaSpiHandle::PandaSpiHandle(std::string serial) : PandaCommsHandle(serial) {
     goto fail;
   }
 
+  protocol_version = get_protocol_version();
+  batched = protocol_version >= SPI_BATCH_PROTOCOL_VERSION && !getenv("BOARDD_SPI_NO_BATCH");
+  LOGW("SPI protocol version %d, batched CAN %s", protocol_version, batched ? "enabled" : "disabled");
+
   return;
 
 fail:
@@ -156,14 +166,118 @@ int PandaSpiHandle::control_read(uint8_t request, uint16_t param1, uint16_t para
 }
 
 int PandaSpiHandle::bulk_write(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout) {
+  if (batched && endpoint == 3) {
+    return batched_write(data, length, timeout);
+  }
   return bulk_transfer(endpoint, data, length, NULL, 0, timeout);
 }
 int PandaSpiHandle::bulk_read(unsigned char endpoint, unsigned char* data, int length, unsigned int timeout) {
+  if (batched && endpoint == 0x81) {
+    return batched_read(data, length, timeout);
+  }
   return bulk_transfer(endpoint, NULL, 0, data, length, timeout);
 }
 
+int PandaSpiHandle::batched_write(uint8_t *data, int length, unsigned int timeout) {
+  std::lock_guard lk(batch_lock);
+
+  int sent = 0;
+  while (sent < length) {
+    const int len = std::min(SPI_XFER_SIZE, length - sent);
+    // pick up RX data on the way, as long as the stash has room
+    const size_t rx_len = std::min((size_t)SPI_XFER_SIZE, SPI_RX_STASH_SIZE - rx_stash.size());
+    const size_t stash_size = rx_stash.size();
+    rx_stash.resize(stash_size + rx_len);
+
+    int d = spi_transfer_retry(SPI_BATCH_ENDPOINT, data + sent, len, rx_stash.data() + stash_size, rx_len, timeout);
+    rx_stash.resize(stash_size + std::max(d, 0));
+    if (d < 0) {
+      LOGE("SPI: batched write failed with %d", d);
+      comms_healthy = false;
+      return d;
+    }
+    sent += len;
+  }
+  return sent;
+}
+
+int PandaSpiHandle::batched_read(uint8_t *data, int length, unsigned int timeout) {
+  std::lock_guard lk(batch_lock);
+
+  // data picked up by writes came off the panda first
+  int ret = std::min((int)rx_stash.size(), length);
+  memcpy(data, rx_stash.data(), ret);
+  rx_stash.erase(rx_stash.begin(), rx_stash.begin() + ret);
+  if (!rx_stash.empty() || ret == length) {
+    return ret;
+  }
+
+  int d = bulk_transfer(0x81, NULL, 0, data + ret, length - ret, timeout);
+  return d < 0 ? d : ret + d;
+}
+
+// CRC8 as computed by the panda over its version packet, last byte first
+static uint8_t version_crc(const uint8_t *dat, int len) {
+  uint8_t crc = 0xFFU;
+  for (int i = len - 1; i >= 0; i--) {
+    crc ^= dat[i];
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 0x80U) ? (uint8_t)((crc << 1) ^ 0xD5U) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+int PandaSpiHandle::get_protocol_version() {
+  LockEx lock(spi_fd, hw_lock);
+
+  // the panda echoes VERSION, then a 2 byte data length, the data and a CRC8.
+  // the protocol version is the last data byte
+  const int header_len = 9;
+  spi_ioc_transfer transfer = {
+    .tx_buf = (uint64_t)tx_buf,
+    .rx_buf = (uint64_t)rx_buf,
+    .len = 7
+  };
+  memcpy(tx_buf, "VERSION", 7);
+  if (util::safe_ioctl(spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
+    return 0;
+  }
+
+  memset(tx_buf, 0, SPI_BUF_SIZE);
+  transfer.len = header_len;
+  const double start_millis = millis_since_boot();
+  while (true) {
+    if (util::safe_ioctl(spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
+      return 0;
+    }
+    if (memcmp(rx_buf, "VERSION", 7) == 0) {
+      break;
+    }
+    if (millis_since_boot() - start_millis > SPI_ACK_TIMEOUT) {
+      LOGW("SPI: no VERSION response, assuming protocol version 2");
+      return 2;
+    }
+  }
+
+  const uint16_t data_len = rx_buf[7] | (rx_buf[8] << 8);
+  if (data_len == 0 || data_len + header_len + 1 > SPI_BUF_SIZE) {
+    return 0;
+  }
+  transfer.len = data_len + 1;
+  transfer.rx_buf = (uint64_t)(rx_buf + header_len);
+  if (util::safe_ioctl(spi_fd, SPI_IOC_MESSAGE(1), &transfer) < 0) {
+    return 0;
+  }
+  if (version_crc(rx_buf, header_len + data_len) != rx_buf[header_len + data_len]) {
+    LOGE("SPI: bad VERSION checksum");
+    return 0;
+  }
+  return rx_buf[header_len + data_len - 1];
+}
+
 int PandaSpiHandle::bulk_transfer(uint8_t endpoint, uint8_t *tx_data, uint16_t tx_len, uint8_t *rx_data, uint16_t rx_len, unsigned int timeout) {
-  const int xfer_size = SPI_BUF_SIZE - 0x40;
+  const int xfer_size = SPI_XFER_SIZE;
 
   int ret = 0;
   uint16_t length = (tx_data != NULL) ? tx_len : rx_len;
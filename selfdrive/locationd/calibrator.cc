@@ -0,0 +1,182 @@
+#include "selfdrive/locationd/calibrator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/transformations/orientation.hpp"
+
+const double MIN_SPEED_FILTER = 15 * 0.44704;  // 15 mph
+const double MAX_VEL_ANGLE_STD = DEG2RAD(0.25);
+const double MAX_YAW_RATE_FILTER = DEG2RAD(2.0);  // per second
+const double MAX_HEIGHT_STD = std::exp(-3.5);
+
+const int SMOOTH_CYCLES = 10;
+const double MAX_ALLOWED_YAW_SPREAD = DEG2RAD(2.0);
+const double MAX_ALLOWED_PITCH_SPREAD = DEG2RAD(4.0);
+const Eigen::Vector3d RPY_INIT = Eigen::Vector3d::Zero();
+const Eigen::Vector3d WIDE_FROM_DEVICE_EULER_INIT = Eigen::Vector3d::Zero();
+const double HEIGHT_INIT = 1.22;
+
+// These values are needed to accommodate the model frame in the narrow cam of the C3
+const double PITCH_LIMITS[] = {-0.09074112085129739, 0.17};
+const double YAW_LIMITS[] = {-0.06912048084718224, 0.06912048084718235};
+
+static bool is_calibration_valid(const Eigen::Vector3d &rpy) {
+  return (PITCH_LIMITS[0] < rpy[1] && rpy[1] < PITCH_LIMITS[1]) && (YAW_LIMITS[0] < rpy[2] && rpy[2] < YAW_LIMITS[1]);
+}
+
+static Eigen::Vector3d sanity_clip(Eigen::Vector3d rpy) {
+  if (rpy.hasNaN()) {
+    rpy = RPY_INIT;
+  }
+  return {rpy[0],
+          std::clamp(rpy[1], PITCH_LIMITS[0] - .005, PITCH_LIMITS[1] + .005),
+          std::clamp(rpy[2], YAW_LIMITS[0] - .005, YAW_LIMITS[1] + .005)};
+}
+
+template <typename T>
+static T moving_avg_with_linear_decay(const T &prev_mean, const T &new_val, int idx, double block_size) {
+  return (double(idx) * prev_mean + (block_size - idx) * new_val) / block_size;
+}
+
+Calibrator::Calibrator() {
+  this->reset(RPY_INIT, 0, WIDE_FROM_DEVICE_EULER_INIT, HEIGHT_INIT);
+  this->update_status();
+}
+
+void Calibrator::reset(const Eigen::Vector3d &rpy_init, int valid_blocks_init, const Eigen::Vector3d &wide_from_device_euler_init,
+                       double height_init, const Eigen::Vector3d *smooth_from) {
+  this->rpy = rpy_init.allFinite() ? rpy_init : RPY_INIT;
+  this->height = std::isfinite(height_init) ? height_init : HEIGHT_INIT;
+  this->wide_from_device_euler = wide_from_device_euler_init.allFinite() ? wide_from_device_euler_init : WIDE_FROM_DEVICE_EULER_INIT;
+  this->valid_blocks = std::max(valid_blocks_init, 0);
+
+  this->rpys.fill(this->rpy);
+  this->wide_from_device_eulers.fill(this->wide_from_device_euler);
+  this->heights.fill(this->height);
+  this->stats_stale = true;
+
+  this->idx = 0;
+  this->block_idx = 0;
+
+  if (smooth_from == nullptr) {
+    this->old_rpy = RPY_INIT;
+    this->old_rpy_weight = 0.0;
+  } else {
+    this->old_rpy = *smooth_from;
+    this->old_rpy_weight = 1.0;
+  }
+}
+
+void Calibrator::update_block_stats() {
+  // exclude current block_idx from validity window
+  int n = 0;
+  Eigen::Vector3d sum_rpy = Eigen::Vector3d::Zero(), sum_wide = Eigen::Vector3d::Zero();
+  Eigen::Vector3d max_rpy = Eigen::Vector3d::Constant(-INFINITY), min_rpy = Eigen::Vector3d::Constant(INFINITY);
+  double sum_height = 0.0;
+  for (int i = 0; i < std::min(this->valid_blocks, INPUTS_WANTED); i++) {
+    if (i == this->block_idx) continue;
+    sum_rpy += this->rpys[i];
+    sum_wide += this->wide_from_device_eulers[i];
+    sum_height += this->heights[i];
+    max_rpy = max_rpy.cwiseMax(this->rpys[i]);
+    min_rpy = min_rpy.cwiseMin(this->rpys[i]);
+    n++;
+  }
+
+  this->stats_valid = n > 0;
+  if (this->stats_valid) {
+    this->mean_rpy = sum_rpy / n;
+    this->mean_wide_from_device_euler = sum_wide / n;
+    this->mean_height = sum_height / n;
+    this->spread_rpy = (max_rpy - min_rpy).cwiseAbs();
+  }
+  this->stats_stale = false;
+}
+
+void Calibrator::update_status() {
+  if (this->stats_stale) {
+    this->update_block_stats();
+  }
+  if (this->stats_valid) {
+    this->wide_from_device_euler = this->mean_wide_from_device_euler;
+    this->height = this->mean_height;
+    this->rpy = this->mean_rpy;
+    this->calib_spread = this->spread_rpy;
+  } else {
+    this->calib_spread = Eigen::Vector3d::Zero();
+  }
+
+  if (this->valid_blocks < INPUTS_NEEDED) {
+    if (this->cal_status != RECALIBRATING) {
+      this->cal_status = UNCALIBRATED;
+    }
+  } else if (is_calibration_valid(this->rpy)) {
+    this->cal_status = CALIBRATED;
+  } else {
+    this->cal_status = INVALID;
+  }
+
+  // If spread is too high, assume mounting was changed and reset to last block.
+  // Make the transition smooth. Abrupt transitions are not good for feedback loop through supercombo model.
+  // TODO: add height spread check with smooth transition too
+  bool spread_too_high = this->calib_spread[1] > MAX_ALLOWED_PITCH_SPREAD || this->calib_spread[2] > MAX_ALLOWED_YAW_SPREAD;
+  if (spread_too_high && this->cal_status == CALIBRATED) {
+    Eigen::Vector3d last_block_rpy = this->rpys[(this->block_idx + INPUTS_WANTED - 1) % INPUTS_WANTED];
+    Eigen::Vector3d smooth_from = this->rpy;
+    this->reset(last_block_rpy, 1, WIDE_FROM_DEVICE_EULER_INIT, HEIGHT_INIT, &smooth_from);
+    this->cal_status = RECALIBRATING;
+  }
+}
+
+bool Calibrator::write_this_cycle() const {
+  return (this->idx == 0) && (this->block_idx % (INPUTS_WANTED / 5) == 5);
+}
+
+Eigen::Vector3d Calibrator::get_smooth_rpy() const {
+  if (this->old_rpy_weight > 0) {
+    return this->old_rpy_weight * this->old_rpy + (1.0 - this->old_rpy_weight) * this->rpy;
+  }
+  return this->rpy;
+}
+
+int Calibrator::get_cal_perc() const {
+  return std::min(100 * (this->valid_blocks * BLOCK_SIZE + this->idx) / (INPUTS_NEEDED * BLOCK_SIZE), 100);
+}
+
+bool Calibrator::handle_cam_odom(double v_ego, const double trans[3], const double rot[3], const double trans_std[3],
+                                 const double *new_wide_from_device_euler, const double *road_transform_trans,
+                                 const double *road_transform_trans_std, Eigen::Vector3d &new_rpy) {
+  this->old_rpy_weight = std::max(0.0, this->old_rpy_weight - 1.0 / SMOOTH_CYCLES);
+
+  bool straight_and_fast = (v_ego > MIN_SPEED_FILTER) && (trans[0] > MIN_SPEED_FILTER) && (std::abs(rot[2]) < MAX_YAW_RATE_FILTER);
+  bool rpy_certain = std::atan2(trans_std[1], trans[0]) < MAX_VEL_ANGLE_STD;
+  bool height_certain = road_transform_trans_std == nullptr || road_transform_trans_std[2] < MAX_HEIGHT_STD;
+
+  bool certain_if_calib = (rpy_certain && height_certain) || (this->valid_blocks < INPUTS_NEEDED);
+  if (!(straight_and_fast && certain_if_calib)) {
+    return false;
+  }
+
+  Eigen::Vector3d observed_rpy(0, -std::atan2(trans[2], trans[0]), std::atan2(trans[1], trans[0]));
+  new_rpy = sanity_clip(rot2euler(euler2rot(this->get_smooth_rpy()) * euler2rot(observed_rpy)));
+
+  Eigen::Vector3d wide = new_wide_from_device_euler ? Eigen::Vector3d(new_wide_from_device_euler) : WIDE_FROM_DEVICE_EULER_INIT;
+  double new_height = road_transform_trans ? road_transform_trans[2] : HEIGHT_INIT;
+
+  this->rpys[this->block_idx] = moving_avg_with_linear_decay(this->rpys[this->block_idx], new_rpy, this->idx, BLOCK_SIZE);
+  this->wide_from_device_eulers[this->block_idx] = moving_avg_with_linear_decay(this->wide_from_device_eulers[this->block_idx],
+                                                                                 wide, this->idx, BLOCK_SIZE);
+  this->heights[this->block_idx] = moving_avg_with_linear_decay(this->heights[this->block_idx], new_height, this->idx, BLOCK_SIZE);
+
+  this->idx = (this->idx + 1) % BLOCK_SIZE;
+  if (this->idx == 0) {
+    this->block_idx += 1;
+    this->valid_blocks = std::max(this->block_idx, this->valid_blocks);
+    this->block_idx = this->block_idx % INPUTS_WANTED;
+    this->stats_stale = true;
+  }
+
+  this->update_status();
+  return true;
+}
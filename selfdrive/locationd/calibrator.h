@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+
+#include <eigen3/Eigen/Dense>
+
+// calibrationd's estimator. cameraOdometry while driving straight and fast is averaged
+// into blocks of BLOCK_SIZE, the last INPUTS_WANTED blocks are kept in a ring and the
+// calibration is their mean. The mean and spread of the finished blocks only change
+// when a block finishes, they're computed then instead of on every message.
+class Calibrator {
+public:
+  // LiveCalibrationData.Status
+  enum Status {
+    UNCALIBRATED = 0,
+    CALIBRATED = 1,
+    INVALID = 2,
+    RECALIBRATING = 3,
+  };
+
+  static constexpr int BLOCK_SIZE = 100;  // at model frequency, blocks needed for efficiency
+  static constexpr int INPUTS_NEEDED = 5;  // Minimum blocks needed for valid calibration
+  static constexpr int INPUTS_WANTED = 50;  // We want a little bit more than we need for stability
+
+  Calibrator();
+
+  // starts over from a calibration, smoothing the output over from smooth_from if given
+  void reset(const Eigen::Vector3d &rpy_init, int valid_blocks, const Eigen::Vector3d &wide_from_device_euler_init,
+             double height_init, const Eigen::Vector3d *smooth_from = nullptr);
+  // wide_from_device_euler and the road transform are null when cameraOdometry doesn't have them.
+  // false if the message wasn't used, otherwise its rpy is in new_rpy
+  bool handle_cam_odom(double v_ego, const double trans[3], const double rot[3], const double trans_std[3],
+                       const double *wide_from_device_euler, const double *road_transform_trans,
+                       const double *road_transform_trans_std, Eigen::Vector3d &new_rpy);
+  Eigen::Vector3d get_smooth_rpy() const;
+  int get_cal_perc() const;
+  // the cached calibration is due to be written
+  bool write_this_cycle() const;
+
+  Status cal_status = UNCALIBRATED;
+  int valid_blocks = 0;
+  int idx = 0;
+  int block_idx = 0;
+  Eigen::Vector3d rpy;
+  Eigen::Vector3d calib_spread = Eigen::Vector3d::Zero();
+  Eigen::Vector3d wide_from_device_euler;
+  double height;
+
+private:
+  void update_status();
+  void update_block_stats();
+
+  std::array<Eigen::Vector3d, INPUTS_WANTED> rpys;
+  std::array<Eigen::Vector3d, INPUTS_WANTED> wide_from_device_eulers;
+  std::array<double, INPUTS_WANTED> heights;
+
+  Eigen::Vector3d old_rpy = Eigen::Vector3d::Zero();
+  double old_rpy_weight = 0.0;
+
+  // over the blocks outside the one being filled, stale once one finishes or on reset
+  bool stats_stale = true;
+  bool stats_valid = false;
+  Eigen::Vector3d mean_rpy, mean_wide_from_device_euler, spread_rpy;
+  double mean_height;
+};
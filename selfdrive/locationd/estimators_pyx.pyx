@@ -0,0 +1,254 @@
+# distutils: language = c++
+# cython: language_level = 3
+from libcpp cimport bool
+from libcpp.pair cimport pair
+from libcpp.vector cimport vector
+
+import numpy as np
+cimport numpy as np
+
+cdef extern from "<eigen3/Eigen/Dense>":
+  cdef cppclass Vector3d "Eigen::Vector3d":
+    Vector3d()
+    Vector3d(double, double, double)
+    double *data()
+
+cdef extern from "selfdrive/locationd/models/car_kf.h":
+  int CAR_DIM_STATE
+  int CAR_DIM_STATE_ERR
+
+  cdef cppclass CarStateVec "CarEKF::StateVec":
+    const double *data()
+
+  cdef cppclass CarCovMat "CarEKF::CovMat":
+    const double *data()
+
+cdef extern from "selfdrive/locationd/params_learner.h":
+  cdef struct CarModelParams:
+    double mass
+    double rotational_inertia
+    double center_to_front
+    double center_to_rear
+    double stiffness_front
+    double stiffness_rear
+
+  cdef cppclass ParamsLearnerCore "ParamsLearner":
+    ParamsLearnerCore(const CarModelParams &, double, double, double, const double *)
+    void handle_live_location(double, double, double, bool, double, double, bool, bool)
+    void handle_car_state(double, double, double)
+    const CarStateVec &get_x()
+    const CarCovMat &get_P()
+    bool active
+    double speed
+    double yaw_rate
+    double yaw_rate_std
+    double roll
+    double steering_angle
+    bool roll_valid
+
+cdef extern from "selfdrive/locationd/torque_buckets.h":
+  cdef cppclass TorqueBucketsCore "TorqueBuckets":
+    TorqueBucketsCore(const vector[pair[double, double]] &, const vector[double] &, size_t, size_t)
+    void add_point(double, double)
+    size_t size()
+    vector[size_t] bucket_lengths()
+    bool is_valid()
+    bool fit(double &, double &, double &)
+    vector[double] get_points()
+
+cdef extern from "selfdrive/locationd/calibrator.h":
+  cdef cppclass CalibratorCore "Calibrator":
+    CalibratorCore()
+    void reset(const Vector3d &, int, const Vector3d &, double, const Vector3d *)
+    bool handle_cam_odom(double, const double *, const double *, const double *, const double *, const double *,
+                         const double *, Vector3d &)
+    Vector3d get_smooth_rpy()
+    int get_cal_perc()
+    bool write_this_cycle()
+    int cal_status
+    int valid_blocks
+    Vector3d rpy
+    Vector3d calib_spread
+    Vector3d wide_from_device_euler
+    double height
+
+
+cdef Vector3d to_vector3d(v):
+  return Vector3d(v[0], v[1], v[2])
+
+cdef to_numpy(Vector3d &v):
+  return np.array([v.data()[0], v.data()[1], v.data()[2]])
+
+# cameraOdometry's optional fields are empty lists when missing
+cdef const double *optional_vec3(v, double out[3]):
+  if len(v) != 3:
+    return NULL
+  out[0], out[1], out[2] = v[0], v[1], v[2]
+  return out
+
+
+cdef class CalibrationEstimator:
+  """calibrationd's block averaged calibration, fed with cameraOdometry"""
+  cdef CalibratorCore calibrator
+
+  def reset(self, rpy_init, int valid_blocks, wide_from_device_euler, double height, smooth_from=None):
+    cdef Vector3d smooth
+    if smooth_from is None:
+      self.calibrator.reset(to_vector3d(rpy_init), valid_blocks, to_vector3d(wide_from_device_euler), height, NULL)
+    else:
+      smooth = to_vector3d(smooth_from)
+      self.calibrator.reset(to_vector3d(rpy_init), valid_blocks, to_vector3d(wide_from_device_euler), height, &smooth)
+
+  def handle_cam_odom(self, double v_ego, trans, rot, wide_from_device_euler, trans_std, road_transform_trans,
+                      road_transform_trans_std):
+    """Returns the rpy of the message, None if it wasn't used"""
+    cdef double c_trans[3]
+    cdef double c_rot[3]
+    cdef double c_trans_std[3]
+    cdef double c_wide[3]
+    cdef double c_road_trans[3]
+    cdef double c_road_trans_std[3]
+    cdef Vector3d new_rpy
+    c_trans[0], c_trans[1], c_trans[2] = trans[0], trans[1], trans[2]
+    c_rot[0], c_rot[1], c_rot[2] = rot[0], rot[1], rot[2]
+    c_trans_std[0], c_trans_std[1], c_trans_std[2] = trans_std[0], trans_std[1], trans_std[2]
+    if not self.calibrator.handle_cam_odom(v_ego, c_trans, c_rot, c_trans_std, optional_vec3(wide_from_device_euler, c_wide),
+                                           optional_vec3(road_transform_trans, c_road_trans),
+                                           optional_vec3(road_transform_trans_std, c_road_trans_std), new_rpy):
+      return None
+    return to_numpy(new_rpy)
+
+  @property
+  def rpy(self):
+    return to_numpy(self.calibrator.rpy)
+
+  @property
+  def smooth_rpy(self):
+    cdef Vector3d smooth = self.calibrator.get_smooth_rpy()
+    return to_numpy(smooth)
+
+  @property
+  def calib_spread(self):
+    return to_numpy(self.calibrator.calib_spread)
+
+  @property
+  def wide_from_device_euler(self):
+    return to_numpy(self.calibrator.wide_from_device_euler)
+
+  @property
+  def height(self):
+    return np.array([self.calibrator.height])
+
+  @property
+  def valid_blocks(self):
+    return self.calibrator.valid_blocks
+
+  @property
+  def cal_status(self):
+    return self.calibrator.cal_status
+
+  @property
+  def cal_perc(self):
+    return self.calibrator.get_cal_perc()
+
+  @property
+  def write_this_cycle(self):
+    return self.calibrator.write_this_cycle()
+
+
+cdef class ParamsLearner:
+  """paramsd's car filter, fed with the liveLocationKalman and carState fields it uses"""
+  cdef ParamsLearnerCore *learner
+
+  def __cinit__(self, CP, double steer_ratio, double stiffness_factor, double angle_offset, P_initial=None):
+    cdef CarModelParams car
+    car.mass = CP.mass
+    car.rotational_inertia = CP.rotationalInertia
+    car.center_to_front = CP.centerToFront
+    car.center_to_rear = CP.wheelbase - CP.centerToFront
+    car.stiffness_front = CP.tireStiffnessFront
+    car.stiffness_rear = CP.tireStiffnessRear
+
+    cdef np.ndarray[double, ndim=2, mode="c"] P
+    if P_initial is None:
+      self.learner = new ParamsLearnerCore(car, steer_ratio, stiffness_factor, angle_offset, NULL)
+    else:
+      P = np.ascontiguousarray(P_initial, dtype=np.double)
+      assert P.shape[0] == CAR_DIM_STATE_ERR and P.shape[1] == CAR_DIM_STATE_ERR
+      self.learner = new ParamsLearnerCore(car, steer_ratio, stiffness_factor, angle_offset, <double*>P.data)
+
+  def __dealloc__(self):
+    del self.learner
+
+  def handle_log(self, double t, str which, msg):
+    if which == 'liveLocationKalman':
+      self.learner.handle_live_location(t, msg.angularVelocityCalibrated.value[2], msg.angularVelocityCalibrated.std[2],
+                                        msg.angularVelocityCalibrated.valid, msg.orientationNED.value[0],
+                                        msg.orientationNED.std[0], msg.sensorsOK, msg.posenetOK)
+    elif which == 'carState':
+      self.learner.handle_car_state(t, msg.steeringAngleDeg, msg.vEgo)
+
+  @property
+  def x(self):
+    cdef double[:] x = <double[:CAR_DIM_STATE]><double*>self.learner.get_x().data()
+    return np.copy(np.asarray(x))
+
+  @property
+  def P(self):
+    cdef double[:, :] P = <double[:CAR_DIM_STATE_ERR, :CAR_DIM_STATE_ERR]><double*>self.learner.get_P().data()
+    return np.copy(np.asarray(P))
+
+  @property
+  def active(self):
+    return self.learner.active
+
+  @property
+  def speed(self):
+    return self.learner.speed
+
+  @property
+  def yaw_rate(self):
+    return self.learner.yaw_rate
+
+  @property
+  def roll(self):
+    return self.learner.roll
+
+
+cdef class TorqueBuckets:
+  """torqued's steer buckets of (steer, lateral accel) points, with an incremental total least squares fit"""
+  cdef TorqueBucketsCore *buckets
+
+  def __cinit__(self, x_bounds, min_points, int min_points_total, int points_per_bucket):
+    self.buckets = new TorqueBucketsCore([(float(lo), float(hi)) for lo, hi in x_bounds], [float(m) for m in min_points],
+                                         min_points_total, points_per_bucket)
+
+  def __dealloc__(self):
+    del self.buckets
+
+  def __len__(self):
+    return self.buckets.size()
+
+  def bucket_lengths(self):
+    return list(self.buckets.bucket_lengths())
+
+  def is_valid(self):
+    return self.buckets.is_valid()
+
+  def add_point(self, double x, double y):
+    self.buckets.add_point(x, y)
+
+  def load_points(self, points):
+    for x, y in points:
+      self.buckets.add_point(x, y)
+
+  def get_points(self):
+    """(steer, lateral accel) of every point, n x 2"""
+    return np.array(self.buckets.get_points(), dtype=np.double).reshape(-1, 2)
+
+  def fit(self):
+    """Returns slope, offset and the std of the points across the line, all nan without a fit"""
+    cdef double slope, offset, spread_std
+    if not self.buckets.fit(slope, offset, spread_std):
+      return np.nan, np.nan, np.nan
+    return slope, offset, spread_std
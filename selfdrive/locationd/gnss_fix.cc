@@ -0,0 +1,83 @@
+#include "selfdrive/locationd/gnss_fix.h"
+
+#include <cmath>
+
+using namespace Eigen;
+
+const double SPEED_OF_LIGHT = 2.99792458e8;  // m/s
+const double EARTH_ROTATION_RATE = 7.2921151467e-5;  // rad/s
+const int GAUSS_NEWTON_MAX_ITER = 25;
+const double GAUSS_NEWTON_XTOL = 1e-8;
+
+// residuals and their jacobian at x, weighted by 1/std when weight is set
+typedef void (*residual_fn)(const std::vector<GnssFixMeasurement> &measurements, const Vector3d &est_pos,
+                            const VectorXd &x, bool weight, VectorXd &res, MatrixXd &jac);
+
+static void pr_residual(const std::vector<GnssFixMeasurement> &measurements, const Vector3d &,
+                        const VectorXd &x, bool weight, VectorXd &res, MatrixXd &jac) {
+  const Vector3d pos = x.head<3>();
+  const double bc = x(3), bg = x(4);
+  for (size_t i = 0; i < measurements.size(); i++) {
+    const GnssFixMeasurement &m = measurements[i];
+    const double w = weight ? 1.0 / m.pseudorange_std : 1.0;
+
+    // the earth turns while the signal is in flight
+    const double theta = EARTH_ROTATION_RATE * (m.pseudorange - bc) / SPEED_OF_LIGHT;
+    const double c = std::cos(theta), s = std::sin(theta);
+    const Vector3d sat(m.sat_pos(0) * c + m.sat_pos(1) * s, m.sat_pos(1) * c - m.sat_pos(0) * s, m.sat_pos(2));
+    const Vector3d d = sat - pos;
+    const double range = d.norm();
+    const double drange_dtheta = (d(0) * sat(1) - d(1) * sat(0)) / range;
+
+    res(i) = w * (range - (m.pseudorange - bc - (m.glonass ? bg : 0.0)));
+    jac.row(i) << -w * d.transpose() / range, w * (1.0 - drange_dtheta * EARTH_ROTATION_RATE / SPEED_OF_LIGHT), m.glonass ? w : 0.0;
+  }
+}
+
+static void prr_residual(const std::vector<GnssFixMeasurement> &measurements, const Vector3d &est_pos,
+                         const VectorXd &x, bool weight, VectorXd &res, MatrixXd &jac) {
+  const Vector3d vel = x.head<3>();
+  const double cd = x(3);
+  for (size_t i = 0; i < measurements.size(); i++) {
+    const GnssFixMeasurement &m = measurements[i];
+    const double w = weight ? 1.0 / m.pseudorange_rate_std : 1.0;
+
+    const Vector3d los = (m.sat_pos - est_pos).normalized();
+    res(i) = w * (los.dot(m.sat_vel - vel) + cd - m.pseudorange_rate);
+    jac.row(i) << -w * los.transpose(), w;
+  }
+}
+
+static bool solve(residual_fn fn, const std::vector<GnssFixMeasurement> &measurements, const Vector3d &est_pos,
+                  const VectorXd &x0, GnssFix &fix) {
+  const int n = measurements.size();
+  VectorXd x = x0;
+  VectorXd res(n);
+  MatrixXd jac(n, x0.size());
+
+  // Gauss-Newton, the pseudo inverse covers a bias no measurement depends on (no GLONASS)
+  for (int iter = 0; iter < GAUSS_NEWTON_MAX_ITER; iter++) {
+    fn(measurements, est_pos, x, true, res, jac);
+    VectorXd step = jac.completeOrthogonalDecomposition().solve(res);
+    x -= step;
+    if (step.norm() < GAUSS_NEWTON_XTOL) break;
+  }
+  if (!x.allFinite()) return false;
+
+  fn(measurements, est_pos, x, false, res, jac);
+  fix.x = x;
+  fix.residuals = res;
+  fix.std = (jac.transpose() * jac).completeOrthogonalDecomposition().pseudoInverse().diagonal().cwiseAbs().cwiseSqrt();
+  return true;
+}
+
+bool calc_pos_fix(const std::vector<GnssFixMeasurement> &measurements, GnssFix &fix, int min_measurements, const VectorXd &x0) {
+  if ((int)measurements.size() < min_measurements) return false;
+  return solve(pr_residual, measurements, Vector3d::Zero(), x0, fix);
+}
+
+bool calc_vel_fix(const std::vector<GnssFixMeasurement> &measurements, const Vector3d &est_pos, GnssFix &fix,
+                  int min_measurements, const VectorXd &x0) {
+  if ((int)measurements.size() < min_measurements) return false;
+  return solve(prr_residual, measurements, est_pos, x0, fix);
+}
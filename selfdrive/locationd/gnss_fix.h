@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+// Snapshot least squares position and velocity fixes from corrected GNSS
+// measurements, the positioning step of laikad done natively. Same models as
+// laika's calc_pos_fix/calc_vel_fix: pseudoranges with the earth's rotation
+// during signal flight, a receiver clock bias and a GLONASS bias on top,
+// pseudorange rates along the line of sight with a clock drift.
+
+struct GnssFixMeasurement {
+  bool glonass;
+  Eigen::Vector3d sat_pos;
+  Eigen::Vector3d sat_vel;
+  double pseudorange, pseudorange_std;
+  double pseudorange_rate, pseudorange_rate_std;
+};
+
+struct GnssFix {
+  Eigen::VectorXd x;  // [x, y, z, clock bias, glonass bias] or [vx, vy, vz, clock drift]
+  Eigen::VectorXd std;
+  Eigen::VectorXd residuals;  // unweighted, per measurement
+};
+
+// false when there are fewer than min_measurements or the solution isn't finite
+bool calc_pos_fix(const std::vector<GnssFixMeasurement> &measurements, GnssFix &fix, int min_measurements = 6,
+                  const Eigen::VectorXd &x0 = Eigen::VectorXd::Zero(5));
+bool calc_vel_fix(const std::vector<GnssFixMeasurement> &measurements, const Eigen::Vector3d &est_pos, GnssFix &fix,
+                  int min_measurements = 6, const Eigen::VectorXd &x0 = Eigen::VectorXd::Zero(4));
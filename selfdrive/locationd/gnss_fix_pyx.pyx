@@ -0,0 +1,72 @@
+# distutils: language = c++
+# cython: language_level = 3
+from libcpp cimport bool
+from libcpp.vector cimport vector
+
+import numpy as np
+cimport numpy as np
+
+cdef extern from "<eigen3/Eigen/Dense>":
+  cdef cppclass Vector3d "Eigen::Vector3d":
+    Vector3d()
+    Vector3d(double, double, double)
+
+  cdef cppclass VectorXd "Eigen::VectorXd":
+    VectorXd()
+    double *data()
+    long size()
+
+cdef extern from "selfdrive/locationd/gnss_fix.h":
+  cdef struct GnssFixMeasurement:
+    bool glonass
+    Vector3d sat_pos
+    Vector3d sat_vel
+    double pseudorange
+    double pseudorange_std
+    double pseudorange_rate
+    double pseudorange_rate_std
+
+  cdef struct GnssFix:
+    VectorXd x
+    VectorXd std
+    VectorXd residuals
+
+  bool calc_pos_fix_c "calc_pos_fix"(const vector[GnssFixMeasurement] &, GnssFix &, int)
+  bool calc_vel_fix_c "calc_vel_fix"(const vector[GnssFixMeasurement] &, const Vector3d &, GnssFix &, int)
+
+# one row per corrected measurement: [glonass, sat_pos (3), sat_vel (3),
+# pseudorange, pseudorange_std, pseudorange_rate, pseudorange_rate_std]
+MEASUREMENT_COLS = 11
+
+cdef vector[GnssFixMeasurement] to_measurements(np.ndarray[double, ndim=2, mode="c"] arr):
+  assert arr.shape[1] == MEASUREMENT_COLS
+  cdef vector[GnssFixMeasurement] measurements
+  cdef GnssFixMeasurement m
+  measurements.reserve(arr.shape[0])
+  for i in range(arr.shape[0]):
+    m.glonass = arr[i, 0] != 0
+    m.sat_pos = Vector3d(arr[i, 1], arr[i, 2], arr[i, 3])
+    m.sat_vel = Vector3d(arr[i, 4], arr[i, 5], arr[i, 6])
+    m.pseudorange = arr[i, 7]
+    m.pseudorange_std = arr[i, 8]
+    m.pseudorange_rate = arr[i, 9]
+    m.pseudorange_rate_std = arr[i, 10]
+    measurements.push_back(m)
+  return measurements
+
+cdef to_numpy(VectorXd &v):
+  return np.array([v.data()[i] for i in range(v.size())])
+
+def calc_pos_fix(np.ndarray[double, ndim=2, mode="c"] arr, int min_measurements=6):
+  """Returns ([x, y, z, clock bias, glonass bias], residuals, std), all empty without a fix"""
+  cdef GnssFix fix
+  if not calc_pos_fix_c(to_measurements(arr), fix, min_measurements):
+    return [], [], []
+  return to_numpy(fix.x), to_numpy(fix.residuals), to_numpy(fix.std)
+
+def calc_vel_fix(np.ndarray[double, ndim=2, mode="c"] arr, est_pos, int min_measurements=6):
+  """Returns ([vx, vy, vz, clock drift], residuals, std), all empty without a fix"""
+  cdef GnssFix fix
+  if not calc_vel_fix_c(to_measurements(arr), Vector3d(est_pos[0], est_pos[1], est_pos[2]), fix, min_measurements):
+    return [], [], []
+  return to_numpy(fix.x), to_numpy(fix.residuals), to_numpy(fix.std)
@@ -21,6 +21,8 @@ from laika.helpers import ConstellationId, get_sv_id
 from laika.raw_gnss import GNSSMeasurement, correct_measurements, process_measurements, read_raw_ublox
 from laika.raw_gnss import gps_time_from_qcom_report, get_measurements_from_qcom_reports
 from laika.opt import calc_pos_fix, get_posfix_sympy_fun, calc_vel_fix, get_velfix_sympy_func
+from openpilot.selfdrive.locationd.gnss_fix_pyx import calc_pos_fix as calc_pos_fix_native
+from openpilot.selfdrive.locationd.gnss_fix_pyx import calc_vel_fix as calc_vel_fix_native
 from openpilot.selfdrive.locationd.models.constants import GENERATED_DIR, ObservationKind
 from openpilot.selfdrive.locationd.models.gnss_kf import GNSSKalman
 from openpilot.selfdrive.locationd.models.gnss_kf import States as GStates
@@ -31,6 +33,8 @@ MAX_TIME_GAP = 10
 EPHEMERIS_CACHE = 'LaikadEphemerisV3'
 CACHE_VERSION = 0.2
 POS_FIX_RESIDUAL_THRESHOLD = 100.0
+# position and velocity fixes from the C++ solver instead of laika's
+NATIVE_FIX = "LAIKAD_NATIVE_FIX" in os.environ
 
 
 class LogEphemerisType(IntEnum):
@@ -164,13 +168,20 @@ class Laikad:
     if self.last_fix_t is None or abs(self.last_fix_t - t) > 0:
       min_measurements = 5 if any(p.constellation_id == ConstellationId.GLONASS for p in measurements) else 4
 
-      position_solution, pr_residuals, pos_std = calc_pos_fix(measurements, self.posfix_functions, min_measurements=min_measurements)
+      if NATIVE_FIX:
+        meas_arr = native_measurement_array(measurements)
+        position_solution, pr_residuals, pos_std = calc_pos_fix_native(meas_arr, min_measurements)
+      else:
+        position_solution, pr_residuals, pos_std = calc_pos_fix(measurements, self.posfix_functions, min_measurements=min_measurements)
       if len(position_solution) < 3:
         return None
       position_estimate = position_solution[:3]
       position_std = pos_std[:3]
 
-      velocity_solution, prr_residuals, vel_std = calc_vel_fix(measurements, position_estimate, self.velfix_function, min_measurements=min_measurements)
+      if NATIVE_FIX:
+        velocity_solution, prr_residuals, vel_std = calc_vel_fix_native(meas_arr, position_estimate, min_measurements)
+      else:
+        velocity_solution, prr_residuals, vel_std = calc_vel_fix(measurements, position_estimate, self.velfix_function, min_measurements=min_measurements)
       if len(velocity_solution) < 3:
         return None
       velocity_estimate = velocity_solution[:3]
@@ -419,6 +430,12 @@ def create_measurement_msg(meas: GNSSMeasurement):
   c.satVel = meas.sat_vel.tolist()
   return c
 
+def native_measurement_array(measurements: List[GNSSMeasurement]) -> np.ndarray:
+  # rows as gnss_fix_pyx expects them
+  return np.array([[m.constellation_id == ConstellationId.GLONASS, *m.sat_pos_final, *m.sat_vel,
+                    m.observables_final['C1C'], m.observables_std['C1C'], m.observables_final['D1C'], m.observables_std['D1C']]
+                   for m in measurements], dtype=np.float64).reshape(-1, 11)
+
 def kf_add_observations(gnss_kf: GNSSKalman, t: float, measurements: List[GNSSMeasurement]):
   ekf_data = defaultdict(list)
   for m in measurements:
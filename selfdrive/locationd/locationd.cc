@@ -5,8 +5,11 @@
 
 #include <algorithm>
 #include <cmath>
+#include <thread>
 #include <vector>
 
+#include "common/placement.h"
+
 using namespace EKFS;
 using namespace Eigen;
 
@@ -40,6 +43,8 @@ const float  GPS_ORIENTATION_ERROR_RESET_THRESHOLD = 1.0;
 const int    GPS_ORIENTATION_ERROR_RESET_CNT = 3;
 
 const bool   DEBUG = getenv("DEBUG") != nullptr && std::string(getenv("DEBUG")) != "0";
+// every Nth liveLocationKalman is full, the rest only carry what consumers read (see build_live_location), all full by default
+const int    FULL_OUTPUT_DECIMATION = getenv("LOCATIOND_FULL_DECIMATION") ? std::max(1, atoi(getenv("LOCATIOND_FULL_DECIMATION"))) : 1;
 
 static VectorXd floatlist2vector(const capnp::List<float, capnp::Kind::PRIMITIVE>::Reader& floatlist) {
   VectorXd res(floatlist.size());
@@ -69,6 +74,13 @@ static MatrixXdr rotate_cov(const MatrixXdr& rot_matrix, const MatrixXdr& cov_in
   return ((rot_matrix *  cov_in) * rot_matrix.transpose());
 }
 
+static VectorXd position_geodetic(const VectorXd& state) {
+  VectorXd fix_ecef = state.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
+  ECEF fix_ecef_ecef = { .x = fix_ecef(0), .y = fix_ecef(1), .z = fix_ecef(2) };
+  Geodetic fix_pos_geo = ecef2geodetic(fix_ecef_ecef);
+  return Vector3d(fix_pos_geo.lat, fix_pos_geo.lon, fix_pos_geo.alt);
+}
+
 static VectorXd rotate_std(const MatrixXdr& rot_matrix, const VectorXd& std_in) {
   // Stds cannot be rotated like values, only covariances can be rotated
   return rotate_cov(rot_matrix, std_in.array().square().matrix().asDiagonal()).diagonal().array().sqrt();
@@ -91,9 +103,9 @@ Localizer::Localizer(LocalizerGnssSource gnss_source) {
   this->configure_gnss_source(gnss_source);
 }
 
-void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
-  VectorXd predicted_state = this->kf->get_x();
-  MatrixXdr predicted_cov = this->kf->get_P();
+void Localizer::build_live_location(const LocalizerOutput &out, cereal::LiveLocationKalman::Builder& fix) {
+  const VectorXd &predicted_state = out.x;
+  const MatrixXdr &predicted_cov = out.P;
   VectorXd predicted_std = predicted_cov.diagonal().array().sqrt();
 
   VectorXd fix_ecef = predicted_state.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
@@ -101,20 +113,20 @@ void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
   VectorXd fix_ecef_std = predicted_std.segment<STATE_ECEF_POS_ERR_LEN>(STATE_ECEF_POS_ERR_START);
   VectorXd vel_ecef = predicted_state.segment<STATE_ECEF_VELOCITY_LEN>(STATE_ECEF_VELOCITY_START);
   VectorXd vel_ecef_std = predicted_std.segment<STATE_ECEF_VELOCITY_ERR_LEN>(STATE_ECEF_VELOCITY_ERR_START);
-  VectorXd fix_pos_geo_vec = this->get_position_geodetic();
+  VectorXd fix_pos_geo_vec = position_geodetic(predicted_state);
   VectorXd orientation_ecef = quat2euler(vector2quat(predicted_state.segment<STATE_ECEF_ORIENTATION_LEN>(STATE_ECEF_ORIENTATION_START)));
   VectorXd orientation_ecef_std = predicted_std.segment<STATE_ECEF_ORIENTATION_ERR_LEN>(STATE_ECEF_ORIENTATION_ERR_START);
   MatrixXdr orientation_ecef_cov = predicted_cov.block<STATE_ECEF_ORIENTATION_ERR_LEN, STATE_ECEF_ORIENTATION_ERR_LEN>(STATE_ECEF_ORIENTATION_ERR_START, STATE_ECEF_ORIENTATION_ERR_START);
   MatrixXdr device_from_ecef = euler2rot(orientation_ecef).transpose();
-  VectorXd calibrated_orientation_ecef = rot2euler((this->calib_from_device * device_from_ecef).transpose());
+  VectorXd calibrated_orientation_ecef = rot2euler((out.calib_from_device * device_from_ecef).transpose());
 
-  VectorXd acc_calib = this->calib_from_device * predicted_state.segment<STATE_ACCELERATION_LEN>(STATE_ACCELERATION_START);
+  VectorXd acc_calib = out.calib_from_device * predicted_state.segment<STATE_ACCELERATION_LEN>(STATE_ACCELERATION_START);
   MatrixXdr acc_calib_cov = predicted_cov.block<STATE_ACCELERATION_ERR_LEN, STATE_ACCELERATION_ERR_LEN>(STATE_ACCELERATION_ERR_START, STATE_ACCELERATION_ERR_START);
-  VectorXd acc_calib_std = rotate_cov(this->calib_from_device, acc_calib_cov).diagonal().array().sqrt();
-  VectorXd ang_vel_calib = this->calib_from_device * predicted_state.segment<STATE_ANGULAR_VELOCITY_LEN>(STATE_ANGULAR_VELOCITY_START);
+  VectorXd acc_calib_std = rotate_cov(out.calib_from_device, acc_calib_cov).diagonal().array().sqrt();
+  VectorXd ang_vel_calib = out.calib_from_device * predicted_state.segment<STATE_ANGULAR_VELOCITY_LEN>(STATE_ANGULAR_VELOCITY_START);
 
   MatrixXdr vel_angular_cov = predicted_cov.block<STATE_ANGULAR_VELOCITY_ERR_LEN, STATE_ANGULAR_VELOCITY_ERR_LEN>(STATE_ANGULAR_VELOCITY_ERR_START, STATE_ANGULAR_VELOCITY_ERR_START);
-  VectorXd ang_vel_calib_std = rotate_cov(this->calib_from_device, vel_angular_cov).diagonal().array().sqrt();
+  VectorXd ang_vel_calib_std = rotate_cov(out.calib_from_device, vel_angular_cov).diagonal().array().sqrt();
 
   VectorXd vel_device = device_from_ecef * vel_ecef;
   VectorXd device_from_ecef_eul = quat2euler(vector2quat(predicted_state.segment<STATE_ECEF_ORIENTATION_LEN>(STATE_ECEF_ORIENTATION_START))).transpose();
@@ -129,50 +141,56 @@ void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
     predicted_cov.block<STATE_ECEF_VELOCITY_ERR_LEN, STATE_ECEF_ORIENTATION_ERR_LEN>(STATE_ECEF_VELOCITY_ERR_START, STATE_ECEF_ORIENTATION_ERR_START);
   VectorXd H_input(device_from_ecef_eul.size() + vel_ecef.size());
   H_input << device_from_ecef_eul, vel_ecef;
+  // only runs generated code, fine from the publish thread
   MatrixXdr HH = this->kf->H(H_input);
   MatrixXdr vel_device_cov = (HH * condensed_cov) * HH.transpose();
   VectorXd vel_device_std = vel_device_cov.diagonal().array().sqrt();
 
-  VectorXd vel_calib = this->calib_from_device * vel_device;
-  VectorXd vel_calib_std = rotate_cov(this->calib_from_device, vel_device_cov).diagonal().array().sqrt();
+  VectorXd vel_calib = out.calib_from_device * vel_device;
+  VectorXd vel_calib_std = rotate_cov(out.calib_from_device, vel_device_cov).diagonal().array().sqrt();
 
   VectorXd orientation_ned = ned_euler_from_ecef(fix_ecef_ecef, orientation_ecef);
-  VectorXd orientation_ned_std = rotate_cov(this->converter->ecef2ned_matrix, orientation_ecef_cov).diagonal().array().sqrt();
+  VectorXd orientation_ned_std = rotate_cov(out.ecef2ned_matrix, orientation_ecef_cov).diagonal().array().sqrt();
   VectorXd calibrated_orientation_ned = ned_euler_from_ecef(fix_ecef_ecef, calibrated_orientation_ecef);
-  VectorXd nextfix_ecef = fix_ecef + vel_ecef;
-  VectorXd ned_vel = this->converter->ecef2ned((ECEF) { .x = nextfix_ecef(0), .y = nextfix_ecef(1), .z = nextfix_ecef(2) }).to_vector() - converter->ecef2ned(fix_ecef_ecef).to_vector();
-
-  VectorXd accDevice = predicted_state.segment<STATE_ACCELERATION_LEN>(STATE_ACCELERATION_START);
-  VectorXd accDeviceErr = predicted_std.segment<STATE_ACCELERATION_ERR_LEN>(STATE_ACCELERATION_ERR_START);
-
-  VectorXd angVelocityDevice = predicted_state.segment<STATE_ANGULAR_VELOCITY_LEN>(STATE_ANGULAR_VELOCITY_START);
-  VectorXd angVelocityDeviceErr = predicted_std.segment<STATE_ANGULAR_VELOCITY_ERR_LEN>(STATE_ANGULAR_VELOCITY_ERR_START);
 
   Vector3d nans = Vector3d(NAN, NAN, NAN);
 
   // TODO fill in NED and Calibrated stds
-  // write measurements to msg
-  init_measurement(fix.initPositionGeodetic(), fix_pos_geo_vec, nans, this->gps_mode);
-  init_measurement(fix.initPositionECEF(), fix_ecef, fix_ecef_std, this->gps_mode);
-  init_measurement(fix.initVelocityECEF(), vel_ecef, vel_ecef_std, this->gps_mode);
-  init_measurement(fix.initVelocityNED(), ned_vel, nans, this->gps_mode);
-  init_measurement(fix.initVelocityDevice(), vel_device, vel_device_std, true);
-  init_measurement(fix.initAccelerationDevice(), accDevice, accDeviceErr, true);
-  init_measurement(fix.initOrientationECEF(), orientation_ecef, orientation_ecef_std, this->gps_mode);
-  init_measurement(fix.initCalibratedOrientationECEF(), calibrated_orientation_ecef, nans, this->calibrated && this->gps_mode);
-  init_measurement(fix.initOrientationNED(), orientation_ned, orientation_ned_std, this->gps_mode);
-  init_measurement(fix.initCalibratedOrientationNED(), calibrated_orientation_ned, nans, this->calibrated && this->gps_mode);
-  init_measurement(fix.initAngularVelocityDevice(), angVelocityDevice, angVelocityDeviceErr, true);
-  init_measurement(fix.initVelocityCalibrated(), vel_calib, vel_calib_std, this->calibrated);
-  init_measurement(fix.initAngularVelocityCalibrated(), ang_vel_calib, ang_vel_calib_std, this->calibrated);
-  init_measurement(fix.initAccelerationCalibrated(), acc_calib, acc_calib_std, this->calibrated);
-  if (DEBUG) {
-    init_measurement(fix.initFilterState(), predicted_state, predicted_std, true);
+  // write measurements to msg, the pose, velocity and rates consumers read are in every message
+  init_measurement(fix.initPositionGeodetic(), fix_pos_geo_vec, nans, out.gps_mode);
+  init_measurement(fix.initPositionECEF(), fix_ecef, fix_ecef_std, out.gps_mode);
+  init_measurement(fix.initVelocityECEF(), vel_ecef, vel_ecef_std, out.gps_mode);
+  init_measurement(fix.initCalibratedOrientationECEF(), calibrated_orientation_ecef, nans, out.calibrated && out.gps_mode);
+  init_measurement(fix.initOrientationNED(), orientation_ned, orientation_ned_std, out.gps_mode);
+  init_measurement(fix.initCalibratedOrientationNED(), calibrated_orientation_ned, nans, out.calibrated && out.gps_mode);
+  init_measurement(fix.initVelocityCalibrated(), vel_calib, vel_calib_std, out.calibrated);
+  init_measurement(fix.initAngularVelocityCalibrated(), ang_vel_calib, ang_vel_calib_std, out.calibrated);
+  init_measurement(fix.initAccelerationCalibrated(), acc_calib, acc_calib_std, out.calibrated);
+
+  // device frame, ECEF orientation and NED velocity only in full messages
+  if (out.full) {
+    VectorXd nextfix_ecef = fix_ecef + vel_ecef;
+    VectorXd ned_vel = out.ecef2ned_matrix * (nextfix_ecef - out.init_ecef) - out.ecef2ned_matrix * (fix_ecef - out.init_ecef);
+
+    VectorXd accDevice = predicted_state.segment<STATE_ACCELERATION_LEN>(STATE_ACCELERATION_START);
+    VectorXd accDeviceErr = predicted_std.segment<STATE_ACCELERATION_ERR_LEN>(STATE_ACCELERATION_ERR_START);
+
+    VectorXd angVelocityDevice = predicted_state.segment<STATE_ANGULAR_VELOCITY_LEN>(STATE_ANGULAR_VELOCITY_START);
+    VectorXd angVelocityDeviceErr = predicted_std.segment<STATE_ANGULAR_VELOCITY_ERR_LEN>(STATE_ANGULAR_VELOCITY_ERR_START);
+
+    init_measurement(fix.initVelocityNED(), ned_vel, nans, out.gps_mode);
+    init_measurement(fix.initVelocityDevice(), vel_device, vel_device_std, true);
+    init_measurement(fix.initAccelerationDevice(), accDevice, accDeviceErr, true);
+    init_measurement(fix.initOrientationECEF(), orientation_ecef, orientation_ecef_std, out.gps_mode);
+    init_measurement(fix.initAngularVelocityDevice(), angVelocityDevice, angVelocityDeviceErr, true);
+    if (DEBUG) {
+      init_measurement(fix.initFilterState(), predicted_state, predicted_std, true);
+    }
   }
 
   double old_mean = 0.0, new_mean = 0.0;
   int i = 0;
-  for (double x : this->posenet_stds) {
+  for (double x : out.posenet_stds) {
     if (i < POSENET_STD_HIST_HALF) {
       old_mean += x;
     } else {
@@ -185,19 +203,18 @@ void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
   // experimentally found these values, no false positives in 20k minutes of driving
   bool std_spike = (new_mean / old_mean > 4.0 && new_mean > 7.0);
 
-  fix.setPosenetOK(!(std_spike && this->car_speed > 5.0));
-  fix.setDeviceStable(!this->device_fell);
-  fix.setExcessiveResets(this->reset_tracker > MAX_RESET_TRACKER);
-  fix.setTimeToFirstFix(std::isnan(this->ttff) ? -1. : this->ttff);
-  this->device_fell = false;
+  fix.setPosenetOK(!(std_spike && out.car_speed > 5.0));
+  fix.setDeviceStable(!out.device_fell);
+  fix.setExcessiveResets(out.reset_tracker > MAX_RESET_TRACKER);
+  fix.setTimeToFirstFix(std::isnan(out.ttff) ? -1. : out.ttff);
 
   //fix.setGpsWeek(this->time.week);
   //fix.setGpsTimeOfWeek(this->time.tow);
-  fix.setUnixTimestampMillis(this->unix_timestamp_millis);
+  fix.setUnixTimestampMillis(out.unix_timestamp_millis);
 
-  double time_since_reset = this->kf->get_filter_time() - this->last_reset_time;
+  double time_since_reset = out.filter_time - out.last_reset_time;
   fix.setTimeSinceReset(time_since_reset);
-  if (fix_ecef_std.norm() < VALID_POS_STD && this->calibrated && time_since_reset > VALID_TIME_SINCE_RESET) {
+  if (fix_ecef_std.norm() < VALID_POS_STD && out.calibrated && time_since_reset > VALID_TIME_SINCE_RESET) {
     fix.setStatus(cereal::LiveLocationKalman::Status::VALID);
   } else if (fix_ecef_std.norm() < VALID_POS_STD && time_since_reset > VALID_TIME_SINCE_RESET) {
     fix.setStatus(cereal::LiveLocationKalman::Status::UNCALIBRATED);
@@ -207,10 +224,7 @@ void Localizer::build_live_location(cereal::LiveLocationKalman::Builder& fix) {
 }
 
 VectorXd Localizer::get_position_geodetic() {
-  VectorXd fix_ecef = this->kf->get_x().segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
-  ECEF fix_ecef_ecef = { .x = fix_ecef(0), .y = fix_ecef(1), .z = fix_ecef(2) };
-  Geodetic fix_pos_geo = ecef2geodetic(fix_ecef_ecef);
-  return Vector3d(fix_pos_geo.lat, fix_pos_geo.lon, fix_pos_geo.alt);
+  return position_geodetic(this->kf->get_x());
 }
 
 VectorXd Localizer::get_state() {
@@ -221,6 +235,14 @@ VectorXd Localizer::get_stdev() {
   return this->kf->get_P().diagonal().array().sqrt();
 }
 
+size_t Localizer::get_rewind_count() {
+  return this->kf->get_rewind_count();
+}
+
+size_t Localizer::get_rejected_count() {
+  return this->kf->get_rejected_count();
+}
+
 bool Localizer::are_inputs_ok() {
   return this->critical_services_valid(this->observation_values_invalid) && !this->observation_timings_invalid;
 }
@@ -265,7 +287,7 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
     bool gyro_valid = gyro_camodo_yawrate_err < gyro_camodo_yawrate_err_threshold;
 
     if ((meas.norm() < ROTATION_SANITY_CHECK) && gyro_valid) {
-      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_GYRO, { meas });
+      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_GYRO, meas);
       this->observation_values_invalid["gyroscope"] *= DECAY;
     } else {
       this->observation_values_invalid["gyroscope"] += 1.0;
@@ -283,7 +305,7 @@ void Localizer::handle_sensor(double current_time, const cereal::SensorEventData
 
     auto meas = Vector3d(-v[2], -v[1], -v[0]);
     if (meas.norm() < ACCEL_SANITY_CHECK) {
-      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_ACCEL, { meas });
+      this->kf->predict_and_observe(sensor_time, OBSERVATION_PHONE_ACCEL, meas);
       this->observation_values_invalid["accelerometer"] *= DECAY;
     } else {
       this->observation_values_invalid["accelerometer"] += 1.0;
@@ -303,8 +325,8 @@ void Localizer::input_fake_gps_observations(double current_time) {
   const MatrixXdr &ecef_pos_R = this->kf->get_fake_gps_pos_cov();
   const MatrixXdr &ecef_vel_R = this->kf->get_fake_gps_vel_cov();
 
-  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_POS, { ecef_pos }, { ecef_pos_R });
-  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_VEL, { ecef_vel }, { ecef_vel_R });
+  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_POS, ecef_pos, ecef_pos_R);
+  this->kf->predict_and_observe(current_time, OBSERVATION_ECEF_VEL, ecef_vel, ecef_vel_R);
 }
 
 void Localizer::handle_gps(double current_time, const cereal::GpsLocationData::Reader& log, const double sensor_time_offset) {
@@ -354,15 +376,15 @@ void Localizer::handle_gps(double current_time, const cereal::GpsLocationData::R
   if (ecef_vel.norm() > 5.0 && orientation_error.norm() > 1.0) {
     LOGE("Locationd vs ubloxLocation orientation difference too large, kalman reset");
     this->reset_kalman(NAN, initial_pose_ecef_quat, ecef_pos, ecef_vel, ecef_pos_R, ecef_vel_R);
-    this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_ORIENTATION_FROM_GPS, { initial_pose_ecef_quat });
+    this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_ORIENTATION_FROM_GPS, initial_pose_ecef_quat);
   } else if (gps_est_error > 100.0) {
     LOGE("Locationd vs ubloxLocation position difference too large, kalman reset");
     this->reset_kalman(NAN, initial_pose_ecef_quat, ecef_pos, ecef_vel, ecef_pos_R, ecef_vel_R);
   }
 
   this->last_gps_msg = sensor_time;
-  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_POS, { ecef_pos }, { ecef_pos_R });
-  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_VEL, { ecef_vel }, { ecef_vel_R });
+  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_POS, ecef_pos, ecef_pos_R);
+  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_VEL, ecef_vel, ecef_vel_R);
 }
 
 void Localizer::handle_gnss(double current_time, const cereal::GnssMeasurements::Reader& log) {
@@ -432,22 +454,22 @@ void Localizer::handle_gnss(double current_time, const cereal::GnssMeasurements:
   } else if (orientation_reset_count > GPS_ORIENTATION_ERROR_RESET_CNT) {
     LOGE("Locationd vs gnssMeasurement orientation difference too large, kalman reset");
     this->reset_kalman(NAN, initial_pose_ecef_quat, ecef_pos, ecef_vel, ecef_pos_R, ecef_vel_R);
-    this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_ORIENTATION_FROM_GPS, { initial_pose_ecef_quat });
+    this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_ORIENTATION_FROM_GPS, initial_pose_ecef_quat);
     this->orientation_reset_count = 0;
   }
 
   this->gps_mode = true;
   this->last_gps_msg = sensor_time;
-  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_POS, { ecef_pos }, { ecef_pos_R });
-  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_VEL, { ecef_vel }, { ecef_vel_R });
+  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_POS, ecef_pos, ecef_pos_R);
+  this->kf->predict_and_observe(sensor_time, OBSERVATION_ECEF_VEL, ecef_vel, ecef_vel_R);
 }
 
 void Localizer::handle_car_state(double current_time, const cereal::CarState::Reader& log) {
   this->car_speed = std::abs(log.getVEgo());
   this->standstill = log.getStandstill();
   if (this->standstill) {
-    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ROT, { Vector3d(0.0, 0.0, 0.0) });
-    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ACCEL, { Vector3d(0.0, 0.0, 0.0) });
+    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ROT, Vector3d(0.0, 0.0, 0.0));
+    this->kf->predict_and_observe(current_time, OBSERVATION_NO_ACCEL, Vector3d(0.0, 0.0, 0.0));
   }
 }
 
@@ -484,12 +506,12 @@ void Localizer::handle_cam_odo(double current_time, const cereal::CameraOdometry
   // Multiply by 10 to avoid to high certainty in kalman filter because of temporally correlated noise
   trans_calib_std *= 10.0;
   rot_calib_std *= 10.0;
-  MatrixXdr rot_device_cov = rotate_std(this->device_from_calib, rot_calib_std).array().square().matrix().asDiagonal();
-  MatrixXdr trans_device_cov = rotate_std(this->device_from_calib, trans_calib_std).array().square().matrix().asDiagonal();
+  Matrix<double, 3, 3, RowMajor> rot_device_cov = rotate_std(this->device_from_calib, rot_calib_std).array().square().matrix().asDiagonal();
+  Matrix<double, 3, 3, RowMajor> trans_device_cov = rotate_std(this->device_from_calib, trans_calib_std).array().square().matrix().asDiagonal();
   this->kf->predict_and_observe(current_time, OBSERVATION_CAMERA_ODO_ROTATION,
-    { rot_device }, { rot_device_cov });
+    rot_device, rot_device_cov);
   this->kf->predict_and_observe(current_time, OBSERVATION_CAMERA_ODO_TRANSLATION,
-    { trans_device }, { trans_device_cov });
+    trans_device, trans_device_cov);
   this->observation_values_invalid["cameraOdometry"] *= DECAY;
   this->camodo_yawrate_distribution = Vector2d(rot_device[2], rotate_std(this->device_from_calib, rot_calib_std)[2]);
 }
@@ -615,16 +637,72 @@ void Localizer::handle_msg(const cereal::Event::Reader& log) {
 
 kj::ArrayPtr<capnp::byte> Localizer::get_message_bytes(MessageBuilder& msg_builder, bool inputsOK,
                                                        bool sensorsOK, bool gpsOK, bool msgValid) {
+  LocalizerOutput out;
+  this->get_output(out, inputsOK, sensorsOK, gpsOK, msgValid);
+  return this->get_message_bytes(msg_builder, out);
+}
+
+kj::ArrayPtr<capnp::byte> Localizer::get_message_bytes(MessageBuilder& msg_builder, const LocalizerOutput &out) {
   cereal::Event::Builder evt = msg_builder.initEvent();
-  evt.setValid(msgValid);
+  evt.setValid(out.valid);
   cereal::LiveLocationKalman::Builder liveLoc = evt.initLiveLocationKalman();
-  this->build_live_location(liveLoc);
-  liveLoc.setSensorsOK(sensorsOK);
-  liveLoc.setGpsOK(gpsOK);
-  liveLoc.setInputsOK(inputsOK);
+  this->build_live_location(out, liveLoc);
+  liveLoc.setSensorsOK(out.sensorsOK);
+  liveLoc.setGpsOK(out.gpsOK);
+  liveLoc.setInputsOK(out.inputsOK);
   return msg_builder.toBytes();
 }
 
+void Localizer::get_output(LocalizerOutput &out, bool inputsOK, bool sensorsOK, bool gpsOK, bool msgValid) {
+  out.x = this->kf->get_x();
+  out.P = this->kf->get_P();
+  out.filter_time = this->kf->get_filter_time();
+  out.calib_from_device = this->calib_from_device;
+  out.ecef2ned_matrix = this->converter->ecef2ned_matrix;
+  out.init_ecef = this->converter->init_ecef;
+  std::copy(this->posenet_stds.begin(), this->posenet_stds.end(), out.posenet_stds.begin());
+  out.car_speed = this->car_speed;
+  out.last_reset_time = this->last_reset_time;
+  out.reset_tracker = this->reset_tracker;
+  out.ttff = this->ttff;
+  out.unix_timestamp_millis = this->unix_timestamp_millis;
+  out.calibrated = this->calibrated;
+  out.gps_mode = this->gps_mode;
+  out.device_fell = this->device_fell;
+  this->device_fell = false;
+
+  out.inputsOK = inputsOK;
+  out.sensorsOK = sensorsOK;
+  out.gpsOK = gpsOK;
+  out.valid = msgValid;
+  out.full = true;
+  out.save_position = false;
+}
+
+void Localizer::publish_thread(LocalizerOutputQueue *queue) {
+  util::set_thread_name("locationd_publish");
+
+  PubMaster pm({"liveLocationKalman"});
+  LocalizerOutput out;
+  while (!do_exit) {
+    if (!queue->try_pop(out)) {
+      util::sleep_for(1);
+      continue;
+    }
+
+    MessageBuilder msg_builder;
+    kj::ArrayPtr<capnp::byte> bytes = this->get_message_bytes(msg_builder, out);
+    pm.send("liveLocationKalman", bytes.begin(), bytes.size());
+
+    if (out.save_position) {
+      VectorXd posGeo = position_geodetic(out.x);
+      std::string lastGPSPosJSON = util::string_format(
+        "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
+      Params().put("LastGPSPosition", lastGPSPosJSON);
+    }
+  }
+}
+
 bool Localizer::is_gps_ok() {
   return (this->kf->get_filter_time() - this->last_gps_msg) < 2.0;
 }
@@ -694,7 +772,12 @@ int Localizer::locationd_thread() {
 
   // TODO: remove carParams once we're always sending at 100Hz
   SubMaster sm(service_list, {}, nullptr, {gps_location_socket, "carParams"});
-  PubMaster pm({"liveLocationKalman"});
+
+  // liveLocationKalman is built, sent and saved on its own thread, started before
+  // this one goes realtime so it doesn't inherit the priority
+  LocalizerOutputQueue outputs;
+  std::thread publisher(&Localizer::publish_thread, this, &outputs);
+  apply_placement("locationd");
 
   uint64_t cnt = 0;
   bool filterInitialized = false;
@@ -703,17 +786,23 @@ int Localizer::locationd_thread() {
     this->observation_values_invalid.insert({service, 0.0});
   }
 
+  // Observations are handled from sm.update() in the order they were sent, avoiding filter rewinds
+  for (const char* service : service_list) {
+    sm.setHandler(service, [&](const cereal::Event::Reader &log) {
+      if (filterInitialized && log.getValid()) {
+        this->handle_msg(log);
+      }
+    });
+  }
+
+  // swapped with the queue's slots, so the outputs' buffers go back and forth
+  LocalizerOutput out;
   while (!do_exit) {
-    sm.update();
-    if (filterInitialized){
+    if (filterInitialized) {
       this->observation_timings_invalid_reset();
-      for (const char* service : service_list) {
-        if (sm.updated(service) && sm.valid(service)){
-          const cereal::Event::Reader log = sm[service];
-          this->handle_msg(log);
-        }
-      }
-    } else {
+    }
+    sm.update();
+    if (!filterInitialized) {
       filterInitialized = sm.allAliveAndValid();
     }
 
@@ -729,28 +818,15 @@ int Localizer::locationd_thread() {
         this->ttff = std::max(1e-3, (sm[trigger_msg].getLogMonoTime() * 1e-9) - this->first_valid_log_time);
       }
 
-      MessageBuilder msg_builder;
-      kj::ArrayPtr<capnp::byte> bytes = this->get_message_bytes(msg_builder, inputsOK, sensorsOK, gpsOK, filterInitialized);
-      pm.send("liveLocationKalman", bytes.begin(), bytes.size());
-
-      if (cnt % 1200 == 0 && gpsOK) {  // once a minute
-        VectorXd posGeo = this->get_position_geodetic();
-        std::string lastGPSPosJSON = util::string_format(
-          "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
-
-        std::thread([] (const std::string gpsjson) {
-          Params().put("LastGPSPosition", gpsjson);
-        }, lastGPSPosJSON).detach();
+      this->get_output(out, inputsOK, sensorsOK, gpsOK, filterInitialized);
+      out.full = cnt % FULL_OUTPUT_DECIMATION == 0;
+      out.save_position = cnt % 1200 == 0 && gpsOK;  // once a minute
+      if (!outputs.try_push(out)) {
+        LOGW("liveLocationKalman publish is behind, dropping an update");
       }
       cnt++;
     }
   }
+  publisher.join();
   return 0;
 }
-
-int main() {
-  util::set_realtime_priority(5);
-
-  Localizer localizer;
-  return localizer.locationd_thread();
-}
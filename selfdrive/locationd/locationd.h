@@ -1,6 +1,7 @@
 #pragma once
 
 #include <eigen3/Eigen/Dense>
+#include <array>
 #include <deque>
 #include <fstream>
 #include <memory>
@@ -11,6 +12,7 @@
 #include "common/transformations/coordinates.hpp"
 #include "common/transformations/orientation.hpp"
 #include "common/params.h"
+#include "common/queue.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
 #include "common/util.h"
@@ -26,6 +28,35 @@ enum LocalizerGnssSource {
   UBLOX, QCOM
 };
 
+// Everything liveLocationKalman is built from, copied out of the filter on each
+// publish so the message is built and sent off the filter thread.
+struct LocalizerOutput {
+  Eigen::VectorXd x;
+  MatrixXdr P;
+  double filter_time = NAN;
+  MatrixXdr calib_from_device;
+  Eigen::Matrix3d ecef2ned_matrix;
+  Eigen::Vector3d init_ecef;
+  std::array<double, POSENET_STD_HIST_HALF * 2> posenet_stds;
+  double car_speed = 0.0;
+  double last_reset_time = NAN;
+  double reset_tracker = 0.0;
+  double ttff = NAN;
+  int64_t unix_timestamp_millis = 0;
+  bool calibrated = false;
+  bool gps_mode = false;
+  bool device_fell = false;
+
+  bool inputsOK = false;
+  bool sensorsOK = false;
+  bool gpsOK = false;
+  bool valid = false;
+  bool full = true;  // otherwise without the device frame, ECEF orientation and NED velocity
+  bool save_position = false;  // also write LastGPSPosition
+};
+
+typedef SPSCQueue<LocalizerOutput, 8> LocalizerOutputQueue;
+
 class Localizer {
 public:
   Localizer(LocalizerGnssSource gnss_source = LocalizerGnssSource::UBLOX);
@@ -47,11 +78,16 @@ public:
 
   kj::ArrayPtr<capnp::byte> get_message_bytes(MessageBuilder& msg_builder,
     bool inputsOK, bool sensorsOK, bool gpsOK, bool msgValid);
-  void build_live_location(cereal::LiveLocationKalman::Builder& fix);
+  kj::ArrayPtr<capnp::byte> get_message_bytes(MessageBuilder& msg_builder, const LocalizerOutput &out);
+  void get_output(LocalizerOutput &out, bool inputsOK, bool sensorsOK, bool gpsOK, bool msgValid);
+  void build_live_location(const LocalizerOutput &out, cereal::LiveLocationKalman::Builder& fix);
+  void publish_thread(LocalizerOutputQueue *queue);
 
   Eigen::VectorXd get_position_geodetic();
   Eigen::VectorXd get_state();
   Eigen::VectorXd get_stdev();
+  size_t get_rewind_count();
+  size_t get_rejected_count();
 
   void handle_msg_bytes(const char *data, const size_t size);
   void handle_msg(const cereal::Event::Reader& log);
@@ -0,0 +1,6 @@
+#include "selfdrive/locationd/locationd.h"
+
+int main() {
+  Localizer localizer;
+  return localizer.locationd_thread();
+}
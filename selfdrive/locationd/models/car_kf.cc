@@ -0,0 +1,40 @@
+#include "selfdrive/locationd/models/car_kf.h"
+
+CarKalman::CarKalman(double steer_ratio, double stiffness_factor, double angle_offset, const double *P_initial) {
+  CarEKF::StateVec x = car_initial_x;
+  x[CAR_STATE_STEER_RATIO_START] = steer_ratio;
+  x[CAR_STATE_STIFFNESS_START] = stiffness_factor;
+  x[CAR_STATE_ANGLE_OFFSET_START] = angle_offset;
+
+  CarEKF::CovMat Q = car_Q_diag.asDiagonal();
+  CarEKF::CovMat P = P_initial ? CarEKF::CovMat(Eigen::Map<const CarEKF::CovMat>(P_initial)) : Q;
+  this->filter = std::make_unique<CarEKF>(this->name, Q, x, P);
+}
+
+const CarEKF::StateVec &CarKalman::get_x() const {
+  return this->filter->state();
+}
+
+const CarEKF::CovMat &CarKalman::get_P() const {
+  return this->filter->covs();
+}
+
+void CarKalman::set_global(const std::string &global_var, double val) {
+  this->filter->set_global(global_var, val);
+}
+
+void CarKalman::set_filter_time(double t) {
+  this->filter->set_filter_time(t);
+}
+
+void CarKalman::reset_rewind() {
+  this->filter->reset_rewind();
+}
+
+bool CarKalman::predict_and_observe(double t, int kind, double meas) {
+  return this->predict_and_observe(t, kind, meas, car_obs_noise.at(kind));
+}
+
+bool CarKalman::predict_and_observe(double t, int kind, double meas, double R) {
+  return this->filter->predict_and_update_batch(t, kind, &meas, &R, 1, 1);
+}
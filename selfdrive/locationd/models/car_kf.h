@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <eigen3/Eigen/Dense>
+
+#include "generated/car_kf_constants.h"
+#include "rednose/helpers/ekf_sym.h"
+#include "rednose/helpers/ekf_sym_fixed.h"
+
+using namespace EKFS;
+
+// every car observation is a single measurement
+typedef EKFSymFixed<CAR_DIM_STATE, CAR_DIM_STATE_ERR, CAR_MAX_OBS_DIM> CarEKF;
+
+// the car model filter of car_kf.py, the vehicle params are set as globals
+class CarKalman {
+public:
+  // P_initial is row major, the process noise when null
+  CarKalman(double steer_ratio, double stiffness_factor, double angle_offset, const double *P_initial = nullptr);
+
+  const CarEKF::StateVec &get_x() const;
+  const CarEKF::CovMat &get_P() const;
+  void set_global(const std::string &global_var, double val);
+  void set_filter_time(double t);
+  void reset_rewind();
+
+  // a scalar observation, R defaults to the kind's noise
+  bool predict_and_observe(double t, int kind, double meas);
+  bool predict_and_observe(double t, int kind, double meas, double R);
+
+private:
+  std::string name = "car";
+  std::unique_ptr<CarEKF> filter;
+};
@@ -42,23 +42,22 @@ LiveKalman::LiveKalman() {
   }
 
   // init filter
-  this->filter = std::make_shared<EKFSym>(this->name, get_mapmat(this->Q), get_mapvec(this->initial_x),
-    get_mapmat(initial_P), this->dim_state, this->dim_state_err, 0, 0, 0, std::vector<int>(),
-    std::vector<int>{3}, std::vector<std::string>(), 0.8);
+  assert(this->dim_state == LIVE_DIM_STATE && this->dim_state_err == LIVE_DIM_STATE_ERR);
+  this->filter = std::make_shared<LiveEKF>(this->name, this->Q, this->initial_x, this->initial_P, std::vector<int>{3}, 0.8);
 }
 
 void LiveKalman::init_state(const VectorXd &state, const VectorXd &covs_diag, double filter_time) {
-  MatrixXdr covs = covs_diag.asDiagonal();
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  LiveEKF::CovMat covs = covs_diag.asDiagonal();
+  this->filter->init_state(state, covs, filter_time);
 }
 
 void LiveKalman::init_state(const VectorXd &state, const MatrixXdr &covs, double filter_time) {
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  this->filter->init_state(state, covs, filter_time);
 }
 
 void LiveKalman::init_state(const VectorXd &state, double filter_time) {
-  MatrixXdr covs = this->filter->covs();
-  this->filter->init_state(get_mapvec(state), get_mapmat(covs), filter_time);
+  LiveEKF::CovMat covs = this->filter->covs();
+  this->filter->init_state(state, covs, filter_time);
 }
 
 VectorXd LiveKalman::get_x() {
@@ -73,6 +72,14 @@ double LiveKalman::get_filter_time() {
   return this->filter->get_filter_time();
 }
 
+size_t LiveKalman::get_rewind_count() {
+  return this->filter->get_rewind_count();
+}
+
+size_t LiveKalman::get_rejected_count() {
+  return this->filter->get_rejected_count();
+}
+
 std::vector<MatrixXdr> LiveKalman::get_R(int kind, int n) {
   std::vector<MatrixXdr> R;
   for (int i = 0; i < n; i++) {
@@ -81,13 +88,13 @@ std::vector<MatrixXdr> LiveKalman::get_R(int kind, int n) {
   return R;
 }
 
-std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, const std::vector<VectorXd> &meas, std::vector<MatrixXdr> R) {
-  std::optional<Estimate> r;
-  if (R.size() == 0) {
-    R = this->get_R(kind, meas.size());
-  }
-  r = this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(meas), get_vec_mapmat(R));
-  return r;
+bool LiveKalman::predict_and_observe(double t, int kind, const Eigen::Ref<const VectorXd> &meas) {
+  return this->predict_and_observe(t, kind, meas, this->obs_noise.at(kind));
+}
+
+bool LiveKalman::predict_and_observe(double t, int kind, const Eigen::Ref<const VectorXd> &meas, const Eigen::Ref<const MatrixXdr> &R) {
+  assert(R.rows() == meas.rows() && R.cols() == meas.rows() && R.outerStride() == R.cols());
+  return this->filter->predict_and_update_batch(t, kind, meas.data(), R.data(), 1, meas.rows());
 }
 
 void LiveKalman::predict(double t) {
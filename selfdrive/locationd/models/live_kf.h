@@ -11,11 +11,15 @@
 
 #include "generated/live_kf_constants.h"
 #include "rednose/helpers/ekf_sym.h"
+#include "rednose/helpers/ekf_sym_fixed.h"
 
 #define EARTH_GM 3.986005e14  // m^3/s^2 (gravitational constant * mass of earth)
 
 using namespace EKFS;
 
+// one measurement per observation, the most locationd passes at once
+typedef EKFSymFixed<LIVE_DIM_STATE, LIVE_DIM_STATE_ERR, LIVE_MAX_OBS_DIM> LiveEKF;
+
 Eigen::Map<Eigen::VectorXd> get_mapvec(const Eigen::VectorXd &vec);
 Eigen::Map<MatrixXdr> get_mapmat(const MatrixXdr &mat);
 std::vector<Eigen::Map<Eigen::VectorXd>> get_vec_mapvec(const std::vector<Eigen::VectorXd> &vec_vec);
@@ -32,9 +36,13 @@ public:
   Eigen::VectorXd get_x();
   MatrixXdr get_P();
   double get_filter_time();
+  size_t get_rewind_count();
+  size_t get_rejected_count();
   std::vector<MatrixXdr> get_R(int kind, int n);
 
-  std::optional<Estimate> predict_and_observe(double t, int kind, const std::vector<Eigen::VectorXd> &meas, std::vector<MatrixXdr> R = {});
+  // one measurement, R defaults to the kind's noise. false if it was too old to rewind to
+  bool predict_and_observe(double t, int kind, const Eigen::Ref<const Eigen::VectorXd> &meas);
+  bool predict_and_observe(double t, int kind, const Eigen::Ref<const Eigen::VectorXd> &meas, const Eigen::Ref<const MatrixXdr> &R);
   std::optional<Estimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
   std::optional<Estimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
@@ -51,7 +59,7 @@ public:
 private:
   std::string name = "live";
 
-  std::shared_ptr<EKFSym> filter;
+  std::shared_ptr<LiveEKF> filter;
 
   int dim_state;
   int dim_state_err;
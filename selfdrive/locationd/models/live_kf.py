@@ -219,6 +219,12 @@ class LiveKalman():
       live_kf_header += f'#define STATE_{state}_LEN {slc.stop - slc.start}\n'
     live_kf_header += "\n"
 
+    # sizes for the fixed size filter
+    live_kf_header += f'#define LIVE_DIM_STATE {dim_state}\n'
+    live_kf_header += f'#define LIVE_DIM_STATE_ERR {dim_state_err}\n'
+    live_kf_header += f'#define LIVE_MAX_OBS_DIM {max(h.shape[0] for h, _, _ in obs_eqs)}\n'
+    live_kf_header += "\n"
+
     for kind, val in inspect.getmembers(ObservationKind, lambda x: isinstance(x, int)):
       live_kf_header += f'#define OBSERVATION_{kind} {val}\n'
     live_kf_header += "\n"
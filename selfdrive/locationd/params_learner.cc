@@ -0,0 +1,90 @@
+#include "selfdrive/locationd/params_learner.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/transformations/coordinates.hpp"
+
+const double DT_MDL = 0.05;  // liveLocationKalman is at the model rate
+const double ROLL_MAX_DELTA = DEG2RAD(20.0) * DT_MDL;  // 20deg in 1 second is well within curvature limits
+const double ROLL_MIN = DEG2RAD(-10.0);
+const double ROLL_MAX = DEG2RAD(10.0);
+const double ROLL_STD_MAX = DEG2RAD(1.5);
+const double MIN_ACTIVE_SPEED = 1.0;
+
+ParamsLearner::ParamsLearner(const CarModelParams &car, double steer_ratio, double stiffness_factor, double angle_offset,
+                             const double *P_initial)
+  : kf(steer_ratio, stiffness_factor, angle_offset, P_initial) {
+  this->kf.set_global("mass", car.mass);
+  this->kf.set_global("rotational_inertia", car.rotational_inertia);
+  this->kf.set_global("center_to_front", car.center_to_front);
+  this->kf.set_global("center_to_rear", car.center_to_rear);
+  this->kf.set_global("stiffness_front", car.stiffness_front);
+  this->kf.set_global("stiffness_rear", car.stiffness_rear);
+}
+
+void ParamsLearner::handle_live_location(double t, double new_yaw_rate, double new_yaw_rate_std, bool yaw_rate_valid,
+                                         double localizer_roll, double localizer_roll_std, bool sensors_ok, bool posenet_ok) {
+  this->yaw_rate = new_yaw_rate;
+  this->yaw_rate_std = new_yaw_rate_std;
+
+  if (std::isnan(localizer_roll_std)) {
+    localizer_roll_std = DEG2RAD(1.0);
+  }
+  this->roll_valid = (localizer_roll_std < ROLL_STD_MAX) && (ROLL_MIN < localizer_roll && localizer_roll < ROLL_MAX) && sensors_ok;
+  double new_roll, roll_std;
+  if (this->roll_valid) {
+    new_roll = localizer_roll;
+    // Experimentally found multiplier of 2 to be best trade-off between stability and accuracy or similar?
+    roll_std = 2 * localizer_roll_std;
+  } else {
+    // This is done to bound the road roll estimate when localizer values are invalid
+    new_roll = 0.0;
+    roll_std = DEG2RAD(10.0);
+  }
+  this->roll = std::clamp(new_roll, this->roll - ROLL_MAX_DELTA, this->roll + ROLL_MAX_DELTA);
+
+  yaw_rate_valid = yaw_rate_valid && 0 < this->yaw_rate_std && this->yaw_rate_std < 10;  // rad/s
+  yaw_rate_valid = yaw_rate_valid && std::abs(this->yaw_rate) < 1;  // rad/s
+
+  if (this->active) {
+    if (posenet_ok) {
+      if (yaw_rate_valid) {
+        this->kf.predict_and_observe(t, OBSERVATION_ROAD_FRAME_YAW_RATE, -this->yaw_rate, std::pow(this->yaw_rate_std, 2));
+      }
+      this->kf.predict_and_observe(t, OBSERVATION_ROAD_ROLL, this->roll, std::pow(roll_std, 2));
+    }
+    this->kf.predict_and_observe(t, OBSERVATION_ANGLE_OFFSET_FAST, 0.0);
+
+    // We observe the current stiffness and steer ratio (with a high observation noise) to bound
+    // the respective estimate STD. Otherwise the STDs keep increasing, causing rapid changes in the
+    // states in longer routes (especially straight stretches).
+    double stiffness = this->kf.get_x()[CAR_STATE_STIFFNESS_START];
+    double steer_ratio = this->kf.get_x()[CAR_STATE_STEER_RATIO_START];
+    this->kf.predict_and_observe(t, OBSERVATION_STIFFNESS, stiffness);
+    this->kf.predict_and_observe(t, OBSERVATION_STEER_RATIO, steer_ratio);
+  }
+  this->hold_when_inactive(t);
+}
+
+void ParamsLearner::handle_car_state(double t, double steering_angle_deg, double v_ego) {
+  this->steering_angle = steering_angle_deg;
+  this->speed = v_ego;
+
+  bool in_linear_region = std::abs(this->steering_angle) < 45;
+  this->active = this->speed > MIN_ACTIVE_SPEED && in_linear_region;
+
+  if (this->active) {
+    this->kf.predict_and_observe(t, OBSERVATION_STEER_ANGLE, DEG2RAD(steering_angle_deg));
+    this->kf.predict_and_observe(t, OBSERVATION_ROAD_FRAME_X_SPEED, this->speed);
+  }
+  this->hold_when_inactive(t);
+}
+
+void ParamsLearner::hold_when_inactive(double t) {
+  if (!this->active) {
+    // Reset time when stopped so uncertainty doesn't grow
+    this->kf.set_filter_time(t);
+    this->kf.reset_rewind();
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "selfdrive/locationd/models/car_kf.h"
+
+// the vehicle params paramsd sets as the car filter's globals, from CarParams
+struct CarModelParams {
+  double mass;
+  double rotational_inertia;
+  double center_to_front;
+  double center_to_rear;
+  double stiffness_front;
+  double stiffness_rear;
+};
+
+// paramsd's learner: feeds the car filter from liveLocationKalman and carState, the
+// fields it reads passed in as plain values. paramsd.py builds liveParameters from x and P.
+class ParamsLearner {
+public:
+  ParamsLearner(const CarModelParams &car, double steer_ratio, double stiffness_factor, double angle_offset,
+                const double *P_initial = nullptr);
+
+  void handle_live_location(double t, double new_yaw_rate, double new_yaw_rate_std, bool yaw_rate_valid,
+                            double localizer_roll, double localizer_roll_std, bool sensors_ok, bool posenet_ok);
+  void handle_car_state(double t, double steering_angle_deg, double v_ego);
+
+  const CarEKF::StateVec &get_x() const { return this->kf.get_x(); }
+  const CarEKF::CovMat &get_P() const { return this->kf.get_P(); }
+
+  bool active = false;
+  double speed = 0.0;
+  double yaw_rate = 0.0;
+  double yaw_rate_std = 0.0;
+  double roll = 0.0;
+  double steering_angle = 0.0;
+  bool roll_valid = false;
+
+private:
+  void hold_when_inactive(double t);
+
+  CarKalman kf;
+};
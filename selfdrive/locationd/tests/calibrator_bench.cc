@@ -0,0 +1,96 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "common/transformations/orientation.hpp"
+#include "selfdrive/locationd/calibrator.h"
+
+// per message cost of the calibrator on synthetic cameraOdometry, driving straight and
+// fast with the device mounted at a fixed pitch and yaw, and how many messages it takes
+// to calibrate from scratch and again after the mount moves. The odometry is seen through
+// the current calibration, like the model's on calibrated frames.
+// Usage: calibrator_bench [messages]
+
+struct CamOdom {
+  double trans[3];
+  double rot[3];
+  double trans_std[3];
+  double wide_from_device_euler[3];
+  double road_transform_trans[3];
+  double road_transform_trans_std[3];
+};
+
+static CamOdom cam_odom(std::mt19937 &gen, const Eigen::Vector3d &calib_rpy, const Eigen::Vector3d &mount_rpy) {
+  std::normal_distribution<double> noise(0.0, 0.002);
+  const double speed = 25.0;
+  Eigen::Vector3d noisy_mount = mount_rpy + Eigen::Vector3d(0.0, noise(gen), noise(gen));
+  Eigen::Vector3d v = euler2rot(calib_rpy).transpose() * euler2rot(noisy_mount) * Eigen::Vector3d(speed, 0.0, 0.0);
+  return {
+    .trans = {v[0], v[1], v[2]},
+    .rot = {0.0, 0.0, noise(gen)},
+    .trans_std = {0.1, 0.05, 0.05},
+    .wide_from_device_euler = {0.0, 0.0, 0.0},
+    .road_transform_trans = {0.0, 0.0, 1.22 + noise(gen)},
+    .road_transform_trans_std = {0.01, 0.01, 0.01},
+  };
+}
+
+// with recalibrate, calibrated only counts once it has been recalibrating
+static int messages_until_calibrated(Calibrator &calibrator, std::mt19937 &gen, const Eigen::Vector3d &mount_rpy, int limit,
+                                     bool recalibrate = false) {
+  Eigen::Vector3d new_rpy;
+  bool waiting = recalibrate;
+  for (int i = 0; i < limit; i++) {
+    CamOdom o = cam_odom(gen, calibrator.get_smooth_rpy(), mount_rpy);
+    calibrator.handle_cam_odom(25.0, o.trans, o.rot, o.trans_std, o.wide_from_device_euler,
+                               o.road_transform_trans, o.road_transform_trans_std, new_rpy);
+    waiting = waiting && calibrator.cal_status != Calibrator::RECALIBRATING;
+    if (!waiting && calibrator.cal_status == Calibrator::CALIBRATED) {
+      return i + 1;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  const int messages = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const Eigen::Vector3d mount_rpy(0.0, 0.03, -0.01);
+  // a 3 degree yaw change, the spread check resets to the newest block and calibrates again
+  const Eigen::Vector3d moved_rpy = mount_rpy + Eigen::Vector3d(0.0, 0.0, 0.05);
+  std::mt19937 gen(0);
+
+  Calibrator calibrator;
+  printf("calibrated from scratch after %d messages\n", messages_until_calibrated(calibrator, gen, mount_rpy, messages));
+  int moved = messages_until_calibrated(calibrator, gen, moved_rpy, messages, true);
+  Eigen::Vector3d rpy = calibrator.get_smooth_rpy();
+  printf("calibrated again after the mount moved in %d messages\n", moved);
+  printf("rpy %.5f %.5f %.5f, mounted at %.5f %.5f %.5f\n", rpy[0], rpy[1], rpy[2], moved_rpy[0], moved_rpy[1], moved_rpy[2]);
+
+  // timed from there on, the odometry made up front through the settled calibration
+  std::vector<CamOdom> odoms;
+  for (int i = 0; i < messages; i++) {
+    odoms.push_back(cam_odom(gen, rpy, moved_rpy));
+  }
+
+  Eigen::Vector3d new_rpy;
+  auto start = std::chrono::steady_clock::now();
+  for (const CamOdom &o : odoms) {
+    calibrator.handle_cam_odom(25.0, o.trans, o.rot, o.trans_std, o.wide_from_device_euler,
+                               o.road_transform_trans, o.road_transform_trans_std, new_rpy);
+  }
+  double used_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / messages;
+
+  // stopped, rejected before any math
+  start = std::chrono::steady_clock::now();
+  for (const CamOdom &o : odoms) {
+    calibrator.handle_cam_odom(0.0, o.trans, o.rot, o.trans_std, o.wide_from_device_euler,
+                               o.road_transform_trans, o.road_transform_trans_std, new_rpy);
+  }
+  double rejected_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / messages;
+
+  printf("%d messages: %.0f ns per used, %.0f ns per rejected, status %d\n", messages, used_ns, rejected_ns, calibrator.cal_status);
+  return 0;
+}
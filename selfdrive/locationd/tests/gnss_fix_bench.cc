@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "common/transformations/coordinates.hpp"
+#include "selfdrive/locationd/gnss_fix.h"
+
+// Position and velocity fixes per epoch from a synthetic sky: satellites spread
+// over the receiver's hemisphere, pseudoranges with clock and GLONASS biases and
+// noise. Reports the time per epoch and the error against the truth.
+// Usage: gnss_fix_bench [epochs] [satellites]
+
+const double SPEED_OF_LIGHT = 2.99792458e8;
+const double EARTH_ROTATION_RATE = 7.2921151467e-5;
+
+int main(int argc, char *argv[]) {
+  const int epochs = argc > 1 ? std::atoi(argv[1]) : 10000;
+  const int num_sats = argc > 2 ? std::atoi(argv[2]) : 12;
+
+  std::mt19937 rng(0);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  const Geodetic rcv_geo = {37.7749, -122.4194, 10.0};
+  LocalCoord local(rcv_geo);
+  const Eigen::Vector3d rcv_pos = local.init_ecef;
+  const Eigen::Vector3d rcv_vel = local.ned2ecef_matrix * Eigen::Vector3d(20.0, 5.0, 0.0);
+  const double clock_bias = 1.5e4, glonass_bias = 30.0, clock_drift = 80.0;
+
+  double pos_err = 0.0, vel_err = 0.0, ns = 0.0;
+  int fixes = 0;
+  for (int e = 0; e < epochs; e++) {
+    std::vector<GnssFixMeasurement> measurements(num_sats);
+    for (int i = 0; i < num_sats; i++) {
+      GnssFixMeasurement &m = measurements[i];
+      m.glonass = i % 3 == 2;
+      // somewhere above 15 degrees elevation, ~20000km up
+      double az = 2 * M_PI * uniform(rng), el = DEG2RAD(15.0 + 75.0 * uniform(rng));
+      Eigen::Vector3d ned_dir(std::cos(el) * std::cos(az), std::cos(el) * std::sin(az), -std::sin(el));
+      m.sat_pos = rcv_pos + local.ned2ecef_matrix * ned_dir * 2.0e7;
+      m.sat_vel = local.ned2ecef_matrix * Eigen::Vector3d(noise(rng), noise(rng), noise(rng)) * 3000.0;
+
+      // the signal left before the earth turned by theta, invert what the fix undoes
+      double range = (m.sat_pos - rcv_pos).norm();
+      double theta = EARTH_ROTATION_RATE * range / SPEED_OF_LIGHT;
+      Eigen::Vector3d sat = m.sat_pos;
+      m.sat_pos << sat(0) * std::cos(theta) - sat(1) * std::sin(theta), sat(1) * std::cos(theta) + sat(0) * std::sin(theta), sat(2);
+
+      m.pseudorange_std = 5.0;
+      m.pseudorange = range + clock_bias + (m.glonass ? glonass_bias : 0.0) + m.pseudorange_std * noise(rng);
+      m.pseudorange_rate_std = 0.5;
+      Eigen::Vector3d los = (m.sat_pos - rcv_pos).normalized();
+      m.pseudorange_rate = los.dot(m.sat_vel - rcv_vel) + clock_drift + m.pseudorange_rate_std * noise(rng);
+    }
+
+    GnssFix pos, vel;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = calc_pos_fix(measurements, pos, 5) && calc_vel_fix(measurements, pos.x.head<3>(), vel, 5);
+    ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (ok) {
+      pos_err += (pos.x.head<3>() - rcv_pos).norm();
+      vel_err += (vel.x.head<3>() - rcv_vel).norm();
+      fixes++;
+    }
+  }
+
+  printf("%d epochs, %d satellites: %.1f us per epoch, %d fixes\n", epochs, num_sats, ns / epochs / 1e3, fixes);
+  printf("mean position error %.2f m, velocity error %.3f m/s\n", pos_err / fixes, vel_err / fixes);
+  return 0;
+}
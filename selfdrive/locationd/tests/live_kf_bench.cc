@@ -0,0 +1,72 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "selfdrive/locationd/models/live_kf.h"
+
+// predict + update of the live filter per observation kind, the fixed size LiveEKF
+// locationd runs against the dynamic EKFSym it replaced, stepping 10ms per update.
+// Usage: live_kf_bench [iterations]
+
+static const std::map<int, const char *> KIND_NAMES = {
+  {OBSERVATION_PHONE_GYRO, "phone_gyro"},
+  {OBSERVATION_PHONE_ACCEL, "phone_accel"},
+  {OBSERVATION_NO_ROT, "no_rot"},
+  {OBSERVATION_NO_ACCEL, "no_accel"},
+  {OBSERVATION_ECEF_POS, "ecef_pos"},
+  {OBSERVATION_ECEF_VEL, "ecef_vel"},
+  {OBSERVATION_ECEF_ORIENTATION_FROM_GPS, "ecef_orientation_from_gps"},
+  {OBSERVATION_CAMERA_ODO_TRANSLATION, "camera_odo_translation"},
+  {OBSERVATION_CAMERA_ODO_ROTATION, "camera_odo_rotation"},
+};
+
+// a measurement the filter agrees with, so every kind runs the same path from the initial state
+static Eigen::VectorXd measurement(int kind, const Eigen::VectorXd &x, int dim) {
+  if (kind == OBSERVATION_ECEF_POS) return x.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
+  if (kind == OBSERVATION_ECEF_ORIENTATION_FROM_GPS) return x.segment<STATE_ECEF_ORIENTATION_LEN>(STATE_ECEF_ORIENTATION_START);
+  return Eigen::VectorXd::Zero(dim);
+}
+
+template <typename F>
+static double ns_per_iteration(int iterations, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    f(i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  const int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+  Eigen::VectorXd x0 = live_initial_x;
+  MatrixXdr P0 = live_initial_P_diag.asDiagonal();
+  MatrixXdr Q = live_Q_diag.asDiagonal();
+
+  printf("%-28s %12s %12s\n", "kind", "fixed ns", "dynamic ns");
+  for (const auto &[kind, name] : KIND_NAMES) {
+    // camera odometry translation comes with its own noise, locationd passes it along
+    auto noise = live_obs_noise_diag.find(kind);
+    const MatrixXdr R = noise != live_obs_noise_diag.end() ? MatrixXdr(noise->second.asDiagonal()) : MatrixXdr::Identity(3, 3);
+    const Eigen::VectorXd z = measurement(kind, x0, R.rows());
+
+    LiveEKF fixed("live", Q, x0, P0, {STATE_ECEF_ORIENTATION_START}, 0.8);
+    const LiveEKF::ObsVec fz = z;
+    const LiveEKF::ObsMat fR = R;
+    double fixed_ns = ns_per_iteration(iterations, [&](int i) {
+      fixed.predict_and_update_batch(i * 0.01, kind, &fz, &fR, 1);
+    });
+
+    EKFSym dynamic("live", get_mapmat(Q), get_mapvec(x0), get_mapmat(P0), x0.rows(), P0.rows(), 0, 0, 0,
+                   std::vector<int>(), std::vector<int>{STATE_ECEF_ORIENTATION_START}, std::vector<std::string>(), 0.8);
+    double dynamic_ns = ns_per_iteration(iterations, [&](int i) {
+      dynamic.predict_and_update_batch(i * 0.01, kind, {get_mapvec(z)}, {get_mapmat(R)});
+    });
+
+    printf("%-28s %12.0f %12.0f\n", name, fixed_ns, dynamic_ns);
+  }
+  return 0;
+}
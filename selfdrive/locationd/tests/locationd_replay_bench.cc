@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "common/bench.h"
+#include "selfdrive/locationd/locationd.h"
+
+// Feeds the locationd inputs of a decompressed rlog straight into Localizer, in
+// logMonoTime order and as fast as it goes, no sockets. Reports throughput, time
+// per handled event type and filter rewinds. The pose at each cameraOdometry can
+// be saved as a reference and compared against on a later run, which catches
+// accuracy changes as well as speed ones when working on the filter. --json writes
+// the common daemon bench report, see common/bench.h.
+// Usage: locationd_replay_bench [--qcom] [--save-ref FILE] [--ref FILE] [--json FILE] rlog
+
+struct Pose {
+  uint64_t mono_time;
+  double pos[3];  // ECEF
+  double quat[4];  // ECEF orientation
+  double vel[3];  // ECEF
+};
+
+struct HandlerStats {
+  uint64_t count = 0;
+  double total_ns = 0, max_ns = 0;
+};
+
+struct InputEvent {
+  uint64_t mono_time;
+  cereal::Event::Which which;
+  const char *data;
+  size_t size;
+};
+
+static Pose get_pose(Localizer &localizer, uint64_t mono_time) {
+  Eigen::VectorXd x = localizer.get_state();
+  Pose p = {.mono_time = mono_time};
+  Eigen::Map<Eigen::Vector3d>(p.pos) = x.segment<STATE_ECEF_POS_LEN>(STATE_ECEF_POS_START);
+  Eigen::Map<Eigen::Vector4d>(p.quat) = x.segment<STATE_ECEF_ORIENTATION_LEN>(STATE_ECEF_ORIENTATION_START);
+  Eigen::Map<Eigen::Vector3d>(p.vel) = x.segment<STATE_ECEF_VELOCITY_LEN>(STATE_ECEF_VELOCITY_START);
+  return p;
+}
+
+static void compare(const std::vector<Pose> &poses, const std::vector<Pose> &ref) {
+  double pos_sum = 0, pos_max = 0, rot_sum = 0, rot_max = 0, vel_sum = 0, vel_max = 0;
+  size_t n = std::min(poses.size(), ref.size());
+  size_t compared = 0;
+  for (size_t i = 0; i < n && poses[i].mono_time == ref[i].mono_time; i++, compared++) {
+    double dpos = (Eigen::Map<const Eigen::Vector3d>(poses[i].pos) - Eigen::Map<const Eigen::Vector3d>(ref[i].pos)).norm();
+    double dvel = (Eigen::Map<const Eigen::Vector3d>(poses[i].vel) - Eigen::Map<const Eigen::Vector3d>(ref[i].vel)).norm();
+    // angle between the orientations, either sign of the quaternion is the same rotation
+    double dot = std::abs(Eigen::Map<const Eigen::Vector4d>(poses[i].quat).dot(Eigen::Map<const Eigen::Vector4d>(ref[i].quat)));
+    double drot = RAD2DEG(2.0 * std::acos(std::min(1.0, dot)));
+    pos_sum += dpos; vel_sum += dvel; rot_sum += drot;
+    pos_max = std::max(pos_max, dpos);
+    vel_max = std::max(vel_max, dvel);
+    rot_max = std::max(rot_max, drot);
+  }
+
+  printf("\nagainst reference: %zu of %zu poses compared\n", compared, ref.size());
+  if (compared != poses.size() || compared != ref.size()) {
+    printf("  poses diverged in time or count, the inputs or the filter's timing changed\n");
+  }
+  if (compared > 0) {
+    printf("  %-18s %12s %12s\n", "", "mean", "max");
+    printf("  %-18s %12.6f %12.6f\n", "position (m)", pos_sum / compared, pos_max);
+    printf("  %-18s %12.6f %12.6f\n", "orientation (deg)", rot_sum / compared, rot_max);
+    printf("  %-18s %12.6f %12.6f\n", "velocity (m/s)", vel_sum / compared, vel_max);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool qcom = false;
+  std::string save_ref, ref_path, json_path, rlog;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--qcom") == 0) {
+      qcom = true;
+    } else if (strcmp(argv[i], "--save-ref") == 0 && i + 1 < argc) {
+      save_ref = argv[++i];
+    } else if (strcmp(argv[i], "--ref") == 0 && i + 1 < argc) {
+      ref_path = argv[++i];
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      rlog = argv[i];
+    }
+  }
+  if (rlog.empty()) {
+    fprintf(stderr, "usage: %s [--qcom] [--save-ref FILE] [--ref FILE] [--json FILE] rlog\n", argv[0]);
+    return 1;
+  }
+  if (util::ends_with(rlog, ".bz2")) {
+    fprintf(stderr, "%s is compressed, bunzip2 it first\n", rlog.c_str());
+    return 1;
+  }
+
+  // sockets the daemon subscribes to, the gps one depends on the receiver
+  const std::map<cereal::Event::Which, const char *> inputs = {
+    {cereal::Event::ACCELEROMETER, "accelerometer"},
+    {cereal::Event::GYROSCOPE, "gyroscope"},
+    {qcom ? cereal::Event::GPS_LOCATION : cereal::Event::GPS_LOCATION_EXTERNAL, qcom ? "gpsLocation" : "gpsLocationExternal"},
+    {cereal::Event::CAR_STATE, "carState"},
+    {cereal::Event::CAMERA_ODOMETRY, "cameraOdometry"},
+    {cereal::Event::LIVE_CALIBRATION, "liveCalibration"},
+  };
+
+  std::string raw = util::read_file(rlog);
+  auto words = kj::heapArray<capnp::word>(raw.size() / sizeof(capnp::word));
+  memcpy(words.begin(), raw.data(), words.size() * sizeof(capnp::word));
+
+  std::vector<InputEvent> events;
+  kj::ArrayPtr<const capnp::word> remaining = words.asPtr();
+  try {
+    while (remaining.size() > 0) {
+      capnp::FlatArrayMessageReader reader(remaining);
+      cereal::Event::Reader event = reader.getRoot<cereal::Event>();
+      // invalid messages are dropped by the daemon's handlers as well
+      if (inputs.count(event.which()) && event.getValid()) {
+        events.push_back({event.getLogMonoTime(), event.which(), (const char *)remaining.begin(),
+                          (reader.getEnd() - remaining.begin()) * sizeof(capnp::word)});
+      }
+      remaining = kj::arrayPtr(reader.getEnd(), remaining.end());
+    }
+  } catch (const kj::Exception &e) {
+    fprintf(stderr, "stopped at a corrupt event: %s\n", e.getDescription().cStr());
+  }
+  // SubMaster hands them out in the order they were sent
+  std::stable_sort(events.begin(), events.end(), [](const InputEvent &a, const InputEvent &b) {
+    return a.mono_time < b.mono_time;
+  });
+
+  Localizer localizer(qcom ? LocalizerGnssSource::QCOM : LocalizerGnssSource::UBLOX);
+  std::map<cereal::Event::Which, HandlerStats> stats;
+  std::vector<Pose> poses;
+  BenchReport report("locationd");
+
+  auto start = std::chrono::steady_clock::now();
+  for (const InputEvent &e : events) {
+    auto t = std::chrono::steady_clock::now();
+    localizer.handle_msg_bytes(e.data, e.size);
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t).count();
+
+    HandlerStats &s = stats[e.which];
+    s.count++;
+    s.total_ns += ns;
+    s.max_ns = std::max(s.max_ns, ns);
+    report.add_ns(inputs.at(e.which), ns);
+    if (e.which == cereal::Event::CAMERA_ODOMETRY) {
+      poses.push_back(get_pose(localizer, e.mono_time));
+    }
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  double log_secs = events.empty() ? 0.0 : (events.back().mono_time - events.front().mono_time) * 1e-9;
+  printf("%zu events (%.1fs of log) in %.3fs: %.0f events/s, %.0fx realtime\n",
+         events.size(), log_secs, secs, events.size() / secs, log_secs / secs);
+  printf("%-22s %10s %10s %10s\n", "event", "count", "mean us", "max us");
+  for (const auto &[which, s] : stats) {
+    printf("%-22s %10lu %10.2f %10.2f\n", inputs.at(which), s.count, s.total_ns / s.count / 1e3, s.max_ns / 1e3);
+  }
+  printf("rewinds: %zu, too old to rewind: %zu\n", localizer.get_rewind_count(), localizer.get_rejected_count());
+
+  if (!json_path.empty()) {
+    report.set("rewinds", (double)localizer.get_rewind_count());
+    report.finish(log_secs);
+    report.write(json_path);
+  }
+
+  if (!save_ref.empty()) {
+    util::write_file(save_ref.c_str(), poses.data(), poses.size() * sizeof(Pose), O_WRONLY | O_CREAT | O_TRUNC);
+    printf("saved %zu poses to %s\n", poses.size(), save_ref.c_str());
+  }
+  if (!ref_path.empty()) {
+    std::string ref_raw = util::read_file(ref_path);
+    std::vector<Pose> ref(ref_raw.size() / sizeof(Pose));
+    memcpy(ref.data(), ref_raw.data(), ref.size() * sizeof(Pose));
+    compare(poses, ref);
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "selfdrive/locationd/torque_buckets.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include <eigen3/Eigen/Dense>
+
+void TorqueBuckets::Moments::add(double px, double py, double sign) {
+  n += sign;
+  x += sign * px;
+  y += sign * py;
+  xx += sign * px * px;
+  xy += sign * px * py;
+  yy += sign * py * py;
+}
+
+TorqueBuckets::TorqueBuckets(const std::vector<std::pair<double, double>> &x_bounds, const std::vector<double> &min_points,
+                             size_t min_points_total, size_t points_per_bucket)
+  : min_points_total(min_points_total), points_per_bucket(points_per_bucket) {
+  assert(x_bounds.size() == min_points.size() && points_per_bucket > 0);
+  for (size_t i = 0; i < x_bounds.size(); i++) {
+    Bucket &b = this->buckets.emplace_back();
+    b.min_x = x_bounds[i].first;
+    b.max_x = x_bounds[i].second;
+    b.min_points = min_points[i];
+    b.points.reserve(points_per_bucket);
+  }
+}
+
+void TorqueBuckets::add_point(double x, double y) {
+  for (Bucket &b : this->buckets) {
+    if (x >= b.min_x && x < b.max_x) {
+      if (b.points.size() < this->points_per_bucket) {
+        b.points.emplace_back(x, y);
+        b.sums.add(x, y, 1.0);
+        return;
+      }
+
+      auto &oldest = b.points[b.head];
+      b.sums.add(oldest.first, oldest.second, -1.0);
+      oldest = {x, y};
+      b.sums.add(x, y, 1.0);
+      b.head = (b.head + 1) % this->points_per_bucket;
+      if (b.head == 0) {
+        // every point was replaced once, start the sums over so the subtractions don't drift
+        b.sums = Moments();
+        for (const auto &[px, py] : b.points) {
+          b.sums.add(px, py, 1.0);
+        }
+      }
+      return;
+    }
+  }
+}
+
+size_t TorqueBuckets::size() const {
+  size_t n = 0;
+  for (const Bucket &b : this->buckets) {
+    n += b.points.size();
+  }
+  return n;
+}
+
+std::vector<size_t> TorqueBuckets::bucket_lengths() const {
+  std::vector<size_t> lengths;
+  for (const Bucket &b : this->buckets) {
+    lengths.push_back(b.points.size());
+  }
+  return lengths;
+}
+
+bool TorqueBuckets::is_valid() const {
+  for (const Bucket &b : this->buckets) {
+    if (b.points.size() < b.min_points) return false;
+  }
+  return this->size() >= this->min_points_total;
+}
+
+bool TorqueBuckets::fit(double &slope, double &offset, double &spread_std) const {
+  Moments m;
+  for (const Bucket &b : this->buckets) {
+    m.n += b.sums.n; m.x += b.sums.x; m.y += b.sums.y;
+    m.xx += b.sums.xx; m.xy += b.sums.xy; m.yy += b.sums.yy;
+  }
+  if (m.n < 3) return false;
+
+  // total least squares as both x and y are noisy observations: the rows [x, 1, y] are
+  // closest to the plane normal to the smallest eigenvector of their gram matrix, the
+  // right singular vector torqued used to take from an SVD of all the points
+  Eigen::Matrix3d gram;
+  gram << m.xx, m.x, m.xy,
+          m.x,  m.n, m.y,
+          m.xy, m.y, m.yy;
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(gram);
+  if (solver.info() != Eigen::Success) return false;
+  Eigen::Vector3d v = solver.eigenvectors().col(0);
+  if (v[2] == 0.0) return false;
+  slope = -v[0] / v[2];
+  offset = -v[1] / v[2];
+
+  // std of the points rotated onto the line, across it
+  double sin_a = std::sqrt(slope * slope / (slope * slope + 1));
+  double cos_a = std::sqrt(1 / (slope * slope + 1));
+  double var_x = m.xx / m.n - std::pow(m.x / m.n, 2);
+  double var_y = m.yy / m.n - std::pow(m.y / m.n, 2);
+  double cov_xy = m.xy / m.n - (m.x / m.n) * (m.y / m.n);
+  double var = sin_a * sin_a * var_x - 2 * sin_a * cos_a * cov_xy + cos_a * cos_a * var_y;
+  spread_std = std::sqrt(std::max(var, 0.0));
+  return true;
+}
+
+std::vector<double> TorqueBuckets::get_points() const {
+  std::vector<double> out;
+  out.reserve(this->size() * 2);
+  for (const Bucket &b : this->buckets) {
+    for (size_t i = 0; i < b.points.size(); i++) {
+      const auto &[x, y] = b.points[(b.head + i) % b.points.size()];
+      out.push_back(x);
+      out.push_back(y);
+    }
+  }
+  return out;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// torqued's (steer torque, lateral acceleration) points, the newest points_per_bucket
+// of each steer bucket. Sums of the points are kept up to date as they come and go, so
+// the total least squares fit costs the same however many points there are.
+class TorqueBuckets {
+public:
+  TorqueBuckets(const std::vector<std::pair<double, double>> &x_bounds, const std::vector<double> &min_points,
+                size_t min_points_total, size_t points_per_bucket);
+
+  // dropped when x is outside every bucket
+  void add_point(double x, double y);
+  size_t size() const;
+  std::vector<size_t> bucket_lengths() const;
+  bool is_valid() const;
+  // the line through all points and the spread around it, false if the points don't make one
+  bool fit(double &slope, double &offset, double &spread_std) const;
+  // n x 2 row major, bucket by bucket, oldest first
+  std::vector<double> get_points() const;
+
+private:
+  struct Moments {
+    double n = 0, x = 0, y = 0, xx = 0, xy = 0, yy = 0;
+    void add(double px, double py, double sign);
+  };
+
+  struct Bucket {
+    double min_x, max_x, min_points;
+    std::vector<std::pair<double, double>> points;  // ring once full
+    size_t head = 0;
+    Moments sums;
+  };
+
+  std::vector<Bucket> buckets;
+  size_t min_points_total;
+  size_t points_per_bucket;
+};
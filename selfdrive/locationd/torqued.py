@@ -12,14 +12,12 @@ from openpilot.common.realtime import config_realtime_process, DT_MDL
 from openpilot.common.filter_simple import FirstOrderFilter
 from openpilot.system.swaglog import cloudlog
 from openpilot.selfdrive.controls.lib.vehicle_model import ACCELERATION_DUE_TO_GRAVITY
-from openpilot.selfdrive.locationd.helpers import PointBuckets
+from openpilot.selfdrive.locationd.estimators_pyx import TorqueBuckets  # pylint: disable=no-name-in-module, import-error
 
 HISTORY = 5  # secs
 POINTS_PER_BUCKET = 1500
 MIN_POINTS_TOTAL = 4000
 MIN_POINTS_TOTAL_QLOG = 600
-FIT_POINTS_TOTAL = 2000
-FIT_POINTS_TOTAL_QLOG = 600
 MIN_VEL = 15  # m/s
 FRICTION_FACTOR = 1.5  # ~85% of data coverage
 FACTOR_SANITY = 0.3
@@ -38,20 +36,6 @@ VERSION = 1  # bump this to invalidate old parameter caches
 ALLOWED_CARS = ['toyota', 'hyundai']
 
 
-def slope2rot(slope):
-  sin = np.sqrt(slope**2 / (slope**2 + 1))
-  cos = np.sqrt(1 / (slope**2 + 1))
-  return np.array([[cos, -sin], [sin, cos]])
-
-
-class TorqueBuckets(PointBuckets):
-  def add_point(self, x, y):
-    for bound_min, bound_max in self.x_bounds:
-      if (x >= bound_min) and (x < bound_max):
-        self.buckets[(bound_min, bound_max)].append([x, 1.0, y])
-        break
-
-
 class TorqueEstimator:
   def __init__(self, CP, decimated=False):
     self.hist_len = int(HISTORY / DT_MDL)
@@ -59,14 +43,12 @@ class TorqueEstimator:
     if decimated:
       self.min_bucket_points = MIN_BUCKET_POINTS / 10
       self.min_points_total = MIN_POINTS_TOTAL_QLOG
-      self.fit_points = FIT_POINTS_TOTAL_QLOG
       self.factor_sanity = FACTOR_SANITY_QLOG
       self.friction_sanity = FRICTION_SANITY_QLOG
 
     else:
       self.min_bucket_points = MIN_BUCKET_POINTS
       self.min_points_total = MIN_POINTS_TOTAL
-      self.fit_points = FIT_POINTS_TOTAL
       self.factor_sanity = FACTOR_SANITY
       self.friction_sanity = FRICTION_SANITY
 
@@ -137,22 +119,16 @@ class TorqueEstimator:
     self.filtered_points = TorqueBuckets(x_bounds=STEER_BUCKET_BOUNDS,
                                          min_points=self.min_bucket_points,
                                          min_points_total=self.min_points_total,
-                                         points_per_bucket=POINTS_PER_BUCKET,
-                                         rowsize=3)
+                                         points_per_bucket=POINTS_PER_BUCKET)
 
   def estimate_params(self):
-    points = self.filtered_points.get_points(self.fit_points)
     # total least square solution as both x and y are noisy observations
     # this is empirically the slope of the hysteresis parallelogram as opposed to the line through the diagonals
-    try:
-      _, _, v = np.linalg.svd(points, full_matrices=False)
-      slope, offset = -v.T[0:2, 2] / v.T[2, 2]
-      _, spread = np.matmul(points[:, [0, 2]], slope2rot(slope)).T
-      friction_coeff = np.std(spread) * FRICTION_FACTOR
-    except np.linalg.LinAlgError as e:
-      cloudlog.exception(f"Error computing live torque params: {e}")
-      slope = offset = friction_coeff = np.nan
-    return slope, offset, friction_coeff
+    # fit over every point, from sums the buckets keep as points come and go
+    slope, offset, spread_std = self.filtered_points.fit()
+    if np.isnan(slope):
+      cloudlog.error("Error computing live torque params: points don't fit a line")
+    return slope, offset, spread_std * FRICTION_FACTOR
 
   def update_params(self, params):
     self.decay = min(self.decay + DT_MDL, MAX_FILTER_DECAY)
@@ -207,7 +183,7 @@ class TorqueEstimator:
       liveTorqueParameters.liveValid = False
 
     if with_points:
-      liveTorqueParameters.points = self.filtered_points.get_points()[:, [0, 2]].tolist()
+      liveTorqueParameters.points = self.filtered_points.get_points().tolist()
 
     liveTorqueParameters.latAccelFactorFiltered = float(self.filtered_params['latAccelFactor'].x)
     liveTorqueParameters.latAccelOffsetFiltered = float(self.filtered_params['latAccelOffset'].x)
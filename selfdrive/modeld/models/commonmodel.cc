@@ -9,40 +9,75 @@
 #include "common/mat.h"
 #include "common/timing.h"
 
-ModelFrame::ModelFrame(cl_device_id device_id, cl_context context) {
-  input_frames = std::make_unique<float[]>(buf_size);
-
+ModelFrame::ModelFrame(cl_device_id device_id, cl_context context, ModelInputType _input_type) : input_type(_input_type) {
+  const size_t net_input_size = buf_size * model_input_elem_size(input_type);
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
   y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
   u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
   v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
-  net_input_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_FRAME_SIZE * sizeof(float), NULL, &err));
+  net_input_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, net_input_size, NULL, &err));
+  // start from a zeroed history like the host buffer did, zero has the same bits in every type
+  const uint8_t zero = 0;
+  CL_CHECK(clEnqueueFillBuffer(q, net_input_cl, &zero, sizeof(zero), 0, net_input_size, 0, NULL, NULL));
 
   transform_init(&transform, context, device_id);
   loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
 }
 
 float* ModelFrame::prepare(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3 &projection, cl_mem *output) {
-  transform_queue(&this->transform, q,
-                  yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
-                  y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, projection);
+  queue(yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset, projection, output);
+  return finish();
+}
 
-  if (output == NULL) {
-    loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, net_input_cl);
+void ModelFrame::queue(cl_mem yuv_cl, int frame_width, int frame_height, int frame_stride, int frame_uv_offset, const mat3 &projection, cl_mem *output) {
+  assert(ready == nullptr);
+  // the runner is done with the last frame once the next one is queued
+  if (input_frames != nullptr) {
+    CL_CHECK(clEnqueueUnmapMemObject(q, net_input_cl, input_frames, 0, NULL, NULL));
+    input_frames = nullptr;
+  }
+
+  cl_mem out_cl = output == NULL ? net_input_cl : *output;
+  // loadys/loaduv only write floats
+  if (unfused_warp && input_type == ModelInputType::FLOAT32) {
+    transform_queue(&this->transform, q,
+                    yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
+                    y_cl, u_cl, v_cl, MODEL_WIDTH, MODEL_HEIGHT, projection);
+    loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, out_cl, true);
+  } else {
+    loadyuv_warp_queue(&loadyuv, q, yuv_cl, frame_width, frame_height, frame_stride, frame_uv_offset,
+                       projection, out_cl, true, input_type);
+  }
 
-    std::memmove(&input_frames[0], &input_frames[MODEL_FRAME_SIZE], sizeof(float) * MODEL_FRAME_SIZE);
-    CL_CHECK(clEnqueueReadBuffer(q, net_input_cl, CL_TRUE, 0, MODEL_FRAME_SIZE * sizeof(float), &input_frames[MODEL_FRAME_SIZE], 0, nullptr, nullptr));
-    clFinish(q);
-    return &input_frames[0];
+  if (output == NULL) {
+    // with the GPU and CPU sharing memory the map is only a sync, not a copy. the pointer
+    // is valid right away, the data once the event completes
+    input_frames = (float *)CL_CHECK_ERR(clEnqueueMapBuffer(q, net_input_cl, CL_FALSE, CL_MAP_READ, 0,
+                                                            buf_size * model_input_elem_size(input_type), 0, NULL, &ready, &err));
   } else {
-    loadyuv_queue(&loadyuv, q, y_cl, u_cl, v_cl, *output, true);
-    // NOTE: Since thneed is using a different command queue, this clFinish is needed to ensure the image is ready.
-    clFinish(q);
-    return NULL;
+    CL_CHECK(clEnqueueMarkerWithWaitList(q, 0, NULL, &ready));
   }
+  // start the work now, the caller can go on to queue the other camera before waiting
+  CL_CHECK(clFlush(q));
+}
+
+float* ModelFrame::finish() {
+  assert(ready != nullptr);
+  // NOTE: thneed replays its commands outside of OpenCL, so it can't take the event in a wait list
+  CL_CHECK(clWaitForEvents(1, &ready));
+  CL_CHECK(clReleaseEvent(ready));
+  ready = nullptr;
+  return input_frames;
 }
 
 ModelFrame::~ModelFrame() {
+  if (ready != nullptr) {
+    finish();
+  }
+  if (input_frames != nullptr) {
+    CL_CHECK(clEnqueueUnmapMemObject(q, net_input_cl, input_frames, 0, NULL, NULL));
+    CL_CHECK(clFinish(q));
+  }
   transform_destroy(&transform);
   loadyuv_destroy(&loadyuv);
   CL_CHECK(clReleaseMemObject(net_input_cl));
@@ -52,15 +87,107 @@ ModelFrame::~ModelFrame() {
   CL_CHECK(clReleaseCommandQueue(q));
 }
 
+#ifdef __aarch64__
+#include <arm_neon.h>
+
+// cephes style expf, within 2 ulp of expf
+static inline float32x4_t exp_f32x4(float32x4_t x) {
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-88.3762626647949f)), vdupq_n_f32(88.3762626647949f));
+
+  // x = n*ln2 + r, |r| <= ln2/2
+  const float32x4_t n = vrndmq_f32(vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(1.44269504088896341f)));
+  x = vmlsq_f32(x, n, vdupq_n_f32(0.693359375f));
+  x = vmlsq_f32(x, n, vdupq_n_f32(-2.12194440e-4f));
+
+  float32x4_t y = vdupq_n_f32(1.9875691500e-4f);
+  y = vmlaq_f32(vdupq_n_f32(1.3981999507e-3f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(8.3334519073e-3f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(4.1665795894e-2f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(1.6666665459e-1f), y, x);
+  y = vmlaq_f32(vdupq_n_f32(5.0000001201e-1f), y, x);
+  y = vmlaq_f32(vaddq_f32(x, vdupq_n_f32(1.0f)), y, vmulq_f32(x, x));
+
+  // scale by 2^n through the exponent bits
+  const int32x4_t pow2n = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+  return vmulq_f32(y, vreinterpretq_f32_s32(pow2n));
+}
+#endif
+
+void exp_array(const float *input, float *output, size_t len) {
+  size_t i = 0;
+#ifdef __aarch64__
+  for (; i + 4 <= len; i += 4) {
+    vst1q_f32(output + i, exp_f32x4(vld1q_f32(input + i)));
+  }
+#endif
+  for (; i < len; i++) {
+    output[i] = expf(input[i]);
+  }
+}
+
+void sigmoid_array(const float *input, float *output, size_t len) {
+  size_t i = 0;
+#ifdef __aarch64__
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  for (; i + 4 <= len; i += 4) {
+    const float32x4_t e = exp_f32x4(vnegq_f32(vld1q_f32(input + i)));
+    vst1q_f32(output + i, vdivq_f32(one, vaddq_f32(one, e)));
+  }
+#endif
+  for (; i < len; i++) {
+    output[i] = sigmoid(input[i]);
+  }
+}
+
+void gather(const float *input, size_t stride, float *output, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    output[i] = input[i * stride];
+  }
+}
+
+#ifndef __aarch64__
+// round to nearest even like vcvt, except that what would be a denormal half goes to zero
+static inline uint16_t half_bits(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x > 0x7f800000) return sign | 0x7e00;                 // nan
+  if (x >= 0x477ff000) return sign | 0x7c00;                // rounds past the largest half, inf
+  if (x < 0x38800000) return sign;                          // below the smallest normal half
+  x -= (127 - 15) << 23;
+  x += 0xfff + ((x >> 13) & 1);
+  return sign | (x >> 13);
+}
+#endif
+
+void float_to_half(const float *input, uint16_t *output, size_t len) {
+  size_t i = 0;
+#ifdef __aarch64__
+  for (; i + 4 <= len; i += 4) {
+    vst1_u16(output + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(input + i))));
+  }
+  for (; i < len; i++) {
+    output[i] = vget_lane_u16(vreinterpret_u16_f16(vcvt_f16_f32(vdupq_n_f32(input[i]))), 0);
+  }
+#else
+  for (; i < len; i++) {
+    output[i] = half_bits(input[i]);
+  }
+#endif
+}
+
 void softmax(const float* input, float* output, size_t len) {
   const float max_val = *std::max_element(input, input + len);
-  float denominator = 0;
   for (int i = 0; i < len; i++) {
-    float const v_exp = expf(input[i] - max_val);
-    denominator += v_exp;
-    output[i] = v_exp;
+    output[i] = input[i] - max_val;
   }
+  exp_array(output, output, len);
 
+  float denominator = 0;
+  for (int i = 0; i < len; i++) {
+    denominator += output[i];
+  }
   const float inv_denominator = 1. / denominator;
   for (int i = 0; i < len; i++) {
     output[i] *= inv_denominator;
@@ -18,9 +18,18 @@
 #include "selfdrive/modeld/transforms/transform.h"
 
 const bool send_raw_pred = getenv("SEND_RAW_PRED") != NULL;
+// separate warp and loadyuv passes instead of the fused kernel, to verify it against
+const bool unfused_warp = getenv("UNFUSED_WARP") != NULL;
 
 void softmax(const float* input, float* output, size_t len);
 float sigmoid(float input);
+// elementwise over contiguous arrays, vectorized with NEON on aarch64. input and output may alias
+void exp_array(const float *input, float *output, size_t len);
+void sigmoid_array(const float *input, float *output, size_t len);
+// copies len floats spaced stride floats apart, pulls one field out of an array of output structs
+void gather(const float *input, size_t stride, float *output, size_t len);
+// fp16 as its bits, for the model inputs kept in half precision like the feature history
+void float_to_half(const float *input, uint16_t *output, size_t len);
 
 template<class T, size_t size>
 constexpr const kj::ArrayPtr<const T> to_kj_array_ptr(const std::array<T, size> &arr) {
@@ -29,19 +38,32 @@ constexpr const kj::ArrayPtr<const T> to_kj_array_ptr(const std::array<T, size>
 
 class ModelFrame {
 public:
-  ModelFrame(cl_device_id device_id, cl_context context);
+  // the frames are written as input_type. prepare and finish return float pointers
+  // regardless, like the tf8 inputs the runners take
+  ModelFrame(cl_device_id device_id, cl_context context, ModelInputType input_type = ModelInputType::FLOAT32);
   ~ModelFrame();
   float* prepare(cl_mem yuv_cl, int width, int height, int frame_stride, int frame_uv_offset, const mat3& transform, cl_mem *output);
+  // prepare split in two: queue() starts the warp and returns, finish() waits for it and
+  // returns what prepare() would. queue both cameras before finishing either so they overlap
+  void queue(cl_mem yuv_cl, int width, int height, int frame_stride, int frame_uv_offset, const mat3& transform, cl_mem *output);
+  float* finish();
+  // completes when the queued frame is ready, for consumers that take OpenCL wait lists
+  cl_event ready_event() const { return ready; }
 
   const int MODEL_WIDTH = 512;
   const int MODEL_HEIGHT = 256;
   const int MODEL_FRAME_SIZE = MODEL_WIDTH * MODEL_HEIGHT * 3 / 2;
   const int buf_size = MODEL_FRAME_SIZE * 2;
+  const ModelInputType input_type;
 
 private:
   Transform transform;
   LoadYUVState loadyuv;
   cl_command_queue q;
-  cl_mem y_cl, u_cl, v_cl, net_input_cl;
-  std::unique_ptr<float[]> input_frames;
+  cl_mem y_cl, u_cl, v_cl;
+  // both frames of the CPU runners' input, shifted on the GPU and mapped for the
+  // runner instead of read back. mapped while the runner uses it
+  cl_mem net_input_cl;
+  float *input_frames = nullptr;
+  cl_event ready = nullptr;
 };
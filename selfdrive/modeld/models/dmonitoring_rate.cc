@@ -0,0 +1,32 @@
+#include "selfdrive/modeld/models/dmonitoring_rate.h"
+
+void DMonitoringRate::set_engaged(bool engaged) {
+  if (!engaged) {
+    reduced = false;
+    calm_since_ns = 0;
+  }
+  this->engaged = engaged;
+}
+
+bool DMonitoringRate::should_run(uint32_t frame_id) {
+  if (has_run && frame_id - last_run_frame < (uint32_t)divider()) return false;
+  has_run = true;
+  last_run_frame = frame_id;
+  return true;
+}
+
+void DMonitoringRate::update(uint64_t timestamp_ns, float face_prob, float distracted_prob) {
+  if (face_prob < DM_ALERT_FACE_PROB || distracted_prob > DM_ALERT_DISTRACTED_PROB) {
+    reduced = false;
+    calm_since_ns = 0;
+    return;
+  }
+
+  // between the two thresholds the rate stays what it is, but it's not a calm stretch
+  if (face_prob < DM_CALM_FACE_PROB || distracted_prob > DM_CALM_DISTRACTED_PROB || !engaged) {
+    calm_since_ns = 0;
+    return;
+  }
+  if (calm_since_ns == 0) calm_since_ns = timestamp_ns;
+  if (timestamp_ns - calm_since_ns >= DM_CALM_TIME_NS) reduced = true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+// How often the driver monitoring model runs. While the driver has been attentive and
+// the model sure of it for a while, only every DM_REDUCED_DIVIDER-th driver camera frame
+// is run, which leaves the GPU and DSP to the driving model. A distracted or uncertain
+// result, or a disengagement, goes back to every frame right away.
+constexpr int DM_CAMERA_FREQ = 20;
+constexpr int DM_REDUCED_DIVIDER = 2;
+// in power save (thermal status not green) the reduced rate is lower still
+constexpr int DM_POWER_SAVE_DIVIDER = 4;
+
+// attentive: a face is seen and nothing points to distraction
+constexpr float DM_CALM_FACE_PROB = 0.9;
+constexpr float DM_CALM_DISTRACTED_PROB = 0.1;
+// how long the driver has to be attentive before the rate drops
+constexpr uint64_t DM_CALM_TIME_NS = 3ULL * 1000000000ULL;
+// a run above this, or with no face, goes back to the full rate
+constexpr float DM_ALERT_DISTRACTED_PROB = 0.3;
+constexpr float DM_ALERT_FACE_PROB = 0.5;
+
+class DMonitoringRate {
+public:
+  // the driving state, on every carState/deviceState update
+  void set_engaged(bool engaged);
+  void set_power_save(bool power_save) { this->power_save = power_save; }
+
+  // whether this frame is run. Frame ids rather than a count, dropped frames don't delay a run
+  bool should_run(uint32_t frame_id);
+  // the result of a run, distracted_prob is the largest of the distraction outputs
+  void update(uint64_t timestamp_ns, float face_prob, float distracted_prob);
+
+  int divider() const { return reduced ? (power_save ? DM_POWER_SAVE_DIVIDER : DM_REDUCED_DIVIDER) : 1; }
+  // runs a second, what driverStateV2 is published at
+  float rate() const { return (float)DM_CAMERA_FREQ / divider(); }
+
+private:
+  bool engaged = false;
+  bool power_save = false;
+  bool reduced = false;
+  bool has_run = false;
+  uint32_t last_run_frame = 0;
+  // when the current attentive stretch started, 0 if it isn't one
+  uint64_t calm_since_ns = 0;
+};
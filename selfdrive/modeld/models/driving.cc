@@ -1,7 +1,15 @@
 #include "selfdrive/modeld/models/driving.h"
 
+#include <algorithm>
 #include <cstring>
 
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/trace.h"
+
+// post-processing time is logged over this many frames
+constexpr int POSTPROCESS_LOG_INTERVAL = 60 * MODEL_FREQ;
+
 
 void fill_lead(cereal::ModelDataV2::LeadDataV3::Builder lead, const ModelOutputLeads &leads, int t_idx, float prob_t) {
   std::array<float, LEAD_TRAJ_LEN> lead_t = {0.0, 2.0, 4.0, 6.0, 8.0, 10.0};
@@ -10,16 +18,19 @@ void fill_lead(cereal::ModelDataV2::LeadDataV3::Builder lead, const ModelOutputL
   lead.setProbTime(prob_t);
   std::array<float, LEAD_TRAJ_LEN> lead_x, lead_y, lead_v, lead_a;
   std::array<float, LEAD_TRAJ_LEN> lead_x_std, lead_y_std, lead_v_std, lead_a_std;
-  for (int i=0; i<LEAD_TRAJ_LEN; i++) {
-    lead_x[i] = best_prediction.mean[i].x;
-    lead_y[i] = best_prediction.mean[i].y;
-    lead_v[i] = best_prediction.mean[i].velocity;
-    lead_a[i] = best_prediction.mean[i].acceleration;
-    lead_x_std[i] = exp(best_prediction.std[i].x);
-    lead_y_std[i] = exp(best_prediction.std[i].y);
-    lead_v_std[i] = exp(best_prediction.std[i].velocity);
-    lead_a_std[i] = exp(best_prediction.std[i].acceleration);
-  }
+  constexpr size_t stride = sizeof(ModelOutputLeadElement) / sizeof(float);
+  gather(&best_prediction.mean[0].x, stride, lead_x.data(), LEAD_TRAJ_LEN);
+  gather(&best_prediction.mean[0].y, stride, lead_y.data(), LEAD_TRAJ_LEN);
+  gather(&best_prediction.mean[0].velocity, stride, lead_v.data(), LEAD_TRAJ_LEN);
+  gather(&best_prediction.mean[0].acceleration, stride, lead_a.data(), LEAD_TRAJ_LEN);
+
+  // every field of std is used, exp the whole block at once
+  std::array<float, LEAD_TRAJ_LEN * stride> std_exp;
+  exp_array(&best_prediction.std[0].x, std_exp.data(), std_exp.size());
+  gather(&std_exp[0], stride, lead_x_std.data(), LEAD_TRAJ_LEN);
+  gather(&std_exp[1], stride, lead_y_std.data(), LEAD_TRAJ_LEN);
+  gather(&std_exp[2], stride, lead_v_std.data(), LEAD_TRAJ_LEN);
+  gather(&std_exp[3], stride, lead_a_std.data(), LEAD_TRAJ_LEN);
   lead.setT(to_kj_array_ptr(lead_t));
   lead.setX(to_kj_array_ptr(lead_x));
   lead.setY(to_kj_array_ptr(lead_y));
@@ -43,15 +54,15 @@ void fill_meta(cereal::ModelDataV2::MetaData::Builder meta, const ModelOutputMet
   std::array<float, DISENGAGE_LEN> lat_long_t = {2, 4, 6, 8, 10};
   std::array<float, DISENGAGE_LEN> gas_disengage_sigmoid, brake_disengage_sigmoid, steer_override_sigmoid,
                                    brake_3ms2_sigmoid, brake_4ms2_sigmoid, brake_5ms2_sigmoid;
-  for (int i=0; i<DISENGAGE_LEN; i++) {
-    gas_disengage_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].gas_disengage);
-    brake_disengage_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_disengage);
-    steer_override_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].steer_override);
-    brake_3ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_3ms2);
-    brake_4ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_4ms2);
-    brake_5ms2_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].brake_5ms2);
-    //gas_pressed_sigmoid[i] = sigmoid(meta_data.disengage_prob[i].gas_pressed);
-  }
+  std::array<float, DISENGAGE_LEN * META_STRIDE> disengage_sigmoid;
+  sigmoid_array(&meta_data.disengage_prob[0].gas_disengage, disengage_sigmoid.data(), disengage_sigmoid.size());
+  gather(&disengage_sigmoid[0], META_STRIDE, gas_disengage_sigmoid.data(), DISENGAGE_LEN);
+  gather(&disengage_sigmoid[1], META_STRIDE, brake_disengage_sigmoid.data(), DISENGAGE_LEN);
+  gather(&disengage_sigmoid[2], META_STRIDE, steer_override_sigmoid.data(), DISENGAGE_LEN);
+  gather(&disengage_sigmoid[3], META_STRIDE, brake_3ms2_sigmoid.data(), DISENGAGE_LEN);
+  gather(&disengage_sigmoid[4], META_STRIDE, brake_4ms2_sigmoid.data(), DISENGAGE_LEN);
+  gather(&disengage_sigmoid[5], META_STRIDE, brake_5ms2_sigmoid.data(), DISENGAGE_LEN);
+  // gas_pressed at 6 isn't published
 
   std::memmove(ps.prev_brake_5ms2_probs.data(), &ps.prev_brake_5ms2_probs[1], 4*sizeof(float));
   std::memmove(ps.prev_brake_3ms2_probs.data(), &ps.prev_brake_3ms2_probs[1], 2*sizeof(float));
@@ -147,26 +158,30 @@ void fill_plan(cereal::ModelDataV2::Builder &framed, const ModelOutputPlanPredic
   std::array<float, TRAJECTORY_SIZE> acc_x, acc_y, acc_z;
   std::array<float, TRAJECTORY_SIZE> rot_rate_x, rot_rate_y, rot_rate_z;
 
-  for (int i=0; i<TRAJECTORY_SIZE; i++) {
-    pos_x[i] = plan.mean[i].position.x;
-    pos_y[i] = plan.mean[i].position.y;
-    pos_z[i] = plan.mean[i].position.z;
-    pos_x_std[i] = exp(plan.std[i].position.x);
-    pos_y_std[i] = exp(plan.std[i].position.y);
-    pos_z_std[i] = exp(plan.std[i].position.z);
-    vel_x[i] = plan.mean[i].velocity.x;
-    vel_y[i] = plan.mean[i].velocity.y;
-    vel_z[i] = plan.mean[i].velocity.z;
-    acc_x[i] = plan.mean[i].acceleration.x;
-    acc_y[i] = plan.mean[i].acceleration.y;
-    acc_z[i] = plan.mean[i].acceleration.z;
-    rot_x[i] = plan.mean[i].rotation.x;
-    rot_y[i] = plan.mean[i].rotation.y;
-    rot_z[i] = plan.mean[i].rotation.z;
-    rot_rate_x[i] = plan.mean[i].rotation_rate.x;
-    rot_rate_y[i] = plan.mean[i].rotation_rate.y;
-    rot_rate_z[i] = plan.mean[i].rotation_rate.z;
-  }
+  constexpr size_t stride = sizeof(ModelOutputPlanElement) / sizeof(float);
+  gather(&plan.mean[0].position.x, stride, pos_x.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].position.y, stride, pos_y.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].position.z, stride, pos_z.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].velocity.x, stride, vel_x.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].velocity.y, stride, vel_y.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].velocity.z, stride, vel_z.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].acceleration.x, stride, acc_x.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].acceleration.y, stride, acc_y.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].acceleration.z, stride, acc_z.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].rotation.x, stride, rot_x.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].rotation.y, stride, rot_y.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].rotation.z, stride, rot_z.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].rotation_rate.x, stride, rot_rate_x.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].rotation_rate.y, stride, rot_rate_y.data(), TRAJECTORY_SIZE);
+  gather(&plan.mean[0].rotation_rate.z, stride, rot_rate_z.data(), TRAJECTORY_SIZE);
+
+  // only the position std is used, gather it first rather than exp all of std
+  gather(&plan.std[0].position.x, stride, pos_x_std.data(), TRAJECTORY_SIZE);
+  gather(&plan.std[0].position.y, stride, pos_y_std.data(), TRAJECTORY_SIZE);
+  gather(&plan.std[0].position.z, stride, pos_z_std.data(), TRAJECTORY_SIZE);
+  exp_array(pos_x_std.data(), pos_x_std.data(), TRAJECTORY_SIZE);
+  exp_array(pos_y_std.data(), pos_y_std.data(), TRAJECTORY_SIZE);
+  exp_array(pos_z_std.data(), pos_z_std.data(), TRAJECTORY_SIZE);
 
   fill_xyzt(framed.initPosition(), T_IDXS_FLOAT, pos_x, pos_y, pos_z, pos_x_std, pos_y_std, pos_z_std);
   fill_xyzt(framed.initVelocity(), T_IDXS_FLOAT, vel_x, vel_y, vel_z);
@@ -180,16 +195,19 @@ void fill_lateral_planner(cereal::ModelDataV2::Builder &framed, const LateralPla
   std::array<float, TRAJECTORY_SIZE> lateral_plan_solution_x, lateral_plan_solution_y, lateral_plan_solution_yaw, lateral_plan_solution_yaw_rate;
   std::array<float, TRAJECTORY_SIZE> lateral_plan_solution_x_std, lateral_plan_solution_y_std, lateral_plan_solution_yaw_std, lateral_plan_solution_yaw_rate_std;
 
-  for (int i=0; i<TRAJECTORY_SIZE; i++) {
-    lateral_plan_solution_x[i] = model_lateral_planner_solution.mean[i].x;
-    lateral_plan_solution_y[i] = model_lateral_planner_solution.mean[i].y;
-    lateral_plan_solution_yaw[i] = model_lateral_planner_solution.mean[i].yaw;
-    lateral_plan_solution_yaw_rate[i] = model_lateral_planner_solution.mean[i].yaw_rate;
-    lateral_plan_solution_x_std[i] = exp(model_lateral_planner_solution.std[i].x);
-    lateral_plan_solution_y_std[i] = exp(model_lateral_planner_solution.std[i].y);
-    lateral_plan_solution_yaw_std[i] = exp(model_lateral_planner_solution.std[i].yaw);
-    lateral_plan_solution_yaw_rate_std[i] = exp(model_lateral_planner_solution.std[i].yaw_rate);
-  }
+  const auto &solution = model_lateral_planner_solution;
+  constexpr size_t stride = sizeof(LateralPlannerOutputElement) / sizeof(float);
+  gather(&solution.mean[0].x, stride, lateral_plan_solution_x.data(), TRAJECTORY_SIZE);
+  gather(&solution.mean[0].y, stride, lateral_plan_solution_y.data(), TRAJECTORY_SIZE);
+  gather(&solution.mean[0].yaw, stride, lateral_plan_solution_yaw.data(), TRAJECTORY_SIZE);
+  gather(&solution.mean[0].yaw_rate, stride, lateral_plan_solution_yaw_rate.data(), TRAJECTORY_SIZE);
+
+  std::array<float, TRAJECTORY_SIZE * stride> std_exp;
+  exp_array(&solution.std[0].x, std_exp.data(), std_exp.size());
+  gather(&std_exp[0], stride, lateral_plan_solution_x_std.data(), TRAJECTORY_SIZE);
+  gather(&std_exp[1], stride, lateral_plan_solution_y_std.data(), TRAJECTORY_SIZE);
+  gather(&std_exp[2], stride, lateral_plan_solution_yaw_std.data(), TRAJECTORY_SIZE);
+  gather(&std_exp[3], stride, lateral_plan_solution_yaw_rate_std.data(), TRAJECTORY_SIZE);
 
   auto lateral_planner_solution = framed.initLateralPlannerSolution();
   lateral_planner_solution.setX(to_kj_array_ptr(lateral_plan_solution_x));
@@ -215,22 +233,23 @@ void fill_lane_lines(cereal::ModelDataV2::Builder &framed, const std::array<floa
   std::array<float, TRAJECTORY_SIZE> edge_left_y, edge_left_z;
   std::array<float, TRAJECTORY_SIZE> edge_right_y, edge_right_z;
 
-  for (int j=0; j<TRAJECTORY_SIZE; j++) {
-    left_far_y[j] = lanes.mean.left_far[j].y;
-    left_far_z[j] = lanes.mean.left_far[j].z;
-    left_near_y[j] = lanes.mean.left_near[j].y;
-    left_near_z[j] = lanes.mean.left_near[j].z;
-    right_near_y[j] = lanes.mean.right_near[j].y;
-    right_near_z[j] = lanes.mean.right_near[j].z;
-    right_far_y[j] = lanes.mean.right_far[j].y;
-    right_far_z[j] = lanes.mean.right_far[j].z;
-
-    // Fetch road edges data
-    edge_left_y[j] = edges.mean.left[j].y;
-    edge_left_z[j] = edges.mean.left[j].z;
-    edge_right_y[j] = edges.mean.right[j].y;
-    edge_right_z[j] = edges.mean.right[j].z;
+  constexpr size_t stride = sizeof(ModelOutputYZ) / sizeof(float);
+  gather(&lanes.mean.left_far[0].y, stride, left_far_y.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.left_far[0].z, stride, left_far_z.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.left_near[0].y, stride, left_near_y.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.left_near[0].z, stride, left_near_z.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.right_near[0].y, stride, right_near_y.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.right_near[0].z, stride, right_near_z.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.right_far[0].y, stride, right_far_y.data(), TRAJECTORY_SIZE);
+  gather(&lanes.mean.right_far[0].z, stride, right_far_z.data(), TRAJECTORY_SIZE);
+
+  // Fetch road edges data
+  gather(&edges.mean.left[0].y, stride, edge_left_y.data(), TRAJECTORY_SIZE);
+  gather(&edges.mean.left[0].z, stride, edge_left_z.data(), TRAJECTORY_SIZE);
+  gather(&edges.mean.right[0].y, stride, edge_right_y.data(), TRAJECTORY_SIZE);
+  gather(&edges.mean.right[0].z, stride, edge_right_z.data(), TRAJECTORY_SIZE);
 
+  for (int j=0; j<TRAJECTORY_SIZE; j++) {
     // Blindspot path
     left_bs_y[j] = (left_near_y[j] + ((left_near_y[j] - edge_left_y[j]) < (left_near_y[j] - left_far_y[j]) ? edge_left_y[j] : left_far_y[j])) / 2;
     left_bs_z[j] = (left_near_z[j] + ((left_near_y[j] - edge_left_y[j]) < (left_near_y[j] - left_far_y[j]) ? edge_left_z[j] : left_far_z[j])) / 2;
@@ -266,12 +285,11 @@ void fill_road_edges(cereal::ModelDataV2::Builder &framed, const std::array<floa
                      const ModelOutputRoadEdges &edges) {
   std::array<float, TRAJECTORY_SIZE> left_y, left_z;
   std::array<float, TRAJECTORY_SIZE> right_y, right_z;
-  for (int j=0; j<TRAJECTORY_SIZE; j++) {
-    left_y[j] = edges.mean.left[j].y;
-    left_z[j] = edges.mean.left[j].z;
-    right_y[j] = edges.mean.right[j].y;
-    right_z[j] = edges.mean.right[j].z;
-  }
+  constexpr size_t stride = sizeof(ModelOutputYZ) / sizeof(float);
+  gather(&edges.mean.left[0].y, stride, left_y.data(), TRAJECTORY_SIZE);
+  gather(&edges.mean.left[0].z, stride, left_z.data(), TRAJECTORY_SIZE);
+  gather(&edges.mean.right[0].y, stride, right_y.data(), TRAJECTORY_SIZE);
+  gather(&edges.mean.right[0].z, stride, right_z.data(), TRAJECTORY_SIZE);
 
   auto road_edges = framed.initRoadEdges(2);
   fill_xyzt(road_edges[0], plan_t, X_IDXS_FLOAT, left_y, left_z);
@@ -338,6 +356,7 @@ void fill_model(cereal::ModelDataV2::Builder &framed, const ModelOutput &net_out
 
 void fill_model_msg(MessageBuilder &msg, float *net_output_data, PublishState &ps, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
                     uint64_t timestamp_eof, uint64_t timestamp_llk, float model_execution_time, const bool nav_enabled, const bool valid) {
+  const uint64_t t_start = nanos_since_boot();
   const uint32_t frame_age = (frame_id > vipc_frame_id) ? (frame_id - vipc_frame_id) : 0;
   auto framed = msg.initEvent(valid).initModelV2();
   framed.setFrameId(vipc_frame_id);
@@ -352,6 +371,23 @@ void fill_model_msg(MessageBuilder &msg, float *net_output_data, PublishState &p
     framed.setRawPredictions(kj::ArrayPtr<const float>(net_output_data, NET_OUTPUT_SIZE).asBytes());
   }
   fill_model(framed, *((ModelOutput*) net_output_data), ps);
+
+  const uint64_t dt = nanos_since_boot() - t_start;
+  if (trace_enabled) {
+    // the model ran right before this, both are linked to the road frame camerad made
+    const uint64_t flow_id = TRACE_FRAME_FLOW(VISION_STREAM_ROAD, vipc_frame_id);
+    trace_span("modeld.execute", t_start - (uint64_t)(model_execution_time * 1e9), t_start, flow_id);
+    trace_span("modeld.postprocess", t_start, t_start + dt, flow_id);
+    trace_counter("modeld.frame_drop", frame_drop);
+  }
+  ps.postprocess_time_total += dt;
+  ps.postprocess_time_max = std::max(ps.postprocess_time_max, dt);
+  if (++ps.postprocess_count == POSTPROCESS_LOG_INTERVAL) {
+    LOG("model execution %.2f ms, post-process avg %.3f ms, max %.3f ms", model_execution_time * 1e3,
+        ps.postprocess_time_total / 1e6 / ps.postprocess_count, ps.postprocess_time_max / 1e6);
+    ps.postprocess_time_total = ps.postprocess_time_max = 0;
+    ps.postprocess_count = 0;
+  }
 }
 
 void fill_pose_msg(MessageBuilder &msg, float *net_output_data, uint32_t vipc_frame_id, uint32_t vipc_dropped_frames, uint64_t timestamp_eof, const bool valid) {
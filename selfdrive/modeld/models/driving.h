@@ -266,6 +266,9 @@ struct PublishState {
   std::array<float, DISENGAGE_LEN * DISENGAGE_LEN> disengage_buffer = {};
   std::array<float, 5> prev_brake_5ms2_probs = {};
   std::array<float, 3> prev_brake_3ms2_probs = {};
+  // post-processing time of fill_model_msg, logged periodically
+  uint64_t postprocess_time_total = 0, postprocess_time_max = 0;
+  int postprocess_count = 0;
 };
 
 void fill_model_msg(MessageBuilder &msg, float *net_output_data, PublishState &ps, uint32_t vipc_frame_id, uint32_t vipc_frame_id_extra, uint32_t frame_id, float frame_drop,
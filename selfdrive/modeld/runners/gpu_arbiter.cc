@@ -0,0 +1,162 @@
+#include "selfdrive/modeld/runners/gpu_arbiter.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
+
+const char *GPU_ARBITER_SHM = "/modeld_gpu_arbiter";
+const uint32_t GPU_ARBITER_READY = 0x67707561;
+const int GPU_WAIT_LOG_INTERVAL = 1000;
+
+static bool pid_alive(pid_t pid) {
+  return pid != 0 && (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+GpuArbiter::GpuArbiter(const std::string &model_name, GpuPriority priority) : name(model_name), prio((int)priority) {
+  bool created = true;
+  int fd = HANDLE_EINTR(shm_open(GPU_ARBITER_SHM, O_RDWR | O_CREAT | O_EXCL, 0666));
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = HANDLE_EINTR(shm_open(GPU_ARBITER_SHM, O_RDWR, 0666));
+  }
+  if (fd < 0 || (created && ftruncate(fd, sizeof(Shared)) != 0)) {
+    LOGE("gpu arbiter: can't open %s, running %s without it: %s", GPU_ARBITER_SHM, name.c_str(), strerror(errno));
+    if (fd >= 0) close(fd);
+    return;
+  }
+
+  // whoever created the segment initializes it, everyone else waits until it's ready
+  if (!created) {
+    for (int i = 0; i < 100; i++) {
+      struct stat st = {};
+      if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(Shared)) break;
+      util::sleep_for(10);
+    }
+  }
+  void *mem = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED) {
+    LOGE("gpu arbiter: can't map %s, running %s without it", GPU_ARBITER_SHM, name.c_str());
+    return;
+  }
+  shared = (Shared *)mem;
+
+  if (created) {
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared->lock, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&shared->cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    shared->ready = GPU_ARBITER_READY;
+  } else {
+    for (int i = 0; i < 100 && shared->ready != GPU_ARBITER_READY; i++) {
+      util::sleep_for(10);
+    }
+    if (shared->ready != GPU_ARBITER_READY) {
+      LOGE("gpu arbiter: %s never got initialized, running %s without it", GPU_ARBITER_SHM, name.c_str());
+      munmap(shared, sizeof(Shared));
+      shared = nullptr;
+    }
+  }
+}
+
+GpuArbiter::~GpuArbiter() {
+  if (shared != nullptr) {
+    if (held) release();
+    munmap(shared, sizeof(Shared));
+  }
+}
+
+void GpuArbiter::lock_shared() {
+  if (pthread_mutex_lock(&shared->lock) == EOWNERDEAD) {
+    pthread_mutex_consistent(&shared->lock);
+  }
+}
+
+bool GpuArbiter::higher_waiting() const {
+  for (int p = 0; p < prio; p++) {
+    for (pid_t pid : shared->waiting[p]) {
+      if (pid_alive(pid)) return true;
+    }
+  }
+  return false;
+}
+
+void GpuArbiter::acquire() {
+  if (shared == nullptr) return;
+  acquire_start = nanos_since_boot();
+
+  lock_shared();
+  pid_t *slot = nullptr;
+  for (pid_t &pid : shared->waiting[prio]) {
+    if (!pid_alive(pid)) {
+      pid = getpid();
+      slot = &pid;
+      break;
+    }
+  }
+  // with no free slot this waits without holding off lower priorities, only ordering suffers
+
+  while (shared->owner != 0 || higher_waiting()) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += 100 * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+    int ret = pthread_cond_timedwait(&shared->cond, &shared->lock, &ts);
+    if (ret == EOWNERDEAD) {
+      pthread_mutex_consistent(&shared->lock);
+    }
+    // an owner that died mid run never releases
+    if (ret != 0 && shared->owner != 0 && !pid_alive(shared->owner)) {
+      LOGW("gpu arbiter: owner %d is gone, taking over", shared->owner);
+      shared->owner = 0;
+    }
+  }
+  if (slot != nullptr) *slot = 0;
+  shared->owner = getpid();
+  held = true;
+  pthread_mutex_unlock(&shared->lock);
+
+  const uint64_t wait = nanos_since_boot() - acquire_start;
+  wait_total += wait;
+  wait_max = std::max(wait_max, wait);
+  if (++runs == GPU_WAIT_LOG_INTERVAL) {
+    LOG("%s gpu queue wait: avg %.2f ms, max %.2f ms over %d runs", name.c_str(),
+        wait_total / 1e6 / runs, wait_max / 1e6, runs);
+    runs = 0;
+    wait_total = wait_max = 0;
+  }
+}
+
+void GpuArbiter::release() {
+  if (shared == nullptr || !held) return;
+
+  lock_shared();
+  shared->owner = 0;
+  held = false;
+  pthread_cond_broadcast(&shared->cond);
+  pthread_mutex_unlock(&shared->lock);
+}
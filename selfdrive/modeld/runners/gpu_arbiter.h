@@ -0,0 +1,60 @@
+#pragma once
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Cooperative priority lock around model runs, shared by every process running a
+// model. The GPU can't be preempted, so this only orders work: a waiting run of a
+// higher priority always goes before lower ones, and nothing starts while another
+// run is on the GPU. Used by the runners, the driving model (thneed) runs at HIGH,
+// the SNPE models (driver monitoring, nav) at LOW.
+enum class GpuPriority {
+  HIGH = 0,
+  LOW = 1,
+};
+const int GPU_PRIORITY_CNT = 2;
+const int GPU_MAX_WAITERS = 8;
+
+class GpuArbiter {
+public:
+  GpuArbiter(const std::string &model_name, GpuPriority priority);
+  ~GpuArbiter();
+  void acquire();
+  void release();
+
+private:
+  struct Shared {
+    std::atomic<uint32_t> ready;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pid_t owner;
+    // pids rather than counts, so a waiter that died doesn't hold off lower priorities
+    pid_t waiting[GPU_PRIORITY_CNT][GPU_MAX_WAITERS];
+  };
+  void lock_shared();
+  bool higher_waiting() const;
+
+  const std::string name;
+  const int prio;
+  Shared *shared = nullptr;
+  bool held = false;
+
+  // queue wait stats, logged every GPU_WAIT_LOG_INTERVAL runs
+  uint64_t acquire_start = 0;
+  int runs = 0;
+  uint64_t wait_total = 0, wait_max = 0;
+};
+
+// holds the arbiter for a scope
+class GpuLock {
+public:
+  GpuLock(GpuArbiter &a) : arbiter(a) { arbiter.acquire(); }
+  ~GpuLock() { arbiter.release(); }
+
+private:
+  GpuArbiter &arbiter;
+};
@@ -18,6 +18,7 @@ struct ModelInput {
   int size;
 
   ModelInput(const std::string _name, float *_buffer, int _size) : name(_name), buffer(_buffer), size(_size) {}
+  virtual ~ModelInput() {}
   virtual void setBuffer(float *_buffer, int _size) {
     assert(size == _size || size == 0);
     buffer = _buffer;
@@ -31,6 +32,11 @@ public:
 
   virtual ~RunModel() {}
   virtual void execute() {}
+  // async execute, the output is written once poll or wait_for return true.
+  // runners without it run synchronously in submit
+  virtual void submit() { execute(); }
+  virtual bool poll() { return true; }
+  virtual bool wait_for(int timeout_ms) { return true; }
   virtual void* getCLBuffer(const std::string name) { return nullptr; }
 
   virtual void addInput(const std::string name, float *buffer, int size) {
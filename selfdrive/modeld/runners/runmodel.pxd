@@ -1,5 +1,6 @@
 # distutils: language = c++
 
+from libcpp cimport bool
 from libcpp.string cimport string
 
 cdef extern from "selfdrive/modeld/runners/runmodel.h":
@@ -12,3 +13,6 @@ cdef extern from "selfdrive/modeld/runners/runmodel.h":
     void setInputBuffer(string, float*, int)
     void * getCLBuffer(string)
     void execute()
+    void submit()
+    bool poll()
+    bool wait_for(int)
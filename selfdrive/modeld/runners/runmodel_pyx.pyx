@@ -36,3 +36,12 @@ cdef class RunModel:
 
   def execute(self):
     self.model.execute()
+
+  def submit(self):
+    self.model.submit()
+
+  def poll(self):
+    return self.model.poll()
+
+  def wait_for(self, int timeout_ms):
+    return self.model.wait_for(timeout_ms)
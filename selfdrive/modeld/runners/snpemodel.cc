@@ -16,10 +16,14 @@ void PrintErrorStringAndExit() {
   std::exit(EXIT_FAILURE);
 }
 
-SNPEModel::SNPEModel(const std::string path, float *_output, size_t _output_size, int runtime, bool _use_tf8, cl_context context) {
+SNPEModel::SNPEModel(const std::string path, float *_output, size_t _output_size, int runtime, bool _use_tf8, cl_context _context)
+  : arbiter(path.substr(path.rfind('/') + 1), GpuPriority::LOW), context(_context) {
   output = _output;
   output_size = _output_size;
   use_tf8 = _use_tf8;
+  if (context != NULL) {
+    device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  }
 
 #ifdef QCOM2
   if (runtime == USE_GPU_RUNTIME) {
@@ -104,12 +108,43 @@ void SNPEModel::addInput(const std::string name, float *buffer, int size) {
     strides[i-1] = stride;
   }
 
+  // inputs added without a buffer live in ion memory with a cl_mem over it, so the
+  // transform writes them in place and nothing is read back to the CPU for them
+  std::unique_ptr<VisionBuf> cl_buf;
+  if (buffer == NULL && context != NULL) {
+    cl_buf = std::make_unique<VisionBuf>();
+    cl_buf->allocate(product*size_of_input);
+    cl_buf->init_cl(device_id, context);
+    buffer = (float *)cl_buf->addr;
+    size = product;
+  }
+
   auto input_buffer = ub_factory.createUserBuffer(buffer, product*size_of_input, strides, input_encoding);
   input_map.add(input_tensor_name, input_buffer.get());
-  inputs.push_back(std::unique_ptr<SNPEModelInput>(new SNPEModelInput(name, buffer, size, std::move(input_buffer))));
+  auto input = std::make_unique<SNPEModelInput>(name, buffer, size, std::move(input_buffer));
+  input->cl_buf = std::move(cl_buf);
+  inputs.push_back(std::move(input));
+}
+
+void *SNPEModel::getCLBuffer(const std::string name) {
+  for (auto &input : inputs) {
+    if (name == input->name) {
+      VisionBuf *cl_buf = static_cast<SNPEModelInput *>(input.get())->cl_buf.get();
+      return cl_buf ? &cl_buf->buf_cl : nullptr;
+    }
+  }
+  LOGE("Tried to get CL buffer for input `%s` but no input with this name exists", name.c_str());
+  assert(false);
+  return nullptr;
 }
 
 void SNPEModel::execute() {
+  // the driving model goes first
+  GpuLock lk(arbiter);
+  for (auto &input : inputs) {
+    VisionBuf *cl_buf = static_cast<SNPEModelInput *>(input.get())->cl_buf.get();
+    if (cl_buf) cl_buf->sync(VISIONBUF_SYNC_FROM_DEVICE);
+  }
   if (!snpe->execute(input_map, output_map)) {
     PrintErrorStringAndExit();
   }
@@ -15,22 +15,30 @@
 #include <SNPE/SNPEBuilder.hpp>
 #include <SNPE/SNPEFactory.hpp>
 
+#include "cereal/visionipc/visionbuf.h"
+#include "selfdrive/modeld/runners/gpu_arbiter.h"
 #include "selfdrive/modeld/runners/runmodel.h"
 
 struct SNPEModelInput : public ModelInput {
   std::unique_ptr<zdl::DlSystem::IUserBuffer> snpe_buffer;
+  // set for inputs added without a buffer, the ion buffer both OpenCL and SNPE use
+  std::unique_ptr<VisionBuf> cl_buf;
 
   SNPEModelInput(const std::string _name, float *_buffer, int _size, std::unique_ptr<zdl::DlSystem::IUserBuffer> _snpe_buffer) : ModelInput(_name, _buffer, _size), snpe_buffer(std::move(_snpe_buffer)) {}
   void setBuffer(float *_buffer, int _size) {
     ModelInput::setBuffer(_buffer, _size);
     assert(snpe_buffer->setBufferAddress(_buffer) == true);
   }
+  ~SNPEModelInput() {
+    if (cl_buf) cl_buf->free();
+  }
 };
 
 class SNPEModel : public RunModel {
 public:
   SNPEModel(const std::string path, float *_output, size_t _output_size, int runtime, bool use_tf8 = false, cl_context context = NULL);
   void addInput(const std::string name, float *buffer, int size);
+  void *getCLBuffer(const std::string name);
   void execute();
 
 private:
@@ -46,6 +54,9 @@ private:
   zdl::DlSystem::UserBufferMap output_map;
   std::unique_ptr<zdl::DlSystem::IUserBuffer> output_buffer;
 
+  GpuArbiter arbiter;
+  cl_context context;
+  cl_device_id device_id = nullptr;
   bool use_tf8;
   float *output;
   size_t output_size;
@@ -4,10 +4,13 @@
 
 #include "common/swaglog.h"
 
-ThneedModel::ThneedModel(const std::string path, float *_output, size_t _output_size, int runtime, bool luse_tf8, cl_context context) {
+ThneedModel::ThneedModel(const std::string path, float *_output, size_t _output_size, int runtime, bool luse_tf8, cl_context context)
+  : arbiter(path.substr(path.rfind('/') + 1), GpuPriority::HIGH) {
   thneed = new Thneed(true, context);
   thneed->load(path.c_str());
   thneed->clexec();
+  // the first run builds the kernels, it's not part of the profile
+  thneed->profile_reset();
 
   recorded = false;
   output = _output;
@@ -35,7 +38,17 @@ void* ThneedModel::getCLBuffer(const std::string name) {
 }
 
 void ThneedModel::execute() {
-  if (!recorded) {
+  GpuLock lk(arbiter);
+  if (thneed->profile > 0) {
+    // never recorded, the replayed commands can't be timed per kernel
+    float *input_buffers[inputs.size()];
+    for (int i = 0; i < inputs.size(); i++) {
+      input_buffers[inputs.size() - i - 1] = inputs[i]->buffer;
+    }
+    thneed->copy_inputs(input_buffers);
+    thneed->clexec();
+    thneed->copy_output(output);
+  } else if (!recorded) {
     thneed->record = true;
     float *input_buffers[inputs.size()];
     for (int i = 0; i < inputs.size(); i++) {
@@ -56,3 +69,36 @@ void ThneedModel::execute() {
     thneed->execute(input_buffers, output);
   }
 }
+
+void ThneedModel::submit() {
+  assert(pending == -1);
+  if (!recorded || thneed->profile > 0) {
+    // the first run records the commands, that one is synchronous. So is every profiled run
+    execute();
+    return;
+  }
+
+  float *input_buffers[inputs.size()];
+  for (int i = 0; i < inputs.size(); i++) {
+    input_buffers[inputs.size() - i - 1] = inputs[i]->buffer;
+  }
+  // held until the output is collected
+  arbiter.acquire();
+  pending = thneed->submit(input_buffers);
+}
+
+bool ThneedModel::poll() {
+  if (pending != -1 && thneed->poll(pending)) collect();
+  return pending == -1;
+}
+
+bool ThneedModel::wait_for(int timeout_ms) {
+  if (pending != -1 && thneed->wait_for(pending, timeout_ms)) collect();
+  return pending == -1;
+}
+
+void ThneedModel::collect() {
+  thneed->copy_output(output);
+  pending = -1;
+  arbiter.release();
+}
@@ -2,6 +2,7 @@
 
 #include <string>
 
+#include "selfdrive/modeld/runners/gpu_arbiter.h"
 #include "selfdrive/modeld/runners/runmodel.h"
 #include "selfdrive/modeld/thneed/thneed.h"
 
@@ -10,8 +11,16 @@ public:
   ThneedModel(const std::string path, float *_output, size_t _output_size, int runtime, bool use_tf8 = false, cl_context context = NULL);
   void *getCLBuffer(const std::string name);
   void execute();
+  void submit();
+  bool poll();
+  bool wait_for(int timeout_ms);
 private:
+  void collect();
+
   Thneed *thneed = NULL;
+  GpuArbiter arbiter;
   bool recorded;
   float *output;
+  // token of the submitted run whose output hasn't been copied out yet, -1 if none
+  int pending = -1;
 };
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/clutil.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "selfdrive/modeld/models/driving.h"
+#include "selfdrive/modeld/runners/snpemodel.h"
+#include "selfdrive/modeld/transforms/loadyuv.h"
+#include "selfdrive/modeld/transforms/transform.h"
+#include "third_party/json11/json11.hpp"
+#include "tools/replay/framereader.h"
+#include "tools/replay/logreader.h"
+
+#ifdef QCOM2
+#include "selfdrive/modeld/runners/thneedmodel.h"
+#endif
+
+// Times the driving model the way modeld runs it, on frames and inputs from a
+// recorded segment: warp, loadyuv, execute, the feature history copy out of the
+// output, and building modelV2/cameraOdometry. Prints percentiles per stage as
+// JSON, to track regressions between releases. --fp16 is for thneeds compiled with
+// half image and feature history inputs, the images then go through the fused warp.
+// Usage: model_bench <model.thneed|model.dlc> <rlog> <fcamera.hevc> [ecamera.hevc] [--frames N] [--runtime cpu|gpu|dsp] [--fp16]
+
+const int MODEL_WIDTH = 512;
+const int MODEL_HEIGHT = 256;
+const int MODEL_FRAME_SIZE = MODEL_WIDTH * MODEL_HEIGHT * 3 / 2;
+
+// one camera's input, the same pipeline ModelFrame runs, split so each pass can be timed
+struct CameraInput {
+  CameraInput(cl_device_id device_id, cl_context context) {
+    transform_init(&transform, context, device_id);
+    loadyuv_init(&loadyuv, context, device_id, MODEL_WIDTH, MODEL_HEIGHT);
+    y_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_WIDTH * MODEL_HEIGHT, NULL, &err));
+    u_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
+    v_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, (MODEL_WIDTH / 2) * (MODEL_HEIGHT / 2), NULL, &err));
+  }
+  ~CameraInput() {
+    transform_destroy(&transform);
+    loadyuv_destroy(&loadyuv);
+    CL_CHECK(clReleaseMemObject(y_cl));
+    CL_CHECK(clReleaseMemObject(u_cl));
+    CL_CHECK(clReleaseMemObject(v_cl));
+  }
+
+  Transform transform;
+  LoadYUVState loadyuv;
+  cl_mem y_cl, u_cl, v_cl;
+  // the model's cl input, or a host buffer for runners without one
+  cl_mem net_cl = nullptr;
+  std::vector<float> host_frames;
+};
+
+static json11::Json percentiles(std::vector<double> ms) {
+  if (ms.empty()) return json11::Json();
+  std::sort(ms.begin(), ms.end());
+  auto at = [&](double p) { return ms[std::min(ms.size() - 1, (size_t)(p / 100.0 * ms.size()))]; };
+  return json11::Json::object{{"p50", at(50)}, {"p90", at(90)}, {"p99", at(99)}, {"max", ms.back()}};
+}
+
+// model pixels to frame pixels, a plain scale. calibration doesn't matter for timing
+static mat3 frame_projection(int width, int height) {
+  return mat3{{(float)width / MODEL_WIDTH, 0.0, 0.0,
+               0.0, (float)height / MODEL_HEIGHT, 0.0,
+               0.0, 0.0, 1.0}};
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<std::string> paths;
+  int max_frames = 1200;
+  int runtime = USE_GPU_RUNTIME;
+  bool fp16 = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--frames" && i + 1 < argc) {
+      max_frames = std::atoi(argv[++i]);
+    } else if (arg == "--runtime" && i + 1 < argc) {
+      std::string r = argv[++i];
+      runtime = r == "cpu" ? USE_CPU_RUNTIME : r == "dsp" ? USE_DSP_RUNTIME : USE_GPU_RUNTIME;
+    } else if (arg == "--fp16") {
+      fp16 = true;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.size() < 3) {
+    fprintf(stderr, "usage: %s <model.thneed|model.dlc> <rlog> <fcamera.hevc> [ecamera.hevc] [--frames N] [--runtime cpu|gpu|dsp] [--fp16]\n", argv[0]);
+    return 1;
+  }
+  const std::string model_path = paths[0];
+  if (fp16 && !util::ends_with(model_path, ".thneed")) {
+    fprintf(stderr, "--fp16 needs a thneed, SNPE takes float or tf8 inputs\n");
+    return 1;
+  }
+  const ModelInputType img_type = fp16 ? ModelInputType::FLOAT16 : ModelInputType::FLOAT32;
+
+  // recorded desire and traffic convention, replayed at the model's rate
+  LogReader lr;
+  if (!lr.load(paths[1], nullptr, {cereal::Event::Which::LATERAL_PLAN, cereal::Event::Which::DRIVER_MONITORING_STATE})) {
+    fprintf(stderr, "failed to read %s\n", paths[1].c_str());
+    return 1;
+  }
+
+  std::unique_ptr<FrameReader> frames[2];
+  for (int i = 0; i < 2; i++) {
+    // without an ecamera the road frames go to both inputs
+    const std::string &path = paths[std::min<size_t>(2 + i, paths.size() - 1)];
+    frames[i] = std::make_unique<FrameReader>();
+    if (!frames[i]->load(path)) {
+      fprintf(stderr, "failed to read %s\n", path.c_str());
+      return 1;
+    }
+  }
+  const int frame_cnt = std::min<int>({max_frames, (int)frames[0]->getFrameCount(), (int)frames[1]->getFrameCount()});
+
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = cl_create_context(device_id);
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+
+  std::vector<float> output(NET_OUTPUT_SIZE);
+  std::unique_ptr<RunModel> model;
+#ifdef QCOM2
+  if (util::ends_with(model_path, ".thneed")) {
+    model = std::make_unique<ThneedModel>(model_path, output.data(), output.size(), runtime, false, context);
+  }
+#endif
+  if (!model) {
+    model = std::make_unique<SNPEModel>(model_path, output.data(), output.size(), runtime, false, context);
+  }
+
+  // same inputs, in the same order, as modeld
+  std::map<std::string, std::vector<float>> inputs;
+  inputs["desire"].resize(DESIRE_LEN * (HISTORY_BUFFER_LEN + 1));
+  inputs["traffic_convention"].resize(TRAFFIC_CONVENTION_LEN);
+  inputs["lat_planner_state"].resize(LAT_PLANNER_STATE_LEN);
+  inputs["nav_features"].resize(NAV_FEATURE_LEN);
+  inputs["nav_instructions"].resize(NAV_INSTRUCTION_LEN);
+  inputs["features_buffer"].resize(HISTORY_BUFFER_LEN * FEATURE_LEN);
+  // the history as the fp16 model takes it, converted one frame of features at a time
+  std::vector<uint16_t> features_f16(fp16 ? HISTORY_BUFFER_LEN * FEATURE_LEN : 0);
+
+  const char *img_names[2] = {"input_imgs", "big_input_imgs"};
+  std::vector<std::unique_ptr<CameraInput>> cams;
+  std::vector<VisionBuf> bufs(2);
+  for (int i = 0; i < 2; i++) {
+    model->addInput(img_names[i], NULL, 0);
+    cams.push_back(std::make_unique<CameraInput>(device_id, context));
+
+    VisionBuf &b = bufs[i];
+    const int w = frames[i]->width, h = frames[i]->height;
+    b.allocate(w * h * 3 / 2);
+    b.init_yuv(w, h, w, w * h);
+    b.init_cl(device_id, context);
+  }
+  for (const char *name : {"desire", "traffic_convention", "lat_planner_state", "nav_features", "nav_instructions", "features_buffer"}) {
+    auto &v = inputs[name];
+    if (fp16 && strcmp(name, "features_buffer") == 0) {
+      model->addInput(name, (float *)features_f16.data(), features_f16.size());
+    } else {
+      model->addInput(name, v.data(), v.size());
+    }
+  }
+  for (int i = 0; i < 2; i++) {
+    void *cl_buf = model->getCLBuffer(img_names[i]);
+    if (cl_buf != nullptr) {
+      cams[i]->net_cl = *(cl_mem *)cl_buf;
+    } else {
+      cams[i]->host_frames.resize(MODEL_FRAME_SIZE * 2);
+      cams[i]->net_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, MODEL_FRAME_SIZE * 2 * model_input_elem_size(img_type), NULL, &err));
+      model->setInputBuffer(img_names[i], cams[i]->host_frames.data(), cams[i]->host_frames.size());
+    }
+  }
+
+  std::map<std::string, std::vector<double>> times;
+  PublishState ps;
+  auto event = lr.events.begin();
+  const uint64_t start_time = lr.events.empty() ? 0 : lr.events[0]->mono_time;
+  int desire = 0, prev_desire = 0;
+
+  for (int f = 0; f < frame_cnt; f++) {
+    for (int i = 0; i < 2; i++) {
+      frames[i]->get(f, &bufs[i]);
+    }
+    for (; event != lr.events.end() && (*event)->mono_time <= start_time + f * (1e9 / MODEL_FREQ); ++event) {
+      if ((*event)->which == cereal::Event::Which::LATERAL_PLAN) {
+        desire = (int)(*event)->event().getLateralPlan().getDesire();
+      } else {
+        bool rhd = (*event)->event().getDriverMonitoringState().getIsRHD();
+        inputs["traffic_convention"][0] = rhd ? 0.0f : 1.0f;
+        inputs["traffic_convention"][1] = rhd ? 1.0f : 0.0f;
+      }
+    }
+    // desire history, pulses on change like modeld
+    auto &desire_buf = inputs["desire"];
+    std::memmove(desire_buf.data(), desire_buf.data() + DESIRE_LEN, sizeof(float) * DESIRE_LEN * HISTORY_BUFFER_LEN);
+    std::fill_n(desire_buf.end() - DESIRE_LEN, DESIRE_LEN, 0.0f);
+    if (desire > 0 && desire < DESIRE_LEN && desire != prev_desire) {
+      desire_buf[DESIRE_LEN * HISTORY_BUFFER_LEN + desire] = 1.0f;
+    }
+    prev_desire = desire;
+
+    uint64_t t = nanos_since_boot();
+    auto lap = [&](const char *stage) {
+      const uint64_t now = nanos_since_boot();
+      times[stage].push_back((now - t) / 1e6);
+      t = now;
+    };
+
+    if (fp16) {
+      for (int i = 0; i < 2; i++) {
+        VisionBuf &b = bufs[i];
+        loadyuv_warp_queue(&cams[i]->loadyuv, q, b.buf_cl, b.width, b.height, b.stride, b.uv_offset,
+                           frame_projection(b.width, b.height), cams[i]->net_cl, true, img_type);
+      }
+    } else {
+      for (int i = 0; i < 2; i++) {
+        VisionBuf &b = bufs[i];
+        transform_queue(&cams[i]->transform, q, b.buf_cl, b.width, b.height, b.stride, b.uv_offset,
+                        cams[i]->y_cl, cams[i]->u_cl, cams[i]->v_cl, MODEL_WIDTH, MODEL_HEIGHT, frame_projection(b.width, b.height));
+      }
+      CL_CHECK(clFinish(q));
+      lap("transform");
+
+      for (int i = 0; i < 2; i++) {
+        CameraInput &c = *cams[i];
+        loadyuv_queue(&c.loadyuv, q, c.y_cl, c.u_cl, c.v_cl, c.net_cl, true);
+      }
+    }
+    for (int i = 0; i < 2; i++) {
+      CameraInput &c = *cams[i];
+      if (!c.host_frames.empty()) {
+        CL_CHECK(clEnqueueReadBuffer(q, c.net_cl, CL_FALSE, 0, MODEL_FRAME_SIZE * 2 * model_input_elem_size(img_type), c.host_frames.data(), 0, NULL, NULL));
+      }
+    }
+    CL_CHECK(clFinish(q));
+    lap(fp16 ? "warpload" : "loadyuv");
+
+    model->execute();
+    lap("execute");
+
+    // the features of this frame go into the history, like modeld does with the output
+    auto &features = inputs["features_buffer"];
+    std::memmove(features.data(), features.data() + FEATURE_LEN, sizeof(float) * FEATURE_LEN * (HISTORY_BUFFER_LEN - 1));
+    std::memcpy(features.data() + FEATURE_LEN * (HISTORY_BUFFER_LEN - 1), output.data() + OUTPUT_SIZE, sizeof(float) * FEATURE_LEN);
+    if (fp16) {
+      std::memmove(features_f16.data(), features_f16.data() + FEATURE_LEN, sizeof(uint16_t) * FEATURE_LEN * (HISTORY_BUFFER_LEN - 1));
+      float_to_half(output.data() + OUTPUT_SIZE, features_f16.data() + FEATURE_LEN * (HISTORY_BUFFER_LEN - 1), FEATURE_LEN);
+    }
+    lap("output_copy");
+
+    MessageBuilder model_msg, pose_msg;
+    fill_model_msg(model_msg, output.data(), ps, f, f, f, 0, 0, 0, times["execute"].back() / 1e3, false, true);
+    fill_pose_msg(pose_msg, output.data(), f, 0, 0, true);
+    lap("postprocess");
+  }
+
+  json11::Json::object stages;
+  for (const auto &[stage, ms] : times) {
+    stages[stage] = percentiles(ms);
+  }
+  json11::Json result = json11::Json::object{
+    {"model", model_path},
+    {"runtime", runtime},
+    {"fp16", fp16},
+    {"frames", frame_cnt},
+    {"stages_ms", stages},
+  };
+  printf("%s\n", result.dump().c_str());
+
+  for (int i = 0; i < 2; i++) {
+    if (!cams[i]->host_frames.empty()) CL_CHECK(clReleaseMemObject(cams[i]->net_cl));
+    bufs[i].free();
+  }
+  cams.clear();
+  model.reset();
+  CL_CHECK(clReleaseCommandQueue(q));
+  CL_CHECK(clReleaseContext(context));
+  return 0;
+}
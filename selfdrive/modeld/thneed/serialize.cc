@@ -1,4 +1,10 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cassert>
+#include <cstring>
 #include <set>
 
 #include "third_party/json11/json11.hpp"
@@ -9,13 +15,128 @@ using namespace json11;
 
 extern map<cl_program, string> g_program_source;
 
+// The programs a thneed ships as source are built once per GPU driver and the
+// binaries cached, building them is most of the startup time. The cache is keyed
+// on the driver and the thneed's header, which carries the program sources.
+//   header: magic, version, key, program count
+//   per program: name length, name, binary length, binary
+//   trailer: fnv1a of everything before it
+#ifdef QCOM2
+static const char *THNEED_CACHE_DIR = "/data/thneed_cache";
+#else
+static const char *THNEED_CACHE_DIR = "/tmp/thneed_cache";
+#endif
+const uint32_t PROGRAM_CACHE_MAGIC = 0x434e4854;  // THNC
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+static uint64_t fnv1a(const void *data, size_t len, uint64_t h = 0xcbf29ce484222325ULL) {
+  const uint8_t *d = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ d[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static string device_info(cl_device_id device_id, cl_device_info param) {
+  char info[0x400] = {};
+  clGetDeviceInfo(device_id, param, sizeof(info) - 1, info, NULL);
+  return info;
+}
+
+template <typename T>
+static bool read_val(const uint8_t *&p, const uint8_t *end, T &val) {
+  if (end - p < (ptrdiff_t)sizeof(T)) return false;
+  memcpy(&val, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+template <typename T>
+static void write_val(string &out, const T &val) {
+  out.append((const char *)&val, sizeof(T));
+}
+
+static map<string, cl_program> load_program_cache(const string &path, uint64_t key, cl_context context, cl_device_id device_id) {
+  map<string, cl_program> programs;
+  string data = util::read_file(path);
+  if (data.size() < sizeof(uint64_t)) return programs;
+
+  const uint8_t *p = (const uint8_t *)data.data();
+  const uint8_t *end = p + data.size() - sizeof(uint64_t);
+  uint64_t checksum;
+  memcpy(&checksum, end, sizeof(checksum));
+  uint32_t magic, version, count;
+  uint64_t cache_key;
+  if (checksum != fnv1a(p, end - p) || !read_val(p, end, magic) || !read_val(p, end, version) ||
+      !read_val(p, end, cache_key) || !read_val(p, end, count) ||
+      magic != PROGRAM_CACHE_MAGIC || version != PROGRAM_CACHE_VERSION || cache_key != key) {
+    printf("Thneed::load: program cache %s is stale\n", path.c_str());
+    return programs;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t name_len;
+    uint64_t bin_len;
+    if (!read_val(p, end, name_len) || end - p < (ptrdiff_t)name_len) break;
+    string name((const char *)p, name_len);
+    p += name_len;
+    if (!read_val(p, end, bin_len) || end - p < (ptrdiff_t)bin_len) break;
+    programs[name] = cl_program_from_binary(context, device_id, p, bin_len);
+    p += bin_len;
+  }
+  if (programs.size() != count) {
+    for (auto &[name, prg] : programs) clReleaseProgram(prg);
+    programs.clear();
+  }
+  return programs;
+}
+
+static void save_program_cache(const string &path, uint64_t key, cl_device_id device_id, const map<string, cl_program> &programs) {
+  string out;
+  write_val(out, PROGRAM_CACHE_MAGIC);
+  write_val(out, PROGRAM_CACHE_VERSION);
+  write_val(out, key);
+  write_val(out, (uint32_t)programs.size());
+  for (const auto &[name, prg] : programs) {
+    size_t bin_len = 0;
+    CL_CHECK(clGetProgramInfo(prg, CL_PROGRAM_BINARY_SIZES, sizeof(bin_len), &bin_len, NULL));
+    string bin(bin_len, '\0');
+    unsigned char *bin_ptr = (unsigned char *)bin.data();
+    CL_CHECK(clGetProgramInfo(prg, CL_PROGRAM_BINARIES, sizeof(bin_ptr), &bin_ptr, NULL));
+
+    write_val(out, (uint32_t)name.size());
+    out += name;
+    write_val(out, (uint64_t)bin_len);
+    out += bin;
+  }
+  write_val(out, fnv1a(out.data(), out.size()));
+
+  // written aside and renamed, a cache cut short by a power loss must not load
+  util::create_directories(THNEED_CACHE_DIR, 0775);
+  const string tmp_path = path + ".tmp";
+  if (util::write_file(tmp_path.c_str(), out.data(), out.size(), O_WRONLY | O_CREAT | O_TRUNC) != 0 ||
+      rename(tmp_path.c_str(), path.c_str()) != 0) {
+    printf("Thneed::load: failed to write program cache %s\n", path.c_str());
+  }
+}
+
 void Thneed::load(const char *filename) {
   printf("Thneed::load: loading from %s\n", filename);
 
-  string buf = util::read_file(filename);
-  int jsz = *(int *)buf.data();
+  // mapped rather than read, the weights are only copied once, into the cl buffers
+  int fd = open(filename, O_RDONLY);
+  assert(fd >= 0);
+  struct stat st = {};
+  int stat_err = fstat(fd, &st);
+  assert(stat_err == 0);
+  const size_t buf_size = st.st_size;
+  char *buf = (char *)mmap(NULL, buf_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  assert(buf != MAP_FAILED);
+
+  int jsz = *(int *)buf;
   string jsonerr;
-  string jj(buf.data() + sizeof(int), jsz);
+  string jj(buf + sizeof(int), jsz);
   Json jdat = Json::parse(jj, jsonerr);
 
   map<cl_mem, cl_mem> real_mem;
@@ -33,7 +154,7 @@ void Thneed::load(const char *filename) {
       assert(mobj["needs_load"].bool_value() == false);
     } else {
       if (mobj["needs_load"].bool_value()) {
-        clbuf = clCreateBuffer(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, sz, &buf[ptr], NULL);
+        clbuf = clCreateBuffer(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, sz, buf + ptr, NULL);
         if (debug >= 1) printf("loading %p %d @ 0x%X\n", clbuf, sz, ptr);
         ptr += sz;
       } else {
@@ -66,7 +187,7 @@ void Thneed::load(const char *filename) {
 
 #ifndef QCOM2
       if (mobj["needs_load"].bool_value()) {
-        clbuf = clCreateImage(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, &format, &desc, &buf[ptr-sz], &errcode);
+        clbuf = clCreateImage(context, CL_MEM_COPY_HOST_PTR | CL_MEM_READ_WRITE, &format, &desc, buf + ptr - sz, &errcode);
       } else {
         clbuf = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, &errcode);
       }
@@ -83,10 +204,26 @@ void Thneed::load(const char *filename) {
     real_mem[*(cl_mem*)(mobj["id"].string_value().data())] = clbuf;
   }
 
+  const string driver = device_info(device_id, CL_DEVICE_NAME) + device_info(device_id, CL_DRIVER_VERSION);
+  const uint64_t cache_key = fnv1a(jj.data(), jj.size(), fnv1a(driver.data(), driver.size()));
+  const string base = filename;
+  const string cache_path = util::string_format("%s/%s.%016llx", THNEED_CACHE_DIR, base.substr(base.rfind('/') + 1).c_str(),
+                                                (unsigned long long)cache_key);
+
+  const auto &sources = jdat["programs"].object_items();
   map<string, cl_program> g_programs;
-  for (const auto &[name, source] : jdat["programs"].object_items()) {
-    if (debug >= 1) printf("building %s with size %zu\n", name.c_str(), source.string_value().size());
-    g_programs[name] = cl_program_from_source(context, device_id, source.string_value());
+  if (!sources.empty()) {
+    g_programs = load_program_cache(cache_path, cache_key, context, device_id);
+  }
+  if (g_programs.size() != sources.size()) {
+    g_programs.clear();
+    for (const auto &[name, source] : sources) {
+      if (debug >= 1) printf("building %s with size %zu\n", name.c_str(), source.string_value().size());
+      g_programs[name] = cl_program_from_source(context, device_id, source.string_value());
+    }
+    if (!sources.empty()) save_program_cache(cache_path, cache_key, device_id, g_programs);
+  } else {
+    printf("Thneed::load: %zu programs from %s\n", g_programs.size(), cache_path.c_str());
   }
 
   for (auto &obj : jdat["inputs"].array_items()) {
@@ -117,7 +254,7 @@ void Thneed::load(const char *filename) {
     string name = obj["name"].string_value();
     size_t length = obj["length"].int_value();
     if (debug >= 1) printf("binary %s with size %zu\n", name.c_str(), length);
-    g_programs[name] = cl_program_from_binary(context, device_id, (const uint8_t*)&buf[ptr], length);
+    g_programs[name] = cl_program_from_binary(context, device_id, (const uint8_t*)buf + ptr, length);
     ptr += length;
   }
 
@@ -150,4 +287,5 @@ void Thneed::load(const char *filename) {
   }
 
   clFinish(command_queue);
+  munmap(buf, buf_size);
 }
@@ -5,7 +5,9 @@
 #endif
 
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -41,7 +43,7 @@ class CLQueuedKernel {
                    cl_uint _work_dim,
                    const size_t *_global_work_size,
                    const size_t *_local_work_size);
-    cl_int exec();
+    cl_int exec(cl_event *event = NULL);
     void debug_print(bool verbose);
     int get_arg_num(const char *search_arg_name);
     cl_program program;
@@ -61,6 +63,15 @@ class CLQueuedKernel {
     Thneed *thneed;
 };
 
+// GPU time of the runs of one kernel at one work size, from the queue's profiling events
+struct KernelProfile {
+  string name;
+  string work_size;
+  uint64_t calls = 0;
+  uint64_t total_ns = 0;
+  uint64_t max_ns = 0;
+};
+
 class CachedIoctl {
   public:
     virtual void exec() {}
@@ -95,6 +106,13 @@ class Thneed {
     void execute(float **finputs, float *foutput, bool slow=false);
     void wait();
 
+    // async execute: submit copies the inputs and queues the commands, returning a token
+    // for poll or wait_for. the output is only valid once the token completed
+    int submit(float **finputs);
+    bool poll(int token);
+    // sleeps in the kernel until the token retires, false on timeout. timeout -1 waits forever
+    bool wait_for(int token, int timeout_ms);
+
     vector<cl_mem> input_clmem;
     vector<void *> inputs;
     vector<size_t> input_sizes;
@@ -110,6 +128,15 @@ class Thneed {
     int debug;
     int timestamp;
 
+    // THNEED_PROFILE=N times every kernel of the CL path and prints a report every N runs.
+    // The recorded commands have no events, so a profiled thneed always runs clexec
+    int profile = 0;
+    int profile_runs = 0;
+    map<string, KernelProfile> kernel_profile;
+    // ranked by total GPU time
+    void profile_report(FILE *f);
+    void profile_reset();
+
 #ifdef QCOM2
     unique_ptr<GPUMalloc> ram;
     vector<unique_ptr<CachedIoctl> > cmds;
@@ -1,11 +1,13 @@
 #include "selfdrive/modeld/thneed/thneed.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <map>
 
 #include "common/clutil.h"
 #include "common/timing.h"
+#include "common/util.h"
 
 map<pair<cl_kernel, int>, string> g_args;
 map<pair<cl_kernel, int>, int> g_args_size;
@@ -19,20 +21,78 @@ void Thneed::stop() {
 void Thneed::clinit() {
   device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
   if (context == NULL) context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
-  //cl_command_queue_properties props[3] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
-  cl_command_queue_properties props[3] = {CL_QUEUE_PROPERTIES, 0, 0};
+  char *thneed_profile_env = getenv("THNEED_PROFILE");
+  profile = (thneed_profile_env != NULL) ? atoi(thneed_profile_env) : 0;
+  cl_command_queue_properties props[3] = {CL_QUEUE_PROPERTIES, profile > 0 ? (cl_command_queue_properties)CL_QUEUE_PROFILING_ENABLE : 0, 0};
   command_queue = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
   printf("Thneed::clinit done\n");
 }
 
 cl_int Thneed::clexec() {
   if (debug >= 1) printf("Thneed::clexec: running %lu queued kernels\n", kq.size());
-  for (auto &k : kq) {
-    if (record) ckq.push_back(k);
-    cl_int ret = k->exec();
+  vector<cl_event> events(profile > 0 ? kq.size() : 0);
+  for (int i = 0; i < kq.size(); i++) {
+    if (record) ckq.push_back(kq[i]);
+    cl_int ret = kq[i]->exec(profile > 0 ? &events[i] : NULL);
     assert(ret == CL_SUCCESS);
   }
-  return clFinish(command_queue);
+  cl_int ret = clFinish(command_queue);
+  if (profile <= 0) return ret;
+
+  for (int i = 0; i < kq.size(); i++) {
+    cl_ulong start, end;
+    CL_CHECK(clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL));
+    CL_CHECK(clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL));
+    CL_CHECK(clReleaseEvent(events[i]));
+
+    const CLQueuedKernel &k = *kq[i];
+    string work_size;
+    for (int d = 0; d < k.work_dim; d++) {
+      work_size += util::string_format("%s%zu", d ? "x" : "", k.global_work_size[d]);
+    }
+    work_size += "/";
+    for (int d = 0; d < k.work_dim; d++) {
+      work_size += util::string_format("%s%zu", d ? "x" : "", k.local_work_size[d]);
+    }
+
+    KernelProfile &p = kernel_profile[k.name + " " + work_size];
+    if (p.calls == 0) {
+      p.name = k.name;
+      p.work_size = work_size;
+    }
+    p.calls++;
+    p.total_ns += end - start;
+    p.max_ns = std::max<uint64_t>(p.max_ns, end - start);
+  }
+  if (++profile_runs % profile == 0) profile_report(stdout);
+  return ret;
+}
+
+void Thneed::profile_report(FILE *f) {
+  if (profile_runs == 0) return;
+  vector<const KernelProfile *> ranked;
+  uint64_t total_ns = 0;
+  for (auto &[key, p] : kernel_profile) {
+    ranked.push_back(&p);
+    total_ns += p.total_ns;
+  }
+  std::sort(ranked.begin(), ranked.end(), [](auto a, auto b) { return a->total_ns > b->total_ns; });
+
+  fprintf(f, "Thneed profile: %d runs, %.2f ms of kernels a run\n", profile_runs, total_ns / 1e6 / profile_runs);
+  fprintf(f, "%4s %10s %6s %6s %10s %10s  %-48s %s\n", "rank", "us/run", "%", "calls", "mean us", "max us", "kernel", "global/local");
+  for (int i = 0; i < ranked.size(); i++) {
+    const KernelProfile &p = *ranked[i];
+    fprintf(f, "%4d %10.1f %6.2f %6.1f %10.1f %10.1f  %-48s %s\n", i + 1,
+            p.total_ns / 1e3 / profile_runs, 100.0 * p.total_ns / std::max<uint64_t>(total_ns, 1),
+            (double)p.calls / profile_runs, p.total_ns / 1e3 / p.calls, p.max_ns / 1e3,
+            p.name.c_str(), p.work_size.c_str());
+  }
+  fflush(f);
+}
+
+void Thneed::profile_reset() {
+  kernel_profile.clear();
+  profile_runs = 0;
 }
 
 void Thneed::copy_inputs(float **finputs, bool internal) {
@@ -53,7 +113,10 @@ void Thneed::copy_output(float *foutput) {
     size_t sz;
     clGetMemObjectInfo(output, CL_MEM_SIZE, sizeof(sz), &sz, NULL);
     if (debug >= 1) printf("copying %lu for output %p -> %p\n", sz, output, foutput);
-    CL_CHECK(clEnqueueReadBuffer(command_queue, output, CL_TRUE, 0, sz, foutput, 0, NULL, NULL));
+    // the GPU shares memory with the CPU, mapping avoids the driver's staging copy of a read
+    void *mapped = CL_CHECK_ERR(clEnqueueMapBuffer(command_queue, output, CL_TRUE, CL_MAP_READ, 0, sz, 0, NULL, NULL, &err));
+    memcpy(foutput, mapped, sz);
+    CL_CHECK(clEnqueueUnmapMemObject(command_queue, output, mapped, 0, NULL, NULL));
   } else {
     printf("CAUTION: model output is NULL, does it have no outputs?\n");
   }
@@ -104,7 +167,7 @@ int CLQueuedKernel::get_arg_num(const char *search_arg_name) {
   assert(false);
 }
 
-cl_int CLQueuedKernel::exec() {
+cl_int CLQueuedKernel::exec(cl_event *event) {
   if (kernel == NULL) {
     kernel = clCreateKernel(program, name.c_str(), NULL);
     arg_names.clear();
@@ -133,7 +196,7 @@ cl_int CLQueuedKernel::exec() {
   }
 
   return clEnqueueNDRangeKernel(thneed->command_queue,
-    kernel, work_dim, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    kernel, work_dim, NULL, global_work_size, local_work_size, 0, NULL, event);
 }
 
 void CLQueuedKernel::debug_print(bool verbose) {
@@ -220,16 +220,39 @@ Thneed::Thneed(bool do_clinit, cl_context _context) {
 }
 
 void Thneed::wait() {
+  wait_for(timestamp, -1);
+}
+
+bool Thneed::wait_for(int token, int timeout_ms) {
   struct kgsl_device_waittimestamp_ctxtid wait;
   wait.context_id = context_id;
-  wait.timestamp = timestamp;
-  wait.timeout = -1;
+  wait.timestamp = token;
+  wait.timeout = timeout_ms;
 
   uint64_t tb = nanos_since_boot();
   int wret = ioctl(fd, IOCTL_KGSL_DEVICE_WAITTIMESTAMP_CTXTID, &wait);
   uint64_t te = nanos_since_boot();
 
   if (debug >= 1) printf("wait %d after %lu us\n", wret, (te-tb)/1000);
+  return wret == 0;
+}
+
+bool Thneed::poll(int token) {
+  struct kgsl_cmdstream_readtimestamp_ctxtid ts;
+  ts.context_id = context_id;
+  ts.type = KGSL_TIMESTAMP_RETIRED;
+  int ret = ioctl(fd, IOCTL_KGSL_CMDSTREAM_READTIMESTAMP_CTXTID, &ts);
+  assert(ret == 0);
+  // timestamps wrap
+  return (int)(ts.timestamp - (unsigned int)token) >= 0;
+}
+
+int Thneed::submit(float **finputs) {
+  copy_inputs(finputs, true);
+  for (auto &it : cmds) {
+    it->exec();
+  }
+  return timestamp;
 }
 
 void Thneed::execute(float **finputs, float *foutput, bool slow) {
@@ -20,6 +20,12 @@ void loadyuv_init(LoadYUVState* s, cl_context ctx, cl_device_id device_id, int w
   s->loadys_krnl = CL_CHECK_ERR(clCreateKernel(prg, "loadys", &err));
   s->loaduv_krnl = CL_CHECK_ERR(clCreateKernel(prg, "loaduv", &err));
   s->copy_krnl = CL_CHECK_ERR(clCreateKernel(prg, "copy", &err));
+  s->warpload_krnl = CL_CHECK_ERR(clCreateKernel(prg, "warpload", &err));
+  s->warpload_tf8_krnl = CL_CHECK_ERR(clCreateKernel(prg, "warpload_tf8", &err));
+  s->copy_tf8_krnl = CL_CHECK_ERR(clCreateKernel(prg, "copy_tf8", &err));
+  s->warpload_f16_krnl = CL_CHECK_ERR(clCreateKernel(prg, "warpload_f16", &err));
+  s->copy_f16_krnl = CL_CHECK_ERR(clCreateKernel(prg, "copy_f16", &err));
+  s->m_cl = CL_CHECK_ERR(clCreateBuffer(ctx, CL_MEM_READ_WRITE, 2*3*3*sizeof(float), NULL, &err));
 
   // done with this
   CL_CHECK(clReleaseProgram(prg));
@@ -29,6 +35,12 @@ void loadyuv_destroy(LoadYUVState* s) {
   CL_CHECK(clReleaseKernel(s->loadys_krnl));
   CL_CHECK(clReleaseKernel(s->loaduv_krnl));
   CL_CHECK(clReleaseKernel(s->copy_krnl));
+  CL_CHECK(clReleaseKernel(s->warpload_krnl));
+  CL_CHECK(clReleaseKernel(s->warpload_tf8_krnl));
+  CL_CHECK(clReleaseKernel(s->copy_tf8_krnl));
+  CL_CHECK(clReleaseKernel(s->warpload_f16_krnl));
+  CL_CHECK(clReleaseKernel(s->copy_f16_krnl));
+  CL_CHECK(clReleaseMemObject(s->m_cl));
 }
 
 void loadyuv_queue(LoadYUVState* s, cl_command_queue q,
@@ -72,3 +84,41 @@ void loadyuv_queue(LoadYUVState* s, cl_command_queue q,
   CL_CHECK(clEnqueueNDRangeKernel(q, s->loaduv_krnl, 1, NULL,
                                &loaduv_work_size, NULL, 0, 0, NULL));
 }
+
+void loadyuv_warp_queue(LoadYUVState* s, cl_command_queue q,
+                        cl_mem in_yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                        const mat3& projection, cl_mem out_cl, bool do_shift, ModelInputType type) {
+  // y projection, then the uv one for the half size planes, like transform_queue
+  float m[2*3*3];
+  memcpy(&m[0], projection.v, sizeof(projection.v));
+  memcpy(&m[9], transform_scale_buffer(projection, 0.5).v, sizeof(projection.v));
+  CL_CHECK(clEnqueueWriteBuffer(q, s->m_cl, CL_TRUE, 0, sizeof(m), m, 0, NULL, NULL));
+
+  cl_int out_off = 0;
+  if (do_shift) {
+    // shift the image in slot 1 to slot 0, then place the new image in slot 1
+    out_off = (s->width*s->height) + (s->width/2)*(s->height/2)*2;
+    cl_kernel copy_krnl = type == ModelInputType::FLOAT32 ? s->copy_krnl :
+                          type == ModelInputType::FLOAT16 ? s->copy_f16_krnl : s->copy_tf8_krnl;
+    CL_CHECK(clSetKernelArg(copy_krnl, 0, sizeof(cl_mem), &out_cl));
+    CL_CHECK(clSetKernelArg(copy_krnl, 1, sizeof(cl_int), &out_off));
+    const size_t copy_work_size = out_off/8;
+    CL_CHECK(clEnqueueNDRangeKernel(q, copy_krnl, 1, NULL,
+                                &copy_work_size, NULL, 0, 0, NULL));
+  }
+
+  cl_kernel krnl = type == ModelInputType::FLOAT32 ? s->warpload_krnl :
+                   type == ModelInputType::FLOAT16 ? s->warpload_f16_krnl : s->warpload_tf8_krnl;
+  CL_CHECK(clSetKernelArg(krnl, 0, sizeof(cl_mem), &in_yuv));
+  CL_CHECK(clSetKernelArg(krnl, 1, sizeof(cl_int), &in_stride));
+  CL_CHECK(clSetKernelArg(krnl, 2, sizeof(cl_int), &in_uv_offset));
+  CL_CHECK(clSetKernelArg(krnl, 3, sizeof(cl_int), &in_height));
+  CL_CHECK(clSetKernelArg(krnl, 4, sizeof(cl_int), &in_width));
+  CL_CHECK(clSetKernelArg(krnl, 5, sizeof(cl_mem), &s->m_cl));
+  CL_CHECK(clSetKernelArg(krnl, 6, sizeof(cl_mem), &out_cl));
+  CL_CHECK(clSetKernelArg(krnl, 7, sizeof(cl_int), &out_off));
+
+  const size_t work_size[2] = {(size_t)s->width/2, (size_t)s->height/2};
+  CL_CHECK(clEnqueueNDRangeKernel(q, krnl, 2, NULL,
+                               work_size, NULL, 0, 0, NULL));
+}
@@ -45,3 +45,89 @@ __kernel void copy(__global float8 * inout,
   const int gid = get_global_id(0);
   inout[gid] = inout[gid + in_offset / 8];
 }
+
+__kernel void copy_tf8(__global uchar8 * inout,
+                       int in_offset)
+{
+  const int gid = get_global_id(0);
+  inout[gid] = inout[gid + in_offset / 8];
+}
+
+// fp16 is moved as its bits, half arithmetic would need cl_khr_fp16
+__kernel void copy_f16(__global ushort8 * inout,
+                       int in_offset)
+{
+  const int gid = get_global_id(0);
+  inout[gid] = inout[gid + in_offset / 8];
+}
+
+// fused warpPerspective + loadys/loaduv, samples the NV12 frame straight into the
+// model's input layout. same fixed point bilinear sampling as transform.cl, the
+// output only differs from the unfused path where fast relaxed math moves a rounding
+#define INTER_BITS 5
+#define INTER_TAB_SIZE (1 << INTER_BITS)
+#define INTER_REMAP_COEF_BITS 15
+#define INTER_REMAP_COEF_SCALE (1 << INTER_REMAP_COEF_BITS)
+
+inline uchar warp_sample(__global const uchar * src, int src_row_stride, int src_px_stride, int src_offset,
+                         int src_rows, int src_cols, __constant float * M, int dx, int dy) {
+  float X0 = M[0] * dx + M[1] * dy + M[2];
+  float Y0 = M[3] * dx + M[4] * dy + M[5];
+  float W = M[6] * dx + M[7] * dy + M[8];
+  W = W != 0.0f ? INTER_TAB_SIZE / W : 0.0f;
+  int X = rint(X0 * W), Y = rint(Y0 * W);
+
+  short sx = convert_short_sat(X >> INTER_BITS);
+  short sy = convert_short_sat(Y >> INTER_BITS);
+  short ay = (short)(Y & (INTER_TAB_SIZE - 1));
+  short ax = (short)(X & (INTER_TAB_SIZE - 1));
+
+  int v0 = (sx >= 0 && sx < src_cols && sy >= 0 && sy < src_rows) ?
+      convert_int(src[mad24(sy, src_row_stride, src_offset + sx*src_px_stride)]) : 0;
+  int v1 = (sx+1 >= 0 && sx+1 < src_cols && sy >= 0 && sy < src_rows) ?
+      convert_int(src[mad24(sy, src_row_stride, src_offset + (sx+1)*src_px_stride)]) : 0;
+  int v2 = (sx >= 0 && sx < src_cols && sy+1 >= 0 && sy+1 < src_rows) ?
+      convert_int(src[mad24(sy+1, src_row_stride, src_offset + sx*src_px_stride)]) : 0;
+  int v3 = (sx+1 >= 0 && sx+1 < src_cols && sy+1 >= 0 && sy+1 < src_rows) ?
+      convert_int(src[mad24(sy+1, src_row_stride, src_offset + (sx+1)*src_px_stride)]) : 0;
+
+  float taby = 1.f/INTER_TAB_SIZE*ay;
+  float tabx = 1.f/INTER_TAB_SIZE*ax;
+
+  int itab0 = convert_short_sat_rte( (1.0f-taby)*(1.0f-tabx) * INTER_REMAP_COEF_SCALE );
+  int itab1 = convert_short_sat_rte( (1.0f-taby)*tabx * INTER_REMAP_COEF_SCALE );
+  int itab2 = convert_short_sat_rte( taby*(1.0f-tabx) * INTER_REMAP_COEF_SCALE );
+  int itab3 = convert_short_sat_rte( taby*tabx * INTER_REMAP_COEF_SCALE );
+
+  int val = v0 * itab0 +  v1 * itab1 + v2 * itab2 + v3 * itab3;
+  return convert_uchar_sat((val + (1 << (INTER_REMAP_COEF_BITS-1))) >> INTER_REMAP_COEF_BITS);
+}
+
+// one work item per output uv pixel. M holds the y projection, then the uv one
+#define WARP_LOAD(name, T, STORE)                                                                   \
+__kernel void name(__global const uchar * src, int src_stride, int src_uv_offset,                    \
+                   int src_rows, int src_cols, __constant float * M,                                 \
+                   __global T * out, int out_offset)                                                 \
+{                                                                                                    \
+  const int x = get_global_id(0);                                                                    \
+  const int y = get_global_id(1);                                                                    \
+  const int i = out_offset + y * (TRANSFORMED_WIDTH/2) + x;                                          \
+  /* y0: even row, even col. y1: odd row, even col. y2: even row, odd col. y3: odd row, odd col */   \
+  for (int k = 0; k < 4; k++) {                                                                      \
+    STORE(out, i + k*UV_SIZE, warp_sample(src, src_stride, 1, 0, src_rows, src_cols, M,              \
+                                          2*x + k/2, 2*y + (k&1)));                                  \
+  }                                                                                                  \
+  STORE(out, i + 4*UV_SIZE, warp_sample(src, src_stride, 2, src_uv_offset, src_rows/2, src_cols/2,   \
+                                        M + 9, x, y));                                               \
+  STORE(out, i + 5*UV_SIZE, warp_sample(src, src_stride, 2, src_uv_offset + 1, src_rows/2, src_cols/2, \
+                                        M + 9, x, y));                                               \
+}
+
+#define STORE_FLOAT(out, i, v) out[i] = convert_float(v)
+#define STORE_TF8(out, i, v) out[i] = (v)
+// 0-255 is exact in fp16, so the half input loses nothing over the float one
+#define STORE_HALF(out, i, v) vstore_half(convert_float(v), i, out)
+
+WARP_LOAD(warpload, float, STORE_FLOAT)
+WARP_LOAD(warpload_tf8, uchar, STORE_TF8)
+WARP_LOAD(warpload_f16, half, STORE_HALF)
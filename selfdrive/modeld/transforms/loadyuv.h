@@ -1,10 +1,27 @@
 #pragma once
 
+#include <cstdint>
+
 #include "common/clutil.h"
+#include "common/mat.h"
+
+// element type of the packed model input. tf8 is 0-255 as uint8, like the SNPE tf8 inputs
+enum class ModelInputType {
+  FLOAT32,
+  FLOAT16,
+  TF8,
+};
+
+inline size_t model_input_elem_size(ModelInputType type) {
+  return type == ModelInputType::FLOAT32 ? sizeof(float) : type == ModelInputType::FLOAT16 ? sizeof(uint16_t) : sizeof(uint8_t);
+}
 
 typedef struct {
   int width, height;
   cl_kernel loadys_krnl, loaduv_krnl, copy_krnl;
+  cl_kernel warpload_krnl, warpload_tf8_krnl, copy_tf8_krnl;
+  cl_kernel warpload_f16_krnl, copy_f16_krnl;
+  cl_mem m_cl;
 } LoadYUVState;
 
 void loadyuv_init(LoadYUVState* s, cl_context ctx, cl_device_id device_id, int width, int height);
@@ -14,3 +31,10 @@ void loadyuv_destroy(LoadYUVState* s);
 void loadyuv_queue(LoadYUVState* s, cl_command_queue q,
                    cl_mem y_cl, cl_mem u_cl, cl_mem v_cl,
                    cl_mem out_cl, bool do_shift = false);
+
+// warp the NV12 frame with projection and write the packed model input in one pass,
+// replacing transform_queue followed by loadyuv_queue. out_cl holds elements of type
+void loadyuv_warp_queue(LoadYUVState* s, cl_command_queue q,
+                        cl_mem in_yuv, int in_width, int in_height, int in_stride, int in_uv_offset,
+                        const mat3& projection, cl_mem out_cl, bool do_shift = false,
+                        ModelInputType type = ModelInputType::FLOAT32);
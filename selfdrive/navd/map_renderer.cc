@@ -1,6 +1,7 @@
 #include "selfdrive/navd/map_renderer.h"
 
 #include <cmath>
+#include <iterator>
 #include <string>
 #include <QApplication>
 #include <QBuffer>
@@ -9,6 +10,7 @@
 #include "common/timing.h"
 #include "common/swaglog.h"
 #include "selfdrive/ui/qt/maps/map_helpers.h"
+#include "system/hardware/hw.h"
 
 const float DEFAULT_ZOOM = 13.5; // Don't go below 13 or features will start to disappear
 const int HEIGHT = 256, WIDTH = 256;
@@ -22,6 +24,32 @@ const int MAP_OFFSET = 128;
 const bool TEST_MODE = getenv("MAP_RENDER_TEST_MODE");
 const int LLK_DECIMATION = TEST_MODE ? 1 : 10;
 
+// the tile cache holds the prefetched route, QMapboxGL defaults to 50MB
+const uint64_t MAPS_CACHE_MAX_SIZE = 512 * 1024 * 1024ULL;
+const double PREFETCH_SPACING_METERS = 300;  // a frame is 512m across
+const int MAX_PREFETCH_POINTS = 200;
+
+// The model input is the red channel of the map. The gray pass packs 4 pixels of it
+// into every RGBA texel of a WIDTH/4 wide FBO with the rows flipped top down, so what's
+// read back is the Y plane of the VisionBuf as is, and a quarter of the RGBA frame.
+const char *GRAY_VERTEX_SHADER = R"(#version 300 es
+void main() {
+  // one triangle that covers the viewport
+  gl_Position = vec4(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0, 0.0, 1.0);
+})";
+
+const char *GRAY_FRAGMENT_SHADER = R"(#version 300 es
+precision mediump float;
+uniform sampler2D frame;
+out vec4 gray;
+void main() {
+  ivec2 p = ivec2(gl_FragCoord.xy);
+  int y = textureSize(frame, 0).y - 1 - p.y;
+  gray = vec4(texelFetch(frame, ivec2(4 * p.x, y), 0).r, texelFetch(frame, ivec2(4 * p.x + 1, y), 0).r,
+              texelFetch(frame, ivec2(4 * p.x + 2, y), 0).r, texelFetch(frame, ivec2(4 * p.x + 3, y), 0).r);
+})";
+const uint64_t GRAY_READBACK_TIMEOUT_NS = 100 * 1000000ULL;
+
 float get_zoom_level_for_scale(float lat, float meters_per_pixel) {
   float meters_per_tile = meters_per_pixel * PIXELS_PER_TILE;
   float num_tiles = cos(DEG2RAD(lat)) * EARTH_CIRCUMFERENCE_METERS / meters_per_tile;
@@ -38,6 +66,14 @@ QMapbox::Coordinate get_point_along_line(float lat, float lon, float bearing, fl
 
 
 MapRenderer::MapRenderer(const QMapboxGLSettings &settings, bool online) : m_settings(settings) {
+  if (online) {
+    m_settings.setMapMode(QMapboxGLSettings::Static);
+    if (m_settings.cacheDatabasePath().isEmpty()) {
+      m_settings.setCacheDatabasePath(QString::fromStdString(Path::comma_home() + "/mbgl-cache-navd.db"));
+    }
+    m_settings.setCacheDatabaseMaximumSize(MAPS_CACHE_MAX_SIZE);
+  }
+
   QSurfaceFormat fmt;
   fmt.setRenderableType(QSurfaceFormat::OpenGLES);
 
@@ -58,6 +94,9 @@ MapRenderer::MapRenderer(const QMapboxGLSettings &settings, bool online) : m_set
 
   QOpenGLFramebufferObjectFormat fbo_format;
   fbo.reset(new QOpenGLFramebufferObject(WIDTH, HEIGHT, fbo_format));
+  if (!initGrayPass()) {
+    LOGW("no gray pass, frames are converted on the CPU");
+  }
 
   std::string style = util::read_file(STYLE_PATH);
   m_map.reset(new QMapboxGL(nullptr, m_settings, fbo->size(), 1));
@@ -88,6 +127,10 @@ MapRenderer::MapRenderer(const QMapboxGLSettings &settings, bool online) : m_set
   });
 
   if (online) {
+    QObject::connect(m_map.data(), &QMapboxGL::needsRendering, this, &MapRenderer::render);
+    // queued, it's emitted from inside the render() that finishes the still, before the readback
+    QObject::connect(m_map.data(), &QMapboxGL::staticRenderFinished, this, &MapRenderer::stillFinished, Qt::QueuedConnection);
+
     vipc_server.reset(new VisionIpcServer("navd"));
     vipc_server->create_buffers(VisionStreamType::VISION_STREAM_MAP, NUM_VIPC_BUFFERS, false, WIDTH, HEIGHT);
     vipc_server->start_listener();
@@ -112,23 +155,8 @@ void MapRenderer::msgUpdate() {
 
     if ((sm->rcv_frame("liveLocationKalman") % LLK_DECIMATION) == 0) {
       float bearing = RAD2DEG(orientation.getValue()[2]);
-      updatePosition(get_point_along_line(pos.getValue()[0], pos.getValue()[1], bearing, MAP_OFFSET), bearing);
-
-      // TODO: use the static rendering mode instead
-      // retry render a few times
-      for (int i = 0; i < 5 && !rendered(); i++) {
-        QApplication::processEvents(QEventLoop::AllEvents, 100);
-        update();
-        if (rendered()) {
-          LOGW("rendered after %d retries", i+1);
-          break;
-        }
-      }
-
-      // fallback to sending a blank frame
-      if (!rendered()) {
-        publish(0, false);
-      }
+      requestFrame(get_point_along_line(pos.getValue()[0], pos.getValue()[1], bearing, MAP_OFFSET), bearing,
+                   (*sm)["liveLocationKalman"].getLogMonoTime());
     }
   }
 
@@ -139,17 +167,26 @@ void MapRenderer::msgUpdate() {
       route.push_back(QGeoCoordinate(c.getLatitude(), c.getLongitude()));
     }
     updateRoute(route);
+
+    // the route starts where the car is, so it's prefetched from the start
+    prefetch_points.clear();
+    prefetch_idx = 0;
+    double dist = PREFETCH_SPACING_METERS;
+    for (int i = 1; i < route.size() && prefetch_points.size() < MAX_PREFETCH_POINTS; i++) {
+      dist += route[i - 1].distanceTo(route[i]);
+      if (dist >= PREFETCH_SPACING_METERS) {
+        prefetch_points.push_back(route[i]);
+        dist = 0;
+      }
+    }
+    prefetchNext();
   }
 
   // schedule next update
   timer->start(0);
 }
 
-void MapRenderer::updatePosition(QMapbox::Coordinate position, float bearing) {
-  if (m_map.isNull()) {
-    return;
-  }
-
+void MapRenderer::setCamera(QMapbox::Coordinate position, float bearing) {
   // Choose a scale that ensures above 13 zoom level up to and above 75deg of lat
   float meters_per_pixel = 2;
   float zoom = get_zoom_level_for_scale(position.first, meters_per_pixel);
@@ -157,24 +194,80 @@ void MapRenderer::updatePosition(QMapbox::Coordinate position, float bearing) {
   m_map->setCoordinate(position);
   m_map->setBearing(bearing);
   m_map->setZoom(zoom);
+}
+
+void MapRenderer::updatePosition(QMapbox::Coordinate position, float bearing) {
+  if (m_map.isNull()) {
+    return;
+  }
+
+  setCamera(position, bearing);
   update();
 }
 
+void MapRenderer::requestFrame(QMapbox::Coordinate position, float bearing, uint64_t llk_mono_time) {
+  // every frame is published by the time the next one is due, blank if its tiles aren't in
+  if (frame_request) {
+    LOGW("map frame not rendered in time, sending a blank one");
+    publish(0, false, frame_request->llk_mono_time);
+  }
+
+  // a still in flight, for a prefetch or the late frame, is finished at this camera instead
+  setCamera(position, bearing);
+  frame_request = FrameRequest{.llk_mono_time = llk_mono_time, .start_t = millis_since_boot()};
+  if (!still_in_flight) startStill();
+}
+
+void MapRenderer::startStill() {
+  still_in_flight = true;
+  m_map->startStaticRender();
+}
+
+void MapRenderer::render() {
+  update();
+  if (frame_request) frame_request->drawn = true;
+}
+
+void MapRenderer::stillFinished(const QString &error) {
+  still_in_flight = false;
+  if (!error.isEmpty()) {
+    LOGE("static render failed: %s", error.toStdString().c_str());
+  }
+
+  if (frame_request) {
+    if (!error.isEmpty()) {
+      publish(0, false, frame_request->llk_mono_time);
+    } else if (!frame_request->drawn) {
+      // done for the camera before the frame moved it, go again
+      startStill();
+      return;
+    } else {
+      publish((millis_since_boot() - frame_request->start_t) / 1000.0, true, frame_request->llk_mono_time);
+    }
+    frame_request.reset();
+  }
+  prefetchNext();
+}
+
+void MapRenderer::prefetchNext() {
+  if (still_in_flight || frame_request || prefetch_idx >= prefetch_points.size()) return;
+
+  const QGeoCoordinate &c = prefetch_points[prefetch_idx];
+  float bearing = prefetch_idx > 0 ? prefetch_points[prefetch_idx - 1].azimuthTo(c) : 0;
+  setCamera({c.latitude(), c.longitude()}, bearing);
+  prefetch_idx++;
+  startStill();
+}
+
 bool MapRenderer::loaded() {
   return m_map->isFullyLoaded();
 }
 
 void MapRenderer::update() {
-  double start_t = millis_since_boot();
   gl_functions->glClear(GL_COLOR_BUFFER_BIT);
   m_map->render();
+  if (gray_program) startGrayReadback();
   gl_functions->glFlush();
-  double end_t = millis_since_boot();
-
-  if ((vipc_server != nullptr) && loaded()) {
-    publish((end_t - start_t) / 1000.0, true);
-    last_llk_rendered = (*sm)["liveLocationKalman"].getLogMonoTime();
-  }
 }
 
 void MapRenderer::sendThumbnail(const uint64_t ts, const kj::Array<capnp::byte> &buf) {
@@ -186,9 +279,116 @@ void MapRenderer::sendThumbnail(const uint64_t ts, const kj::Array<capnp::byte>
   pm->send("navThumbnail", msg);
 }
 
-void MapRenderer::publish(const double render_time, const bool loaded) {
-  QImage cap = fbo->toImage().convertToFormat(QImage::Format_RGB888, Qt::AutoColor);
+bool MapRenderer::initGrayPass() {
+  if (ctx->format().majorVersion() < 3) return false;
+  gl_extra = ctx->extraFunctions();
+
+  gray_program = std::make_unique<QOpenGLShaderProgram>();
+  if (!gray_program->addShaderFromSourceCode(QOpenGLShader::Vertex, GRAY_VERTEX_SHADER) ||
+      !gray_program->addShaderFromSourceCode(QOpenGLShader::Fragment, GRAY_FRAGMENT_SHADER) ||
+      !gray_program->link()) {
+    LOGE("gray pass shaders failed: %s", gray_program->log().toStdString().c_str());
+    gray_program.reset();
+    return false;
+  }
+  gray_fbo = std::make_unique<QOpenGLFramebufferObject>(WIDTH / 4, HEIGHT, QOpenGLFramebufferObjectFormat());
+
+  gl_extra->glGenBuffers(1, &gray_pbo);
+  gl_extra->glBindBuffer(GL_PIXEL_PACK_BUFFER, gray_pbo);
+  gl_extra->glBufferData(GL_PIXEL_PACK_BUFFER, WIDTH * HEIGHT, nullptr, GL_STREAM_READ);
+  gl_extra->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return true;
+}
+
+void MapRenderer::startGrayReadback() {
+  QOpenGLExtraFunctions *gl = gl_extra;
+  if (gray_fence) {
+    gl->glDeleteSync(gray_fence);
+    gray_fence = nullptr;
+  }
+
+  // mapbox caches the GL state it set, whatever this changes is put back after
+  GLint prev_fbo, prev_program, prev_active_texture, prev_texture, prev_vao, prev_viewport[4];
+  GLboolean prev_color_mask[4];
+  gl->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prev_fbo);
+  gl->glGetIntegerv(GL_CURRENT_PROGRAM, &prev_program);
+  gl->glGetIntegerv(GL_ACTIVE_TEXTURE, &prev_active_texture);
+  gl->glActiveTexture(GL_TEXTURE0);
+  gl->glGetIntegerv(GL_TEXTURE_BINDING_2D, &prev_texture);
+  gl->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &prev_vao);
+  gl->glGetIntegerv(GL_VIEWPORT, prev_viewport);
+  gl->glGetBooleanv(GL_COLOR_WRITEMASK, prev_color_mask);
+  const GLenum caps[] = {GL_BLEND, GL_SCISSOR_TEST, GL_CULL_FACE, GL_DEPTH_TEST, GL_STENCIL_TEST};
+  GLboolean prev_caps[std::size(caps)];
+  for (size_t i = 0; i < std::size(caps); i++) {
+    prev_caps[i] = gl->glIsEnabled(caps[i]);
+    gl->glDisable(caps[i]);
+  }
+
+  gray_fbo->bind();
+  gl->glViewport(0, 0, WIDTH / 4, HEIGHT);
+  gl->glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  gl->glBindVertexArray(0);
+  gray_program->bind();
+  gray_program->setUniformValue("frame", 0);
+  gl->glBindTexture(GL_TEXTURE_2D, fbo->texture());
+  gl->glDrawArrays(GL_TRIANGLES, 0, 3);
+
+  // lands in the PBO without waiting for the GPU, the fence says when it's there
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, gray_pbo);
+  gl->glReadPixels(0, 0, WIDTH / 4, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  gray_fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  for (size_t i = 0; i < std::size(caps); i++) {
+    if (prev_caps[i]) gl->glEnable(caps[i]);
+  }
+  gl->glColorMask(prev_color_mask[0], prev_color_mask[1], prev_color_mask[2], prev_color_mask[3]);
+  gl->glViewport(prev_viewport[0], prev_viewport[1], prev_viewport[2], prev_viewport[3]);
+  gl->glBindVertexArray(prev_vao);
+  gl->glBindTexture(GL_TEXTURE_2D, prev_texture);
+  gl->glActiveTexture(prev_active_texture);
+  gl->glUseProgram(prev_program);
+  gl->glBindFramebuffer(GL_FRAMEBUFFER, prev_fbo);
+}
+
+// copies the last gray readback to dst, false if there's none
+bool MapRenderer::finishGrayReadback(uint8_t *dst) {
+  if (!gray_fence) return false;
+
+  QOpenGLExtraFunctions *gl = gl_extra;
+  GLenum ret = gl->glClientWaitSync(gray_fence, GL_SYNC_FLUSH_COMMANDS_BIT, GRAY_READBACK_TIMEOUT_NS);
+  gl->glDeleteSync(gray_fence);
+  gray_fence = nullptr;
+  if (ret != GL_ALREADY_SIGNALED && ret != GL_CONDITION_SATISFIED) {
+    LOGE("gray readback didn't finish: %x", ret);
+    return false;
+  }
 
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, gray_pbo);
+  void *src = gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, WIDTH * HEIGHT, GL_MAP_READ_BIT);
+  if (src) {
+    memcpy(dst, src, WIDTH * HEIGHT);
+    gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return src != nullptr;
+}
+
+// FNV-1a over 8 byte words, enough to tell two renders of the same map apart from a changed one
+static uint64_t image_hash(const uint8_t *data, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, data + i, sizeof(w));
+    h = (h ^ w) * 0x100000001b3ULL;
+  }
+  for (; i < len; i++) h = (h ^ data[i]) * 0x100000001b3ULL;
+  return h ? h : 1;
+}
+
+void MapRenderer::publish(const double render_time, const bool loaded, const uint64_t llk_mono_time) {
   auto location = (*sm)["liveLocationKalman"].getLiveLocationKalman();
   bool valid = loaded && (location.getStatus() == cereal::LiveLocationKalman::Status::VALID) && location.getPositionGeodetic().getValid();
   ever_loaded = ever_loaded || loaded;
@@ -196,24 +396,33 @@ void MapRenderer::publish(const double render_time, const bool loaded) {
   VisionBuf* buf = vipc_server->get_buffer(VisionStreamType::VISION_STREAM_MAP);
   VisionIpcBufExtra extra = {
     .frame_id = frame_id,
-    .timestamp_sof = (*sm)["liveLocationKalman"].getLogMonoTime(),
+    .timestamp_sof = llk_mono_time,
     .timestamp_eof = ts,
     .valid = valid,
   };
 
-  assert(cap.sizeInBytes() >= buf->len);
+  assert(buf->len >= WIDTH * HEIGHT);
   uint8_t* dst = (uint8_t*)buf->addr;
-  uint8_t* src = cap.bits();
-
-  // RGB to greyscale
-  memset(dst, 128, buf->len);
-  for (int i = 0; i < WIDTH * HEIGHT; i++) {
-    dst[i] = src[i * 3];
+  if (!finishGrayReadback(dst)) {
+    // RGB to greyscale
+    QImage cap = fbo->toImage().convertToFormat(QImage::Format_RGB888, Qt::AutoColor);
+    uint8_t* src = cap.bits();
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+      dst[i] = src[i * 3];
+    }
   }
+  memset(dst + WIDTH * HEIGHT, 128, buf->len - WIDTH * HEIGHT);
 
+  // while stopped, or with nothing new on the map, the image is the same every render and
+  // the nav model can keep its last output
+  extra.content_hash = image_hash(dst, WIDTH * HEIGHT);
   vipc_server->send(buf, &extra);
 
-  // Send thumbnail
+  // Send thumbnail, only these need the full frame
+  QImage cap;
+  if (TEST_MODE || frame_id % 100 == 0) {
+    cap = fbo->toImage().convertToFormat(QImage::Format_RGB888, Qt::AutoColor);
+  }
   if (TEST_MODE) {
     // Full image in thumbnails in test mode
     kj::Array<capnp::byte> buffer_kj = kj::heapArray<capnp::byte>((const capnp::byte*)cap.bits(), cap.sizeInBytes());
@@ -234,7 +443,7 @@ void MapRenderer::publish(const double render_time, const bool loaded) {
   auto evt = msg.initEvent();
   auto state = evt.initMapRenderState();
   evt.setValid(valid);
-  state.setLocationMonoTime((*sm)["liveLocationKalman"].getLogMonoTime());
+  state.setLocationMonoTime(llk_mono_time);
   state.setRenderTime(render_time);
   state.setFrameId(frame_id);
   pm->send("mapRenderState", msg);
@@ -243,10 +452,13 @@ void MapRenderer::publish(const double render_time, const bool loaded) {
 }
 
 uint8_t* MapRenderer::getImage() {
-  QImage cap = fbo->toImage().convertToFormat(QImage::Format_RGB888, Qt::AutoColor);
+  uint8_t* dst = new uint8_t[WIDTH * HEIGHT];
+  if (finishGrayReadback(dst)) {
+    return dst;
+  }
 
+  QImage cap = fbo->toImage().convertToFormat(QImage::Format_RGB888, Qt::AutoColor);
   uint8_t* src = cap.bits();
-  uint8_t* dst = new uint8_t[WIDTH * HEIGHT];
 
   // RGB to greyscale
   for (int i = 0; i < WIDTH * HEIGHT; i++) {
@@ -284,6 +496,10 @@ void MapRenderer::initLayers() {
 }
 
 MapRenderer::~MapRenderer() {
+  if (gl_extra) {
+    if (gray_fence) gl_extra->glDeleteSync(gray_fence);
+    gl_extra->glDeleteBuffers(1, &gray_pbo);
+  }
 }
 
 extern "C" {
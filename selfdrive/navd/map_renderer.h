@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 
 #include <QOpenGLContext>
 #include <QMapboxGL>
@@ -8,8 +9,10 @@
 #include <QGeoCoordinate>
 #include <QOpenGLBuffer>
 #include <QOffscreenSurface>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLFunctions>
 #include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
 
 #include "cereal/visionipc/visionipc_server.h"
 #include "cereal/messaging/messaging.h"
@@ -31,10 +34,20 @@ private:
   std::unique_ptr<QOpenGLFunctions> gl_functions;
   std::unique_ptr<QOpenGLFramebufferObject> fbo;
 
+  // the gray pass, the model input rendered into a small FBO and read back through a PBO
+  QOpenGLExtraFunctions *gl_extra = nullptr;
+  std::unique_ptr<QOpenGLShaderProgram> gray_program;
+  std::unique_ptr<QOpenGLFramebufferObject> gray_fbo;
+  GLuint gray_pbo = 0;
+  GLsync gray_fence = nullptr;
+  bool initGrayPass();
+  void startGrayReadback();
+  bool finishGrayReadback(uint8_t *dst);
+
   std::unique_ptr<VisionIpcServer> vipc_server;
   std::unique_ptr<PubMaster> pm;
   std::unique_ptr<SubMaster> sm;
-  void publish(const double render_time, const bool loaded);
+  void publish(const double render_time, const bool loaded, const uint64_t llk_mono_time);
   void sendThumbnail(const uint64_t ts, const kj::Array<capnp::byte> &buf);
 
   QMapboxGLSettings m_settings;
@@ -43,10 +56,26 @@ private:
   void initLayers();
 
   uint32_t frame_id = 0;
-  uint64_t last_llk_rendered = 0;
-  bool rendered() {
-    return last_llk_rendered == (*sm)["liveLocationKalman"].getLogMonoTime();
-  }
+
+  // Online the map renders in static mode, a still is done once every tile it shows is
+  // loaded and drawn. frame_request is the frame that's published when it's done.
+  struct FrameRequest {
+    uint64_t llk_mono_time;
+    double start_t;
+    bool drawn = false;  // rendered since the camera moved to it
+  };
+  std::optional<FrameRequest> frame_request;
+  bool still_in_flight = false;
+  void setCamera(QMapbox::Coordinate position, float bearing);
+  void requestFrame(QMapbox::Coordinate position, float bearing, uint64_t llk_mono_time);
+  void startStill();
+  void stillFinished(const QString &error);
+  void render();
+
+  // points along the route whose tiles are loaded into the cache while there's no frame to render
+  QList<QGeoCoordinate> prefetch_points;
+  int prefetch_idx = 0;
+  void prefetchNext();
 
   QTimer* timer;
   bool ever_loaded = false;
@@ -1,16 +1,37 @@
 #include <sys/resource.h>
 
+#include <future>
+
 #include <QApplication>
+#include <QTimer>
 #include <QTranslator>
 
 #include "system/hardware/hw.h"
+#include "selfdrive/ui/profiler.h"
 #include "selfdrive/ui/qt/qt_window.h"
 #include "selfdrive/ui/qt/util.h"
 #include "selfdrive/ui/qt/window.h"
 
+// the first frame is up once the first paint has been processed
+class FirstFrameFilter : public QObject {
+protected:
+  bool eventFilter(QObject *obj, QEvent *event) override {
+    if (event->type() == QEvent::Paint) {
+      qApp->removeEventFilter(this);
+      QTimer::singleShot(0, []() { uiStartupPhase("first_frame"); });
+    }
+    return false;
+  }
+};
+
 int main(int argc, char *argv[]) {
+  uiStartupPhase("start");
   setpriority(PRIO_PROCESS, 0, -20);
 
+  // one read of the params directory, on a worker while the display is opened. The toggles
+  // read their values from the cache it fills
+  std::future<void> params_read = std::async(std::launch::async, []() { Params().readAll(); });
+
   qInstallMessageHandler(swagLogMessageHandler);
   initApp(argc, argv);
 
@@ -22,9 +43,18 @@ int main(int argc, char *argv[]) {
 
   QApplication a(argc, argv);
   a.installTranslator(&translator);
+  FirstFrameFilter first_frame;
+  a.installEventFilter(&first_frame);
+  uiStartupPhase("app");
+
+  params_read.wait();
+  uiStartupPhase("params");
+  uiState();
+  uiStartupPhase("ui_state");
 
   MainWindow w;
   setMainWindow(&w);
   a.installEventFilter(&w);
+  uiStartupPhase("main_window");
   return a.exec();
 }
@@ -0,0 +1,99 @@
+#include "selfdrive/ui/profiler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include "common/statlog.h"
+#include "common/swaglog.h"
+#include "common/trace.h"
+#include "common/util.h"
+
+namespace {
+
+// string literals, they're trace span names too
+const char *section_names[] = {
+  "ui.sockets",
+  "ui.state",
+  "ui.camera",
+  "ui.model",
+  "ui.lane_lines",
+  "ui.hud",
+  "ui.map",
+  "ui.frame",
+};
+static_assert(std::size(section_names) == (size_t)UISection::COUNT);
+
+}  // namespace
+
+UIProfiler::UIProfiler() : enabled(getenv("UI_PROFILE") && strcmp(getenv("UI_PROFILE"), "1") == 0) {
+  log_start_time = millis_since_boot() / 1000.;
+}
+
+void UIProfiler::add(UISection section, double ms) {
+  Window &w = windows[(int)section];
+  w.ms[w.head] = ms;
+  w.head = (w.head + 1) % UI_PROFILE_WINDOW;
+  w.count = std::min(w.count + 1, UI_PROFILE_WINDOW);
+}
+
+float UIProfiler::percentile(UISection section, float p) const {
+  const Window &w = windows[(int)section];
+  if (w.count == 0) return 0;
+
+  std::array<float, UI_PROFILE_WINDOW> sorted;
+  std::copy_n(w.ms.begin(), w.count, sorted.begin());
+  auto nth = sorted.begin() + std::min<int>(w.count - 1, p * w.count);
+  std::nth_element(sorted.begin(), nth, sorted.begin() + w.count);
+  return *nth;
+}
+
+std::vector<std::string> UIProfiler::summary() const {
+  std::vector<std::string> lines = {util::string_format("%-14s %6s %6s %6s", "ms", "p50", "p95", "max")};
+  for (int i = 0; i < (int)UISection::COUNT; i++) {
+    const UISection s = (UISection)i;
+    lines.push_back(util::string_format("%-14s %6.2f %6.2f %6.2f", section_names[i] + 3,
+                                        percentile(s, 0.5), percentile(s, 0.95), percentile(s, 1.0)));
+  }
+  return lines;
+}
+
+void UIProfiler::frameDone() {
+  const double now = millis_since_boot() / 1000.;
+  if (now - log_start_time < UI_PROFILE_LOG_INTERVAL) return;
+  log_start_time = now;
+
+  std::string line;
+  for (int i = 0; i < (int)UISection::COUNT; i++) {
+    const UISection s = (UISection)i;
+    const float p50 = percentile(s, 0.5), p95 = percentile(s, 0.95);
+    statlog_gauge(util::string_format("%s.p50_ms", section_names[i]).c_str(), p50);
+    statlog_gauge(util::string_format("%s.p95_ms", section_names[i]).c_str(), p95);
+    line += util::string_format(" %s %.2f/%.2f", section_names[i] + 3, p50, p95);
+  }
+  LOGW("ui frame times p50/p95 ms:%s", line.c_str());
+}
+
+UIProfiler *uiProfiler() {
+  static UIProfiler profiler;
+  return &profiler;
+}
+
+void uiStartupPhase(const char *phase) {
+  static const uint64_t start_ns = nanos_since_boot();
+  static uint64_t prev_ns = start_ns;
+
+  const uint64_t now_ns = nanos_since_boot();
+  const double ms = (now_ns - prev_ns) / 1e6, total_ms = (now_ns - start_ns) / 1e6;
+  statlog_gauge(util::string_format("ui.startup.%s_ms", phase).c_str(), ms);
+  if (trace_enabled) trace_span(phase, prev_ns, now_ns);
+  LOGW("ui startup: %s in %.1f ms, %.1f ms since start", phase, ms, total_ms);
+  prev_ns = now_ns;
+}
+
+UIProfileScope::~UIProfileScope() {
+  if (start_ns == 0) return;
+  const uint64_t end_ns = nanos_since_boot();
+  uiProfiler()->add(section, (end_ns - start_ns) / 1e6);
+  if (trace_enabled) trace_span(section_names[(int)section], start_ns, end_ns);
+}
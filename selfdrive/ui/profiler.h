@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "common/timing.h"
+
+// Time per frame of the parts of the UI, over a rolling window of frames, for the
+// developer overlay onroad, the log and the trace. It's off unless the UI runs with
+// UI_PROFILE=1, then every UIProfileScope is two clock reads. Every
+// UI_PROFILE_LOG_INTERVAL the percentiles go to statlog and the log too.
+
+#define UI_PROFILE_WINDOW 256  // frames
+#define UI_PROFILE_LOG_INTERVAL 10.0  // seconds
+
+enum class UISection {
+  SOCKETS,
+  STATE,
+  CAMERA,
+  MODEL,
+  LANE_LINES,
+  HUD,
+  MAP,
+  FRAME,  // all of the onroad paint
+  COUNT,
+};
+
+class UIProfiler {
+public:
+  UIProfiler();
+  void add(UISection section, double ms);
+  // the p-th percentile (0 to 1) of a section's window in ms, 0 without samples
+  float percentile(UISection section, float p) const;
+  // a line per section with its percentiles, for the overlay
+  std::vector<std::string> summary() const;
+  // at the end of a frame, logs once an interval passed
+  void frameDone();
+
+  const bool enabled;
+
+private:
+  struct Window {
+    std::array<float, UI_PROFILE_WINDOW> ms = {};
+    int count = 0;  // up to UI_PROFILE_WINDOW
+    int head = 0;
+  };
+  std::array<Window, (int)UISection::COUNT> windows;
+  double log_start_time = 0;
+};
+
+UIProfiler *uiProfiler();
+
+// A phase of startup is done, always logged with the time it took and the time since the
+// first phase, also as a ui.startup.<phase>_ms gauge and a trace span. phase is a literal
+void uiStartupPhase(const char *phase);
+
+class UIProfileScope {
+public:
+  UIProfileScope(UISection s) : section(s) {
+    if (uiProfiler()->enabled) start_ns = nanos_since_boot();
+  }
+  ~UIProfileScope();
+
+private:
+  UISection section;
+  uint64_t start_ns = 0;
+};
+
+#define UI_PROFILE_CONCAT_(a, b) a##b
+#define UI_PROFILE_CONCAT(a, b) UI_PROFILE_CONCAT_(a, b)
+#define UI_PROFILE_SCOPE(section) UIProfileScope UI_PROFILE_CONCAT(__ui_profile_scope_, __LINE__)(section)
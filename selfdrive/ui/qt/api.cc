@@ -9,9 +9,13 @@
 #include <QDateTime>
 #include <QDebug>
 #include <QFile>
-#include <QJsonDocument>
+#include <QHash>
+#include <QMetaMethod>
 #include <QNetworkRequest>
+#include <QPointer>
+#include <QtConcurrent>
 
+#include <algorithm>
 #include <string>
 
 #include "common/params.h"
@@ -62,13 +66,51 @@ QString create_jwt(const QJsonObject &payloads, int expiry) {
   return jwt;
 }
 
+// The RSA signature is the slow part of a request, the token of the requests is signed
+// once and used until it's 5 minutes from expiring or the dongle id changes
+QString request_jwt() {
+  static QString jwt, identity;
+  static qint64 expires = 0;
+
+  const int expiry = 3600;
+  QString id = getDongleId().value_or("");
+  qint64 t = QDateTime::currentSecsSinceEpoch();
+  if (jwt.isEmpty() || id != identity || t > expires - 5 * 60) {
+    jwt = create_jwt({}, expiry);
+    identity = id;
+    expires = t + expiry;
+  }
+  return jwt;
+}
+
 }  // namespace CommaApi
 
+namespace {
+
+// The last response of a GET with the validators the server sent along. The parse is kept
+// too, a 304 isn't parsed again
+struct CachedResponse {
+  QByteArray etag, last_modified;
+  QByteArray body;
+  QFuture<QJsonDocument> json;
+  bool parsed = false;
+};
+
+QHash<QString, CachedResponse> response_cache;
+// GETs in flight by their key, and the requests waiting on each reply
+QHash<QString, QNetworkReply *> in_flight;
+QHash<QNetworkReply *, QList<QPointer<HttpRequest>>> waiting;
+
+}  // namespace
+
 HttpRequest::HttpRequest(QObject *parent, bool create_jwt, int timeout) : create_jwt(create_jwt), QObject(parent) {
   networkTimer = new QTimer(this);
   networkTimer->setSingleShot(true);
   networkTimer->setInterval(timeout);
   connect(networkTimer, &QTimer::timeout, this, &HttpRequest::requestTimeout);
+  connect(&jsonWatcher, &QFutureWatcher<QJsonDocument>::finished, [=]() {
+    emit requestJson(jsonWatcher.result(), true);
+  });
 }
 
 bool HttpRequest::active() const {
@@ -84,9 +126,19 @@ void HttpRequest::sendRequest(const QString &requestURL, const HttpRequest::Meth
     qDebug() << "HttpRequest is active";
     return;
   }
+
+  // the device and the user token get different answers
+  const QString key = method == HttpRequest::Method::GET ? (create_jwt ? "jwt " : "user ") + requestURL : "";
+  if (QNetworkReply *shared = in_flight.value(key)) {
+    reply = shared;
+    waiting[reply].push_back(this);
+    networkTimer->start();
+    return;
+  }
+
   QString token;
   if (create_jwt) {
-    token = CommaApi::create_jwt();
+    token = CommaApi::request_jwt();
   } else {
     QString token_json = QString::fromStdString(util::read_file(util::getenv("HOME") + "/.comma/auth.json"));
     QJsonDocument json_d = QJsonDocument::fromJson(token_json.toUtf8());
@@ -102,38 +154,94 @@ void HttpRequest::sendRequest(const QString &requestURL, const HttpRequest::Meth
   }
 
   if (method == HttpRequest::Method::GET) {
+    auto cached = response_cache.constFind(key);
+    if (cached != response_cache.constEnd()) {
+      if (!cached->etag.isEmpty()) request.setRawHeader("If-None-Match", cached->etag);
+      if (!cached->last_modified.isEmpty()) request.setRawHeader("If-Modified-Since", cached->last_modified);
+    }
     reply = nam()->get(request);
+    in_flight[key] = reply;
   } else if (method == HttpRequest::Method::DELETE) {
     reply = nam()->deleteResource(request);
   }
 
+  waiting[reply].push_back(this);
   networkTimer->start();
-  connect(reply, &QNetworkReply::finished, this, &HttpRequest::requestFinished);
+  connect(reply, &QNetworkReply::finished, [reply = reply, key]() { replyFinished(reply, key); });
 }
 
+// aborts the reply of every request waiting on it, they asked for the same
 void HttpRequest::requestTimeout() {
   reply->abort();
 }
 
-void HttpRequest::requestFinished() {
-  networkTimer->stop();
+void HttpRequest::replyFinished(QNetworkReply *reply, const QString &key) {
+  const QList<QPointer<HttpRequest>> requests = waiting.take(reply);
+  if (!key.isEmpty()) in_flight.remove(key);
+  reply->deleteLater();
 
-  if (reply->error() == QNetworkReply::NoError) {
-    emit requestDone(reply->readAll(), true, reply->error());
-  } else {
-    QString error;
-    if (reply->error() == QNetworkReply::OperationCanceledError) {
+  const QNetworkReply::NetworkError error = reply->error();
+  for (auto &r : requests) {
+    if (r) {
+      r->networkTimer->stop();
+      r->reply = nullptr;
+    }
+  }
+
+  if (error != QNetworkReply::NoError) {
+    QString errorString = reply->errorString();
+    if (error == QNetworkReply::OperationCanceledError) {
       nam()->clearAccessCache();
       nam()->clearConnectionCache();
-      error = "Request timed out";
+      errorString = "Request timed out";
+    }
+    for (auto &r : requests) {
+      if (r) r->emitError(error, errorString);
+    }
+    return;
+  }
+
+  QByteArray body = reply->readAll();
+  const bool json = std::any_of(requests.begin(), requests.end(), [](auto &r) { return r && r->wantsJson(); });
+  QFuture<QJsonDocument> parsed;
+  if (!key.isEmpty()) {
+    CachedResponse &cached = response_cache[key];
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+      body = cached.body;
     } else {
-      error = reply->errorString();
+      cached = {.etag = reply->rawHeader("ETag"), .last_modified = reply->rawHeader("Last-Modified"), .body = body};
+    }
+    if (json && !cached.parsed) {
+      cached.json = parseJson(body);
+      cached.parsed = true;
     }
-    emit requestDone(error, false, reply->error());
+    parsed = cached.json;
+  } else if (json) {
+    parsed = parseJson(body);
   }
 
-  reply->deleteLater();
-  reply = nullptr;
+  for (auto &r : requests) {
+    if (r) r->emitResponse(body, parsed);
+  }
+}
+
+bool HttpRequest::wantsJson() const {
+  return isSignalConnected(QMetaMethod::fromSignal(&HttpRequest::requestJson));
+}
+
+QFuture<QJsonDocument> HttpRequest::parseJson(const QByteArray &response) {
+  return QtConcurrent::run([response]() { return QJsonDocument::fromJson(response.trimmed()); });
+}
+
+void HttpRequest::emitResponse(const QByteArray &response, const QFuture<QJsonDocument> &json) {
+  if (wantsJson()) jsonWatcher.setFuture(json);
+  emit requestDone(response, true, QNetworkReply::NoError);
+}
+
+void HttpRequest::emitError(QNetworkReply::NetworkError error, const QString &errorString) {
+  const bool json = wantsJson();
+  emit requestDone(errorString, false, error);
+  if (json) emit requestJson({}, false);
 }
 
 QNetworkAccessManager *HttpRequest::nam() {
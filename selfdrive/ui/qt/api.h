@@ -1,5 +1,8 @@
 #pragma once
 
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkReply>
 #include <QString>
@@ -12,11 +15,16 @@ namespace CommaApi {
 const QString BASE_URL = util::getenv("API_HOST", "https://api.commadotai.com").c_str();
 QByteArray rsa_sign(const QByteArray &data);
 QString create_jwt(const QJsonObject &payloads = {}, int expiry = 3600);
+QString request_jwt();
 
 }  // namespace CommaApi
 
 /**
  * Makes a request to the request endpoint.
+ *
+ * GETs of a url are shared by every HttpRequest: one that's already in flight is waited
+ * for instead of sent again, and the last response is kept so the next one is sent with
+ * its ETag/Last-Modified and a 304 is answered from it.
  */
 
 class HttpRequest : public QObject {
@@ -32,16 +40,26 @@ public:
 
 signals:
   void requestDone(const QString &response, bool success, QNetworkReply::NetworkError error);
+  // the response parsed on a worker, only if something is connected to it
+  void requestJson(const QJsonDocument &json, bool success);
 
 protected:
+  bool wantsJson() const;
+  static QFuture<QJsonDocument> parseJson(const QByteArray &response);
+  // requestDone, and requestJson with json once it's parsed
+  void emitResponse(const QByteArray &response, const QFuture<QJsonDocument> &json);
+
   QNetworkReply *reply = nullptr;
 
 private:
   static QNetworkAccessManager *nam();
+  static void replyFinished(QNetworkReply *reply, const QString &key);
+  void emitError(QNetworkReply::NetworkError error, const QString &errorString);
+
   QTimer *networkTimer = nullptr;
+  QFutureWatcher<QJsonDocument> jsonWatcher;
   bool create_jwt;
 
 private slots:
   void requestTimeout();
-  void requestFinished();
 };
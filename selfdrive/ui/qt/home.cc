@@ -38,11 +38,6 @@ HomeWindow::HomeWindow(QWidget* parent) : QWidget(parent) {
   body = new BodyWindow(this);
   slayout->addWidget(body);
 
-  driver_view = new DriverViewWindow(this);
-  connect(driver_view, &DriverViewWindow::done, [=] {
-    showDriverView(false);
-  });
-  slayout->addWidget(driver_view);
   setAttribute(Qt::WA_NoSystemBackground);
   QObject::connect(uiState(), &UIState::uiUpdate, this, &HomeWindow::updateState);
   QObject::connect(uiState(), &UIState::offroadTransition, this, &HomeWindow::offroadTransition);
@@ -80,6 +75,14 @@ void HomeWindow::offroadTransition(bool offroad) {
 void HomeWindow::showDriverView(bool show) {
   if (show) {
     emit closeSettings();
+    // made the first time it's shown, it isn't needed to start up
+    if (!driver_view) {
+      driver_view = new DriverViewWindow(this);
+      connect(driver_view, &DriverViewWindow::done, [=] {
+        showDriverView(false);
+      });
+      slayout->addWidget(driver_view);
+    }
     slayout->setCurrentWidget(driver_view);
   } else {
     slayout->setCurrentWidget(home);
@@ -198,6 +201,10 @@ OffroadHome::OffroadHome(QWidget* parent) : QFrame(parent) {
   timer = new QTimer(this);
   timer->callOnTimeout(this, &OffroadHome::refresh);
 
+  status = new OffroadStatus(this);
+  QObject::connect(status, &OffroadStatus::changed, this, &OffroadHome::statusChanged);
+  status->start();
+
   setStyleSheet(R"(
     * {
       color: white;
@@ -232,19 +239,23 @@ OffroadHome::OffroadHome(QWidget* parent) : QFrame(parent) {
 void OffroadHome::showEvent(QShowEvent *event) {
   refresh();
   timer->start(10 * 1000);
+  status->setPaused(false);
 }
 
 void OffroadHome::hideEvent(QHideEvent *event) {
   timer->stop();
+  status->setPaused(true);
 }
 
 void OffroadHome::refresh() {
   date->setText(QLocale(uiState()->language.mid(5)).toString(QDateTime::currentDateTime(), "dddd, MMMM d"));
   QString modelName = MODEL_NAME[modelKey];
   version->setText(getBrand() + " v" + getVersion().left(14).trimmed() + " - " + modelName);
+}
 
-  bool updateAvailable = update_widget->refresh();
-  int alerts = alerts_widget->refresh();
+void OffroadHome::statusChanged(const OffroadStatusState &state) {
+  bool updateAvailable = update_widget->refresh(state);
+  int alerts = alerts_widget->refresh(state);
 
   // pop-up new notification
   int idx = center_layout->currentIndex();
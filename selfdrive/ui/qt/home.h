@@ -29,10 +29,12 @@ private:
   void showEvent(QShowEvent *event) override;
   void hideEvent(QHideEvent *event) override;
   void refresh();
+  void statusChanged(const OffroadStatusState &state);
 
   Params params;
 
   QTimer* timer;
+  OffroadStatus* status;
   ElidedLabel* date;
   ElidedLabel* version;
   QStackedLayout* center_layout;
@@ -71,7 +73,7 @@ private:
   OffroadHome *home;
   OnroadWindow *onroad;
   BodyWindow *body;
-  DriverViewWindow *driver_view;
+  DriverViewWindow *driver_view = nullptr;
   QStackedLayout *slayout;
 
 private slots:
@@ -1,10 +1,14 @@
 #include "selfdrive/ui/qt/maps/map.h"
 
 #include <algorithm>
+#include <cmath>
 #include <eigen3/Eigen/Dense>
 
 #include <QDebug>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
 
+#include "selfdrive/ui/profiler.h"
 #include "selfdrive/ui/qt/maps/map_helpers.h"
 #include "selfdrive/ui/qt/util.h"
 #include "selfdrive/ui/ui.h"
@@ -17,8 +21,17 @@ const float MIN_ZOOM = 14;
 const float MAX_PITCH = 50;
 const float MIN_PITCH = 0;
 const float MAP_SCALE = 2;
+const float LOW_RES_SCALE = 2;  // of the framebuffer with MapLowResolution
 
-MapWindow::MapWindow(const QMapboxGLSettings &settings) : m_settings(settings), velocity_filter(0, 10, 0.05, false) {
+// The camera follows the car only once it would move the map by a pixel. Mapbox renders
+// on its own changes, anything below that is a render that looks the same.
+const float CAMERA_MIN_PIXELS = 1;
+const float CAMERA_MIN_ZOOM = 0.005;
+// the route is drawn in pieces of this, the ones that were driven are filtered out
+const double ROUTE_PIECE_LENGTH = 20;  // m
+
+MapWindow::MapWindow(const QMapboxGLSettings &settings) : m_settings(settings), velocity_filter(0, 10, 0.05, false),
+                                                          low_res(Params().getBool("MapLowResolution")) {
   QObject::connect(uiState(), &UIState::uiUpdate, this, &MapWindow::updateState);
 
   map_overlay = new QWidget (this);
@@ -163,7 +176,6 @@ void MapWindow::updateState(const UIState &s) {
     return;
   }
   const SubMaster &sm = *(s.sm);
-  update();
 
   if (sm.updated("modelV2")) {
     // set path color on change, and show map on rising edge of navigate on openpilot
@@ -230,23 +242,46 @@ void MapWindow::updateState(const UIState &s) {
 
   if (locationd_valid) {
     // Update current location marker
-    auto point = coordinate_to_collection(*last_position);
-    QMapbox::Feature feature1(QMapbox::Feature::PointType, point, {}, {});
-    QVariantMap carPosSource;
-    carPosSource["type"] = "geojson";
-    carPosSource["data"] = QVariant::fromValue<QMapbox::Feature>(feature1);
-    m_map->updateSource("carPosSource", carPosSource);
+    if (!marker_position || pixelDistance(*marker_position, *last_position) >= cameraMinPixels()) {
+      auto point = coordinate_to_collection(*last_position);
+      QMapbox::Feature feature1(QMapbox::Feature::PointType, point, {}, {});
+      QVariantMap carPosSource;
+      carPosSource["type"] = "geojson";
+      carPosSource["data"] = QVariant::fromValue<QMapbox::Feature>(feature1);
+      m_map->updateSource("carPosSource", carPosSource);
+      marker_position = last_position;
+    }
+
+    // the pieces behind the car are hidden, only the layer's filter changes
+    if (auto d = route_index.project(*last_position, route_along)) {
+      route_along = *d;
+      const int first_piece = route_along / ROUTE_PIECE_LENGTH;
+      if (first_piece != route_first_piece) {
+        m_map->setFilter("navLayer", QVariantList{">=", QVariantList{"get", "i"}, first_piece});
+        route_first_piece = first_piece;
+      }
+    }
 
     // Map bearing isn't updated when interacting, keep location marker up to date
     if (last_bearing) {
-      m_map->setLayoutProperty("carPosLayer", "icon-rotate", *last_bearing - m_map->bearing());
+      const float icon_rotate = *last_bearing - m_map->bearing();
+      if (!marker_rotate || std::abs(*marker_rotate - icon_rotate) >= minBearingChange()) {
+        m_map->setLayoutProperty("carPosLayer", "icon-rotate", icon_rotate);
+        marker_rotate = icon_rotate;
+      }
     }
   }
 
   if (interaction_counter == 0) {
-    if (last_position) m_map->setCoordinate(*last_position);
-    if (last_bearing) m_map->setBearing(*last_bearing);
-    m_map->setZoom(util::map_val<float>(velocity_filter.x(), 0, 30, MAX_ZOOM, MIN_ZOOM));
+    if (last_position && pixelDistance(m_map->coordinate(), *last_position) >= cameraMinPixels()) {
+      m_map->setCoordinate(*last_position);
+    }
+    if (last_bearing) {
+      const double bearing_change = std::remainder(*last_bearing - m_map->bearing(), 360.0);
+      if (std::abs(bearing_change) >= minBearingChange()) m_map->setBearing(*last_bearing);
+    }
+    const float zoom = util::map_val<float>(velocity_filter.x(), 0, 30, MAX_ZOOM, MIN_ZOOM);
+    if (std::abs(zoom - m_map->zoom()) >= CAMERA_MIN_ZOOM) m_map->setZoom(zoom);
   } else {
     interaction_counter--;
   }
@@ -274,12 +309,18 @@ void MapWindow::updateState(const UIState &s) {
   if (sm.rcv_frame("navRoute") != route_rcv_frame) {
     qWarning() << "Updating navLayer with new route";
     auto route = sm["navRoute"].getNavRoute();
-    auto route_points = capnp_coordinate_list_to_collection(route.getCoordinates());
-    QMapbox::Feature feature(QMapbox::Feature::LineStringType, route_points, {}, {});
+    QMapbox::Coordinates route_points;
+    for (auto const &c : route.getCoordinates()) {
+      route_points.push_back({c.getLatitude(), c.getLongitude()});
+    }
+    route_index = RouteIndex(route_points);
+    route_along = 0;
+    route_first_piece = 0;
     QVariantMap navSource;
     navSource["type"] = "geojson";
-    navSource["data"] = QVariant::fromValue<QMapbox::Feature>(feature);
+    navSource["data"] = QVariant::fromValue(route_index.pieces(ROUTE_PIECE_LENGTH));
     m_map->updateSource("navSource", navSource);
+    m_map->setFilter("navLayer", QVariantList{">=", QVariantList{"get", "i"}, 0});
     m_map->setLayoutProperty("navLayer", "visibility", "visible");
 
     route_rcv_frame = sm.rcv_frame("navRoute");
@@ -295,13 +336,35 @@ void MapWindow::setError(const QString &err_str) {
   }
 }
 
+// in screen pixels, at the current zoom
+float MapWindow::pixelDistance(const QMapbox::Coordinate &a, const QMapbox::Coordinate &b) const {
+  // the size of a pixel of the 512 pixel mapbox tiles, at the latitude
+  const double meters_per_pixel = 40075016.686 * std::cos(DEG2RAD(a.first)) / (512 * std::pow(2.0, m_map->zoom()));
+  const double meters = QGeoCoordinate(a.first, a.second).distanceTo(QGeoCoordinate(b.first, b.second));
+  return meters / meters_per_pixel * MAP_SCALE;
+}
+
+// hot, the map follows the car in bigger steps and renders less often
+float MapWindow::cameraMinPixels() const {
+  const RenderQuality q = uiState()->scene.render_quality;
+  return CAMERA_MIN_PIXELS * (q == RenderQuality::FULL ? 1 : q == RenderQuality::REDUCED ? 4 : 8);
+}
+
+// the rotation that moves the corners of the map by cameraMinPixels(), in degrees
+float MapWindow::minBearingChange() const {
+  return RAD2DEG(cameraMinPixels() / std::max(1.0, std::hypot(width(), height()) / 2));
+}
+
 void MapWindow::resizeGL(int w, int h) {
   m_map->resize(size() / MAP_SCALE);
   map_overlay->setFixedSize(width(), height());
+  low_res_fbo.reset();
 }
 
 void MapWindow::initializeGL() {
   m_map.reset(new QMapboxGL(this, m_settings, size(), 1));
+  // it changed or tiles came in, camera updates below a pixel render nothing
+  QObject::connect(m_map.data(), &QMapboxGL::needsRendering, this, [this]() { update(); });
 
   if (last_position) {
     m_map->setCoordinateZoom(*last_position, MAX_ZOOM);
@@ -326,7 +389,28 @@ void MapWindow::initializeGL() {
 
 void MapWindow::paintGL() {
   if (!isVisible() || m_map.isNull()) return;
+  UI_PROFILE_SCOPE(UISection::MAP);
+
+  if (!low_res) {
+    m_map->render();
+    return;
+  }
+
+  // rendered into a smaller framebuffer, then scaled up into the widget's
+  const QSize full_size = size() * devicePixelRatioF();
+  const QSize fbo_size = full_size / LOW_RES_SCALE;
+  if (!low_res_fbo) {
+    low_res_fbo.reset(new QOpenGLFramebufferObject(fbo_size, QOpenGLFramebufferObject::CombinedDepthStencil));
+    m_map->setFramebufferObject(low_res_fbo->handle(), fbo_size);
+  }
+  low_res_fbo->bind();
   m_map->render();
+
+  QOpenGLExtraFunctions *f = context()->extraFunctions();
+  f->glBindFramebuffer(GL_READ_FRAMEBUFFER, low_res_fbo->handle());
+  f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultFramebufferObject());
+  f->glBlitFramebuffer(0, 0, fbo_size.width(), fbo_size.height(), 0, 0, full_size.width(), full_size.height(), GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  f->glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
 }
 
 void MapWindow::clearRoute() {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 
 #include <QGeoCoordinate>
@@ -8,6 +9,7 @@
 #include <QMap>
 #include <QMapboxGL>
 #include <QMouseEvent>
+#include <QOpenGLFramebufferObject>
 #include <QOpenGLWidget>
 #include <QPixmap>
 #include <QPushButton>
@@ -21,6 +23,7 @@
 #include "common/util.h"
 #include "selfdrive/ui/ui.h"
 #include "selfdrive/ui/qt/maps/map_eta.h"
+#include "selfdrive/ui/qt/maps/map_helpers.h"
 #include "selfdrive/ui/qt/maps/map_instructions.h"
 
 class MapWindow : public QOpenGLWidget {
@@ -48,9 +51,18 @@ private:
   bool gestureEvent(QGestureEvent *event);
   void pinchTriggered(QPinchGesture *gesture);
   void setError(const QString &err_str);
+  float pixelDistance(const QMapbox::Coordinate &a, const QMapbox::Coordinate &b) const;
+  float cameraMinPixels() const;
+  float minBearingChange() const;
 
   bool loaded_once = false;
 
+  // Rendering
+  const bool low_res;
+  std::unique_ptr<QOpenGLFramebufferObject> low_res_fbo;
+  std::optional<QMapbox::Coordinate> marker_position;
+  std::optional<float> marker_rotate;
+
   // Panning
   QPointF m_lastPos;
   int interaction_counter = 0;
@@ -76,6 +88,9 @@ private:
   void clearRoute();
   void updateDestinationMarker();
   uint64_t route_rcv_frame = 0;
+  RouteIndex route_index;
+  double route_along = 0;  // m along the route to the car
+  int route_first_piece = 0;  // the first piece that's drawn
 
   // FrogPilot variables
   Params params = Params();
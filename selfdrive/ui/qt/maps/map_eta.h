@@ -19,5 +19,6 @@ private:
 
   bool format_24h = false;
   QTextDocument eta_doc;
+  QString eta_html;
   Params param;
 };
@@ -1,6 +1,7 @@
 #include "selfdrive/ui/qt/maps/map_helpers.h"
 
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 
@@ -149,3 +150,112 @@ std::pair<QString, QString> map_format_distance(float d, bool is_metric) {
                         : std::pair{QString::number(50 * std::nearbyint(d / 50)), QObject::tr("ft")};
   }
 }
+
+namespace {
+
+const double EARTH_RADIUS = 6378137.0;  // m
+const double BIN_SIZE = 0.002;  // deg, about 200 m of latitude
+
+int64_t bin_key(int lat_bin, int lon_bin) {
+  return ((int64_t)lat_bin << 32) | (uint32_t)lon_bin;
+}
+
+// m east and north of origin, close enough over the length of a segment
+std::pair<double, double> local_xy(const QMapbox::Coordinate &origin, const QMapbox::Coordinate &c) {
+  return {DEG2RAD(c.second - origin.second) * std::cos(DEG2RAD(origin.first)) * EARTH_RADIUS,
+          DEG2RAD(c.first - origin.first) * EARTH_RADIUS};
+}
+
+}  // namespace
+
+RouteIndex::RouteIndex(QMapbox::Coordinates coordinates) : points(std::move(coordinates)) {
+  along.reserve(points.size());
+  for (int i = 0; i < points.size(); i++) {
+    if (i == 0) {
+      along.push_back(0);
+      continue;
+    }
+    const auto [x, y] = local_xy(points[i - 1], points[i]);
+    along.push_back(along.back() + std::hypot(x, y));
+
+    const auto &a = points[i - 1], &b = points[i];
+    const int lat0 = std::floor(std::min(a.first, b.first) / BIN_SIZE), lat1 = std::floor(std::max(a.first, b.first) / BIN_SIZE);
+    const int lon0 = std::floor(std::min(a.second, b.second) / BIN_SIZE), lon1 = std::floor(std::max(a.second, b.second) / BIN_SIZE);
+    for (int lat = lat0; lat <= lat1; lat++) {
+      for (int lon = lon0; lon <= lon1; lon++) {
+        bins[bin_key(lat, lon)].push_back(i - 1);
+      }
+    }
+  }
+}
+
+std::optional<double> RouteIndex::project(const QMapbox::Coordinate &c, double along_hint, double max_distance) const {
+  if (empty()) return {};
+
+  // the cells within max_distance, a cell is narrower in m away from the equator
+  const double cell_m = DEG2RAD(BIN_SIZE) * EARTH_RADIUS;
+  const int lat_r = std::ceil(max_distance / cell_m);
+  const int lon_r = std::ceil(max_distance / (cell_m * std::max(0.01, std::cos(DEG2RAD(c.first)))));
+  const int lat_c = std::floor(c.first / BIN_SIZE), lon_c = std::floor(c.second / BIN_SIZE);
+
+  std::optional<double> best;
+  double best_score = 0;
+  for (int lat = lat_c - lat_r; lat <= lat_c + lat_r; lat++) {
+    for (int lon = lon_c - lon_r; lon <= lon_c + lon_r; lon++) {
+      auto it = bins.find(bin_key(lat, lon));
+      if (it == bins.end()) continue;
+
+      for (int s : it->second) {
+        // the closest point of the segment, in m around c
+        const auto [ax, ay] = local_xy(c, points[s]);
+        const auto [bx, by] = local_xy(c, points[s + 1]);
+        const double dx = bx - ax, dy = by - ay;
+        const double len2 = dx * dx + dy * dy;
+        const double t = len2 > 0 ? std::clamp(-(ax * dx + ay * dy) / len2, 0.0, 1.0) : 0;
+        const double dist = std::hypot(ax + t * dx, ay + t * dy);
+        if (dist > max_distance) continue;
+
+        const double d = along[s] + t * (along[s + 1] - along[s]);
+        // a metre off the route weighs as much as 20 along it from the hint
+        const double score = dist + 0.05 * std::abs(d - along_hint);
+        if (!best || score < best_score) {
+          best = d;
+          best_score = score;
+        }
+      }
+    }
+  }
+  return best;
+}
+
+int RouteIndex::segmentAt(double d) const {
+  const int i = std::upper_bound(along.begin(), along.end(), d) - along.begin() - 1;
+  return std::clamp(i, 0, (int)points.size() - 2);
+}
+
+QMapbox::Coordinate RouteIndex::pointAt(double d) const {
+  if (empty()) return points.empty() ? QMapbox::Coordinate() : points.front();
+
+  const int s = segmentAt(d);
+  const double len = along[s + 1] - along[s];
+  const double t = len > 0 ? std::clamp((d - along[s]) / len, 0.0, 1.0) : 0;
+  const auto &a = points[s], &b = points[s + 1];
+  return {a.first + t * (b.first - a.first), a.second + t * (b.second - a.second)};
+}
+
+QList<QMapbox::Feature> RouteIndex::pieces(double piece_length) const {
+  QList<QMapbox::Feature> features;
+  if (empty()) return features;
+
+  int next = 1;  // the first point after the start of the piece
+  for (int i = 0; i * piece_length < length(); i++) {
+    const double end = std::min((i + 1) * piece_length, length());
+    QMapbox::Coordinates line = {pointAt(i * piece_length)};
+    for (; next < points.size() && along[next] < end; next++) {
+      line.push_back(points[next]);
+    }
+    line.push_back(pointAt(end));
+    features.push_back(QMapbox::Feature(QMapbox::Feature::LineStringType, {QMapbox::CoordinatesCollection{line}}, {{"i", i}}, {}));
+  }
+  return features;
+}
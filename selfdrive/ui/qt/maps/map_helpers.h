@@ -2,7 +2,9 @@
 
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #include <eigen3/Eigen/Dense>
 #include <QMapboxGL>
 #include <QGeoCoordinate>
@@ -30,3 +32,32 @@ QMapbox::CoordinatesCollections coordinate_list_to_collection(const QList<QGeoCo
 QList<QGeoCoordinate> polyline_to_coordinate_list(const QString &polylineString);
 std::optional<QMapbox::Coordinate> coordinate_from_param(const std::string &param);
 std::pair<QString, QString> map_format_distance(float d, bool is_metric);
+
+// A route's points with the distance along it to each, and its segments binned on a coarse
+// lat/lon grid. Finding where a position is on the route looks at the bins around it, and
+// anything by distance along the route is a binary search.
+class RouteIndex {
+public:
+  RouteIndex() = default;
+  explicit RouteIndex(QMapbox::Coordinates coordinates);
+
+  bool empty() const { return points.size() < 2; }
+  double length() const { return empty() ? 0 : along.back(); }  // m
+
+  // distance along the route of its closest point to c, none if that's further than
+  // max_distance m away. Of the points about as close, for a route that comes back on
+  // itself, the one nearest to along_hint wins.
+  std::optional<double> project(const QMapbox::Coordinate &c, double along_hint = 0, double max_distance = 50) const;
+  QMapbox::Coordinate pointAt(double d) const;
+
+  // the route cut every piece_length m, as line features with their number in "i". Piece i
+  // starts at i * piece_length, so the ones behind a distance are filtered out by number.
+  QList<QMapbox::Feature> pieces(double piece_length) const;
+
+private:
+  int segmentAt(double d) const;
+
+  QMapbox::Coordinates points;
+  std::vector<double> along;  // m to each point
+  std::unordered_map<int64_t, std::vector<int>> bins;  // segments touching each grid cell
+};
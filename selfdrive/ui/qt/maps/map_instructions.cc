@@ -1,6 +1,5 @@
 #include "selfdrive/ui/qt/maps/map_instructions.h"
 
-#include <QDir>
 #include <QVBoxLayout>
 
 #include "selfdrive/ui/qt/maps/map_helpers.h"
@@ -41,69 +40,36 @@ MapInstructions::MapInstructions(QWidget *parent) : QWidget(parent) {
   pal.setColor(QPalette::Background, QColor(0, 0, 0, 150));
   setAutoFillBackground(true);
   setPalette(pal);
-
-  buildPixmapCache();
 }
 
-void MapInstructions::buildPixmapCache() {
-  QDir dir("../assets/navigation");
-  for (QString fn : dir.entryList({"*" + ICON_SUFFIX}, QDir::Files)) {
-    QPixmap pm(dir.filePath(fn));
-    QString key = fn.left(fn.size() - ICON_SUFFIX.length());
-    pm = pm.scaledToWidth(200, Qt::SmoothTransformation);
-
-    // Maneuver icons
-    pixmap_cache[key] = pm;
-    // lane direction icons
-    if (key.contains("turn_")) {
-      pixmap_cache["lane_" + key] = pm.scaled({125, 125}, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    }
-
-    // for rhd, reflect direction and then flip
-    if (key.contains("_left")) {
-      pixmap_cache["rhd_" + key.replace("_left", "_right")] = pm.transformed(QTransform().scale(-1, 1));
-    } else if (key.contains("_right")) {
-      pixmap_cache["rhd_" + key.replace("_right", "_left")] = pm.transformed(QTransform().scale(-1, 1));
+// An icon is loaded and scaled the first time it's shown. "lane_" is the smaller lane
+// version of an icon, "rhd_" the mirror image of the other direction
+const QPixmap &MapInstructions::pixmap(const QString &key) {
+  auto it = pixmap_cache.constFind(key);
+  if (it == pixmap_cache.constEnd()) {
+    QPixmap pm;
+    if (key.startsWith("lane_")) {
+      pm = pixmap(key.mid(5)).scaled({125, 125}, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    } else if (key.startsWith("rhd_")) {
+      QString fn = key.mid(4);
+      fn = fn.contains("_right") ? fn.replace("_right", "_left") : fn.replace("_left", "_right");
+      pm = pixmap(fn).transformed(QTransform().scale(-1, 1));
+    } else if (pm.load("../assets/navigation/" + key + ICON_SUFFIX)) {
+      pm = pm.scaledToWidth(200, Qt::SmoothTransformation);
     }
+    it = pixmap_cache.insert(key, pm);
   }
+  return *it;
 }
 
 void MapInstructions::updateInstructions(cereal::NavInstruction::Reader instruction) {
-  setUpdatesEnabled(false);
-
-  // Show instruction text
   QString primary_str = QString::fromStdString(instruction.getManeuverPrimaryText());
   QString secondary_str = QString::fromStdString(instruction.getManeuverSecondaryText());
-
-  primary->setText(primary_str);
-  secondary->setVisible(secondary_str.length() > 0);
-  secondary->setText(secondary_str);
-
-  auto distance_str_pair = map_format_distance(instruction.getManeuverDistance(), uiState()->scene.is_metric);
-  distance->setText(QString("%1 %2").arg(distance_str_pair.first, distance_str_pair.second));
-
-  // Show arrow with direction
   QString type = QString::fromStdString(instruction.getManeuverType());
   QString modifier = QString::fromStdString(instruction.getManeuverModifier());
-  if (!type.isEmpty()) {
-    QString fn = "direction_" + type;
-    if (!modifier.isEmpty()) {
-      fn += "_" + modifier;
-    }
-    fn = fn.replace(' ', '_');
-    bool rhd = is_rhd && (fn.contains("_left") || fn.contains("_right"));
-    icon_01->setPixmap(pixmap_cache[!rhd ? fn : "rhd_" + fn]);
-    icon_01->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
-    icon_01->setVisible(true);
-  } else {
-    icon_01->setVisible(false);
-  }
 
-  // Hide distance after arrival
-  distance->setVisible(type != "arrive" || instruction.getManeuverDistance() > 0);
-
-  // Show lanes
   auto lanes = instruction.getLanes();
+  QStringList lane_icons;
   for (int i = 0; i < lanes.size(); ++i) {
     bool active = lanes[i].getActive();
     const auto active_direction = lanes[i].getActiveDirection();
@@ -126,16 +92,54 @@ void MapInstructions::updateInstructions(cereal::NavInstruction::Reader instruct
     if (!active) {
       fn += "_inactive";
     }
+    lane_icons.push_back(fn);
+  }
+
+  auto distance_str_pair = map_format_distance(instruction.getManeuverDistance(), uiState()->scene.is_metric);
+  distance->setText(QString("%1 %2").arg(distance_str_pair.first, distance_str_pair.second));
+  // Hide distance after arrival
+  distance->setVisible(type != "arrive" || instruction.getManeuverDistance() > 0);
+
+  const QString maneuver_key = QStringList{type, modifier, primary_str, secondary_str, lane_icons.join(',')}.join('|');
+  if (maneuver_key == maneuver) {
+    setVisible(true);
+    return;
+  }
+  maneuver = maneuver_key;
+
+  setUpdatesEnabled(false);
+
+  // Show instruction text
+  primary->setText(primary_str);
+  secondary->setVisible(secondary_str.length() > 0);
+  secondary->setText(secondary_str);
 
+  // Show arrow with direction
+  if (!type.isEmpty()) {
+    QString fn = "direction_" + type;
+    if (!modifier.isEmpty()) {
+      fn += "_" + modifier;
+    }
+    fn = fn.replace(' ', '_');
+    bool rhd = is_rhd && (fn.contains("_left") || fn.contains("_right"));
+    icon_01->setPixmap(pixmap(!rhd ? fn : "rhd_" + fn));
+    icon_01->setSizePolicy(QSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed));
+    icon_01->setVisible(true);
+  } else {
+    icon_01->setVisible(false);
+  }
+
+  // Show lanes
+  for (int i = 0; i < lane_icons.size(); ++i) {
     QLabel *label = (i < lane_labels.size()) ? lane_labels[i] : lane_labels.emplace_back(new QLabel);
     if (!label->parentWidget()) {
       lane_layout->addWidget(label);
     }
-    label->setPixmap(pixmap_cache[fn]);
+    label->setPixmap(pixmap(lane_icons[i]));
     label->setVisible(true);
   }
 
-  for (int i = lanes.size(); i < lane_labels.size(); ++i) {
+  for (int i = lane_icons.size(); i < lane_labels.size(); ++i) {
     lane_labels[i]->setVisible(false);
   }
 
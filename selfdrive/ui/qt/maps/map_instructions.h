@@ -30,9 +30,12 @@ private:
   bool is_rhd = false;
   std::vector<QLabel *> lane_labels;
   QHash<QString, QPixmap> pixmap_cache;
+  // the maneuver that's shown, while it stays the same only the distance is updated
+  QString maneuver;
+
+  const QPixmap &pixmap(const QString &key);
 
 public:
   MapInstructions(QWidget * parent=nullptr);
-  void buildPixmapCache();
   void updateInstructions(cereal::NavInstruction::Reader instruction);
 };
@@ -294,7 +294,7 @@ NavManager::NavManager(QObject *parent) : QObject(parent) {
       // Fetch favorite and recent locations
       QString url = CommaApi::BASE_URL + "/v1/navigation/" + *dongle_id + "/locations";
       RequestRepeater *repeater = new RequestRepeater(this, url, "ApiCache_NavDestinations", 30, true);
-      QObject::connect(repeater, &RequestRepeater::requestDone, this, &NavManager::parseLocationsResponse);
+      QObject::connect(repeater, &RequestRepeater::requestJson, this, &NavManager::parseLocationsResponse);
     }
     {
       auto param_watcher = new ParamWatcher(this);
@@ -325,13 +325,12 @@ NavManager::NavManager(QObject *parent) : QObject(parent) {
   }
 }
 
-void NavManager::parseLocationsResponse(const QString &response, bool success) {
-  if (!success || response == prev_response) return;
+void NavManager::parseLocationsResponse(const QJsonDocument &doc, bool success) {
+  if (!success || doc == prev_response) return;
 
-  prev_response = response;
-  QJsonDocument doc = QJsonDocument::fromJson(response.trimmed().toUtf8());
+  prev_response = doc;
   if (doc.isNull()) {
-    qWarning() << "JSON Parse failed on navigation locations" << response;
+    qWarning() << "JSON Parse failed on navigation locations";
     return;
   }
 
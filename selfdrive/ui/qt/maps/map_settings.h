@@ -39,11 +39,11 @@ signals:
 
 private:
   NavManager(QObject *parent);
-  void parseLocationsResponse(const QString &response, bool success);
+  void parseLocationsResponse(const QJsonDocument &doc, bool success);
   void sortLocations();
 
   Params params;
-  QString prev_response;
+  QJsonDocument prev_response;
   QJsonArray locations;
   QJsonObject current_dest;
   std::future<void> write_param_future;
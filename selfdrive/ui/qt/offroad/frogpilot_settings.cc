@@ -2,6 +2,8 @@
 
 #include "selfdrive/ui/qt/offroad/frogpilot_settings.h"
 
+#include "common/swaglog.h"
+
 FrogPilotControlsPanel::FrogPilotControlsPanel(QWidget *parent) : FrogPilotPanel(parent) {
   setDefaultParams();
 
@@ -529,14 +531,20 @@ void FrogPilotPanel::setDefaultParams() {
     {"WideCameraDisable", "1"}
   };
 
-  bool rebootRequired = false;
+  std::map<std::string, std::string> missing_values;
   for (const auto& [key, value] : default_values) {
     if (params.get(key).empty()) {
-      params.put(key, value);
-      rebootRequired = true;
+      missing_values[key] = value;
     }
   }
 
+  bool rebootRequired = !missing_values.empty();
+  if (rebootRequired) {
+    double commit_ms;
+    params.putMany(missing_values, &commit_ms);
+    LOGW("set %zu default params in %.1f ms", missing_values.size(), commit_ms);
+  }
+
   if (rebootRequired) {
     while (!std::filesystem::exists("/data/openpilot/prebuilt")) {
       std::this_thread::sleep_for(std::chrono::seconds(1));
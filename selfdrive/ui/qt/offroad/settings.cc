@@ -363,13 +363,25 @@ void SettingsWindow::showEvent(QShowEvent *event) {
 }
 
 void SettingsWindow::setCurrentPanel(int index, const QString &param) {
-  panel_widget->setCurrentIndex(index);
+  panel_widget->setCurrentWidget(panel(index));
   nav_btns->buttons()[index]->setChecked(true);
   if (!param.isEmpty()) {
     emit expandToggleDescription(param);
   }
 }
 
+// The stack holds a placeholder for a panel until it's shown, then the panel takes its place
+QWidget *SettingsWindow::panel(int index) {
+  if (make_panel[index]) {
+    QWidget *placeholder = panel_widget->widget(index);
+    panel_widget->insertWidget(index, make_panel[index]());
+    panel_widget->removeWidget(placeholder);
+    placeholder->deleteLater();
+    make_panel[index] = nullptr;
+  }
+  return panel_widget->widget(index);
+}
+
 SettingsWindow::SettingsWindow(QWidget *parent) : QFrame(parent) {
 
   // setup two main layouts
@@ -398,26 +410,28 @@ SettingsWindow::SettingsWindow(QWidget *parent) : QFrame(parent) {
   sidebar_layout->addWidget(close_btn, 0, Qt::AlignRight);
   QObject::connect(close_btn, &QPushButton::clicked, this, &SettingsWindow::closeSettings);
 
-  // setup panels
-  DevicePanel *device = new DevicePanel(this);
-  QObject::connect(device, &DevicePanel::reviewTrainingGuide, this, &SettingsWindow::reviewTrainingGuide);
-  QObject::connect(device, &DevicePanel::showDriverView, this, &SettingsWindow::showDriverView);
-
-  TogglesPanel *toggles = new TogglesPanel(this);
-  QObject::connect(this, &SettingsWindow::expandToggleDescription, toggles, &TogglesPanel::expandToggleDescription);
-
-  QList<QPair<QString, QWidget *>> panels = {
-    {tr("Device"), device},
-    {tr("Network"), new Networking(this)},
-    {tr("Toggles"), toggles},
-    {tr("Software"), new SoftwarePanel(this)},
-    {tr("Controls"), new FrogPilotControlsPanel(this)},
-    {tr("Vehicles"), new FrogPilotVehiclesPanel(this)},
-    {tr("Visuals"), new FrogPilotVisualsPanel(this)},
+  // setup panels, they're made the first time they're shown
+  QList<QPair<QString, std::function<QWidget *()>>> panels = {
+    {tr("Device"), [=]() -> QWidget * {
+      DevicePanel *device = new DevicePanel(this);
+      QObject::connect(device, &DevicePanel::reviewTrainingGuide, this, &SettingsWindow::reviewTrainingGuide);
+      QObject::connect(device, &DevicePanel::showDriverView, this, &SettingsWindow::showDriverView);
+      return device;
+    }},
+    {tr("Network"), [=]() -> QWidget * { return new Networking(this); }},
+    {tr("Toggles"), [=]() -> QWidget * {
+      TogglesPanel *toggles = new TogglesPanel(this);
+      QObject::connect(this, &SettingsWindow::expandToggleDescription, toggles, &TogglesPanel::expandToggleDescription);
+      return toggles;
+    }},
+    {tr("Software"), [=]() -> QWidget * { return new SoftwarePanel(this); }},
+    {tr("Controls"), [=]() -> QWidget * { return new FrogPilotControlsPanel(this); }},
+    {tr("Vehicles"), [=]() -> QWidget * { return new FrogPilotVehiclesPanel(this); }},
+    {tr("Visuals"), [=]() -> QWidget * { return new FrogPilotVisualsPanel(this); }},
   };
 
   if (Params().getInt("PrimeType") == 0) {
-    panels.append({tr("Navigation"), new FrogPilotNavigationPanel(this)});
+    panels.append({tr("Navigation"), [=]() -> QWidget * { return new FrogPilotNavigationPanel(this); }});
   }
 
   nav_btns = new QButtonGroup(this);
@@ -445,14 +459,16 @@ SettingsWindow::SettingsWindow(QWidget *parent) : QFrame(parent) {
     sidebar_layout->addWidget(btn, 0, Qt::AlignRight);
 
     const int lr_margin = name != tr("Network") ? 50 : 0;  // Network panel handles its own margins
-    panel->setContentsMargins(lr_margin, 25, lr_margin, 25);
-
-    ScrollView *panel_frame = new ScrollView(panel, this);
-    panel_widget->addWidget(panel_frame);
+    make_panel.push_back([=, make = panel]() -> QWidget * {
+      QWidget *w = make();
+      w->setContentsMargins(lr_margin, 25, lr_margin, 25);
+      return new ScrollView(w, this);
+    });
+    panel_widget->addWidget(new QWidget(this));
 
-    QObject::connect(btn, &QPushButton::clicked, [=, w = panel_frame]() {
-      btn->setChecked(true);
-      panel_widget->setCurrentWidget(w);
+    const int index = make_panel.size() - 1;
+    QObject::connect(btn, &QPushButton::clicked, [=]() {
+      setCurrentPanel(index);
     });
   }
   sidebar_layout->setContentsMargins(50, 50, 100, 50);
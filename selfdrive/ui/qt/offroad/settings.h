@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <map>
 #include <string>
 
@@ -32,10 +33,14 @@ signals:
   void expandToggleDescription(const QString &param);
 
 private:
+  QWidget *panel(int index);
+
   QPushButton *sidebar_alert_widget;
   QWidget *sidebar_widget;
   QButtonGroup *nav_btns;
   QStackedWidget *panel_widget;
+  // makes the panel of an index the first time it's shown, empty once it's made
+  QVector<std::function<QWidget *()>> make_panel;
 };
 
 class DevicePanel : public ListWidget {
@@ -9,8 +9,12 @@
 #include <QApplication>
 #include <QDebug>
 #include <QMouseEvent>
+#include <QtConcurrent>
 
+#include "common/statlog.h"
+#include "common/swaglog.h"
 #include "common/timing.h"
+#include "selfdrive/ui/profiler.h"
 #include "selfdrive/ui/qt/util.h"
 #ifdef ENABLE_MAPS
 #include "selfdrive/ui/qt/maps/map_helpers.h"
@@ -28,21 +32,32 @@ static void drawIcon(QPainter &p, const QPoint &center, const QPixmap &img, cons
   p.setOpacity(1.0);
 }
 
-static void drawIconRotate(QPainter &p, const QPoint &center, const QPixmap &img, const QBrush &bg, float opacity, const int angle) {
-  p.setRenderHint(QPainter::Antialiasing);
-  p.setOpacity(1.0);  // bg dictates opacity of ellipse
-  p.setPen(Qt::NoPen);
-  p.setBrush(bg);
-  p.drawEllipse(center, btn_size / 2, btn_size / 2);
-  p.save();
-  p.translate(center);
-  p.rotate(-angle);
-  p.setOpacity(opacity);
-  p.drawPixmap(-QPoint(img.width() / 2, img.height() / 2), img); 
-  p.setOpacity(1.0);
-  p.restore();
+// Custom steering wheel images, loaded the first time they're picked and kept
+static const QPixmap &wheelImage(int wheel) {
+  static const std::map<int, QString> paths = {
+    {0, "../assets/img_chffr_wheel.png"},
+    {1, "../assets/lexus.png"},
+    {2, "../assets/toyota.png"},
+    {3, "../assets/frog.png"},
+    {4, "../assets/rocket.png"},
+    {5, "../assets/hyundai.png"},
+    {6, "../assets/stalin.png"}
+  };
+  static std::map<int, QPixmap> images;
+
+  if (!paths.count(wheel)) wheel = 0;
+  auto it = images.find(wheel);
+  if (it == images.end()) {
+    it = images.emplace(wheel, loadPixmap(paths.at(wheel), {img_size, img_size})).first;
+  }
+  return it->second;
 }
 
+// the road camera should be on screen within this after the car is started
+const double CAMERA_BUDGET_MS = 2000;
+// the map is made once the camera is, or after this if it doesn't show up
+const int MAP_DEFER_MS = 5000;
+
 OnroadWindow::OnroadWindow(QWidget *parent) : QWidget(parent) {
   QVBoxLayout *main_layout  = new QVBoxLayout(this);
   main_layout->setMargin(UI_BORDER_SIZE);
@@ -51,6 +66,7 @@ OnroadWindow::OnroadWindow(QWidget *parent) : QWidget(parent) {
   main_layout->addLayout(stacked_layout);
 
   nvg = new AnnotatedCameraWidget(VISION_STREAM_ROAD, this);
+  QObject::connect(nvg, &CameraWidget::firstFrameDrawn, this, &OnroadWindow::cameraFrameDrawn);
 
   QWidget * split_wrapper = new QWidget;
   split = new QHBoxLayout(split_wrapper);
@@ -217,26 +233,50 @@ void OnroadWindow::mousePressEvent(QMouseEvent* e) {
 }
 
 void OnroadWindow::offroadTransition(bool offroad) {
-#ifdef ENABLE_MAPS
   if (!offroad) {
-    if (map == nullptr && (uiState()->hasPrime() || !MAPBOX_TOKEN.isEmpty())) {
-      auto m = new MapPanel(get_mapbox_settings());
-      map = m;
+    ignition_t = millis_since_boot();
+    QTimer::singleShot(MAP_DEFER_MS, this, &OnroadWindow::createMap);
+  } else {
+    ignition_t = 0;
+  }
 
-      QObject::connect(m, &MapPanel::mapPanelRequested, this, &OnroadWindow::mapPanelRequested);
-      QObject::connect(nvg->map_settings_btn, &MapSettingsButton::clicked, m, &MapPanel::toggleMapSettings);
-      nvg->map_settings_btn->setEnabled(true);
+  alerts->updateAlert({});
+}
 
-      m->setFixedWidth(topWidget(this)->width() / 2 - UI_BORDER_SIZE);
-      split->insertWidget(0, m);
+void OnroadWindow::cameraFrameDrawn() {
+  if (ignition_t == 0) return;
 
-      // hidden by default, made visible when navRoute is published
-      m->setVisible(false);
-    }
+  const double ms = millis_since_boot() - ignition_t;
+  ignition_t = 0;
+  statlog_gauge("ui.startup.onroad_camera_ms", ms);
+  if (ms > CAMERA_BUDGET_MS) {
+    LOGE("road camera on screen %.0f ms after the car started, over the %.0f ms budget", ms, CAMERA_BUDGET_MS);
+  } else {
+    LOGW("road camera on screen %.0f ms after the car started", ms);
   }
-#endif
+  // not from inside the camera's paint
+  QTimer::singleShot(0, this, &OnroadWindow::createMap);
+}
 
-  alerts->updateAlert({});
+// The map's GL context, style and tiles compete with the camera for the GPU and the main
+// thread, it's made once the car is started and the road is on screen
+void OnroadWindow::createMap() {
+#ifdef ENABLE_MAPS
+  if (uiState()->scene.started && map == nullptr && (uiState()->hasPrime() || !MAPBOX_TOKEN.isEmpty())) {
+    auto m = new MapPanel(get_mapbox_settings());
+    map = m;
+
+    QObject::connect(m, &MapPanel::mapPanelRequested, this, &OnroadWindow::mapPanelRequested);
+    QObject::connect(nvg->map_settings_btn, &MapSettingsButton::clicked, m, &MapPanel::toggleMapSettings);
+    nvg->map_settings_btn->setEnabled(true);
+
+    m->setFixedWidth(topWidget(this)->width() / 2 - UI_BORDER_SIZE);
+    split->insertWidget(0, m);
+
+    // hidden by default, made visible when navRoute is published
+    m->setVisible(false);
+  }
+#endif
 }
 
 void OnroadWindow::primeChanged(bool prime) {
@@ -262,12 +302,15 @@ void OnroadWindow::paintEvent(QPaintEvent *event) {
     p.setPen(Qt::white);
 
     // Construct the FPS display string
-    QString fpsDisplayString = QString("FPS: %1 (%2) | Min: %3 | Max: %4 | Avg: %5")
+    QString fpsDisplayString = QString("FPS: %1 (%2) | Min: %3 | Max: %4 | Avg: %5 | Upload: %6 ms | Draw: %7 ms | Quality: %8")
       .arg(fps, 0, 'f', 2)
       .arg(Params("/dev/shm/params").getInt("CameraFPS"))
       .arg(minFPS, 0, 'f', 2)
       .arg(maxFPS, 0, 'f', 2)
-      .arg(avgFPS, 0, 'f', 2);
+      .arg(avgFPS, 0, 'f', 2)
+      .arg(nvg->uploadTime(), 0, 'f', 2)
+      .arg(nvg->drawTime(), 0, 'f', 2)
+      .arg(render_quality_name(uiState()->scene.render_quality));
 
     // Calculate text positioning
     const QRect currentRect = rect();
@@ -352,20 +395,9 @@ void OnroadAlerts::paintEvent(QPaintEvent *event) {
 ExperimentalButton::ExperimentalButton(QWidget *parent) : experimental_mode(false), engageable(false), QPushButton(parent), scene(uiState()->scene) {
   setFixedSize(btn_size, btn_size + 10);
 
-  engage_img = loadPixmap("../assets/img_chffr_wheel.png", {img_size, img_size});
+  engage_img = wheelImage(0);
   experimental_img = loadPixmap("../assets/img_experimental.svg", {img_size, img_size});
   QObject::connect(this, &QPushButton::clicked, this, &ExperimentalButton::changeMode);
-
-  // Custom steering wheel images
-  wheelImages = {
-    {0, loadPixmap("../assets/img_chffr_wheel.png", {img_size, img_size})},
-    {1, loadPixmap("../assets/lexus.png", {img_size, img_size})},
-    {2, loadPixmap("../assets/toyota.png", {img_size, img_size})},
-    {3, loadPixmap("../assets/frog.png", {img_size, img_size})},
-    {4, loadPixmap("../assets/rocket.png", {img_size, img_size})},
-    {5, loadPixmap("../assets/hyundai.png", {img_size, img_size})},
-    {6, loadPixmap("../assets/stalin.png", {img_size, img_size})}
-  };
 }
 
 void ExperimentalButton::changeMode() {
@@ -394,7 +426,11 @@ void ExperimentalButton::updateState(const UIState &s) {
   // FrogPilot variables
   leadInfo = scene.lead_info;
   rotatingWheel = scene.rotating_wheel;
-  steeringWheel = scene.steering_wheel;
+  if (steeringWheel != scene.steering_wheel) {
+    steeringWheel = scene.steering_wheel;
+    engage_img = wheelImage(steeringWheel);
+    update();
+  }
 
   // Update the icon so the steering wheel rotates in real time
   if (rotatingWheel && steeringAngleDeg != scene.steering_angle_deg) {
@@ -406,7 +442,6 @@ void ExperimentalButton::updateState(const UIState &s) {
 void ExperimentalButton::paintEvent(QPaintEvent *event) {
   QPainter p(this);
   // Custom steering wheel icon
-  engage_img = wheelImages[steeringWheel];
   QPixmap img = steeringWheel ? engage_img : (experimental_mode ? experimental_img : engage_img);
 
   const QColor background_color = steeringWheel && !isDown() && engageable ?
@@ -417,10 +452,15 @@ void ExperimentalButton::paintEvent(QPaintEvent *event) {
 
   if (!scene.show_driver_camera) {
     if (rotatingWheel) {
-      drawIconRotate(p, QPoint(btn_size / 2, btn_size / 2 + (leadInfo ? 10 : 0)), img, background_color, (isDown() || !engageable) ? 0.6 : 1.0, steeringAngleDeg);
-    } else {
-      drawIcon(p, QPoint(btn_size / 2, btn_size / 2 + (leadInfo ? 10 : 0)), img, background_color, (isDown() || !engageable) ? 0.6 : 1.0);
+      // rotated again only when the angle or the image changed since the last paint
+      const std::pair<qint64, int> key = {img.cacheKey(), steeringAngleDeg};
+      if (key != rotated_key) {
+        rotated_img = img.transformed(QTransform().rotate(-steeringAngleDeg));
+        rotated_key = key;
+      }
+      img = rotated_img;
     }
+    drawIcon(p, QPoint(btn_size / 2, btn_size / 2 + (leadInfo ? 10 : 0)), img, background_color, (isDown() || !engageable) ? 0.6 : 1.0);
   }
 }
 
@@ -495,25 +535,8 @@ AnnotatedCameraWidget::AnnotatedCameraWidget(VisionStreamType type, QWidget* par
   };
 
   // Turn signal images
-  theme_path = QString("../assets/custom_themes/%1/images").arg(themeConfiguration.find(customSignals) != themeConfiguration.end() ? themeConfiguration[customSignals].first : "stock_theme");
-  const QStringList imagePaths = {
-    theme_path + "/turn_signal_1.png",
-    theme_path + "/turn_signal_2.png",
-    theme_path + "/turn_signal_3.png",
-    theme_path + "/turn_signal_4.png"
-  };
-
-  signalImgVector.clear();
-  signalImgVector.reserve(4 * imagePaths.size() + 2);  // Reserve space for both regular and flipped images
-  for (int i = 0; i < 2; ++i) {
-    for (const QString &imagePath : imagePaths) {
-      QPixmap pixmap(imagePath);
-      signalImgVector.push_back(pixmap);  // Regular image
-      signalImgVector.push_back(pixmap.transformed(QTransform().scale(-1, 1)));  // Flipped image
-    }
-  }
-  signalImgVector.push_back(QPixmap(theme_path + "/turn_signal_1_red.png"));  // Regular blindspot image
-  signalImgVector.push_back(QPixmap(theme_path + "/turn_signal_1_red.png").transformed(QTransform().scale(-1, 1)));  // Flipped blindspot image
+  QObject::connect(&signal_images_watcher, &QFutureWatcher<QVector<QImage>>::finished, this, &AnnotatedCameraWidget::signalImagesLoaded);
+  loadSignalImages();
 
   // Initialize the timer for the turn signal animation
   const auto animationTimer = new QTimer(this);
@@ -583,6 +606,8 @@ void AnnotatedCameraWidget::updateState(const UIState &s) {
   main_layout->setAlignment(personality_btn, (rightHandDM ? Qt::AlignRight : Qt::AlignLeft) | Qt::AlignBottom);
   personality_btn->setVisible(onroadAdjustableProfiles && !hideBottomIcons && !s.scene.show_driver_camera);
 
+  renderQuality = s.scene.render_quality;
+
   // FrogPilot variables
   accelerationPath = s.scene.acceleration_path;
   adjacentPath = s.scene.adjacent_path;
@@ -620,27 +645,41 @@ void AnnotatedCameraWidget::updateState(const UIState &s) {
   // Update the turn signal animation images upon toggle change
   if (customSignals != s.scene.custom_signals) {
     customSignals = s.scene.custom_signals;
+    loadSignalImages();
+  }
+}
 
-    theme_path = QString("../assets/custom_themes/%1/images").arg(themeConfiguration.find(customSignals) != themeConfiguration.end() ? themeConfiguration[customSignals].first : "stock_theme");
-    const QStringList imagePaths = {
-      theme_path + "/turn_signal_1.png",
-      theme_path + "/turn_signal_2.png",
-      theme_path + "/turn_signal_3.png",
-      theme_path + "/turn_signal_4.png"
-    };
+// The images of the theme are read and decoded on a worker, the animation waits for them
+void AnnotatedCameraWidget::loadSignalImages() {
+  theme_path = QString("../assets/custom_themes/%1/images").arg(themeConfiguration.find(customSignals) != themeConfiguration.end() ? themeConfiguration[customSignals].first : "stock_theme");
+  signal_images_watcher.setFuture(QtConcurrent::run([path = theme_path]() {
+    QVector<QImage> images;
+    for (const char *name : {"turn_signal_1.png", "turn_signal_2.png", "turn_signal_3.png", "turn_signal_4.png", "turn_signal_1_red.png"}) {
+      images.push_back(QImage(path + "/" + name));
+    }
+    return images;
+  }));
+}
 
-    signalImgVector.clear();
-    signalImgVector.reserve(4 * imagePaths.size() + 2);  // Reserve space for both regular and flipped images
-    for (int i = 0; i < 2; ++i) {
-      for (const QString &imagePath : imagePaths) {
-        QPixmap pixmap(imagePath);
-        signalImgVector.push_back(pixmap);  // Regular image
-        signalImgVector.push_back(pixmap.transformed(QTransform().scale(-1, 1)));  // Flipped image
-      }
+void AnnotatedCameraWidget::signalImagesLoaded() {
+  const QVector<QImage> images = signal_images_watcher.result();
+
+  // Each image is converted once, the copies share it and its texture
+  QVector<std::pair<QPixmap, QPixmap>> pixmaps;
+  for (const QImage &image : images) {
+    pixmaps.push_back({QPixmap::fromImage(image), QPixmap::fromImage(image.mirrored(true, false))});
+  }
+
+  signalImgVector.clear();
+  signalImgVector.reserve(4 * (images.size() - 1) + 2);  // Reserve space for both regular and flipped images
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < images.size() - 1; ++j) {
+      signalImgVector.push_back(pixmaps[j].first);  // Regular image
+      signalImgVector.push_back(pixmaps[j].second);  // Flipped image
     }
-    signalImgVector.push_back(QPixmap(theme_path + "/turn_signal_1_red.png"));  // Regular blindspot image
-    signalImgVector.push_back(QPixmap(theme_path + "/turn_signal_1_red.png").transformed(QTransform().scale(-1, 1)));  // Flipped blindspot image
   }
+  signalImgVector.push_back(pixmaps.back().first);  // Regular blindspot image
+  signalImgVector.push_back(pixmaps.back().second);  // Flipped blindspot image
 }
 
 void AnnotatedCameraWidget::drawHud(QPainter &p) {
@@ -652,9 +691,57 @@ void AnnotatedCameraWidget::drawHud(QPainter &p) {
   bg.setColorAt(1, QColor::fromRgbF(0, 0, 0, 0));
   p.fillRect(0, 0, width(), UI_HEADER_HEIGHT, bg);
 
+  // set speed and speed limit
+  const auto set_speed_key = std::make_tuple(setSpeed, speedLimit, slcSpeedLimitOffset, vtscOffset, is_cruise_set, is_metric, has_us_speed_limit,
+                                             has_eu_speed_limit, status, reverseCruiseIncrease, displaySLCOffset, slcOverridden);
+  set_speed_layer.draw(p, QRect(0, 0, 320, 480), set_speed_key, [this](QPainter &lp) { drawSetSpeed(lp); });
+
+  // current speed
+  if (!speedHidden) {
+    const int speed_int = std::nearbyint(speed);
+    const int speed_x = rect().center().x();
+    current_speed_layer.draw(p, QRect(speed_x - 250, 0, 500, 320), {speed_int, speedUnit}, [=](QPainter &lp) {
+      lp.setFont(InterFont(176, QFont::Bold));
+      drawText(lp, speed_x, 210, QString::number(speed_int));
+      lp.setFont(InterFont(66));
+      drawText(lp, speed_x, 290, speedUnit, 200);
+    });
+  }
+
+  p.restore();
+
+  // Compass
+  if (compass && !hideBottomIcons) {
+    drawCompass(p);
+  }
+
+  // Lead following logics
+  if (leadInfo) {
+    drawLeadInfo(p);
+  }
+
+  // FrogPilot status bar
+  if (alwaysOnLateral || conditionalExperimental || roadNameUI) {
+    drawStatusBar(p);
+  }
+
+  // Turn signal animation
+  if (customSignals && (turnSignalLeft || turnSignalRight)) {
+    drawTurnSignals(p);
+  }
+}
+
+void AnnotatedCameraWidget::drawText(QPainter &p, int x, int y, const QString &text, int alpha) {
+  QRect real_rect = p.fontMetrics().boundingRect(text);
+  real_rect.moveCenter({x, y - real_rect.height() / 2});
+
+  p.setPen(QColor(0xff, 0xff, 0xff, alpha));
+  p.drawText(real_rect.x(), real_rect.bottom(), text);
+}
+
+void AnnotatedCameraWidget::drawSetSpeed(QPainter &p) {
   QString speedLimitStr = (speedLimit > 1) ? QString::number(std::nearbyint(speedLimit)) : "–";
   QString speedLimitOffsetStr = (slcSpeedLimitOffset > 1) ? "+" + QString::number(std::nearbyint(slcSpeedLimitOffset)) : "–";
-  QString speedStr = QString::number(std::nearbyint(speed));
   QString setSpeedStr = is_cruise_set ? QString::number(std::nearbyint(setSpeed - fmax(vtscOffset - 1, 0))) : "–";
 
   // Draw outer box + border to contain set speed and speed limit
@@ -757,44 +844,6 @@ void AnnotatedCameraWidget::drawHud(QPainter &p) {
     p.setPen(blackColor());
     p.drawText(sign_rect, Qt::AlignCenter, speedLimitStr);
   }
-
-  // current speed
-  if (!speedHidden) {
-    p.setFont(InterFont(176, QFont::Bold));
-    drawText(p, rect().center().x(), 210, speedStr);
-    p.setFont(InterFont(66));
-    drawText(p, rect().center().x(), 290, speedUnit, 200);
-  }
-
-  p.restore();
-
-  // Compass
-  if (compass && !hideBottomIcons) {
-    drawCompass(p);
-  }
-
-  // Lead following logics
-  if (leadInfo) {
-    drawLeadInfo(p);
-  }
-
-  // FrogPilot status bar
-  if (alwaysOnLateral || conditionalExperimental || roadNameUI) {
-    drawStatusBar(p);
-  }
-
-  // Turn signal animation
-  if (customSignals && (turnSignalLeft || turnSignalRight)) {
-    drawTurnSignals(p);
-  }
-}
-
-void AnnotatedCameraWidget::drawText(QPainter &p, int x, int y, const QString &text, int alpha) {
-  QRect real_rect = p.fontMetrics().boundingRect(text);
-  real_rect.moveCenter({x, y - real_rect.height() / 2});
-
-  p.setPen(QColor(0xff, 0xff, 0xff, alpha));
-  p.drawText(real_rect.x(), real_rect.bottom(), text);
 }
 
 void AnnotatedCameraWidget::initializeGL() {
@@ -806,6 +855,13 @@ void AnnotatedCameraWidget::initializeGL() {
 
   prev_draw_t = millis_since_boot();
   setBackgroundColor(bg_colors[STATUS_DISENGAGED]);
+  overlay.initialize();
+}
+
+AnnotatedCameraWidget::~AnnotatedCameraWidget() {
+  makeCurrent();
+  overlay.cleanup();
+  doneCurrent();
 }
 
 void AnnotatedCameraWidget::updateFrameMat() {
@@ -826,35 +882,32 @@ void AnnotatedCameraWidget::updateFrameMat() {
       .translate(-intrinsic_matrix.v[2], -intrinsic_matrix.v[5]);
 }
 
-void AnnotatedCameraWidget::drawLaneLines(QPainter &painter, const UIState *s) {
-  painter.save();
-
+void AnnotatedCameraWidget::drawLaneLines(const UIState *s) {
   const UIScene &scene = s->scene;
   SubMaster &sm = *(s->sm);
 
   // lanelines
   for (int i = 0; i < std::size(scene.lane_line_vertices); ++i) {
     if (customColors != 0) {
-      painter.setBrush(themeConfiguration[customColors].second.first);
+      overlay.fill(scene.lane_line_vertices[i], themeConfiguration[customColors].second.first);
     } else {
-      painter.setBrush(QColor::fromRgbF(1.0, 1.0, 1.0, std::clamp<float>(scene.lane_line_probs[i], 0.0, 0.7)));
+      overlay.fill(scene.lane_line_vertices[i], QColor::fromRgbF(1.0, 1.0, 1.0, std::clamp<float>(scene.lane_line_probs[i], 0.0, 0.7)));
     }
-    painter.drawPolygon(scene.lane_line_vertices[i]);
   }
 
   // road edges
   for (int i = 0; i < std::size(scene.road_edge_vertices); ++i) {
     if (customColors != 0) {
-      painter.setBrush(themeConfiguration[customColors].second.first);
+      overlay.fill(scene.road_edge_vertices[i], themeConfiguration[customColors].second.first);
     } else {
-      painter.setBrush(QColor::fromRgbF(1.0, 0, 0, std::clamp<float>(1.0 - scene.road_edge_stds[i], 0.0, 1.0)));
+      overlay.fill(scene.road_edge_vertices[i], QColor::fromRgbF(1.0, 0, 0, std::clamp<float>(1.0 - scene.road_edge_stds[i], 0.0, 1.0)));
     }
-    painter.drawPolygon(scene.road_edge_vertices[i]);
   }
 
   // paint path
   QLinearGradient bg(0, height(), 0, 0);
-  if (sm["controlsState"].getControlsState().getExperimentalMode() || accelerationPath) {
+  // only the middle of the gradient would be drawn below full quality
+  if (renderQuality == RenderQuality::FULL && (sm["controlsState"].getControlsState().getExperimentalMode() || accelerationPath)) {
     // The first half of track_vertices are the points for the right side of the path
     // and the indices match the positions of accel from uiPlan
     const auto &acceleration_const = sm["uiPlan"].getUiPlan().getAccel();
@@ -882,7 +935,6 @@ void AnnotatedCameraWidget::drawLaneLines(QPainter &painter, const UIState *s) {
       } else {
         // speed up: 120, slow down: 0
         float path_hue = fmax(fmin(60 + acceleration[i] * 35, 120), 0);
-        // FIXME: painter.drawPolygon can be slow if hue is not rounded
         path_hue = int(path_hue * 100 + 0.5) / 100;
 
         float saturation = fmin(fabs(acceleration[i] * 1.5), 1);
@@ -906,13 +958,7 @@ void AnnotatedCameraWidget::drawLaneLines(QPainter &painter, const UIState *s) {
     bg.setColorAt(1.0, QColor::fromHslF(112 / 360., 1.0, 0.68, 0.0));
   }
 
-  painter.setBrush(bg);
-  painter.drawPolygon(scene.track_vertices);
-
-  // create new path with track vertices and track edge vertices
-  QPainterPath path;
-  path.addPolygon(scene.track_vertices);
-  path.addPolygon(scene.track_edge_vertices);
+  overlay.fill(scene.track_vertices, bg);
 
   // paint path edges
   QLinearGradient pe(0, height(), 0, 0);
@@ -944,8 +990,8 @@ void AnnotatedCameraWidget::drawLaneLines(QPainter &painter, const UIState *s) {
     pe.setColorAt(1.0, QColor::fromHslF(112 / 360., 1.00, 0.68, 0.1));
   }
 
-  painter.setBrush(pe);
-  painter.drawPath(path);
+  // odd-even, the band between the track and its edges
+  overlay.fill({&scene.track_vertices, &scene.track_edge_vertices}, pe);
 
   // paint blindspot path
   QLinearGradient bs(0, height(), 0, 0);
@@ -955,53 +1001,60 @@ void AnnotatedCameraWidget::drawLaneLines(QPainter &painter, const UIState *s) {
     bs.setColorAt(1.0, QColor::fromHslF(0 / 360., 0.75, 0.50, 0.2));
   }
 
-  painter.setBrush(bs);
   if (blindSpotLeft) {
-    painter.drawPolygon(scene.track_left_adjacent_lane_vertices);
+    overlay.fill(scene.track_left_adjacent_lane_vertices, bs);
   }
   if (blindSpotRight) {
-    painter.drawPolygon(scene.track_right_adjacent_lane_vertices);
+    overlay.fill(scene.track_right_adjacent_lane_vertices, bs);
   }
 
   // paint adjacent lane paths
-  if (customRoadUI && adjacentPath && (laneWidthLeft != 0 || laneWidthRight != 0)) {
+  if (customRoadUI && adjacentPath && renderQuality != RenderQuality::MINIMAL && (laneWidthLeft != 0 || laneWidthRight != 0)) {
+    overlay.fill(scene.track_left_adjacent_lane_vertices, adjacentLaneGradient(laneWidthLeft, blindSpotLeft));
+    overlay.fill(scene.track_right_adjacent_lane_vertices, adjacentLaneGradient(laneWidthRight, blindSpotRight));
+  }
+}
+
+QLinearGradient AnnotatedCameraWidget::adjacentLaneGradient(float laneWidth, bool blindspot) {
+  // Declare the lane width thresholds
+  constexpr float minLaneWidth = 2.5;
+  constexpr float maxLaneWidth = 3.0;
+
+  double hue;
+  if (laneWidth < minLaneWidth || blindspot) {
+    // Make the path red for smaller paths or if there's a car in the blindspot
+    hue = 0;
+  } else if (laneWidth >= maxLaneWidth) {
+    // Make the path green for larger paths
+    hue = 120;
+  } else {
+    // Transition the path from red to green based on lane width
+    hue = 120 * (laneWidth - minLaneWidth) / (maxLaneWidth - minLaneWidth);
+  }
+  QLinearGradient gradient(0, height(), 0, 0);
+  gradient.setColorAt(0.0, QColor::fromHslF(hue / 360., 0.75, 0.50, 0.6));
+  gradient.setColorAt(0.5, QColor::fromHslF(hue / 360., 0.75, 0.50, 0.4));
+  gradient.setColorAt(1.0, QColor::fromHslF(hue / 360., 0.75, 0.50, 0.2));
+  return gradient;
+}
+
+void AnnotatedCameraWidget::drawLaneLineText(QPainter &painter, const UIState *s) {
+  const UIScene &scene = s->scene;
+
+  painter.save();
+
+  // label adjacent lane paths
+  if (customRoadUI && adjacentPath && renderQuality != RenderQuality::MINIMAL && (laneWidthLeft != 0 || laneWidthRight != 0)) {
     // Set up the units
     const double conversionFactor = is_metric ? 1.0 : 3.28084;
     const QString unit_d = is_metric ? " meters" : " feet";
 
-    // Declare the lane width thresholds
-    constexpr float minLaneWidth = 2.5;
-    constexpr float maxLaneWidth = 3.0;
-
     // Font and Pen setup
     const QFont font = InterFont(35, QFont::Bold);
-    const QPen whitePen(Qt::white), transparentPen(Qt::transparent);
-
-    // Set gradient colors based on laneWidth and blindspot
-    const auto setGradientColors = [](QLinearGradient& gradient, const float laneWidth, const bool blindspot) {
-      static double hue;
-      if (laneWidth < minLaneWidth || blindspot) {
-        // Make the path red for smaller paths or if there's a car in the blindspot
-        hue = 0;
-      } else if (laneWidth >= maxLaneWidth) {
-        // Make the path green for larger paths
-        hue = 120;
-      } else {
-        // Transition the path from red to green based on lane width
-        hue = 120 * (laneWidth - minLaneWidth) / (maxLaneWidth - minLaneWidth);
-      }
-      gradient.setColorAt(0.0, QColor::fromHslF(hue / 360., 0.75, 0.50, 0.6));
-      gradient.setColorAt(0.5, QColor::fromHslF(hue / 360., 0.75, 0.50, 0.4));
-      gradient.setColorAt(1.0, QColor::fromHslF(hue / 360., 0.75, 0.50, 0.2));
-    };
+    const QPen whitePen(Qt::white);
 
-    // Paint the lanes
+    // Label the lanes, they're filled in drawLaneLines
     const auto paintLane = [&](QPainter& painter, const QPolygonF& lane, const float laneWidth, const bool blindspot) {
-      QLinearGradient gradient(0, height(), 0, 0);
-      setGradientColors(gradient, laneWidth, blindspot);
-      painter.setBrush(gradient);
-      painter.setPen(transparentPen);
-      painter.drawPolygon(lane);
       painter.setFont(font);
       painter.setPen(whitePen);
 
@@ -1015,7 +1068,7 @@ void AnnotatedCameraWidget::drawLaneLines(QPainter &painter, const UIState *s) {
       painter.setPen(Qt::NoPen);
     };
 
-    // Paint lanes
+    // Label lanes
     paintLane(painter, scene.track_left_adjacent_lane_vertices, laneWidthLeft, blindSpotLeft);
     paintLane(painter, scene.track_right_adjacent_lane_vertices, laneWidthRight, blindSpotRight);
   }
@@ -1064,9 +1117,21 @@ void AnnotatedCameraWidget::drawDriverState(QPainter &painter, const UIState *s)
   painter.restore();
 }
 
-void AnnotatedCameraWidget::drawLead(QPainter &painter, const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd) {
-  painter.save();
+void AnnotatedCameraWidget::leadChevron(const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd, QPolygonF &glow, QPolygonF &chevron) {
+  const float d_rel = lead_data.getDRel();
+
+  float sz = std::clamp((25 * 30) / (d_rel / 3 + 30), 15.0f, 30.0f) * 2.35;
+  float x = std::clamp((float)vd.x(), 0.f, width() - sz / 2);
+  float y = std::fmin(height() - sz * .6, (float)vd.y());
+
+  float g_xo = sz / 5;
+  float g_yo = sz / 10;
 
+  glow = {{x + (sz * 1.35) + g_xo, y + sz + g_yo}, {x, y - g_yo}, {x - (sz * 1.35) - g_xo, y + sz + g_yo}};
+  chevron = {{x + (sz * 1.25), y + sz}, {x, y}, {x - (sz * 1.25), y + sz}};
+}
+
+void AnnotatedCameraWidget::drawLead(const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd) {
   const float speedBuff = customColors ? 25. : 10.;  // Make the center of the chevron appear sooner if a custom theme is active
   const float leadBuff = customColors ? 100. : 40.;  // Make the center of the chevron appear sooner if a custom theme is active
   const float d_rel = lead_data.getDRel();
@@ -1081,30 +1146,28 @@ void AnnotatedCameraWidget::drawLead(QPainter &painter, const cereal::RadarState
     fillAlpha = (int)(fmin(fillAlpha, 255));
   }
 
-  float sz = std::clamp((25 * 30) / (d_rel / 3 + 30), 15.0f, 30.0f) * 2.35;
-  float x = std::clamp((float)vd.x(), 0.f, width() - sz / 2);
-  float y = std::fmin(height() - sz * .6, (float)vd.y());
-
-  float g_xo = sz / 5;
-  float g_yo = sz / 10;
-
-  QPointF glow[] = {{x + (sz * 1.35) + g_xo, y + sz + g_yo}, {x, y - g_yo}, {x - (sz * 1.35) - g_xo, y + sz + g_yo}};
-  painter.setBrush(QColor(218, 202, 37, 255));
-  painter.drawPolygon(glow, std::size(glow));
+  QPolygonF glow, chevron;
+  leadChevron(lead_data, vd, glow, chevron);
+  overlay.fill(glow, QColor(218, 202, 37, 255));
 
   // chevron
-  QPointF chevron[] = {{x + (sz * 1.25), y + sz}, {x, y}, {x - (sz * 1.25), y + sz}};
   if (customColors != 0) {
-    painter.setBrush(themeConfiguration[customColors].second.first);
+    overlay.fill(chevron, themeConfiguration[customColors].second.first);
   } else {
-    painter.setBrush(redColor(fillAlpha));
+    overlay.fill(chevron, redColor(fillAlpha));
   }
-  painter.drawPolygon(chevron, std::size(chevron));
+}
 
+void AnnotatedCameraWidget::drawLeadText(QPainter &painter, const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd) {
   // Add lead info
   if (leadInfo) {
+    painter.save();
+
+    QPolygonF glow, chevron;
+    leadChevron(lead_data, vd, glow, chevron);
+
     // Declare and initialize the variables
-    float distance = d_rel;
+    float distance = lead_data.getDRel();
     float lead_speed = std::max(lead_data.getVLead(), 0.0f);  // Ensure speed doesn't go under 0 m/s since that's dumb
     QString unit_d = "meters";
     QString unit_s = "m/s";
@@ -1142,9 +1205,9 @@ void AnnotatedCameraWidget::drawLead(QPainter &painter, const cereal::RadarState
     const int middle_x = (chevron[2].x() + chevron[0].x()) / 2;
     const int textWidth = metrics.horizontalAdvance(text);
     painter.drawText(middle_x - textWidth / 2, chevron[0].y() + metrics.height() + 5, text);
-  }
 
-  painter.restore();
+    painter.restore();
+  }
 }
 
 void AnnotatedCameraWidget::paintGL() {
@@ -1184,7 +1247,10 @@ void AnnotatedCameraWidget::paintGL() {
       // for replay of old routes, never go to widecam
       wide_cam_requested = wide_cam_requested && s->scene.calibration_wide_valid;
     }
-    Params("/dev/shm/params").putBoolNonBlocking("WideCamera", wide_cam_requested);
+    if (wide_cam_requested != wide_cam_published) {
+      Params("/dev/shm/params").putBoolNonBlocking("WideCamera", wide_cam_requested);
+      wide_cam_published = wide_cam_requested;
+    }
     CameraWidget::setStreamType(s->scene.show_driver_camera ? VISION_STREAM_DRIVER : wide_cam_requested ? VISION_STREAM_WIDE_ROAD : VISION_STREAM_ROAD);
 
     s->scene.wide_cam = CameraWidget::getStreamType() == VISION_STREAM_WIDE_ROAD;
@@ -1195,36 +1261,55 @@ void AnnotatedCameraWidget::paintGL() {
       CameraWidget::updateCalibration(DEFAULT_CALIBRATION);
     }
     CameraWidget::setFrameId(model.getFrameId());
+    CameraWidget::setNearestSampling(renderQuality == RenderQuality::MINIMAL);
+    UI_PROFILE_SCOPE(UISection::CAMERA);
     CameraWidget::paintGL();
   }
 
   QPainter painter(this);
-  painter.setRenderHint(QPainter::Antialiasing);
+  painter.setRenderHint(QPainter::Antialiasing, renderQuality == RenderQuality::FULL);
   painter.setPen(Qt::NoPen);
 
   if (!s->scene.show_driver_camera) {
     if (s->worldObjectsVisible()) {
       if (sm.rcv_frame("modelV2") > s->scene.started_frame) {
+        UI_PROFILE_SCOPE(UISection::MODEL);
         update_model(s, model, sm["uiPlan"].getUiPlan());
         if (sm.rcv_frame("radarState") > s->scene.started_frame) {
           update_leads(s, radar_state, model.getPosition());
         }
       }
 
-      drawLaneLines(painter, s);
+      auto lead_one = radar_state.getLeadOne();
+      auto lead_two = radar_state.getLeadTwo();
+      const bool draw_lead_one = s->scene.longitudinal_control && lead_one.getStatus();
+      const bool draw_lead_two = s->scene.longitudinal_control && lead_two.getStatus() && (std::abs(lead_one.getDRel() - lead_two.getDRel()) > 3.0);
+
+      UI_PROFILE_SCOPE(UISection::LANE_LINES);
+      painter.beginNativePainting();
+      overlay.begin(width(), height());
+      overlay.setFlat(renderQuality != RenderQuality::FULL);
+      drawLaneLines(s);
+      if (draw_lead_one) {
+        drawLead(lead_one, s->scene.lead_vertices[0]);
+      }
+      if (draw_lead_two) {
+        drawLead(lead_two, s->scene.lead_vertices[1]);
+      }
+      overlay.end();
+      painter.endNativePainting();
 
-      if (s->scene.longitudinal_control) {
-        auto lead_one = radar_state.getLeadOne();
-        auto lead_two = radar_state.getLeadTwo();
-        if (lead_one.getStatus()) {
-          drawLead(painter, lead_one, s->scene.lead_vertices[0]);
-        }
-        if (lead_two.getStatus() && (std::abs(lead_one.getDRel() - lead_two.getDRel()) > 3.0)) {
-          drawLead(painter, lead_two, s->scene.lead_vertices[1]);
-        }
+      drawLaneLineText(painter, s);
+      if (draw_lead_one) {
+        drawLeadText(painter, lead_one, s->scene.lead_vertices[0]);
+      }
+      if (draw_lead_two) {
+        drawLeadText(painter, lead_two, s->scene.lead_vertices[1]);
       }
     }
 
+    UI_PROFILE_SCOPE(UISection::HUD);
+
     // DMoji
     if (!hideBottomIcons && (sm.rcv_frame("driverStateV2") > s->scene.started_frame) && !muteDM) {
       update_dmonitoring(s, sm["driverStateV2"].getDriverStateV2(), dm_fade_state, rightHandDM);
@@ -1242,6 +1327,13 @@ void AnnotatedCameraWidget::paintGL() {
   }
   prev_draw_t = cur_draw_t;
 
+  UIProfiler *profiler = uiProfiler();
+  if (profiler->enabled) {
+    profiler->add(UISection::FRAME, cur_draw_t - start_draw_t);
+    profiler->frameDone();
+    drawProfiler(painter);
+  }
+
   // publish debug msg
   MessageBuilder msg;
   auto m = msg.initEvent().initUiDebug();
@@ -1256,11 +1348,33 @@ void AnnotatedCameraWidget::showEvent(QShowEvent *event) {
   prev_draw_t = millis_since_boot();
 }
 
-// FrogPilot widgets
-
-void AnnotatedCameraWidget::drawCompass(QPainter &p) {
+void AnnotatedCameraWidget::drawProfiler(QPainter &p) {
   p.save();
 
+  const std::vector<std::string> lines = uiProfiler()->summary();
+  QFont font("monospace");
+  font.setStyleHint(QFont::Monospace);
+  font.setPixelSize(28);
+  p.setFont(font);
+
+  const int line_height = p.fontMetrics().height();
+  const QRect box(UI_BORDER_SIZE * 2, UI_HEADER_HEIGHT + 40, p.fontMetrics().horizontalAdvance(QString::fromStdString(lines[0])) + 40,
+                  line_height * lines.size() + 30);
+  p.setPen(Qt::NoPen);
+  p.setBrush(blackColor(180));
+  p.drawRoundedRect(box, 20, 20);
+
+  p.setPen(Qt::white);
+  for (int i = 0; i < lines.size(); i++) {
+    p.drawText(box.x() + 20, box.y() + 15 + line_height * i + p.fontMetrics().ascent(), QString::fromStdString(lines[i]));
+  }
+
+  p.restore();
+}
+
+// FrogPilot widgets
+
+void AnnotatedCameraWidget::drawCompass(QPainter &painter) {
   // Variable declarations
   constexpr int circle_size = 250;
   constexpr int circle_offset = circle_size / 2;
@@ -1269,90 +1383,92 @@ void AnnotatedCameraWidget::drawCompass(QPainter &p) {
   const int x = !rightHandDM ? rect().right() - btn_size / 2 - (UI_BORDER_SIZE * 2) - 10 : btn_size / 2 + (UI_BORDER_SIZE * 2) + 10;
   const int y = rect().bottom() - 20 - (alwaysOnLateral || conditionalExperimental || roadNameUI ? 50 : 0) - 140;
 
-  // Enable Antialiasing
-  p.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
-
-  // Configure the circles
-  const QPen whitePen(Qt::white, 2);
-  p.setPen(whitePen);
-
-  const auto drawCircle = [&](const int offset, const QBrush &brush = Qt::NoBrush) {
-    p.setOpacity(1.0);
-    p.setBrush(brush);
-    p.drawEllipse(x - offset, y - offset, offset * 2, offset * 2);
-  };
-
-  // Draw the circle background and white inner circle
-  drawCircle(circle_offset, blackColor(100));
-
-  // Rotate and draw the compass_inner_img image
-  p.translate(x, y);
-  p.rotate(bearingDeg);
-  p.drawPixmap(-compass_inner_img.width() / 2, -compass_inner_img.height() / 2, compass_inner_img);
-
-  // Reset transformation for subsequent drawing
-  p.rotate(-bearingDeg);
-  p.translate(-x, -y);
-
-  // Draw the cardinal directions
-  p.setFont(InterFont(25, QFont::Bold));
-
-  const auto drawDirection = [&](const QString &text, const int from, const int to, const int align) {
-    // Move the "E" and "W" directions a bit closer to the middle so they're more uniform
-    const int offset = (text == "E") ? -5 : ((text == "W") ? 5 : 0);
-    // Set the opacity based on whether the direction label is currently being pointed at
-    p.setOpacity((bearingDeg >= from && bearingDeg < to) ? 1.0 : 0.2);
-    p.drawText(QRect(x - inner_compass + offset, y - inner_compass, btn_size, btn_size), align, text);
-  };
+  // painted again when the bearing changes
+  const QRect compass_rect(x - degreeLabelOffset - 25, y - degreeLabelOffset - 25, (degreeLabelOffset + 25) * 2, (degreeLabelOffset + 25) * 2);
+  compass_layer.draw(painter, compass_rect, bearingDeg, [&](QPainter &p) {
+    // Enable Antialiasing
+    p.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
 
-  drawDirection("N", 0, 68, Qt::AlignTop | Qt::AlignHCenter);
-  drawDirection("E", 23, 158, Qt::AlignRight | Qt::AlignVCenter);
-  drawDirection("S", 113, 248, Qt::AlignBottom | Qt::AlignHCenter);
-  drawDirection("W", 203, 338, Qt::AlignLeft | Qt::AlignVCenter);
-  drawDirection("N", 293, 360, Qt::AlignTop | Qt::AlignHCenter);
+    // Configure the circles
+    const QPen whitePen(Qt::white, 2);
+    p.setPen(whitePen);
 
-  // Draw the white circle outlining the cardinal directions
-  drawCircle(inner_compass + 5);
+    const auto drawCircle = [&](const int offset, const QBrush &brush = Qt::NoBrush) {
+      p.setOpacity(1.0);
+      p.setBrush(brush);
+      p.drawEllipse(x - offset, y - offset, offset * 2, offset * 2);
+    };
 
-  // Draw the white circle outlining the bearing degrees
-  drawCircle(degreeLabelOffset);
+    // Draw the circle background and white inner circle
+    drawCircle(circle_offset, blackColor(100));
 
-  // Draw the black background for the bearing degrees
-  QPainterPath outerCircle, innerCircle;
-  outerCircle.addEllipse(x - degreeLabelOffset, y - degreeLabelOffset, degreeLabelOffset * 2, degreeLabelOffset * 2);
-  innerCircle.addEllipse(x - circle_offset, y - circle_offset, circle_size, circle_size);
-  p.setOpacity(1.0);
-  p.fillPath(outerCircle.subtracted(innerCircle), Qt::black);
+    // Rotate and draw the compass_inner_img image
+    p.translate(x, y);
+    p.rotate(bearingDeg);
+    p.drawPixmap(-compass_inner_img.width() / 2, -compass_inner_img.height() / 2, compass_inner_img);
+
+    // Reset transformation for subsequent drawing
+    p.rotate(-bearingDeg);
+    p.translate(-x, -y);
+
+    // Draw the cardinal directions
+    p.setFont(InterFont(25, QFont::Bold));
+
+    const auto drawDirection = [&](const QString &text, const int from, const int to, const int align) {
+      // Move the "E" and "W" directions a bit closer to the middle so they're more uniform
+      const int offset = (text == "E") ? -5 : ((text == "W") ? 5 : 0);
+      // Set the opacity based on whether the direction label is currently being pointed at
+      p.setOpacity((bearingDeg >= from && bearingDeg < to) ? 1.0 : 0.2);
+      p.drawText(QRect(x - inner_compass + offset, y - inner_compass, btn_size, btn_size), align, text);
+    };
 
-  // Draw the degree lines and bearing degrees
-  const auto drawCompassElements = [&](const int angle) {
-    const bool isCardinalDirection = angle % 90 == 0;
-    const int lineLength = isCardinalDirection ? 15 : 10;
-    const bool isBold = abs(angle - static_cast<int>(bearingDeg)) <= 7;
+    drawDirection("N", 0, 68, Qt::AlignTop | Qt::AlignHCenter);
+    drawDirection("E", 23, 158, Qt::AlignRight | Qt::AlignVCenter);
+    drawDirection("S", 113, 248, Qt::AlignBottom | Qt::AlignHCenter);
+    drawDirection("W", 203, 338, Qt::AlignLeft | Qt::AlignVCenter);
+    drawDirection("N", 293, 360, Qt::AlignTop | Qt::AlignHCenter);
 
-    // Set the current bearing degree value to bold
-    p.setFont(InterFont(8, isBold ? QFont::Bold : QFont::Normal));
-    p.setPen(QPen(Qt::white, isCardinalDirection ? 3 : 1));
+    // Draw the white circle outlining the cardinal directions
+    drawCircle(inner_compass + 5);
 
-    // Place the elements in their respective spots around their circles
-    p.save();
-    p.translate(x, y);
-    p.rotate(angle);
-    p.drawLine(0, -(circle_size / 2 - lineLength), 0, -(circle_size / 2));
-    p.translate(0, -(circle_size / 2 + 12));
-    p.rotate(-angle);
-    p.drawText(QRect(-20, -10, 40, 20), Qt::AlignCenter, QString::number(angle));
-    p.restore();
-  };
+    // Draw the white circle outlining the bearing degrees
+    drawCircle(degreeLabelOffset);
 
-  for (int i = 0; i < 360; i += 15) {
-    drawCompassElements(i);
-  }
+    // Draw the black background for the bearing degrees
+    QPainterPath outerCircle, innerCircle;
+    outerCircle.addEllipse(x - degreeLabelOffset, y - degreeLabelOffset, degreeLabelOffset * 2, degreeLabelOffset * 2);
+    innerCircle.addEllipse(x - circle_offset, y - circle_offset, circle_size, circle_size);
+    p.setOpacity(1.0);
+    p.fillPath(outerCircle.subtracted(innerCircle), Qt::black);
+
+    // Draw the degree lines and bearing degrees
+    const auto drawCompassElements = [&](const int angle) {
+      const bool isCardinalDirection = angle % 90 == 0;
+      const int lineLength = isCardinalDirection ? 15 : 10;
+      const bool isBold = abs(angle - static_cast<int>(bearingDeg)) <= 7;
+
+      // Set the current bearing degree value to bold
+      p.setFont(InterFont(8, isBold ? QFont::Bold : QFont::Normal));
+      p.setPen(QPen(Qt::white, isCardinalDirection ? 3 : 1));
+
+      // Place the elements in their respective spots around their circles
+      p.save();
+      p.translate(x, y);
+      p.rotate(angle);
+      p.drawLine(0, -(circle_size / 2 - lineLength), 0, -(circle_size / 2));
+      p.translate(0, -(circle_size / 2 + 12));
+      p.rotate(-angle);
+      p.drawText(QRect(-20, -10, 40, 20), Qt::AlignCenter, QString::number(angle));
+      p.restore();
+    };
 
-  p.restore();
+    for (int i = 0; i < 360; i += 15) {
+      drawCompassElements(i);
+    }
+  });
 }
 
-void AnnotatedCameraWidget::drawLeadInfo(QPainter &p) {
+void AnnotatedCameraWidget::drawLeadInfo(QPainter &painter) {
   const SubMaster &sm = *uiState()->sm;
 
   // State variables
@@ -1383,75 +1499,77 @@ void AnnotatedCameraWidget::drawLeadInfo(QPainter &p) {
     isFiveSecondsPassed = timer.hasExpired(maxAccelDuration);
   }
 
-  // Conduct any conversions
-  const double convertAcceleration = conversions[0][is_metric];
-  const double convertDistance = conversions[1][is_metric];
-  const QString speedMetric = QString::fromUtf8(units[0][is_metric]);
-  const auto &abbreviateUnits = units[mapOpen ? 2 : 1];
-
-  // Construct text segments
-  const auto createText = [&](const QString &title, const double data) {
-    return title + QString::number(data * convertDistance, 'f', 0) + QString::fromUtf8(abbreviateUnits[is_metric]);
-  };
+  // painted again when any of the insights change
+  const QRect insightsRect(rect().left() - 1, rect().top() - 60, rect().width() + 2, 100);
+  const auto key = std::make_tuple(currentAcceleration, maxAcceleration, isFiveSecondsPassed, is_metric, mapOpen, obstacleDistance,
+                                   obstacleDistanceStock, stoppedEquivalence, stoppedEquivalenceStock, desiredFollow);
+  lead_info_layer.draw(painter, insightsRect, key, [&](QPainter &p) {
+    // Conduct any conversions
+    const double convertAcceleration = conversions[0][is_metric];
+    const double convertDistance = conversions[1][is_metric];
+    const QString speedMetric = QString::fromUtf8(units[0][is_metric]);
+    const auto &abbreviateUnits = units[mapOpen ? 2 : 1];
+
+    // Construct text segments
+    const auto createText = [&](const QString &title, const double data) {
+      return title + QString::number(data * convertDistance, 'f', 0) + QString::fromUtf8(abbreviateUnits[is_metric]);
+    };
 
-  // Create segments for insights
-  const QString accelText = QString("Accel: %1%2")
-    .arg(currentAcceleration * convertAcceleration, 0, 'f', 2)
-    .arg(speedMetric);
+    // Create segments for insights
+    const QString accelText = QString("Accel: %1%2")
+      .arg(currentAcceleration * convertAcceleration, 0, 'f', 2)
+      .arg(speedMetric);
 
-  const QString maxAccSuffix = mapOpen ? "" : QString(" - Max: %1%2")
-    .arg(maxAcceleration * convertAcceleration, 0, 'f', 2)
-    .arg(speedMetric);
+    const QString maxAccSuffix = mapOpen ? "" : QString(" - Max: %1%2")
+      .arg(maxAcceleration * convertAcceleration, 0, 'f', 2)
+      .arg(speedMetric);
 
-  const QString obstacleText = createText(mapOpen ? " | Obstacle: " : "  |  Obstacle Factor: ", obstacleDistance);
-  const QString stopText = createText(mapOpen ? " - Stop: " : "  -  Stop Factor: ", stoppedEquivalence);
-  const QString followText = " = " + createText(mapOpen ? "Follow: " : "Follow Distance: ", desiredFollow);
+    const QString obstacleText = createText(mapOpen ? " | Obstacle: " : "  |  Obstacle Factor: ", obstacleDistance);
+    const QString stopText = createText(mapOpen ? " - Stop: " : "  -  Stop Factor: ", stoppedEquivalence);
+    const QString followText = " = " + createText(mapOpen ? "Follow: " : "Follow Distance: ", desiredFollow);
 
-  // Check if the longitudinal toggles have an impact on the driving logics
-  const auto createDiffText = [&](const double data, const double stockData) {
-    const double difference = data - stockData;
-    return difference != 0 ? QString(" (%1%2)").arg(difference > 0 ? "+" : "").arg(difference) : QString();
-  };
-
-  // Prepare rectangle for insights
-  p.save();
-  const QRect insightsRect(rect().left() - 1, rect().top() - 60, rect().width() + 2, 100);
-  p.setBrush(QColor(0, 0, 0, 150));
-  p.drawRoundedRect(insightsRect, 30, 30);
-  p.setFont(InterFont(30, QFont::DemiBold));
-  p.setRenderHint(QPainter::TextAntialiasing);
+    // Check if the longitudinal toggles have an impact on the driving logics
+    const auto createDiffText = [&](const double data, const double stockData) {
+      const double difference = data - stockData;
+      return difference != 0 ? QString(" (%1%2)").arg(difference > 0 ? "+" : "").arg(difference) : QString();
+    };
 
-  // Calculate positioning for text drawing
-  const QRect adjustedRect = insightsRect.adjusted(0, 27, 0, 27);
-  const int textBaseLine = adjustedRect.y() + (adjustedRect.height() + p.fontMetrics().height()) / 2 - p.fontMetrics().descent();
-
-  // Calculate the entire text width to ensure perfect centering
-  const int totalTextWidth = p.fontMetrics().horizontalAdvance(accelText) 
-                           + p.fontMetrics().horizontalAdvance(maxAccSuffix)
-                           + p.fontMetrics().horizontalAdvance(obstacleText)
-                           + p.fontMetrics().horizontalAdvance(createDiffText(obstacleDistance, obstacleDistanceStock))
-                           + p.fontMetrics().horizontalAdvance(stopText)
-                           + p.fontMetrics().horizontalAdvance(createDiffText(stoppedEquivalence, stoppedEquivalenceStock))
-                           + p.fontMetrics().horizontalAdvance(followText);
-
-  int textStartPos = adjustedRect.x() + (adjustedRect.width() - totalTextWidth) / 2;
-
-  // Draw the text
-  const auto drawText = [&](const QString &text, const QColor color) {
-    p.setPen(color);
-    p.drawText(textStartPos, textBaseLine, text);
-    textStartPos += p.fontMetrics().horizontalAdvance(text);
-  };
+    // Prepare rectangle for insights
+    p.setBrush(QColor(0, 0, 0, 150));
+    p.drawRoundedRect(insightsRect, 30, 30);
+    p.setFont(InterFont(30, QFont::DemiBold));
+    p.setRenderHint(QPainter::TextAntialiasing);
 
-  drawText(accelText, Qt::white);
-  drawText(maxAccSuffix, isFiveSecondsPassed ? Qt::white : Qt::red);
-  drawText(obstacleText, Qt::white);
-  drawText(createDiffText(obstacleDistance, obstacleDistanceStock), (obstacleDistance - obstacleDistanceStock) > 0 ? Qt::green : Qt::red);
-  drawText(stopText, Qt::white);
-  drawText(createDiffText(stoppedEquivalence, stoppedEquivalenceStock), (stoppedEquivalence - stoppedEquivalenceStock) > 0 ? Qt::green : Qt::red);
-  drawText(followText, Qt::white);
+    // Calculate positioning for text drawing
+    const QRect adjustedRect = insightsRect.adjusted(0, 27, 0, 27);
+    const int textBaseLine = adjustedRect.y() + (adjustedRect.height() + p.fontMetrics().height()) / 2 - p.fontMetrics().descent();
+
+    // Calculate the entire text width to ensure perfect centering
+    const int totalTextWidth = p.fontMetrics().horizontalAdvance(accelText) 
+                             + p.fontMetrics().horizontalAdvance(maxAccSuffix)
+                             + p.fontMetrics().horizontalAdvance(obstacleText)
+                             + p.fontMetrics().horizontalAdvance(createDiffText(obstacleDistance, obstacleDistanceStock))
+                             + p.fontMetrics().horizontalAdvance(stopText)
+                             + p.fontMetrics().horizontalAdvance(createDiffText(stoppedEquivalence, stoppedEquivalenceStock))
+                             + p.fontMetrics().horizontalAdvance(followText);
+
+    int textStartPos = adjustedRect.x() + (adjustedRect.width() - totalTextWidth) / 2;
+
+    // Draw the text
+    const auto drawText = [&](const QString &text, const QColor color) {
+      p.setPen(color);
+      p.drawText(textStartPos, textBaseLine, text);
+      textStartPos += p.fontMetrics().horizontalAdvance(text);
+    };
 
-  p.restore();
+    drawText(accelText, Qt::white);
+    drawText(maxAccSuffix, isFiveSecondsPassed ? Qt::white : Qt::red);
+    drawText(obstacleText, Qt::white);
+    drawText(createDiffText(obstacleDistance, obstacleDistanceStock), (obstacleDistance - obstacleDistanceStock) > 0 ? Qt::green : Qt::red);
+    drawText(stopText, Qt::white);
+    drawText(createDiffText(stoppedEquivalence, stoppedEquivalenceStock), (stoppedEquivalence - stoppedEquivalenceStock) > 0 ? Qt::green : Qt::red);
+    drawText(followText, Qt::white);
+  });
 }
 
 PersonalityButton::PersonalityButton(QWidget *parent) : QPushButton(parent), scene(uiState()->scene) {
@@ -1482,7 +1600,11 @@ PersonalityButton::PersonalityButton(QWidget *parent) : QPushButton(parent), sce
 }
 
 void PersonalityButton::checkUpdate() {
-  // Sync with the steering wheel button
+  // Sync with the steering wheel button, once the params changed
+  const uint32_t version = params.version();
+  if (version == params_version) return;
+  params_version = version;
+
   if (params.getInt("LongitudinalPersonality") != personalityProfile) {
     personalityProfile = params.getInt("LongitudinalPersonality");
     updateState();
@@ -1544,7 +1666,7 @@ void AnnotatedCameraWidget::drawStatusBar(QPainter &p) {
   constexpr qreal fadeDuration = 1500.0;  // 1.5 seconds
   constexpr qreal textDuration = 5000.0;  // 5 seconds
 
-  const QString roadName = roadNameUI ? QString::fromStdString(Params("/dev/shm/params").get("RoadName")) : QString();
+  const QString roadName = roadNameUI ? uiState()->scene.road_name : QString();
   const QString screenSuffix = ". Double tap the screen to revert";
   const QString wheelSuffix = ". Double press the \"LKAS\" button to revert";
 
@@ -1604,23 +1726,25 @@ void AnnotatedCameraWidget::drawStatusBar(QPainter &p) {
   p.setOpacity(1.0);
   p.drawRoundedRect(statusBarRect, 30, 30);
 
-  // Configure the text
-  p.setFont(InterFont(40, QFont::Bold));
-  p.setPen(Qt::white);
-  p.setRenderHint(QPainter::TextAntialiasing);
+  // The texts are painted again when they change, only their opacity is animated. They
+  // grow up from the bar when they wrap
+  const QRect textLayerRect = statusBarRect.adjusted(0, -100, 0, 0);
+  const auto drawStatusText = [&](QPainter &tp, const QString &text) {
+    tp.setFont(InterFont(40, QFont::Bold));
+    tp.setPen(Qt::white);
+    QRect textRect = tp.fontMetrics().boundingRect(statusBarRect, Qt::AlignCenter | Qt::TextWordWrap, text);
+    textRect.moveBottom(statusBarRect.bottom() - 50);
+    tp.drawText(textRect, Qt::AlignCenter | Qt::TextWordWrap, text);
+  };
 
   // Draw the status text with the calculated opacity
   p.setOpacity(statusTextOpacity);
-  QRect textRect = p.fontMetrics().boundingRect(statusBarRect, Qt::AlignCenter | Qt::TextWordWrap, newStatus);
-  textRect.moveBottom(statusBarRect.bottom() - 50);
-  p.drawText(textRect, Qt::AlignCenter | Qt::TextWordWrap, newStatus);
+  status_text_layer.draw(p, textLayerRect, newStatus, [&](QPainter &tp) { drawStatusText(tp, newStatus); });
 
   // Draw the road name with the calculated opacity if it's not empty
   if (!roadName.isEmpty()) {
     p.setOpacity(roadNameOpacity);
-    textRect = p.fontMetrics().boundingRect(statusBarRect, Qt::AlignCenter | Qt::TextWordWrap, roadName);
-    textRect.moveBottom(statusBarRect.bottom() - 50);
-    p.drawText(textRect, Qt::AlignCenter | Qt::TextWordWrap, roadName);
+    road_name_layer.draw(p, textLayerRect, roadName, [&](QPainter &tp) { drawStatusText(tp, roadName); });
   }
 
   p.restore();
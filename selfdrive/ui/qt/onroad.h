@@ -3,13 +3,16 @@
 #include <memory>
 
 #include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QPushButton>
 #include <QStackedLayout>
 #include <QWidget>
 
 #include "common/util.h"
 #include "selfdrive/ui/ui.h"
+#include "selfdrive/ui/qt/util.h"
 #include "selfdrive/ui/qt/widgets/cameraview.h"
+#include "selfdrive/ui/qt/widgets/overlay.h"
 
 
 const int btn_size = 192;
@@ -61,8 +64,9 @@ private:
   bool leadInfo;
   bool rotatingWheel;
   int steeringAngleDeg;
-  int steeringWheel;
-  std::map<int, QPixmap> wheelImages;
+  int steeringWheel = 0;
+  QPixmap rotated_img;
+  std::pair<qint64, int> rotated_key;
 
 };
 
@@ -98,6 +102,7 @@ private:
   const UIScene &scene;
 
   int personalityProfile = 0;
+  uint32_t params_version = params.version() - 1;
   int yOffset;
 
   QElapsedTimer transitionTimer;
@@ -112,18 +117,23 @@ class AnnotatedCameraWidget : public CameraWidget {
 
 public:
   explicit AnnotatedCameraWidget(VisionStreamType type, QWidget* parent = 0);
+  ~AnnotatedCameraWidget();
   void updateState(const UIState &s);
 
   MapSettingsButton *map_settings_btn;
 
 private:
   void drawText(QPainter &p, int x, int y, const QString &text, int alpha = 255);
+  void drawSetSpeed(QPainter &p);
+  void drawProfiler(QPainter &p);
 
   // FrogPilot widgets
   void drawCompass(QPainter &p);
   void drawLeadInfo(QPainter &p);
   void drawStatusBar(QPainter &p);
   void drawTurnSignals(QPainter &p);
+  void loadSignalImages();
+  void signalImagesLoaded();
 
   QVBoxLayout *main_layout;
   ExperimentalButton *experimental_btn;
@@ -146,6 +156,8 @@ private:
 
   int skip_frame_count = 0;
   bool wide_cam_requested = false;
+  std::optional<bool> wide_cam_published;
+  RenderQuality renderQuality = RenderQuality::FULL;
 
   // FrogPilot variables
   bool accelerationPath;
@@ -189,14 +201,29 @@ private:
   size_t animationFrameIndex;
   std::unordered_map<int, std::pair<QString, std::pair<QColor, std::map<double, QBrush>>>> themeConfiguration;
   std::vector<QPixmap> signalImgVector;
+  QFutureWatcher<QVector<QImage>> signal_images_watcher;
+
+  // the HUD, painted again when what it shows changes
+  HudLayer<std::tuple<float, float, float, float, bool, bool, bool, bool, int, bool, bool, bool>> set_speed_layer;
+  HudLayer<std::tuple<int, QString>> current_speed_layer;
+  HudLayer<int> compass_layer;
+  HudLayer<std::tuple<double, double, bool, bool, bool, int, int, int, int, int>> lead_info_layer;
+  HudLayer<QString> status_text_layer;
+  HudLayer<QString> road_name_layer;
 
 protected:
   void paintGL() override;
   void initializeGL() override;
   void showEvent(QShowEvent *event) override;
   void updateFrameMat() override;
-  void drawLaneLines(QPainter &painter, const UIState *s);
-  void drawLead(QPainter &painter, const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd);
+  // the overlay fills, between overlay.begin() and end()
+  void drawLaneLines(const UIState *s);
+  void drawLead(const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd);
+  // and the text on them, with the painter once the fills are drawn
+  void drawLaneLineText(QPainter &painter, const UIState *s);
+  void drawLeadText(QPainter &painter, const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd);
+  void leadChevron(const cereal::RadarState::LeadData::Reader &lead_data, const QPointF &vd, QPolygonF &glow, QPolygonF &chevron);
+  QLinearGradient adjacentLaneGradient(float laneWidth, bool blindspot);
   void drawHud(QPainter &p);
   void drawDriverState(QPainter &painter, const UIState *s);
   inline QColor redColor(int alpha = 255) { return QColor(201, 34, 49, alpha); }
@@ -205,6 +232,7 @@ protected:
 
   double prev_draw_t = 0;
   FirstOrderFilter fps_filter;
+  OverlayRenderer overlay;
 };
 
 // container for all onroad widgets
@@ -240,8 +268,13 @@ private:
   QPoint timeoutPoint = QPoint(420, 69);
   QTimer clickTimer;
 
+  // when the car was started, until the road camera is on screen
+  double ignition_t = 0;
+
 private slots:
   void offroadTransition(bool offroad);
   void primeChanged(bool prime);
   void updateState(const UIState &s);
+  void cameraFrameDrawn();
+  void createMap();
 };
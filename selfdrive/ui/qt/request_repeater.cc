@@ -15,7 +15,10 @@ RequestRepeater::RequestRepeater(QObject *parent, const QString &requestURL, con
   if (!cacheKey.isEmpty()) {
     prevResp = QString::fromStdString(params.get(cacheKey.toStdString()));
     if (!prevResp.isEmpty()) {
-      QTimer::singleShot(500, [=]() { emit requestDone(prevResp, true, QNetworkReply::NoError); });
+      QTimer::singleShot(500, [=]() {
+        const QByteArray resp = prevResp.toUtf8();
+        emitResponse(resp, wantsJson() ? parseJson(resp) : QFuture<QJsonDocument>());
+      });
     }
     QObject::connect(this, &HttpRequest::requestDone, [=](const QString &resp, bool success) {
       if (success && resp != prevResp) {
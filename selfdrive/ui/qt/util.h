@@ -38,6 +38,42 @@ struct InterFont : public QFont {
   }
 };
 
+// A part of the onroad HUD that's painted into a pixmap only when the key it's painted
+// from changes, every other frame draws the pixmap, which the GL paint engine keeps as
+// a texture. paint(QPainter &) paints in the coordinates of the painter it's drawn
+// with, clipped to rect, with no pen.
+template <class Key>
+class HudLayer {
+public:
+  template <class Paint>
+  void draw(QPainter &p, const QRect &rect, const Key &key, Paint paint) {
+    const qreal dpr = p.device()->devicePixelRatioF();
+    if (pixmap.isNull() || rect != last_rect || dpr != pixmap.devicePixelRatioF()) {
+      pixmap = QPixmap(rect.size() * dpr);
+      pixmap.setDevicePixelRatio(dpr);
+    } else if (key == last_key) {
+      p.drawPixmap(rect.topLeft(), pixmap);
+      return;
+    }
+    pixmap.fill(Qt::transparent);
+    {
+      QPainter lp(&pixmap);
+      lp.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
+      lp.setPen(Qt::NoPen);
+      lp.translate(-rect.topLeft());
+      paint(lp);
+    }
+    last_key = key;
+    last_rect = rect;
+    p.drawPixmap(rect.topLeft(), pixmap);
+  }
+
+private:
+  QPixmap pixmap;
+  Key last_key = {};
+  QRect last_rect;
+};
+
 class ParamWatcher : public QObject {
   Q_OBJECT
 
@@ -7,6 +7,7 @@
 #endif
 
 #include <cmath>
+#include <cstring>
 #include <set>
 #include <string>
 #include <utility>
@@ -113,6 +114,12 @@ CameraWidget::~CameraWidget() {
     glDeleteBuffers(1, &frame_vbo);
     glDeleteBuffers(1, &frame_ibo);
     glDeleteBuffers(2, textures);
+#ifndef QCOM2
+    for (int i = 0; i < PBO_COUNT; i++) {
+      if (pbo_fences[i]) glDeleteSync(pbo_fences[i]);
+    }
+    glDeleteBuffers(PBO_COUNT, pbos);
+#endif
   }
   doneCurrent();
 }
@@ -257,6 +264,7 @@ void CameraWidget::updateCalibration(const mat3 &calib) {
 }
 
 void CameraWidget::paintGL() {
+  const double start_t = millis_since_boot();
   glClearColor(bg.redF(), bg.greenF(), bg.blueF(), bg.alphaF());
   glClear(GL_STENCIL_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
@@ -279,6 +287,9 @@ void CameraWidget::paintGL() {
   prev_frame_id = frames[frame_idx].first;
   VisionBuf *frame = frames[frame_idx].second;
   assert(frame != nullptr);
+  if (!frame->is_intact()) {
+    qDebug() << "Frame overwritten while held" << frames[frame_idx].first;
+  }
 
   updateFrameMat();
 
@@ -286,25 +297,27 @@ void CameraWidget::paintGL() {
   glBindVertexArray(frame_vao);
   glUseProgram(program->programId());
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  const GLint filter = nearest_sampling ? GL_NEAREST : GL_LINEAR;
 
 #ifdef QCOM2
   // no frame copy
   glActiveTexture(GL_TEXTURE0);
   glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, egl_images[frame->idx]);
   assert(glGetError() == GL_NO_ERROR);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, filter);
 #else
-  // fallback to copy
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, stream_stride);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, textures[0]);
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stream_width, stream_height, GL_RED, GL_UNSIGNED_BYTE, frame->y);
-  assert(glGetError() == GL_NO_ERROR);
-
-  glPixelStorei(GL_UNPACK_ROW_LENGTH, stream_stride/2);
-  glActiveTexture(GL_TEXTURE0 + 1);
-  glBindTexture(GL_TEXTURE_2D, textures[1]);
-  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stream_width/2, stream_height/2, GL_RG, GL_UNSIGNED_BYTE, frame->uv);
-  assert(glGetError() == GL_NO_ERROR);
+  // fallback to copy, skipped when the frame is already in the textures
+  if (uploaded_frame != std::make_pair(frame, prev_frame_id)) {
+    uploadFrame(frame);
+    uploaded_frame = {frame, prev_frame_id};
+  }
+  for (int i = 0; i < 2; i++) {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  }
 #endif
 
   glUniformMatrix4fv(program->uniformLocation("uTransform"), 1, GL_TRUE, frame_mat.v);
@@ -316,7 +329,53 @@ void CameraWidget::paintGL() {
   glActiveTexture(GL_TEXTURE0);
   glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
   glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  draw_time.update(millis_since_boot() - start_t);
+
+  if (!frame_drawn) {
+    frame_drawn = true;
+    emit firstFrameDrawn();
+  }
+}
+
+#ifndef QCOM2
+void CameraWidget::uploadFrame(VisionBuf *frame) {
+  const double start_t = millis_since_boot();
+  const size_t y_size = stream_stride * stream_height;
+  const size_t uv_size = stream_stride * (stream_height / 2);
+
+  // The GPU may still be reading this buffer from PBO_COUNT frames ago
+  if (pbo_fences[pbo_idx]) {
+    glClientWaitSync(pbo_fences[pbo_idx], GL_SYNC_FLUSH_COMMANDS_BIT, 100 * 1000 * 1000);
+    glDeleteSync(pbo_fences[pbo_idx]);
+    pbo_fences[pbo_idx] = nullptr;
+  }
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[pbo_idx]);
+  uint8_t *dst = (uint8_t *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, y_size + uv_size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+  assert(dst != nullptr);
+  memcpy(dst, frame->y, y_size);
+  memcpy(dst + y_size, frame->uv, uv_size);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  // the texture updates read the PBO asynchronously
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, stream_stride);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, textures[0]);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stream_width, stream_height, GL_RED, GL_UNSIGNED_BYTE, (const void *)0);
+  assert(glGetError() == GL_NO_ERROR);
+
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, stream_stride/2);
+  glActiveTexture(GL_TEXTURE0 + 1);
+  glBindTexture(GL_TEXTURE_2D, textures[1]);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, stream_width/2, stream_height/2, GL_RG, GL_UNSIGNED_BYTE, (const void *)y_size);
+  assert(glGetError() == GL_NO_ERROR);
+
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  pbo_fences[pbo_idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  pbo_idx = (pbo_idx + 1) % PBO_COUNT;
+  upload_time.update(millis_since_boot() - start_t);
 }
+#endif
 
 void CameraWidget::vipcConnected(VisionIpcClient *vipc_client) {
   makeCurrent();
@@ -365,6 +424,18 @@ void CameraWidget::vipcConnected(VisionIpcClient *vipc_client) {
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, stream_width/2, stream_height/2, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr);
   assert(glGetError() == GL_NO_ERROR);
+
+  if (!pbos[0]) glGenBuffers(PBO_COUNT, pbos);
+  for (int i = 0; i < PBO_COUNT; i++) {
+    if (pbo_fences[i]) {
+      glDeleteSync(pbo_fences[i]);
+      pbo_fences[i] = nullptr;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, stream_stride * stream_height * 3 / 2, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  uploaded_frame = {};
 #endif
 }
 
@@ -405,8 +476,11 @@ void CameraWidget::vipcThread() {
     if (VisionBuf *buf = vipc_client->recv(&meta_main, 1000)) {
       {
         std::lock_guard lk(frame_lock);
+        // hold the buffer so camerad doesn't reuse it while it can still be drawn
+        buf->acquire();
         frames.push_back(std::make_pair(meta_main.frame_id, buf));
         while (frames.size() > FRAME_BUFFER_SIZE) {
+          frames.front().second->release();
           frames.pop_front();
         }
       }
@@ -428,6 +502,10 @@ void CameraWidget::vipcThread() {
 
 void CameraWidget::clearFrames() {
   std::lock_guard lk(frame_lock);
+  for (auto &[_, buf] : frames) {
+    buf->release();
+  }
   frames.clear();
   available_streams.clear();
+  frame_drawn = false;
 }
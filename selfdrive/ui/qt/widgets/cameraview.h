@@ -23,6 +23,7 @@
 #endif
 
 #include "cereal/visionipc/visionipc_client.h"
+#include "common/util.h"
 #include "system/camerad/cameras/camera_common.h"
 #include "selfdrive/ui/ui.h"
 
@@ -40,6 +41,11 @@ public:
   void setFrameId(int frame_id) { draw_frame_id = frame_id; }
   void setStreamType(VisionStreamType type) { requested_stream_type = type; }
   VisionStreamType getStreamType() { return active_stream_type; }
+  // cheaper and blockier sampling of the frame, for when the device runs hot
+  void setNearestSampling(bool nearest) { nearest_sampling = nearest; }
+  // smoothed frame upload and draw times in ms
+  float uploadTime() { return upload_time.x(); }
+  float drawTime() { return draw_time.x(); }
   void stopVipcThread();
 
 signals:
@@ -47,6 +53,8 @@ signals:
   void vipcThreadConnected(VisionIpcClient *);
   void vipcThreadFrameReceived();
   void vipcAvailableStreamsUpdated(std::set<VisionStreamType>);
+  // the first frame drawn since the frames were cleared, i.e. of a new connection
+  void firstFrameDrawn();
 
 protected:
   void paintGL() override;
@@ -63,6 +71,7 @@ protected:
   int glHeight();
 
   bool zoomed_view;
+  bool nearest_sampling = false;
   GLuint frame_vao, frame_vbo, frame_ibo;
   GLuint textures[2];
   mat4 frame_mat = {};
@@ -72,7 +81,17 @@ protected:
 #ifdef QCOM2
   EGLDisplay egl_display;
   std::map<int, EGLImageKHR> egl_images;
+#else
+  // ring of pixel buffers so texture uploads don't stall the paint
+  static const int PBO_COUNT = 3;
+  GLuint pbos[PBO_COUNT] = {};
+  GLsync pbo_fences[PBO_COUNT] = {};
+  int pbo_idx = 0;
+  std::pair<VisionBuf *, uint32_t> uploaded_frame = {};
+  void uploadFrame(VisionBuf *frame);
 #endif
+  FirstOrderFilter upload_time = FirstOrderFilter(0, 1, 1. / UI_FREQ);
+  FirstOrderFilter draw_time = FirstOrderFilter(0, 1, 1. / UI_FREQ);
 
   std::string stream_name;
   int stream_width = 0;
@@ -94,6 +113,7 @@ protected:
   std::deque<std::pair<uint32_t, VisionBuf*>> frames;
   uint32_t draw_frame_id = 0;
   uint32_t prev_frame_id = 0;
+  bool frame_drawn = false;  // since clearFrames, under frame_lock
 
 protected slots:
   void vipcConnected(VisionIpcClient *vipc_client);
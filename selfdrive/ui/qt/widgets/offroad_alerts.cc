@@ -5,6 +5,8 @@
 #include <vector>
 #include <utility>
 
+#include <QCoreApplication>
+#include <QElapsedTimer>
 #include <QHBoxLayout>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -13,6 +15,80 @@
 #include "system/hardware/hw.h"
 #include "selfdrive/ui/qt/widgets/scrollview.h"
 
+OffroadStatus::OffroadStatus(QObject *parent) : QThread(parent) {
+  qRegisterMetaType<OffroadStatusState>();
+}
+
+OffroadStatus::~OffroadStatus() {
+  requestInterruption();
+  wait();
+}
+
+void OffroadStatus::setPaused(bool p) {
+  if (!p) refresh_requested = true;
+  paused = p;
+}
+
+void OffroadStatus::run() {
+  Params params;
+  OffroadStatusState last;
+  bool first = true;
+  uint32_t version = params.version() - 1;
+  QElapsedTimer since_read;
+
+  while (!isInterruptionRequested()) {
+    // checks for interruption at least once a second
+    bool params_changed = params.waitForChange(version, 1000);
+    if (params_changed) version = params.version();
+    if (paused || !(params_changed || refresh_requested || since_read.hasExpired(10 * 1000))) continue;
+
+    refresh_requested = false;
+    since_read.start();
+    OffroadStatusState state = read(params);
+    if (first || state != last) {
+      first = false;
+      last = state;
+      emit changed(state);
+    }
+  }
+}
+
+OffroadStatusState OffroadStatus::read(Params &params) {
+  static std::vector<std::pair<std::string, int>> sorted = [] {
+    QString json = util::read_file("../controls/lib/alerts_offroad.json").c_str();
+    QJsonObject obj = QJsonDocument::fromJson(json.toUtf8()).object();
+
+    // descending sort labels by severity
+    std::vector<std::pair<std::string, int>> sorted;
+    for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+      sorted.push_back({it.key().toStdString(), it.value()["severity"].toInt()});
+    }
+    std::sort(sorted.begin(), sorted.end(), [=](auto &l, auto &r) { return l.second > r.second; });
+    return sorted;
+  }();
+
+  OffroadStatusState state;
+  for (auto &[key, severity] : sorted) {
+    QString text;
+    std::string bytes = params.get(key);
+    if (bytes.size()) {
+      auto doc_par = QJsonDocument::fromJson(bytes.c_str());
+      text = QCoreApplication::translate("OffroadAlert", doc_par["text"].toString().toUtf8().data());
+      auto extra = doc_par["extra"].toString();
+      if (!extra.isEmpty()) {
+        text = text.arg(extra);
+      }
+    }
+    state.alerts.push_back({key, severity, text});
+  }
+
+  state.update_available = params.getBool("UpdateAvailable");
+  if (state.update_available) {
+    state.release_notes = params.get("UpdaterNewReleaseNotes").c_str();
+  }
+  return state;
+}
+
 AbstractAlert::AbstractAlert(bool hasRebootBtn, QWidget *parent) : QFrame(parent) {
   QVBoxLayout *main_layout = new QVBoxLayout(this);
   main_layout->setMargin(50);
@@ -78,46 +154,28 @@ AbstractAlert::AbstractAlert(bool hasRebootBtn, QWidget *parent) : QFrame(parent
   )");
 }
 
-int OffroadAlert::refresh() {
+int OffroadAlert::refresh(const OffroadStatusState &state) {
   // build widgets for each offroad alert on first refresh
   if (alerts.empty()) {
-    QString json = util::read_file("../controls/lib/alerts_offroad.json").c_str();
-    QJsonObject obj = QJsonDocument::fromJson(json.toUtf8()).object();
-
-    // descending sort labels by severity
-    std::vector<std::pair<std::string, int>> sorted;
-    for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
-      sorted.push_back({it.key().toStdString(), it.value()["severity"].toInt()});
-    }
-    std::sort(sorted.begin(), sorted.end(), [=](auto &l, auto &r) { return l.second > r.second; });
-
-    for (auto &[key, severity] : sorted) {
+    for (auto &alert : state.alerts) {
       QLabel *l = new QLabel(this);
-      alerts[key] = l;
+      alerts[alert.key] = l;
       l->setMargin(60);
       l->setWordWrap(true);
-      l->setStyleSheet(QString("background-color: %1").arg(severity ? "#E22C2C" : "#292929"));
+      l->setStyleSheet(QString("background-color: %1").arg(alert.severity ? "#E22C2C" : "#292929"));
       scrollable_layout->addWidget(l);
     }
     scrollable_layout->addStretch(1);
   }
 
   int alertCount = 0;
-  for (const auto &[key, label] : alerts) {
-    QString text;
-    std::string bytes = params.get(key);
-    if (bytes.size()) {
-      auto doc_par = QJsonDocument::fromJson(bytes.c_str());
-      text = tr(doc_par["text"].toString().toUtf8().data());
-      auto extra = doc_par["extra"].toString();
-      if (!extra.isEmpty()) {
-        text = text.arg(extra);
-      }
-    }
-    label->setText(text);
-    label->setVisible(!text.isEmpty());
-    alertCount += !text.isEmpty();
+  for (auto &alert : state.alerts) {
+    QLabel *label = alerts[alert.key];
+    label->setText(alert.text);
+    label->setVisible(!alert.text.isEmpty());
+    alertCount += !alert.text.isEmpty();
   }
+  if (!alerts.count("Offroad_ConnectivityNeeded")) return alertCount;
   disable_check_btn->setVisible(!alerts["Offroad_ConnectivityNeeded"]->text().isEmpty());
   snooze_btn->setVisible(!alerts["Offroad_ConnectivityNeeded"]->text().isEmpty());
   return alertCount;
@@ -130,10 +188,9 @@ UpdateAlert::UpdateAlert(QWidget *parent) : AbstractAlert(true, parent) {
   scrollable_layout->addWidget(releaseNotes);
 }
 
-bool UpdateAlert::refresh() {
-  bool updateAvailable = params.getBool("UpdateAvailable");
-  if (updateAvailable) {
-    releaseNotes->setText(params.get("UpdaterNewReleaseNotes").c_str());
+bool UpdateAlert::refresh(const OffroadStatusState &state) {
+  if (state.update_available) {
+    releaseNotes->setText(state.release_notes);
   }
-  return updateAvailable;
+  return state.update_available;
 }
@@ -1,14 +1,57 @@
 #pragma once
 
+#include <atomic>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <QLabel>
 #include <QPushButton>
+#include <QThread>
 #include <QVBoxLayout>
 
 #include "common/params.h"
 
+struct OffroadStatusState {
+  struct Alert {
+    std::string key;
+    int severity;
+    QString text;  // translated, empty if it isn't set
+    bool operator==(const Alert &other) const { return key == other.key && severity == other.severity && text == other.text; }
+  };
+  std::vector<Alert> alerts;  // by descending severity
+  bool update_available = false;
+  QString release_notes;
+
+  bool operator==(const OffroadStatusState &other) const {
+    return alerts == other.alerts && update_available == other.update_available && release_notes == other.release_notes;
+  }
+  bool operator!=(const OffroadStatusState &other) const { return !(*this == other); }
+};
+Q_DECLARE_METATYPE(OffroadStatusState);
+
+// Reads the offroad alerts and the update status off the UI thread, when the params
+// change and every 10s, and emits changed() only when what it read is different.
+// It doesn't read while it's paused.
+class OffroadStatus : public QThread {
+  Q_OBJECT
+
+public:
+  explicit OffroadStatus(QObject *parent = nullptr);
+  ~OffroadStatus();
+  void setPaused(bool paused);
+
+signals:
+  void changed(const OffroadStatusState &state);
+
+private:
+  void run() override;
+  OffroadStatusState read(Params &params);
+
+  std::atomic<bool> paused = true;
+  std::atomic<bool> refresh_requested = false;
+};
+
 class AbstractAlert : public QFrame {
   Q_OBJECT
 
@@ -29,7 +72,7 @@ class UpdateAlert : public AbstractAlert {
 
 public:
   UpdateAlert(QWidget *parent = 0);
-  bool refresh();
+  bool refresh(const OffroadStatusState &state);
 
 private:
   QLabel *releaseNotes = nullptr;
@@ -40,7 +83,7 @@ class OffroadAlert : public AbstractAlert {
 
 public:
   explicit OffroadAlert(QWidget *parent = 0) : AbstractAlert(false, parent) {}
-  int refresh();
+  int refresh(const OffroadStatusState &state);
 
 private:
   std::map<std::string, QLabel*> alerts;
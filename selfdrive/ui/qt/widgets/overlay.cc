@@ -0,0 +1,240 @@
+#include "selfdrive/ui/qt/widgets/overlay.h"
+
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GLES3/gl3.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+
+#include <QLinearGradient>
+
+namespace {
+
+const int GRADIENT_SIZE = 256;
+const int MAX_GRADIENTS = 16;  // per flush
+
+const char overlay_vertex_shader[] =
+#ifdef __APPLE__
+  "#version 330 core\n"
+#else
+  "#version 300 es\n"
+#endif
+  "layout(location = 0) in vec2 aPosition;\n"
+  "uniform vec2 uSize;\n"
+  "out vec2 vPosition;\n"
+  "void main() {\n"
+  "  vPosition = aPosition;\n"
+  "  gl_Position = vec4(aPosition.x / uSize.x * 2.0 - 1.0, 1.0 - aPosition.y / uSize.y * 2.0, 0.0, 1.0);\n"
+  "}\n";
+
+const char overlay_fragment_shader[] =
+#ifdef __APPLE__
+  "#version 330 core\n"
+#else
+  "#version 300 es\n"
+  "precision highp float;\n"
+#endif
+  "uniform vec4 uColor;\n"
+  "uniform sampler2D uGradients;\n"
+  "uniform float uGradientRow;\n"
+  "uniform vec2 uGradientY;\n"
+  "in vec2 vPosition;\n"
+  "out vec4 colorOut;\n"
+  "void main() {\n"
+  "  if (uGradientRow < 0.0) {\n"
+  "    colorOut = uColor;\n"
+  "    return;\n"
+  "  }\n"
+  "  float t = clamp((vPosition.y - uGradientY.x) / (uGradientY.y - uGradientY.x), 0.0, 1.0);\n"
+  // GRADIENT_SIZE and MAX_GRADIENTS
+  "  colorOut = texture(uGradients, vec2((t * 255.0 + 0.5) / 256.0, (uGradientRow + 0.5) / 16.0));\n"
+  "}\n";
+
+void premultiplied(const QColor &c, float out[4]) {
+  const float a = c.alphaF();
+  out[0] = c.redF() * a;
+  out[1] = c.greenF() * a;
+  out[2] = c.blueF() * a;
+  out[3] = a;
+}
+
+// the stops of the gradient sampled at GRADIENT_SIZE points, pad spread like QPainter's default
+void bake_gradient(QGradientStops stops, uint8_t *row) {
+  if (stops.empty()) {
+    // what QPainter draws for a gradient without stops
+    stops = {{0.0, Qt::black}, {1.0, Qt::white}};
+  }
+  for (int i = 0; i < GRADIENT_SIZE; i++) {
+    const qreal t = i / (GRADIENT_SIZE - 1.0);
+    auto next = std::lower_bound(stops.begin(), stops.end(), t, [](const QGradientStop &s, qreal v) { return s.first < v; });
+    float c[4];
+    if (next == stops.begin() || next == stops.end()) {
+      premultiplied(next == stops.end() ? stops.back().second : next->second, c);
+    } else {
+      auto prev = next - 1;
+      const float f = next->first > prev->first ? (t - prev->first) / (next->first - prev->first) : 1.0;
+      float c0[4], c1[4];
+      premultiplied(prev->second, c0);
+      premultiplied(next->second, c1);
+      for (int j = 0; j < 4; j++) c[j] = c0[j] + (c1[j] - c0[j]) * f;
+    }
+    for (int j = 0; j < 4; j++) {
+      row[i * 4 + j] = std::clamp(c[j] * 255.0f + 0.5f, 0.0f, 255.0f);
+    }
+  }
+}
+
+}  // namespace
+
+void OverlayRenderer::cleanup() {
+  if (vao) {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteTextures(1, &gradient_texture);
+    vao = vbo = gradient_texture = 0;
+  }
+  program.reset();
+}
+
+void OverlayRenderer::initialize() {
+  program = std::make_unique<QOpenGLShaderProgram>();
+  bool ret = program->addShaderFromSourceCode(QOpenGLShader::Vertex, overlay_vertex_shader);
+  assert(ret);
+  ret = program->addShaderFromSourceCode(QOpenGLShader::Fragment, overlay_fragment_shader);
+  assert(ret);
+  program->link();
+
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (const void *)0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindVertexArray(0);
+
+  glGenTextures(1, &gradient_texture);
+  glBindTexture(GL_TEXTURE_2D, gradient_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GRADIENT_SIZE, MAX_GRADIENTS, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void OverlayRenderer::begin(int w, int h) {
+  width = w;
+  height = h;
+}
+
+void OverlayRenderer::fill(std::initializer_list<const QPolygonF *> polys, const QBrush &brush) {
+  QRectF bounds;
+  const int first_polygon = polygons.size();
+  for (const QPolygonF *p : polys) {
+    if (p->size() < 3) continue;
+    polygons.push_back({(int)vertices.size() / 2, (int)p->size()});
+    for (const QPointF &pt : *p) {
+      vertices.push_back(pt.x());
+      vertices.push_back(pt.y());
+    }
+    bounds |= p->boundingRect();
+  }
+  if ((int)polygons.size() == first_polygon) return;
+
+  Fill f = {.first_polygon = first_polygon, .polygon_count = (int)polygons.size() - first_polygon};
+  f.cover_first = vertices.size() / 2;
+  for (const QPointF &pt : {bounds.topLeft(), bounds.topRight(), bounds.bottomRight(), bounds.bottomLeft()}) {
+    vertices.push_back(pt.x());
+    vertices.push_back(pt.y());
+  }
+
+  if (brush.style() == Qt::LinearGradientPattern && flat) {
+    const QGradientStops stops = brush.gradient()->stops();
+    premultiplied(stops[stops.size() / 2].second, f.color);
+  } else if (brush.style() == Qt::LinearGradientPattern) {
+    if (gradients.size() == (size_t)GRADIENT_SIZE * 4 * MAX_GRADIENTS) {
+      // the vertices stay, flush only draws the fills that are done
+      flush();
+    }
+    const QLinearGradient *g = static_cast<const QLinearGradient *>(brush.gradient());
+    f.gradient_row = gradients.size() / (GRADIENT_SIZE * 4);
+    f.gradient_y[0] = g->start().y();
+    f.gradient_y[1] = g->finalStop().y();
+    gradients.resize(gradients.size() + GRADIENT_SIZE * 4);
+    bake_gradient(g->stops(), &gradients[f.gradient_row * GRADIENT_SIZE * 4]);
+  } else {
+    premultiplied(brush.color(), f.color);
+  }
+  fills.push_back(f);
+}
+
+void OverlayRenderer::end() {
+  flush();
+  vertices.clear();
+  polygons.clear();
+}
+
+void OverlayRenderer::flush() {
+  if (fills.empty()) return;
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  const size_t size = vertices.size() * sizeof(float);
+  if (size > vbo_size) {
+    vbo_size = std::max(size, vbo_size * 2);
+    glBufferData(GL_ARRAY_BUFFER, vbo_size, nullptr, GL_STREAM_DRAW);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, gradient_texture);
+  if (!gradients.empty()) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GRADIENT_SIZE, gradients.size() / (GRADIENT_SIZE * 4), GL_RGBA, GL_UNSIGNED_BYTE, gradients.data());
+  }
+
+  program->bind();
+  program->setUniformValue("uSize", (float)width, (float)height);
+  program->setUniformValue("uGradients", 0);
+  const int color_loc = program->uniformLocation("uColor");
+  const int row_loc = program->uniformLocation("uGradientRow");
+  const int gradient_y_loc = program->uniformLocation("uGradientY");
+
+  glBindVertexArray(vao);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_STENCIL_TEST);
+  glStencilMask(1);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_SCISSOR_TEST);
+  glDisable(GL_CULL_FACE);
+  for (const Fill &f : fills) {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glStencilFunc(GL_ALWAYS, 0, 1);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+    for (int i = f.first_polygon; i < f.first_polygon + f.polygon_count; i++) {
+      glDrawArrays(GL_TRIANGLE_FAN, polygons[i].first, polygons[i].second);
+    }
+
+    // the cover puts the stencil back to 0 for the next fill
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glStencilFunc(GL_NOTEQUAL, 0, 1);
+    glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
+    glUniform4fv(color_loc, 1, f.color);
+    glUniform1f(row_loc, f.gradient_row);
+    glUniform2fv(gradient_y_loc, 1, f.gradient_y);
+    glDrawArrays(GL_TRIANGLE_FAN, f.cover_first, 4);
+  }
+  glDisable(GL_STENCIL_TEST);
+  glDisable(GL_BLEND);
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  program->release();
+
+  fills.clear();
+  gradients.clear();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <QBrush>
+#include <QOpenGLShaderProgram>
+#include <QPolygonF>
+#include <QRectF>
+
+// Fills the onroad overlay polygons with GL, in the context of the widget that paints
+// them. A fill draws every polygon as a triangle fan that inverts the stencil, then
+// covers their bounds where the stencil is set, which is QPainter's odd-even fill for
+// any polygon and holes, with the edges antialiased by the multisampled target. The
+// fills of a frame are batched, their vertices go up in one buffer and the gradients
+// in one texture, a row per fill.
+// Brushes are a color or a vertical QLinearGradient, the only ones onroad uses.
+class OverlayRenderer {
+public:
+  // both with the widget's context current, from its initializeGL() and destructor
+  void initialize();
+  void cleanup();
+
+  // in the widget's logical coordinates, between QPainter::beginNativePainting() and
+  // endNativePainting() if a painter is active
+  void begin(int width, int height);
+  void fill(std::initializer_list<const QPolygonF *> polygons, const QBrush &brush);
+  void fill(const QPolygonF &polygon, const QBrush &brush) { fill({&polygon}, brush); }
+  void end();
+  // gradients are filled with the color of their middle stop, no lookup per pixel
+  void setFlat(bool flat) { this->flat = flat; }
+
+private:
+  struct Fill {
+    int first_polygon, polygon_count;
+    int cover_first;  // the 4 vertices of the bounds
+    float color[4] = {};  // premultiplied
+    int gradient_row = -1;
+    float gradient_y[2] = {};  // where the gradient is at 0 and at 1
+  };
+
+  void flush();
+
+  std::unique_ptr<QOpenGLShaderProgram> program;
+  unsigned int vao = 0, vbo = 0, gradient_texture = 0;
+  size_t vbo_size = 0;
+  int width = 0, height = 0;
+  bool flat = false;
+
+  std::vector<float> vertices;  // x, y
+  std::vector<std::pair<int, int>> polygons;  // first vertex, count
+  std::vector<Fill> fills;
+  std::vector<uint8_t> gradients;  // RGBA rows, premultiplied
+};
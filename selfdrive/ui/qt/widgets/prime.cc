@@ -255,14 +255,13 @@ SetupWidget::SetupWidget(QWidget* parent) : QFrame(parent) {
     QString url = CommaApi::BASE_URL + "/v1.1/devices/" + *dongleId + "/";
     RequestRepeater* repeater = new RequestRepeater(this, url, "ApiCache_Device", 5);
 
-    QObject::connect(repeater, &RequestRepeater::requestDone, this, &SetupWidget::replyFinished);
+    QObject::connect(repeater, &RequestRepeater::requestJson, this, &SetupWidget::replyFinished);
   }
 }
 
-void SetupWidget::replyFinished(const QString &response, bool success) {
+void SetupWidget::replyFinished(const QJsonDocument &doc, bool success) {
   if (!success) return;
 
-  QJsonDocument doc = QJsonDocument::fromJson(response.toUtf8());
   if (doc.isNull()) {
     qDebug() << "JSON Parse failed on getting pairing and prime status";
     return;
@@ -69,5 +69,5 @@ private:
   PrimeUserWidget *primeUser;
 
 private slots:
-  void replyFinished(const QString &response, bool success);
+  void replyFinished(const QJsonDocument &doc, bool success);
 };
@@ -3,6 +3,7 @@
 #include <QFontDatabase>
 
 #include "system/hardware/hw.h"
+#include "selfdrive/ui/profiler.h"
 
 MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
   main_layout = new QStackedLayout(this);
@@ -12,6 +13,7 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
   main_layout->addWidget(homeWindow);
   QObject::connect(homeWindow, &HomeWindow::openSettings, this, &MainWindow::openSettings);
   QObject::connect(homeWindow, &HomeWindow::closeSettings, this, &MainWindow::closeSettings);
+  uiStartupPhase("home_window");
 
   settingsWindow = new SettingsWindow(this);
   main_layout->addWidget(settingsWindow);
@@ -23,6 +25,7 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
   QObject::connect(settingsWindow, &SettingsWindow::showDriverView, [=] {
     homeWindow->showDriverView(true);
   });
+  uiStartupPhase("settings_window");
 
   onboardingWindow = new OnboardingWindow(this);
   main_layout->addWidget(onboardingWindow);
@@ -32,6 +35,7 @@ MainWindow::MainWindow(QWidget *parent) : QWidget(parent) {
   if (!onboardingWindow->completed()) {
     main_layout->setCurrentWidget(onboardingWindow);
   }
+  uiStartupPhase("onboarding_window");
 
   QObject::connect(uiState(), &UIState::offroadTransition, [=](bool offroad) {
     updateFrogPilotParams();
@@ -0,0 +1,254 @@
+#include "selfdrive/ui/soundd/mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "common/swaglog.h"
+#include "common/util.h"
+
+namespace {
+
+// what pulse asks for at a time, and what it keeps queued
+const pa_usec_t PERIOD_US = 10000;
+const pa_usec_t TARGET_LATENCY_US = 2 * PERIOD_US;
+
+const pa_sample_spec SAMPLE_SPEC = {.format = PA_SAMPLE_S16LE, .rate = AudioMixer::SAMPLE_RATE, .channels = 1};
+
+template <typename T>
+T read_le(const std::string &data, size_t pos) {
+  T v;
+  memcpy(&v, data.data() + pos, sizeof(T));
+  return v;
+}
+
+// the PCM of a 16 bit wav, downmixed and resampled to SAMPLE_SPEC
+bool decode_wav(const std::string &data, std::vector<int16_t> &out) {
+  if (data.size() < 12 || data.compare(0, 4, "RIFF") != 0 || data.compare(8, 4, "WAVE") != 0) return false;
+
+  uint16_t format = 0, channels = 0, bits = 0;
+  uint32_t rate = 0;
+  const char *pcm = nullptr;
+  size_t pcm_size = 0;
+  for (size_t pos = 12; pos + 8 <= data.size();) {
+    const uint32_t size = read_le<uint32_t>(data, pos + 4);
+    const size_t body = pos + 8;
+    if (size > data.size() - body) return false;
+    if (data.compare(pos, 4, "fmt ") == 0 && size >= 16) {
+      format = read_le<uint16_t>(data, body);
+      channels = read_le<uint16_t>(data, body + 2);
+      rate = read_le<uint32_t>(data, body + 4);
+      bits = read_le<uint16_t>(data, body + 14);
+    } else if (data.compare(pos, 4, "data") == 0) {
+      pcm = data.data() + body;
+      pcm_size = size;
+    }
+    pos = body + size + (size & 1);  // chunks are padded to even sizes
+  }
+  // 0xfffe is WAVE_FORMAT_EXTENSIBLE, which is still PCM at 16 bits
+  if ((format != 1 && format != 0xfffe) || bits != 16 || channels == 0 || rate == 0 || !pcm) return false;
+
+  const size_t frames = pcm_size / (2 * channels);
+  std::vector<float> mono(frames);
+  for (size_t i = 0; i < frames; ++i) {
+    int sum = 0;
+    for (int c = 0; c < channels; ++c) {
+      int16_t s;
+      memcpy(&s, pcm + (i * channels + c) * 2, 2);
+      sum += s;
+    }
+    mono[i] = (float)sum / channels;
+  }
+
+  const size_t out_frames = (uint64_t)frames * SAMPLE_SPEC.rate / rate;
+  out.resize(out_frames);
+  for (size_t i = 0; i < out_frames; ++i) {
+    const double t = (double)i * rate / SAMPLE_SPEC.rate;
+    const size_t j = std::min((size_t)t, frames - 1);
+    const size_t k = std::min(j + 1, frames - 1);
+    out[i] = std::nearbyint(mono[j] + (mono[k] - mono[j]) * (t - j));
+  }
+  return !out.empty();
+}
+
+}  // namespace
+
+AudioMixer::AudioMixer() {
+  mainloop = pa_threaded_mainloop_new();
+  pa_threaded_mainloop_lock(mainloop);
+  connect();
+  pa_threaded_mainloop_unlock(mainloop);
+  pa_threaded_mainloop_start(mainloop);
+}
+
+AudioMixer::~AudioMixer() {
+  pa_threaded_mainloop_lock(mainloop);
+  exiting = true;
+  if (stream) {
+    pa_stream_disconnect(stream);
+    pa_stream_unref(stream);
+  }
+  pa_context_disconnect(context);
+  pa_context_unref(context);
+  pa_threaded_mainloop_unlock(mainloop);
+  pa_threaded_mainloop_stop(mainloop);
+  pa_threaded_mainloop_free(mainloop);
+}
+
+void AudioMixer::connect() {
+  context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "soundd");
+  pa_context_set_state_callback(context, contextStateCallback, this);
+  // waits for the server if it isn't up yet
+  pa_context_connect(context, nullptr, PA_CONTEXT_NOFAIL, nullptr);
+}
+
+void AudioMixer::contextStateCallback(pa_context *c, void *userdata) {
+  AudioMixer *m = (AudioMixer *)userdata;
+  switch (pa_context_get_state(c)) {
+    case PA_CONTEXT_READY:
+      m->openStream();
+      m->updateSinkVolume();
+      break;
+    case PA_CONTEXT_FAILED:
+    case PA_CONTEXT_TERMINATED:
+      if (!m->exiting) {
+        LOGE("pulseaudio connection lost: %s", pa_strerror(pa_context_errno(c)));
+        // not from a callback of the context that's replaced
+        pa_mainloop_api *api = pa_threaded_mainloop_get_api(m->mainloop);
+        api->defer_new(api, reconnectCallback, m);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void AudioMixer::reconnectCallback(pa_mainloop_api *api, pa_defer_event *e, void *userdata) {
+  AudioMixer *m = (AudioMixer *)userdata;
+  api->defer_free(e);
+  if (m->stream) {
+    pa_stream_unref(m->stream);
+    m->stream = nullptr;
+  }
+  pa_context_unref(m->context);
+  m->connect();
+}
+
+void AudioMixer::openStream() {
+  stream = pa_stream_new(context, "alerts", &SAMPLE_SPEC, nullptr);
+  pa_stream_set_write_callback(stream, writeCallback, this);
+
+  pa_buffer_attr attr = {};
+  attr.maxlength = (uint32_t)-1;
+  attr.tlength = pa_usec_to_bytes(TARGET_LATENCY_US, &SAMPLE_SPEC);
+  attr.prebuf = (uint32_t)-1;
+  attr.minreq = pa_usec_to_bytes(PERIOD_US, &SAMPLE_SPEC);
+  attr.fragsize = (uint32_t)-1;
+  if (pa_stream_connect_playback(stream, nullptr, &attr, PA_STREAM_ADJUST_LATENCY, nullptr, nullptr) < 0) {
+    LOGE("failed to open the pulseaudio stream: %s", pa_strerror(pa_context_errno(context)));
+  }
+}
+
+void AudioMixer::writeCallback(pa_stream *s, size_t nbytes, void *userdata) {
+  AudioMixer *m = (AudioMixer *)userdata;
+  void *data = nullptr;
+  if (pa_stream_begin_write(s, &data, &nbytes) < 0 || !data) return;
+  m->mix((int16_t *)data, nbytes / sizeof(int16_t));
+  pa_stream_write(s, data, nbytes, nullptr, 0, PA_SEEK_RELATIVE);
+}
+
+void AudioMixer::mix(int16_t *out, size_t count) {
+  mix_buf.assign(count, 0.0f);
+  for (auto &[id, s] : sounds) {
+    for (size_t i = 0; s.playing && i < count;) {
+      const size_t n = std::min(count - i, s.samples.size() - s.pos);
+      for (size_t j = 0; j < n; ++j) {
+        mix_buf[i + j] += s.samples[s.pos + j] * s.volume;
+      }
+      i += n;
+      s.pos += n;
+      if (s.pos == s.samples.size()) {
+        s.pos = 0;
+        if (s.loops_remaining != LOOP_INFINITE && --s.loops_remaining <= 0) {
+          s.playing = false;
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = std::clamp(mix_buf[i], -32768.0f, 32767.0f);
+  }
+}
+
+bool AudioMixer::load(int id, const std::string &path) {
+  std::vector<int16_t> samples;
+  if (!decode_wav(util::read_file(path), samples)) {
+    LOGE("failed to load %s", path.c_str());
+    return false;
+  }
+
+  pa_threaded_mainloop_lock(mainloop);
+  sounds[id] = {.samples = std::move(samples)};
+  pa_threaded_mainloop_unlock(mainloop);
+  return true;
+}
+
+void AudioMixer::play(int id, int loops, float volume) {
+  pa_threaded_mainloop_lock(mainloop);
+  auto it = sounds.find(id);
+  if (it != sounds.end()) {
+    const bool silent = std::none_of(sounds.begin(), sounds.end(), [](auto &s) { return s.second.playing; });
+    Sound &s = it->second;
+    s.pos = 0;
+    s.loops_remaining = loops == LOOP_INFINITE ? LOOP_INFINITE : std::max(loops, 1);
+    s.volume = volume;
+    s.playing = true;
+    // what's queued is silence, drop it and pulse asks for the sound right away
+    if (silent && stream && pa_stream_get_state(stream) == PA_STREAM_READY) {
+      pa_operation *o = pa_stream_flush(stream, nullptr, nullptr);
+      if (o) pa_operation_unref(o);
+    }
+  }
+  pa_threaded_mainloop_unlock(mainloop);
+}
+
+void AudioMixer::stop(int id) {
+  pa_threaded_mainloop_lock(mainloop);
+  auto it = sounds.find(id);
+  if (it != sounds.end()) {
+    it->second.playing = false;
+  }
+  pa_threaded_mainloop_unlock(mainloop);
+}
+
+bool AudioMixer::repeating(int id) {
+  pa_threaded_mainloop_lock(mainloop);
+  auto it = sounds.find(id);
+  const bool ret = it != sounds.end() && it->second.playing &&
+                   (it->second.loops_remaining > 1 || it->second.loops_remaining == LOOP_INFINITE);
+  pa_threaded_mainloop_unlock(mainloop);
+  return ret;
+}
+
+void AudioMixer::setSinkVolume(float volume) {
+  pa_threaded_mainloop_lock(mainloop);
+  sink_volume = pa_sw_volume_from_linear(volume);
+  updateSinkVolume();
+  pa_threaded_mainloop_unlock(mainloop);
+}
+
+// the sink's channels are needed for its volume
+void AudioMixer::updateSinkVolume() {
+  if (sink_volume == PA_VOLUME_INVALID || pa_context_get_state(context) != PA_CONTEXT_READY) return;
+  pa_operation *o = pa_context_get_sink_info_by_name(context, "@DEFAULT_SINK@", sinkInfoCallback, this);
+  if (o) pa_operation_unref(o);
+}
+
+void AudioMixer::sinkInfoCallback(pa_context *c, const pa_sink_info *info, int eol, void *userdata) {
+  if (eol || !info) return;
+  AudioMixer *m = (AudioMixer *)userdata;
+  pa_cvolume volume;
+  pa_cvolume_set(&volume, info->volume.channels, m->sink_volume);
+  pa_operation *o = pa_context_set_sink_volume_by_index(c, info->index, &volume, nullptr, nullptr);
+  if (o) pa_operation_unref(o);
+}
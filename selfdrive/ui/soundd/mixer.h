@@ -0,0 +1,59 @@
+#pragma once
+
+#include <pulse/pulseaudio.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Plays the alert sounds through a PulseAudio stream that stays open, mixed in pulse's
+// thread. The wavs are decoded once, playing one only moves its cursor, and the silence
+// that was queued is dropped when it starts, so it's heard within a period of the stream.
+// The volume is the default sink's, set through the API instead of running pactl.
+class AudioMixer {
+public:
+  static const int SAMPLE_RATE = 48000;
+  static const int LOOP_INFINITE = -2;  // like QSoundEffect::Infinite
+
+  AudioMixer();
+  ~AudioMixer();
+
+  // a 16 bit PCM wav, as the sound id. What was loaded as id before is replaced
+  bool load(int id, const std::string &path);
+  // loops is the number of times it plays, 0 is once as well
+  void play(int id, int loops, float volume);
+  void stop(int id);
+  // whether it plays on after the current loop
+  bool repeating(int id);
+  // 0 to 1, linear
+  void setSinkVolume(float volume);
+
+private:
+  struct Sound {
+    std::vector<int16_t> samples;  // mono at SAMPLE_RATE
+    size_t pos = 0;
+    int loops_remaining = 0;  // with the current one
+    float volume = 1.0;
+    bool playing = false;
+  };
+
+  static void contextStateCallback(pa_context *c, void *userdata);
+  static void reconnectCallback(pa_mainloop_api *api, pa_defer_event *e, void *userdata);
+  static void writeCallback(pa_stream *s, size_t nbytes, void *userdata);
+  static void sinkInfoCallback(pa_context *c, const pa_sink_info *info, int eol, void *userdata);
+  void connect();
+  void openStream();
+  void updateSinkVolume();
+  void mix(int16_t *out, size_t count);
+
+  pa_threaded_mainloop *mainloop = nullptr;
+  pa_context *context = nullptr;
+  pa_stream *stream = nullptr;
+  bool exiting = false;
+
+  // all of it is used with the mainloop locked
+  std::map<int, Sound> sounds;
+  std::vector<float> mix_buf;
+  pa_volume_t sink_volume = PA_VOLUME_INVALID;
+};
@@ -3,7 +3,6 @@
 #include <cmath>
 
 #include <QAudio>
-#include <QAudioDeviceInfo>
 #include <QDebug>
 
 #include "cereal/messaging/messaging.h"
@@ -13,8 +12,6 @@
 // TODO: detect when we can't display the UI
 
 Sound::Sound(QObject *parent) : sm({"controlsState", "microphone"}) {
-  qInfo() << "default audio device: " << QAudioDeviceInfo::defaultOutputDevice().deviceName();
-
   // FrogPilot variables
   isSilentMode = params.getBool("SilentMode");
 
@@ -33,20 +30,29 @@ Sound::Sound(QObject *parent) : sm({"controlsState", "microphone"}) {
     soundPaths[key] = base;
   }
 
-  for (auto &[alert, fn, loops, volume] : sound_list) {
-    QSoundEffect *s = new QSoundEffect(this);
-    QObject::connect(s, &QSoundEffect::statusChanged, [=]() {
-      assert(s->status() != QSoundEffect::Error);
-    });
-    s->setSource(QUrl::fromLocalFile(soundPaths[customSounds] + "/" + fn));
-    s->setVolume(isSilentMode ? 0 : volume);
-    sounds[alert] = {s, loops};
-  }
+  loadSounds();
 
-  QTimer *timer = new QTimer(this);
-  QObject::connect(timer, &QTimer::timeout, this, &Sound::update);
   QObject::connect(uiState(), &UIState::uiUpdateFrogPilotParams, this, &Sound::updateFrogPilotParams);
-  timer->start(1000 / UI_FREQ);
+  // the alerts are played as soon as controlsState has them, not on a timer
+  update_thread = std::thread([this] {
+    util::set_thread_name("soundd_update");
+    while (!exiting) {
+      sm.update(1000 / UI_FREQ);
+      update();
+    }
+  });
+}
+
+Sound::~Sound() {
+  exiting = true;
+  update_thread.join();
+}
+
+void Sound::loadSounds() {
+  for (auto &[alert, fn, loops, volume] : sound_list) {
+    bool ret = mixer.load((int)alert, (soundPaths[customSounds] + "/" + fn).toStdString());
+    assert(ret);
+  }
 }
 
 void Sound::updateFrogPilotParams(const UIState &s) {
@@ -54,15 +60,10 @@ void Sound::updateFrogPilotParams(const UIState &s) {
   customSounds = isCustomTheme ? params.getInt("CustomSounds") : 0;
   isSilentMode = params.getBool("SilentMode");
 
-  for (auto &[alert, fn, loops, volume] : sound_list) {
-    auto &[s, _] = sounds[alert];
-    s->setSource(QUrl::fromLocalFile(soundPaths[customSounds] + "/" + fn));
-    s->setVolume(isSilentMode ? 0 : volume);
-  }
+  loadSounds();
 }
 
 void Sound::update() {
-  sm.update(0);
 
   // scale volume using ambient noise level
   if (sm.updated("microphone")) {
@@ -70,7 +71,7 @@ void Sound::update() {
     volume = QAudio::convertVolume(volume, QAudio::LogarithmicVolumeScale, QAudio::LinearVolumeScale);
     // set volume on changes
     if (std::exchange(current_volume, std::nearbyint(volume * 10)) != current_volume) {
-      Hardware::set_volume(volume);
+      mixer.setSinkVolume(util::map_val(volume, 0.f, 1.f, Hardware::MIN_VOLUME, Hardware::MAX_VOLUME));
     }
   }
 
@@ -81,18 +82,19 @@ void Sound::setAlert(const Alert &alert) {
   if (!current_alert.equal(alert)) {
     current_alert = alert;
     // stop sounds
-    for (auto &[s, loops] : sounds) {
+    for (auto &[sound, fn, loops, volume] : sound_list) {
       // Only stop repeating sounds
-      if (s->loopsRemaining() > 1 || s->loopsRemaining() == QSoundEffect::Infinite) {
-        s->stop();
+      if (mixer.repeating((int)sound)) {
+        mixer.stop((int)sound);
       }
     }
 
     // play sound
-    if (alert.sound != AudibleAlert::NONE) {
-      auto &[s, loops] = sounds[alert.sound];
-      s->setLoopCount(loops);
-      s->play();
+    for (auto &[sound, fn, loops, volume] : sound_list) {
+      if (sound == alert.sound) {
+        mixer.play((int)sound, loops, isSilentMode ? 0 : volume);
+        break;
+      }
     }
   }
 }
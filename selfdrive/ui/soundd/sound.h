@@ -1,12 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
 #include <tuple>
 
-#include <QMap>
-#include <QSoundEffect>
 #include <QString>
 
 #include "system/hardware/hw.h"
+#include "selfdrive/ui/soundd/mixer.h"
 #include "selfdrive/ui/ui.h"
 
 
@@ -19,34 +20,39 @@ const std::tuple<AudibleAlert, QString, int, float> sound_list[] = {
   {AudibleAlert::REFUSE, "refuse.wav", 0, MAX_VOLUME},
 
   {AudibleAlert::PROMPT, "prompt.wav", 0, MAX_VOLUME},
-  {AudibleAlert::PROMPT_REPEAT, "prompt.wav", QSoundEffect::Infinite, MAX_VOLUME},
-  {AudibleAlert::PROMPT_DISTRACTED, "prompt_distracted.wav", QSoundEffect::Infinite, MAX_VOLUME},
+  {AudibleAlert::PROMPT_REPEAT, "prompt.wav", AudioMixer::LOOP_INFINITE, MAX_VOLUME},
+  {AudibleAlert::PROMPT_DISTRACTED, "prompt_distracted.wav", AudioMixer::LOOP_INFINITE, MAX_VOLUME},
 
-  {AudibleAlert::WARNING_SOFT, "warning_soft.wav", QSoundEffect::Infinite, MAX_VOLUME},
-  {AudibleAlert::WARNING_IMMEDIATE, "warning_immediate.wav", QSoundEffect::Infinite, MAX_VOLUME},
+  {AudibleAlert::WARNING_SOFT, "warning_soft.wav", AudioMixer::LOOP_INFINITE, MAX_VOLUME},
+  {AudibleAlert::WARNING_IMMEDIATE, "warning_immediate.wav", AudioMixer::LOOP_INFINITE, MAX_VOLUME},
 };
 
 class Sound : public QObject {
 public:
   explicit Sound(QObject *parent = 0);
+  ~Sound();
 
 public slots:
   // FrogPilot slots
   void updateFrogPilotParams(const UIState &s);
 
 protected:
+  void loadSounds();
+  // from update_thread, it wakes up with every message
   void update();
   void setAlert(const Alert &alert);
 
   SubMaster sm;
   Alert current_alert = {};
-  QMap<AudibleAlert, QPair<QSoundEffect *, int>> sounds;
+  AudioMixer mixer;
   int current_volume = -1;
+  std::atomic<bool> exiting = false;
+  std::thread update_thread;
 
   // FrogPilot variables
   Params params;
   bool isCustomTheme;
-  bool isSilentMode;
+  std::atomic<bool> isSilentMode;
   int customSounds;
   std::unordered_map<int, QString> soundPaths;
 };
@@ -11,30 +11,86 @@
 #include "common/swaglog.h"
 #include "common/util.h"
 #include "common/watchdog.h"
+#include "selfdrive/ui/profiler.h"
 #include "system/hardware/hw.h"
 
 #define BACKLIGHT_DT 0.05
 #define BACKLIGHT_TS 10.00
 
+namespace {
+
+// Projects points in car space to full frame image space, with the camera matrices
+// multiplied out once for all the points of a frame.
+struct FrameProjection {
+  FrameProjection(const UIState *s) : car_space_transform(s->car_space_transform) {
+    const float margin = 500.0f;
+    clip_region = QRectF{-margin, -margin, s->fb_w + 2 * margin, s->fb_h + 2 * margin};
+    KE = matmul3(s->scene.wide_cam ? ECAM_INTRINSIC_MATRIX : FCAM_INTRINSIC_MATRIX,
+                 s->scene.wide_cam ? s->scene.view_from_wide_calib : s->scene.view_from_calib);
+  }
+
+  inline vec3 to_camera(float x, float y, float z) const {
+    return matvecmul3(KE, (vec3){{x, y, z}});
+  }
+
+  inline bool to_frame(const vec3 &KEp, QPointF *out) const {
+    QPointF point = car_space_transform.map(QPointF{KEp.v[0] / KEp.v[2], KEp.v[1] / KEp.v[2]});
+    if (clip_region.contains(point)) {
+      *out = point;
+      return true;
+    }
+    return false;
+  }
+
+  mat3 KE;  // intrinsics * view_from_calib
+  QTransform car_space_transform;
+  QRectF clip_region;
+};
+
 // Projects a point in car to space to the corresponding point in full frame
 // image space.
-static bool calib_frame_to_full_frame(const UIState *s, float in_x, float in_y, float in_z, QPointF *out) {
-  const float margin = 500.0f;
-  const QRectF clip_region{-margin, -margin, s->fb_w + 2 * margin, s->fb_h + 2 * margin};
+bool calib_frame_to_full_frame(const FrameProjection &proj, float in_x, float in_y, float in_z, QPointF *out) {
+  return proj.to_frame(proj.to_camera(in_x, in_y, in_z), out);
+}
 
-  const vec3 pt = (vec3){{in_x, in_y, in_z}};
-  const vec3 Ep = matvecmul3(s->scene.wide_cam ? s->scene.view_from_wide_calib : s->scene.view_from_calib, pt);
-  const vec3 KEp = matvecmul3(s->scene.wide_cam ? ECAM_INTRINSIC_MATRIX : FCAM_INTRINSIC_MATRIX, Ep);
+void project_line(const FrameProjection &proj, const cereal::XYZTData::Reader &line,
+                  float y_off, float z_off, QPolygonF *pvd, int max_idx, bool allow_invert) {
+  const auto line_x = line.getX(), line_y = line.getY(), line_z = line.getZ();
+  std::array<QPointF, TRAJECTORY_SIZE> left_points, right_points;
+  int n = 0;
 
-  // Project.
-  QPointF point = s->car_space_transform.map(QPointF{KEp.v[0] / KEp.v[2], KEp.v[1] / KEp.v[2]});
-  if (clip_region.contains(point)) {
-    *out = point;
-    return true;
+  // the sides are the center -+ y_off, the projection is linear so that's the center's
+  // projection -+ y_off times the y column of KE
+  const vec3 side = {{proj.KE.v[1] * y_off, proj.KE.v[4] * y_off, proj.KE.v[7] * y_off}};
+  for (int i = 0; i <= max_idx && i < TRAJECTORY_SIZE; i++) {
+    // highly negative x positions  are drawn above the frame and cause flickering, clip to zy plane of camera
+    if (line_x[i] < 0) continue;
+    const vec3 center = proj.to_camera(line_x[i], line_y[i], line_z[i] + z_off);
+    const vec3 l_pt = {{center.v[0] - side.v[0], center.v[1] - side.v[1], center.v[2] - side.v[2]}};
+    const vec3 r_pt = {{center.v[0] + side.v[0], center.v[1] + side.v[1], center.v[2] + side.v[2]}};
+    QPointF left, right;
+    bool l = proj.to_frame(l_pt, &left);
+    bool r = proj.to_frame(r_pt, &right);
+    if (l && r) {
+      // For wider lines the drawn polygon will "invert" when going over a hill and cause artifacts
+      if (!allow_invert && n && left.y() > left_points[n - 1].y()) {
+        continue;
+      }
+      left_points[n] = left;
+      right_points[n] = right;
+      n++;
+    }
   }
-  return false;
+
+  // left side front to back, then the right side back to front. The polygon keeps its
+  // capacity, after the first frame this doesn't allocate
+  pvd->resize(2 * n);
+  std::copy(left_points.begin(), left_points.begin() + n, pvd->begin());
+  std::reverse_copy(right_points.begin(), right_points.begin() + n, pvd->begin() + n);
 }
 
+}  // namespace
+
 int get_path_length_idx(const cereal::XYZTData::Reader &line, const float path_height) {
   const auto line_x = line.getX();
   int max_idx = 0;
@@ -45,44 +101,37 @@ int get_path_length_idx(const cereal::XYZTData::Reader &line, const float path_h
 }
 
 void update_leads(UIState *s, const cereal::RadarState::Reader &radar_state, const cereal::XYZTData::Reader &line) {
+  const FrameProjection proj(s);
   for (int i = 0; i < 2; ++i) {
     auto lead_data = (i == 0) ? radar_state.getLeadOne() : radar_state.getLeadTwo();
     if (lead_data.getStatus()) {
       float z = line.getZ()[get_path_length_idx(line, lead_data.getDRel())];
-      calib_frame_to_full_frame(s, lead_data.getDRel(), -lead_data.getYRel(), z + 1.22, &s->scene.lead_vertices[i]);
+      calib_frame_to_full_frame(proj, lead_data.getDRel(), -lead_data.getYRel(), z + 1.22, &s->scene.lead_vertices[i]);
     }
   }
 }
 
 void update_line_data(const UIState *s, const cereal::XYZTData::Reader &line,
                       float y_off, float z_off, QPolygonF *pvd, int max_idx, bool allow_invert=true) {
-  const auto line_x = line.getX(), line_y = line.getY(), line_z = line.getZ();
-  QPolygonF left_points, right_points;
-  left_points.reserve(max_idx + 1);
-  right_points.reserve(max_idx + 1);
-
-  for (int i = 0; i <= max_idx; i++) {
-    // highly negative x positions  are drawn above the frame and cause flickering, clip to zy plane of camera
-    if (line_x[i] < 0) continue;
-    QPointF left, right;
-    bool l = calib_frame_to_full_frame(s, line_x[i], line_y[i] - y_off, line_z[i] + z_off, &left);
-    bool r = calib_frame_to_full_frame(s, line_x[i], line_y[i] + y_off, line_z[i] + z_off, &right);
-    if (l && r) {
-      // For wider lines the drawn polygon will "invert" when going over a hill and cause artifacts
-      if (!allow_invert && left_points.size() && left.y() > left_points.back().y()) {
-        continue;
-      }
-      left_points.push_back(left);
-      right_points.push_front(right);
-    }
-  }
-  *pvd = left_points + right_points;
+  project_line(FrameProjection(s), line, y_off, z_off, pvd, max_idx, allow_invert);
 }
 
 void update_model(UIState *s,
                   const cereal::ModelDataV2::Reader &model,
                   const cereal::UiPlan::Reader &plan) {
   UIScene &scene = s->scene;
+  const SubMaster &sm = *(s->sm);
+  // the geometry only changes with its inputs, not every time the frame is painted
+  const ModelGeometryKey key = {
+    sm.rcv_frame("modelV2"), sm.rcv_frame("uiPlan"), sm.rcv_frame("radarState"), sm.rcv_frame("liveCalibration"),
+    scene.wide_cam, s->car_space_transform, s->fb_w, s->fb_h,
+    scene.custom_road_ui, scene.unlimited_road_ui_length, scene.blind_spot_path, scene.lane_line_width,
+    scene.road_edge_width, scene.path_width, scene.path_edge_width, scene.lane_width_left, scene.lane_width_right,
+  };
+  if (key == scene.model_geometry_key) return;
+  scene.model_geometry_key = key;
+
+  const FrameProjection proj(s);
   auto plan_position = plan.getPosition();
   if (plan_position.getX().size() < TRAJECTORY_SIZE){
     plan_position = model.getPosition();
@@ -96,7 +145,7 @@ void update_model(UIState *s,
   int max_idx = get_path_length_idx(lane_lines[0], max_distance);
   for (int i = 0; i < std::size(scene.lane_line_vertices); i++) {
     scene.lane_line_probs[i] = lane_line_probs[i];
-    update_line_data(s, lane_lines[i], scene.custom_road_ui ? scene.lane_line_width * scene.lane_line_probs[i] : 0.025 * scene.lane_line_probs[i], 0, &scene.lane_line_vertices[i], max_idx);
+    project_line(proj, lane_lines[i], scene.custom_road_ui ? scene.lane_line_width * scene.lane_line_probs[i] : 0.025 * scene.lane_line_probs[i], 0, &scene.lane_line_vertices[i], max_idx, true);
   }
 
   // update road edges
@@ -104,26 +153,26 @@ void update_model(UIState *s,
   const auto road_edge_stds = model.getRoadEdgeStds();
   for (int i = 0; i < std::size(scene.road_edge_vertices); i++) {
     scene.road_edge_stds[i] = road_edge_stds[i];
-    update_line_data(s, road_edges[i], scene.custom_road_ui ? scene.road_edge_width : 0.025, 0, &scene.road_edge_vertices[i], max_idx);
+    project_line(proj, road_edges[i], scene.custom_road_ui ? scene.road_edge_width : 0.025, 0, &scene.road_edge_vertices[i], max_idx, true);
   }
 
   // update path
-  auto lead_one = (*s->sm)["radarState"].getRadarState().getLeadOne();
+  auto lead_one = sm["radarState"].getRadarState().getLeadOne();
   if (lead_one.getStatus()) {
     const float lead_d = lead_one.getDRel() * 2.;
     max_distance = std::clamp((float)(lead_d - fmin(lead_d * 0.35, 10.)), 0.0f, max_distance);
   }
   max_idx = get_path_length_idx(plan_position, max_distance);
-  update_line_data(s, plan_position, scene.custom_road_ui ? scene.path_width * (1 - scene.path_edge_width / 100) : 0.9, 1.22, &scene.track_vertices, max_idx, false);
+  project_line(proj, plan_position, scene.custom_road_ui ? scene.path_width * (1 - scene.path_edge_width / 100) : 0.9, 1.22, &scene.track_vertices, max_idx, false);
 
   // update path edges
-  update_line_data(s, plan_position, scene.custom_road_ui ? scene.path_width : 0, 1.22, &scene.track_edge_vertices, max_idx, false);
+  project_line(proj, plan_position, scene.custom_road_ui ? scene.path_width : 0, 1.22, &scene.track_edge_vertices, max_idx, false);
 
   // update left adjacent path
-  update_line_data(s, lane_lines[4], scene.blind_spot_path ? scene.lane_width_left / 2 : 0, 0, &scene.track_left_adjacent_lane_vertices, max_idx);
+  project_line(proj, lane_lines[4], scene.blind_spot_path ? scene.lane_width_left / 2 : 0, 0, &scene.track_left_adjacent_lane_vertices, max_idx, true);
 
   // update right adjacent path
-  update_line_data(s, lane_lines[5], scene.blind_spot_path ? scene.lane_width_right / 2 : 0, 0, &scene.track_right_adjacent_lane_vertices, max_idx);
+  project_line(proj, lane_lines[5], scene.blind_spot_path ? scene.lane_width_right / 2 : 0, 0, &scene.track_right_adjacent_lane_vertices, max_idx, true);
 }
 
 void update_dmonitoring(UIState *s, const cereal::DriverStateV2::Reader &driverstate, float dm_fade_state, bool is_rhd) {
@@ -163,6 +212,28 @@ static void update_sockets(UIState *s) {
   s->sm->update(0);
 }
 
+static void update_render_quality(UIScene &scene, cereal::DeviceState::ThermalStatus ts) {
+  const RenderQuality target = ts == cereal::DeviceState::ThermalStatus::GREEN  ? RenderQuality::FULL
+                             : ts == cereal::DeviceState::ThermalStatus::YELLOW ? RenderQuality::REDUCED
+                                                                                : RenderQuality::MINIMAL;
+  const double t = millis_since_boot();
+  if (target > scene.render_quality) {
+    LOGW("render quality down to %s", render_quality_name(target));
+    scene.render_quality = target;
+    scene.render_quality_recover_t = 0;
+  } else if (target < scene.render_quality) {
+    if (scene.render_quality_recover_t == 0) {
+      scene.render_quality_recover_t = t;
+    } else if (t - scene.render_quality_recover_t > RENDER_QUALITY_RECOVER_S * 1000) {
+      LOGW("render quality back to %s", render_quality_name(target));
+      scene.render_quality = target;
+      scene.render_quality_recover_t = 0;
+    }
+  } else {
+    scene.render_quality_recover_t = 0;
+  }
+}
+
 static void update_state(UIState *s) {
   SubMaster &sm = *(s->sm);
   UIScene &scene = s->scene;
@@ -204,7 +275,7 @@ static void update_state(UIState *s) {
         }
       }
     }
-  } else if ((s->sm->frame - s->sm->rcv_frame("pandaStates")) > 5*UI_FREQ) {
+  } else if ((nanos_since_boot() - s->sm->rcv_time("pandaStates")) > 5e9) {
     scene.pandaType = cereal::PandaState::PandaType::UNKNOWN;
   }
   if (sm.updated("carParams")) {
@@ -270,6 +341,9 @@ static void update_state(UIState *s) {
     float scale = (cam_state.getSensor() == cereal::FrameData::ImageSensor::AR0231) ? 6.0f : 1.0f;
     scene.light_sensor = std::max(100.0f - scale * cam_state.getExposureValPercent(), 0.0f);
   }
+  if (sm.updated("deviceState")) {
+    update_render_quality(scene, sm["deviceState"].getDeviceState().getThermalStatus());
+  }
   scene.started = sm["deviceState"].getDeviceState().getStarted() && scene.ignition;
 }
 
@@ -342,12 +416,13 @@ void UIState::updateStatus() {
 }
 
 UIState::UIState(QObject *parent) : QObject(parent) {
-  sm = std::make_unique<SubMaster, const std::initializer_list<const char *>>({
+  // lazy, most services are only read on some frames
+  sm = std::make_unique<SubMaster>(std::vector<const char *>{
     "modelV2", "controlsState", "liveCalibration", "radarState", "deviceState", "roadCameraState",
     "pandaStates", "carParams", "driverMonitoringState", "carState", "liveLocationKalman", "driverStateV2",
     "wideRoadCameraState", "managerState", "navInstruction", "navRoute", "uiPlan", "carControl",
     "gpsLocationExternal", "lateralPlan", "longitudinalPlan"
-  });
+  }, std::vector<const char *>{}, nullptr, std::vector<const char *>{}, true);
 
   language = QString::fromStdString(params.get("LanguageSetting"));
   auto prime_value = params.get("PrimeType");
@@ -364,18 +439,38 @@ UIState::UIState(QObject *parent) : QObject(parent) {
 }
 
 void UIState::update() {
-  update_sockets(this);
-  update_state(this);
+  {
+    UI_PROFILE_SCOPE(UISection::SOCKETS);
+    update_sockets(this);
+  }
+  {
+    UI_PROFILE_SCOPE(UISection::STATE);
+    update_state(this);
+  }
   updateStatus();
 
-  if (sm->frame % UI_FREQ == 0) {
+  // Onroad the UI follows the model and the car, and the camera view paints on every
+  // frame it receives. Offroad there's only the slow services and the params, the
+  // widgets repaint when what they show changes, so it ticks at an idle rate.
+  const int freq = scene.started ? UI_FREQ : UI_IDLE_FREQ;
+  if (freq != update_freq) {
+    update_freq = freq;
+    timer->setInterval(1000 / update_freq);
+  }
+
+  if (sm->frame % update_freq == 0) {
     watchdog_kick(nanos_since_boot());
   }
   emit uiUpdate(*this);
 
+  // The memory params are only read again after something changed them
+  uint32_t memory_version = paramsMemory.version();
+  bool memory_changed = memory_version != params_memory_version;
+  params_memory_version = memory_version;
+
   // Update FrogPilot variables when they are changed
   static bool toggles_checked = false;
-  if (paramsMemory.getBool("FrogPilotTogglesUpdated")) {
+  if ((memory_changed || toggles_checked) && paramsMemory.getBool("FrogPilotTogglesUpdated")) {
     emit uiUpdateFrogPilotParams(*this);
     // Loop through twice so other parts of the code update first
     if (toggles_checked) {
@@ -388,10 +483,14 @@ void UIState::update() {
   }
 
   // FrogPilot live variables that need to be constantly checked
+  if (memory_changed) {
+    conditional_status = paramsMemory.getInt("ConditionalStatus");
+    scene.map_open = paramsMemory.getBool("MapOpen");
+    scene.road_name = QString::fromStdString(paramsMemory.get("RoadName"));
+  }
   if (scene.conditional_experimental) {
-    scene.conditional_status = paramsMemory.getInt("ConditionalStatus");
+    scene.conditional_status = conditional_status;
   }
-  scene.map_open = paramsMemory.getBool("MapOpen");
 }
 
 void UIState::setPrimeType(PrimeType type) {
@@ -434,7 +533,7 @@ void Device::resetInteractiveTimeout(int timeout) {
   if (timeout == -1) {
     timeout = (ignition_on ? 10 : 30);
   }
-  interactive_timeout = timeout * UI_FREQ;
+  interactive_deadline = millis_since_boot() + timeout * 1000.;
 }
 
 void Device::updateBrightness(const UIState &s) {
@@ -453,7 +552,11 @@ void Device::updateBrightness(const UIState &s) {
     clipped_brightness = std::clamp(100.0f * clipped_brightness, 10.0f, 100.0f);
   }
 
-  int brightness = brightness_filter.update(clipped_brightness);
+  // the filter is tuned for UI_FREQ, it's stepped as often at the idle rate
+  int brightness = 0;
+  for (int i = 0; i < UI_FREQ / s.updateFreq(); i++) {
+    brightness = brightness_filter.update(clipped_brightness);
+  }
   if (!awake) {
     brightness = 0;
   } else if (s.scene.screen_brightness <= 100) {
@@ -475,14 +578,15 @@ void Device::updateWakefulness(const UIState &s) {
 
   if (ignition_just_turned_off) {
     resetInteractiveTimeout();
-  } else if (interactive_timeout > 0 && --interactive_timeout == 0) {
+  } else if (interactive_deadline > 0 && millis_since_boot() >= interactive_deadline) {
+    interactive_deadline = 0;
     emit interactiveTimeout();
   }
 
   if (s.scene.screen_brightness != 0) {
-    setAwake(s.scene.ignition || interactive_timeout > 0);
+    setAwake(s.scene.ignition || interactive_deadline > 0);
   } else {
-    setAwake(interactive_timeout > 0);
+    setAwake(interactive_deadline > 0);
   }
 }
 
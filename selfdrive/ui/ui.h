@@ -4,6 +4,7 @@
 #include <memory>
 #include <string>
 #include <optional>
+#include <tuple>
 
 #include <QObject>
 #include <QTimer>
@@ -21,6 +22,7 @@ const int UI_BORDER_SIZE = 30;
 const int UI_HEADER_HEIGHT = 420;
 
 const int UI_FREQ = 20; // Hz
+const int UI_IDLE_FREQ = 5; // Hz, offroad
 const int BACKLIGHT_OFFROAD = 50;
 typedef cereal::CarControl::HUDControl::AudibleAlert AudibleAlert;
 
@@ -99,6 +101,25 @@ typedef enum UIStatus {
   STATUS_LATERAL_ACTIVE,
 } UIStatus;
 
+// How much the onroad view draws. It drops a tier per thermal status above green, so
+// the ui sheds load before thermald throttles modeld, and comes back up once the
+// status has been lower for RENDER_QUALITY_RECOVER_S.
+//   REDUCED: paths filled without gradients, HUD without antialiasing, map redrawn on
+//            bigger camera steps
+//   MINIMAL: also no adjacent lane paths, the camera sampled with nearest filtering and
+//            the map on even bigger steps
+enum class RenderQuality {
+  FULL,
+  REDUCED,
+  MINIMAL,
+};
+
+const double RENDER_QUALITY_RECOVER_S = 30;
+
+inline const char *render_quality_name(RenderQuality q) {
+  return q == RenderQuality::FULL ? "Full" : q == RenderQuality::REDUCED ? "Reduced" : "Minimal";
+}
+
 enum PrimeType {
   UNKNOWN = -1,
   NONE = 0,
@@ -124,6 +145,10 @@ static std::map<cereal::ControlsState::AlertStatus, QColor> alert_colors = {
   {cereal::ControlsState::AlertStatus::FROGPILOT, QColor(0x17, 0x86, 0x44, 0xf1)},
 };
 
+// everything the model geometry is projected from
+typedef std::tuple<uint64_t, uint64_t, uint64_t, uint64_t, bool, QTransform, int, int,
+                   bool, bool, bool, float, float, float, float, float, float> ModelGeometryKey;
+
 typedef struct UIScene {
   bool calibration_valid = false;
   bool calibration_wide_valid  = false;
@@ -138,6 +163,7 @@ typedef struct UIScene {
   QPolygonF track_vertices;
   QPolygonF lane_line_vertices[4];
   QPolygonF road_edge_vertices[2];
+  ModelGeometryKey model_geometry_key;
 
   // lead
   QPointF lead_vertices[2];
@@ -155,6 +181,9 @@ typedef struct UIScene {
   bool started, ignition, is_metric, map_on_left, longitudinal_control = true;
   uint64_t started_frame;
 
+  RenderQuality render_quality = RenderQuality::FULL;
+  double render_quality_recover_t = 0;  // when the thermal status went below the tier
+
   // FrogPilot variables
   bool acceleration_path;
   bool adjacent_path;
@@ -207,6 +236,7 @@ typedef struct UIScene {
   float speed_limit_offset;
   float vtsc_offset;
   int bearing_deg;
+  QString road_name;
   QPolygonF track_edge_vertices;
   QPolygonF track_left_adjacent_lane_vertices;
   QPolygonF track_right_adjacent_lane_vertices;
@@ -232,6 +262,9 @@ public:
 
   int fb_w = 0, fb_h = 0;
 
+  // UI_FREQ onroad, UI_IDLE_FREQ offroad
+  inline int updateFreq() const { return update_freq; }
+
   std::unique_ptr<SubMaster> sm;
 
   UIStatus status;
@@ -255,12 +288,15 @@ private slots:
 
 private:
   QTimer *timer;
+  int update_freq = UI_FREQ;
   bool started_prev = false;
   PrimeType prime_type = PrimeType::UNKNOWN;
   
   // FrogPilot variables
   Params params;
   Params paramsMemory{"/dev/shm/params"};
+  uint32_t params_memory_version = paramsMemory.version() - 1;  // read them on the first update
+  int conditional_status = 0;
 };
 
 UIState *uiState();
@@ -278,7 +314,7 @@ public:
 
 private:
   bool awake = false;
-  int interactive_timeout = 0;
+  double interactive_deadline = 0;  // millis_since_boot() it times out at, 0 once it did
   bool ignition_on = false;
 
   int offroad_brightness = BACKLIGHT_OFFROAD;
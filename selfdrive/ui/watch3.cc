@@ -1,10 +1,329 @@
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#include <GLES3/gl3.h>
+#endif
+
 #include <QApplication>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLWidget>
+#include <QPainter>
 #include <QtWidgets>
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cereal/visionipc/visionipc_client.h"
+#include "common/timing.h"
 #include "selfdrive/ui/qt/qt_window.h"
 #include "selfdrive/ui/qt/util.h"
 #include "selfdrive/ui/qt/widgets/cameraview.h"
 
+// Draws every stream in one GL context and one paint, a tile each, with the receive rate
+// and latency of each. A frame is uploaded once, when it's new, and the stats are taken
+// as frames are received, so watching doesn't load the machine down like a CameraWidget
+// per stream does. It uploads the frames, the camerad zero copy path is CameraWidget's.
+// Usage: watch3 [--widgets], --widgets for a CameraWidget per stream
+class CompositorWidget : public QOpenGLWidget, protected QOpenGLFunctions {
+public:
+  struct StreamInfo {
+    std::string name;
+    VisionStreamType type;
+  };
+
+  CompositorWidget(const std::vector<StreamInfo> &infos, int num_columns, QWidget *parent = nullptr)
+      : QOpenGLWidget(parent), columns(num_columns) {
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    for (auto &info : infos) {
+      streams.emplace_back(std::make_unique<Stream>(info));
+    }
+    for (auto &s : streams) {
+      s->thread = std::thread(&CompositorWidget::recvThread, this, s.get());
+    }
+  }
+
+  ~CompositorWidget() {
+    exiting = true;
+    for (auto &s : streams) {
+      s->thread.join();
+      if (s->latest) s->latest->release();
+    }
+    makeCurrent();
+    if (program) {
+      glDeleteVertexArrays(1, &vao);
+      glDeleteBuffers(1, &vbo);
+      for (auto &s : streams) glDeleteTextures(2, s->textures);
+    }
+    doneCurrent();
+  }
+
+protected:
+  struct Stream {
+    Stream(const StreamInfo &info) : name(info.name), type(info.type) {}
+    const std::string name;
+    const VisionStreamType type;
+    std::thread thread;
+
+    std::mutex lock;
+    VisionBuf *latest = nullptr;  // acquired, until a newer one replaces it
+    uint64_t latest_seq = 0;
+    int width = 0, height = 0, stride = 0;
+    bool connected = false;
+    // the last whole second
+    float fps = 0, latency_ms = 0, max_latency_ms = 0;
+    int window_frames = 0, window_latency_frames = 0;
+    double window_latency_ms = 0, window_max_latency_ms = 0;
+    uint64_t window_start_ns = 0;
+
+    // only the GUI thread
+    GLuint textures[2] = {};
+    int texture_width = 0, texture_height = 0;
+    uint64_t uploaded_seq = 0;
+  };
+
+  void recvThread(Stream *s) {
+    std::unique_ptr<VisionIpcClient> client;
+    uint64_t seq = 0;
+    while (!exiting) {
+      if (!client || !client->connected) {
+        {
+          std::lock_guard lk(s->lock);
+          if (s->latest) s->latest->release();
+          s->latest = nullptr;
+          s->connected = false;
+        }
+        client = std::make_unique<VisionIpcClient>(s->name, s->type, false);
+        if (!client->connect(false)) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(100));
+          continue;
+        }
+        std::lock_guard lk(s->lock);
+        s->width = client->buffers[0].width;
+        s->height = client->buffers[0].height;
+        s->stride = client->buffers[0].stride;
+        s->connected = true;
+        s->window_start_ns = nanos_since_boot();
+      }
+
+      VisionIpcBufExtra extra = {};
+      VisionBuf *buf = client->recv(&extra, 100);
+      if (!buf) continue;
+
+      const uint64_t now = nanos_since_boot();
+      {
+        std::lock_guard lk(s->lock);
+        buf->acquire();
+        if (s->latest) s->latest->release();
+        s->latest = buf;
+        s->latest_seq = ++seq;
+
+        s->window_frames++;
+        // not every stream has it, the map's doesn't
+        if (extra.timestamp_eof != 0 && now > extra.timestamp_eof) {
+          const double latency_ms = (now - extra.timestamp_eof) / 1e6;
+          s->window_latency_ms += latency_ms;
+          s->window_max_latency_ms = std::max(s->window_max_latency_ms, latency_ms);
+          s->window_latency_frames++;
+        }
+        if (now - s->window_start_ns >= 1000000000ULL) {
+          s->fps = s->window_frames / ((now - s->window_start_ns) / 1e9);
+          s->latency_ms = s->window_latency_frames ? s->window_latency_ms / s->window_latency_frames : 0;
+          s->max_latency_ms = s->window_max_latency_ms;
+          s->window_frames = s->window_latency_frames = 0;
+          s->window_latency_ms = s->window_max_latency_ms = 0;
+          s->window_start_ns = now;
+        }
+      }
+      // one paint for whatever came in meanwhile, from all the streams
+      if (!update_pending.exchange(true)) {
+        QMetaObject::invokeMethod(this, [this]() { update(); }, Qt::QueuedConnection);
+      }
+    }
+  }
+
+  void initializeGL() override {
+    initializeOpenGLFunctions();
+    program = std::make_unique<QOpenGLShaderProgram>(context());
+    bool ret = program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertex_shader);
+    assert(ret);
+    ret = program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragment_shader);
+    assert(ret);
+    program->link();
+
+    // a quad, with the frame's first row at the top
+    const float coords[] = {
+      -1.0, -1.0, 0.0, 1.0,
+      -1.0,  1.0, 0.0, 0.0,
+       1.0, -1.0, 1.0, 1.0,
+       1.0,  1.0, 1.0, 0.0,
+    };
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(coords), coords, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (const void *)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (const void *)(2 * sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    program->bind();
+    program->setUniformValue("uTextureY", 0);
+    program->setUniformValue("uTextureUV", 1);
+    program->release();
+    for (auto &s : streams) {
+      glGenTextures(2, s->textures);
+    }
+  }
+
+  // with the stream locked
+  void upload(Stream *s) {
+    if (s->texture_width != s->width || s->texture_height != s->height) {
+      s->texture_width = s->width;
+      s->texture_height = s->height;
+      for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, s->textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (i == 0) {
+          glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, s->width, s->height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        } else {
+          glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, s->width / 2, s->height / 2, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+        }
+      }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, s->stride);
+    glBindTexture(GL_TEXTURE_2D, s->textures[0]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s->width, s->height, GL_RED, GL_UNSIGNED_BYTE, s->latest->y);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, s->stride / 2);
+    glBindTexture(GL_TEXTURE_2D, s->textures[1]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s->width / 2, s->height / 2, GL_RG, GL_UNSIGNED_BYTE, s->latest->uv);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    s->uploaded_seq = s->latest_seq;
+  }
+
+  void paintGL() override {
+    update_pending = false;
+    const int rows = (streams.size() + columns - 1) / columns;
+    const qreal dpr = devicePixelRatio();
+    const int tile_w = width() / columns, tile_h = height() / rows;
+
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindVertexArray(vao);
+    program->bind();
+    for (int i = 0; i < (int)streams.size(); i++) {
+      Stream *s = streams[i].get();
+      {
+        std::lock_guard lk(s->lock);
+        if (!s->connected || s->width == 0) continue;
+        if (s->latest && s->latest_seq != s->uploaded_seq) upload(s);
+      }
+      if (s->uploaded_seq == 0) continue;
+
+      // the frame fit into its tile, GL's y is from the bottom
+      const int tx = (i % columns) * tile_w, ty = height() - (i / columns + 1) * tile_h;
+      const float tile_aspect = (float)tile_w / tile_h, frame_aspect = (float)s->texture_width / s->texture_height;
+      float zx = frame_aspect > tile_aspect ? 1.0 : frame_aspect / tile_aspect;
+      float zy = frame_aspect > tile_aspect ? tile_aspect / frame_aspect : 1.0;
+      // mirrored, like the driver view of CameraWidget
+      if (s->type == VISION_STREAM_DRIVER) zx = -zx;
+
+      glViewport(tx * dpr, ty * dpr, tile_w * dpr, tile_h * dpr);
+      program->setUniformValue("uScale", zx, zy);
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, s->textures[0]);
+      glActiveTexture(GL_TEXTURE0 + 1);
+      glBindTexture(GL_TEXTURE_2D, s->textures[1]);
+      glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    program->release();
+    glBindVertexArray(0);
+    glViewport(0, 0, width() * dpr, height() * dpr);
+
+    QPainter p(this);
+    p.setFont(QFont("Inter", 14));
+    for (int i = 0; i < (int)streams.size(); i++) {
+      Stream *s = streams[i].get();
+      QString text;
+      {
+        std::lock_guard lk(s->lock);
+        text = QString("%1 %2").arg(QString::fromStdString(s->name)).arg(s->type);
+        if (!s->connected) {
+          text += "  not connected";
+        } else {
+          text += QString("  %1x%2  %3 fps").arg(s->width).arg(s->height).arg(s->fps, 0, 'f', 1);
+          if (s->latency_ms > 0) {
+            text += QString("  latency %1 ms, max %2 ms").arg(s->latency_ms, 0, 'f', 1).arg(s->max_latency_ms, 0, 'f', 1);
+          }
+        }
+      }
+      const QRect tile((i % columns) * tile_w, (i / columns) * tile_h, tile_w, tile_h);
+      const QRect box = p.fontMetrics().boundingRect(text).adjusted(-8, -4, 8, 4);
+      p.fillRect(box.translated(tile.topLeft() - box.topLeft() + QPoint(10, 10)), QColor(0, 0, 0, 160));
+      p.setPen(Qt::white);
+      p.drawText(tile.adjusted(18, 14, 0, 0), Qt::AlignLeft | Qt::AlignTop, text);
+    }
+  }
+
+  static constexpr const char *vertex_shader =
+#ifdef __APPLE__
+    "#version 330 core\n"
+#else
+    "#version 300 es\n"
+#endif
+    "layout(location = 0) in vec2 aPosition;\n"
+    "layout(location = 1) in vec2 aTexCoord;\n"
+    "uniform vec2 uScale;\n"
+    "out vec2 vTexCoord;\n"
+    "void main() {\n"
+    "  gl_Position = vec4(aPosition * uScale, 0.0, 1.0);\n"
+    "  vTexCoord = aTexCoord;\n"
+    "}\n";
+
+  static constexpr const char *fragment_shader =
+#ifdef __APPLE__
+    "#version 330 core\n"
+#else
+    "#version 300 es\n"
+    "precision mediump float;\n"
+#endif
+    "uniform sampler2D uTextureY;\n"
+    "uniform sampler2D uTextureUV;\n"
+    "in vec2 vTexCoord;\n"
+    "out vec4 colorOut;\n"
+    "void main() {\n"
+    "  float y = texture(uTextureY, vTexCoord).r;\n"
+    "  vec2 uv = texture(uTextureUV, vTexCoord).rg - 0.5;\n"
+    "  colorOut = vec4(y + 1.402 * uv.y, y - 0.344 * uv.x - 0.714 * uv.y, y + 1.772 * uv.x, 1.0);\n"
+    "}\n";
+
+  const int columns;
+  std::vector<std::unique_ptr<Stream>> streams;
+  std::atomic<bool> exiting = false;
+  std::atomic<bool> update_pending = false;
+  std::unique_ptr<QOpenGLShaderProgram> program;
+  GLuint vao = 0, vbo = 0;
+};
+
 int main(int argc, char *argv[]) {
   initApp(argc, argv);
 
@@ -16,6 +335,16 @@ int main(int argc, char *argv[]) {
   layout->setMargin(0);
   layout->setSpacing(0);
 
+  if (!a.arguments().contains("--widgets")) {
+    layout->addWidget(new CompositorWidget({
+      {"navd", VISION_STREAM_MAP},
+      {"camerad", VISION_STREAM_ROAD},
+      {"camerad", VISION_STREAM_DRIVER},
+      {"camerad", VISION_STREAM_WIDE_ROAD},
+    }, 2));
+    return a.exec();
+  }
+
   {
     QHBoxLayout *hlayout = new QHBoxLayout();
     layout->addLayout(hlayout);
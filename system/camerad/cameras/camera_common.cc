@@ -1,12 +1,18 @@
 #include "system/camerad/cameras/camera_common.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "third_party/libyuv/include/libyuv.h"
 #include <jpeglib.h>
@@ -15,6 +21,8 @@
 #include "common/clutil.h"
 #include "common/modeldata.h"
 #include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/trace.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 #include "third_party/linux/include/msm_media_info.h"
@@ -26,46 +34,83 @@
 
 ExitHandler do_exit;
 
-class Debayer {
+Debayer::Debayer(cl_device_id device_id, cl_context context, const CameraBuf *b, const CameraState *s, int buf_width, int uv_offset,
+                 int half_width, int half_uv_offset) {
+  char args[4096];
+  const CameraInfo *ci = &s->ci;
+  snprintf(args, sizeof(args),
+           "-cl-fast-relaxed-math -cl-denorms-are-zero "
+           "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d -DFRAME_OFFSET=%d "
+           "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DRGB_STRIDE=%d -DYUV_STRIDE=%d -DUV_OFFSET=%d "
+           "-DIS_OX=%d -DCAM_NUM=%d%s "
+           "-DAE_X_START=%d -DAE_X_END=%d -DAE_X_SKIP=%d -DAE_Y_START=%d -DAE_Y_END=%d -DAE_Y_SKIP=%d "
+           "-DHALF_OUT=%d -DHALF_STRIDE=%d -DHALF_UV_OFFSET=%d",
+           ci->frame_width, ci->frame_height, ci->frame_stride, ci->frame_offset,
+           b->rgb_width, b->rgb_height, b->rgb_stride, buf_width, uv_offset,
+           s->camera_id==CAMERA_ID_OX03C10 ? 1 : 0, s->camera_num, s->camera_num==1 ? " -DVIGNETTING" : "",
+           b->exposure_window.x_start, b->exposure_window.x_end, b->exposure_window.x_skip,
+           b->exposure_window.y_start, b->exposure_window.y_end, b->exposure_window.y_skip,
+           half_width > 0 ? 1 : 0, half_width, half_uv_offset);
+  const char *cl_file = "cameras/real_debayer.cl";
+  cl_program prg_debayer = cl_program_from_file(context, device_id, cl_file, args);
+  krnl_ = CL_CHECK_ERR(clCreateKernel(prg_debayer, "debayer10", &err));
+  CL_CHECK(clReleaseProgram(prg_debayer));
+}
+
+void Debayer::queue(cl_command_queue q, cl_mem cam_buf_cl, cl_mem buf_cl, cl_mem hist_cl, cl_mem half_cl, int width, int height, cl_event *debayer_event) {
+  CL_CHECK(clSetKernelArg(krnl_, 0, sizeof(cl_mem), &cam_buf_cl));
+  CL_CHECK(clSetKernelArg(krnl_, 1, sizeof(cl_mem), &buf_cl));
+  CL_CHECK(clSetKernelArg(krnl_, 2, sizeof(cl_mem), &hist_cl));
+  CL_CHECK(clSetKernelArg(krnl_, 3, sizeof(cl_mem), &half_cl));
+
+  // the local size is also LOCAL_SIZE in the kernel
+  const size_t globalWorkSize[] = {size_t(width / 2), size_t(height / 2)};
+  const int debayer_local_worksize = 16;
+  const size_t localWorkSize[] = {debayer_local_worksize, debayer_local_worksize};
+  CL_CHECK(clEnqueueNDRangeKernel(q, krnl_, 2, NULL, globalWorkSize, localWorkSize, 0, 0, debayer_event));
+}
+
+Debayer::~Debayer() {
+  CL_CHECK(clReleaseKernel(krnl_));
+}
+
+class Scaler {
 public:
-  Debayer(cl_device_id device_id, cl_context context, const CameraBuf *b, const CameraState *s, int buf_width, int uv_offset) {
-    char args[4096];
-    const CameraInfo *ci = &s->ci;
+  Scaler(cl_device_id device_id, cl_context context, int in_width, int in_height, int in_stride, int in_uv_offset,
+         int out_width, int out_height, int out_stride, int out_uv_offset) : out_width_(out_width), out_height_(out_height) {
+    char args[1024];
     snprintf(args, sizeof(args),
              "-cl-fast-relaxed-math -cl-denorms-are-zero "
-             "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d -DFRAME_OFFSET=%d "
-             "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DRGB_STRIDE=%d -DYUV_STRIDE=%d -DUV_OFFSET=%d "
-             "-DIS_OX=%d -DCAM_NUM=%d%s",
-             ci->frame_width, ci->frame_height, ci->frame_stride, ci->frame_offset,
-             b->rgb_width, b->rgb_height, b->rgb_stride, buf_width, uv_offset,
-             s->camera_id==CAMERA_ID_OX03C10 ? 1 : 0, s->camera_num, s->camera_num==1 ? " -DVIGNETTING" : "");
-    const char *cl_file = "cameras/real_debayer.cl";
-    cl_program prg_debayer = cl_program_from_file(context, device_id, cl_file, args);
-    krnl_ = CL_CHECK_ERR(clCreateKernel(prg_debayer, "debayer10", &err));
-    CL_CHECK(clReleaseProgram(prg_debayer));
+             "-DIN_WIDTH=%d -DIN_HEIGHT=%d -DIN_STRIDE=%d -DIN_UV_OFFSET=%d "
+             "-DOUT_WIDTH=%d -DOUT_HEIGHT=%d -DOUT_STRIDE=%d -DOUT_UV_OFFSET=%d",
+             in_width, in_height, in_stride, in_uv_offset, out_width, out_height, out_stride, out_uv_offset);
+    cl_program prg_scale = cl_program_from_file(context, device_id, "cameras/nv12_scale.cl", args);
+    krnl_ = CL_CHECK_ERR(clCreateKernel(prg_scale, "nv12_scale", &err));
+    CL_CHECK(clReleaseProgram(prg_scale));
   }
 
-  void queue(cl_command_queue q, cl_mem cam_buf_cl, cl_mem buf_cl, int width, int height, cl_event *debayer_event) {
-    CL_CHECK(clSetKernelArg(krnl_, 0, sizeof(cl_mem), &cam_buf_cl));
-    CL_CHECK(clSetKernelArg(krnl_, 1, sizeof(cl_mem), &buf_cl));
+  void queue(cl_command_queue q, cl_mem in_cl, cl_mem out_cl, cl_event *scale_event) {
+    CL_CHECK(clSetKernelArg(krnl_, 0, sizeof(cl_mem), &in_cl));
+    CL_CHECK(clSetKernelArg(krnl_, 1, sizeof(cl_mem), &out_cl));
 
-    const size_t globalWorkSize[] = {size_t(width / 2), size_t(height / 2)};
-    const int debayer_local_worksize = 16;
-    const size_t localWorkSize[] = {debayer_local_worksize, debayer_local_worksize};
-    CL_CHECK(clEnqueueNDRangeKernel(q, krnl_, 2, NULL, globalWorkSize, localWorkSize, 0, 0, debayer_event));
+    const size_t globalWorkSize[] = {size_t(out_width_ / 2), size_t(out_height_ / 2)};
+    CL_CHECK(clEnqueueNDRangeKernel(q, krnl_, 2, NULL, globalWorkSize, NULL, 0, 0, scale_event));
   }
 
-  ~Debayer() {
+  ~Scaler() {
     CL_CHECK(clReleaseKernel(krnl_));
   }
 
 private:
+  int out_width_, out_height_;
   cl_kernel krnl_;
 };
 
-void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType init_yuv_type) {
+void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType init_yuv_type,
+                     const ExposureWindow &init_exposure_window) {
   vipc_server = v;
   this->yuv_type = init_yuv_type;
+  this->exposure_window = init_exposure_window;
   frame_buf_count = frame_cnt;
 
   const CameraInfo *ci = &s->ci;
@@ -92,7 +137,34 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
   vipc_server->create_buffers_with_sizes(yuv_type, YUV_BUFFER_COUNT, false, rgb_width, rgb_height, nv12_size, nv12_width, nv12_uv_offset);
   LOGD("created %d YUV vipc buffers with size %dx%d", YUV_BUFFER_COUNT, nv12_width, nv12_height);
 
-  debayer = new Debayer(device_id, context, this, s, nv12_width, nv12_uv_offset);
+  // the road's half res stream comes straight out of the debayer, other sizes are scaled from the full frame
+  if (yuv_type == VISION_STREAM_ROAD) {
+    const int half_width = rgb_width / 2, half_height = rgb_height / 2;
+    vipc_server->create_derived_buffers(VISION_STREAM_ROAD_HALF, yuv_type, DERIVED_BUFFER_COUNT, half_width, half_height);
+    debayer = new Debayer(device_id, context, this, s, nv12_width, nv12_uv_offset, half_width, half_width * half_height);
+    half_type = VISION_STREAM_ROAD_HALF;
+  } else {
+    debayer = new Debayer(device_id, context, this, s, nv12_width, nv12_uv_offset);
+  }
+  if (env_raw_ring_frames > 0) {
+    raw_ring = std::make_unique<RawFrameRing>(camera_bufs[0].len, env_raw_ring_frames);
+    LOG("camera %d: raw ring of %d frames", s->camera_num, env_raw_ring_frames);
+  }
+  exposure_hist_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(exposure_hist), NULL, &err));
+
+  // Scale the road stream once here instead of in every consumer
+  if (yuv_type == VISION_STREAM_ROAD) {
+    const std::pair<VisionStreamType, std::pair<int, int>> derived[] = {
+      {VISION_STREAM_ROAD_QCAM, {QCAM_WIDTH, QCAM_HEIGHT}},
+    };
+    for (auto &[type, size] : derived) {
+      auto [width, height] = size;
+      vipc_server->create_derived_buffers(type, yuv_type, DERIVED_BUFFER_COUNT, width, height);
+      scalers.push_back({type, new Scaler(device_id, context, rgb_width, rgb_height, nv12_width, nv12_uv_offset,
+                                          width, height, width, width * height)});
+    }
+    LOGD("created %zu derived vipc streams", scalers.size());
+  }
 
 #ifdef __APPLE__
   q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
@@ -103,13 +175,48 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
 }
 
 CameraBuf::~CameraBuf() {
+  // let outstanding send callbacks run first
+  if (q) CL_CHECK(clFinish(q));
   for (int i = 0; i < frame_buf_count; i++) {
     camera_bufs[i].free();
   }
   if (debayer) delete debayer;
+  if (exposure_hist_cl) CL_CHECK(clReleaseMemObject(exposure_hist_cl));
+  for (auto &[_, scaler] : scalers) delete scaler;
   if (q) CL_CHECK(clReleaseCommandQueue(q));
 }
 
+// Frames are sent from OpenCL completion callbacks, so the processing thread
+// only waits for the debayer it needs for its own callbacks, while the scalers
+// and publishing finish on the GPU's time.
+struct VipcSend {
+  VisionIpcServer *server;
+  VisionBuf *buf;
+  VisionIpcBufExtra extra;
+  LatencyStats *latency;
+};
+
+static void CL_CALLBACK send_on_complete(cl_event event, cl_int status, void *user_data) {
+  std::unique_ptr<VipcSend> send((VipcSend *)user_data);
+  if (status == CL_COMPLETE) {
+    send->server->send(send->buf, &send->extra);
+    if (send->latency) {
+      const uint64_t now = nanos_since_boot();
+      send->latency->add(LATENCY_PUBLISH, now - send->extra.timestamp_eof);
+      send->latency->add(LATENCY_SOF_PUBLISH, now - send->extra.timestamp_sof);
+    }
+  } else {
+    LOGE("frame %d on stream %d not sent, kernel failed with %d", send->extra.frame_id, send->buf->type, status);
+  }
+  CL_CHECK(clReleaseEvent(event));
+}
+
+static void send_when_done(cl_event event, VisionIpcServer *server, VisionBuf *buf, const VisionIpcBufExtra &extra,
+                           LatencyStats *latency = nullptr) {
+  // the callback owns the event and releases it
+  CL_CHECK(clSetEventCallback(event, CL_COMPLETE, send_on_complete, new VipcSend{server, buf, extra, latency}));
+}
+
 bool CameraBuf::acquire() {
   if (!safe_queue.try_pop(cur_buf_idx, 50)) return false;
 
@@ -119,29 +226,109 @@ bool CameraBuf::acquire() {
   }
 
   cur_frame_data = camera_bufs_metadata[cur_buf_idx];
+  const uint64_t acquire_ns = nanos_since_boot();
+  latency.add(LATENCY_SOF_EOF, cur_frame_data.timestamp_eof - cur_frame_data.timestamp_sof);
+  latency.add(LATENCY_REQUEST, cur_frame_data.timestamp_request - cur_frame_data.timestamp_sof);
+  latency.add(LATENCY_QUEUE, acquire_ns - cur_frame_data.timestamp_eof);
+  latency.add_frame(cur_frame_data.frame_id);
   cur_yuv_buf = vipc_server->get_buffer(yuv_type);
   cur_camera_buf = &camera_bufs[cur_buf_idx];
 
-  double start_time = millis_since_boot();
-  cl_event event;
-  debayer->queue(q, camera_bufs[cur_buf_idx].buf_cl, cur_yuv_buf->buf_cl, rgb_width, rgb_height, &event);
-  clWaitForEvents(1, &event);
-  CL_CHECK(clReleaseEvent(event));
-  cur_frame_data.processing_time = (millis_since_boot() - start_time) / 1000.0;
-
   VisionIpcBufExtra extra = {
     cur_frame_data.frame_id,
     cur_frame_data.timestamp_sof,
     cur_frame_data.timestamp_eof,
   };
   cur_yuv_buf->set_frame_id(cur_frame_data.frame_id);
-  vipc_server->send(cur_yuv_buf, &extra);
+  TRACE_SCOPE_FLOW("camerad.process", TRACE_FRAME_FLOW(yuv_type, cur_frame_data.frame_id));
 
+  double start_time = millis_since_boot();
+  const uint32_t zero = 0;
+  CL_CHECK(clEnqueueFillBuffer(q, exposure_hist_cl, &zero, sizeof(zero), 0, sizeof(exposure_hist), 0, NULL, NULL));
+  cl_event debayer_event, hist_event;
+  VisionBuf *half_buf = half_type ? vipc_server->get_buffer(*half_type) : nullptr;
+  // the kernel argument has to be set, it's unused without a half output
+  cl_mem half_cl = half_buf ? half_buf->buf_cl : cur_yuv_buf->buf_cl;
+  debayer->queue(q, camera_bufs[cur_buf_idx].buf_cl, cur_yuv_buf->buf_cl, exposure_hist_cl, half_cl, rgb_width, rgb_height, &debayer_event);
+  if (half_buf) {
+    half_buf->set_frame_id(cur_frame_data.frame_id);
+    CL_CHECK(clRetainEvent(debayer_event));
+    send_when_done(debayer_event, vipc_server, half_buf, extra);
+  }
+  send_when_done(debayer_event, vipc_server, cur_yuv_buf, extra, &latency);
+  CL_CHECK(clEnqueueReadBuffer(q, exposure_hist_cl, CL_FALSE, 0, sizeof(exposure_hist), exposure_hist, 0, NULL, &hist_event));
+
+  // the queue is in order, the scalers run right after the debayer
+  for (auto &[type, scaler] : scalers) {
+    VisionBuf *buf = vipc_server->get_buffer(type);
+    buf->set_frame_id(cur_frame_data.frame_id);
+    cl_event scale_event;
+    scaler->queue(q, cur_yuv_buf->buf_cl, buf->buf_cl, &scale_event);
+    send_when_done(scale_event, vipc_server, buf, extra);
+  }
+  CL_CHECK(clFlush(q));
+
+  // the histogram read comes right after the debayer. the exposure and
+  // thumbnail callbacks read the yuv frame
+  CL_CHECK(clWaitForEvents(1, &hist_event));
+  CL_CHECK(clReleaseEvent(hist_event));
+  latency.add(LATENCY_GPU, nanos_since_boot() - acquire_ns);
+  cur_frame_data.processing_time = (millis_since_boot() - start_time) / 1000.0;
   return true;
 }
 
 void CameraBuf::queue(size_t buf_idx) {
-  safe_queue.push(buf_idx);
+  // called from the event loop of all the cameras, it mustn't wait on one that's behind
+  if (!safe_queue.try_push(buf_idx)) {
+    LOGW("processing is %d frames behind, dropped buffer %zu", CAMERA_QUEUE_SIZE, buf_idx);
+  }
+}
+
+void LatencyStats::add(LatencyStage stage, int64_t ns) {
+  // timestamps from before the clocks were set up show up as huge or negative
+  if (ns < 0) return;
+  const size_t bucket = std::min<uint64_t>(ns / LATENCY_BUCKET_NS, LATENCY_BUCKETS - 1);
+  buckets[stage][bucket]++;
+  int64_t prev = max_ns[stage];
+  while (prev < ns && !max_ns[stage].compare_exchange_weak(prev, ns)) {}
+}
+
+void LatencyStats::add_frame(int frame_id) {
+  // a reset of the ids after a realign isn't a drop
+  if (last_frame_id >= 0 && frame_id > last_frame_id) dropped += frame_id - last_frame_id - 1;
+  last_frame_id = frame_id;
+  frames++;
+}
+
+void LatencyStats::log_and_reset(int camera_num) {
+  static const char *names[] = {"sof_eof", "request", "queue", "gpu", "publish", "callback", "sof_publish"};
+  static_assert(std::size(names) == LATENCY_STAGE_MAX);
+
+  std::string out;
+  for (int stage = 0; stage < LATENCY_STAGE_MAX; stage++) {
+    uint32_t counts[LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+      counts[i] = buckets[stage][i].exchange(0);
+      total += counts[i];
+    }
+    const int64_t max = max_ns[stage].exchange(0);
+    if (total == 0) continue;
+
+    // upper edge of the bucket the percentile falls in
+    auto percentile = [&](double p) {
+      uint64_t cur = 0;
+      int i = 0;
+      for (; i < LATENCY_BUCKETS - 1; i++) {
+        cur += counts[i];
+        if (cur >= total * p) break;
+      }
+      return std::min<double>((i + 1) * LATENCY_BUCKET_NS, max) / 1e6;
+    };
+    out += util::string_format(" %s %.2f/%.2f/%.2f", names[stage], percentile(0.5), percentile(0.99), max / 1e6);
+  }
+  const uint32_t f = frames.exchange(0), d = dropped.exchange(0);
+  LOG("camera %d latency ms p50/p99/max:%s, dropped %u of %u frames", camera_num, out.c_str(), d, f + d);
 }
 
 // common functions
@@ -179,32 +366,126 @@ kj::Array<uint8_t> get_raw_frame_image(const CameraBuf *b) {
   return kj::mv(frame_image);
 }
 
-static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_width, int thumbnail_height) {
-  int downscale = b->cur_yuv_buf->width / thumbnail_width;
-  assert(downscale * thumbnail_height == b->cur_yuv_buf->height);
-  int in_stride = b->cur_yuv_buf->stride;
+// Thumbnails are encoded on their own thread, the libjpeg compress takes ~10ms
+// and would otherwise delay the next road frame. The processing thread only
+// point-samples the frame down into a planar buffer, which is cheap, and hands
+// it over. A thumbnail that's still being encoded when the next one is due
+// makes that one get skipped.
+class ThumbnailWorker {
+public:
+  ThumbnailWorker(PubMaster *pub_master) : pm(pub_master), thread(&ThumbnailWorker::run, this) {}
+  ~ThumbnailWorker() {
+    {
+      std::lock_guard lk(lock);
+      stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
+
+  void submit(const CameraBuf *b);
+
+private:
+  void run();
+
+  PubMaster *pm;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool pending = false;
+  bool stopping = false;
+
+  // owned by the worker while pending
+  std::vector<uint8_t> planes;
+  int width = 0, height = 0;
+  uint32_t frame_id = 0;
+  uint64_t timestamp_eof = 0;
+
+  std::thread thread;
+};
+
+// subsampled conversion from nv12 to planar yuv420
+static void nv12_subsample(const VisionBuf *in, int thumbnail_width, int thumbnail_height, std::vector<uint8_t> &out) {
+  int downscale = in->width / thumbnail_width;
+  assert(downscale * thumbnail_height == in->height);
+  int in_stride = in->stride;
 
   // make the buffer big enough. jpeg_write_raw_data requires 16-pixels aligned height to be used.
-  std::unique_ptr<uint8[]> buf(new uint8_t[(thumbnail_width * ((thumbnail_height + 15) & ~15) * 3) / 2]);
-  uint8_t *y_plane = buf.get();
+  out.resize((thumbnail_width * ((thumbnail_height + 15) & ~15) * 3) / 2);
+  uint8_t *y_plane = out.data();
   uint8_t *u_plane = y_plane + thumbnail_width * thumbnail_height;
   uint8_t *v_plane = u_plane + (thumbnail_width * thumbnail_height) / 4;
+  for (int hy = 0; hy < thumbnail_height/2; hy++) {
+    for (int hx = 0; hx < thumbnail_width/2; hx++) {
+      int ix = hx * downscale + (downscale-1)/2;
+      int iy = hy * downscale + (downscale-1)/2;
+      y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 0)] = in->y[(iy*2 + 0) * in_stride + ix*2 + 0];
+      y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 1)] = in->y[(iy*2 + 0) * in_stride + ix*2 + 1];
+      y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 0)] = in->y[(iy*2 + 1) * in_stride + ix*2 + 0];
+      y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 1)] = in->y[(iy*2 + 1) * in_stride + ix*2 + 1];
+      u_plane[hy*thumbnail_width/2 + hx] = in->uv[iy*in_stride + ix*2 + 0];
+      v_plane[hy*thumbnail_width/2 + hx] = in->uv[iy*in_stride + ix*2 + 1];
+    }
+  }
+}
+
+RawFrameRing::RawFrameRing(size_t frame_len, int size) : frames(size), metadata(size) {
+  for (auto &f : frames) {
+    f.allocate(frame_len);
+  }
+}
+
+RawFrameRing::~RawFrameRing() {
+  for (auto &f : frames) {
+    f.free();
+  }
+}
+
+void RawFrameRing::push(const VisionBuf *raw, const FrameMetadata &frame_data) {
+  std::lock_guard lk(lock);
+  if (dumping) {
+    skipped++;
+    return;
+  }
+
+  memcpy(frames[head].addr, raw->addr, std::min(raw->len, frames[head].len));
+  metadata[head] = frame_data;
+  head = (head + 1) % frames.size();
+  count = std::min(count + 1, frames.size());
+}
+
+int RawFrameRing::dump(const std::string &dir, const std::string &prefix) {
+  size_t first, n;
   {
-    // subsampled conversion from nv12 to yuv
-    for (int hy = 0; hy < thumbnail_height/2; hy++) {
-      for (int hx = 0; hx < thumbnail_width/2; hx++) {
-        int ix = hx * downscale + (downscale-1)/2;
-        int iy = hy * downscale + (downscale-1)/2;
-        y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 0)] = b->cur_yuv_buf->y[(iy*2 + 0) * in_stride + ix*2 + 0];
-        y_plane[(hy*2 + 0)*thumbnail_width + (hx*2 + 1)] = b->cur_yuv_buf->y[(iy*2 + 0) * in_stride + ix*2 + 1];
-        y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 0)] = b->cur_yuv_buf->y[(iy*2 + 1) * in_stride + ix*2 + 0];
-        y_plane[(hy*2 + 1)*thumbnail_width + (hx*2 + 1)] = b->cur_yuv_buf->y[(iy*2 + 1) * in_stride + ix*2 + 1];
-        u_plane[hy*thumbnail_width/2 + hx] = b->cur_yuv_buf->uv[iy*in_stride + ix*2 + 0];
-        v_plane[hy*thumbnail_width/2 + hx] = b->cur_yuv_buf->uv[iy*in_stride + ix*2 + 1];
-      }
+    std::lock_guard lk(lock);
+    dumping = true;
+    skipped = 0;
+    n = count;
+    first = (head + frames.size() - count) % frames.size();
+  }
+
+  int written = 0;
+  for (size_t i = 0; i < n; i++) {
+    const size_t idx = (first + i) % frames.size();
+    std::string fn = util::string_format("%s/%s_%d.raw", dir.c_str(), prefix.c_str(), metadata[idx].frame_id);
+    if (util::write_file(fn.c_str(), frames[idx].addr, frames[idx].len, O_WRONLY | O_CREAT | O_TRUNC) == 0) {
+      written++;
+    } else {
+      LOGE("failed to write %s", fn.c_str());
     }
   }
 
+  std::lock_guard lk(lock);
+  dumping = false;
+  count = 0;
+  LOG("raw dump %s: %d frames, %d skipped while writing", prefix.c_str(), written, skipped);
+  return written;
+}
+
+static kj::Array<capnp::byte> yuv420_to_jpeg(uint8_t *planes, int thumbnail_width, int thumbnail_height) {
+  uint8_t *y_plane = planes;
+  uint8_t *u_plane = y_plane + thumbnail_width * thumbnail_height;
+  uint8_t *v_plane = u_plane + (thumbnail_width * thumbnail_height) / 4;
+
   struct jpeg_compress_struct cinfo;
   struct jpeg_error_mgr jerr;
   cinfo.err = jpeg_std_error(&jerr);
@@ -255,38 +536,58 @@ static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_w
   return dat;
 }
 
-static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
-  auto thumbnail = yuv420_to_jpeg(b, b->rgb_width / 4, b->rgb_height / 4);
-  if (thumbnail.size() == 0) return;
+void ThumbnailWorker::submit(const CameraBuf *b) {
+  std::unique_lock lk(lock);
+  if (pending) {
+    LOGD("thumbnail for frame %d skipped, previous one still encoding", b->cur_frame_data.frame_id);
+    return;
+  }
 
-  MessageBuilder msg;
-  auto thumbnaild = msg.initEvent().initThumbnail();
-  thumbnaild.setFrameId(b->cur_frame_data.frame_id);
-  thumbnaild.setTimestampEof(b->cur_frame_data.timestamp_eof);
-  thumbnaild.setThumbnail(thumbnail);
+  width = b->rgb_width / 4;
+  height = b->rgb_height / 4;
+  nv12_subsample(b->cur_yuv_buf, width, height, planes);
+  frame_id = b->cur_frame_data.frame_id;
+  timestamp_eof = b->cur_frame_data.timestamp_eof;
+  pending = true;
+  lk.unlock();
+  cv.notify_one();
+}
 
-  pm->send("thumbnail", msg);
+void ThumbnailWorker::run() {
+  util::set_thread_name("camerad_thumbnail");
+
+  std::unique_lock lk(lock);
+  while (true) {
+    cv.wait(lk, [&] { return pending || stopping; });
+    if (stopping) break;
+
+    // submit never touches the buffer while pending is set
+    lk.unlock();
+    auto thumbnail = yuv420_to_jpeg(planes.data(), width, height);
+    if (thumbnail.size() != 0) {
+      MessageBuilder msg;
+      auto thumbnaild = msg.initEvent().initThumbnail();
+      thumbnaild.setFrameId(frame_id);
+      thumbnaild.setTimestampEof(timestamp_eof);
+      thumbnaild.setThumbnail(thumbnail);
+      pm->send("thumbnail", msg);
+    }
+    lk.lock();
+    pending = false;
+  }
 }
 
-float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
+float set_exposure_target(const CameraBuf *b) {
   int lum_med;
-  uint32_t lum_binning[256] = {0};
-  const uint8_t *pix_ptr = b->cur_yuv_buf->y;
-
   unsigned int lum_total = 0;
-  for (int y = y_start; y < y_end; y += y_skip) {
-    for (int x = x_start; x < x_end; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->rgb_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
-    }
+  for (int i = 0; i < EXPOSURE_HIST_BINS; i++) {
+    lum_total += b->exposure_hist[i];
   }
 
-
   // Find mean lumimance value
   unsigned int lum_cur = 0;
   for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
+    lum_cur += b->exposure_hist[lum_med];
 
     if (lum_cur >= lum_total / 2) {
       break;
@@ -296,6 +597,53 @@ float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip
   return lum_med / 256.0;
 }
 
+void FrameSync::init(uint32_t mask) {
+  std::lock_guard lk(lock);
+  enabled_mask = mask;
+  for (auto &b : bundles) b = {};
+}
+
+void FrameSync::add(int camera_num, const FrameMetadata &frame_data) {
+  assert(camera_num >= 0 && camera_num < MAX_CAMERAS);
+  std::lock_guard lk(lock);
+  if (__builtin_popcount(enabled_mask) < 2) return;
+
+  Bundle &b = bundles[frame_data.frame_id % FRAME_SYNC_SLOTS];
+  if (b.mask != 0 && b.frame_id != frame_data.frame_id) {
+    // the slot is being reused, a camera never got to that frame
+    if (b.frame_id < frame_data.frame_id) incomplete++;
+    else return;  // late frame, its bundle is long gone
+    b.mask = 0;
+  }
+  b.frame_id = frame_data.frame_id;
+  b.mask |= 1 << camera_num;
+  b.timestamp_sof[camera_num] = frame_data.timestamp_sof;
+
+  if (b.mask == enabled_mask) {
+    complete(b);
+    b.mask = 0;
+  }
+}
+
+void FrameSync::complete(const Bundle &b) {
+  uint64_t sof_min = UINT64_MAX, sof_max = 0;
+  for (int i = 0; i < MAX_CAMERAS; i++) {
+    if (!(enabled_mask & (1 << i))) continue;
+    sof_min = std::min(sof_min, b.timestamp_sof[i]);
+    sof_max = std::max(sof_max, b.timestamp_sof[i]);
+  }
+  const uint64_t skew = sof_max - sof_min;
+  skew_sum_ns += skew;
+  skew_max_ns = std::max(skew_max_ns, skew);
+
+  if (++synced == FRAME_SYNC_LOG_INTERVAL) {
+    LOG("frame sync: %d bundles, %d incomplete, sof skew avg %.3f ms max %.3f ms",
+        synced, incomplete, (double)skew_sum_ns / synced / 1e6, skew_max_ns / 1e6);
+    synced = incomplete = 0;
+    skew_sum_ns = skew_max_ns = 0;
+  }
+}
+
 void *processing_thread(MultiCameraState *cameras, CameraState *cs, process_thread_cb callback) {
   const char *thread_name = nullptr;
   if (cs == &cameras->road_cam) {
@@ -307,15 +655,28 @@ void *processing_thread(MultiCameraState *cameras, CameraState *cs, process_thre
   }
   util::set_thread_name(thread_name);
 
+  std::unique_ptr<ThumbnailWorker> thumbnail_worker;
+  if (cs == &(cameras->road_cam) && cameras->pm) {
+    thumbnail_worker = std::make_unique<ThumbnailWorker>(cameras->pm);
+  }
+
   uint32_t cnt = 0;
   while (!do_exit) {
     if (!cs->buf.acquire()) continue;
 
+    const uint64_t callback_start = nanos_since_boot();
     callback(cameras, cs, cnt);
+    cs->buf.latency.add(LATENCY_CALLBACK, nanos_since_boot() - callback_start);
+    cameras->frame_sync.add(cs->camera_num, cs->buf.cur_frame_data);
+    if (cs->buf.raw_ring) {
+      cs->buf.raw_ring->push(cs->buf.cur_camera_buf, cs->buf.cur_frame_data);
+    }
 
-    if (cs == &(cameras->road_cam) && cameras->pm && cnt % 100 == 3) {
-      // this takes 10ms???
-      publish_thumbnail(cameras->pm, &(cs->buf));
+    if (thumbnail_worker && cnt % 100 == 3) {
+      thumbnail_worker->submit(&(cs->buf));
+    }
+    if (cnt % LATENCY_LOG_INTERVAL == LATENCY_LOG_INTERVAL - 1) {
+      cs->buf.latency.log_and_reset(cs->camera_num);
     }
     ++cnt;
   }
@@ -326,6 +687,37 @@ std::thread start_process_thread(MultiCameraState *cameras, CameraState *cs, pro
   return std::thread(processing_thread, cameras, cs, callback);
 }
 
+void raw_dump_thread(MultiCameraState *cameras) {
+  util::set_thread_name("camerad_raw_dump");
+
+  Params params;
+  SubMaster sm({"userFlag"});
+  while (!do_exit) {
+    sm.update(100);
+    bool trigger = sm.updated("userFlag");
+    if (params.getBool("CameraRawDump")) {
+      params.remove("CameraRawDump");
+      trigger = true;
+    }
+    if (!trigger) continue;
+
+    // next to the log root, not in it, so the uploader doesn't pick the dumps up
+    const std::string dir = util::string_format("%s/../raw_dumps/%llu", Path::log_root().c_str(), (unsigned long long)nanos_since_boot());
+    if (!util::create_directories(dir, 0775)) {
+      LOGE("failed to create %s", dir.c_str());
+      continue;
+    }
+    const std::pair<const char *, CameraState *> cams[] = {
+      {"road", &cameras->road_cam}, {"wide_road", &cameras->wide_road_cam}, {"driver", &cameras->driver_cam},
+    };
+    for (auto &[name, c] : cams) {
+      if (c->enabled && c->buf.raw_ring) {
+        c->buf.raw_ring->dump(dir, name);
+      }
+    }
+  }
+}
+
 void camerad_thread() {
   cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
 #ifdef QCOM2
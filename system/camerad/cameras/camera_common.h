@@ -1,9 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "cereal/messaging/messaging.h"
 #include "cereal/visionipc/visionbuf.h"
@@ -27,6 +33,13 @@
 #define CAMERA_ID_MAX 10
 
 const int YUV_BUFFER_COUNT = 40;
+const int DERIVED_BUFFER_COUNT = 10;
+// frames waiting for the processing thread, the sensor buffers are reused long before it fills
+const int CAMERA_QUEUE_SIZE = 16;
+
+// downscaled stream used by the qcamera encoder
+const int QCAM_WIDTH = 526;
+const int QCAM_HEIGHT = 330;
 
 enum CameraType {
   RoadCam = 0,
@@ -41,6 +54,10 @@ const bool env_disable_driver = getenv("DISABLE_DRIVER") != NULL;
 const bool env_debug_frames = getenv("DEBUG_FRAMES") != NULL;
 const bool env_log_raw_frames = getenv("LOG_RAW_FRAMES") != NULL;
 const bool env_ctrl_exp_from_params = getenv("CTRL_EXP_FROM_PARAMS") != NULL;
+// keep the last N raw frames of every camera, dumped on userFlag or the CameraRawDump param
+const int env_raw_ring_frames = getenv("RAW_RING_FRAMES") ? atoi(getenv("RAW_RING_FRAMES")) : 0;
+// fewer ISP requests in flight on the road camera, see LOW_LATENCY_REQUEST_DEPTH
+const bool env_low_latency = getenv("CAMERAD_LOW_LATENCY") != NULL;
 
 typedef struct CameraInfo {
   uint32_t frame_width, frame_height;
@@ -51,12 +68,21 @@ typedef struct CameraInfo {
   int stats_offset = -1;
 } CameraInfo;
 
+// part of the frame auto exposure meters, every x_skip/y_skip pixel
+struct ExposureWindow {
+  int x_start, x_end, x_skip;
+  int y_start, y_end, y_skip;
+};
+
+const int EXPOSURE_HIST_BINS = 256;
+
 typedef struct FrameMetadata {
   uint32_t frame_id;
 
   // Timestamps
   uint64_t timestamp_sof; // only set on tici
   uint64_t timestamp_eof;
+  uint64_t timestamp_request;  // the ISP request completed
 
   // Exposure
   unsigned int integ_lines;
@@ -68,21 +94,88 @@ typedef struct FrameMetadata {
   float processing_time;
 } FrameMetadata;
 
+enum LatencyStage {
+  LATENCY_SOF_EOF,   // sensor readout
+  LATENCY_REQUEST,   // sof until the ISP request completed
+  LATENCY_QUEUE,     // eof until the processing thread picked the frame up
+  LATENCY_GPU,       // debayer enqueue until its histogram was read back
+  LATENCY_PUBLISH,   // eof until the yuv frame was sent
+  LATENCY_CALLBACK,  // the per camera processing callback
+  LATENCY_SOF_PUBLISH,  // sof until the yuv frame was sent, what a consumer sees
+  LATENCY_STAGE_MAX,
+};
+
+const int LATENCY_BUCKETS = 256;
+const uint64_t LATENCY_BUCKET_NS = 250000;
+// stats are logged and reset once per this many frames
+const int LATENCY_LOG_INTERVAL = 20 * 60;
+
+// Per stage latency histograms of a camera. Filled in by the processing
+// thread and the CL completion callbacks, so everything is atomic.
+class LatencyStats {
+public:
+  void add(LatencyStage stage, int64_t ns);
+  // every acquired frame, a gap in the ids counts as dropped frames
+  void add_frame(int frame_id);
+  void log_and_reset(int camera_num);
+
+private:
+  std::atomic<uint32_t> buckets[LATENCY_STAGE_MAX][LATENCY_BUCKETS] = {};
+  std::atomic<int64_t> max_ns[LATENCY_STAGE_MAX] = {};
+  int last_frame_id = -1;
+  std::atomic<uint32_t> frames = 0, dropped = 0;
+};
+
 struct MultiCameraState;
 class CameraState;
-class Debayer;
+class CameraBuf;
+class Scaler;
+
+class Debayer {
+public:
+  // half_width > 0 also outputs a half resolution NV12 frame with the given layout
+  Debayer(cl_device_id device_id, cl_context context, const CameraBuf *b, const CameraState *s, int buf_width, int uv_offset,
+          int half_width = 0, int half_uv_offset = 0);
+  ~Debayer();
+  void queue(cl_command_queue q, cl_mem cam_buf_cl, cl_mem buf_cl, cl_mem hist_cl, cl_mem half_cl, int width, int height, cl_event *debayer_event);
+
+private:
+  cl_kernel krnl_;
+};
+
+// Copies of the most recent raw frames of a camera. The processing thread
+// pushes into it, a dump freezes the ring while it's written out so the live
+// frames never wait on the disk.
+class RawFrameRing {
+public:
+  RawFrameRing(size_t frame_len, int size);
+  ~RawFrameRing();
+  void push(const VisionBuf *raw, const FrameMetadata &frame_data);
+  // writes the frames oldest first as <dir>/<prefix>_<frame_id>.raw
+  int dump(const std::string &dir, const std::string &prefix);
+
+private:
+  std::mutex lock;
+  bool dumping = false;
+  std::vector<VisionBuf> frames;
+  std::vector<FrameMetadata> metadata;
+  size_t head = 0, count = 0;
+  uint32_t skipped = 0;
+};
 
 class CameraBuf {
 private:
   VisionIpcServer *vipc_server;
   Debayer *debayer = nullptr;
+  std::vector<std::pair<VisionStreamType, Scaler *>> scalers;
+  std::optional<VisionStreamType> half_type;
   VisionStreamType yuv_type;
   int cur_buf_idx;
-  SafeQueue<int> safe_queue;
-  int frame_buf_count;
+  BlockingSPSCQueue<int, CAMERA_QUEUE_SIZE> safe_queue;
+  int frame_buf_count = 0;
 
 public:
-  cl_command_queue q;
+  cl_command_queue q = nullptr;
   FrameMetadata cur_frame_data;
   VisionBuf *cur_yuv_buf;
   VisionBuf *cur_camera_buf;
@@ -90,19 +183,59 @@ public:
   std::unique_ptr<FrameMetadata[]> camera_bufs_metadata;
   int rgb_width, rgb_height, rgb_stride;
 
+  // luminance histogram of the current frame's exposure window, filled in by the debayer
+  ExposureWindow exposure_window;
+  cl_mem exposure_hist_cl = nullptr;
+  uint32_t exposure_hist[EXPOSURE_HIST_BINS] = {};
+
+  std::unique_ptr<RawFrameRing> raw_ring;
+  LatencyStats latency;
+
   CameraBuf() = default;
   ~CameraBuf();
-  void init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType yuv_type);
+  void init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType yuv_type,
+            const ExposureWindow &exposure_window);
   bool acquire();
   void queue(size_t buf_idx);
 };
 
+const int MAX_CAMERAS = 3;
+// frames still waiting for the other cameras, a few frame times worth
+const int FRAME_SYNC_SLOTS = 8;
+// stats are logged once per this many bundles
+const int FRAME_SYNC_LOG_INTERVAL = 20 * 60;
+
+// Matches the frames of all enabled cameras by frame_id once they've been
+// processed and measures how far apart their start of frame timestamps are.
+class FrameSync {
+public:
+  void init(uint32_t enabled_mask);
+  void add(int camera_num, const FrameMetadata &frame_data);
+
+private:
+  struct Bundle {
+    uint32_t frame_id;
+    uint32_t mask;
+    uint64_t timestamp_sof[MAX_CAMERAS];
+  };
+  void complete(const Bundle &b);
+
+  std::mutex lock;
+  uint32_t enabled_mask = 0;
+  Bundle bundles[FRAME_SYNC_SLOTS] = {};
+
+  // since the last stats log
+  uint32_t synced = 0, incomplete = 0;
+  uint64_t skew_sum_ns = 0, skew_max_ns = 0;
+};
+
 typedef void (*process_thread_cb)(MultiCameraState *s, CameraState *c, int cnt);
 
 void fill_frame_data(cereal::FrameData::Builder &framed, const FrameMetadata &frame_data, CameraState *c);
 kj::Array<uint8_t> get_raw_frame_image(const CameraBuf *b);
-float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip);
+float set_exposure_target(const CameraBuf *b);
 std::thread start_process_thread(MultiCameraState *cameras, CameraState *cs, process_thread_cb callback);
+void raw_dump_thread(MultiCameraState *cameras);
 
 void cameras_init(VisionIpcServer *v, MultiCameraState *s, cl_device_id device_id, cl_context ctx);
 void cameras_open(MultiCameraState *s);
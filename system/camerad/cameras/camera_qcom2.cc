@@ -454,10 +454,9 @@ void CameraState::config_isp(int io_mem_handle, int fence, int request_id, int b
   }
 }
 
-void CameraState::enqueue_buffer(int i, bool dp) {
+// waits for the request in buffer i and hands the frame to processing if dp
+void CameraState::finish_buffer(int i, bool dp) {
   int ret;
-  int request_id = request_ids[i];
-
   if (buf_handle[i] && sync_objs[i]) {
     // wait
     struct cam_sync_wait sync_wait = {0};
@@ -479,7 +478,15 @@ void CameraState::enqueue_buffer(int i, bool dp) {
     if (ret != 0) {
       LOGE("failed to destroy sync object: %d %d", ret, sync_destroy.sync_obj);
     }
+    sync_objs[i] = 0;
   }
+}
+
+void CameraState::enqueue_buffer(int i, bool dp) {
+  int ret;
+  int request_id = request_ids[i];
+
+  finish_buffer(i, dp);
 
   // create output fence
   struct cam_sync_info sync_create = {0};
@@ -581,7 +588,15 @@ void CameraState::camera_map_bufs(MultiCameraState *s) {
     LOGD("map buf req: (fd: %d) 0x%x %d", buf.camera_bufs[i].fd, mem_mgr_map_cmd.out.buf_handle, ret);
     buf_handle[i] = mem_mgr_map_cmd.out.buf_handle;
   }
-  enqueue_req_multi(1, FRAME_BUF_COUNT, 0);
+  enqueue_req_multi(1, request_depth, 0);
+}
+
+static ExposureWindow exposure_window(VisionStreamType yuv_type) {
+  switch (yuv_type) {
+    case VISION_STREAM_DRIVER: return {96, 1832, 2, 242, 1148, 4};
+    case VISION_STREAM_WIDE_ROAD: return {96, 1830, 2, 250, 774, 2};
+    default: return {96, 1830, 2, 160, 1146, 2};
+  }
 }
 
 void CameraState::camera_init(MultiCameraState *s, VisionIpcServer * v, int camera_id_, unsigned int fps, cl_device_id device_id, cl_context ctx, VisionStreamType yuv_type) {
@@ -595,10 +610,13 @@ void CameraState::camera_init(MultiCameraState *s, VisionIpcServer * v, int came
 
   request_id_last = 0;
   skipped = true;
+  request_depth = (env_low_latency && yuv_type == VISION_STREAM_ROAD) ? LOW_LATENCY_REQUEST_DEPTH : FRAME_BUF_COUNT;
+  static_assert(LOW_LATENCY_REQUEST_DEPTH >= 2 && LOW_LATENCY_REQUEST_DEPTH <= FRAME_BUF_COUNT);
+  if (request_depth != FRAME_BUF_COUNT) LOGW("camera %d keeps %d requests in flight", camera_num, request_depth);
 
   camera_set_parameters();
 
-  buf.init(device_id, ctx, this, v, FRAME_BUF_COUNT, yuv_type);
+  buf.init(device_id, ctx, this, v, FRAME_BUF_COUNT, yuv_type, exposure_window(yuv_type));
   camera_map_bufs(s);
 }
 
@@ -794,6 +812,12 @@ void cameras_init(VisionIpcServer *v, MultiCameraState *s, cl_device_id device_i
   s->road_cam.camera_init(s, v, s->road_cam.camera_id, 20, device_id, ctx, VISION_STREAM_ROAD);
   s->wide_road_cam.camera_init(s, v, s->wide_road_cam.camera_id, 20, device_id, ctx, VISION_STREAM_WIDE_ROAD);
 
+  uint32_t enabled_mask = 0;
+  for (CameraState *c : {&s->driver_cam, &s->road_cam, &s->wide_road_cam}) {
+    if (c->enabled) enabled_mask |= 1 << c->camera_num;
+  }
+  s->frame_sync.init(enabled_mask);
+
   s->pm = new PubMaster({"roadCameraState", "driverCameraState", "wideRoadCameraState", "thumbnail"});
 }
 
@@ -989,7 +1013,7 @@ void CameraState::handle_camera_event(void *evdat) {
     if (main_id > frame_id_last + 1 && !skipped) {
       LOGE("camera %d realign", camera_num);
       clear_req_queue();
-      enqueue_req_multi(real_id + 1, FRAME_BUF_COUNT - 1, 0);
+      enqueue_req_multi(real_id + 1, request_depth - 1, 0);
       skipped = true;
     } else if (main_id == frame_id_last + 1) {
       skipped = false;
@@ -998,7 +1022,7 @@ void CameraState::handle_camera_event(void *evdat) {
     // check for dropped requests
     if (real_id > request_id_last + 1) {
       LOGE("camera %d dropped requests %d %d", camera_num, real_id, request_id_last);
-      enqueue_req_multi(request_id_last + 1 + FRAME_BUF_COUNT, real_id - (request_id_last + 1), 0);
+      enqueue_req_multi(request_id_last + 1 + request_depth, real_id - (request_id_last + 1), 0);
     }
 
     // metas
@@ -1008,6 +1032,7 @@ void CameraState::handle_camera_event(void *evdat) {
     auto &meta_data = buf.camera_bufs_metadata[buf_idx];
     meta_data.frame_id = main_id - idx_offset;
     meta_data.timestamp_sof = timestamp;
+    meta_data.timestamp_request = nanos_since_boot();
     exp_lock.lock();
     meta_data.gain = analog_gain_frac * (1 + dc_gain_weight * (dc_gain_factor-1) / dc_gain_max_weight);
     meta_data.high_conversion_gain = dc_gain_enabled;
@@ -1016,13 +1041,15 @@ void CameraState::handle_camera_event(void *evdat) {
     meta_data.target_grey_fraction = target_grey_fraction;
     exp_lock.unlock();
 
-    // dispatch
-    enqueue_req_multi(real_id + FRAME_BUF_COUNT, 1, 1);
+    // dispatch this frame, then keep request_depth requests ahead of it. With the full depth
+    // the next request goes into this frame's buffer, with less it's another one
+    finish_buffer(buf_idx, true);
+    enqueue_req_multi(real_id + request_depth, 1, 0);
   } else { // not ready
     if (main_id > frame_id_last + 10) {
       LOGE("camera %d reset after half second of no response", camera_num);
       clear_req_queue();
-      enqueue_req_multi(request_id_last + 1, FRAME_BUF_COUNT, 0);
+      enqueue_req_multi(request_id_last + 1, request_depth, 0);
       frame_id_last = main_id;
       skipped = true;
     }
@@ -1207,7 +1234,7 @@ static void ar0231_process_registers(MultiCameraState *s, CameraState *c, cereal
 }
 
 static void process_driver_camera(MultiCameraState *s, CameraState *c, int cnt) {
-  c->set_camera_exposure(set_exposure_target(&c->buf, 96, 1832, 2, 242, 1148, 4));
+  c->set_camera_exposure(set_exposure_target(&c->buf));
 
   MessageBuilder msg;
   auto framed = msg.initEvent().initDriverCameraState();
@@ -1237,9 +1264,7 @@ void process_road_camera(MultiCameraState *s, CameraState *c, int cnt) {
 
   s->pm->send(c == &s->road_cam ? "roadCameraState" : "wideRoadCameraState", msg);
 
-  const auto [x, y, w, h] = (c == &s->wide_road_cam) ? std::tuple(96, 250, 1734, 524) : std::tuple(96, 160, 1734, 986);
-  const int skip = 2;
-  c->set_camera_exposure(set_exposure_target(b, x, x + w, skip, y, y + h, skip));
+  c->set_camera_exposure(set_exposure_target(b));
 }
 
 void cameras_run(MultiCameraState *s) {
@@ -1254,6 +1279,7 @@ void cameras_run(MultiCameraState *s) {
   if (s->driver_cam.enabled) threads.push_back(start_process_thread(s, &s->driver_cam, process_driver_camera));
   if (s->road_cam.enabled) threads.push_back(start_process_thread(s, &s->road_cam, process_road_camera));
   if (s->wide_road_cam.enabled) threads.push_back(start_process_thread(s, &s->wide_road_cam, process_road_camera));
+  if (env_raw_ring_frames > 0) threads.push_back(std::thread(raw_dump_thread, s));
 
   // start devices
   LOG("-- Starting devices");
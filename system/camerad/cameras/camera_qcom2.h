@@ -12,6 +12,9 @@
 #include "common/util.h"
 
 #define FRAME_BUF_COUNT 4
+// ISP requests in flight on the road camera with CAMERAD_LOW_LATENCY. The current frame
+// and the next one, every request further ahead is only a cushion against drops
+#define LOW_LATENCY_REQUEST_DEPTH 2
 #define ANALOG_GAIN_MAX_CNT 55
 
 class CameraState {
@@ -85,6 +88,8 @@ public:
   int buf_handle[FRAME_BUF_COUNT];
   int sync_objs[FRAME_BUF_COUNT];
   int request_ids[FRAME_BUF_COUNT];
+  // requests kept in flight, at most FRAME_BUF_COUNT
+  int request_depth = FRAME_BUF_COUNT;
   int request_id_last;
   int frame_id_last;
   int idx_offset;
@@ -98,6 +103,7 @@ private:
   void config_isp(int io_mem_handle, int fence, int request_id, int buf0_mem_handle, int buf0_offset);
   void enqueue_req_multi(int start, int n, bool dp);
   void enqueue_buffer(int i, bool dp);
+  void finish_buffer(int i, bool dp);
   int clear_req_queue();
 
   int sensors_init();
@@ -109,6 +115,8 @@ private:
   std::map<uint16_t, std::pair<int, int>> ar0231_build_register_lut(uint8_t *data);
 };
 
+extern CameraInfo cameras_supported[CAMERA_ID_MAX];
+
 typedef struct MultiCameraState {
   unique_fd video0_fd;
   unique_fd cam_sync_fd;
@@ -120,5 +128,6 @@ typedef struct MultiCameraState {
   CameraState wide_road_cam;
   CameraState driver_cam;
 
+  FrameSync frame_sync;
   PubMaster *pm;
 } MultiCameraState;
@@ -0,0 +1,37 @@
+// Bilinear downscale of an NV12 frame. One work item per output 2x2 block, which
+// covers four Y samples and a single interleaved UV pair.
+
+#define SCALE_X ((float)IN_WIDTH / OUT_WIDTH)
+#define SCALE_Y ((float)IN_HEIGHT / OUT_HEIGHT)
+
+float sample(__global const uchar *plane, int stride, int step, int w, int h, float x, float y) {
+  x = clamp(x, 0.0f, (float)(w - 1));
+  y = clamp(y, 0.0f, (float)(h - 1));
+  const int x0 = (int)x, y0 = (int)y;
+  const int x1 = min(x0 + 1, w - 1), y1 = min(y0 + 1, h - 1);
+  const float fx = x - x0, fy = y - y0;
+
+  const float top = mix((float)plane[y0 * stride + x0 * step], (float)plane[y0 * stride + x1 * step], fx);
+  const float bottom = mix((float)plane[y1 * stride + x0 * step], (float)plane[y1 * stride + x1 * step], fx);
+  return mix(top, bottom, fy);
+}
+
+__kernel void nv12_scale(__global const uchar *in, __global uchar *out) {
+  const int gx = get_global_id(0);
+  const int gy = get_global_id(1);
+  if (gx >= OUT_WIDTH / 2 || gy >= OUT_HEIGHT / 2) return;
+
+  for (int dy = 0; dy < 2; dy++) {
+    for (int dx = 0; dx < 2; dx++) {
+      const int x = gx * 2 + dx, y = gy * 2 + dy;
+      const float v = sample(in, IN_STRIDE, 1, IN_WIDTH, IN_HEIGHT, (x + 0.5f) * SCALE_X - 0.5f, (y + 0.5f) * SCALE_Y - 0.5f);
+      out[y * OUT_STRIDE + x] = convert_uchar_sat_rte(v);
+    }
+  }
+
+  const float ux = (gx + 0.5f) * SCALE_X - 0.5f, uy = (gy + 0.5f) * SCALE_Y - 0.5f;
+  __global const uchar *in_uv = in + IN_UV_OFFSET;
+  __global uchar *out_uv = out + OUT_UV_OFFSET + gy * OUT_STRIDE + gx * 2;
+  out_uv[0] = convert_uchar_sat_rte(sample(in_uv, IN_STRIDE, 2, IN_WIDTH / 2, IN_HEIGHT / 2, ux, uy));
+  out_uv[1] = convert_uchar_sat_rte(sample(in_uv + 1, IN_STRIDE, 2, IN_WIDTH / 2, IN_HEIGHT / 2, ux, uy));
+}
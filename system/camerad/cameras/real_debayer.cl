@@ -89,11 +89,34 @@ float get_k(float a, float b, float c, float d) {
   return 2.0 - (fabs(a - b) + fabs(c - d));
 }
 
-__kernel void debayer10(const __global uchar * in, __global uchar * out)
+// luminance histogram of the auto exposure window, every AE_X_SKIP/AE_Y_SKIP pixel
+#define HIST_BINS 256
+
+inline bool in_ae_window(int x, int y) {
+  return x >= AE_X_START && x < AE_X_END && y >= AE_Y_START && y < AE_Y_END &&
+         (x - AE_X_START) % AE_X_SKIP == 0 && (y - AE_Y_START) % AE_Y_SKIP == 0;
+}
+
+// With HALF_OUT the kernel also writes the half resolution stream. Every work
+// item covers a 2x2 block, so its half res Y is the block's average and a
+// half res UV pair is the average of the full res UVs of a 2x2 group of work
+// items, the same as a bilinear scale by exactly two.
+#define LOCAL_SIZE 16
+
+__kernel void debayer10(const __global uchar * in, __global uchar * out, __global uint * hist, __global uchar * half_out)
 {
   const int gid_x = get_global_id(0);
   const int gid_y = get_global_id(1);
 
+  // groups at the right and bottom edge can be smaller
+  __local uint local_hist[HIST_BINS];
+  const int lid = mad24((int)get_local_id(1), (int)get_local_size(0), (int)get_local_id(0));
+  const int local_cnt = get_local_size(0) * get_local_size(1);
+  for (int i = lid; i < HIST_BINS; i += local_cnt) {
+    local_hist[i] = 0;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
   const int y_top_mod = (gid_y == 0) ? 2: 0;
   const int y_bot_mod = (gid_y == (RGB_HEIGHT/2 - 1)) ? 1: 3;
 
@@ -179,11 +202,24 @@ __kernel void debayer10(const __global uchar * in, __global uchar * out)
     RGB_TO_Y(rgb_out[1].s0, rgb_out[1].s1, rgb_out[1].s2)
   );
   vstore2(yy, 0, out + mad24(gid_y * 2, YUV_STRIDE, gid_x * 2));
+#if HALF_OUT
+  ushort half_y = convert_ushort(yy.s0) + yy.s1;
+#endif
+  const int x0 = gid_x * 2, y0 = gid_y * 2;
+  if (in_ae_window(x0, y0)) atomic_inc(&local_hist[yy.s0]);
+  if (in_ae_window(x0 + 1, y0)) atomic_inc(&local_hist[yy.s1]);
+
   yy = (uchar2)(
     RGB_TO_Y(rgb_out[2].s0, rgb_out[2].s1, rgb_out[2].s2),
     RGB_TO_Y(rgb_out[3].s0, rgb_out[3].s1, rgb_out[3].s2)
   );
   vstore2(yy, 0, out + mad24(gid_y * 2 + 1, YUV_STRIDE, gid_x * 2));
+#if HALF_OUT
+  half_y += convert_ushort(yy.s0) + yy.s1;
+  half_out[mad24(gid_y, HALF_STRIDE, gid_x)] = (half_y + 2) >> 2;
+#endif
+  if (in_ae_window(x0, y0 + 1)) atomic_inc(&local_hist[yy.s0]);
+  if (in_ae_window(x0 + 1, y0 + 1)) atomic_inc(&local_hist[yy.s1]);
 
   // write uvs
   const short ar = AVERAGE(rgb_out[0].s0, rgb_out[1].s0, rgb_out[2].s0, rgb_out[3].s0);
@@ -194,4 +230,23 @@ __kernel void debayer10(const __global uchar * in, __global uchar * out)
     RGB_TO_V(ar, ag, ab)
   );
   vstore2(uv, 0, out + UV_OFFSET + mad24(gid_y, YUV_STRIDE, gid_x * 2));
+
+#if HALF_OUT
+  __local ushort2 local_uv[LOCAL_SIZE][LOCAL_SIZE];
+  const int lx = get_local_id(0), ly = get_local_id(1);
+  local_uv[ly][lx] = convert_ushort2(uv);
+#endif
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+#if HALF_OUT
+  // groups start on even ids and the half res size is even, so the 2x2 is always in the group
+  if ((lx & 1) == 0 && (ly & 1) == 0) {
+    const ushort2 sum = local_uv[ly][lx] + local_uv[ly][lx + 1] + local_uv[ly + 1][lx] + local_uv[ly + 1][lx + 1];
+    vstore2(convert_uchar2((sum + (ushort2)2) >> (ushort2)2), 0, half_out + HALF_UV_OFFSET + mad24(gid_y / 2, HALF_STRIDE, gid_x));
+  }
+#endif
+  for (int i = lid; i < HIST_BINS; i += local_cnt) {
+    if (local_hist[i] != 0) atomic_add(&hist[i], local_hist[i]);
+  }
 }
@@ -3,6 +3,7 @@
 #include <cassert>
 
 #include "common/params.h"
+#include "common/placement.h"
 #include "common/util.h"
 #include "system/hardware/hw.h"
 
@@ -12,11 +13,8 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
-  int ret;
-  ret = util::set_realtime_priority(53);
-  assert(ret == 0);
-  ret = util::set_core_affinity({6});
-  assert(ret == 0 || Params().getBool("IsOffroad")); // failure ok while offroad due to offlining cores
+  int ret = apply_placement("camerad");
+  assert(ret == 0 || Params().getBool("IsOffroad")); // affinity failure ok while offroad due to offlining cores
 
   camerad_thread();
   return 0;
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/bench.h"
+#include "common/clutil.h"
+#include "system/camerad/cameras/camera_common.h"
+#include "system/camerad/cameras/camera_qcom2.h"
+#include "third_party/linux/include/msm_media_info.h"
+
+// GPU time of the debayer kernel per sensor, with and without the fused half
+// resolution output, on random raw data. Run from system/camerad. --json writes the
+// common daemon bench report, see common/bench.h, with a frame counted as 1/20s of drive.
+// Usage: debayer_bench [--json FILE] [iterations]
+
+static double run(cl_device_id device_id, cl_context context, cl_command_queue q, int camera_id, bool half, int iterations,
+                  BenchReport &report, const std::string &stage) {
+  CameraState s;
+  s.ci = cameras_supported[camera_id];
+  s.camera_id = camera_id;
+  s.camera_num = 1;  // road, with vignetting correction
+  CameraBuf &b = s.buf;
+  b.rgb_width = s.ci.frame_width;
+  b.rgb_height = s.ci.frame_height;
+  b.exposure_window = {96, 1830, 2, 160, 1146, 2};
+
+  const int nv12_width = VENUS_Y_STRIDE(COLOR_FMT_NV12, b.rgb_width);
+  const int nv12_height = VENUS_Y_SCANLINES(COLOR_FMT_NV12, b.rgb_height);
+  const int half_width = b.rgb_width / 2, half_height = b.rgb_height / 2;
+  Debayer debayer(device_id, context, &b, &s, nv12_width, nv12_width * nv12_height,
+                  half ? half_width : 0, half_width * half_height);
+
+  std::vector<uint8_t> raw(s.ci.frame_stride * (s.ci.frame_height + s.ci.extra_height));
+  std::mt19937 gen(0);
+  std::generate(raw.begin(), raw.end(), [&]() { return gen() & 0xff; });
+  cl_mem raw_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, raw.size(), raw.data(), &err));
+  cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, nv12_width * nv12_height * 3 / 2, NULL, &err));
+  cl_mem hist_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, EXPOSURE_HIST_BINS * sizeof(uint32_t), NULL, &err));
+  cl_mem half_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_WRITE, half_width * half_height * 3 / 2, NULL, &err));
+
+  double total_ms = 0;
+  for (int i = 0; i < iterations + 1; i++) {
+    cl_event event;
+    debayer.queue(q, raw_cl, yuv_cl, hist_cl, half_cl, b.rgb_width, b.rgb_height, &event);
+    CL_CHECK(clWaitForEvents(1, &event));
+    cl_ulong start, end;
+    CL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL));
+    CL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL));
+    CL_CHECK(clReleaseEvent(event));
+    // the first run includes the kernel warming up
+    if (i > 0) {
+      total_ms += (end - start) / 1e6;
+      report.add_ns(stage, end - start);
+    }
+  }
+
+  for (cl_mem m : {raw_cl, yuv_cl, hist_cl, half_cl}) {
+    CL_CHECK(clReleaseMemObject(m));
+  }
+  return total_ms / iterations;
+}
+
+int main(int argc, char *argv[]) {
+  int iterations = 100;
+  std::string json_path;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else {
+      iterations = std::atoi(argv[i]);
+    }
+  }
+
+  cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+  cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+  const cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};
+  cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
+
+  BenchReport report("camerad_debayer");
+  const std::pair<const char *, int> sensors[] = {{"AR0231", CAMERA_ID_AR0231}, {"OX03C10", CAMERA_ID_OX03C10}};
+  for (auto &[name, camera_id] : sensors) {
+    for (bool half : {false, true}) {
+      const std::string stage = std::string(name) + (half ? " +half res" : " full res");
+      printf("%-8s %-10s %.3f ms\n", name, half ? "+half res" : "full res", run(device_id, context, q, camera_id, half, iterations, report, stage));
+    }
+  }
+  if (!json_path.empty()) {
+    report.finish(4 * iterations / 20.0);
+    report.write(json_path);
+  }
+
+  CL_CHECK(clReleaseCommandQueue(q));
+  CL_CHECK(clReleaseContext(context));
+  return 0;
+}
@@ -41,6 +41,13 @@ namespace Path {
     return "ipc:///tmp/logmessage" + Path::openpilot_prefix();
   }
 
+  inline std::string cl_cache() {
+    if (const char *env = getenv("CL_CACHE")) {
+      return env;
+    }
+    return Hardware::PC() ? Path::comma_home() + "/clcache" : "/data/clcache";
+  }
+
   inline std::string download_cache_root() {
     if (const char *env = getenv("COMMA_CACHE")) {
       return env;
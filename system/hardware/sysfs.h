@@ -0,0 +1,42 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "common/util.h"
+
+// A sysfs attribute that stays open. The kernel makes up the value again on every read
+// from offset 0, and takes every write as a new one, so each access is a single pread or
+// pwrite instead of an open, a read and a close. Those are positional, so it can be used
+// from several threads, e.g. as a function local static.
+class SysfsFile {
+public:
+  explicit SysfsFile(const char *path, bool writable = false)
+      : fd(HANDLE_EINTR(open(path, (writable ? O_WRONLY : O_RDONLY) | O_CLOEXEC))) {}
+  ~SysfsFile() {
+    if (fd >= 0) close(fd);
+  }
+  SysfsFile(const SysfsFile &) = delete;
+  SysfsFile &operator=(const SysfsFile &) = delete;
+
+  // empty if it can't be read
+  std::string read() const {
+    char buf[64];
+    ssize_t n = fd >= 0 ? HANDLE_EINTR(pread(fd, buf, sizeof(buf), 0)) : -1;
+    return n > 0 ? std::string(buf, n) : std::string();
+  }
+  int readInt(int default_value = 0) const {
+    std::string value = read();
+    return value.empty() ? default_value : std::atoi(value.c_str());
+  }
+
+  bool write(const std::string &value) const {
+    return fd >= 0 && HANDLE_EINTR(pwrite(fd, value.data(), value.size(), 0)) == (ssize_t)value.size();
+  }
+
+private:
+  const int fd;
+};
@@ -8,6 +8,7 @@
 #include "common/params.h"
 #include "common/util.h"
 #include "system/hardware/base.h"
+#include "system/hardware/sysfs.h"
 
 class HardwareTici : public HardwareNone {
 public:
@@ -20,16 +21,25 @@ public:
   }
 
   static std::string get_name() {
-    std::string devicetree_model = util::read_file("/sys/firmware/devicetree/base/model");
-    return (devicetree_model.find("tizi") != std::string::npos) ? "tizi" : "tici";
+    static const std::string name = [] {
+      std::string devicetree_model = util::read_file("/sys/firmware/devicetree/base/model");
+      return (devicetree_model.find("tizi") != std::string::npos) ? "tizi" : "tici";
+    }();
+    return name;
   }
 
   static cereal::InitData::DeviceType get_device_type() {
     return (get_name() == "tizi") ? cereal::InitData::DeviceType::TIZI : cereal::InitData::DeviceType::TICI;
   }
 
-  static int get_voltage() { return std::atoi(util::read_file("/sys/class/hwmon/hwmon1/in1_input").c_str()); }
-  static int get_current() { return std::atoi(util::read_file("/sys/class/hwmon/hwmon1/curr1_input").c_str()); }
+  static int get_voltage() {
+    static const SysfsFile voltage("/sys/class/hwmon/hwmon1/in1_input");
+    return voltage.readInt();
+  }
+  static int get_current() {
+    static const SysfsFile current("/sys/class/hwmon/hwmon1/curr1_input");
+    return current.readInt();
+  }
 
   static std::string get_serial() {
     static std::string serial("");
@@ -52,20 +62,13 @@ public:
   static void reboot() { std::system("sudo reboot"); }
   static void poweroff() { std::system("sudo poweroff"); }
   static void set_brightness(int percent) {
-    std::string max = util::read_file("/sys/class/backlight/panel0-backlight/max_brightness");
-
-    std::ofstream brightness_control("/sys/class/backlight/panel0-backlight/brightness");
-    if (brightness_control.is_open()) {
-      brightness_control << (int)(percent * (std::stof(max)/100.)) << "\n";
-      brightness_control.close();
-    }
+    static const int max = SysfsFile("/sys/class/backlight/panel0-backlight/max_brightness").readInt();
+    static const SysfsFile brightness_control("/sys/class/backlight/panel0-backlight/brightness", true);
+    brightness_control.write(std::to_string((int)(percent * (max / 100.))) + "\n");
   }
   static void set_display_power(bool on) {
-    std::ofstream bl_power_control("/sys/class/backlight/panel0-backlight/bl_power");
-    if (bl_power_control.is_open()) {
-      bl_power_control << (on ? "0" : "4") << "\n";
-      bl_power_control.close();
-    }
+    static const SysfsFile bl_power_control("/sys/class/backlight/panel0-backlight/bl_power", true);
+    bl_power_control.write(on ? "0\n" : "4\n");
   }
   static void set_volume(float volume) {
     volume = util::map_val(volume, 0.f, 1.f, MIN_VOLUME, MAX_VOLUME);
@@ -1,9 +1,15 @@
+#include <syslog.h>
 #include <systemd/sd-journal.h>
 
+#include <algorithm>
 #include <cassert>
 #include <csignal>
+#include <cstring>
+#include <deque>
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "third_party/json11/json11.hpp"
 
@@ -11,8 +17,42 @@
 #include "common/timing.h"
 #include "common/util.h"
 
+// entries sent together, the rest of a storm waits for the next batch
+const int MAX_BATCH = 64;
+const int DROPPED_SUMMARY_SEC = 10;
+
+// a token bucket per source, a storm from one doesn't crowd out the others
+struct SourceRate {
+  double tokens;
+  uint64_t last_ns = 0;
+  uint64_t first_dropped_ns = 0;
+  int dropped = 0;
+};
+
+std::string journal_field(sd_journal *journal, const char *field) {
+  const void *data;
+  size_t length;
+  if (sd_journal_get_data(journal, field, &data, &length) < 0) return "";
+  const size_t prefix = strlen(field) + 1;  // "FIELD="
+  return length > prefix ? std::string((const char *)data + prefix, length - prefix) : "";
+}
+
+void build_entry(MessageBuilder &msg, uint64_t timestamp, std::map<std::string, std::string> &kv) {
+  auto androidEntry = msg.initEvent().initAndroidLog();
+  androidEntry.setTs(timestamp);
+  androidEntry.setMessage(json11::Json(kv).dump());
+  if (kv.count("_PID")) androidEntry.setPid(std::atoi(kv["_PID"].c_str()));
+  if (kv.count("PRIORITY")) androidEntry.setPriority(std::atoi(kv["PRIORITY"].c_str()));
+  if (kv.count("SYSLOG_IDENTIFIER")) androidEntry.setTag(kv["SYSLOG_IDENTIFIER"]);
+}
+
 ExitHandler do_exit;
 int main(int argc, char *argv[]) {
+  // entries less important than this aren't forwarded, like journalctl -p. 0 is emerg and 7 debug
+  const int max_priority = std::clamp(util::getenv("LOGCATD_PRIORITY", LOG_DEBUG), 0, LOG_DEBUG);
+  // entries a second per source, and how many it may send at once
+  const float rate = util::getenv("LOGCATD_RATE", 100.0f);
+  const float burst = util::getenv("LOGCATD_BURST", 500.0f);
 
   PubMaster pm({"androidLog"});
 
@@ -21,6 +61,14 @@ int main(int argc, char *argv[]) {
   assert(err >= 0);
   err = sd_journal_get_fd(journal); // needed so sd_journal_wait() works properly if files rotate
   assert(err >= 0);
+  // the journal skips the others, they're never read. Matches on one field are or'ed
+  if (max_priority < LOG_DEBUG) {
+    for (int p = 0; p <= max_priority; p++) {
+      std::string match = "PRIORITY=" + std::to_string(p);
+      err = sd_journal_add_match(journal, match.c_str(), 0);
+      assert(err >= 0);
+    }
+  }
   err = sd_journal_seek_tail(journal);
   assert(err >= 0);
 
@@ -28,46 +76,95 @@ int main(int argc, char *argv[]) {
   // call sd_journal_previous_skip after sd_journal_seek_tail (like journalctl -f does) to makes things work.
   sd_journal_previous_skip(journal, 1);
 
-  while (!do_exit) {
-    err = sd_journal_next(journal);
-    assert(err >= 0);
+  std::unordered_map<std::string, SourceRate> sources;
+  uint64_t last_summary_ns = nanos_since_boot();
+  std::deque<MessageBuilder> batch;
+  std::vector<kj::ArrayPtr<capnp::byte>> batch_bytes;
 
-    // Wait for new message if we didn't receive anything
-    if (err == 0) {
-      err = sd_journal_wait(journal, 1000 * 1000);
+  while (!do_exit) {
+    batch.clear();
+    bool drained = false;
+    while ((int)batch.size() < MAX_BATCH) {
+      err = sd_journal_next(journal);
       assert(err >= 0);
-      continue; // Try again
-    }
+      if (err == 0) {
+        drained = true;
+        break;
+      }
 
-    uint64_t timestamp = 0;
-    err = sd_journal_get_realtime_usec(journal, &timestamp);
-    assert(err >= 0);
+      // the rate is decided on before the entry is read and serialized
+      std::string source = journal_field(journal, "SYSLOG_IDENTIFIER");
+      if (source.empty()) source = journal_field(journal, "_COMM");
+      const uint64_t ts = nanos_since_boot();
+      SourceRate &r = sources.try_emplace(source, SourceRate{.tokens = burst}).first->second;
+      if (r.last_ns != 0) {
+        r.tokens = std::min<double>(burst, r.tokens + (ts - r.last_ns) * 1e-9 * rate);
+      }
+      r.last_ns = ts;
+      if (r.tokens < 1.0) {
+        if (r.dropped++ == 0) r.first_dropped_ns = ts;
+        continue;
+      }
+      r.tokens -= 1.0;
+
+      uint64_t timestamp = 0;
+      err = sd_journal_get_realtime_usec(journal, &timestamp);
+      assert(err >= 0);
 
-    const void *data;
-    size_t length;
-    std::map<std::string, std::string> kv;
+      const void *data;
+      size_t length;
+      std::map<std::string, std::string> kv;
 
-    SD_JOURNAL_FOREACH_DATA(journal, data, length) {
-      std::string str((char*)data, length);
+      SD_JOURNAL_FOREACH_DATA(journal, data, length) {
+        std::string str((char*)data, length);
 
-      // Split "KEY=VALUE"" on "=" and put in map
-      std::size_t found = str.find("=");
-      if (found != std::string::npos) {
-        kv[str.substr(0, found)] = str.substr(found + 1, std::string::npos);
+        // Split "KEY=VALUE"" on "=" and put in map
+        std::size_t found = str.find("=");
+        if (found != std::string::npos) {
+          kv[str.substr(0, found)] = str.substr(found + 1, std::string::npos);
+        }
       }
+
+      build_entry(batch.emplace_back(), timestamp, kv);
     }
 
-    MessageBuilder msg;
+    // what the limits dropped, as entries of logcatd's own
+    const uint64_t now = nanos_since_boot();
+    if (now - last_summary_ns >= DROPPED_SUMMARY_SEC * 1000000000ULL) {
+      last_summary_ns = now;
+      for (auto it = sources.begin(); it != sources.end();) {
+        SourceRate &r = it->second;
+        if (r.dropped > 0) {
+          const double secs = (now - r.first_dropped_ns) * 1e-9;
+          std::map<std::string, std::string> kv = {
+            {"MESSAGE", util::string_format("dropped %d entries from %s in %.1fs", r.dropped, it->first.c_str(), secs)},
+            {"PRIORITY", std::to_string(LOG_WARNING)},
+            {"SYSLOG_IDENTIFIER", "logcatd"},
+            {"_PID", std::to_string(getpid())},
+          };
+          build_entry(batch.emplace_back(), nanos_since_epoch() / 1000, kv);
+          r.dropped = 0;
+        }
+        // the ones that have been quiet long enough to have a full bucket again
+        if (r.dropped == 0 && r.tokens + (now - r.last_ns) * 1e-9 * rate >= burst) {
+          it = sources.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
 
-    // Build message
-    auto androidEntry = msg.initEvent().initAndroidLog();
-    androidEntry.setTs(timestamp);
-    androidEntry.setMessage(json11::Json(kv).dump());
-    if (kv.count("_PID")) androidEntry.setPid(std::atoi(kv["_PID"].c_str()));
-    if (kv.count("PRIORITY")) androidEntry.setPriority(std::atoi(kv["PRIORITY"].c_str()));
-    if (kv.count("SYSLOG_IDENTIFIER")) androidEntry.setTag(kv["SYSLOG_IDENTIFIER"]);
+    if (!batch.empty()) {
+      batch_bytes.clear();
+      for (auto &msg : batch) batch_bytes.push_back(msg.toBytes());
+      pm.sendBatch("androidLog", batch_bytes);
+    }
 
-    pm.send("androidLog", msg);
+    // Wait for new message if we didn't receive anything
+    if (drained) {
+      err = sd_journal_wait(journal, 1000 * 1000);
+      assert(err >= 0);
+    }
   }
 
   sd_journal_close(journal);
@@ -0,0 +1,275 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "common/statlog.h"
+#include "common/swaglog.h"
+#include "common/timing.h"
+#include "common/util.h"
+#include "system/hardware/hw.h"
+
+// Frees log storage, oldest segments first. Same policy as deleter.py: below MIN_BYTES or
+// MIN_PERCENT free, delete the first directory in creation order that isn't locked, with
+// boot/crash and the last PRESERVE_COUNT preserved segments (and the ones before them) last.
+//
+// The segment list and sizes come from one scan at start, after that from inotify: a new
+// directory in the log root is a rotation, which is when the one before it is done and
+// gets measured. Deleting runs at idle I/O priority, and big files are truncated in steps
+// before the unlink, since freeing all the extents of a 1GB fcamera.hevc at once stalls
+// the writes of loggerd.
+
+const uint64_t MIN_BYTES = 5ULL * 1024 * 1024 * 1024;
+const double MIN_PERCENT = 10;
+
+const char *DELETE_LAST[] = {"boot", "crash"};
+
+const char *PRESERVE_ATTR_NAME = "user.preserve";
+const char PRESERVE_ATTR_VALUE = '1';
+const int PRESERVE_COUNT = 5;
+
+const off_t TRUNCATE_STEP = 64 * 1024 * 1024;
+const int TRUNCATE_STEP_SLEEP_MS = 20;
+
+const int STATS_INTERVAL_MS = 10000;
+
+// not in glibc's headers
+const int IOPRIO_CLASS_IDLE = 3;
+const int IOPRIO_WHO_PROCESS = 1;
+const int IOPRIO_CLASS_SHIFT = 13;
+
+ExitHandler do_exit;
+
+// the order of listdir_by_creation, both halves of "route--segment" padded to 10
+static std::string sort_key(const std::string &name) {
+  auto pad = [](const std::string &s) { return s.size() < 10 ? std::string(10 - s.size(), '0') + s : s; };
+  size_t pos = name.rfind("--");
+  return pos == std::string::npos ? pad(name) : pad(name.substr(0, pos)) + "--" + pad(name.substr(pos + 2));
+}
+
+struct Segment {
+  std::string name;
+  std::string key;
+  uint64_t bytes = 0;
+  bool operator<(const Segment &other) const { return key < other.key; }
+};
+
+static uint64_t disk_usage(const std::string &path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) return 0;
+  if (!S_ISDIR(st.st_mode)) return st.st_blocks * 512;
+
+  uint64_t bytes = 0;
+  if (DIR *d = opendir(path.c_str())) {
+    while (struct dirent *de = readdir(d)) {
+      if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+      bytes += disk_usage(path + "/" + de->d_name);
+    }
+    closedir(d);
+  }
+  return bytes;
+}
+
+static std::vector<std::string> list_dir(const std::string &path) {
+  std::vector<std::string> ret;
+  if (DIR *d = opendir(path.c_str())) {
+    while (struct dirent *de = readdir(d)) {
+      if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0) ret.push_back(de->d_name);
+    }
+    closedir(d);
+  }
+  return ret;
+}
+
+static void unlink_throttled(const std::string &path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > TRUNCATE_STEP) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      for (off_t size = st.st_size - TRUNCATE_STEP; size > 0 && !do_exit; size -= TRUNCATE_STEP) {
+        if (ftruncate(fd, size) != 0) break;
+        util::sleep_for(TRUNCATE_STEP_SLEEP_MS);
+      }
+      close(fd);
+    }
+  }
+  if (unlink(path.c_str()) != 0) LOGE("deleter: unlink %s failed: %s", path.c_str(), strerror(errno));
+}
+
+static bool remove_throttled(const std::string &path) {
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) return false;
+  if (!S_ISDIR(st.st_mode)) {
+    unlink_throttled(path);
+    return true;
+  }
+  for (auto &name : list_dir(path)) {
+    remove_throttled(path + "/" + name);
+  }
+  return rmdir(path.c_str()) == 0;
+}
+
+class Deleter {
+public:
+  Deleter(const std::string &root) : root(root) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, root.c_str(), IN_CREATE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR) < 0) {
+      LOGE("deleter: can't watch %s, rescanning before every delete: %s", root.c_str(), strerror(errno));
+      inotify_ok = false;
+    }
+    rescan();
+  }
+  ~Deleter() {
+    if (inotify_fd >= 0) close(inotify_fd);
+  }
+
+  void run() {
+    uint64_t last_stats = 0;
+    while (!do_exit) {
+      struct statvfs st;
+      bool out_of_space = false;
+      double free_percent = 100.0;
+      if (statvfs(root.c_str(), &st) == 0 && st.f_blocks > 0) {
+        free_percent = 100.0 * st.f_bavail / st.f_blocks;
+        out_of_space = (uint64_t)st.f_bavail * st.f_frsize < MIN_BYTES || free_percent < MIN_PERCENT;
+      }
+
+      if (out_of_space) {
+        if (!inotify_ok) rescan();
+        delete_one();
+      }
+
+      if (millis_since_boot() - last_stats >= STATS_INTERVAL_MS) {
+        last_stats = millis_since_boot();
+        uint64_t bytes = 0;
+        for (auto &s : segments) bytes += s.bytes;
+        statlog_gauge("deleter_log_mb", (int)(bytes >> 20));
+        statlog_gauge("deleter_segments", (int)segments.size());
+        statlog_gauge("deleter_free_percent", (float)free_percent);
+      }
+
+      // 100ms between deletes, like deleter.py, and a rotation wakes it up early
+      struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN};
+      int ret = poll(&pfd, inotify_ok ? 1 : 0, out_of_space ? 100 : 30000);
+      if (ret > 0) read_events();
+    }
+  }
+
+private:
+  void rescan() {
+    segments.clear();
+    for (auto &name : list_dir(root)) add(name, true);
+  }
+
+  void add(const std::string &name, bool measure) {
+    Segment s = {.name = name, .key = sort_key(name)};
+    if (measure) s.bytes = disk_usage(root + "/" + name);
+    auto it = std::lower_bound(segments.begin(), segments.end(), s);
+    if (it != segments.end() && it->name == name) return;
+    segments.insert(it, std::move(s));
+  }
+
+  void remove(const std::string &name) {
+    auto it = std::find_if(segments.begin(), segments.end(), [&](auto &s) { return s.name == name; });
+    if (it != segments.end()) segments.erase(it);
+  }
+
+  void read_events() {
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + len;) {
+        auto *ev = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + ev->len;
+        if (ev->len == 0) continue;
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+          // the newest segment until now is done with, measure it once
+          if (!segments.empty() && segments.back().key < sort_key(ev->name)) {
+            segments.back().bytes = disk_usage(root + "/" + segments.back().name);
+          }
+          add(ev->name, false);
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+          remove(ev->name);
+        }
+      }
+    }
+  }
+
+  bool has_preserve_xattr(const std::string &name) {
+    char value = 0;
+    return getxattr((root + "/" + name).c_str(), PRESERVE_ATTR_NAME, &value, 1) == 1 && value == PRESERVE_ATTR_VALUE;
+  }
+
+  // the last PRESERVE_COUNT preserved segments and the one before each
+  std::set<std::string> preserved() {
+    std::set<std::string> ret;
+    int n = 0;
+    for (auto it = segments.rbegin(); it != segments.rend() && n < PRESERVE_COUNT; ++it) {
+      if (!has_preserve_xattr(it->name)) continue;
+      n++;
+      size_t pos = it->name.rfind("--");
+      if (pos == std::string::npos || pos == 0) continue;
+      const std::string seg = it->name.substr(pos + 2);
+      if (seg.empty() || !std::all_of(seg.begin(), seg.end(), ::isdigit)) continue;
+      ret.insert(it->name);
+      ret.insert(it->name.substr(0, pos) + "--" + std::to_string(std::stoi(seg) - 1));
+    }
+    return ret;
+  }
+
+  void delete_one() {
+    const std::set<std::string> keep = preserved();
+    std::vector<const Segment *> order;
+    for (auto &s : segments) order.push_back(&s);
+    auto rank = [&](const Segment *s) {
+      bool last = std::any_of(std::begin(DELETE_LAST), std::end(DELETE_LAST), [&](const char *d) { return s->name == d; });
+      return std::make_pair(last, keep.count(s->name) > 0);
+    };
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) { return rank(a) < rank(b); });
+
+    for (const Segment *s : order) {
+      const std::string path = root + "/" + s->name;
+      auto files = list_dir(path);
+      if (std::any_of(files.begin(), files.end(), [](auto &f) { return util::ends_with(f, ".lock"); })) continue;
+
+      const std::string name = s->name;
+      const uint64_t bytes = s->bytes;
+      LOGW("deleter: deleting %s (%.1f MB)", path.c_str(), bytes / 1e6);
+      if (!remove_throttled(path)) {
+        LOGE("deleter: issue deleting %s: %s", path.c_str(), strerror(errno));
+        continue;
+      }
+      // out of the list right away, the inotify event may come after the next statvfs
+      remove(name);
+      statlog_count("deleter_deleted_kb", bytes >> 10);
+      return;
+    }
+  }
+
+  const std::string root;
+  int inotify_fd = -1;
+  bool inotify_ok = true;
+  // in creation order
+  std::vector<Segment> segments;
+};
+
+int main(int argc, char *argv[]) {
+  if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0) {
+    LOGW("deleter: can't set idle I/O priority: %s", strerror(errno));
+  }
+  Deleter deleter(Path::log_root());
+  deleter.run();
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include "system/loggerd/encode_pool.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the pool is shared between processes");
+
+const uint32_t ENCODE_POOL_MAGIC = 0x656e6370;  // "encp"
+const size_t ENCODE_POOL_ALIGN = 4096;
+
+static uint64_t monotonic_ms() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000ULL + t.tv_nsec / 1000000;
+}
+
+static size_t data_offset() {
+  return (sizeof(EncodePoolHeader) + ENCODE_POOL_ALIGN - 1) / ENCODE_POOL_ALIGN * ENCODE_POOL_ALIGN;
+}
+
+std::string encode_pool_path(const std::string &publish_name) {
+  return "/dev/shm/encodepool_" + publish_name;
+}
+
+EncodePool::EncodePool(const std::string &path, size_t slot_size) : path(path) {
+  slot_size = (slot_size + ENCODE_POOL_ALIGN - 1) / ENCODE_POOL_ALIGN * ENCODE_POOL_ALIGN;
+
+  // a new file every time, a loggerd that still has the old one mapped notices the rename
+  const std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) return;
+  fchmod(fd, 0666);
+  if (ftruncate(fd, data_offset() + ENCODE_POOL_SLOTS * slot_size) == 0) {
+    EncodePoolHeader h = {.magic = ENCODE_POOL_MAGIC, .slots = ENCODE_POOL_SLOTS, .slot_size = slot_size};
+    if (pwrite(fd, &h, offsetof(EncodePoolHeader, slot), 0) == (ssize_t)offsetof(EncodePoolHeader, slot) &&
+        map(fd) && rename(tmp.c_str(), path.c_str()) == 0) {
+      close(fd);
+      return;
+    }
+  }
+  close(fd);
+  unlink(tmp.c_str());
+  if (hdr) munmap(hdr, map_size);
+  hdr = nullptr;
+}
+
+EncodePool::EncodePool(const std::string &path) : path(path) {
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) return;
+  map(fd);
+  close(fd);
+}
+
+EncodePool::~EncodePool() {
+  if (hdr) munmap(hdr, map_size);
+}
+
+bool EncodePool::map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < data_offset()) return false;
+
+  EncodePoolHeader h;
+  if (pread(fd, &h, offsetof(EncodePoolHeader, slot), 0) != (ssize_t)offsetof(EncodePoolHeader, slot) ||
+      h.magic != ENCODE_POOL_MAGIC || h.slots != ENCODE_POOL_SLOTS ||
+      (size_t)st.st_size != data_offset() + h.slots * h.slot_size) {
+    return false;
+  }
+  void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) return false;
+  hdr = (EncodePoolHeader *)p;
+  map_size = st.st_size;
+  ino = st.st_ino;
+  return true;
+}
+
+int EncodePool::put(uint32_t encode_id, const uint8_t *data, size_t size) {
+  if (size > hdr->slot_size) return -1;
+
+  const uint64_t now = monotonic_ms();
+  // the oldest slots first, a published packet gets the most time to be taken
+  for (uint32_t i = 0; i < ENCODE_POOL_SLOTS; i++) {
+    const uint32_t idx = (next + i) % ENCODE_POOL_SLOTS;
+    EncodePoolSlot &s = hdr->slot[idx];
+    uint32_t state = s.state.load(std::memory_order_acquire);
+    const bool stale = state != ENCODE_POOL_WRITING && now - s.since_ms.load(std::memory_order_relaxed) > ENCODE_POOL_STALE_MS;
+    if ((state != ENCODE_POOL_FREE && !stale) ||
+        !s.state.compare_exchange_strong(state, ENCODE_POOL_WRITING, std::memory_order_acquire)) {
+      continue;
+    }
+    memcpy((uint8_t *)hdr + data_offset() + idx * hdr->slot_size, data, size);
+    s.size = size;
+    s.encode_id.store(encode_id + 1ULL, std::memory_order_relaxed);
+    s.since_ms.store(now, std::memory_order_relaxed);
+    s.state.store(ENCODE_POOL_PUBLISHED, std::memory_order_release);
+    next = idx + 1;
+    return idx;
+  }
+  return -1;
+}
+
+const uint8_t *EncodePool::take(uint32_t encode_id, size_t size, int &slot) {
+  for (uint32_t idx = 0; idx < ENCODE_POOL_SLOTS; idx++) {
+    EncodePoolSlot &s = hdr->slot[idx];
+    if (s.encode_id.load(std::memory_order_relaxed) != encode_id + 1ULL) continue;
+
+    uint32_t state = ENCODE_POOL_PUBLISHED;
+    if (!s.state.compare_exchange_strong(state, ENCODE_POOL_HELD, std::memory_order_acquire)) continue;
+    // reused for another packet between the id check and taking it
+    if (s.encode_id.load(std::memory_order_relaxed) != encode_id + 1ULL || s.size != size) {
+      s.state.store(ENCODE_POOL_PUBLISHED, std::memory_order_release);
+      continue;
+    }
+    s.since_ms.store(monotonic_ms(), std::memory_order_relaxed);
+    slot = idx;
+    return (const uint8_t *)hdr + data_offset() + idx * hdr->slot_size;
+  }
+  return nullptr;
+}
+
+void EncodePool::release(int slot) {
+  hdr->slot[slot].state.store(ENCODE_POOL_FREE, std::memory_order_release);
+}
+
+bool EncodePool::replaced() const {
+  struct stat st;
+  return stat(path.c_str(), &st) != 0 || st.st_ino != ino;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared memory pool for the packets of the encoders loggerd records. encoderd copies a
+// packet into a free slot and publishes the EncodeData message without data, idx.len and
+// idx.encodeId are what loggerd finds the slot by. loggerd writes the packet to the
+// video file straight from the slot and hands it back, so a keyframe isn't copied
+// through the msgq ring and again out of it.
+//
+// A slot is free, being written, published (the message is on its way) or held by
+// loggerd. When no slot is free, or a packet is bigger than a slot, encoderd sends the
+// data in the message like before. Slots that stay published or held for longer than
+// ENCODE_POOL_STALE_MS had no loggerd to take or release them and are reused.
+
+#define ENCODE_POOL_SLOTS 32
+#define ENCODE_POOL_STALE_MS 10000
+
+enum EncodePoolState : uint32_t {
+  ENCODE_POOL_FREE,
+  ENCODE_POOL_WRITING,
+  ENCODE_POOL_PUBLISHED,
+  ENCODE_POOL_HELD,
+};
+
+struct EncodePoolSlot {
+  std::atomic<uint32_t> state;
+  uint32_t size;
+  std::atomic<uint64_t> encode_id;  // plus one, 0 for a slot that never had a packet
+  std::atomic<uint64_t> since_ms;   // when it was published or taken
+};
+
+struct EncodePoolHeader {
+  uint32_t magic;
+  uint32_t slots;
+  uint64_t slot_size;
+  EncodePoolSlot slot[ENCODE_POOL_SLOTS];
+};
+
+// /dev/shm/encodepool_roadEncodeData for roadEncodeData
+std::string encode_pool_path(const std::string &publish_name);
+
+class EncodePool {
+public:
+  // encoderd creates the pool of an encoder, slots of at least slot_size bytes
+  EncodePool(const std::string &path, size_t slot_size);
+  // loggerd opens it
+  EncodePool(const std::string &path);
+  ~EncodePool();
+  bool valid() const { return hdr != nullptr; }
+
+  // encoderd: the slot the packet was copied to, -1 to send it in the message
+  int put(uint32_t encode_id, const uint8_t *data, size_t size);
+
+  // loggerd: the data of a published packet, null if its slot was taken back
+  const uint8_t *take(uint32_t encode_id, size_t size, int &slot);
+  void release(int slot);
+  // the file was replaced since it was mapped, encoderd restarted
+  bool replaced() const;
+
+private:
+  bool map(int fd);
+
+  const std::string path;
+  EncodePoolHeader *hdr = nullptr;
+  size_t map_size = 0;
+  ino_t ino = 0;
+  uint32_t next = 0;
+};
@@ -1,8 +1,19 @@
 #include "system/loggerd/encoder/encoder.h"
 
+#include <algorithm>
+
 VideoEncoder::VideoEncoder(const EncoderInfo &encoder_info, int in_width, int in_height)
     : encoder_info(encoder_info), in_width(in_width), in_height(in_height) {
   pm.reset(new PubMaster({encoder_info.publish_name}));
+  if (encoder_info.filename != NULL) {
+    // room for keyframes of up to 8 frames of the average size
+    const size_t slot_size = std::max<size_t>(64 * 1024, encoder_info.bitrate / 8 / encoder_info.fps * 8);
+    pool.reset(new EncodePool(encode_pool_path(encoder_info.publish_name), slot_size));
+    if (!pool->valid()) {
+      LOGE("%s: no packet pool, sending packets in the messages", encoder_info.publish_name);
+      pool.reset();
+    }
+  }
 }
 
 void VideoEncoder::publisher_publish(VideoEncoder *e, int segment_num, uint32_t idx, VisionIpcBufExtra &extra,
@@ -19,12 +30,16 @@ void VideoEncoder::publisher_publish(VideoEncoder *e, int segment_num, uint32_t
   edata.setTimestampSof(extra.timestamp_sof);
   edata.setTimestampEof(extra.timestamp_eof);
   edata.setType(e->encoder_info.encode_type);
-  edata.setEncodeId(e->cnt++);
+  const uint32_t encode_id = e->cnt++;
+  edata.setEncodeId(encode_id);
   edata.setSegmentNum(segment_num);
   edata.setSegmentId(idx);
   edata.setFlags(flags);
   edata.setLen(dat.size());
-  edat.setData(dat);
+  // loggerd finds a pooled packet by encodeId and len, see encode_pool.h
+  if (!e->pool || e->pool->put(encode_id, dat.begin(), dat.size()) < 0) {
+    edat.setData(dat);
+  }
   if (flags & V4L2_BUF_FLAG_KEYFRAME) edat.setHeader(header);
 
   auto words = new kj::Array<capnp::word>(capnp::messageToFlatArray(msg));
@@ -9,6 +9,7 @@
 #include "cereal/visionipc/visionipc.h"
 #include "common/queue.h"
 #include "system/camerad/cameras/camera_common.h"
+#include "system/loggerd/encode_pool.h"
 #include "system/loggerd/loggerd.h"
 
 #define V4L2_BUF_FLAG_KEYFRAME 8
@@ -20,6 +21,8 @@ public:
   virtual int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) = 0;
   virtual void encoder_open(const char* path) = 0;
   virtual void encoder_close() = 0;
+  // takes effect from the next frame, encoders without a bitrate ignore it
+  virtual void set_bitrate(int bitrate) {}
 
   static void publisher_publish(VideoEncoder *e, int segment_num, uint32_t idx, VisionIpcBufExtra &extra, unsigned int flags, kj::ArrayPtr<capnp::byte> header, kj::ArrayPtr<capnp::byte> dat);
 
@@ -32,4 +35,6 @@ private:
   // total frames encoded
   int cnt = 0;
   std::unique_ptr<PubMaster> pm;
+  // packets of the encoders loggerd records, null for the livestream ones
+  std::unique_ptr<EncodePool> pool;
 };
@@ -5,9 +5,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <thread>
 
 #define __STDC_CONSTANT_MACROS
 
@@ -24,22 +26,59 @@ extern "C" {
 
 const int env_debug_encoder = (getenv("DEBUG_ENCODER") != NULL) ? atoi(getenv("DEBUG_ENCODER")) : 0;
 
+namespace {
+
+// nearest neighbour scale of interleaved chroma straight into the u and v planes, the
+// same sampling as libyuv's kFilterNone
+void scale_split_uv(const uint8_t *src_uv, int src_stride, int src_width, int src_height,
+                    uint8_t *dst_u, uint8_t *dst_v, int dst_stride, int dst_width, int dst_height) {
+  const int dx = (src_width << 16) / dst_width;
+  const int dy = (src_height << 16) / dst_height;
+  for (int y = 0, sy = dy / 2; y < dst_height; ++y, sy += dy) {
+    const uint8_t *row = src_uv + (sy >> 16) * src_stride;
+    uint8_t *u = dst_u + y * dst_stride;
+    uint8_t *v = dst_v + y * dst_stride;
+    for (int x = 0, sx = dx / 2; x < dst_width; ++x, sx += dx) {
+      const uint8_t *px = row + (sx >> 16) * 2;
+      u[x] = px[0];
+      v[x] = px[1];
+    }
+  }
+}
+
+bool codec_supports(const AVCodec *codec, AVPixelFormat fmt) {
+  for (const AVPixelFormat *p = codec->pix_fmts; p && *p != AV_PIX_FMT_NONE; ++p) {
+    if (*p == fmt) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
 FfmpegEncoder::FfmpegEncoder(const EncoderInfo &encoder_info, int in_width, int in_height)
     : VideoEncoder(encoder_info, in_width, in_height) {
+  codec = avcodec_find_encoder(AV_CODEC_ID_FFVHUFF);
+  assert(codec);
+  scaled = in_width != encoder_info.frame_width || in_height != encoder_info.frame_height;
+
   frame = av_frame_alloc();
   assert(frame);
-  frame->format = AV_PIX_FMT_YUV420P;
+  // the camera's NV12 goes in as it is when nothing needs to change
+  frame->format = (!scaled && codec_supports(codec, AV_PIX_FMT_NV12)) ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
   frame->width = encoder_info.frame_width;
   frame->height = encoder_info.frame_height;
-  frame->linesize[0] = encoder_info.frame_width;
-  frame->linesize[1] = encoder_info.frame_width/2;
-  frame->linesize[2] = encoder_info.frame_width/2;
-
-  convert_buf.resize(in_width * in_height * 3 / 2);
 
-  if (in_width != encoder_info.frame_width || in_height != encoder_info.frame_height) {
-    downscale_buf.resize(encoder_info.frame_width * encoder_info.frame_height * 3 / 2);
+  // y comes from the camera buffer or is scaled straight into its plane,
+  // only u and v need a plane of their own
+  if (frame->format == AV_PIX_FMT_YUV420P) {
+    const int chroma_w = (scaled ? frame->width : in_width) / 2;
+    const int chroma_h = (scaled ? frame->height : in_height) / 2;
+    const size_t y_size = scaled ? frame->width * frame->height : 0;
+    convert_buf.resize(y_size + chroma_w * chroma_h * 2);
   }
+
+  // frames in flight on the encoder threads. FFVHUFF shares no state between frames
+  threads = std::clamp(util::getenv("FFMPEG_ENCODER_THREADS", (int)std::thread::hardware_concurrency()), 1, 8);
 }
 
 FfmpegEncoder::~FfmpegEncoder() {
@@ -48,25 +87,35 @@ FfmpegEncoder::~FfmpegEncoder() {
 }
 
 void FfmpegEncoder::encoder_open(const char* path) {
-  const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_FFVHUFF);
-
   this->codec_ctx = avcodec_alloc_context3(codec);
   assert(this->codec_ctx);
   this->codec_ctx->width = frame->width;
   this->codec_ctx->height = frame->height;
-  this->codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+  this->codec_ctx->pix_fmt = (AVPixelFormat)frame->format;
   this->codec_ctx->time_base = (AVRational){ 1, encoder_info.fps };
+  this->codec_ctx->thread_count = threads;
+  this->codec_ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
   int err = avcodec_open2(this->codec_ctx, codec, NULL);
   assert(err >= 0);
 
   is_open = true;
   segment_num++;
   counter = 0;
+  frames_sent = 0;
+  pending_extra.clear();
 }
 
 void FfmpegEncoder::encoder_close() {
   if (!is_open) return;
 
+  // the frames still on the encoder threads belong to this segment
+  int err = avcodec_send_frame(this->codec_ctx, NULL);
+  if (err < 0) {
+    LOGE("avcodec_send_frame flush error %d", err);
+  } else {
+    receive_packets();
+  }
+
   avcodec_free_context(&codec_ctx);
   is_open = false;
 }
@@ -75,58 +124,61 @@ int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   assert(buf->width == this->in_width);
   assert(buf->height == this->in_height);
 
-  uint8_t *cy = convert_buf.data();
-  uint8_t *cu = cy + in_width * in_height;
-  uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
-  libyuv::NV12ToI420(buf->y, buf->stride,
-                     buf->uv, buf->stride,
-                     cy, in_width,
-                     cu, in_width/2,
-                     cv, in_width/2,
-                     in_width, in_height);
-
-  if (downscale_buf.size() > 0) {
-    uint8_t *out_y = downscale_buf.data();
+  // avcodec_send_frame copies the frame, so it can point into the camera buffer
+  if (frame->format == AV_PIX_FMT_NV12) {
+    frame->data[0] = buf->y;
+    frame->data[1] = buf->uv;
+    frame->linesize[0] = frame->linesize[1] = buf->stride;
+  } else if (!scaled) {
+    uint8_t *cu = convert_buf.data();
+    uint8_t *cv = cu + (in_width / 2) * (in_height / 2);
+    libyuv::SplitUVPlane(buf->uv, buf->stride, cu, in_width/2, cv, in_width/2, in_width/2, in_height/2);
+    frame->data[0] = buf->y;
+    frame->data[1] = cu;
+    frame->data[2] = cv;
+    frame->linesize[0] = buf->stride;
+    frame->linesize[1] = frame->linesize[2] = in_width/2;
+  } else {
+    uint8_t *out_y = convert_buf.data();
     uint8_t *out_u = out_y + frame->width * frame->height;
     uint8_t *out_v = out_u + (frame->width / 2) * (frame->height / 2);
-    libyuv::I420Scale(cy, in_width,
-                      cu, in_width/2,
-                      cv, in_width/2,
-                      in_width, in_height,
-                      out_y, frame->width,
-                      out_u, frame->width/2,
-                      out_v, frame->width/2,
-                      frame->width, frame->height,
-                      libyuv::kFilterNone);
+    libyuv::ScalePlane(buf->y, buf->stride, in_width, in_height,
+                       out_y, frame->width, frame->width, frame->height,
+                       libyuv::kFilterNone);
+    scale_split_uv(buf->uv, buf->stride, in_width/2, in_height/2,
+                   out_u, out_v, frame->width/2, frame->width/2, frame->height/2);
     frame->data[0] = out_y;
     frame->data[1] = out_u;
     frame->data[2] = out_v;
-  } else {
-    frame->data[0] = cy;
-    frame->data[1] = cu;
-    frame->data[2] = cv;
+    frame->linesize[0] = frame->width;
+    frame->linesize[1] = frame->linesize[2] = frame->width/2;
   }
-  frame->pts = counter*50*1000; // 50ms per frame
+  frame->pts = frames_sent*50*1000; // 50ms per frame
 
-  int ret = counter;
+  int ret = frames_sent++;
+  pending_extra.push_back(*extra);
 
   int err = avcodec_send_frame(this->codec_ctx, frame);
   if (err < 0) {
     LOGE("avcodec_send_frame error %d", err);
-    ret = -1;
+    pending_extra.pop_back();
+    return -1;
   }
+  return receive_packets() < 0 ? -1 : ret;
+}
 
+// Publishes the packets that are done. With frame threads they come out a few frames
+// after they went in, in the same order, so each one gets the oldest pending extra.
+int FfmpegEncoder::receive_packets() {
+  int ret = 0;
   AVPacket pkt;
   av_init_packet(&pkt);
   pkt.data = NULL;
   pkt.size = 0;
-  while (ret >= 0) {
-    err = avcodec_receive_packet(this->codec_ctx, &pkt);
-    if (err == AVERROR_EOF) {
-      break;
-    } else if (err == AVERROR(EAGAIN)) {
+  while (true) {
+    int err = avcodec_receive_packet(this->codec_ctx, &pkt);
+    if (err == AVERROR_EOF || err == AVERROR(EAGAIN)) {
       // Encoder might need a few frames on startup to get started. Keep going
-      ret = 0;
       break;
     } else if (err < 0) {
       LOGE("avcodec_receive_packet error %d", err);
@@ -134,17 +186,21 @@ int FfmpegEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
       break;
     }
 
+    assert(!pending_extra.empty());
+    VisionIpcBufExtra extra = pending_extra.front();
+    pending_extra.pop_front();
+
     if (env_debug_encoder) {
-      printf("%20s got %8d bytes flags %8x idx %4d id %8d\n", encoder_info.publish_name, pkt.size, pkt.flags, counter, extra->frame_id);
+      printf("%20s got %8d bytes flags %8x idx %4d id %8d\n", encoder_info.publish_name, pkt.size, pkt.flags, counter, extra.frame_id);
     }
 
-    publisher_publish(this, segment_num, counter, *extra,
+    publisher_publish(this, segment_num, counter, extra,
       (pkt.flags & AV_PKT_FLAG_KEY) ? V4L2_BUF_FLAG_KEYFRAME : 0,
       kj::arrayPtr<capnp::byte>(pkt.data, (size_t)0), // TODO: get the header
       kj::arrayPtr<capnp::byte>(pkt.data, pkt.size));
 
     counter++;
+    av_packet_unref(&pkt);
   }
-  av_packet_unref(&pkt);
   return ret;
 }
@@ -2,6 +2,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <string>
 #include <vector>
 
@@ -23,12 +24,20 @@ public:
   void encoder_close();
 
 private:
+  int receive_packets();
+
   int segment_num = -1;
   int counter = 0;
+  int frames_sent = 0;
   bool is_open = false;
+  bool scaled = false;
+  int threads = 1;
 
+  const AVCodec *codec = NULL;
   AVCodecContext *codec_ctx;
   AVFrame *frame = NULL;
+  // extras of the frames sent that no packet came out for yet
+  std::deque<VisionIpcBufExtra> pending_extra;
+  // the planes that can't point into the camera buffer
   std::vector<uint8_t> convert_buf;
-  std::vector<uint8_t> downscale_buf;
 };
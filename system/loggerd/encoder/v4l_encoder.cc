@@ -27,11 +27,11 @@ static void checked_ioctl(int fd, unsigned long request, void *argp) {
   }
 }
 
-static void dequeue_buffer(int fd, v4l2_buf_type buf_type, unsigned int *index=NULL, unsigned int *bytesused=NULL, unsigned int *flags=NULL, struct timeval *timestamp=NULL) {
+static void dequeue_buffer(int fd, v4l2_buf_type buf_type, uint32_t memory, unsigned int *index=NULL, unsigned int *bytesused=NULL, unsigned int *flags=NULL, struct timeval *timestamp=NULL) {
   v4l2_plane plane = {0};
   v4l2_buffer v4l_buf = {
     .type = buf_type,
-    .memory = V4L2_MEMORY_USERPTR,
+    .memory = memory,
     .m = { .planes = &plane, },
     .length = 1,
   };
@@ -44,18 +44,23 @@ static void dequeue_buffer(int fd, v4l2_buf_type buf_type, unsigned int *index=N
   assert(v4l_buf.m.planes[0].data_offset == 0);
 }
 
-static void queue_buffer(int fd, v4l2_buf_type buf_type, unsigned int index, VisionBuf *buf, struct timeval timestamp={}) {
+static void queue_buffer(int fd, v4l2_buf_type buf_type, uint32_t memory, unsigned int index, VisionBuf *buf, struct timeval timestamp={}) {
   v4l2_plane plane = {
     .length = (unsigned int)buf->len,
-    .m = { .userptr = (unsigned long)buf->addr, },
     .bytesused = (uint32_t)buf->len,
     .reserved = {(unsigned int)buf->fd}
   };
+  if (memory == V4L2_MEMORY_DMABUF) {
+    // the driver imports the ion buffer itself, the frame is never mapped for the encoder
+    plane.m.fd = buf->fd;
+  } else {
+    plane.m.userptr = (unsigned long)buf->addr;
+  }
 
   v4l2_buffer v4l_buf = {
     .type = buf_type,
     .index = index,
-    .memory = V4L2_MEMORY_USERPTR,
+    .memory = memory,
     .m = { .planes = &plane, },
     .length = 1,
     .flags = V4L2_BUF_FLAG_TIMESTAMP_COPY,
@@ -65,13 +70,21 @@ static void queue_buffer(int fd, v4l2_buf_type buf_type, unsigned int index, Vis
   checked_ioctl(fd, VIDIOC_QBUF, &v4l_buf);
 }
 
-static void request_buffers(int fd, v4l2_buf_type buf_type, unsigned int count) {
+static int try_request_buffers(int fd, v4l2_buf_type buf_type, uint32_t memory, unsigned int count) {
   struct v4l2_requestbuffers reqbuf = {
     .type = buf_type,
-    .memory = V4L2_MEMORY_USERPTR,
+    .memory = memory,
     .count = count
   };
-  checked_ioctl(fd, VIDIOC_REQBUFS, &reqbuf);
+  return util::safe_ioctl(fd, VIDIOC_REQBUFS, &reqbuf);
+}
+
+static void request_buffers(int fd, v4l2_buf_type buf_type, uint32_t memory, unsigned int count) {
+  int ret = try_request_buffers(fd, buf_type, memory, count);
+  if (ret != 0) {
+    LOGE("VIDIOC_REQBUFS failed with error %d (%d %d)", errno, buf_type, memory);
+    assert(0);
+  }
 }
 
 void V4LEncoder::dequeue_handler(V4LEncoder *e) {
@@ -112,7 +125,7 @@ void V4LEncoder::dequeue_handler(V4LEncoder *e) {
     if (pfd.revents & POLLIN) {
       unsigned int bytesused, flags, index;
       struct timeval timestamp;
-      dequeue_buffer(e->fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, &index, &bytesused, &flags, &timestamp);
+      dequeue_buffer(e->fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, V4L2_MEMORY_USERPTR, &index, &bytesused, &flags, &timestamp);
       e->buf_out[index].sync(VISIONBUF_SYNC_FROM_DEVICE);
       uint8_t *buf = (uint8_t*)e->buf_out[index].addr;
       int64_t ts = timestamp.tv_sec * 1000000 + timestamp.tv_usec;
@@ -137,12 +150,12 @@ void V4LEncoder::dequeue_handler(V4LEncoder *e) {
       }
 
       // requeue the buffer
-      queue_buffer(e->fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, index, &e->buf_out[index]);
+      queue_buffer(e->fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, V4L2_MEMORY_USERPTR, index, &e->buf_out[index]);
     }
 
     if (pfd.revents & POLLOUT) {
       unsigned int index;
-      dequeue_buffer(e->fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, &index);
+      dequeue_buffer(e->fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, e->in_memory, &index);
       e->free_buf_in.push(index);
     }
   }
@@ -249,9 +262,14 @@ V4LEncoder::V4LEncoder(const EncoderInfo &encoder_info, int in_width, int in_hei
     }
   }
 
-  // allocate buffers
-  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, BUF_OUT_COUNT);
-  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, BUF_IN_COUNT);
+  // allocate buffers. camerad's frames are imported as dmabufs when the driver supports it
+  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, V4L2_MEMORY_USERPTR, BUF_OUT_COUNT);
+  in_memory = V4L2_MEMORY_DMABUF;
+  if (try_request_buffers(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, V4L2_MEMORY_DMABUF, BUF_IN_COUNT) != 0) {
+    LOGW("encoder %s: no dmabuf import (error %d), using userptr", encoder_info.publish_name, errno);
+    in_memory = V4L2_MEMORY_USERPTR;
+    request_buffers(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, in_memory, BUF_IN_COUNT);
+  }
 
   // start encoder
   v4l2_buf_type buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
@@ -262,7 +280,7 @@ V4LEncoder::V4LEncoder(const EncoderInfo &encoder_info, int in_width, int in_hei
   // queue up output buffers
   for (unsigned int i = 0; i < BUF_OUT_COUNT; i++) {
     buf_out[i].allocate(fmt_out.fmt.pix_mp.plane_fmt[0].sizeimage);
-    queue_buffer(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, i, &buf_out[i]);
+    queue_buffer(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, V4L2_MEMORY_USERPTR, i, &buf_out[i]);
   }
   // queue up input buffers
   for (unsigned int i = 0; i < BUF_IN_COUNT; i++) {
@@ -288,11 +306,17 @@ int V4LEncoder::encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra) {
   // push buffer
   extras.push(*extra);
   //buf->sync(VISIONBUF_SYNC_TO_DEVICE);
-  queue_buffer(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, buffer_in, buf, timestamp);
+  queue_buffer(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, in_memory, buffer_in, buf, timestamp);
 
   return this->counter++;
 }
 
+void V4LEncoder::set_bitrate(int bitrate) {
+  // the venc firmware takes bitrate changes while streaming
+  struct v4l2_control ctrl = { .id = V4L2_CID_MPEG_VIDEO_BITRATE, .value = bitrate};
+  checked_ioctl(fd, VIDIOC_S_CTRL, &ctrl);
+}
+
 void V4LEncoder::encoder_close() {
   if (this->is_open) {
     // pop all the frames before closing, then put the buffers back
@@ -312,10 +336,10 @@ V4LEncoder::~V4LEncoder() {
   encoder_close();
   v4l2_buf_type buf_type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
   checked_ioctl(fd, VIDIOC_STREAMOFF, &buf_type);
-  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, 0);
+  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, in_memory, 0);
   buf_type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
   checked_ioctl(fd, VIDIOC_STREAMOFF, &buf_type);
-  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, 0);
+  request_buffers(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, V4L2_MEMORY_USERPTR, 0);
   close(fd);
 
   for (int i = 0; i < BUF_OUT_COUNT; i++) {
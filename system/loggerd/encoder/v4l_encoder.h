@@ -13,6 +13,7 @@ public:
   int encode_frame(VisionBuf* buf, VisionIpcBufExtra *extra);
   void encoder_open(const char* path);
   void encoder_close();
+  void set_bitrate(int bitrate);
 private:
   int fd;
 
@@ -20,11 +21,13 @@ private:
   int segment_num = -1;
   int counter = 0;
 
-  SafeQueue<VisionIpcBufExtra> extras;
+  BlockingSPSCQueue<VisionIpcBufExtra, 16> extras;
 
   static void dequeue_handler(V4LEncoder *e);
   std::thread dequeue_handler_thread;
 
   VisionBuf buf_out[BUF_OUT_COUNT];
-  SafeQueue<unsigned int> free_buf_in;
+  // pushed by the dequeue thread and by encoder_close
+  BlockingMPMCQueue<unsigned int, 8> free_buf_in;
+  uint32_t in_memory;  // v4l2_memory camerad's frames are passed in with
 };
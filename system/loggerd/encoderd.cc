@@ -1,5 +1,14 @@
+#include <sys/statvfs.h>
+
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
 
+#include "common/placement.h"
 #include "system/loggerd/loggerd.h"
 
 #ifdef QCOM2
@@ -18,12 +27,12 @@ struct EncoderdState {
   // Sync logic for startup
   std::atomic<int> encoders_ready = 0;
   std::atomic<uint32_t> start_frame_id = 0;
-  bool camera_ready[WideRoadCam + 1] = {};
-  bool camera_synced[WideRoadCam + 1] = {};
+  bool camera_ready[VISION_STREAM_MAX] = {};
+  bool camera_synced[VISION_STREAM_MAX] = {};
 };
 
 // Handle initial encoder syncing by waiting for all encoders to reach the same frame id
-bool sync_encoders(EncoderdState *s, CameraType cam_type, uint32_t frame_id) {
+bool sync_encoders(EncoderdState *s, VisionStreamType cam_type, uint32_t frame_id) {
   if (s->camera_synced[cam_type]) return true;
 
   if (s->max_waiting > 1 && s->encoders_ready != s->max_waiting) {
@@ -43,14 +52,87 @@ bool sync_encoders(EncoderdState *s, CameraType cam_type, uint32_t frame_id) {
   }
 }
 
+static double log_root_free_percent() {
+  struct statvfs st;
+  if (statvfs(Path::log_root().c_str(), &st) != 0 || st.f_blocks == 0) {
+    return 100.0;
+  }
+  return 100.0 * st.f_bavail / st.f_blocks;
+}
+
+// full bitrate while there's room, scaled linearly down to min_bitrate as the
+// free space gets to where the deleter kicks in
+static int storage_bitrate(const EncoderInfo &info, double free_percent) {
+  if (info.min_bitrate <= 0) return info.bitrate;
+  double k = (free_percent - BITRATE_MIN_FREE_PERCENT) / (BITRATE_FULL_FREE_PERCENT - BITRATE_MIN_FREE_PERCENT);
+  k = std::clamp(k, 0.0, 1.0);
+  // round to 100kbps so small changes in free space don't cause a change every segment
+  int bitrate = info.min_bitrate + k * (info.bitrate - info.min_bitrate);
+  return bitrate / 100000 * 100000;
+}
+
+// Runs one encoder's work on its own thread, so all the encoders of a camera
+// get a frame at the same time instead of one after the other, and the vipc
+// buffer is released sooner. The encoders are independent sessions.
+class EncoderWorker {
+public:
+  EncoderWorker(const std::string &name) : thread(&EncoderWorker::run, this, name) {}
+  ~EncoderWorker() {
+    {
+      std::lock_guard lk(lock);
+      stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+  }
+
+  void submit(std::function<void()> f) {
+    {
+      std::lock_guard lk(lock);
+      assert(!busy);
+      task = std::move(f);
+      busy = true;
+    }
+    cv.notify_all();
+  }
+
+  void wait() {
+    std::unique_lock lk(lock);
+    cv.wait(lk, [&]() { return !busy; });
+  }
+
+private:
+  void run(std::string name) {
+    util::set_thread_name(name.c_str());
+    std::unique_lock lk(lock);
+    while (true) {
+      cv.wait(lk, [&]() { return busy || stopping; });
+      if (!busy) break;
+      lk.unlock();
+      task();
+      lk.lock();
+      task = nullptr;
+      busy = false;
+      cv.notify_all();
+    }
+  }
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::function<void()> task;
+  bool busy = false, stopping = false;
+  std::thread thread;
+};
 
 void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
   util::set_thread_name(cam_info.thread_name);
 
   std::vector<std::unique_ptr<Encoder>> encoders;
+  std::vector<std::unique_ptr<EncoderWorker>> workers;
   VisionIpcClient vipc_client = VisionIpcClient("camerad", cam_info.stream_type, false);
 
   int cur_seg = 0;
+  std::vector<int> bitrates;
   while (!do_exit) {
     if (!vipc_client.connect(false)) {
       util::sleep_for(5);
@@ -66,9 +148,26 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       for (const auto &encoder_info : cam_info.encoder_infos) {
         auto &e = encoders.emplace_back(new Encoder(encoder_info, buf_info.width, buf_info.height));
         e->encoder_open(nullptr);
+        bitrates.push_back(encoder_info.bitrate);
+        // a single encoder runs on this thread
+        if (cam_info.encoder_infos.size() > 1) {
+          workers.emplace_back(new EncoderWorker(encoder_info.publish_name));
+        }
       }
     }
 
+    // runs f on every encoder in parallel, returns once they're all done
+    auto for_each_encoder = [&](const std::function<void(Encoder &)> &f) {
+      if (workers.empty()) {
+        for (auto &e : encoders) f(*e);
+        return;
+      }
+      for (int i = 0; i < encoders.size(); ++i) {
+        workers[i]->submit([&f, e = encoders[i].get()]() { f(*e); });
+      }
+      for (auto &w : workers) w->wait();
+    };
+
     bool lagging = false;
     while (!do_exit) {
       VisionIpcBufExtra extra;
@@ -76,7 +175,9 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       if (buf == nullptr) continue;
 
       // detect loop around and drop the frames
-      if (buf->get_frame_id() != extra.frame_id) {
+      buf->acquire();
+      if (!buf->is_intact() || buf->get_frame_id() != extra.frame_id) {
+        buf->release();
         if (!lagging) {
           LOGE("encoder %s lag  buffer id: %" PRIu64 " extra id: %d", cam_info.thread_name, buf->get_frame_id(), extra.frame_id);
           lagging = true;
@@ -85,29 +186,42 @@ void encoder_thread(EncoderdState *s, const LogCameraInfo &cam_info) {
       }
       lagging = false;
 
-      if (!sync_encoders(s, cam_info.type, extra.frame_id)) {
+      if (!sync_encoders(s, cam_info.stream_type, extra.frame_id) || do_exit) {
+        buf->release();
         continue;
       }
-      if (do_exit) break;
 
       // do rotation if required
       const int frames_per_seg = SEGMENT_LENGTH * MAIN_FPS;
       if (cur_seg >= 0 && extra.frame_id >= ((cur_seg + 1) * frames_per_seg) + s->start_frame_id) {
-        for (auto &e : encoders) {
-          e->encoder_close();
-          e->encoder_open(NULL);
-        }
+        for_each_encoder([](Encoder &e) {
+          e.encoder_close();
+          e.encoder_open(NULL);
+        });
         ++cur_seg;
+
+        // bitrate only changes on segment boundaries
+        const double free_percent = log_root_free_percent();
+        for (int i = 0; i < encoders.size(); ++i) {
+          const EncoderInfo &info = cam_info.encoder_infos[i];
+          int bitrate = storage_bitrate(info, free_percent);
+          if (bitrate != bitrates[i]) {
+            LOGW("encoder %s: bitrate %d -> %d, %.1f%% free", info.publish_name, bitrates[i], bitrate, free_percent);
+            encoders[i]->set_bitrate(bitrate);
+            bitrates[i] = bitrate;
+          }
+        }
       }
 
       // encode a frame
-      for (int i = 0; i < encoders.size(); ++i) {
-        int out_id = encoders[i]->encode_frame(buf, &extra);
+      for_each_encoder([&](Encoder &e) {
+        int out_id = e.encode_frame(buf, &extra);
 
         if (out_id == -1) {
           LOGE("Failed to encode frame. frame_id: %d", extra.frame_id);
         }
-      }
+      });
+      buf->release();
     }
   }
 }
@@ -126,13 +240,31 @@ void encoderd_thread(const LogCameraInfo (&cameras)[N]) {
   }
 
   if (!streams.empty()) {
+    // the qcamera is encoded from camerad's downscaled stream when it's available
+    auto is_qcam = [](const EncoderInfo &e) { return strcmp(e.publish_name, qcam_encoder_info.publish_name) == 0; };
+    const bool has_qcam = streams.count(VISION_STREAM_ROAD_QCAM) && std::any_of(std::begin(cameras), std::end(cameras), [&](auto &cam) {
+      return std::any_of(cam.encoder_infos.begin(), cam.encoder_infos.end(), is_qcam);
+    });
+
     std::vector<std::thread> encoder_threads;
     for (auto stream : streams) {
-      auto it = std::find_if(std::begin(cameras), std::end(cameras),
-                             [stream](auto &cam) { return cam.stream_type == stream; });
-      assert(it != std::end(cameras));
+      LogCameraInfo cam_info;
+      if (has_qcam && stream == VISION_STREAM_ROAD_QCAM) {
+        cam_info = qcam_camera_info;
+      } else {
+        auto it = std::find_if(std::begin(cameras), std::end(cameras),
+                               [stream](auto &cam) { return cam.stream_type == stream; });
+        // derived streams without an encoder
+        if (it == std::end(cameras)) continue;
+        cam_info = *it;
+      }
+
+      if (has_qcam && stream == VISION_STREAM_ROAD) {
+        auto &infos = cam_info.encoder_infos;
+        infos.erase(std::remove_if(infos.begin(), infos.end(), is_qcam), infos.end());
+      }
       ++s.max_waiting;
-      encoder_threads.push_back(std::thread(encoder_thread, &s, *it));
+      encoder_threads.push_back(std::thread(encoder_thread, &s, cam_info));
     }
 
     for (auto &t : encoder_threads) t.join();
@@ -140,13 +272,8 @@ void encoderd_thread(const LogCameraInfo (&cameras)[N]) {
 }
 
 int main(int argc, char* argv[]) {
-  if (!Hardware::PC()) {
-    int ret;
-    ret = util::set_realtime_priority(52);
-    assert(ret == 0);
-    ret = util::set_core_affinity({3});
-    assert(ret == 0);
-  }
+  int ret = apply_placement("encoderd");
+  assert(ret == 0);
   if (argc > 1) {
     std::string arg1(argv[1]);
     if (arg1 == "--stream") {
@@ -1,9 +1,13 @@
 #include "system/loggerd/logger.h"
 
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <ftw.h>
 
+#include <zstd.h>
+
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstdint>
@@ -14,6 +18,7 @@
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <streambuf>
 #include <string>
 #include <vector>
@@ -22,8 +27,271 @@
 #include "common/swaglog.h"
 #include "common/version.h"
 
+// ***** direct io log files *****
+
+DirectFile::DirectFile(const char* path) {
+  fd = HANDLE_EINTR(open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0664));
+  if (fd < 0 && errno == EINVAL) {
+    // tmpfs and some fuse filesystems don't support O_DIRECT
+    LOGW("no O_DIRECT for %s, using buffered writes", path);
+    direct = false;
+    fd = HANDLE_EINTR(open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0664));
+  }
+  assert(fd >= 0);
+
+  int err = posix_memalign((void**)&buf, LOGGER_DIRECT_ALIGN, LOGGER_DIRECT_BLOCK_SIZE);
+  assert(err == 0);
+}
+
+DirectFile::~DirectFile() {
+  if (buf_len > 0) {
+    // O_DIRECT needs aligned lengths, pad the tail and truncate it off again
+    size_t len = buf_len;
+    size_t aligned = direct ? (len + LOGGER_DIRECT_ALIGN - 1) & ~(size_t)(LOGGER_DIRECT_ALIGN - 1) : len;
+    memset(buf + len, 0, aligned - len);
+    write_block(aligned);
+    offset -= aligned - len;
+    int err = ftruncate(fd, offset);
+    assert(err == 0);
+  }
+
+  // segment boundary: wait for everything written so far to reach the disk
+  int err = sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+  if (err != 0) {
+    LOGW("sync_file_range failed: %s", strerror(errno));
+  }
+  free(buf);
+  err = close(fd);
+  assert(err == 0);
+}
+
+void DirectFile::write(void* data, size_t size) {
+  const uint8_t *p = (const uint8_t*)data;
+  while (size > 0) {
+    size_t n = std::min(size, (size_t)LOGGER_DIRECT_BLOCK_SIZE - buf_len);
+    memcpy(buf + buf_len, p, n);
+    buf_len += n;
+    p += n;
+    size -= n;
+    if (buf_len == LOGGER_DIRECT_BLOCK_SIZE) {
+      write_block(LOGGER_DIRECT_BLOCK_SIZE);
+    }
+  }
+}
+
+void DirectFile::write_block(size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    ssize_t n = HANDLE_EINTR(pwrite(fd, buf + written, len - written, offset + written));
+    assert(n > 0);
+    written += n;
+  }
+  if (!direct) {
+    // start writeback now instead of letting dirty pages pile up
+    sync_file_range(fd, offset, len, SYNC_FILE_RANGE_WRITE);
+  }
+  offset += len;
+  buf_len = 0;
+}
+
+// ***** zstd seekable log files *****
+
+// zstd seekable format, see contrib/seekable_format in the zstd repo
+const uint32_t ZSTD_SKIPPABLE_MAGIC = 0x184D2A5E;
+const uint32_t ZSTD_SEEKABLE_MAGIC = 0x8F92EAB1;
+
+ZstdFile::ZstdFile(const char* path, int level) : path(path), file(path), level(level) {
+  frame.reserve(LOGGER_ZST_FRAME_SIZE + (1 << 16));
+  thread = std::thread(&ZstdFile::compress_thread, this);
+}
+
+ZstdFile::~ZstdFile() {
+  flush_frame();
+  {
+    std::lock_guard lk(lock);
+    stop = true;
+  }
+  cv.notify_all();
+  thread.join();
+
+  // seek table, in a skippable frame so it's ignored by regular decompressors
+  std::vector<uint32_t> table = {ZSTD_SKIPPABLE_MAGIC, (uint32_t)(seek_table.size() * 8 + 9)};
+  for (auto &[compressed, decompressed] : seek_table) {
+    table.push_back(compressed);
+    table.push_back(decompressed);
+  }
+  table.push_back(seek_table.size());
+  file.write(table.data(), table.size() * sizeof(uint32_t));
+  uint8_t descriptor = 0;  // no checksums
+  file.write(&descriptor, 1);
+  uint32_t magic = ZSTD_SEEKABLE_MAGIC;
+  file.write(&magic, sizeof(magic));
+
+  write_index();
+}
+
+void ZstdFile::index(uint64_t mono_time, uint16_t which) {
+  if (mono_time != 0) {
+    if (cur_index.first_mono_time == 0) cur_index.first_mono_time = mono_time;
+    cur_index.first_mono_time = std::min(cur_index.first_mono_time, mono_time);
+    cur_index.last_mono_time = std::max(cur_index.last_mono_time, mono_time);
+  }
+  if (which < sizeof(cur_index.services) * 8) {
+    cur_index.services[which / 8] |= 1 << (which % 8);
+  }
+  cur_index.msgs++;
+}
+
+void ZstdFile::write_index() {
+  // frames are compressed in order, so the seek table lines up with the index
+  assert(seek_table.size() == frame_index.size());
+  uint64_t compressed_offset = 0;
+  for (int i = 0; i < frame_index.size(); i++) {
+    frame_index[i].compressed_offset = compressed_offset;
+    frame_index[i].compressed_size = seek_table[i].first;
+    compressed_offset += seek_table[i].first;
+  }
+
+  LogIndexHeader header = {
+    .magic = LOGGER_INDEX_MAGIC,
+    .version = LOGGER_INDEX_VERSION,
+    .num_frames = (uint32_t)frame_index.size(),
+    .entry_size = sizeof(LogIndexEntry),
+  };
+  RawFile index_file((path + ".idx").c_str());
+  index_file.write(&header, sizeof(header));
+  index_file.write(frame_index.data(), frame_index.size() * sizeof(LogIndexEntry));
+}
+
+void ZstdFile::write(void* data, size_t size) {
+  frame.append((const char*)data, size);
+  if (++frame_msgs >= LOGGER_ZST_FRAME_MSGS || frame.size() >= LOGGER_ZST_FRAME_SIZE) {
+    flush_frame();
+  }
+}
+
+void ZstdFile::flush_frame() {
+  if (frame.empty()) return;
+
+  cur_index.decompressed_offset = decompressed_offset;
+  cur_index.decompressed_size = frame.size();
+  decompressed_offset += frame.size();
+  frame_index.push_back(cur_index);
+  cur_index = {};
+
+  std::unique_lock lk(lock);
+  if (queue.size() >= LOGGER_ZST_MAX_QUEUED) {
+    LOGW("zstd compression falling behind, %zu frames queued", queue.size());
+    cv.wait(lk, [&]() { return queue.size() < LOGGER_ZST_MAX_QUEUED; });
+  }
+  queue.push_back(std::move(frame));
+  if (!free_buffers.empty()) {
+    frame = std::move(free_buffers.back());
+    free_buffers.pop_back();
+  } else {
+    frame = std::string();
+    frame.reserve(LOGGER_ZST_FRAME_SIZE + (1 << 16));
+  }
+  frame.clear();
+  frame_msgs = 0;
+  lk.unlock();
+  cv.notify_all();
+}
+
+void ZstdFile::compress_thread() {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  assert(cctx != nullptr);
+  std::string out;
+
+  while (true) {
+    std::string in;
+    {
+      std::unique_lock lk(lock);
+      cv.wait(lk, [&]() { return stop || !queue.empty(); });
+      if (queue.empty()) break;
+      in = std::move(queue.front());
+      queue.pop_front();
+    }
+    cv.notify_all();
+
+    out.resize(ZSTD_compressBound(in.size()));
+    size_t n = ZSTD_compressCCtx(cctx, out.data(), out.size(), in.data(), in.size(), level);
+    assert(!ZSTD_isError(n));
+    file.write(out.data(), n);
+
+    std::lock_guard lk(lock);
+    seek_table.emplace_back(n, in.size());
+    free_buffers.push_back(std::move(in));
+  }
+  ZSTD_freeCCtx(cctx);
+}
+
 // ***** log metadata *****
+
+// What goes into initData besides the wall time. The parts that can't change while the
+// process runs are gathered once, and the params are only read again once the params
+// version moved. With the shared params cache that refresh is memory reads, only values
+// too large for it come from the files.
+struct InitDataCache {
+  std::mutex lock;
+  bool gathered = false;
+  std::vector<std::string> kernel_args;
+  std::string kernel_version;
+  std::string os_version;
+  std::vector<std::pair<std::string, std::string>> commands;
+
+  bool params_read = false;
+  uint32_t params_version = 0;
+  std::map<std::string, std::string> params_map;
+};
+
+static void init_data_gather(InitDataCache &c) {
+  // log kernel args
+  std::ifstream cmdline_stream("/proc/cmdline");
+  std::string buf;
+  while (cmdline_stream >> buf) {
+    c.kernel_args.push_back(buf);
+  }
+
+  c.kernel_version = util::read_file("/proc/version");
+  c.os_version = util::read_file("/VERSION");
+
+  // log commands
+  std::vector<std::string> log_commands = {
+    "df -h",  // usage for all filesystems
+  };
+  for (auto &cmd : log_commands) {
+    c.commands.push_back({cmd, util::check_output(cmd)});
+  }
+  for (auto &[key, value] : Hardware::get_init_logs()) {
+    c.commands.push_back({key, value});
+  }
+  c.gathered = true;
+}
+
+static void init_data_refresh_params(InitDataCache &c, Params &params) {
+  // taken before reading, a change in between is picked up by the next build
+  const uint32_t version = params.version();
+  if (!c.params_read) {
+    c.params_map = params.readAll();
+    c.params_read = true;
+  } else if (version != c.params_version) {
+    for (const auto &key : params.allKeys()) {
+      std::string value = params.get(key);
+      if (value.empty()) {
+        c.params_map.erase(key);
+      } else {
+        c.params_map[key] = std::move(value);
+      }
+    }
+  }
+  c.params_version = version;
+}
+
 kj::Array<capnp::word> logger_build_init_data() {
+  static InitDataCache cache;
+  std::lock_guard lk(cache.lock);
+
   uint64_t wall_time = nanos_since_epoch();
 
   MessageBuilder msg;
@@ -34,30 +302,25 @@ kj::Array<capnp::word> logger_build_init_data() {
   init.setDirty(!getenv("CLEAN"));
   init.setDeviceType(Hardware::get_device_type());
 
-  // log kernel args
-  std::ifstream cmdline_stream("/proc/cmdline");
-  std::vector<std::string> kernel_args;
-  std::string buf;
-  while (cmdline_stream >> buf) {
-    kernel_args.push_back(buf);
-  }
+  if (!cache.gathered) init_data_gather(cache);
 
-  auto lkernel_args = init.initKernelArgs(kernel_args.size());
-  for (int i=0; i<kernel_args.size(); i++) {
-    lkernel_args.set(i, kernel_args[i]);
+  auto lkernel_args = init.initKernelArgs(cache.kernel_args.size());
+  for (int i=0; i<cache.kernel_args.size(); i++) {
+    lkernel_args.set(i, cache.kernel_args[i]);
   }
 
-  init.setKernelVersion(util::read_file("/proc/version"));
-  init.setOsVersion(util::read_file("/VERSION"));
+  init.setKernelVersion(cache.kernel_version);
+  init.setOsVersion(cache.os_version);
 
   // log params
   auto params = Params();
-  std::map<std::string, std::string> params_map = params.readAll();
+  init_data_refresh_params(cache, params);
+  auto &params_map = cache.params_map;
 
   init.setGitCommit(params_map["GitCommit"]);
   init.setGitBranch(params_map["GitBranch"]);
   init.setGitRemote(params_map["GitRemote"]);
-  init.setPassive(params.getBool("Passive"));
+  init.setPassive(params_map["Passive"] == "1");
   init.setDongleId(params_map["DongleId"]);
 
   auto lparams = init.initParams().initEntries(params_map.size());
@@ -71,29 +334,12 @@ kj::Array<capnp::word> logger_build_init_data() {
     j++;
   }
 
-  // log commands
-  std::vector<std::string> log_commands = {
-    "df -h",  // usage for all filesystems
-  };
-
-  auto hw_logs = Hardware::get_init_logs();
-
-  auto commands = init.initCommands().initEntries(log_commands.size() + hw_logs.size());
-  for (int i = 0; i < log_commands.size(); i++) {
-    auto lentry = commands[i];
-
-    lentry.setKey(log_commands[i]);
-
-    const std::string result = util::check_output(log_commands[i]);
-    lentry.setValue(capnp::Data::Reader((const kj::byte*)result.data(), result.size()));
-  }
-
-  int i = log_commands.size();
-  for (auto &[key, value] : hw_logs) {
+  auto commands = init.initCommands().initEntries(cache.commands.size());
+  for (int i = 0; i < cache.commands.size(); i++) {
     auto lentry = commands[i];
-    lentry.setKey(key);
+    lentry.setKey(cache.commands[i].first);
+    const std::string &value = cache.commands[i].second;
     lentry.setValue(capnp::Data::Reader((const kj::byte*)value.data(), value.size()));
-    i++;
   }
 
   return capnp::messageToFlatArray(msg);
@@ -109,6 +355,7 @@ std::string logger_get_route_name() {
 }
 
 void log_init_data(LoggerState *s) {
+  if (s->init_data_pending.valid()) s->init_data = s->init_data_pending.get();
   auto bytes = s->init_data.asBytes();
   logger_log(s, bytes.begin(), bytes.size(), s->has_qlog);
 }
@@ -132,7 +379,8 @@ void logger_init(LoggerState *s, bool has_qlog) {
   s->part = -1;
   s->has_qlog = has_qlog;
   s->route_name = logger_get_route_name();
-  s->init_data = logger_build_init_data();
+  // built while the caller sets up the rest, the first segment waits for it
+  s->init_data_pending = std::async(std::launch::async, logger_build_init_data);
 }
 
 static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
@@ -148,8 +396,8 @@ static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
   snprintf(h->segment_path, sizeof(h->segment_path),
           "%s/%s--%d", root_path, s->route_name.c_str(), s->part);
 
-  snprintf(h->log_path, sizeof(h->log_path), "%s/rlog", h->segment_path);
-  snprintf(h->qlog_path, sizeof(h->qlog_path), "%s/qlog", h->segment_path);
+  snprintf(h->log_path, sizeof(h->log_path), "%s/rlog.zst", h->segment_path);
+  snprintf(h->qlog_path, sizeof(h->qlog_path), "%s/qlog.zst", h->segment_path);
   snprintf(h->lock_path, sizeof(h->lock_path), "%s.lock", h->log_path);
   h->end_sentinel_type = SentinelType::END_OF_SEGMENT;
   h->exit_signal = 0;
@@ -160,9 +408,9 @@ static LoggerHandle* logger_open(LoggerState *s, const char* root_path) {
   if (lock_file == NULL) return NULL;
   fclose(lock_file);
 
-  h->log = std::make_unique<RawFile>(h->log_path);
+  h->log = std::make_unique<ZstdFile>(h->log_path);
   if (s->has_qlog) {
-    h->q_log = std::make_unique<RawFile>(h->qlog_path);
+    h->q_log = std::make_unique<ZstdFile>(h->qlog_path);
   }
 
   pthread_mutex_init(&h->lock, NULL);
@@ -216,10 +464,10 @@ LoggerHandle* logger_get_handle(LoggerState *s) {
   return h;
 }
 
-void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog) {
+void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog, uint8_t* qlog_data, size_t qlog_size) {
   pthread_mutex_lock(&s->lock);
   if (s->cur_handle) {
-    lh_log(s->cur_handle, data, data_size, in_qlog);
+    lh_log(s->cur_handle, data, data_size, in_qlog, qlog_data, qlog_size);
   }
   pthread_mutex_unlock(&s->lock);
 }
@@ -234,12 +482,29 @@ void logger_close(LoggerState *s, ExitHandler *exit_handler) {
   pthread_mutex_unlock(&s->lock);
 }
 
-void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog) {
+void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog, uint8_t* qlog_data, size_t qlog_size) {
+  uint64_t mono_time = 0;
+  uint16_t which = UINT16_MAX;
+  try {
+    capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<capnp::word>((capnp::word *)data, data_size / sizeof(capnp::word)));
+    auto event = cmsg.getRoot<cereal::Event>();
+    mono_time = event.getLogMonoTime();
+    which = (uint16_t)event.which();
+  } catch (const kj::Exception &e) {
+    // logged anyway, just not indexed
+  }
+
   pthread_mutex_lock(&h->lock);
   assert(h->refcnt > 0);
+  h->log->index(mono_time, which);
   h->log->write(data, data_size);
   if (in_qlog && h->q_log) {
-    h->q_log->write(data, data_size);
+    h->q_log->index(mono_time, which);
+    if (qlog_data) {
+      h->q_log->write(qlog_data, qlog_size);
+    } else {
+      h->q_log->write(data, data_size);
+    }
   }
   pthread_mutex_unlock(&h->lock);
 }
@@ -1,12 +1,20 @@
 #pragma once
 
 #include <pthread.h>
+#include <sys/types.h>
 
 #include <cassert>
 #include <cstdint>
 #include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <capnp/serialize.h>
 #include <kj/array.h>
@@ -18,7 +26,52 @@
 
 #define LOGGER_MAX_HANDLES 16
 
-class RawFile {
+// rlog and qlog are written as zstd seekable files, one frame per this many
+// messages or bytes, whichever comes first
+#define LOGGER_ZST_FRAME_MSGS 1000
+#define LOGGER_ZST_FRAME_SIZE (4 * 1024 * 1024)
+#define LOGGER_ZST_LEVEL 3
+#define LOGGER_ZST_MAX_QUEUED 8
+
+// compressed logs are written in blocks of this size, aligned for O_DIRECT
+#define LOGGER_DIRECT_BLOCK_SIZE (2 * 1024 * 1024)
+#define LOGGER_DIRECT_ALIGN 4096
+
+// Index sidecar, <log>.idx: a LogIndexHeader followed by one LogIndexEntry per
+// zstd frame, so readers can find the frames holding a time range or a service
+// without decompressing the whole log. All fields are little endian.
+#define LOGGER_INDEX_MAGIC 0x5844494cU  // "LIDX"
+#define LOGGER_INDEX_VERSION 1
+
+struct LogIndexHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_frames;
+  uint32_t entry_size;
+};
+
+struct LogIndexEntry {
+  uint64_t compressed_offset;
+  uint64_t decompressed_offset;
+  uint32_t compressed_size;
+  uint32_t decompressed_size;
+  uint64_t first_mono_time;  // of the messages in the frame, 0 if it has none with a time
+  uint64_t last_mono_time;
+  uint32_t msgs;
+  uint32_t reserved;
+  uint8_t services[32];  // bit per Event union member (Event::Which) present in the frame
+};
+
+class LogFile {
+ public:
+  virtual ~LogFile() {}
+  virtual void write(void* data, size_t size) = 0;
+  inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
+  // called with the message about to be written, for files that keep an index
+  virtual void index(uint64_t mono_time, uint16_t which) {}
+};
+
+class RawFile : public LogFile {
  public:
   RawFile(const char* path) {
     file = util::safe_fopen(path, "wb");
@@ -29,16 +82,73 @@ class RawFile {
     int err = fclose(file);
     assert(err == 0);
   }
-  inline void write(void* data, size_t size) {
+  void write(void* data, size_t size) {
     int written = util::safe_fwrite(data, 1, size, file);
     assert(written == size);
   }
-  inline void write(kj::ArrayPtr<capnp::byte> array) { write(array.begin(), array.size()); }
+  using LogFile::write;
 
  private:
   FILE* file = nullptr;
 };
 
+// Writes whole aligned blocks with pwrite on an O_DIRECT fd, so writing logs
+// doesn't fill the page cache and evict everyone else's working set. Falls back
+// to buffered writes with early writeback on filesystems without O_DIRECT.
+// The file is flushed to disk with sync_file_range when it's closed.
+class DirectFile : public LogFile {
+ public:
+  DirectFile(const char* path);
+  ~DirectFile();
+  void write(void* data, size_t size);
+  using LogFile::write;
+
+ private:
+  void write_block(size_t len);
+
+  int fd = -1;
+  bool direct = true;
+  uint8_t* buf = nullptr;
+  size_t buf_len = 0;
+  off_t offset = 0;
+};
+
+// Compresses on a background thread while loggerd keeps logging. Every frame
+// is independent and a seek table in the zstd seekable format is appended on
+// close, so readers can start decompressing at any frame. Plain zstd tools
+// read it as a regular multi frame file.
+class ZstdFile : public LogFile {
+ public:
+  ZstdFile(const char* path, int level = LOGGER_ZST_LEVEL);
+  ~ZstdFile();
+  void write(void* data, size_t size);
+  using LogFile::write;
+  void index(uint64_t mono_time, uint16_t which);
+
+ private:
+  void flush_frame();
+  void compress_thread();
+  void write_index();
+
+  const std::string path;
+  DirectFile file;
+  const int level;
+  std::string frame;
+  int frame_msgs = 0;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<std::string> queue;
+  std::vector<std::string> free_buffers;
+  bool stop = false;
+  std::vector<std::pair<uint32_t, uint32_t>> seek_table;  // compressed, decompressed size per frame
+  std::thread thread;
+
+  LogIndexEntry cur_index = {};
+  uint64_t decompressed_offset = 0;
+  std::vector<LogIndexEntry> frame_index;
+};
+
 typedef cereal::Sentinel::SentinelType SentinelType;
 
 typedef struct LoggerHandle {
@@ -50,13 +160,15 @@ typedef struct LoggerHandle {
   char log_path[4096];
   char qlog_path[4096];
   char lock_path[4096];
-  std::unique_ptr<RawFile> log, q_log;
+  std::unique_ptr<LogFile> log, q_log;
 } LoggerHandle;
 
 typedef struct LoggerState {
   pthread_mutex_t lock;
   int part;
   kj::Array<capnp::word> init_data;
+  // set by logger_init until the first segment takes the result
+  std::future<kj::Array<capnp::word>> init_data_pending;
   std::string route_name;
   char log_name[64];
   bool has_qlog;
@@ -73,7 +185,10 @@ int logger_next(LoggerState *s, const char* root_path,
                             int* out_part);
 LoggerHandle* logger_get_handle(LoggerState *s);
 void logger_close(LoggerState *s, ExitHandler *exit_handler=nullptr);
-void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog);
+// qlog_data, if set, is written to the qlog in place of data
+void logger_log(LoggerState *s, uint8_t* data, size_t data_size, bool in_qlog,
+                uint8_t* qlog_data = nullptr, size_t qlog_size = 0);
 
-void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog);
+void lh_log(LoggerHandle* h, uint8_t* data, size_t data_size, bool in_qlog,
+            uint8_t* qlog_data = nullptr, size_t qlog_size = 0);
 void lh_close(LoggerHandle* h);
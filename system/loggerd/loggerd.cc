@@ -1,19 +1,205 @@
 #include <sys/xattr.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cinttypes>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include "common/placement.h"
+#include "common/queue.h"
+#include "system/loggerd/encode_pool.h"
 #include "system/loggerd/encoder/encoder.h"
 #include "system/loggerd/loggerd.h"
 #include "system/loggerd/video_writer.h"
 
 ExitHandler do_exit;
 
+// -- log writer --
+// Receiving and writing are decoupled, so an eMMC stall backs up these rings
+// instead of leaving loggerd behind on the msgq queues, where high rate
+// services would get overwritten. Each receiving thread copies its messages
+// into its own ring, the writer thread merges them. Slot buffers are swapped
+// back and forth, so they keep their capacity.
+//
+// Receivers run at their own pace, so messages are held for a short merge
+// window and written in logMonoTime order. Within the window the order in the
+// log is deterministic no matter which receiver got a message first.
+
+const size_t LOG_WRITE_QUEUE_SIZE = 8192;
+const double LOG_WRITER_REPORT_MS = 10000;
+const uint64_t LOG_MERGE_WINDOW_NS = 50ULL * 1000 * 1000;
+const int LOG_RECEIVER_THREADS = 3;
+
+struct LogWrite {
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> qlog_data;  // thinned qlog copy, empty to log data in both
+  uint64_t mono_time = 0;
+  uint64_t seq = 0;  // order received by the writer, breaks logMonoTime ties
+  bool in_qlog = false;
+};
+
+class LogWriter {
+public:
+  LogWriter(LoggerState *l, int num_inputs) : logger(l) {
+    for (int i = 0; i < num_inputs; i++) {
+      inputs.push_back(std::make_unique<Input>());
+    }
+    thread = std::thread(&LogWriter::run, this);
+  }
+  ~LogWriter() { stop(); }
+
+  // only called from the input's own receiving thread
+  void push(int input, const uint8_t *data, size_t size, bool in_qlog, uint64_t mono_time,
+            kj::ArrayPtr<const capnp::byte> qlog_data = nullptr) {
+    Input &in = *inputs[input];
+    in.slot.data.assign(data, data + size);
+    in.slot.qlog_data.assign(qlog_data.begin(), qlog_data.end());
+    in.slot.in_qlog = in_qlog;
+    in.slot.mono_time = mono_time;
+    if (!in.queue.try_push(in.slot)) {
+      // ring full, the writer is stalled
+      uint64_t t = nanos_since_boot();
+      while (!in.queue.try_push(in.slot)) {
+        util::sleep_for(1);
+      }
+      in.blocked_ns += nanos_since_boot() - t;
+    }
+    uint64_t depth = ++in.pushed - in.popped;
+    if (depth > in.max_depth) in.max_depth = depth;
+  }
+
+  // waits until everything pushed so far, by any input, is written
+  void flush() {
+    uint64_t target = 0;
+    for (auto &in : inputs) target += in->pushed;
+    flushing++;
+    while (written < target) {
+      util::sleep_for(1);
+    }
+    flushing--;
+  }
+
+  void stop() {
+    if (thread.joinable()) {
+      stopping = true;
+      thread.join();
+    }
+  }
+
+  void report() {
+    double tms = millis_since_boot();
+    if (tms - last_report_tms < LOG_WRITER_REPORT_MS) return;
+
+    uint64_t max_write_ms = max_write_ns.exchange(0) / 1e6;
+    uint64_t blocked_ns = 0, max_depth = 0;
+    for (auto &in : inputs) {
+      blocked_ns += in->blocked_ns.exchange(0);
+      max_depth = std::max(max_depth, in->max_depth.exchange(0));
+    }
+    if (blocked_ns > 0 || max_write_ms > 100) {
+      LOGW("log writer stalled: max write %" PRIu64 "ms, receiving blocked for %" PRIu64 "ms, max queued %" PRIu64 "/%zu",
+           max_write_ms, blocked_ns / (uint64_t)1e6, max_depth, LOG_WRITE_QUEUE_SIZE - 1);
+    } else {
+      LOGD("log writer: max write %" PRIu64 "ms, max queued %" PRIu64 ", max merging %zu",
+           max_write_ms, max_depth, max_merging.exchange(0));
+    }
+    last_report_tms = tms;
+  }
+
+private:
+  struct Input {
+    SPSCQueue<LogWrite, LOG_WRITE_QUEUE_SIZE> queue;
+    LogWrite slot;  // receiving side, holds the buffer handed back by the last push
+    std::atomic<uint64_t> pushed = 0, popped = 0;
+    // stats since the last report
+    std::atomic<uint64_t> blocked_ns = 0, max_depth = 0;
+  };
+
+  void run() {
+    util::set_thread_name("loggerd_writer");
+
+    // min-heap on (logMonoTime, seq)
+    auto later = [](const LogWrite &a, const LogWrite &b) {
+      return a.mono_time != b.mono_time ? a.mono_time > b.mono_time : a.seq > b.seq;
+    };
+    std::vector<LogWrite> pending, spare;
+    uint64_t seq = 0;
+
+    while (true) {
+      // read before popping, so nothing pushed before stop() is left behind
+      const bool stop_now = stopping;
+
+      // an empty slot to swap in is needed for every pop
+      bool received = false;
+      for (auto &in : inputs) {
+        while (true) {
+          LogWrite w;
+          if (!spare.empty()) {
+            w = std::move(spare.back());
+            spare.pop_back();
+          }
+          if (!in->queue.try_pop(w)) {
+            spare.push_back(std::move(w));
+            break;
+          }
+          in->popped++;
+          w.seq = seq++;
+          pending.push_back(std::move(w));
+          std::push_heap(pending.begin(), pending.end(), later);
+          received = true;
+        }
+      }
+      if (pending.size() > max_merging) max_merging = pending.size();
+
+      // everything older than the merge window can't be overtaken anymore
+      const bool drain = flushing > 0 || stop_now;
+      const uint64_t now = nanos_since_boot();
+      while (!pending.empty() && (drain || pending.front().mono_time + LOG_MERGE_WINDOW_NS <= now)) {
+        std::pop_heap(pending.begin(), pending.end(), later);
+        LogWrite &w = pending.back();
+        uint64_t t = nanos_since_boot();
+        if (w.qlog_data.empty()) {
+          logger_log(logger, w.data.data(), w.data.size(), w.in_qlog);
+        } else {
+          logger_log(logger, w.data.data(), w.data.size(), w.in_qlog, w.qlog_data.data(), w.qlog_data.size());
+        }
+        uint64_t dt = nanos_since_boot() - t;
+        if (dt > max_write_ns) max_write_ns = dt;
+        spare.push_back(std::move(w));
+        pending.pop_back();
+        written++;
+      }
+
+      if (!received) {
+        if (stop_now && pending.empty()) break;
+        util::sleep_for(1);
+      }
+    }
+  }
+
+  LoggerState *logger;
+  std::vector<std::unique_ptr<Input>> inputs;
+  std::atomic<uint64_t> written = 0;
+  std::atomic<int> flushing = 0;
+  std::atomic<bool> stopping = false;
+
+  // stats since the last report
+  std::atomic<uint64_t> max_write_ns = 0;
+  std::atomic<size_t> max_merging = 0;
+  double last_report_tms = 0;
+
+  std::thread thread;
+};
+
 struct LoggerdState {
   LoggerState logger = {};
+  std::unique_ptr<LogWriter> writer;
   char segment_path[4096];
   std::atomic<int> rotate_segment;
   std::atomic<double> last_camera_seen_tms;
@@ -23,6 +209,11 @@ struct LoggerdState {
 };
 
 void logger_rotate(LoggerdState *s) {
+  // everything received so far belongs in the segment being closed
+  if (s->writer) {
+    s->writer->flush();
+  }
+
   int segment = -1;
   int err = logger_next(&s->logger, Path::log_root().c_str(), s->segment_path, sizeof(s->segment_path), &segment);
   assert(err == 0);
@@ -56,17 +247,134 @@ void rotate_if_needed(LoggerdState *s) {
   }
 }
 
+// The parts of an encode packet loggerd needs, pointing either into the
+// received Message or into a queued copy.
+struct EncoderPacket {
+  int segment_num;  // encoderd's
+  uint32_t flags;
+  uint64_t timestamp_eof;
+  cereal::EncodeIndex::Type type;
+  kj::ArrayPtr<const capnp::byte> header, data;
+  kj::ArrayPtr<const capnp::byte> idx_msg;  // the event logged in place of the packet
+  int pool_slot = -1;  // data is in encoderd's pool, held until the packet is written or queued
+};
+
+// Packets from encoderd's next segment wait here until loggerd rotates. The
+// slots and their buffers are reused, so a slow rotation holds at most
+// ENCODER_QUEUE_SIZE packets instead of growing without bound.
+const size_t ENCODER_QUEUE_SIZE = 5 * MAIN_FPS;
+
+class EncoderPacketQueue {
+public:
+  // copies the packet, false if the queue is full
+  bool push(const EncoderPacket &pkt) {
+    if (count == ENCODER_QUEUE_SIZE) return false;
+    Slot &slot = slots[(head + count) % ENCODER_QUEUE_SIZE];
+    slot.header.assign(pkt.header.begin(), pkt.header.end());
+    slot.data.assign(pkt.data.begin(), pkt.data.end());
+    slot.idx_msg.assign(pkt.idx_msg.begin(), pkt.idx_msg.end());
+    slot.pkt = pkt;
+    slot.pkt.header = kj::arrayPtr(slot.header.data(), slot.header.size());
+    slot.pkt.data = kj::arrayPtr(slot.data.data(), slot.data.size());
+    slot.pkt.idx_msg = kj::arrayPtr(slot.idx_msg.data(), slot.idx_msg.size());
+    slot.pkt.pool_slot = -1;
+    held_bytes += slot.header.size() + slot.data.size() + slot.idx_msg.size();
+    count++;
+    return true;
+  }
+
+  const EncoderPacket &front() const { return slots[head].pkt; }
+
+  void pop() {
+    const Slot &slot = slots[head];
+    held_bytes -= slot.header.size() + slot.data.size() + slot.idx_msg.size();
+    head = (head + 1) % ENCODER_QUEUE_SIZE;
+    count--;
+  }
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+  size_t bytes() const { return held_bytes; }
+
+private:
+  struct Slot {
+    EncoderPacket pkt;
+    std::vector<uint8_t> header, data, idx_msg;
+  };
+  std::array<Slot, ENCODER_QUEUE_SIZE> slots;
+  size_t head = 0, count = 0, held_bytes = 0;
+};
+
 struct RemoteEncoder {
   std::unique_ptr<VideoWriter> writer;
+  std::unique_ptr<EncodePool> pool;
+  int pool_lost = 0;  // pooled packets whose slot was taken back before they got here
   int encoderd_segment_offset;
   int current_segment = -1;
-  std::vector<Message *> q;
+  EncoderPacketQueue q;
   int dropped_frames = 0;
+  int queue_dropped = 0;  // packets lost to a full queue since the last rotation
+  size_t max_queued_bytes = 0;
   bool recording = false;
   bool marked_ready_to_rotate = false;
   bool seen_first_packet = false;
 };
 
+// writes a packet for the segment loggerd is on, returns the bytes logged
+static int write_encoder_packet(LoggerdState *s, const EncoderPacket &pkt, std::string &name, struct RemoteEncoder &re, const EncoderInfo &encoder_info) {
+  // if we aren't recording yet, try to start, since we are in the correct segment
+  if (!re.recording) {
+    if (pkt.flags & V4L2_BUF_FLAG_KEYFRAME) {
+      // only create on iframe
+      if (re.dropped_frames) {
+        // this should only happen for the first segment, maybe
+        LOGW("%s: dropped %d non iframe packets before init", name.c_str(), re.dropped_frames);
+        re.dropped_frames = 0;
+      }
+      // if we aren't actually recording, don't create the writer
+      if (encoder_info.record) {
+        assert(encoder_info.filename != NULL);
+        re.writer.reset(new VideoWriter(s->segment_path,
+          encoder_info.filename, pkt.type != cereal::EncodeIndex::Type::FULL_H_E_V_C,
+          encoder_info.frame_width, encoder_info.frame_height, encoder_info.fps, pkt.type));
+        // write the header
+        re.writer->write((uint8_t *)pkt.header.begin(), pkt.header.size(), pkt.timestamp_eof/1000, true, false);
+      }
+      re.recording = true;
+    } else {
+      // this is a sad case when we aren't recording, but don't have an iframe
+      // nothing we can do but drop the frame
+      ++re.dropped_frames;
+      return 0;
+    }
+  }
+
+  // we have to be recording if we are here
+  assert(re.recording);
+
+  // if we are actually writing the video file, do so
+  if (re.writer) {
+    re.writer->write((uint8_t *)pkt.data.begin(), pkt.data.size(), pkt.timestamp_eof/1000, false, pkt.flags & V4L2_BUF_FLAG_KEYFRAME);
+  }
+
+  // put it in log stream as the idx packet
+  capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<const capnp::word>((const capnp::word *)pkt.idx_msg.begin(), pkt.idx_msg.size() / sizeof(capnp::word)));
+  s->writer->push(0, pkt.idx_msg.begin(), pkt.idx_msg.size(), true, cmsg.getRoot<cereal::Event>().getLogMonoTime());   // always in qlog?
+  return pkt.idx_msg.size();
+}
+
+// the data of a packet encoderd put in its pool, opened or reopened as needed
+static const uint8_t *take_pooled(RemoteEncoder &re, const std::string &name, uint32_t encode_id, size_t size, int &slot) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (!re.pool || !re.pool->valid() || (attempt > 0 && re.pool->replaced())) {
+      re.pool.reset(new EncodePool(encode_pool_path(name)));
+      if (!re.pool->valid()) return nullptr;
+    }
+    if (const uint8_t *data = re.pool->take(encode_id, size, slot)) return data;
+  }
+  return nullptr;
+}
+
 int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct RemoteEncoder &re, const EncoderInfo &encoder_info) {
   int bytes_count = 0;
 
@@ -75,7 +383,6 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
   auto event = cmsg.getRoot<cereal::Event>();
   auto edata = (event.*(encoder_info.get_encode_data_func))();
   auto idx = edata.getIdx();
-  auto flags = idx.getFlags();
 
   // encoderd can have started long before loggerd
   if (!re.seen_first_packet) {
@@ -85,6 +392,47 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
   }
   int offset_segment_num = idx.getSegmentNum() - re.encoderd_segment_offset;
 
+  kj::ArrayPtr<const capnp::byte> data = edata.getData();
+  int pool_slot = -1;
+  if (data.size() == 0 && idx.getLen() > 0) {
+    const uint8_t *pooled = take_pooled(re, name, idx.getEncodeId(), idx.getLen(), pool_slot);
+    if (!pooled) {
+      if (re.pool_lost++ == 0) LOGE("%s: pooled packet %u is gone", name.c_str(), idx.getEncodeId());
+      delete msg;
+      return bytes_count;
+    }
+    data = kj::arrayPtr(pooled, idx.getLen());
+  }
+
+  if (offset_segment_num < s->rotate_segment) {
+    LOGE("%s: encoderd packet has a older segment!!! idx.getSegmentNum():%d s->rotate_segment:%d re.encoderd_segment_offset:%d",
+      name.c_str(), idx.getSegmentNum(), s->rotate_segment.load(), re.encoderd_segment_offset);
+    // free the message, it's useless. this should never happen
+    // actually, this can happen if you restart encoderd
+    re.encoderd_segment_offset = -s->rotate_segment.load();
+    if (pool_slot >= 0) re.pool->release(pool_slot);
+    delete msg;
+    return bytes_count;
+  }
+
+  MessageBuilder bmsg;
+  auto evt = bmsg.initEvent(event.getValid());
+  evt.setLogMonoTime(event.getLogMonoTime());
+  (evt.*(encoder_info.set_encode_idx_func))(idx);
+  auto idx_msg = bmsg.toBytes();
+
+  auto header = edata.getHeader();
+  EncoderPacket pkt = {
+    .segment_num = offset_segment_num,
+    .flags = idx.getFlags(),
+    .timestamp_eof = idx.getTimestampEof(),
+    .type = idx.getType(),
+    .header = kj::arrayPtr(header.begin(), header.size()),
+    .data = kj::arrayPtr(data.begin(), data.size()),
+    .idx_msg = idx_msg.asBytes(),
+    .pool_slot = pool_slot,
+  };
+
   if (offset_segment_num == s->rotate_segment) {
     // loggerd is now on the segment that matches this packet
 
@@ -96,65 +444,25 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
       }
       re.current_segment = s->rotate_segment;
       re.marked_ready_to_rotate = false;
-      // we are in this segment now, process any queued messages before this one
-      if (!re.q.empty()) {
-        for (auto &qmsg : re.q) {
-          bytes_count += handle_encoder_msg(s, qmsg, name, re, encoder_info);
-        }
-        re.q.clear();
+      if (re.queue_dropped > 0 || re.max_queued_bytes > 0) {
+        LOGW("%s: %d packets dropped waiting for rotation, max queued %zu kB", name.c_str(), re.queue_dropped, re.max_queued_bytes / 1024);
       }
-    }
-
-    // if we aren't recording yet, try to start, since we are in the correct segment
-    if (!re.recording) {
-      if (flags & V4L2_BUF_FLAG_KEYFRAME) {
-        // only create on iframe
-        if (re.dropped_frames) {
-          // this should only happen for the first segment, maybe
-          LOGW("%s: dropped %d non iframe packets before init", name.c_str(), re.dropped_frames);
-          re.dropped_frames = 0;
-        }
-        // if we aren't actually recording, don't create the writer
-        if (encoder_info.record) {
-          assert(encoder_info.filename != NULL);
-          re.writer.reset(new VideoWriter(s->segment_path,
-            encoder_info.filename, idx.getType() != cereal::EncodeIndex::Type::FULL_H_E_V_C,
-            encoder_info.frame_width, encoder_info.frame_height, encoder_info.fps, idx.getType()));
-          // write the header
-          auto header = edata.getHeader();
-          re.writer->write((uint8_t *)header.begin(), header.size(), idx.getTimestampEof()/1000, true, false);
-        }
-        re.recording = true;
-      } else {
-        // this is a sad case when we aren't recording, but don't have an iframe
-        // nothing we can do but drop the frame
-        delete msg;
-        ++re.dropped_frames;
-        return bytes_count;
+      if (re.pool_lost > 0) {
+        LOGW("%s: %d pooled packets lost", name.c_str(), re.pool_lost);
+        re.pool_lost = 0;
       }
-    }
+      re.queue_dropped = 0;
+      re.max_queued_bytes = 0;
 
-    // we have to be recording if we are here
-    assert(re.recording);
-
-    // if we are actually writing the video file, do so
-    if (re.writer) {
-      auto data = edata.getData();
-      re.writer->write((uint8_t *)data.begin(), data.size(), idx.getTimestampEof()/1000, false, flags & V4L2_BUF_FLAG_KEYFRAME);
+      // we are in this segment now, process any queued packets before this one
+      while (!re.q.empty() && re.q.front().segment_num == s->rotate_segment) {
+        bytes_count += write_encoder_packet(s, re.q.front(), name, re, encoder_info);
+        re.q.pop();
+      }
     }
 
-    // put it in log stream as the idx packet
-    MessageBuilder bmsg;
-    auto evt = bmsg.initEvent(event.getValid());
-    evt.setLogMonoTime(event.getLogMonoTime());
-    (evt.*(encoder_info.set_encode_idx_func))(idx);
-    auto new_msg = bmsg.toBytes();
-    logger_log(&s->logger, (uint8_t *)new_msg.begin(), new_msg.size(), true);   // always in qlog?
-    bytes_count += new_msg.size();
-
-    // free the message, we used it
-    delete msg;
-  } else if (offset_segment_num > s->rotate_segment) {
+    bytes_count += write_encoder_packet(s, pkt, name, re, encoder_info);
+  } else {
     // encoderd packet has a newer segment, this means encoderd has rolled over
     if (!re.marked_ready_to_rotate) {
       re.marked_ready_to_rotate = true;
@@ -163,17 +471,19 @@ int handle_encoder_msg(LoggerdState *s, Message *msg, std::string &name, struct
         s->rotate_segment.load(), offset_segment_num,
         s->ready_to_rotate.load(), s->max_waiting, name.c_str());
     }
-    // queue up all the new segment messages, they go in after the rotate
-    re.q.push_back(msg);
-  } else {
-    LOGE("%s: encoderd packet has a older segment!!! idx.getSegmentNum():%d s->rotate_segment:%d re.encoderd_segment_offset:%d",
-      name.c_str(), idx.getSegmentNum(), s->rotate_segment.load(), re.encoderd_segment_offset);
-    // free the message, it's useless. this should never happen
-    // actually, this can happen if you restart encoderd
-    re.encoderd_segment_offset = -s->rotate_segment.load();
-    delete msg;
+    // queue up all the new segment packets, they go in after the rotate
+    if (re.q.push(pkt)) {
+      re.max_queued_bytes = std::max(re.max_queued_bytes, re.q.bytes());
+    } else if (re.queue_dropped++ == 0) {
+      LOGE("%s: rotation queue full, dropping packets", name.c_str());
+    }
   }
 
+  // written or copied into the queue, encoderd can have the slot back
+  if (pool_slot >= 0) re.pool->release(pool_slot);
+
+  // free the message, we used it
+  delete msg;
   return bytes_count;
 }
 
@@ -194,43 +504,173 @@ void handle_user_flag(LoggerdState *s) {
   prev_segment = s->rotate_segment.load();
 }
 
+// -- qlog --
+// qlog rates are time based: a service with decimation d and frequency f is
+// logged at most every d/f seconds of logMonoTime, so bursts and services
+// running off their nominal rate don't skew what ends up in the qlog. Messages
+// without a time fall back to every d-th one.
+// Some services get their bulkiest fields dropped from the qlog copy, the qlog
+// goes over LTE while the rlog keeps everything.
+
+typedef kj::Array<capnp::word> (*QlogThinFunc)(cereal::Event::Reader event);
+
+static kj::Array<capnp::word> thin_model_v2(cereal::Event::Reader event) {
+  capnp::MallocMessageBuilder msg;
+  msg.setRoot(event);
+  auto model = msg.getRoot<cereal::Event>().getModelV2();
+  model.disownRawPredictions();
+  model.disownLaneLineStds();
+  model.disownRoadEdgeStds();
+
+  // the disowned fields still take up space in msg, a second copy drops them
+  capnp::MallocMessageBuilder thinned;
+  thinned.setRoot(msg.getRoot<cereal::Event>().asReader());
+  return capnp::messageToFlatArray(thinned);
+}
+
+static const std::map<std::string, QlogThinFunc> qlog_thin_funcs = {
+  {"modelV2", thin_model_v2},
+};
+
+struct ServiceState {
+  std::string name;
+  int counter, freq;
+  uint64_t qlog_interval_ns;  // 0 if the service isn't decimated by time
+  uint64_t next_qlog_mono_time;
+  QlogThinFunc qlog_thin;
+  bool encoder, user_flag;
+  int receiver;
+};
+
+static bool decimate_qlog(ServiceState &service, uint64_t mono_time) {
+  if (service.freq == -1) return false;
+  if (service.qlog_interval_ns == 0 || mono_time == 0) {
+    return service.counter++ % service.freq == 0;
+  }
+  // messages are due on a fixed schedule, half a publish period of jitter is allowed
+  const uint64_t jitter_ns = service.qlog_interval_ns / (2 * service.freq);
+  if (mono_time + jitter_ns < service.next_qlog_mono_time) {
+    return false;
+  }
+  service.next_qlog_mono_time += service.qlog_interval_ns;
+  if (service.next_qlog_mono_time <= mono_time) {
+    // first message, or the service was quiet for a while
+    service.next_qlog_mono_time = mono_time + service.qlog_interval_ns;
+  }
+  return true;
+}
+
+// logs a plain (non encoder) message, returns its size
+static size_t log_message(LoggerdState *s, int receiver, ServiceState &service, Message *msg) {
+  capnp::FlatArrayMessageReader cmsg(kj::ArrayPtr<capnp::word>((capnp::word *)msg->getData(), msg->getSize() / sizeof(capnp::word)));
+  cereal::Event::Reader event;
+  uint64_t mono_time = 0;
+  try {
+    event = cmsg.getRoot<cereal::Event>();
+    mono_time = event.getLogMonoTime();
+  } catch (const kj::Exception &e) {
+    // still logged as is, without a time it's written right away
+  }
+
+  const bool in_qlog = decimate_qlog(service, mono_time);
+  kj::Array<capnp::word> thinned;
+  if (in_qlog && service.qlog_thin && mono_time != 0) {
+    try {
+      thinned = service.qlog_thin(event);
+    } catch (const kj::Exception &e) {
+      LOGD("%s: not thinning qlog copy: %s", service.name.c_str(), e.getDescription().cStr());
+    }
+  }
+
+  s->writer->push(receiver, (uint8_t *)msg->getData(), msg->getSize(), in_qlog, mono_time, thinned.asBytes());
+  size_t size = msg->getSize();
+  delete msg;
+  return size;
+}
+
+// drains the sockets of one of the extra receivers, encoders and rotation stay on the main thread
+static void receiver_thread(LoggerdState *s, int receiver, Poller *poller, std::unordered_map<SubSocket*, ServiceState> *service_state) {
+  util::set_thread_name(("loggerd_recv" + std::to_string(receiver)).c_str());
+
+  std::vector<Message *> batch;
+  while (!do_exit) {
+    for (auto sock : poller->poll(100)) {
+      if (do_exit) break;
+
+      ServiceState &service = service_state->at(sock);
+      batch.clear();
+      sock->receiveMany(batch, 200);
+      for (Message *msg : batch) {
+        if (do_exit) {
+          delete msg;
+          continue;
+        }
+        log_message(s, receiver, service, msg);
+      }
+
+      if (batch.size() >= 200) {
+        LOGD("large volume of '%s' messages", service.name.c_str());
+      }
+    }
+  }
+}
+
 void loggerd_thread() {
+  // the init data is built in the background while the sockets are set up
+  LoggerdState s;
+  logger_init(&s.logger, true);
+
   // setup messaging
-  typedef struct ServiceState {
-    std::string name;
-    int counter, freq;
-    bool encoder, user_flag;
-  } ServiceState;
   std::unordered_map<SubSocket*, ServiceState> service_state;
   std::unordered_map<SubSocket*, struct RemoteEncoder> remote_encoders;
 
   std::unique_ptr<Context> ctx(Context::create());
-  std::unique_ptr<Poller> poller(Poller::create());
+  std::vector<std::unique_ptr<Poller>> pollers;
+  for (int i = 0; i < LOG_RECEIVER_THREADS; i++) {
+    pollers.emplace_back(Poller::create());
+  }
 
-  // subscribe to all socks
+  // encoders and userFlag are handled by the main thread, everything else is
+  // spread over the receivers by rate, highest rate first
+  std::vector<const service *> logged;
   for (const auto& [_, it] : services) {
     const bool encoder = util::ends_with(it.name, "EncodeData");
     const bool livestream_encoder = util::starts_with(it.name, "livestream");
     if (!it.should_log && (!encoder || livestream_encoder)) continue;
-    LOGD("logging %s (on port %d)", it.name.c_str(), it.port);
+    logged.push_back(&it);
+  }
+  std::sort(logged.begin(), logged.end(), [](auto a, auto b) { return a->frequency > b->frequency; });
+
+  std::vector<float> receiver_load(LOG_RECEIVER_THREADS, 0);
+  for (const service *it : logged) {
+    const bool encoder = util::ends_with(it->name, "EncodeData");
+    const bool user_flag = it->name == "userFlag";
+    int receiver = 0;
+    if (!encoder && !user_flag) {
+      receiver = std::min_element(receiver_load.begin(), receiver_load.end()) - receiver_load.begin();
+    }
+    receiver_load[receiver] += it->frequency;
+    LOGD("logging %s (on port %d) in receiver %d", it->name.c_str(), it->port, receiver);
 
-    SubSocket * sock = SubSocket::create(ctx.get(), it.name);
+    SubSocket * sock = SubSocket::create(ctx.get(), it->name);
     assert(sock != NULL);
-    poller->registerSocket(sock);
+    pollers[receiver]->registerSocket(sock);
     service_state[sock] = {
-      .name = it.name,
+      .name = it->name,
       .counter = 0,
-      .freq = it.decimation,
+      .freq = it->decimation,
+      .qlog_interval_ns = it->decimation > 0 && it->frequency > 0 ? (uint64_t)(1e9 * it->decimation / it->frequency) : 0,
+      .next_qlog_mono_time = 0,
+      .qlog_thin = qlog_thin_funcs.count(it->name) ? qlog_thin_funcs.at(it->name) : nullptr,
       .encoder = encoder,
-      .user_flag = it.name == "userFlag",
+      .user_flag = user_flag,
+      .receiver = receiver,
     };
   }
 
-  LoggerdState s;
-  // init logger
-  logger_init(&s.logger, true);
   logger_rotate(&s);
   Params().put("CurrentRoute", s.logger.route_name);
+  s.writer = std::make_unique<LogWriter>(&s.logger, LOG_RECEIVER_THREADS);
 
   std::map<std::string, EncoderInfo> encoder_infos_dict;
   for (const auto &cam : cameras_logged) {
@@ -240,11 +680,17 @@ void loggerd_thread() {
     }
   }
 
+  std::vector<std::thread> receivers;
+  for (int i = 1; i < LOG_RECEIVER_THREADS; i++) {
+    receivers.emplace_back(receiver_thread, &s, i, pollers[i].get(), &service_state);
+  }
+
   uint64_t msg_count = 0, bytes_count = 0;
   double start_ts = millis_since_boot();
+  std::vector<Message *> batch;
   while (!do_exit) {
     // poll for new messages on all sockets
-    for (auto sock : poller->poll(1000)) {
+    for (auto sock : pollers[0]->poll(1000)) {
       if (do_exit) break;
 
       ServiceState &service = service_state[sock];
@@ -253,17 +699,19 @@ void loggerd_thread() {
       }
 
       // drain socket
-      int count = 0;
-      Message *msg = nullptr;
-      while (!do_exit && (msg = sock->receive(true))) {
-        const bool in_qlog = service.freq != -1 && (service.counter++ % service.freq == 0);
+      batch.clear();
+      sock->receiveMany(batch, 200);
+      for (Message *msg : batch) {
+        if (do_exit) {
+          delete msg;
+          continue;
+        }
+
         if (service.encoder) {
           s.last_camera_seen_tms = millis_since_boot();
           bytes_count += handle_encoder_msg(&s, msg, service.name, remote_encoders[sock], encoder_infos_dict[service.name]);
         } else {
-          logger_log(&s.logger, (uint8_t *)msg->getData(), msg->getSize(), in_qlog);
-          bytes_count += msg->getSize();
-          delete msg;
+          bytes_count += log_message(&s, 0, service, msg);
         }
 
         rotate_if_needed(&s);
@@ -272,17 +720,20 @@ void loggerd_thread() {
           double seconds = (millis_since_boot() - start_ts) / 1000.0;
           LOGD("%" PRIu64 " messages, %.2f msg/sec, %.2f KB/sec", msg_count, msg_count / seconds, bytes_count * 0.001 / seconds);
         }
+      }
 
-        count++;
-        if (count >= 200) {
-          LOGD("large volume of '%s' messages", service.name.c_str());
-          break;
-        }
+      if (batch.size() >= 200) {
+        LOGD("large volume of '%s' messages", service.name.c_str());
       }
     }
+    // the other receivers' services don't wake this thread up
+    rotate_if_needed(&s);
+    s.writer->report();
   }
 
   LOGW("closing logger");
+  for (auto &t : receivers) t.join();
+  s.writer->stop();
   logger_close(&s.logger, &do_exit);
 
   if (do_exit.power_failure) {
@@ -296,14 +747,8 @@ void loggerd_thread() {
 }
 
 int main(int argc, char** argv) {
-  if (!Hardware::PC()) {
-    int ret;
-    ret = util::set_core_affinity({0, 1, 2, 3});
-    assert(ret == 0);
-    // TODO: why does this impact camerad timings?
-    //ret = util::set_realtime_priority(1);
-    //assert(ret == 0);
-  }
+  int ret = apply_placement("loggerd");
+  assert(ret == 0);
 
   loggerd_thread();
 
@@ -18,6 +18,11 @@ const int MAIN_BITRATE = 1e7;
 const int LIVESTREAM_BITRATE = 1e6;
 const int QCAM_BITRATE = 256000;
 
+// recorded cameras drop towards their min_bitrate as free space runs low, the
+// deleter starts removing segments at 10% free
+const double BITRATE_FULL_FREE_PERCENT = 30.0;
+const double BITRATE_MIN_FREE_PERCENT = 10.0;
+
 #define NO_CAMERA_PATIENCE 500  // fall back to time-based rotation if all cameras are dead
 
 #define INIT_ENCODE_FUNCTIONS(encode_type)                                \
@@ -39,6 +44,7 @@ public:
   int frame_height = 1208;
   int fps = MAIN_FPS;
   int bitrate = MAIN_BITRATE;
+  int min_bitrate = 0;  // 0 keeps the bitrate fixed
   cereal::EncodeIndex::Type encode_type = Hardware::PC() ? cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS
                                                          : cereal::EncodeIndex::Type::FULL_H_E_V_C;
   ::cereal::EncodeData::Reader (cereal::Event::Reader::*get_encode_data_func)() const;
@@ -58,12 +64,14 @@ public:
 const EncoderInfo main_road_encoder_info = {
   .publish_name = "roadEncodeData",
   .filename = "fcamera.hevc",
+  .min_bitrate = MAIN_BITRATE / 2,
   INIT_ENCODE_FUNCTIONS(RoadEncode),
 };
 
 const EncoderInfo main_wide_road_encoder_info = {
   .publish_name = "wideRoadEncodeData",
   .filename = "ecamera.hevc",
+  .min_bitrate = MAIN_BITRATE / 2,
   INIT_ENCODE_FUNCTIONS(WideRoadEncode),
 };
 
@@ -71,6 +79,7 @@ const EncoderInfo main_driver_encoder_info = {
   .publish_name = "driverEncodeData",
   .filename = "dcamera.hevc",
   .record = Params().getBool("RecordFront"),
+  .min_bitrate = MAIN_BITRATE / 2,
   INIT_ENCODE_FUNCTIONS(DriverEncode),
 };
 
@@ -103,8 +112,8 @@ const EncoderInfo qcam_encoder_info = {
   .filename = "qcamera.ts",
   .bitrate = QCAM_BITRATE,
   .encode_type = cereal::EncodeIndex::Type::QCAMERA_H264,
-  .frame_width = 526,
-  .frame_height = 330,
+  .frame_width = QCAM_WIDTH,
+  .frame_height = QCAM_HEIGHT,
   INIT_ENCODE_FUNCTIONS(QRoadEncode),
 };
 
@@ -115,6 +124,14 @@ const LogCameraInfo road_camera_info{
   .encoder_infos = {main_road_encoder_info, qcam_encoder_info}
 };
 
+// used by encoderd instead of encoding the qcamera from the full road stream when camerad publishes it
+const LogCameraInfo qcam_camera_info{
+  .thread_name = "qcam_encoder",
+  .type = RoadCam,
+  .stream_type = VISION_STREAM_ROAD_QCAM,
+  .encoder_infos = {qcam_encoder_info}
+};
+
 const LogCameraInfo wide_road_camera_info{
   .thread_name = "wide_road_cam_encoder",
   .type = WideRoadCam,
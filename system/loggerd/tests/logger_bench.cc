@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <capnp/serialize.h>
+
+#include "common/bench.h"
+#include "common/util.h"
+#include "system/loggerd/logger.h"
+#include "system/loggerd/loggerd.h"
+
+// The logging half of loggerd on an uncompressed rlog: every event written through
+// logger_log into segments of SEGMENT_LENGTH seconds of log time, compression and
+// rotation included, under a scratch root. One event in QLOG_EVERY also goes to the
+// qlog, about what the service decimations keep. Writes the common daemon bench
+// report, see common/bench.h.
+// Usage: logger_bench [--json FILE] [--root DIR] rlog
+
+const int QLOG_EVERY = 10;
+
+int main(int argc, char *argv[]) {
+  std::string json_path, root = "/tmp/logger_bench", rlog;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json_path = argv[++i];
+    } else if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+      root = argv[++i];
+    } else {
+      rlog = argv[i];
+    }
+  }
+  if (rlog.empty()) {
+    fprintf(stderr, "usage: %s [--json FILE] [--root DIR] rlog\n", argv[0]);
+    return 1;
+  }
+  if (!util::create_directories(root, 0775)) {
+    fprintf(stderr, "can't create %s\n", root.c_str());
+    return 1;
+  }
+
+  std::string raw = util::read_file(rlog);
+  auto words = kj::heapArray<capnp::word>(raw.size() / sizeof(capnp::word));
+  memcpy(words.begin(), raw.data(), words.size() * sizeof(capnp::word));
+
+  struct RawEvent {
+    uint64_t mono_time;
+    kj::ArrayPtr<const capnp::word> words;
+  };
+  std::vector<RawEvent> events;
+  kj::ArrayPtr<const capnp::word> remaining = words.asPtr();
+  try {
+    while (remaining.size() > 0) {
+      capnp::FlatArrayMessageReader reader(remaining);
+      // the log's own initData and sentinels are written by the logger
+      auto event = reader.getRoot<cereal::Event>();
+      if (event.which() != cereal::Event::INIT_DATA && event.which() != cereal::Event::SENTINEL) {
+        events.push_back({event.getLogMonoTime(), kj::arrayPtr(remaining.begin(), reader.getEnd())});
+      }
+      remaining = kj::arrayPtr(reader.getEnd(), remaining.end());
+    }
+  } catch (const kj::Exception &e) {
+    fprintf(stderr, "stopped at a corrupt event: %s\n", e.getDescription().cStr());
+  }
+  if (events.empty()) {
+    fprintf(stderr, "no events in %s\n", rlog.c_str());
+    return 1;
+  }
+
+  BenchReport report("loggerd");
+  LoggerState logger = {};
+  logger_init(&logger, true);
+  char segment_path[4096];
+  int part = -1;
+
+  uint64_t segment_start = events[0].mono_time;
+  auto t = report.now();
+  logger_next(&logger, root.c_str(), segment_path, sizeof(segment_path), &part);
+  report.add("rotate", t);
+
+  for (size_t i = 0; i < events.size(); i++) {
+    const RawEvent &e = events[i];
+    if (e.mono_time > segment_start + SEGMENT_LENGTH * 1000000000ULL) {
+      t = report.now();
+      logger_next(&logger, root.c_str(), segment_path, sizeof(segment_path), &part);
+      report.add("rotate", t);
+      segment_start = e.mono_time;
+    }
+    t = report.now();
+    logger_log(&logger, (uint8_t *)e.words.begin(), e.words.asBytes().size(), i % QLOG_EVERY == 0);
+    report.add("log", t);
+  }
+  t = report.now();
+  logger_close(&logger);
+  report.add("close", t);
+
+  report.set("events", (double)events.size());
+  report.set("segments", (double)part + 1);
+  report.finish((events.back().mono_time - events.front().mono_time) * 1e-9);
+  report.write(json_path);
+  return 0;
+}
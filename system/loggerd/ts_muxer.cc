@@ -0,0 +1,197 @@
+#include "system/loggerd/ts_muxer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include "common/swaglog.h"
+#include "common/util.h"
+
+const int TS_PACKET_SIZE = 188;
+const int TS_PAYLOAD_SIZE = TS_PACKET_SIZE - 4;
+const size_t TS_BUFFER_PACKETS = 512;
+const uint16_t PMT_PID = 0x1000;
+const uint16_t VIDEO_PID = 0x100;
+const uint8_t STREAM_TYPE_H264 = 0x1b;
+// PCR runs this far ahead of the PTS, the decoder's buffering budget
+const uint64_t PCR_DELAY_90K = 9000;
+
+static const uint8_t AUD[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xf0};
+
+// CRC-32/MPEG-2, sections are tiny so no table
+static uint32_t crc32_mpeg(const uint8_t *data, int len) {
+  uint32_t crc = 0xffffffff;
+  for (int i = 0; i < len; i++) {
+    crc ^= (uint32_t)data[i] << 24;
+    for (int b = 0; b < 8; b++) {
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static void put_crc(uint8_t *section, int len) {
+  uint32_t crc = crc32_mpeg(section, len);
+  section[len] = crc >> 24;
+  section[len + 1] = crc >> 16;
+  section[len + 2] = crc >> 8;
+  section[len + 3] = crc;
+}
+
+TsMuxer::TsMuxer(FILE *of, bool flush_on_keyframe) : of(of), flush_on_keyframe(flush_on_keyframe) {
+  buf.resize(TS_BUFFER_PACKETS * TS_PACKET_SIZE);
+}
+
+TsMuxer::~TsMuxer() {
+  flush();
+}
+
+void TsMuxer::flush() {
+  if (buf_len == 0) return;
+  size_t written = util::safe_fwrite(buf.data(), 1, buf_len, of);
+  if (written != buf_len) {
+    LOGE("failed to write ts file. errno=%d", errno);
+  }
+  buf_len = 0;
+}
+
+uint8_t *TsMuxer::next_packet() {
+  if (buf_len == buf.size()) {
+    flush();
+  }
+  uint8_t *pkt = &buf[buf_len];
+  buf_len += TS_PACKET_SIZE;
+  return pkt;
+}
+
+void TsMuxer::set_codec_config(const uint8_t *data, int len) {
+  codec_config.assign(data, data + len);
+}
+
+void TsMuxer::write_psi(uint16_t pid, const uint8_t *section, int len) {
+  assert(len <= TS_PAYLOAD_SIZE - 1);
+  uint8_t &cc = pid == 0 ? cc_pat : cc_pmt;
+  uint8_t *pkt = next_packet();
+  pkt[0] = 0x47;
+  pkt[1] = 0x40 | (pid >> 8);  // payload unit start
+  pkt[2] = pid & 0xff;
+  pkt[3] = 0x10 | cc;
+  cc = (cc + 1) & 0xf;
+  pkt[4] = 0;  // pointer field
+  memcpy(&pkt[5], section, len);
+  memset(&pkt[5 + len], 0xff, TS_PAYLOAD_SIZE - 1 - len);
+}
+
+void TsMuxer::write_pat() {
+  uint8_t section[] = {
+    0x00, 0xb0, 13,        // table id, section length
+    0x00, 0x01, 0xc1, 0x00, 0x00,  // transport stream id, version 0, current
+    0x00, 0x01, (uint8_t)(0xe0 | (PMT_PID >> 8)), (uint8_t)(PMT_PID & 0xff),  // program 1
+    0, 0, 0, 0,            // crc
+  };
+  put_crc(section, sizeof(section) - 4);
+  write_psi(0, section, sizeof(section));
+}
+
+void TsMuxer::write_pmt() {
+  uint8_t section[] = {
+    0x02, 0xb0, 18,        // table id, section length
+    0x00, 0x01, 0xc1, 0x00, 0x00,  // program 1, version 0, current
+    (uint8_t)(0xe0 | (VIDEO_PID >> 8)), (uint8_t)(VIDEO_PID & 0xff),  // PCR pid
+    0xf0, 0x00,            // no program info
+    STREAM_TYPE_H264, (uint8_t)(0xe0 | (VIDEO_PID >> 8)), (uint8_t)(VIDEO_PID & 0xff), 0xf0, 0x00,
+    0, 0, 0, 0,            // crc
+  };
+  put_crc(section, sizeof(section) - 4);
+  write_psi(PMT_PID, section, sizeof(section));
+}
+
+void TsMuxer::write(const uint8_t *data, int len, long long timestamp, bool keyframe) {
+  if (keyframe) {
+    if (flush_on_keyframe) flush();
+    write_pat();
+    write_pmt();
+  }
+
+  // 90kHz clock, 33 bits
+  const uint64_t pts = (PCR_DELAY_90K + (uint64_t)timestamp * 9 / 100) & ((1ULL << 33) - 1);
+  const uint64_t pcr = (pts - PCR_DELAY_90K) & ((1ULL << 33) - 1);
+
+  uint8_t pes_header[14] = {
+    0x00, 0x00, 0x01, 0xe0,  // video stream 0
+    0x00, 0x00,              // unbounded length
+    0x80, 0x80, 0x05,        // PTS only
+    (uint8_t)(0x21 | ((pts >> 29) & 0x0e)),
+    (uint8_t)(pts >> 22),
+    (uint8_t)(((pts >> 14) & 0xfe) | 1),
+    (uint8_t)(pts >> 7),
+    (uint8_t)(((pts << 1) & 0xfe) | 1),
+  };
+
+  // the access unit goes out as it is, split over packets from these pieces
+  struct Span { const uint8_t *ptr; int len; };
+  Span spans[] = {
+    {pes_header, (int)sizeof(pes_header)},
+    {AUD, (int)sizeof(AUD)},
+    {codec_config.data(), keyframe ? (int)codec_config.size() : 0},
+    {data, len},
+  };
+  int total = 0;
+  for (auto &sp : spans) total += sp.len;
+
+  int span = 0, span_pos = 0;
+  for (int pos = 0; pos < total;) {
+    const bool first = pos == 0;
+    // adaptation field bytes, including its length byte. the first packet carries the PCR,
+    // a short last packet is padded with stuffing
+    int af = first ? 8 : 0;
+    int payload = total - pos;
+    if (payload > TS_PAYLOAD_SIZE - af) {
+      payload = TS_PAYLOAD_SIZE - af;
+    } else {
+      af = TS_PAYLOAD_SIZE - payload;
+    }
+
+    uint8_t *pkt = next_packet();
+    pkt[0] = 0x47;
+    pkt[1] = (first ? 0x40 : 0x00) | (VIDEO_PID >> 8);
+    pkt[2] = VIDEO_PID & 0xff;
+    pkt[3] = (af > 0 ? 0x30 : 0x10) | cc_video;
+    cc_video = (cc_video + 1) & 0xf;
+
+    uint8_t *p = &pkt[4];
+    if (af > 0) {
+      p[0] = af - 1;
+      if (af > 1) {
+        int n = 2;
+        p[1] = 0x00;
+        if (first) {
+          p[1] = 0x10 | (keyframe ? 0x40 : 0x00);  // PCR, random access
+          p[2] = pcr >> 25;
+          p[3] = pcr >> 17;
+          p[4] = pcr >> 9;
+          p[5] = pcr >> 1;
+          p[6] = ((pcr & 1) << 7) | 0x7e;
+          p[7] = 0;
+          n = 8;
+        }
+        memset(&p[n], 0xff, af - n);
+      }
+      p += af;
+    }
+
+    for (int left = payload; left > 0;) {
+      int n = std::min(left, spans[span].len - span_pos);
+      memcpy(p, spans[span].ptr + span_pos, n);
+      p += n;
+      left -= n;
+      span_pos += n;
+      if (span_pos == spans[span].len) {
+        span++;
+        span_pos = 0;
+      }
+    }
+    pos += payload;
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Minimal MPEG-TS muxer for a single Annex-B H.264 stream, used in place of
+// libavformat for the qcamera. Packets are written straight into a
+// preallocated buffer, which goes to the file once it's full or, with
+// flush_on_keyframe, at every keyframe so the file always ends on a GOP
+// boundary.
+class TsMuxer {
+public:
+  TsMuxer(FILE *of, bool flush_on_keyframe = false);
+  ~TsMuxer();
+  // the codec config (SPS/PPS) is repeated in front of every keyframe
+  void set_codec_config(const uint8_t *data, int len);
+  // timestamp is in microseconds
+  void write(const uint8_t *data, int len, long long timestamp, bool keyframe);
+  void flush();
+
+private:
+  void write_psi(uint16_t pid, const uint8_t *section, int len);
+  void write_pat();
+  void write_pmt();
+  uint8_t *next_packet();
+
+  FILE *of;
+  const bool flush_on_keyframe;
+  std::vector<uint8_t> codec_config;
+  std::vector<uint8_t> buf;
+  size_t buf_len = 0;
+  uint8_t cc_pat = 0, cc_pmt = 0, cc_video = 0;
+};
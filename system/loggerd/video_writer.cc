@@ -15,7 +15,13 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
   close(lock_fd);
 
   LOGD("encoder_open %s remuxing:%d", this->vid_path.c_str(), this->remuxing);
-  if (this->remuxing) {
+  if (this->remuxing && codec == cereal::EncodeIndex::Type::QCAMERA_H264) {
+    this->of = util::safe_fopen(this->vid_path.c_str(), "wb");
+    assert(this->of);
+    // the muxer buffers itself
+    setvbuf(this->of, NULL, _IONBF, 0);
+    this->ts_muxer = std::make_unique<TsMuxer>(this->of, true);
+  } else if (this->remuxing) {
     bool raw = (codec == cereal::EncodeIndex::Type::BIG_BOX_LOSSLESS);
     avformat_alloc_output_context2(&this->ofmt_ctx, NULL, raw ? "matroska" : NULL, this->vid_path.c_str());
     assert(this->ofmt_ctx);
@@ -51,6 +57,15 @@ VideoWriter::VideoWriter(const char *path, const char *filename, bool remuxing,
 }
 
 void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecconfig, bool keyframe) {
+  if (ts_muxer) {
+    if (codecconfig) {
+      ts_muxer->set_codec_config(data, len);
+    } else {
+      ts_muxer->write(data, len, timestamp, keyframe);
+    }
+    return;
+  }
+
   if (of && data) {
     size_t written = util::safe_fwrite(data, 1, len, of);
     if (written != len) {
@@ -96,7 +111,12 @@ void VideoWriter::write(uint8_t *data, int len, long long timestamp, bool codecc
 }
 
 VideoWriter::~VideoWriter() {
-  if (this->remuxing) {
+  if (this->ts_muxer) {
+    this->ts_muxer.reset();
+    util::safe_fflush(this->of);
+    fclose(this->of);
+    this->of = nullptr;
+  } else if (this->remuxing) {
     int err = av_write_trailer(this->ofmt_ctx);
     if (err != 0) LOGE("av_write_trailer failed %d", err);
     avcodec_free_context(&this->codec_ctx);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
 extern "C" {
@@ -8,6 +9,7 @@ extern "C" {
 }
 
 #include "cereal/messaging/messaging.h"
+#include "system/loggerd/ts_muxer.h"
 
 class VideoWriter {
 public:
@@ -17,6 +19,7 @@ public:
 private:
   std::string vid_path, lock_path;
   FILE *of = nullptr;
+  std::unique_ptr<TsMuxer> ts_muxer;  // h264 remuxes to .ts without libavformat
 
   AVCodecContext *codec_ctx;
   AVFormatContext *ofmt_ctx;
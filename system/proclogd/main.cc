@@ -7,16 +7,26 @@
 
 ExitHandler do_exit;
 
+// thread stats are logged every this many procLogs, one a minute
+const int THREAD_LOG_INTERVAL = 30;
+
 int main(int argc, char **argv) {
   setpriority(PRIO_PROCESS, 0, -15);
+  // the stat file of every process is kept open
+  util::set_file_descriptor_limit(4096);
 
   RateKeeper rk("proclogd", 0.5);
   PubMaster publisher({"procLog"});
 
-  while (!do_exit) {
+  ProcSampler sampler;
+  for (uint64_t cnt = 0; !do_exit; ++cnt) {
     MessageBuilder msg;
-    buildProcLogMessage(msg);
+    auto proc_log = msg.initEvent().initProcLog();
+    sampler.build(proc_log);
     publisher.send("procLog", msg);
+    if (cnt % THREAD_LOG_INTERVAL == 0) {
+      sampler.logThreads();
+    }
 
     rk.keepTime();
   }
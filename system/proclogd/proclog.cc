@@ -1,15 +1,53 @@
 #include "system/proclogd/proclog.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iterator>
 #include <sstream>
+#include <utility>
 
 #include "common/swaglog.h"
+#include "common/timing.h"
 #include "common/util.h"
 
+namespace {
+
+// the number at c, which is moved past it. false if there's no number there
+template <typename T>
+bool scanNumber(const char *&c, const char *end, T &out) {
+  const bool negative = c < end && *c == '-';
+  const char *d = negative ? c + 1 : c;
+  if (d == end || *d < '0' || *d > '9') return false;
+
+  T v = 0;
+  for (; d < end && *d >= '0' && *d <= '9'; ++d) {
+    v = v * 10 + (*d - '0');
+  }
+  out = negative ? -v : v;
+  c = d;
+  return true;
+}
+
+// the lines of a buffer, without the newline
+template <typename F>
+void forEachLine(const char *data, size_t size, F &&f) {
+  for (const char *c = data, *end = data + size; c < end;) {
+    const char *eol = (const char *)memchr(c, '\n', end - c);
+    if (!eol) eol = end;
+    f(c, eol);
+    c = eol + 1;
+  }
+}
+
+}  // namespace
+
 namespace Parser {
 
 // parse /proc/stat
@@ -63,47 +101,51 @@ enum StatPos {
 };
 
 // parse /proc/pid/stat
-std::optional<ProcStat> procStat(std::string stat) {
+bool procStat(const char *stat, size_t size, ProcStat &p) {
   // To avoid being fooled by names containing a closing paren, scan backwards.
-  auto open_paren = stat.find('(');
-  auto close_paren = stat.rfind(')');
-  if (open_paren == std::string::npos || close_paren == std::string::npos || open_paren > close_paren) {
-    return std::nullopt;
-  }
-
-  std::string name = stat.substr(open_paren + 1, close_paren - open_paren - 1);
-  // replace space in name with _
-  std::replace(&stat[open_paren], &stat[close_paren], ' ', '_');
-  std::istringstream iss(stat);
-  std::vector<std::string> v{std::istream_iterator<std::string>(iss),
-                             std::istream_iterator<std::string>()};
-  try {
-    if (v.size() != StatPos::MAX_FIELD) {
-      throw std::invalid_argument("stat");
-    }
-    ProcStat p = {
-      .name = name,
-      .pid = stoi(v[StatPos::pid - 1]),
-      .state = v[StatPos::state - 1][0],
-      .ppid = stoi(v[StatPos::ppid - 1]),
-      .utime = stoul(v[StatPos::utime - 1]),
-      .stime = stoul(v[StatPos::stime - 1]),
-      .cutime = stol(v[StatPos::cutime - 1]),
-      .cstime = stol(v[StatPos::cstime - 1]),
-      .priority = stol(v[StatPos::priority - 1]),
-      .nice = stol(v[StatPos::nice - 1]),
-      .num_threads = stol(v[StatPos::num_threads - 1]),
-      .starttime = stoull(v[StatPos::starttime - 1]),
-      .vms = stoul(v[StatPos::vsize - 1]),
-      .rss = stol(v[StatPos::rss - 1]),
-      .processor = stoi(v[StatPos::processor - 1]),
-    };
+  const char *end = stat + size;
+  const char *open_paren = (const char *)memchr(stat, '(', size);
+  const char *close_paren = nullptr;
+  for (const char *c = end; c > stat && !close_paren; --c) {
+    if (c[-1] == ')') close_paren = c - 1;
+  }
+  if (!open_paren || !close_paren || open_paren > close_paren) return false;
+
+  const char *c = stat;
+  if (!scanNumber(c, open_paren, p.pid)) return false;
+  p.name.assign(open_paren + 1, close_paren);
+
+  c = close_paren + 1;
+  while (c < end && *c == ' ') ++c;
+  if (c == end) return false;
+  p.state = *c++;
+
+  long long v[StatPos::processor + 1] = {};
+  for (int i = StatPos::ppid; i <= StatPos::processor; ++i) {
+    while (c < end && *c == ' ') ++c;
+    if (!scanNumber(c, end, v[i])) return false;
+  }
+  p.ppid = v[StatPos::ppid];
+  p.utime = v[StatPos::utime];
+  p.stime = v[StatPos::stime];
+  p.cutime = v[StatPos::cutime];
+  p.cstime = v[StatPos::cstime];
+  p.priority = v[StatPos::priority];
+  p.nice = v[StatPos::nice];
+  p.num_threads = v[StatPos::num_threads];
+  p.starttime = v[StatPos::starttime];
+  p.vms = v[StatPos::vsize];
+  p.rss = v[StatPos::rss];
+  p.processor = v[StatPos::processor];
+  return true;
+}
+
+std::optional<ProcStat> procStat(std::string stat) {
+  ProcStat p = {};
+  if (procStat(stat.data(), stat.size(), p)) {
     return p;
-  } catch (const std::invalid_argument &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  } catch (const std::out_of_range &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
   }
+  LOGE("failed to parse procStat :%s", stat.c_str());
   return std::nullopt;
 }
 
@@ -157,14 +199,193 @@ const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
 const double jiffy = sysconf(_SC_CLK_TCK);
 const size_t page_size = sysconf(_SC_PAGE_SIZE);
 
-void buildCPUTimes(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/stat");
-  std::vector<CPUTime> stats = Parser::cpuTimes(stream);
+ProcSampler::~ProcSampler() {
+  for (auto &[pid, proc] : procs_) {
+    if (proc.fd >= 0) close(proc.fd);
+  }
+  for (auto &[tid, thread] : threads_) {
+    for (int fd : {thread.stat_fd, thread.status_fd, thread.schedstat_fd}) {
+      if (fd >= 0) close(fd);
+    }
+  }
+  if (stat_fd_ >= 0) close(stat_fd_);
+  if (meminfo_fd_ >= 0) close(meminfo_fd_);
+}
+
+// reads the file from offset 0 into buf_, opening it if fd isn't open. A file that can't
+// be read is closed, the next read opens it again.
+bool ProcSampler::read(int &fd, const char *path) {
+  if (fd < 0) {
+    fd = HANDLE_EINTR(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) return false;
+  }
+
+  buf_size_ = 0;
+  while (true) {
+    if (buf_size_ == buf_.size()) buf_.resize(buf_.size() * 2);
+    ssize_t n = HANDLE_EINTR(pread(fd, buf_.data() + buf_size_, buf_.size() - buf_size_, buf_size_));
+    if (n < 0) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    if (n == 0) return true;
+    buf_size_ += n;
+  }
+}
+
+bool ProcSampler::readProc(int pid, Proc &proc) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  // a kept fd of a process that exited fails, the pid may be another one's by now
+  if (!read(proc.fd, path) && !read(proc.fd, path)) return false;
+  if (!Parser::procStat(buf_.data(), buf_size_, proc.stat)) {
+    LOGE("failed to parse procStat :%.*s", (int)buf_size_, buf_.data());
+    return false;
+  }
+
+  if (proc.extra.pid != pid || proc.extra_starttime != proc.stat.starttime || proc.extra.name != proc.stat.name) {
+    const std::string proc_path = "/proc/" + std::to_string(pid);
+    proc.extra.pid = pid;
+    proc.extra.name = proc.stat.name;
+    proc.extra.exe = util::readlink(proc_path + "/exe");
+    proc.extra.cmdline.clear();
+    const std::string cmdline = util::read_file(proc_path + "/cmdline");
+    for (size_t i = 0; i < cmdline.size();) {
+      size_t arg_end = std::min(cmdline.find('\0', i), cmdline.size());
+      if (arg_end > i) proc.extra.cmdline.emplace_back(cmdline, i, arg_end - i);
+      i = arg_end + 1;
+    }
+    proc.extra_starttime = proc.stat.starttime;
+  }
+  return true;
+}
 
-  auto log_cpu_times = builder.initCpuTimes(stats.size());
-  for (int i = 0; i < stats.size(); ++i) {
+bool ProcSampler::readThread(int pid, int tid, Thread &thread) {
+  char path[96];
+  snprintf(path, sizeof(path), "/proc/%d/task/%d/stat", pid, tid);
+  if (!read(thread.stat_fd, path) && !read(thread.stat_fd, path)) return false;
+  if (!Parser::procStat(buf_.data(), buf_size_, thread.stat)) return false;
+
+  snprintf(path, sizeof(path), "/proc/%d/task/%d/status", pid, tid);
+  if (read(thread.status_fd, path)) {
+    forEachLine(buf_.data(), buf_size_, [&](const char *c, const char *end) {
+      static const std::pair<const char *, size_t> keys[] = {{"voluntary_ctxt_switches:", 24}, {"nonvoluntary_ctxt_switches:", 27}};
+      unsigned long *values[] = {&thread.voluntary_switches, &thread.involuntary_switches};
+      for (size_t i = 0; i < std::size(keys); ++i) {
+        if ((size_t)(end - c) > keys[i].second && memcmp(c, keys[i].first, keys[i].second) == 0) {
+          c += keys[i].second;
+          while (c < end && (*c == ' ' || *c == '\t')) ++c;
+          scanNumber(c, end, *values[i]);
+        }
+      }
+    });
+  }
+
+  // the time on the cpu, waiting on a run queue, timeslices. Not there without schedstats
+  snprintf(path, sizeof(path), "/proc/%d/task/%d/schedstat", pid, tid);
+  if (read(thread.schedstat_fd, path)) {
+    const char *c = buf_.data(), *end = buf_.data() + buf_size_;
+    uint64_t run_ns = 0;
+    if (scanNumber(c, end, run_ns)) {
+      while (c < end && *c == ' ') ++c;
+      scanNumber(c, end, thread.run_delay_ns);
+    }
+  }
+  return true;
+}
+
+void ProcSampler::logThreads() {
+  const uint64_t now = nanos_since_boot();
+  const double secs = (now - thread_sample_ns_) / 1e9;
+  thread_sample_ns_ = now;
+  ++thread_sample_;
+
+  std::string out;
+  char path[64];
+  for (const Proc *proc : sampled_) {
+    // realtime processes have a negative priority
+    if (proc->stat.priority >= 0 && proc->stat.nice >= 0) continue;
+
+    snprintf(path, sizeof(path), "/proc/%d/task", proc->stat.pid);
+    DIR *d = opendir(path);
+    if (!d) continue;
+    while (struct dirent *de = readdir(d)) {
+      const int tid = atoi(de->d_name);
+      if (tid <= 0) continue;
+
+      Thread &thread = threads_[tid];
+      const bool has_last = thread.sample + 1 == thread_sample_;
+      const unsigned long last_cpu = thread.stat.utime + thread.stat.stime;
+      const unsigned long last_voluntary = thread.voluntary_switches, last_involuntary = thread.involuntary_switches;
+      const uint64_t last_run_delay_ns = thread.run_delay_ns;
+      const unsigned long long last_starttime = thread.stat.starttime;
+      if (!readThread(proc->stat.pid, tid, thread)) continue;
+      thread.sample = thread_sample_;
+      // the first sample of a thread, or of another one with its tid, has nothing to diff with
+      if (!has_last || thread.stat.starttime != last_starttime) continue;
+
+      const unsigned long voluntary = thread.voluntary_switches - last_voluntary;
+      const unsigned long involuntary = thread.involuntary_switches - last_involuntary;
+      const double cpu = (thread.stat.utime + thread.stat.stime - last_cpu) / jiffy;
+      if (cpu == 0 && voluntary == 0 && involuntary == 0) continue;
+
+      out += util::string_format(" %s/%s(%d) cpu %.1f%% cs %lu/%lu delay %.2fms,", proc->stat.name.c_str(),
+                                 thread.stat.name.c_str(), tid, secs > 0 ? cpu / secs * 100 : 0, voluntary, involuntary,
+                                 (thread.run_delay_ns - last_run_delay_ns) / 1e6);
+    }
+    closedir(d);
+  }
+  // the ones that exited, or whose process isn't sampled anymore
+  for (auto it = threads_.begin(); it != threads_.end();) {
+    if (it->second.sample != thread_sample_) {
+      for (int fd : {it->second.stat_fd, it->second.status_fd, it->second.schedstat_fd}) {
+        if (fd >= 0) close(fd);
+      }
+      it = threads_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  if (!out.empty()) {
+    out.pop_back();
+    LOG("thread stats over %.0fs (cpu, voluntary/involuntary switches, run queue delay):%s", secs, out.c_str());
+  }
+}
+
+void ProcSampler::build(cereal::ProcLog::Builder &builder) {
+  ++sample_;
+  buildProcs(builder);
+  buildCPUTimes(builder);
+  buildMemInfo(builder);
+}
+
+void ProcSampler::buildCPUTimes(cereal::ProcLog::Builder &builder) {
+  cpu_times_.clear();
+  if (read(stat_fd_, "/proc/stat")) {
+    bool first = true;
+    forEachLine(buf_.data(), buf_size_, [&](const char *c, const char *end) {
+      // skip the first line for cpu total
+      if (std::exchange(first, false)) return;
+      if (end - c < 3 || memcmp(c, "cpu", 3) != 0) return;
+
+      CPUTime t = {};
+      c += 3;
+      unsigned long *fields[] = {&t.utime, &t.ntime, &t.stime, &t.itime, &t.iowtime, &t.irqtime, &t.sirqtime};
+      bool ok = scanNumber(c, end, t.id);
+      for (unsigned long *f : fields) {
+        while (c < end && *c == ' ') ++c;
+        ok = ok && scanNumber(c, end, *f);
+      }
+      if (ok) cpu_times_.push_back(t);
+    });
+  }
+
+  auto log_cpu_times = builder.initCpuTimes(cpu_times_.size());
+  for (int i = 0; i < cpu_times_.size(); ++i) {
     auto l = log_cpu_times[i];
-    const CPUTime &r = stats[i];
+    const CPUTime &r = cpu_times_[i];
     l.setCpuNum(r.id);
     l.setUser(r.utime / jiffy);
     l.setNice(r.ntime / jiffy);
@@ -176,36 +397,61 @@ void buildCPUTimes(cereal::ProcLog::Builder &builder) {
   }
 }
 
-void buildMemInfo(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/meminfo");
-  auto mem_info = Parser::memInfo(stream);
+void ProcSampler::buildMemInfo(cereal::ProcLog::Builder &builder) {
+  enum { TOTAL, FREE, AVAILABLE, BUFFERS, CACHED, ACTIVE, INACTIVE, SHARED, COUNT };
+  static const std::pair<const char *, size_t> keys[COUNT] = {
+    {"MemTotal:", 9}, {"MemFree:", 8}, {"MemAvailable:", 13}, {"Buffers:", 8},
+    {"Cached:", 7}, {"Active:", 7}, {"Inactive:", 9}, {"Shmem:", 6},
+  };
+  uint64_t values[COUNT] = {};
+  if (read(meminfo_fd_, "/proc/meminfo")) {
+    forEachLine(buf_.data(), buf_size_, [&](const char *c, const char *end) {
+      for (int i = 0; i < COUNT; ++i) {
+        auto [key, len] = keys[i];
+        if ((size_t)(end - c) > len && memcmp(c, key, len) == 0) {
+          c += len;
+          while (c < end && *c == ' ') ++c;
+          if (scanNumber(c, end, values[i])) values[i] *= 1024;
+          return;
+        }
+      }
+    });
+  }
 
   auto mem = builder.initMem();
-  mem.setTotal(mem_info["MemTotal:"]);
-  mem.setFree(mem_info["MemFree:"]);
-  mem.setAvailable(mem_info["MemAvailable:"]);
-  mem.setBuffers(mem_info["Buffers:"]);
-  mem.setCached(mem_info["Cached:"]);
-  mem.setActive(mem_info["Active:"]);
-  mem.setInactive(mem_info["Inactive:"]);
-  mem.setShared(mem_info["Shmem:"]);
-}
-
-void buildProcs(cereal::ProcLog::Builder &builder) {
-  auto pids = Parser::pids();
-  std::vector<ProcStat> proc_stats;
-  proc_stats.reserve(pids.size());
-  for (int pid : pids) {
-    std::string path = "/proc/" + std::to_string(pid) + "/stat";
-    if (auto stat = Parser::procStat(util::read_file(path))) {
-      proc_stats.push_back(*stat);
+  mem.setTotal(values[TOTAL]);
+  mem.setFree(values[FREE]);
+  mem.setAvailable(values[AVAILABLE]);
+  mem.setBuffers(values[BUFFERS]);
+  mem.setCached(values[CACHED]);
+  mem.setActive(values[ACTIVE]);
+  mem.setInactive(values[INACTIVE]);
+  mem.setShared(values[SHARED]);
+}
+
+void ProcSampler::buildProcs(cereal::ProcLog::Builder &builder) {
+  sampled_.clear();
+  for (int pid : Parser::pids()) {
+    Proc &proc = procs_[pid];
+    if (readProc(pid, proc)) {
+      proc.sample = sample_;
+      sampled_.push_back(&proc);
+    }
+  }
+  // the ones that exited
+  for (auto it = procs_.begin(); it != procs_.end();) {
+    if (it->second.sample != sample_) {
+      if (it->second.fd >= 0) close(it->second.fd);
+      it = procs_.erase(it);
+    } else {
+      ++it;
     }
   }
 
-  auto procs = builder.initProcs(proc_stats.size());
-  for (size_t i = 0; i < proc_stats.size(); i++) {
+  auto procs = builder.initProcs(sampled_.size());
+  for (size_t i = 0; i < sampled_.size(); i++) {
     auto l = procs[i];
-    const ProcStat &r = proc_stats[i];
+    const ProcStat &r = sampled_[i]->stat;
     l.setPid(r.pid);
     l.setState(r.state);
     l.setPpid(r.ppid);
@@ -222,7 +468,7 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
     l.setProcessor(r.processor);
     l.setName(r.name);
 
-    const ProcCache &extra_info = Parser::getProcExtraInfo(r.pid, r.name);
+    const ProcCache &extra_info = sampled_[i]->extra;
     l.setExe(extra_info.exe);
     auto lcmdline = l.initCmdline(extra_info.cmdline.size());
     for (size_t j = 0; j < lcmdline.size(); j++) {
@@ -232,8 +478,7 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
 }
 
 void buildProcLogMessage(MessageBuilder &msg) {
+  static ProcSampler sampler;
   auto procLog = msg.initEvent().initProcLog();
-  buildProcs(procLog);
-  buildCPUTimes(procLog);
-  buildMemInfo(procLog);
+  sampler.build(procLog);
 }
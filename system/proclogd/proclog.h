@@ -30,6 +30,8 @@ namespace Parser {
 
 std::vector<int> pids();
 std::optional<ProcStat> procStat(std::string stat);
+// parses /proc/<pid>/stat into p, reusing what it holds
+bool procStat(const char *stat, size_t size, ProcStat &p);
 std::vector<std::string> cmdline(std::istream &stream);
 std::vector<CPUTime> cpuTimes(std::istream &stream);
 std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream);
@@ -37,4 +39,53 @@ const ProcCache &getProcExtraInfo(int pid, const std::string &name);
 
 };  // namespace Parser
 
+// Samples /proc without iostreams. The stat files it reads are kept open and read again
+// from offset 0 every sample, a process's stat into the struct of its last sample, and its
+// exe and cmdline are only read when it's new or exec'd.
+class ProcSampler {
+public:
+  ~ProcSampler();
+  void build(cereal::ProcLog::Builder &builder);
+  // logs the CPU, context switches and run queue delay since the last call of every thread
+  // of the processes with a raised priority, by the names set_thread_name() gave them.
+  // Uses the processes of the last build().
+  void logThreads();
+
+private:
+  struct Proc {
+    int fd = -1;
+    ProcStat stat = {};
+    ProcCache extra;
+    unsigned long long extra_starttime = 0;  // what extra is of, with extra.name
+    uint64_t sample = 0;  // the last one it was in
+  };
+
+  struct Thread {
+    int stat_fd = -1, status_fd = -1, schedstat_fd = -1;
+    ProcStat stat = {};
+    unsigned long voluntary_switches = 0, involuntary_switches = 0;
+    uint64_t run_delay_ns = 0;
+    uint64_t sample = 0;
+  };
+
+  bool read(int &fd, const char *path);
+  bool readProc(int pid, Proc &proc);
+  bool readThread(int pid, int tid, Thread &thread);
+  void buildProcs(cereal::ProcLog::Builder &builder);
+  void buildCPUTimes(cereal::ProcLog::Builder &builder);
+  void buildMemInfo(cereal::ProcLog::Builder &builder);
+
+  std::unordered_map<int, Proc> procs_;
+  std::vector<const Proc *> sampled_;
+  std::vector<CPUTime> cpu_times_;
+  std::vector<char> buf_ = std::vector<char>(4096);
+  size_t buf_size_ = 0;  // of what read() read
+  int stat_fd_ = -1, meminfo_fd_ = -1;
+  uint64_t sample_ = 0;
+
+  std::unordered_map<int, Thread> threads_;
+  uint64_t thread_sample_ = 0;
+  uint64_t thread_sample_ns_ = 0;
+};
+
 void buildProcLogMessage(MessageBuilder &msg);
@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
+#include <iterator>
 
 #include "common/swaglog.h"
 #include "common/util.h"
@@ -219,8 +220,18 @@ bool BMX055_Magn::get_event(MessageBuilder &msg, uint64_t ts) {
   uint8_t buffer[8];
   int16_t _x, _y, x, y, z;
 
-  int len = read_register(BMX055_MAGN_I2C_REG_DATAX_LSB, buffer, sizeof(buffer));
-  assert(len == sizeof(buffer));
+  // The BMX055 Magnetometer has no FIFO mode. Self running mode only goes
+  // up to 30 Hz. Therefore we put in forced mode, and request measurements
+  // at a 100 Hz. When reading the registers we have to check the ready bit
+  // To verify the measurement was completed this cycle.
+  // The next one is requested in the same transfer as the data is read.
+  uint8_t forced = BMX055_MAGN_FORCED;
+  I2CAccess accesses[] = {
+    {.register_address = BMX055_MAGN_I2C_REG_DATAX_LSB, .buffer = buffer, .len = sizeof(buffer)},
+    {.register_address = BMX055_MAGN_I2C_REG_MAG, .buffer = &forced, .len = 1, .write = true},
+  };
+  int ret = transfer(accesses, std::size(accesses));
+  assert(ret == 0);
 
   bool parsed = parse_xyz(buffer, &_x, &_y, &z);
   if (parsed) {
@@ -246,11 +257,5 @@ bool BMX055_Magn::get_event(MessageBuilder &msg, uint64_t ts) {
     svec.setStatus(true);
   }
 
-  // The BMX055 Magnetometer has no FIFO mode. Self running mode only goes
-  // up to 30 Hz. Therefore we put in forced mode, and request measurements
-  // at a 100 Hz. When reading the registers we have to check the ready bit
-  // To verify the measurement was completed this cycle.
-  set_register(BMX055_MAGN_I2C_REG_MAG, BMX055_MAGN_FORCED);
-
   return parsed;
 }
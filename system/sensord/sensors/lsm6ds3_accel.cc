@@ -218,16 +218,15 @@ fail:
 
 bool LSM6DS3_Accel::get_event(MessageBuilder &msg, uint64_t ts) {
 
-  // INT1 shared with gyro, check STATUS_REG who triggered
-  uint8_t status_reg = 0;
-  read_register(LSM6DS3_ACCEL_I2C_REG_STAT_REG, &status_reg, sizeof(status_reg));
-  if ((status_reg & LSM6DS3_ACCEL_DRDY_XLDA) == 0) {
+  // INT1 shared with gyro, check STATUS_REG who triggered. It's read in the same
+  // burst as the data, which is thrown away if it isn't ready
+  uint8_t regs[LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL + 6 - LSM6DS3_ACCEL_I2C_REG_STAT_REG];
+  int len = read_register(LSM6DS3_ACCEL_I2C_REG_STAT_REG, regs, sizeof(regs));
+  assert(len == sizeof(regs));
+  if ((regs[0] & LSM6DS3_ACCEL_DRDY_XLDA) == 0) {
     return false;
   }
-
-  uint8_t buffer[6];
-  int len = read_register(LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL, buffer, sizeof(buffer));
-  assert(len == sizeof(buffer));
+  const uint8_t *buffer = &regs[LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL - LSM6DS3_ACCEL_I2C_REG_STAT_REG];
 
   float scale = 9.81 * 2.0f / (1 << 15);
   float x = read_16_bit(buffer[0], buffer[1]) * scale;
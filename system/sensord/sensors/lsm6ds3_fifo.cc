@@ -0,0 +1,172 @@
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "common/swaglog.h"
+#include "common/timing.h"
+
+#define DEG2RAD(x) ((x) * M_PI / 180.0)
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus) : I2CSensor(bus) {}
+
+int LSM6DS3_Fifo::reset() {
+  // going through bypass mode empties the FIFO
+  int ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) return ret;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_ODR_104HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+  if (ret < 0) return ret;
+
+  sets_read = 0;
+  last_trigger_idx = 0;
+  last_trigger_ts = 0;
+  return 0;
+}
+
+int LSM6DS3_Fifo::init() {
+  int ret = verify_chip_id(LSM6DS3_FIFO_I2C_REG_ID, {LSM6DS3_FIFO_CHIP_ID, LSM6DS3TRC_FIFO_CHIP_ID});
+  if (ret == -1) return -1;
+
+  if (ret == LSM6DS3TRC_FIFO_CHIP_ID) {
+    source = cereal::SensorEventData::SensorSource::LSM6DS3TRC;
+  }
+
+  // watermark in 16 bit words
+  const uint16_t threshold = LSM6DS3_FIFO_WATERMARK_SETS * LSM6DS3_FIFO_SET_WORDS;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL1, threshold & 0xFF);
+  if (ret < 0) return ret;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL2, threshold >> 8);
+  if (ret < 0) return ret;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL3, LSM6DS3_FIFO_NO_DECIMATION);
+  if (ret < 0) return ret;
+  ret = reset();
+  if (ret < 0) return ret;
+
+  // swap the data ready interrupts for the watermark on INT1
+  uint8_t value = 0;
+  ret = read_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) return ret;
+  value &= ~(LSM6DS3_FIFO_INT1_DRDY_XL | LSM6DS3_FIFO_INT1_DRDY_G);
+  value |= LSM6DS3_FIFO_INT1_FTH;
+  return set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+}
+
+int LSM6DS3_Fifo::shutdown() {
+  uint8_t value = 0;
+  int ret = read_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, &value, 1);
+  if (ret < 0) return ret;
+  value &= ~LSM6DS3_FIFO_INT1_FTH;
+  ret = set_register(LSM6DS3_FIFO_I2C_REG_INT1_CTRL, value);
+  if (ret < 0) {
+    LOGE("Could not disable lsm6ds3 fifo interrupt!");
+    return ret;
+  }
+  return set_register(LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+}
+
+// drops words until the next one read is a gyro x, returns the words dropped.
+// pattern is STATUS3 and 4 as read last
+int LSM6DS3_Fifo::align_to_set(uint8_t pattern[2]) {
+  int dropped = 0;
+  while (dropped < LSM6DS3_FIFO_SET_WORDS) {
+    if (((pattern[1] & 0x03) << 8 | pattern[0]) % LSM6DS3_FIFO_SET_WORDS == 0) break;
+
+    // the dropped word and the pattern after it in one transfer
+    uint8_t word[2];
+    I2CAccess accesses[] = {
+      {.register_address = LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, .buffer = word, .len = sizeof(word)},
+      {.register_address = LSM6DS3_FIFO_I2C_REG_STATUS3, .buffer = pattern, .len = 2},
+    };
+    if (transfer(accesses, std::size(accesses)) < 0) return -1;
+    dropped++;
+  }
+  return dropped;
+}
+
+int LSM6DS3_Fifo::read_batch(uint64_t ts, std::vector<kj::Array<capnp::word>> &accel, std::vector<kj::Array<capnp::word>> &gyro) {
+  // STATUS1 to 4, the fill level and the pattern of the next word
+  uint8_t status[4];
+  if (read_register(LSM6DS3_FIFO_I2C_REG_STATUS1, status, sizeof(status)) < 0) return -1;
+
+  if (status[1] & LSM6DS3_FIFO_OVER_RUN) {
+    LOGE("lsm6ds3 fifo overrun, resetting");
+    reset();
+    return 0;
+  }
+  if (status[1] & LSM6DS3_FIFO_EMPTY) return 0;
+
+  int words = ((status[1] & LSM6DS3_FIFO_DIFF_MASK_H) << 8) | status[0];
+  const int dropped = align_to_set(&status[2]);
+  if (dropped < 0) return -1;
+  words -= dropped;
+
+  // the watermark interrupt came when the set LSM6DS3_FIFO_WATERMARK_SETS after the
+  // last one read was done. time between interrupts over the number of sets
+  // between them gives the actual sample period
+  const uint64_t trigger_idx = sets_read + LSM6DS3_FIFO_WATERMARK_SETS - 1;
+  if (last_trigger_ts != 0 && trigger_idx > last_trigger_idx && ts > last_trigger_ts) {
+    const double measured = double(ts - last_trigger_ts) / (trigger_idx - last_trigger_idx);
+    const double nominal = LSM6DS3_FIFO_NOMINAL_PERIOD_NS;
+    period_ns += 0.05 * (std::clamp(measured, 0.9 * nominal, 1.1 * nominal) - period_ns);
+  }
+  last_trigger_idx = trigger_idx;
+  last_trigger_ts = ts;
+
+  const float accel_scale = 9.81 * 2.0f / (1 << 15);
+  const float gyro_scale = 8.75 / 1000.0;
+
+  int sets = words / LSM6DS3_FIFO_SET_WORDS;
+  while (sets > 0) {
+    const int n = std::min(sets, LSM6DS3_FIFO_READ_SETS);
+    uint8_t buffer[LSM6DS3_FIFO_READ_SETS * LSM6DS3_FIFO_SET_BYTES];
+    int len = read_register(LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buffer, n * LSM6DS3_FIFO_SET_BYTES);
+    if (len != n * LSM6DS3_FIFO_SET_BYTES) return -1;
+
+    for (int i = 0; i < n; i++) {
+      const uint8_t *b = &buffer[i * LSM6DS3_FIFO_SET_BYTES];
+      const int64_t sample_ts = ts + (int64_t(sets_read) - int64_t(trigger_idx)) * period_ns;
+      sets_read++;
+      if (!is_data_valid(sample_ts)) continue;
+
+      {
+        MessageBuilder msg;
+        auto event = msg.initEvent().initGyroscope();
+        event.setSource(source);
+        event.setVersion(2);
+        event.setSensor(SENSOR_GYRO_UNCALIBRATED);
+        event.setType(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED);
+        event.setTimestamp(sample_ts);
+
+        float x = DEG2RAD(read_16_bit(b[0], b[1]) * gyro_scale);
+        float y = DEG2RAD(read_16_bit(b[2], b[3]) * gyro_scale);
+        float z = DEG2RAD(read_16_bit(b[4], b[5]) * gyro_scale);
+        float xyz[] = {y, -x, z};
+        auto svec = event.initGyroUncalibrated();
+        svec.setV(xyz);
+        svec.setStatus(true);
+        gyro.push_back(capnp::messageToFlatArray(msg));
+      }
+      {
+        MessageBuilder msg;
+        auto event = msg.initEvent().initAccelerometer();
+        event.setSource(source);
+        event.setVersion(1);
+        event.setSensor(SENSOR_ACCELEROMETER);
+        event.setType(SENSOR_TYPE_ACCELEROMETER);
+        event.setTimestamp(sample_ts);
+
+        float x = read_16_bit(b[6], b[7]) * accel_scale;
+        float y = read_16_bit(b[8], b[9]) * accel_scale;
+        float z = read_16_bit(b[10], b[11]) * accel_scale;
+        float xyz[] = {y, -x, z};
+        auto svec = event.initAcceleration();
+        svec.setV(xyz);
+        svec.setStatus(true);
+        accel.push_back(capnp::messageToFlatArray(msg));
+      }
+    }
+    sets -= n;
+  }
+  return accel.size();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include "system/sensord/sensors/i2c_sensor.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR       0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL1  0x06
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL2  0x07
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL3  0x08
+#define LSM6DS3_FIFO_I2C_REG_FIFO_CTRL5  0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL   0x0D
+#define LSM6DS3_FIFO_I2C_REG_ID          0x0F
+#define LSM6DS3_FIFO_I2C_REG_STATUS1     0x3A
+#define LSM6DS3_FIFO_I2C_REG_STATUS3     0x3C
+#define LSM6DS3_FIFO_I2C_REG_DATA_OUT_L  0x3E
+
+// Constants
+#define LSM6DS3_FIFO_CHIP_ID          0x69
+#define LSM6DS3TRC_FIFO_CHIP_ID       0x6A
+#define LSM6DS3_FIFO_NO_DECIMATION    ((0b001 << 3) | 0b001)  // gyro and accel
+#define LSM6DS3_FIFO_ODR_104HZ        (0b0100 << 3)
+#define LSM6DS3_FIFO_MODE_BYPASS      0b000
+#define LSM6DS3_FIFO_MODE_CONTINUOUS  0b110
+#define LSM6DS3_FIFO_INT1_DRDY_XL     0b1
+#define LSM6DS3_FIFO_INT1_DRDY_G      0b10
+#define LSM6DS3_FIFO_INT1_FTH         (1 << 3)
+#define LSM6DS3_FIFO_DIFF_MASK_H      0x0F
+#define LSM6DS3_FIFO_OVER_RUN         (1 << 6)
+#define LSM6DS3_FIFO_EMPTY            (1 << 4)
+
+// gyro and accel are both at 104Hz, so the FIFO holds sets of gyro xyz, accel xyz
+#define LSM6DS3_FIFO_SET_WORDS        6
+#define LSM6DS3_FIFO_SET_BYTES        (LSM6DS3_FIFO_SET_WORDS * 2)
+// interrupt every 4 sets, ~26Hz
+#define LSM6DS3_FIFO_WATERMARK_SETS   4
+// sets read in one transfer, a batch is usually a bit more than the watermark
+#define LSM6DS3_FIFO_READ_SETS        16
+#define LSM6DS3_FIFO_NOMINAL_PERIOD_NS (1e9 / 104.0)
+
+// Hardware FIFO of the LSM6DS3, replaces the per sample data ready interrupts of
+// LSM6DS3_Accel and LSM6DS3_Gyro once they're initialized. On the watermark
+// interrupt all queued samples are read in block reads, and timestamped from the
+// interrupt time and the sample period measured between interrupts.
+class LSM6DS3_Fifo : public I2CSensor {
+  uint8_t get_device_address() {return LSM6DS3_FIFO_I2C_ADDR;}
+  cereal::SensorEventData::SensorSource source = cereal::SensorEventData::SensorSource::LSM6DS3;
+
+  int reset();
+  int align_to_set(uint8_t pattern[2]);
+
+  // absolute index of the next set to be read, and the last watermark interrupt
+  uint64_t sets_read = 0;
+  uint64_t last_trigger_idx = 0;
+  uint64_t last_trigger_ts = 0;
+  double period_ns = LSM6DS3_FIFO_NOMINAL_PERIOD_NS;
+
+public:
+  LSM6DS3_Fifo(I2CBus *bus);
+  int init();
+  // single events aren't supported, use read_batch
+  bool get_event(MessageBuilder &msg, uint64_t ts = 0) { return false; }
+  bool has_interrupt_enabled() { return false; }
+  int shutdown();
+
+  // reads everything queued, ts is the time of the watermark interrupt
+  int read_batch(uint64_t ts, std::vector<kj::Array<capnp::word>> &accel, std::vector<kj::Array<capnp::word>> &gyro);
+};
@@ -201,16 +201,15 @@ fail:
 
 bool LSM6DS3_Gyro::get_event(MessageBuilder &msg, uint64_t ts) {
 
-  // INT1 shared with accel, check STATUS_REG who triggered
-  uint8_t status_reg = 0;
-  read_register(LSM6DS3_GYRO_I2C_REG_STAT_REG, &status_reg, sizeof(status_reg));
-  if ((status_reg & LSM6DS3_GYRO_DRDY_GDA) == 0) {
+  // INT1 shared with accel, check STATUS_REG who triggered. It's read in the same
+  // burst as the data, which is thrown away if it isn't ready
+  uint8_t regs[LSM6DS3_GYRO_I2C_REG_OUTX_L_G + 6 - LSM6DS3_GYRO_I2C_REG_STAT_REG];
+  int len = read_register(LSM6DS3_GYRO_I2C_REG_STAT_REG, regs, sizeof(regs));
+  assert(len == sizeof(regs));
+  if ((regs[0] & LSM6DS3_GYRO_DRDY_GDA) == 0) {
     return false;
   }
-
-  uint8_t buffer[6];
-  int len = read_register(LSM6DS3_GYRO_I2C_REG_OUTX_L_G, buffer, sizeof(buffer));
-  assert(len == sizeof(buffer));
+  const uint8_t *buffer = &regs[LSM6DS3_GYRO_I2C_REG_OUTX_L_G - LSM6DS3_GYRO_I2C_REG_STAT_REG];
 
   float scale = 8.75 / 1000.0;
   float x = DEG2RAD(read_16_bit(buffer[0], buffer[1]) * scale);
@@ -1,16 +1,18 @@
+#include <sys/epoll.h>
 #include <sys/resource.h>
+#include <sys/timerfd.h>
 
-#include <chrono>
-#include <thread>
+#include <algorithm>
+#include <cassert>
+#include <set>
+#include <string>
 #include <vector>
-#include <map>
-#include <poll.h>
 #include <linux/gpio.h>
 
 #include "cereal/services.h"
 #include "cereal/messaging/messaging.h"
 #include "common/i2c.h"
-#include "common/ratekeeper.h"
+#include "common/placement.h"
 #include "common/swaglog.h"
 #include "common/timing.h"
 #include "common/util.h"
@@ -20,6 +22,7 @@
 #include "system/sensord/sensors/bmx055_temp.h"
 #include "system/sensord/sensors/constants.h"
 #include "system/sensord/sensors/lsm6ds3_accel.h"
+#include "system/sensord/sensors/lsm6ds3_fifo.h"
 #include "system/sensord/sensors/lsm6ds3_gyro.h"
 #include "system/sensord/sensors/lsm6ds3_temp.h"
 #include "system/sensord/sensors/mmc5603nj_magn.h"
@@ -28,78 +31,147 @@
 
 ExitHandler do_exit;
 
-void interrupt_loop(std::vector<std::tuple<Sensor *, std::string>> sensors) {
-  PubMaster pm({"gyroscope", "accelerometer"});
+static void publish_batch(PubMaster &pm, const char *name, const std::vector<kj::Array<capnp::word>> &events) {
+  if (events.empty()) return;
+  std::vector<kj::ArrayPtr<capnp::byte>> messages;
+  messages.reserve(events.size());
+  for (auto &e : events) {
+    messages.push_back(e.asBytes());
+  }
+  pm.sendBatch(name, messages);
+}
 
-  int fd = -1;
-  for (auto &[sensor, msg_name] : sensors) {
-    if (sensor->has_interrupt_enabled()) {
-      fd = sensor->gpio_fd;
-      break;
-    }
+static void handle_interrupt(int fd, const std::vector<std::tuple<Sensor *, std::string>> &sensors, LSM6DS3_Fifo *fifo, PubMaster &pm) {
+  // Read all events
+  struct gpioevent_data evdata[16];
+  int err = read(fd, evdata, sizeof(evdata));
+  if (err < 0 || err % sizeof(*evdata) != 0) {
+    LOGE("error reading event data %d", err);
+    return;
   }
 
-  struct pollfd fd_list[1] = {0};
-  fd_list[0].fd = fd;
-  fd_list[0].events = POLLIN | POLLPRI;
+  int num_events = err / sizeof(*evdata);
+  uint64_t offset = nanos_since_epoch() - nanos_since_boot();
+  uint64_t ts = evdata[num_events - 1].timestamp - offset;
 
-  while (!do_exit) {
-    int err = poll(fd_list, 1, 100);
-    if (err == -1) {
-      if (errno == EINTR) {
-        continue;
-      }
-      return;
-    } else if (err == 0) {
-      LOGE("poll timed out");
-      continue;
+  if (fifo != nullptr) {
+    // the first event is the watermark crossing the FIFO was read for
+    std::vector<kj::Array<capnp::word>> accel, gyro;
+    if (fifo->read_batch(evdata[0].timestamp - offset, accel, gyro) < 0) {
+      LOGE("lsm6ds3 fifo read failed");
     }
+    publish_batch(pm, "gyroscope", gyro);
+    publish_batch(pm, "accelerometer", accel);
+    return;
+  }
 
-    if ((fd_list[0].revents & (POLLIN | POLLPRI)) == 0) {
-      LOGE("no poll events set");
+  for (auto &[sensor, msg_name] : sensors) {
+    if (!sensor->has_interrupt_enabled()) {
       continue;
     }
 
-    // Read all events
-    struct gpioevent_data evdata[16];
-    err = read(fd, evdata, sizeof(evdata));
-    if (err < 0 || err % sizeof(*evdata) != 0) {
-      LOGE("error reading event data %d", err);
+    MessageBuilder msg;
+    if (!sensor->get_event(msg, ts)) {
       continue;
     }
 
-    int num_events = err / sizeof(*evdata);
-    uint64_t offset = nanos_since_epoch() - nanos_since_boot();
-    uint64_t ts = evdata[num_events - 1].timestamp - offset;
-
-    for (auto &[sensor, msg_name] : sensors) {
-      if (!sensor->has_interrupt_enabled()) {
-        continue;
-      }
+    if (!sensor->is_data_valid(ts)) {
+      continue;
+    }
 
-      MessageBuilder msg;
-      if (!sensor->get_event(msg, ts)) {
-        continue;
-      }
+    pm.send(msg_name.c_str(), msg);
+  }
+}
 
-      if (!sensor->is_data_valid(ts)) {
-        continue;
-      }
+static void handle_poll(Sensor *sensor, const std::string &msg_name, PubMaster &pm) {
+  MessageBuilder msg;
+  if (sensor->get_event(msg) && sensor->is_data_valid(nanos_since_boot())) {
+    pm.send(msg_name.c_str(), msg);
+  }
+}
 
-      pm.send(msg_name.c_str(), msg);
+// One epoll loop for everything: the IMU interrupt and a timerfd per polled
+// sensor. When several are ready at once the interrupt goes first, then the
+// polled sensors in the order they're listed in.
+static void event_loop(const std::vector<std::tuple<Sensor *, std::string>> &sensors, LSM6DS3_Fifo *fifo) {
+  std::set<std::string> names;
+  for (auto &[sensor, msg_name] : sensors) names.insert(msg_name);
+  std::vector<const char *> service_list;
+  for (auto &n : names) service_list.push_back(n.c_str());
+  PubMaster pm(service_list);
+
+  unique_fd epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  assert(epoll_fd >= 0);
+
+  // event data is the index into sensors, the interrupt is INTERRUPT_IDX
+  const uint64_t INTERRUPT_IDX = UINT64_MAX;
+  int interrupt_fd = -1;
+  std::vector<unique_fd> timer_fds(sensors.size());
+  for (size_t i = 0; i < sensors.size(); i++) {
+    auto &[sensor, msg_name] = sensors[i];
+    struct epoll_event ev = {};
+    if (sensor->has_interrupt_enabled()) {
+      if (interrupt_fd != -1 || sensor->gpio_fd < 0) continue;
+      interrupt_fd = sensor->gpio_fd;
+      ev.events = EPOLLIN | EPOLLPRI;
+      ev.data.u64 = INTERRUPT_IDX;
+      int ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, interrupt_fd, &ev);
+      assert(ret == 0);
+      continue;
     }
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(tfd >= 0);
+    timer_fds[i] = tfd;
+    const long period_ns = 1e9 / services.at(msg_name).frequency;
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = period_ns / 1000000000;
+    spec.it_interval.tv_nsec = period_ns % 1000000000;
+    spec.it_value = spec.it_interval;
+    int ret = timerfd_settime(tfd, 0, &spec, nullptr);
+    assert(ret == 0);
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = i;
+    ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, tfd, &ev);
+    assert(ret == 0);
   }
-}
 
-void polling_loop(Sensor *sensor, std::string msg_name) {
-  PubMaster pm({msg_name.c_str()});
-  RateKeeper rk(msg_name, services.at(msg_name).frequency);
+  uint64_t last_interrupt = nanos_since_boot();
+  std::vector<uint64_t> ready;
   while (!do_exit) {
-    MessageBuilder msg;
-    if (sensor->get_event(msg) && sensor->is_data_valid(nanos_since_boot())) {
-      pm.send(msg_name.c_str(), msg);
+    struct epoll_event events[16];
+    int n = epoll_wait(epoll_fd, events, std::size(events), 100);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      LOGE("epoll_wait failed: %d", errno);
+      return;
+    }
+
+    ready.clear();
+    for (int i = 0; i < n; i++) {
+      ready.push_back(events[i].data.u64);
+    }
+    // INTERRUPT_IDX sorts last, take it first
+    std::sort(ready.begin(), ready.end());
+    if (!ready.empty() && ready.back() == INTERRUPT_IDX) {
+      ready.pop_back();
+      handle_interrupt(interrupt_fd, sensors, fifo, pm);
+      last_interrupt = nanos_since_boot();
+    } else if (interrupt_fd != -1 && nanos_since_boot() - last_interrupt > 100e6) {
+      LOGE("poll timed out");
+      last_interrupt = nanos_since_boot();
+    }
+
+    for (uint64_t idx : ready) {
+      auto &[sensor, msg_name] = sensors[idx];
+      uint64_t expirations = 0;
+      if (read(timer_fds[idx], &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+      if (expirations > 1) {
+        LOGD("%s: missed %lu polls", msg_name.c_str(), expirations - 1);
+      }
+      handle_poll(sensor, msg_name, pm);
     }
-    rk.keepTime();
   }
 }
 
@@ -119,31 +191,34 @@ int sensor_loop(I2CBus *i2c_bus_imu) {
   };
 
   // Initialize sensors
-  std::vector<std::thread> threads;
+  std::vector<std::tuple<Sensor *, std::string>> sensors;
+  bool lsm_ok = true;
   for (auto &[sensor, msg_name] : sensors_init) {
     int err = sensor->init();
     if (err < 0) {
+      if (dynamic_cast<LSM6DS3_Accel *>(sensor) || dynamic_cast<LSM6DS3_Gyro *>(sensor)) lsm_ok = false;
       continue;
     }
+    sensors.push_back({sensor, msg_name});
+  }
 
-    if (!sensor->has_interrupt_enabled()) {
-      threads.emplace_back(polling_loop, sensor, msg_name);
+  // batch the LSM6DS3 through its FIFO, the data ready interrupts stay on if that doesn't work
+  std::unique_ptr<LSM6DS3_Fifo> fifo;
+  if (lsm_ok && getenv("LSM_NO_FIFO") == nullptr) {
+    fifo = std::make_unique<LSM6DS3_Fifo>(i2c_bus_imu);
+    if (fifo->init() < 0) {
+      LOGE("LSM6DS3 fifo init failed, using data ready interrupts");
+      fifo.reset();
     }
   }
 
   // increase interrupt quality by pinning interrupt and process to core 1
-  setpriority(PRIO_PROCESS, 0, -18);
-  util::set_core_affinity({1});
+  apply_placement("sensord");
   std::system("sudo su -c 'echo 1 > /proc/irq/336/smp_affinity_list'");
 
-  // thread for reading events via interrupts
-  threads.emplace_back(&interrupt_loop, std::ref(sensors_init));
-
-  // wait for all threads to finish
-  for (auto &t : threads) {
-    t.join();
-  }
+  event_loop(sensors, fifo.get());
 
+  if (fifo) fifo->shutdown();
   for (auto &[sensor, msg_name] : sensors_init) {
     sensor->shutdown();
     delete sensor;
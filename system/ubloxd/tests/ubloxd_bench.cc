@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "cereal/messaging/messaging.h"
+#include "common/util.h"
+#include "system/ubloxd/ublox_msg.h"
+
+// Parser throughput over the ubloxRaw events of an uncompressed rlog, covers
+// framing, kaitai parsing and building the events the same way ubloxd does.
+// Usage: ubloxd_bench <rlog> [iterations]
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <rlog> [iterations]\n", argv[0]);
+    return 1;
+  }
+  const int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+
+  std::string data = util::read_file(argv[1]);
+  kj::Array<capnp::word> words = kj::heapArray<capnp::word>(data.size() / sizeof(capnp::word));
+  memcpy(words.begin(), data.data(), words.size() * sizeof(capnp::word));
+
+  std::vector<std::pair<float, std::string>> chunks;
+  size_t total_bytes = 0;
+  kj::ArrayPtr<const capnp::word> remaining = words;
+  try {
+    while (remaining.size() > 0) {
+      capnp::FlatArrayMessageReader msg(remaining);
+      remaining = kj::arrayPtr(msg.getEnd(), remaining.end());
+      cereal::Event::Reader event = msg.getRoot<cereal::Event>();
+      if (event.isUbloxRaw()) {
+        auto raw = event.getUbloxRaw();
+        chunks.emplace_back(1e-9 * event.getLogMonoTime(), std::string((const char *)raw.begin(), raw.size()));
+        total_bytes += raw.size();
+      }
+    }
+  } catch (const kj::Exception &e) {
+    fprintf(stderr, "stopped reading log: %s\n", e.getDescription().cStr());
+  }
+  if (chunks.empty()) {
+    fprintf(stderr, "no ubloxRaw in %s\n", argv[1]);
+    return 1;
+  }
+
+  MessageArena arena;
+  size_t frames = 0, events = 0, event_bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < iterations; it++) {
+    UbloxMsgParser parser;
+    for (const auto &[log_time, raw] : chunks) {
+      const uint8_t *dat = (const uint8_t *)raw.data();
+      size_t len = raw.size(), consumed = 0;
+      while (consumed < len) {
+        size_t n = 0;
+        if (parser.add_data(log_time, dat + consumed, len - consumed, n)) {
+          frames++;
+          try {
+            MessageBuilder msg_builder(arena.segment());
+            if (parser.gen_msg(msg_builder) != nullptr) {
+              events++;
+              event_bytes += msg_builder.getSerializedSize();
+            }
+            arena.update(msg_builder);
+          } catch (const std::exception &e) {
+            // malformed payloads are skipped, like ubloxd does
+          }
+          parser.reset();
+        }
+        consumed += n;
+      }
+    }
+  }
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%zu chunks, %.1f kB of ubloxRaw, %d iterations\n", chunks.size(), total_bytes / 1e3, iterations);
+  printf("%.1f MB/s, %.0f frames/s, %.2f us per frame, %zu events (%.0f bytes avg)\n",
+         total_bytes * iterations / secs / 1e6, frames / secs, secs * 1e6 / std::max<size_t>(frames, 1),
+         events, (double)event_bytes / std::max<size_t>(events, 1));
+  return 0;
+}
@@ -8,7 +8,10 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <istream>
+#include <streambuf>
 #include <unordered_map>
 #include <utility>
 
@@ -32,18 +35,18 @@ inline int UbloxMsgParser::needed_bytes() {
   return needed - (uint16_t)bytes_in_parse_buf;
 }
 
-inline bool UbloxMsgParser::valid_cheksum() {
+bool UbloxMsgParser::valid_checksum(const uint8_t *msg, size_t len) {
   uint8_t ck_a = 0, ck_b = 0;
-  for (int i = 2; i < bytes_in_parse_buf - ublox::UBLOX_CHECKSUM_SIZE; i++) {
-    ck_a = (ck_a + msg_parse_buf[i]) & 0xFF;
+  for (int i = 2; i < len - ublox::UBLOX_CHECKSUM_SIZE; i++) {
+    ck_a = (ck_a + msg[i]) & 0xFF;
     ck_b = (ck_b + ck_a) & 0xFF;
   }
-  if (ck_a != msg_parse_buf[bytes_in_parse_buf - 2]) {
-    LOGD("Checksum a mismatch: %02X, %02X", ck_a, msg_parse_buf[6]);
+  if (ck_a != msg[len - 2]) {
+    LOGD("Checksum a mismatch: %02X, %02X", ck_a, msg[len - 2]);
     return false;
   }
-  if (ck_b != msg_parse_buf[bytes_in_parse_buf - 1]) {
-    LOGD("Checksum b mismatch: %02X, %02X", ck_b, msg_parse_buf[7]);
+  if (ck_b != msg[len - 1]) {
+    LOGD("Checksum b mismatch: %02X, %02X", ck_b, msg[len - 1]);
     return false;
   }
   return true;
@@ -51,7 +54,7 @@ inline bool UbloxMsgParser::valid_cheksum() {
 
 inline bool UbloxMsgParser::valid() {
   return bytes_in_parse_buf >= ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE &&
-         needed_bytes() == 0 && valid_cheksum();
+         needed_bytes() == 0 && valid_checksum(msg_parse_buf, bytes_in_parse_buf);
 }
 
 inline bool UbloxMsgParser::valid_so_far() {
@@ -69,6 +72,50 @@ inline bool UbloxMsgParser::valid_so_far() {
 
 bool UbloxMsgParser::add_data(float log_time, const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed) {
   last_log_time = log_time;
+  frame_len = 0;
+
+  // Nothing buffered: look for whole messages in the incoming data and hand
+  // them out in place, only a message split across chunks gets copied.
+  if (bytes_in_parse_buf == 0) {
+    size_t pos = 0;
+    while (pos < incoming_data_len) {
+      const uint8_t *start = (const uint8_t *)memchr(incoming_data + pos, ublox::PREAMBLE1, incoming_data_len - pos);
+      if (start == nullptr) {
+        bytes_consumed = incoming_data_len;
+        return false;
+      }
+      pos = start - incoming_data;
+
+      size_t avail = incoming_data_len - pos;
+      if (avail < ublox::UBLOX_HEADER_SIZE) {
+        break;
+      }
+      if (start[1] != ublox::PREAMBLE2) {
+        pos++;
+        continue;
+      }
+      size_t len = UBLOX_MSG_SIZE(start) + ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
+      if (avail < len) {
+        break;
+      }
+      if (!valid_checksum(start, len)) {
+        pos++;
+        continue;
+      }
+
+      frame_ptr = start;
+      frame_len = len;
+      bytes_consumed = pos + len;
+      return true;
+    }
+
+    // partial message at the end, keep it in the parse buffer for the next chunk
+    bytes_in_parse_buf = incoming_data_len - pos;
+    memcpy(msg_parse_buf, incoming_data + pos, bytes_in_parse_buf);
+    bytes_consumed = incoming_data_len;
+    return false;
+  }
+
   int needed = needed_bytes();
   if (needed > 0) {
     bytes_consumed = std::min((uint32_t)needed, incoming_data_len);
@@ -91,39 +138,71 @@ bool UbloxMsgParser::add_data(float log_time, const uint8_t *incoming_data, uint
   if (needed_bytes() == -1) {
     bytes_in_parse_buf = 0;
   }
-  return valid();
+
+  if (!valid()) {
+    return false;
+  }
+  frame_ptr = msg_parse_buf;
+  frame_len = bytes_in_parse_buf;
+  return true;
 }
 
+namespace {
+
+// Read only streambuf over a message, so kaitai parses it without a copy
+class MemoryStreambuf : public std::streambuf {
+public:
+  MemoryStreambuf(const uint8_t *data, size_t len) {
+    char *p = (char *)data;
+    setg(p, p, p + len);
+  }
+
+protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+    char *base = (dir == std::ios_base::beg) ? eback() : (dir == std::ios_base::cur) ? gptr() : egptr();
+    if (base + off < eback() || base + off > egptr()) {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), base + off, egptr());
+    return pos_type(gptr() - eback());
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+};
+
+}  // namespace
 
-std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
-  std::string dat = data();
-  kaitai::kstream stream(dat);
+const char *UbloxMsgParser::gen_msg(MessageBuilder &msg_builder) {
+  MemoryStreambuf buf(frame_ptr, frame_len);
+  std::istream is(&buf);
+  kaitai::kstream stream(&is);
 
   ubx_t ubx_message(&stream);
   auto body = ubx_message.body();
 
   switch (ubx_message.msg_type()) {
   case 0x0107:
-    return {"gpsLocationExternal", gen_nav_pvt(static_cast<ubx_t::nav_pvt_t*>(body))};
+    return gen_nav_pvt(static_cast<ubx_t::nav_pvt_t*>(body), msg_builder) ? "gpsLocationExternal" : nullptr;
   case 0x0213: // UBX-RXM-SFRB (Broadcast Navigation Data Subframe)
-    return {"ubloxGnss", gen_rxm_sfrbx(static_cast<ubx_t::rxm_sfrbx_t*>(body))};
+    return gen_rxm_sfrbx(static_cast<ubx_t::rxm_sfrbx_t*>(body), msg_builder) ? "ubloxGnss" : nullptr;
   case 0x0215: // UBX-RXM-RAW (Multi-GNSS Raw Measurement Data)
-    return {"ubloxGnss", gen_rxm_rawx(static_cast<ubx_t::rxm_rawx_t*>(body))};
+    return gen_rxm_rawx(static_cast<ubx_t::rxm_rawx_t*>(body), msg_builder) ? "ubloxGnss" : nullptr;
   case 0x0a09:
-    return {"ubloxGnss", gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(body))};
+    return gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(body), msg_builder) ? "ubloxGnss" : nullptr;
   case 0x0a0b:
-    return {"ubloxGnss", gen_mon_hw2(static_cast<ubx_t::mon_hw2_t*>(body))};
+    return gen_mon_hw2(static_cast<ubx_t::mon_hw2_t*>(body), msg_builder) ? "ubloxGnss" : nullptr;
   case 0x0135:
-    return {"ubloxGnss", gen_nav_sat(static_cast<ubx_t::nav_sat_t*>(body))};
+    return gen_nav_sat(static_cast<ubx_t::nav_sat_t*>(body), msg_builder) ? "ubloxGnss" : nullptr;
   default:
     LOGE("Unknown message type %x", ubx_message.msg_type());
-    return {"ubloxGnss", kj::Array<capnp::word>()};
+    return nullptr;
   }
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg) {
-  MessageBuilder msg_builder;
+bool UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg, MessageBuilder &msg_builder) {
   auto gpsLoc = msg_builder.initEvent().initGpsLocationExternal();
   gpsLoc.setSource(cereal::GpsLocationData::SensorSource::UBLOX);
   gpsLoc.setFlags(msg->flags());
@@ -148,10 +227,10 @@ kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg) {
   gpsLoc.setVerticalAccuracy(msg->v_acc() * 1e-03);
   gpsLoc.setSpeedAccuracy(msg->s_acc() * 1e-03);
   gpsLoc.setBearingAccuracyDeg(msg->head_acc() * 1e-05);
-  return capnp::messageToFlatArray(msg_builder);
+  return true;
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+bool UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg, MessageBuilder &msg_builder) {
   // GPS subframes are packed into 10x 4 bytes, each containing 3 actual bytes
   // We will first need to separate the data from the padding and parity
   auto body = *msg->body();
@@ -174,14 +253,13 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
     int subframe_id = subframe.how()->subframe_id();
     if (subframe_id > 3 || subframe_id < 1) {
       // dont parse almanac subframes
-      return kj::Array<capnp::word>();
+      return false;
     }
     gps_subframes[msg->sv_id()][subframe_id] = subframe_data;
   }
 
   // publish if subframes 1-3 have been collected
   if (gps_subframes[msg->sv_id()].size() == 3) {
-    MessageBuilder msg_builder;
     auto eph = msg_builder.initEvent().initUbloxGnss().initEphemeris();
     eph.setSvId(msg->sv_id());
 
@@ -261,14 +339,14 @@ kj::Array<capnp::word> UbloxMsgParser::parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *m
     gps_subframes[msg->sv_id()].clear();
     if (iodc_lsb != iode_s2 || iodc_lsb != iode_s3) {
       // data set cutover, reject ephemeris
-      return kj::Array<capnp::word>();
+      return false;
     }
-    return capnp::messageToFlatArray(msg_builder);
+    return true;
   }
-  return kj::Array<capnp::word>();
+  return false;
 }
 
-kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg) {
+bool UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg, MessageBuilder &msg_builder) {
   // This parser assumes that no 2 satellites of the same frequency
   // can be in view at the same time
   auto body = *msg->body();
@@ -286,7 +364,7 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
     int string_number = gl_string.string_number();
     if (string_number < 1 || string_number > 5 || gl_string.idle_chip()) {
       // dont parse non immediate data, idle_chip == 0
-      return kj::Array<capnp::word>();
+      return false;
     }
 
     // Check if new string either has same superframe_id or log transmission times make sense
@@ -319,15 +397,14 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
   if (msg->sv_id() == 255) {
     // data can be decoded before identifying the SV number, in this case 255
     // is returned, which means "unknown"  (ublox p32)
-    return kj::Array<capnp::word>();
+    return false;
   }
 
   // publish if strings 1-5 have been collected
   if (glonass_strings[msg->freq_id()].size() != 5) {
-    return kj::Array<capnp::word>();
+    return false;
   }
 
-  MessageBuilder msg_builder;
   auto eph = msg_builder.initEvent().initUbloxGnss().initGlonassEphemeris();
   eph.setSvId(msg->sv_id());
   eph.setFreqNum(msg->freq_id() - 7);
@@ -410,23 +487,22 @@ kj::Array<capnp::word> UbloxMsgParser::parse_glonass_ephemeris(ubx_t::rxm_sfrbx_
   }
 
   glonass_strings[msg->freq_id()].clear();
-  return capnp::messageToFlatArray(msg_builder);
+  return true;
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
+bool UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg, MessageBuilder &msg_builder) {
   switch (msg->gnss_id()) {
     case ubx_t::gnss_type_t::GNSS_TYPE_GPS:
-      return parse_gps_ephemeris(msg);
+      return parse_gps_ephemeris(msg, msg_builder);
     case ubx_t::gnss_type_t::GNSS_TYPE_GLONASS:
-      return parse_glonass_ephemeris(msg);
+      return parse_glonass_ephemeris(msg, msg_builder);
     default:
-      return kj::Array<capnp::word>();
+      return false;
   }
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg) {
-  MessageBuilder msg_builder;
+bool UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg, MessageBuilder &msg_builder) {
   auto mr = msg_builder.initEvent().initUbloxGnss().initMeasurementReport();
   mr.setRcvTow(msg->rcv_tow());
   mr.setGpsWeek(msg->week());
@@ -460,11 +536,10 @@ kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg) {
   auto rs = mr.initReceiverStatus();
   rs.setLeapSecValid(bit_to_bool(msg->rec_stat(), 0));
   rs.setClkReset(bit_to_bool(msg->rec_stat(), 2));
-  return capnp::messageToFlatArray(msg_builder);
+  return true;
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_sat(ubx_t::nav_sat_t *msg) {
-  MessageBuilder msg_builder;
+bool UbloxMsgParser::gen_nav_sat(ubx_t::nav_sat_t *msg, MessageBuilder &msg_builder) {
   auto sr = msg_builder.initEvent().initUbloxGnss().initSatReport();
   sr.setITow(msg->itow());
 
@@ -476,11 +551,10 @@ kj::Array<capnp::word> UbloxMsgParser::gen_nav_sat(ubx_t::nav_sat_t *msg) {
     svs[i].setFlagsBitfield(svs_data[i]->flags());
   }
 
-  return capnp::messageToFlatArray(msg_builder);
+  return true;
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw(ubx_t::mon_hw_t *msg) {
-  MessageBuilder msg_builder;
+bool UbloxMsgParser::gen_mon_hw(ubx_t::mon_hw_t *msg, MessageBuilder &msg_builder) {
   auto hwStatus = msg_builder.initEvent().initUbloxGnss().initHwStatus();
   hwStatus.setNoisePerMS(msg->noise_per_ms());
   hwStatus.setFlags(msg->flags());
@@ -488,11 +562,10 @@ kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw(ubx_t::mon_hw_t *msg) {
   hwStatus.setAStatus((cereal::UbloxGnss::HwStatus::AntennaSupervisorState) msg->a_status());
   hwStatus.setAPower((cereal::UbloxGnss::HwStatus::AntennaPowerStatus) msg->a_power());
   hwStatus.setJamInd(msg->jam_ind());
-  return capnp::messageToFlatArray(msg_builder);
+  return true;
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg) {
-  MessageBuilder msg_builder;
+bool UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg, MessageBuilder &msg_builder) {
   auto hwStatus = msg_builder.initEvent().initUbloxGnss().initHwStatus2();
   hwStatus.setOfsI(msg->ofs_i());
   hwStatus.setMagI(msg->mag_i());
@@ -520,5 +593,5 @@ kj::Array<capnp::word> UbloxMsgParser::gen_mon_hw2(ubx_t::mon_hw2_t *msg) {
   hwStatus.setLowLevCfg(msg->low_lev_cfg());
   hwStatus.setPostStatus(msg->post_status());
 
-  return capnp::messageToFlatArray(msg_builder);
+  return true;
 }
@@ -92,31 +92,39 @@ namespace ublox {
 
 class UbloxMsgParser {
   public:
+    // Finds the next message in the stream. Messages that are whole within
+    // incoming_data are handed to gen_msg in place, so incoming_data must stay
+    // valid until then. Only messages split across chunks are copied.
     bool add_data(float log_time, const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed);
-    inline void reset() {bytes_in_parse_buf = 0;}
+    inline void reset() {bytes_in_parse_buf = 0; frame_len = 0;}
     inline int needed_bytes();
-    inline std::string data() {return std::string((const char*)msg_parse_buf, bytes_in_parse_buf);}
-
-    std::pair<std::string, kj::Array<capnp::word>> gen_msg();
-    kj::Array<capnp::word> gen_nav_pvt(ubx_t::nav_pvt_t *msg);
-    kj::Array<capnp::word> gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> gen_rxm_rawx(ubx_t::rxm_rawx_t *msg);
-    kj::Array<capnp::word> gen_mon_hw(ubx_t::mon_hw_t *msg);
-    kj::Array<capnp::word> gen_mon_hw2(ubx_t::mon_hw2_t *msg);
-    kj::Array<capnp::word> gen_nav_sat(ubx_t::nav_sat_t *msg);
+    inline kj::ArrayPtr<const uint8_t> data() {return kj::arrayPtr(frame_ptr, frame_len);}
+
+    // Builds the event for the last message found by add_data into msg_builder,
+    // returns the service to publish it on, or nullptr if there's nothing to send
+    const char *gen_msg(MessageBuilder &msg_builder);
+    bool gen_nav_pvt(ubx_t::nav_pvt_t *msg, MessageBuilder &msg_builder);
+    bool gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg, MessageBuilder &msg_builder);
+    bool gen_rxm_rawx(ubx_t::rxm_rawx_t *msg, MessageBuilder &msg_builder);
+    bool gen_mon_hw(ubx_t::mon_hw_t *msg, MessageBuilder &msg_builder);
+    bool gen_mon_hw2(ubx_t::mon_hw2_t *msg, MessageBuilder &msg_builder);
+    bool gen_nav_sat(ubx_t::nav_sat_t *msg, MessageBuilder &msg_builder);
 
   private:
-    inline bool valid_cheksum();
+    static bool valid_checksum(const uint8_t *msg, size_t len);
     inline bool valid();
     inline bool valid_so_far();
 
-    kj::Array<capnp::word> parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg);
+    bool parse_gps_ephemeris(ubx_t::rxm_sfrbx_t *msg, MessageBuilder &msg_builder);
+    bool parse_glonass_ephemeris(ubx_t::rxm_sfrbx_t *msg, MessageBuilder &msg_builder);
 
     std::unordered_map<int, std::unordered_map<int, std::string>> gps_subframes;
 
     float last_log_time = 0.0;
     size_t bytes_in_parse_buf = 0;
+    // message found by add_data, in the caller's data or msg_parse_buf
+    const uint8_t *frame_ptr = nullptr;
+    size_t frame_len = 0;
     uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE];
 
     // user range accuracy in meters
@@ -1,4 +1,8 @@
 #include <cassert>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
 
 #include <kaitai/kaitaistream.h>
 
@@ -23,6 +27,17 @@ int main() {
   subscriber->setTimeout(100);
 
 
+  // Messages are serialized back to back into one buffer per service and sent
+  // as a batch once the whole ubloxRaw chunk is parsed. The buffers and the
+  // builder's first segment are reused from chunk to chunk.
+  struct PendingBatch {
+    std::vector<capnp::word> words;
+    std::vector<size_t> ends;  // end of every message in words
+  };
+  std::map<std::string, PendingBatch, std::less<>> pending = {{"ubloxGnss", {}}, {"gpsLocationExternal", {}}};
+  std::vector<kj::ArrayPtr<capnp::byte>> batch;
+  MessageArena arena;
+
   while (!do_exit) {
     std::unique_ptr<Message> msg(subscriber->receive());
     if (!msg) {
@@ -46,11 +61,17 @@ int main() {
       if (parser.add_data(log_time, data + bytes_consumed, (uint32_t)(len - bytes_consumed), bytes_consumed_this_time)) {
 
         try {
-          auto ublox_msg = parser.gen_msg();
-          if (ublox_msg.second.size() > 0) {
-            auto bytes = ublox_msg.second.asBytes();
-            pm.send(ublox_msg.first.c_str(), bytes.begin(), bytes.size());
+          MessageBuilder msg_builder(arena.segment());
+          const char *service = parser.gen_msg(msg_builder);
+          if (service != nullptr) {
+            auto &[words, ends] = pending.find(service)->second;
+            size_t size = msg_builder.getSerializedSize() / sizeof(capnp::word);
+            size_t start = words.size();
+            words.resize(start + size);
+            msg_builder.serializeToBuffer((unsigned char *)&words[start], size * sizeof(capnp::word));
+            ends.push_back(start + size);
           }
+          arena.update(msg_builder);
         } catch (const std::exception& e) {
           LOGE("Error parsing ublox message %s", e.what());
         }
@@ -59,6 +80,21 @@ int main() {
       }
       bytes_consumed += bytes_consumed_this_time;
     }
+
+    for (auto &[service, pb] : pending) {
+      auto &[words, ends] = pb;
+      if (ends.empty()) continue;
+
+      batch.clear();
+      size_t start = 0;
+      for (size_t end : ends) {
+        batch.push_back(kj::arrayPtr(&words[start], end - start).asBytes());
+        start = end;
+      }
+      pm.sendBatch(service.c_str(), batch);
+      words.clear();
+      ends.clear();
+    }
   }
 
   return 0;
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""Runs the daemon benches on recorded inputs and writes their reports as one JSON file.
+
+Build them first with `scons --extras bench`. Every bench reports CPU time per second of
+drive, handler latency percentiles and peak RSS (see common/bench.h), the merged file is
+what gets compared between releases. Benches whose input isn't given are skipped.
+"""
+import argparse
+import json
+import os
+import re
+import subprocess
+import tempfile
+
+BASEDIR = os.path.abspath(os.path.join(os.path.dirname(__file__), "../.."))
+
+# name: (binary, working directory, arguments before the input, input)
+def benches(args):
+  return {
+    "boardd": ("selfdrive/boardd/can_replay_bench", None, [], args.can_trace or args.rlog),
+    "can_parser": ("opendbc/can/parser_bench", None, [args.dbc] if args.dbc else None, args.rlog),
+    "locationd": ("selfdrive/locationd/tests/locationd_replay_bench", None, [], args.rlog),
+    "loggerd": ("system/loggerd/tests/logger_bench", None, [], args.rlog),
+    "camerad_debayer": ("system/camerad/test/debayer_bench", "system/camerad", [], str(args.frames)),
+  }
+
+
+def version():
+  with open(os.path.join(BASEDIR, "common/version.h")) as f:
+    return re.search(r'COMMA_VERSION "(.*)"', f.read()).group(1)
+
+
+def run(name, binary, cwd, pre_args, inp):
+  path = os.path.join(BASEDIR, binary)
+  if not os.path.isfile(path):
+    print(f"{name}: {binary} isn't built, skipping")
+    return None
+  with tempfile.NamedTemporaryFile(suffix=".json") as out:
+    cmd = [path, "--json", out.name] + pre_args + [inp]
+    result = subprocess.run(cmd, cwd=os.path.join(BASEDIR, cwd) if cwd else None, capture_output=True, text=True)
+    if result.returncode != 0:
+      print(f"{name}: failed\n{result.stderr}")
+      return None
+    with open(out.name) as f:
+      return json.load(f)
+
+
+if __name__ == "__main__":
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument("--rlog", help="uncompressed rlog, for boardd, the CAN parser, locationd and loggerd")
+  parser.add_argument("--can-trace", help="BOARDD_CAPTURE trace for boardd, instead of the rlog")
+  parser.add_argument("--dbc", help="DBC of the car in the rlog, for the CAN parser")
+  parser.add_argument("--frames", type=int, default=100, help="debayer iterations per sensor mode")
+  parser.add_argument("--only", nargs="*", help="names of the benches to run")
+  parser.add_argument("-o", "--output", default="daemon_bench.json")
+  args = parser.parse_args()
+
+  reports = {}
+  for name, (binary, cwd, pre_args, inp) in benches(args).items():
+    if (args.only and name not in args.only) or pre_args is None or not inp:
+      continue
+    report = run(name, binary, cwd, pre_args, inp)
+    if report is not None:
+      reports[name] = report
+      print(f"{name}: {report['cpu_per_drive_second'] * 100:.1f}% of a core, "
+            f"p99 {report['latency_us']['p99'] if report['latency_us'] else 0:.1f} us, {report['peak_rss_kb'] / 1024:.1f} MB")
+
+  with open(args.output, "w") as f:
+    json.dump({"version": version(), "benches": reports}, f, indent=2)
+  print(f"wrote {len(reports)} reports to {args.output}")
@@ -1,6 +1,8 @@
 #include "tools/replay/camera.h"
 
+#include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <tuple>
 
 #include "third_party/linux/include/msm_media_info.h"
@@ -57,12 +59,11 @@ void CameraServer::cameraThread(Camera &cam) {
   };
 
   while (true) {
-    const auto [fr, eidx] = cam.queue.pop();
+    auto [fr, eidx] = cam.queue.pop();
     if (!fr) break;
 
-    const int id = eidx.getSegmentId();
-    bool prefetched = (id == cam.cached_id && eidx.getSegmentNum() == cam.cached_seg);
-    auto yuv = prefetched ? cam.cached_buf : read_frame(fr, id);
+    // the reader has decoded it ahead, it's a copy
+    auto yuv = read_frame(fr, eidx.getSegmentId());
     if (yuv) {
       VisionIpcBufExtra extra = {
           .frame_id = eidx.getFrameId(),
@@ -75,11 +76,9 @@ void CameraServer::cameraThread(Camera &cam) {
       rError("camera[%d] failed to get frame: %lu", cam.type, eidx.getSegmentId());
     }
 
-    cam.cached_id = id + 1;
-    cam.cached_seg = eidx.getSegmentNum();
-    cam.cached_buf = read_frame(fr, cam.cached_id);
-
-    --publishing_;
+    std::lock_guard lk(publish_lock_);
+    --cam.queued;
+    publish_cv_.notify_all();
   }
 }
 
@@ -92,12 +91,21 @@ void CameraServer::pushFrame(CameraType type, FrameReader *fr, const cereal::Enc
     startVipcServer();
   }
 
-  ++publishing_;
+  {
+    std::lock_guard lk(publish_lock_);
+    ++cam.queued;
+  }
   cam.queue.push({fr, eidx});
 }
 
 void CameraServer::waitForSent() {
-  while (publishing_ > 0) {
-    std::this_thread::yield();
-  }
+  std::unique_lock lk(publish_lock_);
+  publish_cv_.wait(lk, [this]() {
+    return std::all_of(std::begin(cameras_), std::end(cameras_), [](auto &cam) { return cam.queued == 0; });
+  });
+}
+
+void CameraServer::waitForSent(CameraType type, int max_queued) {
+  std::unique_lock lk(publish_lock_);
+  publish_cv_.wait(lk, [&]() { return cameras_[type].queued < max_queued; });
 }
@@ -2,7 +2,9 @@
 
 #include <unistd.h>
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <tuple>
 #include <utility>
 
@@ -13,12 +15,21 @@
 
 std::tuple<size_t, size_t, size_t> get_nv12_info(int width, int height);
 
+// frames of a camera that may be queued at full speed before the stream waits for them,
+// the messages go on while they're read from the reader's decoded frames
+const int MAX_FRAMES_IN_FLIGHT = 4;
+
+// A thread per camera sends its frames in the order they're pushed, into the camera's
+// VisionIPC buffers. pushFrame() doesn't wait for the frame to be sent.
 class CameraServer {
 public:
   CameraServer(std::pair<int, int> camera_size[MAX_CAMERAS] = nullptr);
   ~CameraServer();
   void pushFrame(CameraType type, FrameReader* fr, const cereal::EncodeIndex::Reader& eidx);
+  // until every frame pushed is sent
   void waitForSent();
+  // until fewer than max_queued frames of the camera are left to send
+  void waitForSent(CameraType type, int max_queued);
 
 protected:
   struct Camera {
@@ -27,10 +38,8 @@ protected:
     int width;
     int height;
     std::thread thread;
-    SafeQueue<std::pair<FrameReader*, const cereal::EncodeIndex::Reader>> queue;
-    int cached_id = -1;
-    int cached_seg = -1;
-    VisionBuf * cached_buf;
+    BlockingMPMCQueue<std::pair<FrameReader*, cereal::EncodeIndex::Reader>, 32> queue;
+    int queued = 0;  // protected by publish_lock_
   };
   void startVipcServer();
   void cameraThread(Camera &cam);
@@ -40,6 +49,7 @@ protected:
       {.type = DriverCam, .stream_type = VISION_STREAM_DRIVER},
       {.type = WideRoadCam, .stream_type = VISION_STREAM_WIDE_ROAD},
   };
-  std::atomic<int> publishing_ = 0;
+  std::mutex publish_lock_;
+  std::condition_variable publish_cv_;
   std::unique_ptr<VisionIpcServer> vipc_server_;
 };
@@ -110,7 +110,7 @@ void ConsoleUI::initWindows() {
   w[Win::Stats] = newwin(2, max_width - 2 * BORDER_SIZE, 2, BORDER_SIZE);
   w[Win::Timeline] = newwin(4, max_width - 2 * BORDER_SIZE, 5, BORDER_SIZE);
   w[Win::TimelineDesc] = newwin(1, 100, 10, BORDER_SIZE);
-  w[Win::CarState] = newwin(3, 100, 12, BORDER_SIZE);
+  w[Win::CarState] = newwin(4, 100, 12, BORDER_SIZE);
   w[Win::DownloadBar] = newwin(1, 100, 16, BORDER_SIZE);
   if (int log_height = max_height - 27; log_height > 4) {
     w[Win::LogBorder] = newwin(log_height, max_width - 2 * (BORDER_SIZE - 1), 17, BORDER_SIZE - 1);
@@ -186,6 +186,12 @@ void ConsoleUI::updateStatus() {
   auto angle_offsets = util::string_format("%.2f|%.2f", p.getAngleOffsetAverageDeg(), p.getAngleOffsetDeg());
   write_item(2, 25, "ANGLE OFFSET(AVG|INSTANT): ", angle_offsets, " deg");
 
+  std::string pacing = "-";
+  if (auto stats = replay->pacingStats(); stats.events > 0 && !replay->hasFlag(REPLAY_FLAG_FULL_SPEED)) {
+    pacing = util::string_format("%.2f|%.2f", stats.mean_error_ms, stats.max_error_ms);
+  }
+  write_item(3, 0, "PACING ERROR(AVG|MAX): ", pacing, " ms        ");
+
   wrefresh(w[Win::CarState]);
 }
 
@@ -0,0 +1,361 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <capnp/dynamic.h>
+#include <capnp/schema.h>
+
+#include "opendbc/can/common.h"
+#include "tools/replay/logreader.h"
+#include "tools/replay/route.h"
+#include "tools/replay/util.h"
+
+// Exports services of a route to columns for offline analytics, one .npy file per
+// column, so numpy memory maps them and a query over many routes reads only the columns
+// it uses. A service is flattened into its scalar and enum fields, nested structs as
+// "a.b" columns, lists and text are left out. Fields of a union member that isn't set
+// read as 0. With --dbc, can is decoded with CANParser into a table per message.
+//
+//   <out>/<service>/logMonoTime.npy, <out>/<service>/<field>.npy, ...
+//   <out>/can/<message>/logMonoTime.npy, <out>/can/<message>/<signal>.npy, ...
+//   <out>/schema.json
+//
+// The segments are loaded --jobs at a time, ahead of the one being written, with the
+// same LogReader and file cache replay uses.
+
+namespace {
+
+const int NPY_HEADER_SIZE = 128;
+
+// A .npy file written as it goes. The header has room for any row count and is
+// written again with the real one on close.
+class NpyColumn {
+public:
+  NpyColumn(const QString &path, const char *dtype, size_t item_size) : dtype(dtype), item_size(item_size) {
+    f = fopen(path.toStdString().c_str(), "wb");
+    if (f) writeHeader();
+  }
+  ~NpyColumn() {
+    if (!f) return;
+    fseek(f, 0, SEEK_SET);
+    writeHeader();
+    fclose(f);
+  }
+  void append(const void *v) {
+    if (f && fwrite(v, item_size, 1, f) == 1) rows++;
+  }
+  const char *const dtype;
+  const size_t item_size;
+
+private:
+  void writeHeader() {
+    char dict[NPY_HEADER_SIZE];
+    int n = snprintf(dict, sizeof(dict), "{'descr': '%s', 'fortran_order': False, 'shape': (%zu,), }", dtype, rows);
+    std::string header("\x93NUMPY\x01\x00", 8);
+    const uint16_t len = NPY_HEADER_SIZE - 10;
+    header.append((const char *)&len, 2);
+    header.append(dict, n);
+    header.append(NPY_HEADER_SIZE - 1 - header.size(), ' ');
+    header += '\n';
+    fwrite(header.data(), 1, header.size(), f);
+  }
+
+  FILE *f = nullptr;
+  size_t rows = 0;
+};
+
+// a scalar reached through a path of struct fields from the service's struct
+struct FieldColumn {
+  std::string name;
+  std::vector<capnp::StructSchema::Field> path;
+  capnp::schema::Type::Which type;
+  std::unique_ptr<NpyColumn> out;
+};
+
+std::pair<const char *, size_t> dtype(capnp::schema::Type::Which type) {
+  using T = capnp::schema::Type;
+  switch (type) {
+    case T::BOOL: return {"|b1", 1};
+    case T::INT8: return {"|i1", 1};
+    case T::INT16: return {"<i2", 2};
+    case T::INT32: return {"<i4", 4};
+    case T::INT64: return {"<i8", 8};
+    case T::UINT8: return {"|u1", 1};
+    case T::UINT16: return {"<u2", 2};
+    case T::UINT32: return {"<u4", 4};
+    case T::UINT64: return {"<u8", 8};
+    case T::FLOAT32: return {"<f4", 4};
+    case T::FLOAT64: return {"<f8", 8};
+    case T::ENUM: return {"<u2", 2};
+    default: return {nullptr, 0};
+  }
+}
+
+void addColumns(capnp::StructSchema schema, const std::string &prefix, std::vector<capnp::StructSchema::Field> path,
+                std::vector<FieldColumn> &columns, int depth) {
+  for (auto field : schema.getFields()) {
+    const std::string name = prefix + field.getProto().getName().cStr();
+    auto p = path;
+    p.push_back(field);
+    const auto type = field.getType();
+    if (type.isStruct()) {
+      if (depth < 3) addColumns(type.asStruct(), name + ".", p, columns, depth + 1);
+    } else if (dtype(type.which()).first) {
+      columns.push_back({.name = name, .path = p, .type = type.which()});
+    }
+  }
+}
+
+// the value at the end of the path, 0 if a union member on the way isn't set
+void appendValue(capnp::DynamicStruct::Reader reader, FieldColumn &c) {
+  uint8_t zero[8] = {};
+  for (size_t i = 0; i < c.path.size(); i++) {
+    const auto &field = c.path[i];
+    if (field.getProto().getDiscriminantValue() != capnp::schema::Field::NO_DISCRIMINANT) {
+      KJ_IF_MAYBE(which, reader.which()) {
+        if (!(*which == field)) return c.out->append(zero);
+      } else {
+        return c.out->append(zero);
+      }
+    }
+    if (i + 1 < c.path.size()) {
+      reader = reader.get(field).as<capnp::DynamicStruct>();
+      continue;
+    }
+
+    auto v = reader.get(field);
+    using T = capnp::schema::Type;
+    switch (c.type) {
+      case T::BOOL: { bool x = v.as<bool>(); return c.out->append(&x); }
+      case T::INT8: { int8_t x = v.as<int8_t>(); return c.out->append(&x); }
+      case T::INT16: { int16_t x = v.as<int16_t>(); return c.out->append(&x); }
+      case T::INT32: { int32_t x = v.as<int32_t>(); return c.out->append(&x); }
+      case T::INT64: { int64_t x = v.as<int64_t>(); return c.out->append(&x); }
+      case T::UINT8: { uint8_t x = v.as<uint8_t>(); return c.out->append(&x); }
+      case T::UINT16: { uint16_t x = v.as<uint16_t>(); return c.out->append(&x); }
+      case T::UINT32: { uint32_t x = v.as<uint32_t>(); return c.out->append(&x); }
+      case T::UINT64: { uint64_t x = v.as<uint64_t>(); return c.out->append(&x); }
+      case T::FLOAT32: { float x = v.as<float>(); return c.out->append(&x); }
+      case T::FLOAT64: { double x = v.as<double>(); return c.out->append(&x); }
+      case T::ENUM: { uint16_t x = v.as<capnp::DynamicEnum>().getRaw(); return c.out->append(&x); }
+      default: return c.out->append(zero);
+    }
+  }
+}
+
+struct ServiceTable {
+  capnp::StructSchema::Field event_field;
+  std::unique_ptr<NpyColumn> mono_time, valid;
+  std::vector<FieldColumn> columns;
+};
+
+struct MessageTable {
+  std::unique_ptr<NpyColumn> mono_time;
+  std::map<std::string, std::unique_ptr<NpyColumn>> signals;
+};
+
+class Exporter {
+public:
+  Exporter(const QString &out_dir, const QStringList &services, const QString &dbc, int bus) : out(out_dir) {
+    QDir().mkpath(out);
+    auto event_schema = capnp::Schema::from<cereal::Event>();
+    for (const QString &name : services) {
+      if (name == "can" && !dbc.isEmpty()) {
+        parser = std::make_unique<CANParser>(bus, dbc.toStdString(), true, true);
+        dbc_ = dbc_lookup(dbc.toStdString());
+        allow.insert(cereal::Event::CAN);
+        continue;
+      }
+      KJ_IF_MAYBE(field, event_schema.findFieldByName(name.toStdString())) {
+        if (!field->getType().isStruct()) {
+          rWarning("%s isn't a struct, skipping it", qPrintable(name));
+          continue;
+        }
+        ServiceTable &t = tables[field->getProto().getDiscriminantValue()];
+        t.event_field = *field;
+        addColumns(field->getType().asStruct(), "", {}, t.columns, 0);
+
+        const QString dir = out + "/" + name;
+        QDir().mkpath(dir);
+        t.mono_time = std::make_unique<NpyColumn>(dir + "/logMonoTime.npy", "<u8", 8);
+        t.valid = std::make_unique<NpyColumn>(dir + "/valid.npy", "|b1", 1);
+        for (auto &c : t.columns) {
+          auto [descr, size] = dtype(c.type);
+          c.out = std::make_unique<NpyColumn>(dir + "/" + QString::fromStdString(c.name) + ".npy", descr, size);
+        }
+        allow.insert((cereal::Event::Which)field->getProto().getDiscriminantValue());
+      } else {
+        rWarning("no service %s, skipping it", qPrintable(name));
+      }
+    }
+  }
+
+  void write(const Event *e) {
+    auto event = e->event();
+    if (e->which == cereal::Event::CAN && parser) {
+      writeCan(e->mono_time, event);
+      return;
+    }
+    auto it = tables.find((uint16_t)e->which);
+    if (it == tables.end()) return;
+
+    ServiceTable &t = it->second;
+    const uint64_t mono_time = e->mono_time;
+    const bool valid = event.getValid();
+    t.mono_time->append(&mono_time);
+    t.valid->append(&valid);
+    auto service = capnp::toDynamic(event).get(t.event_field).as<capnp::DynamicStruct>();
+    for (auto &c : t.columns) appendValue(service, c);
+  }
+
+  void writeSchema() {
+    QJsonObject schema;
+    for (auto &[_, t] : tables) {
+      QJsonObject cols = {{"logMonoTime", "<u8"}, {"valid", "|b1"}};
+      for (auto &c : t.columns) cols[QString::fromStdString(c.name)] = c.out->dtype;
+      schema[t.event_field.getProto().getName().cStr()] = cols;
+    }
+    for (auto &[name, m] : can_tables) {
+      QJsonObject cols = {{"logMonoTime", "<u8"}};
+      for (auto &[sig, _] : m.signals) cols[QString::fromStdString(sig)] = "<f8";
+      schema["can/" + QString::fromStdString(name)] = cols;
+    }
+    QFile f(out + "/schema.json");
+    if (!f.open(QIODevice::WriteOnly) || f.write(QJsonDocument(schema).toJson()) < 0) {
+      rWarning("failed to write %s", qPrintable(f.fileName()));
+    }
+  }
+
+  std::set<cereal::Event::Which> allow;
+
+private:
+  void writeCan(uint64_t mono_time, const cereal::Event::Reader &event) {
+    parser->update_event(event, false);
+    parser->query_latest(vals);
+    for (const auto &v : vals) {
+      MessageTable &m = canTable(v.address);
+      auto &sig = m.signals[v.name];
+      if (!sig) {
+        sig = std::make_unique<NpyColumn>(can_dirs[v.address] + "/" + QString::fromStdString(v.name) + ".npy", "<f8", 8);
+      }
+      for (double x : v.all_values) sig->append(&x);
+    }
+    // one row per value of the message, the signals of a message come in together
+    std::map<uint32_t, size_t> rows;
+    for (const auto &v : vals) rows[v.address] = std::max(rows[v.address], v.all_values.size());
+    for (auto &[address, n] : rows) {
+      MessageTable &m = canTable(address);
+      for (size_t i = 0; i < n; i++) m.mono_time->append(&mono_time);
+    }
+  }
+
+  MessageTable &canTable(uint32_t address) {
+    auto it = can_by_address.find(address);
+    if (it != can_by_address.end()) return *it->second;
+
+    std::string name = std::to_string(address);
+    for (const auto &msg : dbc_->msgs) {
+      if (msg.address == address) name = msg.name;
+    }
+    MessageTable &m = can_tables[name];
+    const QString dir = out + "/can/" + QString::fromStdString(name);
+    QDir().mkpath(dir);
+    m.mono_time = std::make_unique<NpyColumn>(dir + "/logMonoTime.npy", "<u8", 8);
+    can_dirs[address] = dir;
+    can_by_address[address] = &m;
+    return m;
+  }
+
+  const QString out;
+  std::map<uint16_t, ServiceTable> tables;
+  std::unique_ptr<CANParser> parser;
+  const DBC *dbc_ = nullptr;
+  std::vector<SignalValue> vals;
+  std::map<std::string, MessageTable> can_tables;
+  std::map<uint32_t, MessageTable *> can_by_address;
+  std::map<uint32_t, QString> can_dirs;
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  QCoreApplication app(argc, argv);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Export services of a route to .npy columns for offline analytics.");
+  parser.addHelpOption();
+  parser.addPositionalArgument("route", "the drive to export");
+  parser.addOption({{"s", "services"}, "comma separated services to export, e.g. carState,controlsState,can", "services"});
+  parser.addOption({{"o", "out"}, "output directory", "dir"});
+  parser.addOption({"dbc", "decode can with this DBC, by name", "dbc"});
+  parser.addOption({"bus", "the bus of the DBC, default 0", "bus"});
+  parser.addOption({"data_dir", "local directory with routes", "data_dir"});
+  parser.addOption({"qlog", "export from the qlogs"});
+  parser.addOption({"jobs", "load <n> segments at a time. default is half the cores", "n"});
+  parser.addOption({"no-cache", "turn off local cache"});
+  parser.process(app);
+
+  const QStringList args = parser.positionalArguments();
+  if (args.empty() || parser.value("services").isEmpty() || parser.value("out").isEmpty()) {
+    parser.showHelp(1);
+  }
+
+  Route route(args.first(), parser.value("data_dir"));
+  if (!route.load()) {
+    rError("failed to load route %s", qPrintable(args.first()));
+    return 1;
+  }
+
+  Exporter exporter(parser.value("out"), parser.value("services").split(","), parser.value("dbc"), parser.value("bus").toInt());
+  const bool local_cache = !parser.isSet("no-cache");
+  const bool qlog = parser.isSet("qlog");
+  const int jobs = std::max(1, parser.isSet("jobs") ? parser.value("jobs").toInt() : QThread::idealThreadCount() / 2);
+
+  // segments are loaded in parallel and written in order
+  std::deque<std::future<std::unique_ptr<LogReader>>> loading;
+  auto segment = route.segments().begin();
+  auto load_next = [&]() {
+    const SegmentFile &files = segment->second;
+    const std::string file = (qlog || files.rlog.isEmpty() ? files.qlog : files.rlog).toStdString();
+    const int n = segment->first;
+    ++segment;
+    loading.push_back(std::async(std::launch::async, [&, file, n]() {
+      setDownloadPriority(n);
+      auto log = std::make_unique<LogReader>();
+      if (file.empty() || !log->load(file, nullptr, exporter.allow, local_cache, 0, 3)) {
+        rWarning("failed to load segment %d", n);
+        return std::unique_ptr<LogReader>();
+      }
+      return log;
+    }));
+  };
+
+  size_t events = 0;
+  while (segment != route.segments().end() || !loading.empty()) {
+    while (segment != route.segments().end() && (int)loading.size() < jobs) load_next();
+    auto log = loading.front().get();
+    loading.pop_front();
+    if (!log) continue;
+    for (const Event *e : log->events) {
+      exporter.write(e);
+    }
+    events += log->events.size();
+  }
+
+  exporter.writeSchema();
+  rInfo("exported %zu events of %zu segments to %s", events, route.segments().size(), qPrintable(parser.value("out")));
+  return 0;
+}
@@ -1,8 +1,18 @@
 #include "tools/replay/framereader.h"
 #include "tools/replay/util.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <cassert>
 #include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+#include "common/timing.h"
+#include "common/util.h"
 #include "third_party/libyuv/include/libyuv.h"
 
 #ifdef __APPLE__
@@ -15,23 +25,6 @@
 
 namespace {
 
-struct buffer_data {
-  const uint8_t *data;
-  int64_t offset;
-  size_t size;
-};
-
-int readPacket(void *opaque, uint8_t *buf, int buf_size) {
-  struct buffer_data *bd = (struct buffer_data *)opaque;
-  assert(bd->offset <= bd->size);
-  buf_size = std::min((size_t)buf_size, (size_t)(bd->size - bd->offset));
-  if (!buf_size) return AVERROR_EOF;
-
-  memcpy(buf, bd->data + bd->offset, buf_size);
-  bd->offset += buf_size;
-  return buf_size;
-}
-
 enum AVPixelFormat get_hw_format(AVCodecContext *ctx, const enum AVPixelFormat *pix_fmts) {
   enum AVPixelFormat *hw_pix_fmt = reinterpret_cast<enum AVPixelFormat *>(ctx->opaque);
   for (const enum AVPixelFormat *p = pix_fmts; *p != -1; p++) {
@@ -50,10 +43,16 @@ FrameReader::FrameReader() {
 }
 
 FrameReader::~FrameReader() {
-  for (AVPacket *pkt : packets) {
-    av_packet_free(&pkt);
+  if (decode_thread_.joinable()) {
+    {
+      std::lock_guard lk(lock_);
+      exit_ = true;
+    }
+    cv_.notify_all();
+    decode_thread_.join();
   }
 
+  if (pkt_) av_packet_free(&pkt_);
   if (decoder_ctx) avcodec_free_context(&decoder_ctx);
   if (input_ctx) avformat_close_input(&input_ctx);
   if (hw_device_ctx) av_buffer_unref(&hw_device_ctx);
@@ -62,17 +61,75 @@ FrameReader::~FrameReader() {
     av_freep(&avio_ctx_->buffer);
     avio_context_free(&avio_ctx_);
   }
+  if (map_) {
+    munmap((void *)map_, map_size_);
+  }
+}
+
+int FrameReader::readData(void *opaque, uint8_t *buf, int buf_size) {
+  BufferData *bd = (BufferData *)opaque;
+  assert(bd->offset <= bd->size);
+  buf_size = std::min((size_t)buf_size, (size_t)(bd->size - bd->offset));
+  if (!buf_size) return AVERROR_EOF;
+
+  memcpy(buf, bd->data + bd->offset, buf_size);
+  bd->offset += buf_size;
+  return buf_size;
+}
+
+int64_t FrameReader::seekData(void *opaque, int64_t offset, int whence) {
+  BufferData *bd = (BufferData *)opaque;
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE: return bd->size;
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += bd->offset; break;
+    case SEEK_END: offset += bd->size; break;
+    default: return -1;
+  }
+  if (offset < 0 || offset > bd->size) return -1;
+  bd->offset = offset;
+  return offset;
 }
 
 bool FrameReader::load(const std::string &url, bool no_hw_decoder, std::atomic<bool> *abort, bool local_cache, int chunk_size, int retries) {
-  FileReader f(local_cache, chunk_size, retries);
-  std::string data = f.read(url, abort);
-  if (data.empty()) {
-    rWarning("URL %s returned no data", url.c_str());
+  const bool is_remote = url.find("https://") == 0;
+  const std::string local_file = is_remote ? cacheFilePath(url) : url;
+  if (is_remote && !(local_cache && util::file_exists(local_file))) {
+    FileReader f(local_cache, chunk_size, retries);
+    data_ = f.read(url, abort);
+    if (data_.empty()) {
+      rWarning("URL %s returned no data", url.c_str());
+      return false;
+    }
+  }
+
+  // local and cached files are mapped, the pages of a GOP are read in when it's decoded
+  if ((!is_remote || local_cache) && map(local_file)) {
+    std::string().swap(data_);
+    return load((std::byte *)map_, map_size_, no_hw_decoder, abort);
+  }
+  if (data_.empty()) {
+    rWarning("failed to read %s", url.c_str());
     return false;
   }
+  return load((std::byte *)data_.data(), data_.size(), no_hw_decoder, abort);
+}
 
-  return load((std::byte *)data.data(), data.size(), no_hw_decoder, abort);
+bool FrameReader::map(const std::string &path) {
+  int fd = HANDLE_EINTR(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return false;
+
+  struct stat st = {};
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) return false;
+
+  map_ = p;
+  map_size_ = st.st_size;
+  return true;
 }
 
 bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, std::atomic<bool> *abort) {
@@ -82,14 +139,14 @@ bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, s
     return false;
   }
 
-  struct buffer_data bd = {
+  buffer_ = {
     .data = (const uint8_t*)data,
     .offset = 0,
     .size = size,
   };
   const int avio_ctx_buffer_size = 64 * 1024;
   unsigned char *avio_ctx_buffer = (unsigned char *)av_malloc(avio_ctx_buffer_size);
-  avio_ctx_ = avio_alloc_context(avio_ctx_buffer, avio_ctx_buffer_size, 0, &bd, readPacket, nullptr, nullptr);
+  avio_ctx_ = avio_alloc_context(avio_ctx_buffer, avio_ctx_buffer_size, 0, &buffer_, readData, nullptr, seekData);
   input_ctx->pb = avio_ctx_;
 
   input_ctx->probesize = 10 * 1024 * 1024;  // 10MB
@@ -130,20 +187,23 @@ bool FrameReader::load(const std::byte *data, size_t size, bool no_hw_decoder, s
     return false;
   }
 
-  packets.reserve(60 * 20);  // 20fps, one minute
+  // only where the packets are, they're read again as they're decoded
+  pkt_ = av_packet_alloc();
+  packet_index_.reserve(60 * 20);  // 20fps, one minute
   while (!(abort && *abort)) {
-    AVPacket *pkt = av_packet_alloc();
-    ret = av_read_frame(input_ctx, pkt);
+    ret = av_read_frame(input_ctx, pkt_);
     if (ret < 0) {
-      av_packet_free(&pkt);
       valid_ = (ret == AVERROR_EOF);
       break;
     }
-    packets.push_back(pkt);
+    const bool key = pkt_->flags & AV_PKT_FLAG_KEY;
+    packet_index_.push_back({.pos = pkt_->pos, .key = key});
     // some stream seems to contain no keyframes
-    key_frames_count_ += pkt->flags & AV_PKT_FLAG_KEY;
+    key_frames_count_ += key;
+    av_packet_unref(pkt_);
   }
-  valid_ = valid_ && !packets.empty();
+  next_packet_ = packet_index_.size();
+  valid_ = valid_ && !packet_index_.empty();
   return valid_;
 }
 
@@ -177,32 +237,156 @@ bool FrameReader::initHardwareDecoder(AVHWDeviceType hw_device_type) {
 
 bool FrameReader::get(int idx, VisionBuf *buf) {
   assert(buf != nullptr);
-  if (!valid_ || idx < 0 || idx >= packets.size()) {
+  if (!valid_ || idx < 0 || idx >= packet_index_.size()) {
     return false;
   }
-  return decode(idx, buf);
+
+  Frame frame;
+  {
+    std::unique_lock lk(lock_);
+    if (!decode_thread_.joinable()) {
+      decode_thread_ = std::thread(&FrameReader::decodeThread, this);
+    }
+    requested_ = idx;
+    last_request_ms_ = millis_since_boot();
+    cv_.notify_all();
+    cv_.wait(lk, [&]() { return cache_.count(idx) || failed_ == idx; });
+    if (failed_ == idx) {
+      failed_ = requested_ = -1;
+      return false;
+    }
+    frame = cache_[idx];
+  }
+
+  const uint8_t *y = frame->data();
+  libyuv::CopyPlane(y, width, buf->y, buf->stride, width, height);
+  libyuv::CopyPlane(y + width * height, width, buf->uv, buf->stride, width, height / 2);
+  return true;
 }
 
-bool FrameReader::decode(int idx, VisionBuf *buf) {
+void FrameReader::decodeThread() {
+  std::unique_lock lk(lock_);
+  while (!exit_) {
+    int idx = nextFrameToDecode();
+    if (idx < 0) {
+      // free the cache of a reader that's not played anymore
+      if (!cache_.empty() && millis_since_boot() - last_request_ms_ > 3000) {
+        cache_.clear();
+        requested_ = -1;
+      }
+      cv_.wait_for(lk, std::chrono::seconds(1));
+      continue;
+    }
+
+    lk.unlock();
+    bool ret = decode(idx);
+    lk.lock();
+    if (!ret) {
+      failed_ = idx;
+      cv_.notify_all();
+    }
+  }
+}
+
+// the frame asked for, else the first one ahead of it that's not decoded yet
+int FrameReader::nextFrameToDecode() {
+  if (requested_ < 0) return -1;
+  if (!cache_.count(requested_) && failed_ != requested_) return requested_;
+
+  const int end = std::min<int>(requested_ + FRAME_DECODE_AHEAD, packet_index_.size() - 1);
+  for (int i = requested_ + 1; i <= end && i != failed_; ++i) {
+    if (!cache_.count(i)) return i;
+  }
+  return -1;
+}
+
+// decodes up to idx from its key frame, or from the last one decoded if it's next. The
+// frames on the way are cached too, they're the ones a scrub back asks for.
+bool FrameReader::decode(int idx) {
   int from_idx = idx;
-  if (idx != prev_idx + 1 && key_frames_count_ > 1) {
+  if (idx != next_packet_ && key_frames_count_ > 1) {
     // seeking to the nearest key frame
     for (int i = idx; i >= 0; --i) {
-      if (packets[i]->flags & AV_PKT_FLAG_KEY) {
+      if (packet_index_[i].key) {
         from_idx = i;
         break;
       }
     }
   }
-  prev_idx = idx;
+  if (from_idx != next_packet_) {
+    if (!seekTo(from_idx)) return false;
+    // what the decoder holds is from another GOP
+    if (packet_index_[from_idx].key) avcodec_flush_buffers(decoder_ctx);
+  }
 
+  bool ret = false;
   for (int i = from_idx; i <= idx; ++i) {
-    AVFrame *f = decodeFrame(packets[i]);
-    if (f && i == idx) {
-      return copyBuffers(f, buf);
+    if (!readPacket()) return false;
+    AVFrame *f = decodeFrame(pkt_);
+    av_packet_unref(pkt_);
+    if (!f) continue;
+
+    std::unique_lock lk(lock_);
+    Frame frame;
+    if (cache_.size() >= FRAME_CACHE_SIZE) {
+      // reuse the frame that's farthest from the one asked for
+      auto farthest = std::max_element(cache_.begin(), cache_.end(), [this](auto &a, auto &b) {
+        return std::abs(a.first - requested_) < std::abs(b.first - requested_);
+      });
+      if (i != idx && std::abs(farthest->first - requested_) <= std::abs(i - requested_)) continue;
+      frame = farthest->second.use_count() == 1 ? farthest->second : nullptr;
+      cache_.erase(farthest);
     }
+    lk.unlock();
+
+    if (!frame) frame = std::make_shared<std::vector<uint8_t>>(getYUVSize());
+    copyBuffers(f, frame->data());
+
+    lk.lock();
+    cache_[i] = frame;
+    ret = i == idx;
+    cv_.notify_all();
   }
-  return false;
+  return ret;
+}
+
+// seeks the demuxer to the packet of frame idx, or to the last one before it whose
+// position is known and reads up to it
+bool FrameReader::seekTo(int idx) {
+  int from = idx;
+  while (from > 0 && packet_index_[from].pos < 0) --from;
+  int ret = av_seek_frame(input_ctx, -1, std::max<int64_t>(packet_index_[from].pos, 0), AVSEEK_FLAG_BYTE);
+  if (ret < 0) {
+    rError("failed to seek to frame %d: %d", idx, ret);
+    next_packet_ = -1;
+    return false;
+  }
+
+  next_packet_ = packet_index_[from].pos < 0 ? 0 : from;
+  while (next_packet_ < idx) {
+    if (!readPacket()) return false;
+    av_packet_unref(pkt_);
+  }
+  return true;
+}
+
+// reads the packet of frame next_packet_ into pkt_
+bool FrameReader::readPacket() {
+  if (next_packet_ < 0 || next_packet_ >= packet_index_.size()) return false;
+
+  const int64_t pos = packet_index_[next_packet_].pos;
+  int ret = 0;
+  // a demuxer may still return what it had of the data before a seek
+  while ((ret = av_read_frame(input_ctx, pkt_)) == 0 && pos >= 0 && pkt_->pos >= 0 && pkt_->pos < pos) {
+    av_packet_unref(pkt_);
+  }
+  if (ret < 0) {
+    rError("failed to read the packet of frame %d: %d", next_packet_, ret);
+    next_packet_ = -1;
+    return false;
+  }
+  ++next_packet_;
+  return true;
 }
 
 AVFrame *FrameReader::decodeFrame(AVPacket *pkt) {
@@ -231,21 +415,19 @@ AVFrame *FrameReader::decodeFrame(AVPacket *pkt) {
   }
 }
 
-bool FrameReader::copyBuffers(AVFrame *f, VisionBuf *buf) {
-  assert(f != nullptr && buf != nullptr);
+void FrameReader::copyBuffers(AVFrame *f, uint8_t *nv12) {
+  assert(f != nullptr && nv12 != nullptr);
+  uint8_t *y = nv12;
+  uint8_t *uv = nv12 + width * height;
   if (hw_pix_fmt == HW_PIX_FMT) {
-    for (int i = 0; i < height/2; i++) {
-      memcpy(buf->y + (i*2 + 0)*buf->stride, f->data[0] + (i*2 + 0)*f->linesize[0], width);
-      memcpy(buf->y + (i*2 + 1)*buf->stride, f->data[0] + (i*2 + 1)*f->linesize[0], width);
-      memcpy(buf->uv + i*buf->stride, f->data[1] + i*f->linesize[1], width);
-    }
+    libyuv::CopyPlane(f->data[0], f->linesize[0], y, width, width, height);
+    libyuv::CopyPlane(f->data[1], f->linesize[1], uv, width, width, height / 2);
   } else {
     libyuv::I420ToNV12(f->data[0], f->linesize[0],
                        f->data[1], f->linesize[1],
                        f->data[2], f->linesize[2],
-                       buf->y, buf->stride,
-                       buf->uv, buf->stride,
+                       y, width,
+                       uv, width,
                        width, height);
   }
-  return true;
 }
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "cereal/visionipc/visionbuf.h"
@@ -16,36 +22,81 @@ struct AVFrameDeleter {
   void operator()(AVFrame* frame) const { av_frame_free(&frame); }
 };
 
+// frames decoded ahead of the one asked for last, and kept around it for scrubbing back.
+// A frame is about 3.5MB for the road cameras.
+const int FRAME_DECODE_AHEAD = 8;
+const int FRAME_CACHE_SIZE = 24;
+
+// Frames are decoded on a thread of the reader, which decodes ahead of the last get()
+// and keeps the frames of the GOPs it decoded for a seek. get() only copies a frame
+// once it's there. The cache is freed when no frame was asked for in a few seconds.
+// The packets aren't kept, load() indexes where each one is in the file and the
+// decoder reads them from there, seeking to the key frame of a GOP it starts. Local and
+// cached files are mapped, so what stays in memory is the pages of the GOPs decoded.
 class FrameReader {
 public:
   FrameReader();
   ~FrameReader();
   bool load(const std::string &url, bool no_hw_decoder = false, std::atomic<bool> *abort = nullptr, bool local_cache = false,
             int chunk_size = -1, int retries = 0);
+  // data is read as the frames are decoded, it must outlive the reader
   bool load(const std::byte *data, size_t size, bool no_hw_decoder = false, std::atomic<bool> *abort = nullptr);
   bool get(int idx, VisionBuf *buf);
   int getYUVSize() const { return width * height * 3 / 2; }
-  size_t getFrameCount() const { return packets.size(); }
+  size_t getFrameCount() const { return packet_index_.size(); }
   bool valid() const { return valid_; }
 
   int width = 0, height = 0;
 
 private:
+  struct PacketInfo {
+    int64_t pos;  // in the file, -1 if the demuxer doesn't say
+    bool key;
+  };
+  struct BufferData {
+    const uint8_t *data = nullptr;
+    int64_t offset = 0;
+    size_t size = 0;
+  };
+
+  static int readData(void *opaque, uint8_t *buf, int buf_size);
+  static int64_t seekData(void *opaque, int64_t offset, int whence);
+  bool map(const std::string &path);
   bool initHardwareDecoder(AVHWDeviceType hw_device_type);
-  bool decode(int idx, VisionBuf *buf);
+  void decodeThread();
+  int nextFrameToDecode();
+  bool decode(int idx);
+  bool seekTo(int idx);
+  bool readPacket();
   AVFrame * decodeFrame(AVPacket *pkt);
-  bool copyBuffers(AVFrame *f, VisionBuf *buf);
+  void copyBuffers(AVFrame *f, uint8_t *nv12);
 
-  std::vector<AVPacket*> packets;
+  std::vector<PacketInfo> packet_index_;
+  AVPacket *pkt_ = nullptr;
+  int next_packet_ = -1;  // the frame of the packet the demuxer reads next
   std::unique_ptr<AVFrame, AVFrameDeleter>av_frame_, hw_frame;
   AVFormatContext *input_ctx = nullptr;
   AVCodecContext *decoder_ctx = nullptr;
   int key_frames_count_ = 0;
   bool valid_ = false;
   AVIOContext *avio_ctx_ = nullptr;
+  BufferData buffer_;
+  std::string data_;  // a download that's not cached
+  const void *map_ = nullptr;
+  size_t map_size_ = 0;
 
   AVPixelFormat hw_pix_fmt = AV_PIX_FMT_NONE;
   AVBufferRef *hw_device_ctx = nullptr;
-  int prev_idx = -1;
   inline static std::atomic<bool> has_hw_decoder = true;
+
+  // NV12 without padding, width * height * 3 / 2
+  typedef std::shared_ptr<std::vector<uint8_t>> Frame;
+  std::mutex lock_;
+  std::condition_variable cv_;
+  std::thread decode_thread_;
+  std::map<int, Frame> cache_;
+  int requested_ = -1;
+  int failed_ = -1;
+  double last_request_ms_ = 0;
+  bool exit_ = false;
 };
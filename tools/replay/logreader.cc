@@ -1,11 +1,27 @@
 #include "tools/replay/logreader.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
-#include "tools/replay/util.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <capnp/serialize.h>
 
-Event::Event(const kj::ArrayPtr<const capnp::word> &amsg, bool frame) : reader(amsg), frame(frame) {
+#include "common/util.h"
+#include "system/loggerd/logger.h"
+
+Event::Event(const kj::ArrayPtr<const capnp::word> &amsg, bool frame) : frame(frame) {
+  capnp::FlatArrayMessageReader reader(amsg);
   words = kj::ArrayPtr<const capnp::word>(amsg.begin(), reader.getEnd());
-  event = reader.getRoot<cereal::Event>();
+  auto event = reader.getRoot<cereal::Event>();
   which = event.which();
   mono_time = event.getLogMonoTime();
 
@@ -24,8 +40,42 @@ Event::Event(const kj::ArrayPtr<const capnp::word> &amsg, bool frame) : reader(a
   }
 }
 
+Event::~Event() {
+  delete reader_.load();
+}
+
+cereal::Event::Reader Event::event() const {
+  capnp::FlatArrayMessageReader *reader = reader_.load(std::memory_order_acquire);
+  if (!reader) {
+    auto created = std::make_unique<capnp::FlatArrayMessageReader>(words);
+    // the first getRoot() sets up the reader, it's done before another thread can see it
+    created->getRoot<cereal::Event>();
+    if (reader_.compare_exchange_strong(reader, created.get(), std::memory_order_acq_rel)) {
+      reader = created.release();
+    }
+  }
+  return reader->getRoot<cereal::Event>();
+}
+
 // class LogReader
 
+namespace {
+
+struct IndexHeader {
+  char magic[4];
+  uint32_t entry_size;
+  uint64_t log_size;
+  uint64_t count;
+};
+
+const char INDEX_MAGIC[4] = {'R', 'L', 'I', '1'};
+
+std::string indexPath(const std::string &log_path) {
+  return log_path + ".idx";
+}
+
+}  // namespace
+
 LogReader::LogReader(size_t memory_pool_block_size) {
 #ifdef HAS_MEMORY_RESOURCE
   const size_t buf_size = sizeof(Event) * memory_pool_block_size;
@@ -38,68 +88,355 @@ LogReader::~LogReader() {
   for (Event *e : events) {
     delete e;
   }
+  if (map_) {
+    munmap((void *)map_, map_size_);
+  }
 }
 
 bool LogReader::load(const std::string &url, std::atomic<bool> *abort,
                      const std::set<cereal::Event::Which> &allow,
                      bool local_cache, int chunk_size, int retries) {
-  raw_ = FileReader(local_cache, chunk_size, retries).read(url, abort);
-  if (raw_.empty()) return false;
+  const bool is_remote = url.find("https://") == 0;
+  const bool is_bz2 = url.find(".bz2") != std::string::npos;
+  const bool is_zst = url.find(".zst") != std::string::npos;
 
-  if (url.find(".bz2") != std::string::npos) {
-    raw_ = decompressBZ2(raw_, abort);
-    if (raw_.empty()) return false;
+  // a log that was decompressed before is mapped from the cache, a local raw log as it is
+  const std::string cache_path = is_remote && local_cache && (is_bz2 || is_zst) ? cachePath(url) : "";
+  if (!cache_path.empty() && loadCache(cache_path, allow)) {
+    return finish(0, abort);
+  }
+  if (!is_remote && !is_bz2 && !is_zst && map(url)) {
+    return finish(map_size_ - parse(map_, map_size_, 0, allow, abort), abort);
+  }
+
+  std::string data = FileReader(local_cache, chunk_size, retries).read(url, abort);
+  if (data.empty()) return false;
+
+  const std::byte *in = (const std::byte *)data.data();
+  if (is_zst && !is_remote && !allow.empty()) {
+    // with the index loggerd writes next to the log, only the frames that have the allowed events
+    if (auto frames = indexedFrames(url + ".idx", data.size(), allow); !frames.empty()) {
+      return decompressAndParse(data, frames, decompressZST, allow, abort, "");
+    }
   }
-  return parse(allow, abort);
+  if (is_bz2) {
+    return decompressAndParse(data, splitBZ2Streams(in, data.size()), decompressBZ2, allow, abort, cache_path);
+  } else if (is_zst) {
+    return decompressAndParse(data, splitZSTFrames(in, data.size()), decompressZST, allow, abort, cache_path);
+  }
+  const std::string &chunk = chunks_.emplace_back(std::move(data));
+  return finish(chunk.size() - parse(chunk.data(), chunk.size(), 0, allow, abort), abort);
 }
 
 bool LogReader::load(const std::byte *data, size_t size, std::atomic<bool> *abort) {
-  raw_.assign((const char *)data, size);
-  return parse({}, abort);
+  const std::string &chunk = chunks_.emplace_back((const char *)data, size);
+  return finish(chunk.size() - parse(chunk.data(), chunk.size(), 0, {}, abort), abort);
 }
 
-bool LogReader::parse(const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort) {
-  try {
-    kj::ArrayPtr<const capnp::word> words((const capnp::word *)raw_.data(), raw_.size() / sizeof(capnp::word));
-    while (words.size() > 0 && !(abort && *abort)) {
-#ifdef HAS_MEMORY_RESOURCE
-      Event *evt = new (mbr_.get()) Event(words);
-#else
-      Event *evt = new Event(words);
-#endif
-      if (!allow.empty() && allow.find(evt->which) == allow.end()) {
-        words = kj::arrayPtr(evt->reader.getEnd(), words.end());
-        delete evt;
+// The parts are decompressed on a few threads, in order, and the pieces they produce are
+// parsed here as they come. A message can be cut between two pieces, the start of it is
+// parsed again with the next one.
+// With a cache path the log is written there as it's decompressed, with an index of its
+// messages, and once it's complete the events are moved to the mapped file.
+bool LogReader::decompressAndParse(const std::string &data, const std::vector<std::pair<size_t, size_t>> &parts, Decompress decompress,
+                                   const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort, const std::string &cache_path) {
+  struct Part {
+    std::deque<std::string> pieces;
+    bool done = false;
+    bool ok = false;
+  };
+  std::vector<Part> output(parts.size());
+  std::mutex lock;
+  std::condition_variable cv;
+  std::atomic<size_t> next = 0;
+  std::atomic<bool> stop = false;
+
+  auto worker = [&]() {
+    for (size_t i = next++; i < parts.size() && !stop; i = next++) {
+      const std::byte *in = (const std::byte *)data.data() + parts[i].first;
+      bool ok = decompress(in, parts[i].second, [&](std::string &&piece) {
+        std::lock_guard lk(lock);
+        output[i].pieces.push_back(std::move(piece));
+        cv.notify_all();
+      }, &stop, DECOMPRESS_PIECE_SIZE);
+
+      std::lock_guard lk(lock);
+      output[i].done = true;
+      output[i].ok = ok;
+      cv.notify_all();
+      if (!ok) stop = true;
+    }
+  };
+  // segments are loaded a few at a time, leave them some cores
+  const size_t num_threads = std::min<size_t>(parts.size(), std::clamp(std::thread::hardware_concurrency() / 2, 1u, 8u));
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+
+  const std::string tmp_path = cache_path + ".tmp" + util::random_string(8);
+  FILE *cache_file = cache_path.empty() ? nullptr : fopen(tmp_path.c_str(), "wb");
+  indexing_ = cache_file != nullptr;
+
+  bool ok = !parts.empty();
+  std::string tail;
+  size_t log_size = 0;
+  for (size_t i = 0; ok && i < parts.size();) {
+    std::string piece;
+    {
+      std::unique_lock lk(lock);
+      while (output[i].pieces.empty() && !output[i].done && !(abort && *abort)) {
+        cv.wait_for(lk, std::chrono::milliseconds(100));
+      }
+      if (abort && *abort) {
+        ok = false;
+        break;
+      }
+      if (output[i].pieces.empty()) {
+        ok = output[i].ok;
+        ++i;
         continue;
       }
+      piece = std::move(output[i].pieces.front());
+      output[i].pieces.pop_front();
+    }
+
+    if (cache_file && fwrite(piece.data(), 1, piece.size(), cache_file) != piece.size()) {
+      rWarning("failed to write %s", tmp_path.c_str());
+      fclose(cache_file);
+      unlink(tmp_path.c_str());
+      cache_file = nullptr;
+      indexing_ = false;
+    }
+    const size_t chunk_offset = log_size - tail.size();
+    log_size += piece.size();
+    if (!tail.empty()) {
+      tail += piece;
+      piece = std::move(tail);
+    }
+    const std::string &chunk = chunks_.emplace_back(std::move(piece));
+    size_t used = parse(chunk.data(), chunk.size(), chunk_offset, allow, abort);
+    tail = chunk.substr(used);
+    ok = !corrupt_;
+  }
 
+  stop = true;
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  if (cache_file) {
+    bool complete = ok && tail.empty() && !(abort && *abort);
+    complete = fclose(cache_file) == 0 && complete;
+    if (complete && rename(tmp_path.c_str(), cache_path.c_str()) == 0 && writeIndex(cache_path, log_size) &&
+        map(cache_path, log_size)) {
+      clearEvents();
+      addEvents(allow);
+      chunks_.clear();
+    } else {
+      unlink(tmp_path.c_str());
+    }
+    index_ = {};
+    indexing_ = false;
+  }
+
+  // decompression failed, a corrupt log is still read up to where it's corrupt
+  if (!ok && !corrupt_) return false;
+  return finish(tail.size(), abort);
+}
+
+// parses the messages that are complete, returns their size. offset is where data is in the log.
+size_t LogReader::parse(const char *data, size_t size, size_t offset, const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort) {
+  kj::ArrayPtr<const capnp::word> words((const capnp::word *)data, size / sizeof(capnp::word));
+  try {
+    while (words.size() > 0 && !(abort && *abort)) {
+      // the rest of it is in the next piece
+      if (capnp::expectedSizeInWordsFromPrefix(words) > words.size()) break;
+
+      Event *evt = newEvent(words);
       // Add encodeIdx packet again as a frame packet for the video stream
+      Event *frame_evt = nullptr;
       if (evt->which == cereal::Event::ROAD_ENCODE_IDX ||
           evt->which == cereal::Event::DRIVER_ENCODE_IDX ||
           evt->which == cereal::Event::WIDE_ROAD_ENCODE_IDX) {
+        frame_evt = newEvent(words, true);
+      }
 
-#ifdef HAS_MEMORY_RESOURCE
-        Event *frame_evt = new (mbr_.get()) Event(words, true);
-#else
-        Event *frame_evt = new Event(words, true);
-#endif
+      if (indexing_) {
+        const uint32_t msg_offset = (offset + ((const char *)words.begin() - data)) / sizeof(capnp::word);
+        const uint32_t msg_size = evt->words.size();
+        if (frame_evt) {
+          index_.push_back({frame_evt->mono_time, msg_offset, msg_size, (uint16_t)evt->which, true});
+        }
+        index_.push_back({evt->mono_time, msg_offset, msg_size, (uint16_t)evt->which, false});
+      }
 
+      words = kj::arrayPtr(evt->words.end(), words.end());
+      if (!allow.empty() && allow.find(evt->which) == allow.end()) {
+        delete frame_evt;
+        delete evt;
+        continue;
+      }
+      if (frame_evt) {
         events.push_back(frame_evt);
       }
-
-      words = kj::arrayPtr(evt->reader.getEnd(), words.end());
       events.push_back(evt);
+      if (collect_timeline) addTimelineMarker(evt);
     }
   } catch (const kj::Exception &e) {
     rWarning("failed to parse log : %s", e.getDescription().cStr());
-    if (!events.empty()) {
-      rWarning("read %zu events from corrupt log", events.size());
-    }
+    corrupt_ = true;
   }
+  return (const char *)words.begin() - data;
+}
 
+bool LogReader::finish(size_t unparsed, std::atomic<bool> *abort) {
+  if (unparsed > 0 && !corrupt_ && !(abort && *abort)) {
+    rWarning("failed to parse log : truncated message");
+    corrupt_ = true;
+  }
+  if (corrupt_ && !events.empty()) {
+    rWarning("read %zu events from corrupt log", events.size());
+  }
   if (!events.empty() && !(abort && *abort)) {
     std::sort(events.begin(), events.end(), Event::lessThan());
     return true;
   }
   return false;
 }
+
+// maps a file read only, the pages are read in as the events are used
+bool LogReader::map(const std::string &path, size_t expected_size) {
+  int fd = HANDLE_EINTR(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd < 0) return false;
+
+  struct stat st = {};
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0 && (expected_size == 0 || (size_t)st.st_size == expected_size)) {
+    p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) return false;
+
+  if (map_) {
+    munmap((void *)map_, map_size_);
+  }
+  map_ = (const char *)p;
+  map_size_ = st.st_size;
+  return true;
+}
+
+bool LogReader::loadCache(const std::string &path, const std::set<cereal::Event::Which> &allow) {
+  const std::string index = util::read_file(indexPath(path));
+  IndexHeader header;
+  if (index.size() < sizeof(header)) return false;
+
+  memcpy(&header, index.data(), sizeof(header));
+  if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.entry_size != sizeof(IndexEntry) ||
+      index.size() != sizeof(header) + header.count * sizeof(IndexEntry) || !map(path, header.log_size)) {
+    return false;
+  }
+
+  index_.resize(header.count);
+  memcpy(index_.data(), index.data() + sizeof(header), header.count * sizeof(IndexEntry));
+  const size_t log_words = map_size_ / sizeof(capnp::word);
+  bool valid = std::all_of(index_.begin(), index_.end(), [=](auto &e) { return (size_t)e.offset + e.size <= log_words; });
+  if (valid) {
+    addEvents(allow);
+    for (const Event *e : events) {
+      if (collect_timeline) addTimelineMarker(e);
+    }
+  }
+  index_ = {};
+  return valid;
+}
+
+// the frames of the zstd log whose entry in its index says they have any of the allowed
+// events, as offset and size. Empty if there's no index or it's not the one of the log.
+std::vector<std::pair<size_t, size_t>> LogReader::indexedFrames(const std::string &path, size_t size,
+                                                                const std::set<cereal::Event::Which> &allow) {
+  const std::string index = util::read_file(path);
+  LogIndexHeader header;
+  if (index.size() < sizeof(header)) return {};
+
+  memcpy(&header, index.data(), sizeof(header));
+  if (header.magic != LOGGER_INDEX_MAGIC || header.version != LOGGER_INDEX_VERSION || header.entry_size != sizeof(LogIndexEntry) ||
+      index.size() != sizeof(header) + (size_t)header.num_frames * sizeof(LogIndexEntry)) {
+    return {};
+  }
+
+  std::vector<std::pair<size_t, size_t>> frames;
+  const LogIndexEntry *entries = (const LogIndexEntry *)(index.data() + sizeof(header));
+  for (uint32_t i = 0; i < header.num_frames; ++i) {
+    const LogIndexEntry &e = entries[i];
+    if (e.compressed_offset + e.compressed_size > size) return {};
+
+    bool has_allowed = false;
+    for (auto which : allow) {
+      has_allowed |= (size_t)which < sizeof(e.services) * 8 && (e.services[(size_t)which / 8] & (1 << ((size_t)which % 8)));
+    }
+    if (has_allowed) {
+      frames.push_back({e.compressed_offset, e.compressed_size});
+    }
+  }
+  // a log without any of them is read whole, like one without an index
+  return frames;
+}
+
+bool LogReader::writeIndex(const std::string &path, uint64_t log_size) {
+  IndexHeader header = {.entry_size = sizeof(IndexEntry), .log_size = log_size, .count = index_.size()};
+  memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  std::string index((const char *)&header, sizeof(header));
+  index.append((const char *)index_.data(), index_.size() * sizeof(IndexEntry));
+
+  // the log is in place before its index, a log without one is decompressed again
+  const std::string index_path = indexPath(path);
+  const std::string tmp_path = index_path + ".tmp" + util::random_string(8);
+  if (util::write_file(tmp_path.c_str(), index.data(), index.size(), O_WRONLY | O_CREAT | O_TRUNC) != 0 ||
+      rename(tmp_path.c_str(), index_path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+// the events of the index, in the mapped log
+void LogReader::addEvents(const std::set<cereal::Event::Which> &allow) {
+  const capnp::word *log = (const capnp::word *)map_;
+  for (const IndexEntry &e : index_) {
+    auto which = (cereal::Event::Which)e.which;
+    if (allow.empty() || allow.find(which) != allow.end()) {
+      events.push_back(newEvent(which, e.mono_time, kj::arrayPtr(log + e.offset, e.size), (bool)e.frame));
+    }
+  }
+}
+
+void LogReader::addTimelineMarker(const Event *e) {
+  if (e->frame) return;
+
+  if (e->which == cereal::Event::Which::USER_FLAG) {
+    timeline.push_back({.mono_time = e->mono_time, .user_flag = true});
+  } else if (e->which == cereal::Event::Which::CONTROLS_STATE) {
+    try {
+      capnp::FlatArrayMessageReader reader(e->words);
+      auto cs = reader.getRoot<cereal::Event>().getControlsState();
+      auto last = std::find_if(timeline.rbegin(), timeline.rend(), [](auto &m) { return !m.user_flag; });
+      if (last == timeline.rend() || last->enabled != cs.getEnabled() || last->alert_status != cs.getAlertStatus() ||
+          last->alert_type != cs.getAlertType().cStr()) {
+        timeline.push_back({e->mono_time, false, cs.getEnabled(), cs.getAlertStatus(), cs.getAlertSize(), cs.getAlertType().cStr()});
+      }
+    } catch (const kj::Exception &ex) {
+      rWarning("failed to read controlsState : %s", ex.getDescription().cStr());
+    }
+  }
+}
+
+void LogReader::clearEvents() {
+  for (Event *e : events) {
+    delete e;
+  }
+  events.clear();
+#ifdef HAS_MEMORY_RESOURCE
+  mbr_->release();
+#endif
+}
@@ -5,28 +5,39 @@
 #include <memory_resource>
 #endif
 
+#include <deque>
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "cereal/gen/cpp/log.capnp.h"
 #include "system/camerad/cameras/camera_common.h"
 #include "tools/replay/filereader.h"
+#include "tools/replay/util.h"
 
 const CameraType ALL_CAMERAS[] = {RoadCam, DriverCam, WideRoadCam};
 const int MAX_CAMERAS = std::size(ALL_CAMERAS);
 const int DEFAULT_EVENT_MEMORY_POOL_BLOCK_SIZE = 65000;
+// compressed logs are parsed in pieces of this size while the rest is decompressed
+const size_t DECOMPRESS_PIECE_SIZE = 8 * 1024 * 1024;
 
+// An event is where its message is, its type and time. The message is only read
+// when event() is first called, most of them are only ever published as bytes.
 class Event {
 public:
-  Event(cereal::Event::Which which, uint64_t mono_time) : reader(kj::ArrayPtr<capnp::word>{}) {
+  Event(cereal::Event::Which which, uint64_t mono_time) : mono_time(mono_time), which(which), frame(false) {
     // construct a dummy Event for binary search, e.g std::upper_bound
-    this->which = which;
-    this->mono_time = mono_time;
   }
+  Event(cereal::Event::Which which, uint64_t mono_time, const kj::ArrayPtr<const capnp::word> &words, bool frame)
+      : mono_time(mono_time), which(which), words(words), frame(frame) {}
+  // reads the type and time from the message
   Event(const kj::ArrayPtr<const capnp::word> &amsg, bool frame = false);
+  ~Event();
   inline kj::ArrayPtr<const capnp::byte> bytes() const { return words.asBytes(); }
+  // safe to call from any thread
+  cereal::Event::Reader event() const;
 
   struct lessThan {
     inline bool operator()(const Event *l, const Event *r) {
@@ -45,10 +56,21 @@ public:
 
   uint64_t mono_time;
   cereal::Event::Which which;
-  cereal::Event::Reader event;
-  capnp::FlatArrayMessageReader reader;
   kj::ArrayPtr<const capnp::word> words;
   bool frame;
+
+private:
+  mutable std::atomic<capnp::FlatArrayMessageReader *> reader_ = nullptr;
+};
+
+// a userFlag, or a controlsState whose engagement or alert differs from the one before it
+struct TimelineMarker {
+  uint64_t mono_time;
+  bool user_flag;
+  bool enabled;
+  cereal::ControlsState::AlertStatus alert_status;
+  cereal::ControlsState::AlertSize alert_size;
+  std::string alert_type;
 };
 
 class LogReader {
@@ -59,10 +81,54 @@ public:
             bool local_cache = false, int chunk_size = -1, int retries = 0);
   bool load(const std::byte *data, size_t size, std::atomic<bool> *abort = nullptr);
   std::vector<Event*> events;
+  // set before load() to collect the markers of the allowed controlsState and userFlag
+  // events as they're parsed, in the order of the log
+  bool collect_timeline = false;
+  std::vector<TimelineMarker> timeline;
+
+  // in the cache, next to where FileReader caches the compressed log
+  static std::string cachePath(const std::string &url) { return cacheFilePath(url) + ".log"; }
 
 private:
-  bool parse(const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort);
-  std::string raw_;
+  // where a message is in the decompressed log, the index of a cached log is a file of these
+  struct IndexEntry {
+    uint64_t mono_time;
+    uint32_t offset;  // in words
+    uint32_t size;
+    uint16_t which;
+    uint8_t frame;
+  };
+
+  typedef bool (*Decompress)(const std::byte *in, size_t in_size, const DecompressOutput &output,
+                             std::atomic<bool> *abort, size_t piece_size);
+  bool decompressAndParse(const std::string &data, const std::vector<std::pair<size_t, size_t>> &parts, Decompress decompress,
+                          const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort, const std::string &cache_path);
+  size_t parse(const char *data, size_t size, size_t offset, const std::set<cereal::Event::Which> &allow, std::atomic<bool> *abort);
+  bool finish(size_t unparsed, std::atomic<bool> *abort);
+  bool map(const std::string &path, size_t expected_size = 0);
+  bool loadCache(const std::string &path, const std::set<cereal::Event::Which> &allow);
+  bool writeIndex(const std::string &path, uint64_t log_size);
+  void addEvents(const std::set<cereal::Event::Which> &allow);
+  void addTimelineMarker(const Event *e);
+  std::vector<std::pair<size_t, size_t>> indexedFrames(const std::string &path, size_t size, const std::set<cereal::Event::Which> &allow);
+  void clearEvents();
+
+  template <class... Args>
+  Event *newEvent(Args &&...args) {
+#ifdef HAS_MEMORY_RESOURCE
+    return new (mbr_.get()) Event(std::forward<Args>(args)...);
+#else
+    return new Event(std::forward<Args>(args)...);
+#endif
+  }
+
+  // the events point into these, they don't move once they're added
+  std::deque<std::string> chunks_;
+  const char *map_ = nullptr;
+  size_t map_size_ = 0;
+  std::vector<IndexEntry> index_;  // only kept while a log is written to the cache
+  bool indexing_ = false;
+  bool corrupt_ = false;
 #ifdef HAS_MEMORY_RESOURCE
   std::unique_ptr<std::pmr::monotonic_buffer_resource> mbr_;
 #endif
@@ -1,10 +1,148 @@
 #include <QApplication>
 #include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+#include <QThread>
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#include <capnp/schema.h>
 
 #include "common/prefix.h"
 #include "tools/replay/consoleui.h"
 #include "tools/replay/replay.h"
 
+namespace {
+
+// what a batch worker counts of the messages it publishes, from the stream thread
+struct RouteSummary {
+  std::mutex lock;
+  std::map<cereal::Event::Which, std::pair<uint64_t, uint64_t>> services;  // messages, bytes
+  uint64_t first_mono_time = 0, last_mono_time = 0;
+};
+
+bool countEvent(const Event *e, void *opaque) {
+  RouteSummary *summary = (RouteSummary *)opaque;
+  std::lock_guard lk(summary->lock);
+  auto &[count, bytes] = summary->services[e->which];
+  ++count;
+  bytes += e->bytes().size();
+  if (summary->first_mono_time == 0) summary->first_mono_time = e->mono_time;
+  summary->last_mono_time = e->mono_time;
+  return false;
+}
+
+// A batch worker replays one route at full speed without the console UI, in the msgq
+// prefix it was given, then writes a JSON summary of it to stdout. The logs go to stderr.
+int runBatchWorker(QCoreApplication &app, Replay *replay) {
+  installMessageHandler([](ReplyMsgType type, const std::string msg) {
+    if (type == ReplyMsgType::Warning || type == ReplyMsgType::Critical) std::cerr << msg << std::endl;
+  });
+
+  RouteSummary summary;
+  QElapsedTimer timer;
+  timer.start();
+  auto write_summary = [&](bool ok) {
+    std::lock_guard lk(summary.lock);
+    static const auto event_fields = capnp::Schema::from<cereal::Event>().getUnionFields();
+    QJsonObject services;
+    uint64_t total_count = 0, total_bytes = 0;
+    for (auto &[which, v] : summary.services) {
+      services[event_fields[(uint16_t)which].getProto().getName().cStr()] = QJsonObject{{"count", (qint64)v.first}, {"bytes", (qint64)v.second}};
+      total_count += v.first;
+      total_bytes += v.second;
+    }
+    QJsonObject json = {
+      {"ok", ok},
+      {"segments", (int)replay->route()->segments().size()},
+      {"route_seconds", (summary.last_mono_time - summary.first_mono_time) / 1e9},
+      {"wall_seconds", timer.elapsed() / 1000.0},
+      {"messages", (qint64)total_count},
+      {"bytes", (qint64)total_bytes},
+      {"services", services},
+    };
+    printf("%s\n", QJsonDocument(json).toJson(QJsonDocument::Compact).constData());
+    fflush(stdout);
+  };
+
+  if (!replay->load()) {
+    write_summary(false);
+    return 1;
+  }
+  replay->installEventFilter(countEvent, &summary);
+  QObject::connect(replay, &Replay::streamFinished, &app, [&]() {
+    write_summary(true);
+    app.quit();
+  }, Qt::QueuedConnection);
+  replay->start();
+  return app.exec();
+}
+
+// Runs a worker process per route, jobs of them at a time, and prints a line per route
+// once they're all done. Every worker gets its own prefix, <prefix>_<n> for the nth route.
+int runBatch(QCoreApplication &app, const QStringList &routes, const QStringList &worker_args, int jobs,
+             const QString &prefix, const QString &summary_path) {
+  std::vector<QJsonObject> results(routes.size());
+  int next = 0, running = 0, failed = 0;
+  std::function<void()> start_next = [&]() {
+    while (running < jobs && next < routes.size()) {
+      const int i = next++;
+      QProcess *proc = new QProcess(&app);
+      proc->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+      QObject::connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), &app, [&, i, proc](int code, QProcess::ExitStatus status) {
+        QJsonObject json;
+        for (const QByteArray &line : proc->readAllStandardOutput().split('\n')) {
+          if (line.startsWith('{')) json = QJsonDocument::fromJson(line).object();
+        }
+        if (json.isEmpty()) json["ok"] = false;
+        json["route"] = routes[i];
+        failed += !json["ok"].toBool() || status != QProcess::NormalExit || code != 0;
+        results[i] = json;
+        proc->deleteLater();
+        --running;
+        if (running == 0 && next == routes.size()) {
+          app.quit();
+        } else {
+          start_next();
+        }
+      });
+      QStringList args = {routes[i], "--batch-worker", "--prefix", QString("%1_%2").arg(prefix).arg(i)};
+      proc->start(app.applicationFilePath(), args + worker_args);
+      ++running;
+      rInfo("replaying %s", qPrintable(routes[i]));
+    }
+  };
+  start_next();
+  app.exec();
+
+  printf("%-48s %-6s %10s %10s %12s %10s %8s\n", "route", "status", "route s", "wall s", "messages", "MB", "speed");
+  QJsonArray all;
+  for (const QJsonObject &json : results) {
+    const double route_s = json["route_seconds"].toDouble(), wall_s = json["wall_seconds"].toDouble();
+    printf("%-48s %-6s %10.1f %10.1f %12lld %10.1f %7.1fx\n", qPrintable(json["route"].toString()),
+           json["ok"].toBool() ? "ok" : "failed", route_s, wall_s, (long long)json["messages"].toDouble(),
+           json["bytes"].toDouble() / 1e6, wall_s > 0 ? route_s / wall_s : 0);
+    all.append(json);
+  }
+  if (!summary_path.isEmpty()) {
+    QFile f(summary_path);
+    if (!f.open(QIODevice::WriteOnly) || f.write(QJsonDocument(all).toJson()) < 0) {
+      rWarning("failed to write the summary to %s", qPrintable(summary_path));
+    }
+  }
+  return failed > 0 ? 1 : 0;
+}
+
+}  // namespace
+
 int main(int argc, char *argv[]) {
 #ifdef __APPLE__
   // With all sockets opened, we might hit the default limit of 256 on macOS
@@ -37,6 +175,16 @@ int main(int argc, char *argv[]) {
   parser.addOption({"demo", "use a demo route instead of providing your own"});
   parser.addOption({"data_dir", "local directory with routes", "data_dir"});
   parser.addOption({"prefix", "set OPENPILOT_PREFIX", "prefix"});
+  parser.addOption({"connections", "download with at most <n> connections. default is 8", "n"});
+  parser.addOption({"bandwidth", "download at most <mbps> megabits per second. default is no limit", "mbps"});
+  parser.addOption({"batch", "replay every route given at full speed, without the UI, in parallel processes, "
+                             "and print a summary of each. video is only sent with --frames"});
+  parser.addOption({"jobs", "in --batch, replay <n> routes at a time. default is half the cores", "n"});
+  parser.addOption({"summary", "in --batch, also write the summaries to <file> as JSON", "file"});
+  parser.addOption({"frames", "in --batch, send video too"});
+  QCommandLineOption worker_option("batch-worker");
+  worker_option.setFlags(QCommandLineOption::HiddenFromHelp);
+  parser.addOption(worker_option);
   for (auto &[name, _, desc] : flags) {
     parser.addOption({name, desc});
   }
@@ -58,16 +206,41 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (parser.isSet("batch")) {
+    // the workers get the options of the replay, the routes and prefixes are theirs
+    QStringList worker_args;
+    for (const char *name : {"allow", "block", "cache", "data_dir", "connections", "bandwidth"}) {
+      if (parser.isSet(name)) worker_args << QString("--%1").arg(name) << parser.value(name);
+    }
+    for (const auto &[name, flag, _] : flags) {
+      if (parser.isSet(name)) worker_args << "--" + name;
+    }
+    if (!parser.isSet("frames") && !parser.isSet("no-vipc")) worker_args << "--no-vipc";
+    const int jobs = parser.isSet("jobs") ? parser.value("jobs").toInt() : QThread::idealThreadCount() / 2;
+    const QString prefix = parser.isSet("prefix") ? parser.value("prefix") : "replay_batch";
+    return runBatch(app, args.empty() ? QStringList{DEMO_ROUTE} : args, worker_args, std::max(jobs, 1),
+                    prefix, parser.value("summary"));
+  }
+  if (parser.isSet("batch-worker")) {
+    replay_flags |= REPLAY_FLAG_FULL_SPEED | REPLAY_FLAG_NO_LOOP;
+  }
+
   std::unique_ptr<OpenpilotPrefix> op_prefix;
   auto prefix = parser.value("prefix");
   if (!prefix.isEmpty()) {
     op_prefix.reset(new OpenpilotPrefix(prefix.toStdString()));
   }
 
+  setDownloadLimits(parser.value("connections").isEmpty() ? 8 : parser.value("connections").toInt(),
+                    parser.value("bandwidth").toDouble() * 1e6 / 8);
+
   Replay *replay = new Replay(route, allow, block, base_blacklist, nullptr, replay_flags, parser.value("data_dir"), &app);
   if (!parser.value("c").isEmpty()) {
     replay->setSegmentCacheLimit(parser.value("c").toInt());
   }
+  if (parser.isSet("batch-worker")) {
+    return runBatchWorker(app, replay);
+  }
   if (!replay->load()) {
     return 0;
   }
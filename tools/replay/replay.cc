@@ -1,5 +1,12 @@
 #include "tools/replay/replay.h"
 
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <cmath>
+#include <future>
+
 #include <QDebug>
 #include <QtConcurrent>
 
@@ -15,6 +22,7 @@ Replay::Replay(QString route, QStringList allow, QStringList block, QStringList
   std::vector<const char *> s;
   auto event_struct = capnp::Schema::from<cereal::Event>().asStruct();
   sockets_.resize(event_struct.getUnionFields().size());
+  batches_.resize(sockets_.size());
   for (const auto &it : services) {
     auto name = it.second.name.c_str();
     uint16_t which = event_struct.getFieldByName(name).getProto().getDiscriminantValue();
@@ -49,8 +57,8 @@ Replay::Replay(QString route, QStringList allow, QStringList block, QStringList
     pm = std::make_unique<PubMaster>(s);
   }
   route_ = std::make_unique<Route>(route, data_dir);
-  events_ = std::make_unique<std::vector<Event *>>();
-  new_events_ = std::make_unique<std::vector<Event *>>();
+  events_ = std::make_unique<MergedEvents>();
+  new_events_ = std::make_unique<MergedEvents>();
 }
 
 Replay::~Replay() {
@@ -151,39 +159,51 @@ void Replay::buildTimeline() {
     [(int)cereal::ControlsState::AlertStatus::CRITICAL] = TimelineType::AlertCritical,
   };
 
+  // the qlogs are loaded a few at a time, the markers of each are added in segment order.
+  // The markers are collected while a log is parsed, a local log with an index only has
+  // the frames with them decompressed.
+  auto load_qlog = [this](const QString &qlog) {
+    auto log = std::make_unique<LogReader>();
+    log->collect_timeline = true;
+    log->load(qlog.toStdString(), &exit_, {cereal::Event::Which::CONTROLS_STATE, cereal::Event::Which::USER_FLAG},
+              !hasFlag(REPLAY_FLAG_NO_FILE_CACHE), 0, 3);
+    return log;
+  };
+  std::deque<std::future<std::unique_ptr<LogReader>>> loading;
   const auto &route_segments = route_->segments();
-  for (auto it = route_segments.cbegin(); it != route_segments.cend() && !exit_; ++it) {
-    LogReader log;
-    if (!log.load(it->second.qlog.toStdString(), &exit_,
-                  {cereal::Event::Which::CONTROLS_STATE, cereal::Event::Which::USER_FLAG},
-                  !hasFlag(REPLAY_FLAG_NO_FILE_CACHE), 0, 3)) continue;
-
-    for (const Event *e : log.events) {
-      if (e->which == cereal::Event::Which::CONTROLS_STATE) {
-        auto cs = e->event.getControlsState();
-
-        if (engaged != cs.getEnabled()) {
-          if (engaged) {
-            std::lock_guard lk(timeline_lock);
-            timeline.push_back({toSeconds(engaged_begin), toSeconds(e->mono_time), TimelineType::Engaged});
-          }
-          engaged_begin = e->mono_time;
-          engaged = cs.getEnabled();
+  auto it = route_segments.cbegin();
+  while (!exit_ && (it != route_segments.cend() || !loading.empty())) {
+    for (; it != route_segments.cend() && loading.size() < TIMELINE_LOAD_JOBS; ++it) {
+      loading.push_back(std::async(std::launch::async, load_qlog, it->second.qlog));
+    }
+    std::unique_ptr<LogReader> log = loading.front().get();
+    loading.pop_front();
+
+    for (const TimelineMarker &m : log->timeline) {
+      if (m.user_flag) {
+        std::lock_guard lk(timeline_lock);
+        timeline.push_back({toSeconds(m.mono_time), toSeconds(m.mono_time), TimelineType::UserFlag});
+        continue;
+      }
+
+      if (engaged != m.enabled) {
+        if (engaged) {
+          std::lock_guard lk(timeline_lock);
+          timeline.push_back({toSeconds(engaged_begin), toSeconds(m.mono_time), TimelineType::Engaged});
         }
+        engaged_begin = m.mono_time;
+        engaged = m.enabled;
+      }
 
-        if (alert_type != cs.getAlertType().cStr() || alert_status != cs.getAlertStatus()) {
-          if (!alert_type.empty() && alert_size != cereal::ControlsState::AlertSize::NONE) {
-            std::lock_guard lk(timeline_lock);
-            timeline.push_back({toSeconds(alert_begin), toSeconds(e->mono_time), timeline_types[(int)alert_status]});
-          }
-          alert_begin = e->mono_time;
-          alert_type = cs.getAlertType().cStr();
-          alert_size = cs.getAlertSize();
-          alert_status = cs.getAlertStatus();
+      if (alert_type != m.alert_type || alert_status != m.alert_status) {
+        if (!alert_type.empty() && alert_size != cereal::ControlsState::AlertSize::NONE) {
+          std::lock_guard lk(timeline_lock);
+          timeline.push_back({toSeconds(alert_begin), toSeconds(m.mono_time), timeline_types[(int)alert_status]});
         }
-      } else if (e->which == cereal::Event::Which::USER_FLAG) {
-        std::lock_guard lk(timeline_lock);
-        timeline.push_back({toSeconds(e->mono_time), toSeconds(e->mono_time), TimelineType::UserFlag});
+        alert_begin = m.mono_time;
+        alert_type = m.alert_type;
+        alert_size = m.alert_size;
+        alert_status = m.alert_status;
       }
     }
   }
@@ -250,16 +270,18 @@ void Replay::queueSegment() {
     ++end;
   }
 
-  // load one segment at a time
-  for (auto it = cur; it != end; ++it) {
+  // the segments ahead are loaded a few at a time, more the faster it plays. Their
+  // downloads share the connections, the segment under the playhead gets them first.
+  setDownloadFocus(cur->first);
+  const int max_loading = std::clamp((int)std::ceil(speed_), 1, 4) + 1;
+  int loading = std::count_if(begin, end, [](auto &e) { return e.second && !e.second->isLoaded(); });
+  for (auto it = cur; it != end && loading < max_loading; ++it) {
     auto &[n, seg] = *it;
-    if ((seg && !seg->isLoaded()) || !seg) {
-      if (!seg) {
-        rDebug("loading segment %d...", n);
-        seg = std::make_unique<Segment>(n, route_->at(n), flags_, allow_list);
-        QObject::connect(seg.get(), &Segment::loadFinished, this, &Replay::segmentLoadFinished);
-      }
-      break;
+    if (!seg) {
+      rDebug("loading segment %d...", n);
+      seg = std::make_unique<Segment>(n, route_->at(n), flags_, allow_list);
+      QObject::connect(seg.get(), &Segment::loadFinished, this, &Replay::segmentLoadFinished);
+      ++loading;
     }
   }
 
@@ -279,11 +301,9 @@ void Replay::queueSegment() {
 
 void Replay::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end) {
   std::vector<int> segments_need_merge;
-  size_t new_events_size = 0;
   for (auto it = begin; it != end; ++it) {
     if (it->second && it->second->isLoaded()) {
       segments_need_merge.push_back(it->first);
-      new_events_size += it->second->log->events.size();
     }
   }
 
@@ -295,15 +315,8 @@ void Replay::mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::
     }
     rDebug("merge segments %s", s.c_str());
     new_events_->clear();
-    new_events_->reserve(new_events_size);
     for (int n : segments_need_merge) {
-      const auto &e = segments_[n]->log->events;
-      if (e.size() > 0) {
-        auto insert_from = e.begin();
-        if (new_events_->size() > 0 && (*insert_from)->which == cereal::Event::Which::INIT_DATA) ++insert_from;
-        auto middle = new_events_->insert(new_events_->end(), insert_from, e.end());
-        std::inplace_merge(new_events_->begin(), middle, new_events_->end(), Event::lessThan());
-      }
+      new_events_->append(segments_[n]->log->events);
     }
 
     if (stream_thread_) {
@@ -328,9 +341,9 @@ void Replay::startStream(const Segment *cur_segment) {
   // write CarParams
   auto it = std::find_if(events.begin(), events.end(), [](auto e) { return e->which == cereal::Event::Which::CAR_PARAMS; });
   if (it != events.end()) {
-    car_fingerprint_ = (*it)->event.getCarParams().getCarFingerprint();
+    car_fingerprint_ = (*it)->event().getCarParams().getCarFingerprint();
     capnp::MallocMessageBuilder builder;
-    builder.setRoot((*it)->event.getCarParams());
+    builder.setRoot((*it)->event().getCarParams());
     auto words = capnp::messageToFlatArray(builder);
     auto bytes = words.asBytes();
     Params().put("CarParams", (const char *)bytes.begin(), bytes.size());
@@ -365,16 +378,41 @@ void Replay::publishMessage(const Event *e) {
 
   if (sm == nullptr) {
     auto bytes = e->bytes();
+    if (hasFlag(REPLAY_FLAG_FULL_SPEED)) {
+      // sent straight from the log, in a batch
+      auto &batch = batches_[e->which];
+      if (batch.empty()) batch_order_.push_back(e->which);
+      batch.push_back(kj::ArrayPtr<capnp::byte>((capnp::byte *)bytes.begin(), bytes.size()));
+      if (++batch_size_ >= MAX_PUBLISH_BATCH) flushMessages();
+      return;
+    }
+
+    flushMessages();
     int ret = pm->send(sockets_[e->which], (capnp::byte *)bytes.begin(), bytes.size());
     if (ret == -1) {
       rWarning("stop publishing %s due to multiple publishers error", sockets_[e->which]);
       sockets_[e->which] = nullptr;
     }
   } else {
-    sm->update_msgs(nanos_since_boot(), {{sockets_[e->which], e->event}});
+    sm->update_msgs(nanos_since_boot(), {{sockets_[e->which], e->event()}});
   }
 }
 
+// the order is kept on a socket, between sockets only from one batch to the next.
+// The messages point into the logs, they're sent before stream() lets go of them.
+void Replay::flushMessages() {
+  for (int which : batch_order_) {
+    auto &batch = batches_[which];
+    if (sockets_[which] != nullptr && pm->sendBatch(sockets_[which], batch) == -1) {
+      rWarning("stop publishing %s due to multiple publishers error", sockets_[which]);
+      sockets_[which] = nullptr;
+    }
+    batch.clear();
+  }
+  batch_order_.clear();
+  batch_size_ = 0;
+}
+
 void Replay::publishFrame(const Event *e) {
   static const std::map<cereal::Event::Which, CameraType> cam_types{
       {cereal::Event::ROAD_ENCODE_IDX, RoadCam},
@@ -385,9 +423,13 @@ void Replay::publishFrame(const Event *e) {
       (e->which == cereal::Event::WIDE_ROAD_ENCODE_IDX && !hasFlag(REPLAY_FLAG_ECAM))) {
     return;
   }
-  auto eidx = capnp::AnyStruct::Reader(e->event).getPointerSection()[0].getAs<cereal::EncodeIndex>();
+  auto eidx = capnp::AnyStruct::Reader(e->event()).getPointerSection()[0].getAs<cereal::EncodeIndex>();
   if (eidx.getType() == cereal::EncodeIndex::Type::FULL_H_E_V_C && isSegmentMerged(eidx.getSegmentNum())) {
     CameraType cam = cam_types.at(e->which);
+    if (hasFlag(REPLAY_FLAG_FULL_SPEED)) {
+      // the messages are held back only once the camera is a few frames behind
+      camera_server_->waitForSent(cam, MAX_FRAMES_IN_FLIGHT);
+    }
     camera_server_->pushFrame(cam, segments_[eidx.getSegmentNum()]->frames[cam].get(), eidx);
   }
 }
@@ -395,6 +437,30 @@ void Replay::publishFrame(const Event *e) {
 void Replay::stream() {
   cereal::Event::Which cur_which = cereal::Event::Which::INIT_DATA;
   double prev_replay_speed = 1.0;
+#ifdef __linux__
+  // wake up when the sleep is over, not up to the default 50us after
+  prctl(PR_SET_TIMERSLACK, 1);
+#endif
+
+  // the pacing errors of the current second
+  uint64_t pacing_start_ts = nanos_since_boot();
+  int pacing_events = 0;
+  double pacing_error_sum = 0, pacing_error_max = 0;
+  auto add_pacing_error = [&](uint64_t due_ts) {
+    const uint64_t now = nanos_since_boot();
+    const double error = std::abs((double)((int64_t)(now - due_ts))) / 1e6;
+    ++pacing_events;
+    pacing_error_sum += error;
+    pacing_error_max = std::max(pacing_error_max, error);
+    if (now - pacing_start_ts >= 1e9) {
+      std::lock_guard lk(pacing_lock_);
+      pacing_stats_ = {pacing_events, pacing_error_sum / pacing_events, pacing_error_max};
+      pacing_start_ts = now;
+      pacing_events = 0;
+      pacing_error_sum = pacing_error_max = 0;
+    }
+  };
+
   std::unique_lock lk(stream_lock_);
 
   while (true) {
@@ -403,7 +469,7 @@ void Replay::stream() {
     if (exit_) break;
 
     Event cur_event(cur_which, cur_mono_time_);
-    auto eit = std::upper_bound(events_->begin(), events_->end(), &cur_event, Event::lessThan());
+    auto eit = events_->upper_bound(&cur_event);
     if (eit == events_->end()) {
       rInfo("waiting for events...");
       continue;
@@ -439,30 +505,38 @@ void Replay::stream() {
           evt_start_ts = cur_mono_time_;
           loop_start_ts = nanos_since_boot();
           prev_replay_speed = speed_;
-        } else if (behind_ns > 0 && !hasFlag(REPLAY_FLAG_FULL_SPEED)) {
-          precise_nano_sleep(behind_ns);
+        } else if (!hasFlag(REPLAY_FLAG_FULL_SPEED)) {
+          // one sleep for the events due within the window after this one
+          if (behind_ns > (long)PACING_WINDOW_NS) {
+            precise_sleep_until(loop_start_ts + etime);
+          }
+          add_pacing_error(loop_start_ts + etime);
         }
 
         if (!evt->frame) {
           publishMessage(evt);
         } else if (camera_server_) {
-          if (hasFlag(REPLAY_FLAG_FULL_SPEED)) {
-            camera_server_->waitForSent();
-          }
+          flushMessages();
           publishFrame(evt);
         }
       }
     }
+    flushMessages();
     // wait for frame to be sent before unlock.(frameReader may be deleted after unlock)
     if (camera_server_) {
       camera_server_->waitForSent();
     }
 
-    if (eit == events_->end() && !hasFlag(REPLAY_FLAG_NO_LOOP)) {
+    if (eit == events_->end()) {
       int last_segment = segments_.empty() ? 0 : segments_.rbegin()->first;
       if (current_segment_ >= last_segment && isSegmentMerged(last_segment)) {
-        rInfo("reaches the end of route, restart from beginning");
-        QMetaObject::invokeMethod(this, std::bind(&Replay::seekTo, this, 0, false), Qt::QueuedConnection);
+        if (hasFlag(REPLAY_FLAG_NO_LOOP)) {
+          rInfo("reaches the end of route");
+          emit streamFinished();
+        } else {
+          rInfo("reaches the end of route, restart from beginning");
+          QMetaObject::invokeMethod(this, std::bind(&Replay::seekTo, this, 0, false), Qt::QueuedConnection);
+        }
       }
     }
   }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <deque>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <optional>
@@ -17,8 +19,14 @@
 
 const QString DEMO_ROUTE = "a2a0ccea32023010|2023-07-27--13-01-19";
 
-// one segment uses about 100M of memory
+// one segment uses about 100M of memory, less with the file cache, which maps its log from disk
 constexpr int MIN_SEGMENTS_CACHE = 5;
+// at full speed the messages are sent in batches of up to this many, a batch per socket
+constexpr int MAX_PUBLISH_BATCH = 64;
+// events due within this long of the one slept for are sent with it, without a sleep of their own
+constexpr uint64_t PACING_WINDOW_NS = 1e6;
+// qlogs loaded at the same time for the timeline
+constexpr int TIMELINE_LOAD_JOBS = 4;
 
 enum REPLAY_FLAGS {
   REPLAY_FLAG_NONE = 0x0000,
@@ -43,8 +51,74 @@ enum class FindFlag {
 };
 
 enum class TimelineType { None, Engaged, AlertInfo, AlertWarning, AlertCritical, UserFlag };
+
+// how far from their time the events of the last second were sent, early ones count too
+struct PacingStats {
+  int events = 0;
+  double mean_error_ms = 0;
+  double max_error_ms = 0;
+};
 typedef bool (*replayEventFilter)(const Event *, void *);
 
+// The events of the merged segments, as the sorted events of each segment in segment
+// order. Segments follow each other in time, so merging them is adding or dropping a
+// span, their events aren't copied or sorted again.
+class MergedEvents {
+public:
+  struct Span {
+    const std::vector<Event *> *events;
+    size_t begin;
+  };
+
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Event *;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Event *const *;
+    using reference = Event *const &;
+
+    iterator(const std::deque<Span> *spans, size_t span, size_t pos) : spans_(spans), span_(span), pos_(pos) {}
+    reference operator*() const { return (*(*spans_)[span_].events)[pos_]; }
+    iterator &operator++() {
+      if (++pos_ == (*spans_)[span_].events->size()) {
+        ++span_;
+        pos_ = span_ < spans_->size() ? (*spans_)[span_].begin : 0;
+      }
+      return *this;
+    }
+    bool operator==(const iterator &other) const { return span_ == other.span_ && pos_ == other.pos_; }
+    bool operator!=(const iterator &other) const { return !(*this == other); }
+
+  private:
+    const std::deque<Span> *spans_;
+    size_t span_, pos_;
+  };
+
+  // the INIT_DATA each segment starts with is only kept from the first
+  void append(const std::vector<Event *> &events) {
+    size_t begin = !spans_.empty() && !events.empty() && events.front()->which == cereal::Event::Which::INIT_DATA;
+    if (begin < events.size()) spans_.push_back({&events, begin});
+  }
+  void clear() { spans_.clear(); }
+  bool empty() const { return spans_.empty(); }
+  const Event *back() const { return spans_.back().events->back(); }
+  iterator begin() const { return spans_.empty() ? end() : iterator(&spans_, 0, spans_.front().begin); }
+  iterator end() const { return iterator(&spans_, spans_.size(), 0); }
+  // the first event after e, in the first segment that has one
+  iterator upper_bound(const Event *e) const {
+    for (size_t i = 0; i < spans_.size(); ++i) {
+      const auto &events = *spans_[i].events;
+      auto it = std::upper_bound(events.begin() + spans_[i].begin, events.end(), e, Event::lessThan());
+      if (it != events.end()) return iterator(&spans_, i, it - events.begin());
+    }
+    return end();
+  }
+
+private:
+  std::deque<Span> spans_;
+};
+
 class Replay : public QObject {
   Q_OBJECT
 
@@ -79,9 +153,13 @@ public:
   inline int totalSeconds() const { return (!segments_.empty()) ? (segments_.rbegin()->first + 1) * 60 : 0; }
   inline void setSpeed(float speed) { speed_ = speed; }
   inline float getSpeed() const { return speed_; }
-  inline const std::vector<Event *> *events() const { return events_.get(); }
+  inline const MergedEvents *events() const { return events_.get(); }
   inline const std::map<int, std::unique_ptr<Segment>> &segments() const { return segments_; }
   inline const std::string &carFingerprint() const { return car_fingerprint_; }
+  inline PacingStats pacingStats() {
+    std::lock_guard lk(pacing_lock_);
+    return pacing_stats_;
+  }
   inline const std::vector<std::tuple<double, double, TimelineType>> getTimeline() {
     std::lock_guard lk(timeline_lock);
     return timeline;
@@ -89,6 +167,8 @@ public:
 
 signals:
   void streamStarted();
+  // from the stream thread, at the end of the route with REPLAY_FLAG_NO_LOOP
+  void streamFinished();
   void segmentsMerged();
   void seekedTo(double sec);
 
@@ -105,6 +185,7 @@ protected:
   void mergeSegments(const SegmentMap::iterator &begin, const SegmentMap::iterator &end);
   void updateEvents(const std::function<bool()>& lambda);
   void publishMessage(const Event *e);
+  void flushMessages();
   void publishFrame(const Event *e);
   void buildTimeline();
   inline bool isSegmentMerged(int n) {
@@ -125,18 +206,25 @@ protected:
   bool events_updated_ = false;
   uint64_t route_start_ts_ = 0;
   std::atomic<uint64_t> cur_mono_time_ = 0;
-  std::unique_ptr<std::vector<Event *>> events_;
-  std::unique_ptr<std::vector<Event *>> new_events_;
+  std::unique_ptr<MergedEvents> events_;
+  std::unique_ptr<MergedEvents> new_events_;
   std::vector<int> segments_merged_;
 
   // messaging
   SubMaster *sm = nullptr;
   std::unique_ptr<PubMaster> pm;
   std::vector<const char*> sockets_;
+  // the messages not sent yet at full speed, by socket, and the sockets in the order of their first one
+  std::vector<std::vector<kj::ArrayPtr<capnp::byte>>> batches_;
+  std::vector<int> batch_order_;
+  int batch_size_ = 0;
   std::unique_ptr<Route> route_;
   std::unique_ptr<CameraServer> camera_server_;
   std::atomic<uint32_t> flags_ = REPLAY_FLAG_NONE;
 
+  std::mutex pacing_lock_;
+  PacingStats pacing_stats_;
+
   std::mutex timeline_lock;
   QFuture<void> timeline_future;
   std::vector<std::tuple<double, double, TimelineType>> timeline;
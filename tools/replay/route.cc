@@ -2,10 +2,14 @@
 
 #include <QDir>
 #include <QEventLoop>
+#include <QFileInfo>
 #include <QJsonArray>
 #include <QJsonDocument>
+#include <QJsonObject>
 #include <QRegExp>
+#include <QUrlQuery>
 #include <QtConcurrent>
+#include <algorithm>
 #include <array>
 #include <memory>
 #include <set>
@@ -13,9 +17,29 @@
 
 #include "selfdrive/ui/qt/api.h"
 #include "system/hardware/hw.h"
+#include "tools/replay/filereader.h"
 #include "tools/replay/replay.h"
 #include "tools/replay/util.h"
 
+const int ROUTE_CACHE_VERSION = 1;
+// for server file lists whose URLs don't say when they expire
+const qint64 ROUTE_CACHE_TTL_SECS = 60 * 60;
+// a list whose URLs expire sooner than this is fetched again, so they last the replay's loads
+const qint64 ROUTE_CACHE_EXPIRY_MARGIN_SECS = 10 * 60;
+
+static const std::pair<const char *, QString SegmentFile::*> segment_file_fields[] = {
+  {"rlog", &SegmentFile::rlog},
+  {"qlog", &SegmentFile::qlog},
+  {"road_cam", &SegmentFile::road_cam},
+  {"driver_cam", &SegmentFile::driver_cam},
+  {"wide_road_cam", &SegmentFile::wide_road_cam},
+  {"qcamera", &SegmentFile::qcamera},
+};
+
+static qint64 mtime(const QString &path) {
+  return QFileInfo(path).lastModified().toMSecsSinceEpoch();
+}
+
 Route::Route(const QString &route, const QString &data_dir) : data_dir_(data_dir) {
   route_ = parseRoute(route);
 }
@@ -34,7 +58,95 @@ bool Route::load() {
     return false;
   }
   date_time_ = QDateTime::fromString(route_.timestamp, "yyyy-MM-dd--HH-mm-ss");
-  return data_dir_.isEmpty() ? loadFromServer() : loadFromLocal();
+  if (loadFromCache()) {
+    rDebug("file list of %s from the cache", route_.str.toStdString().c_str());
+    return true;
+  }
+
+  bool ret = data_dir_.isEmpty() ? loadFromServer() : loadFromLocal();
+  if (ret) saveToCache();
+  return ret;
+}
+
+QString Route::cachePath() const {
+  return QString::fromStdString(cacheFilePath("route:" + route_.str.toStdString() + ":" + data_dir_.toStdString())) + ".route.json";
+}
+
+bool Route::loadFromCache() {
+  QFile f(cachePath());
+  if (!f.open(QIODevice::ReadOnly)) return false;
+  const QJsonObject obj = QJsonDocument::fromJson(f.readAll()).object();
+  if (obj["version"].toInt() != ROUTE_CACHE_VERSION || obj["route"].toString() != route_.str) return false;
+
+  if (data_dir_.isEmpty()) {
+    if (QDateTime::currentSecsSinceEpoch() + ROUTE_CACHE_EXPIRY_MARGIN_SECS >= (qint64)obj["url_expiry"].toDouble()) return false;
+  } else if (mtime(data_dir_) != (qint64)obj["dir_mtime"].toDouble()) {
+    // a segment directory was added or removed
+    return false;
+  }
+
+  std::map<int, SegmentFile> segments;
+  const QJsonObject segs = obj["segments"].toObject();
+  for (auto it = segs.begin(); it != segs.end(); ++it) {
+    const QJsonObject seg = it.value().toObject();
+    // files were added to or removed from the segment
+    if (!data_dir_.isEmpty() && mtime(seg["dir"].toString()) != (qint64)seg["dir_mtime"].toDouble()) return false;
+
+    SegmentFile &files = segments[it.key().toInt()];
+    for (auto &[key, field] : segment_file_fields) {
+      files.*field = seg[key].toString();
+    }
+  }
+  if (segments.empty() || (int)segments.size() != obj["segment_count"].toInt()) return false;
+
+  segments_ = std::move(segments);
+  url_expiry_ = (qint64)obj["url_expiry"].toDouble();
+  return true;
+}
+
+void Route::saveToCache() {
+  QJsonObject segs;
+  for (const auto &[n, files] : segments_) {
+    QJsonObject seg;
+    QJsonObject sizes;
+    QString dir;
+    for (auto &[key, field] : segment_file_fields) {
+      const QString &file = files.*field;
+      if (file.isEmpty()) continue;
+      seg[key] = file;
+      // known for local files, the remote ones are sized when they're downloaded
+      if (!data_dir_.isEmpty()) {
+        sizes[key] = (double)QFileInfo(file).size();
+        dir = QFileInfo(file).absolutePath();
+      }
+    }
+    if (!data_dir_.isEmpty()) {
+      seg["dir"] = dir;
+      seg["dir_mtime"] = (double)mtime(dir);
+      seg["sizes"] = sizes;
+    }
+    segs[QString::number(n)] = seg;
+  }
+
+  QJsonObject obj;
+  obj["version"] = ROUTE_CACHE_VERSION;
+  obj["route"] = route_.str;
+  obj["segment_count"] = (int)segments_.size();
+  obj["segments"] = segs;
+  if (data_dir_.isEmpty()) {
+    obj["url_expiry"] = (double)url_expiry_;
+  } else {
+    obj["dir_mtime"] = (double)mtime(data_dir_);
+  }
+
+  // written next to the final name and renamed, a reader never sees half of it
+  const QString path = cachePath();
+  QFile f(path + ".tmp");
+  if (f.open(QIODevice::WriteOnly | QIODevice::Truncate) && f.write(QJsonDocument(obj).toJson(QJsonDocument::Compact)) > 0) {
+    f.close();
+    QFile::remove(path);
+    f.rename(path);
+  }
 }
 
 bool Route::loadFromServer() {
@@ -53,12 +165,18 @@ bool Route::loadFromServer() {
 
 bool Route::loadFromJson(const QString &json) {
   QRegExp rx(R"(\/(\d+)\/)");
+  url_expiry_ = QDateTime::currentSecsSinceEpoch() + ROUTE_CACHE_TTL_SECS;
   for (const auto &value : QJsonDocument::fromJson(json.trimmed().toUtf8()).object()) {
     for (const auto &url : value.toArray()) {
       QString url_str = url.toString();
       if (rx.indexIn(url_str) != -1) {
         addFileToSegment(rx.cap(1).toInt(), url_str);
       }
+      // the signed URLs say when they expire in se, an ISO 8601 time
+      QDateTime expiry = QDateTime::fromString(QUrlQuery(QUrl(url_str)).queryItemValue("se", QUrl::FullyDecoded), Qt::ISODate);
+      if (expiry.isValid()) {
+        url_expiry_ = std::min(url_expiry_, expiry.toSecsSinceEpoch());
+      }
     }
   }
   return !segments_.empty();
@@ -85,9 +203,9 @@ void Route::addFileToSegment(int n, const QString &file) {
   const int pos = name.lastIndexOf("--");
   name = pos != -1 ? name.mid(pos + 2) : name;
 
-  if (name == "rlog.bz2" || name == "rlog") {
+  if (name == "rlog.bz2" || name == "rlog.zst" || name == "rlog") {
     segments_[n].rlog = file;
-  } else if (name == "qlog.bz2" || name == "qlog") {
+  } else if (name == "qlog.bz2" || name == "qlog.zst" || name == "qlog") {
     segments_[n].qlog = file;
   } else if (name == "fcamera.hevc") {
     segments_[n].road_cam = file;
@@ -128,6 +246,7 @@ Segment::~Segment() {
 }
 
 void Segment::loadFile(int id, const std::string file) {
+  setDownloadPriority(seg_num);
   const bool local_cache = !(flags & REPLAY_FLAG_NO_FILE_CACHE);
   bool success = false;
   if (id < MAX_CAMERAS) {
@@ -45,9 +45,16 @@ protected:
   bool loadFromServer();
   bool loadFromJson(const QString &json);
   void addFileToSegment(int seg_num, const QString &file);
+  // The file lists of a route are kept in the download cache. A server list is good
+  // until its signed URLs expire, a local one while the directories' mtimes are unchanged
+  QString cachePath() const;
+  bool loadFromCache();
+  void saveToCache();
   RouteIdentifier route_ = {};
   QString data_dir_;
   std::map<int, SegmentFile> segments_;
+  // seconds since epoch when the first signed URL of the server's file list expires
+  qint64 url_expiry_ = 0;
   QDateTime date_time_;
 };
 
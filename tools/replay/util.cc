@@ -3,7 +3,13 @@
 #include <bzlib.h>
 #include <curl/curl.h>
 #include <openssl/sha.h>
+#include <zstd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <chrono>
 #include <cstdarg>
 #include <cstring>
 #include <cassert>
@@ -14,6 +20,7 @@
 #include <mutex>
 #include <numeric>
 #include <utility>
+#include <vector>
 
 #include "common/timing.h"
 #include "common/util.h"
@@ -123,8 +130,83 @@ struct DownloadStats {
   double prev_tm = 0;
 };
 
+// hands out the connections of the cap, to one waiting download at a time
+class DownloadScheduler {
+public:
+  // false if it's aborted, connections is lowered to what's free
+  bool acquire(int &connections, int priority, std::atomic<bool> *abort) {
+    std::unique_lock lk(lock);
+    waiting.push_back(priority);
+    auto first = [&]() {
+      auto key = [=](int p) { return p >= focus ? std::pair{0, p - focus} : std::pair{1, focus - p}; };
+      return std::min_element(waiting.begin(), waiting.end(), [&](int a, int b) { return key(a) < key(b); });
+    };
+    while (!(abort && *abort) && !(*first() == priority && (max_connections == 0 || active < max_connections))) {
+      cv.wait_for(lk, std::chrono::milliseconds(100));
+    }
+    waiting.erase(std::find(waiting.begin(), waiting.end(), priority));
+    cv.notify_all();
+    if (abort && *abort) return false;
+
+    if (max_connections > 0) {
+      connections = std::min(connections, max_connections - active);
+    }
+    active += connections;
+    return true;
+  }
+
+  void release(int connections) {
+    std::lock_guard lk(lock);
+    active -= connections;
+    cv.notify_all();
+  }
+
+  // per connection, so the total stays under the cap
+  size_t connectionBandwidth() {
+    std::lock_guard lk(lock);
+    return max_connections > 0 ? max_bytes_per_sec / max_connections : max_bytes_per_sec;
+  }
+
+  void setLimits(int connections, size_t bytes_per_sec) {
+    std::lock_guard lk(lock);
+    max_connections = connections;
+    max_bytes_per_sec = bytes_per_sec;
+    cv.notify_all();
+  }
+
+  void setFocus(int priority) {
+    std::lock_guard lk(lock);
+    focus = priority;
+    cv.notify_all();
+  }
+
+private:
+  std::mutex lock;
+  std::condition_variable cv;
+  std::vector<int> waiting;
+  int active = 0;
+  int focus = 0;
+  int max_connections = 8;
+  size_t max_bytes_per_sec = 0;
+};
+
+DownloadScheduler download_scheduler;
+thread_local int download_priority = INT_MAX;
+
 } // namespace
 
+void setDownloadLimits(int max_connections, size_t max_bytes_per_sec) {
+  download_scheduler.setLimits(std::max(max_connections, 0), max_bytes_per_sec);
+}
+
+void setDownloadFocus(int priority) {
+  download_scheduler.setFocus(priority);
+}
+
+void setDownloadPriority(int priority) {
+  download_priority = priority;
+}
+
 std::string formattedDataSize(size_t size) {
   if (size < 1024) {
     return std::to_string(size) + " B";
@@ -167,14 +249,17 @@ std::string getUrlWithoutQuery(const std::string &url) {
 
 template <class T>
 bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t content_length, std::atomic<bool> *abort) {
-  static DownloadStats download_stats;
-  download_stats.add(url, content_length);
-
   int parts = 1;
   if (chunk_size > 0 && content_length > 10 * 1024 * 1024) {
     parts = std::nearbyint(content_length / (float)chunk_size);
     parts = std::clamp(parts, 1, 5);
   }
+  // the parts are the connections there's room for
+  if (!download_scheduler.acquire(parts, download_priority, abort)) return false;
+  const size_t max_recv_speed = download_scheduler.connectionBandwidth();
+
+  static DownloadStats download_stats;
+  download_stats.add(url, content_length);
 
   CURLM *cm = curl_multi_init();
   size_t written = 0;
@@ -195,6 +280,9 @@ bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t cont
     curl_easy_setopt(eh, CURLOPT_HTTPGET, 1);
     curl_easy_setopt(eh, CURLOPT_NOSIGNAL, 1);
     curl_easy_setopt(eh, CURLOPT_FOLLOWLOCATION, 1);
+    if (max_recv_speed > 0) {
+      curl_easy_setopt(eh, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)max_recv_speed);
+    }
 
     curl_multi_add_handle(cm, eh);
   }
@@ -234,6 +322,7 @@ bool httpDownload(const std::string &url, T &buf, size_t chunk_size, size_t cont
     curl_easy_cleanup(e);
   }
   curl_multi_cleanup(cm);
+  download_scheduler.release(parts);
 
   return success;
 }
@@ -260,7 +349,14 @@ std::string decompressBZ2(const std::string &in, std::atomic<bool> *abort) {
 }
 
 std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool> *abort) {
-  if (in_size == 0) return {};
+  std::string out;
+  bool ret = decompressBZ2(in, in_size, [&](std::string &&piece) { out = std::move(piece); }, abort);
+  return ret ? out : "";
+}
+
+bool decompressBZ2(const std::byte *in, size_t in_size, const DecompressOutput &output,
+                   std::atomic<bool> *abort, size_t piece_size) {
+  if (in_size == 0) return false;
 
   bz_stream strm = {};
   int bzerror = BZ2_bzDecompressInit(&strm, 0, 0);
@@ -268,31 +364,156 @@ std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool>
 
   strm.next_in = (char *)in;
   strm.avail_in = in_size;
-  std::string out(in_size * 5, '\0');
+  std::string out(std::min(in_size * 5, piece_size), '\0');
+  size_t out_pos = 0;
   do {
-    strm.next_out = (char *)(&out[strm.total_out_lo32]);
-    strm.avail_out = out.size() - strm.total_out_lo32;
+    if (out_pos == out.size()) {
+      if (out.size() < piece_size) {
+        out.resize(std::min(out.size() * 2, piece_size));
+      } else {
+        output(std::move(out));
+        out = std::string(piece_size, '\0');
+        out_pos = 0;
+      }
+    }
+    strm.next_out = &out[out_pos];
+    strm.avail_out = out.size() - out_pos;
 
-    const char *prev_write_pos = strm.next_out;
     bzerror = BZ2_bzDecompress(&strm);
-    if (bzerror == BZ_OK && prev_write_pos == strm.next_out) {
+    if (bzerror == BZ_OK && strm.next_out == &out[out_pos]) {
       // content is corrupt
-      bzerror = BZ_STREAM_END;
+      bzerror = BZ_DATA_ERROR;
       rWarning("decompressBZ2 error : content is corrupt");
       break;
     }
-
-    if (bzerror == BZ_OK && strm.avail_in > 0 && strm.avail_out == 0) {
-      out.resize(out.size() * 2);
-    }
+    out_pos = strm.next_out - out.data();
   } while (bzerror == BZ_OK && !(abort && *abort));
 
   BZ2_bzDecompressEnd(&strm);
   if (bzerror == BZ_STREAM_END && !(abort && *abort)) {
-    out.resize(strm.total_out_lo32);
-    return out;
+    out.resize(out_pos);
+    if (!out.empty()) output(std::move(out));
+    return true;
   }
-  return {};
+  return false;
+}
+
+std::string decompressZST(const std::string &in, std::atomic<bool> *abort) {
+  std::string out;
+  bool ret = decompressZST((const std::byte *)in.data(), in.size(), [&](std::string &&piece) { out = std::move(piece); }, abort);
+  return ret ? out : "";
+}
+
+bool decompressZST(const std::byte *in, size_t in_size, const DecompressOutput &output,
+                   std::atomic<bool> *abort, size_t piece_size) {
+  if (in_size == 0) return false;
+
+  ZSTD_DStream *dstream = ZSTD_createDStream();
+  assert(dstream != nullptr);
+
+  // multi frame input, the seek table is a skippable frame and decodes to nothing
+  ZSTD_inBuffer input = {in, in_size, 0};
+  std::string out(std::min(in_size * 5, piece_size), '\0');
+  size_t out_pos = 0;
+  size_t ret = 0;
+  while (!(abort && *abort)) {
+    if (out_pos == out.size()) {
+      if (out.size() < piece_size) {
+        out.resize(std::min(out.size() * 2, piece_size));
+      } else {
+        output(std::move(out));
+        out = std::string(piece_size, '\0');
+        out_pos = 0;
+      }
+    }
+    ZSTD_outBuffer out_buf = {&out[out_pos], out.size() - out_pos, 0};
+    ret = ZSTD_decompressStream(dstream, &out_buf, &input);
+    if (ZSTD_isError(ret)) {
+      rWarning("decompressZST error : %s", ZSTD_getErrorName(ret));
+      break;
+    }
+    out_pos += out_buf.pos;
+    // with room left in the output, the decoder has flushed everything it had
+    if (input.pos == input.size && out_buf.pos < out_buf.size) break;
+  }
+
+  ZSTD_freeDStream(dstream);
+  if (!ZSTD_isError(ret) && ret == 0 && input.pos == input.size && !(abort && *abort)) {
+    out.resize(out_pos);
+    if (!out.empty()) output(std::move(out));
+    return true;
+  }
+  return false;
+}
+
+std::vector<std::pair<size_t, size_t>> splitBZ2Streams(const std::byte *in, size_t in_size) {
+  // a stream starts with "BZh", the block size and the magic of its first block, or of
+  // its end for an empty one. Streams are byte aligned, their blocks aren't, so it's
+  // only files concatenated from several streams (pbzip2, lbzip2) that split.
+  auto stream_start = [&](size_t pos) {
+    const char *p = (const char *)in + pos;
+    return pos + 10 <= in_size && memcmp(p, "BZh", 3) == 0 && p[3] >= '1' && p[3] <= '9' &&
+           (memcmp(p + 4, "\x31\x41\x59\x26\x53\x59", 6) == 0 || memcmp(p + 4, "\x17\x72\x45\x38\x50\x90", 6) == 0);
+  };
+  if (in_size == 0) return {};
+  if (!stream_start(0)) return {{0, in_size}};
+
+  std::vector<std::pair<size_t, size_t>> streams;
+  size_t start = 0;
+  for (size_t pos = 1; pos + 10 <= in_size; ++pos) {
+    const void *b = memchr(in + pos, 'B', in_size - 10 - pos + 1);
+    if (!b) break;
+    pos = (const std::byte *)b - in;
+    if (stream_start(pos)) {
+      streams.push_back({start, pos - start});
+      start = pos;
+    }
+  }
+  streams.push_back({start, in_size - start});
+  return streams;
+}
+
+std::vector<std::pair<size_t, size_t>> splitZSTFrames(const std::byte *in, size_t in_size) {
+  auto read_u32 = [](const std::byte *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  };
+  const uint32_t SEEKABLE_MAGIC = 0x8F92EAB1;
+  const uint32_t SKIPPABLE_MAGIC_MASK = 0xFFFFFFF0, SKIPPABLE_MAGIC = 0x184D2A50;
+
+  std::vector<std::pair<size_t, size_t>> frames;
+  // the seek table footer: number of frames, descriptor, magic
+  if (in_size >= 17 && read_u32(in + in_size - 4) == SEEKABLE_MAGIC) {
+    const uint32_t num_frames = read_u32(in + in_size - 9);
+    const size_t entry_size = ((uint8_t)in[in_size - 5] & 0x80) ? 12 : 8;  // with checksums
+    const size_t table_size = 8 + (size_t)num_frames * entry_size + 9;
+    if (table_size <= in_size) {
+      const std::byte *entries = in + in_size - table_size + 8;
+      size_t offset = 0;
+      for (uint32_t i = 0; i < num_frames && offset <= in_size - table_size; ++i) {
+        const size_t size = read_u32(entries + i * entry_size);
+        frames.push_back({offset, size});
+        offset += size;
+      }
+      if (offset == in_size - table_size) return frames;
+    }
+    // it doesn't match the file, walk the frames instead
+    frames.clear();
+  }
+
+  for (size_t pos = 0; pos < in_size;) {
+    size_t size = ZSTD_findFrameCompressedSize(in + pos, in_size - pos);
+    if (ZSTD_isError(size)) {
+      // corrupt, it's decompressed as a whole and fails there
+      return {{0, in_size}};
+    }
+    if (in_size - pos < 4 || (read_u32(in + pos) & SKIPPABLE_MAGIC_MASK) != SKIPPABLE_MAGIC) {
+      frames.push_back({pos, size});
+    }
+    pos += size;
+  }
+  return frames;
 }
 
 void precise_nano_sleep(long sleep_ns) {
@@ -313,6 +534,16 @@ void precise_nano_sleep(long sleep_ns) {
   }
 }
 
+void precise_sleep_until(uint64_t ts) {
+#ifdef __linux__
+  struct timespec t = {.tv_sec = (time_t)(ts / 1000000000ULL), .tv_nsec = (long)(ts % 1000000000ULL)};
+  while (clock_nanosleep(CLOCK_BOOTTIME, TIMER_ABSTIME, &t, nullptr) == EINTR) {}
+#else
+  const int64_t sleep_ns = ts - nanos_since_boot();
+  if (sleep_ns > 0) precise_nano_sleep(sleep_ns);
+#endif
+}
+
 std::string sha256(const std::string &str) {
   unsigned char hash[SHA256_DIGEST_LENGTH];
   SHA256_CTX sha256;
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <functional>
 #include <string>
+#include <utility>
+#include <vector>
 
 enum class ReplyMsgType {
   Info,
@@ -22,13 +25,38 @@ void logMessage(ReplyMsgType type, const char* fmt, ...);
 
 std::string sha256(const std::string &str);
 void precise_nano_sleep(long sleep_ns);
+// sleeps until nanos_since_boot() is ts, in one absolute sleep where the clock has it
+void precise_sleep_until(uint64_t ts);
 std::string decompressBZ2(const std::string &in, std::atomic<bool> *abort = nullptr);
 std::string decompressBZ2(const std::byte *in, size_t in_size, std::atomic<bool> *abort = nullptr);
+std::string decompressZST(const std::string &in, std::atomic<bool> *abort = nullptr);
+
+// Streaming decompression, the output goes to a callback in pieces of piece_size as it's
+// produced, the last one may be shorter. Returns false if the input is corrupt or it's aborted.
+typedef std::function<void(std::string &&piece)> DecompressOutput;
+bool decompressBZ2(const std::byte *in, size_t in_size, const DecompressOutput &output,
+                   std::atomic<bool> *abort = nullptr, size_t piece_size = SIZE_MAX);
+bool decompressZST(const std::byte *in, size_t in_size, const DecompressOutput &output,
+                   std::atomic<bool> *abort = nullptr, size_t piece_size = SIZE_MAX);
+// The parts of a compressed file that decompress on their own, as offset and size: the
+// streams of a multi stream bzip2 file, the frames of a zstd file without its skippable
+// frames. The seek table of a zstd seekable file is used when it has one.
+std::vector<std::pair<size_t, size_t>> splitBZ2Streams(const std::byte *in, size_t in_size);
+std::vector<std::pair<size_t, size_t>> splitZSTFrames(const std::byte *in, size_t in_size);
 std::string getUrlWithoutQuery(const std::string &url);
 size_t getRemoteFileSize(const std::string &url, std::atomic<bool> *abort = nullptr);
 std::string httpGet(const std::string &url, size_t chunk_size = 0, std::atomic<bool> *abort = nullptr);
 
 typedef std::function<void(uint64_t cur, uint64_t total, bool success)> DownloadProgressHandler;
 void installDownloadProgressHandler(DownloadProgressHandler);
+
+// All downloads share a cap on connections and one on bandwidth, 0 for none. Downloads
+// waiting for a connection are served by priority: the ones at or after the focus first,
+// the nearest first, then the ones before it. Replay uses segment numbers as priorities
+// and the segment under the playhead as the focus.
+void setDownloadLimits(int max_connections, size_t max_bytes_per_sec);
+void setDownloadFocus(int priority);
+// for the downloads made from this thread, the lowest priority until it's set
+void setDownloadPriority(int priority);
 bool httpDownload(const std::string &url, const std::string &file, size_t chunk_size = 0, std::atomic<bool> *abort = nullptr);
 std::string formattedDataSize(size_t size);